@@ -36,6 +36,8 @@ import android.view.IRotationWatcher;
 import android.view.IWindowManager;
 import android.view.Surface;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.util.ArrayList;
 import java.util.Collections;
 import java.util.HashMap;
@@ -66,6 +68,16 @@ public class GestureManager
     /*-----------------------------------------------------------------------*/
 
     private static final int GESTURE_DISABLE = -1;
+
+    /* layout of the records filled by gestures_data_poll_batch(),
+     * must match gestures_record_t in the JNI layer */
+    private static final int GESTURE_RECORD_SIZE = 40;
+    private static final int GESTURE_RECORD_GESTURE = 0;
+    private static final int GESTURE_RECORD_STATUS = 4;
+    private static final int GESTURE_RECORD_TIMESTAMP = 8;
+    private static final int GESTURE_RECORD_VALUES = 16;
+    private static final int GESTURE_BATCH_SIZE = 64;
+    private static final int GESTURE_POLL_BLOCK = -1;
     private static boolean sGestureModuleInitialized = false;
     private static ArrayList<Gesture> sFullGestureList = new ArrayList<Gesture>();
     private static SparseArray<List<Gesture>> sGestureListByType = new SparseArray<List<Gesture>>();
@@ -131,8 +143,10 @@ public class GestureManager
             public void run() {
                 //Log.d(TAG, "entering main gesture thread");
                 final int[] values = new int[6];
-                final int[] status = new int[1];
                 final long timestamp[] = new long[1];
+                final ByteBuffer events = ByteBuffer.allocateDirect(
+                        GESTURE_BATCH_SIZE * GESTURE_RECORD_SIZE)
+                        .order(ByteOrder.nativeOrder());
                 Process.setThreadPriority(Process.THREAD_PRIORITY_URGENT_DISPLAY);
 
                 if (!open()) {
@@ -146,13 +160,13 @@ public class GestureManager
                 }
 
                 while (true) {
-                    // wait for an event
-                    final int gesture = gestures_data_poll(sQueue, values, status, timestamp);
+                    // wait for events, then drain up to GESTURE_BATCH_SIZE of them
+                    final int count = gestures_data_poll_batch(sQueue, events,
+                            GESTURE_BATCH_SIZE, GESTURE_POLL_BLOCK);
 
-                    int accuracy = status[0];
                     synchronized (sListeners) {
-                        if (gesture == -1 || sListeners.isEmpty()) {
-                            if (gesture == -1) {
+                        if (count == -1 || sListeners.isEmpty()) {
+                            if (count == -1) {
                                 // we lost the connection to the event stream. this happens
                                 // when the last listener is removed.
                                 Log.d(TAG, "_gestures_data_poll() failed, we bail out.");
@@ -164,8 +178,18 @@ public class GestureManager
                             mThread = null;
                             break;
                         }
-                        final Gesture gestureObject = sHandleToGesture.get(gesture);
-                        if (gestureObject != null) {
+                        for (int e = 0; e < count; e++) {
+                            final int base = e * GESTURE_RECORD_SIZE;
+                            final int gesture = events.getInt(base + GESTURE_RECORD_GESTURE);
+                            final Gesture gestureObject = sHandleToGesture.get(gesture);
+                            if (gestureObject == null) {
+                                continue;
+                            }
+                            final int accuracy = events.getInt(base + GESTURE_RECORD_STATUS);
+                            timestamp[0] = events.getLong(base + GESTURE_RECORD_TIMESTAMP);
+                            for (int v = 0; v < values.length; v++) {
+                                values[v] = events.getInt(base + GESTURE_RECORD_VALUES + 4 * v);
+                            }
                             // report the gesture event to all listeners that
                             // care about it.
                             final int size = sListeners.size();
@@ -527,5 +551,6 @@ public class GestureManager
     static native void gestures_destroy_queue(int queue);
     static native boolean gestures_enable_gesture(int queue, String name, int gesture, int enable);
     static native int gestures_data_poll(int queue, int[] values, int[] status, long[] timestamp);
+    static native int gestures_data_poll_batch(int queue, ByteBuffer events, int maxEvents, int timeoutMs);
 
 }
@@ -56,4 +56,4 @@ LOCAL_PRELINK_MODULE := false
 
 include $(BUILD_SHARED_LIBRARY)
 
-
+include $(LOCAL_PATH)/tests/Android.mk
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2008, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* the queue draining behind gestures_data_poll_batch, kept apart from the
+ * JNI glue so that it can be run on the host against a stand-in queue */
+
+#ifndef GESTURES_BATCH_H
+#define GESTURES_BATCH_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/poll.h>
+#include <sys/types.h>
+
+#include <android/sensor.h>
+#include <utils/Errors.h>
+
+/* layout of one record written by gestures_data_poll_batch, in native byte
+ * order. Must match GESTURE_RECORD_* in GestureManager.java */
+typedef struct {
+    int32_t         gesture;
+    int32_t         status;
+    int64_t         timestamp;
+    int32_t         values[6];
+} gestures_record_t;
+
+#define GESTURE_READ_CHUNK (16)
+
+/* drains up to max_events events from queue into rec, which holds at least
+ * that many records. Queue provides the read(), waitForEvent() and getFd()
+ * of SensorEventQueue.
+ * timeout_ms < 0 blocks until at least one event is available, 0 returns
+ * immediately and > 0 waits at most that many milliseconds.
+ * Returns the number of records written, 0 on timeout or -1 on error. */
+template <class Queue>
+static int gestures_drain(Queue& queue, gestures_record_t *rec,
+        int max_events, int timeout_ms)
+{
+    ASensorEvent events[GESTURE_READ_CHUNK];
+    ssize_t res;
+    int count = 0;
+
+    if (max_events <= 0)
+        return -1;
+
+    res = queue.read(events, GESTURE_READ_CHUNK < max_events ?
+                             GESTURE_READ_CHUNK : max_events);
+    if (res == -EAGAIN || res == 0) {
+        if (timeout_ms == 0)
+            return 0;
+        if (timeout_ms < 0) {
+            if (queue.waitForEvent() != android::NO_ERROR)
+                return -1;
+        } else {
+            struct pollfd pfd;
+            pfd.fd = queue.getFd();
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            int n = poll(&pfd, 1, timeout_ms);
+            if (n == 0)
+                return 0;
+            if (n < 0 || (pfd.revents & (POLLERR | POLLHUP)))
+                return -1;
+        }
+        res = 0;
+    }
+
+    while (res >= 0 && count < max_events) {
+        for (ssize_t i = 0; i < res; i++, rec++) {
+            rec->gesture = events[i].sensor;
+            rec->status = events[i].vector.status;
+            rec->timestamp = events[i].timestamp;
+            memcpy(rec->values, events[i].vector.v, sizeof(rec->values));
+        }
+        count += res;
+        if (count >= max_events)
+            break;
+        int want = max_events - count;
+        res = queue.read(events, GESTURE_READ_CHUNK < want ?
+                                 GESTURE_READ_CHUNK : want);
+        if (res == 0 || res == -EAGAIN)
+            break;
+    }
+    if (res < 0 && res != -EAGAIN && count == 0)
+        return -1;
+
+    return count;
+}
+
+#endif /* GESTURES_BATCH_H */
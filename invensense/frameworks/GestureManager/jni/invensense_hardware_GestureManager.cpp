@@ -45,6 +45,8 @@
 #include "jni.h"
 #include "JNIHelp.h"
 
+#include "gestures_batch.h"
+
 #undef  LOG_NDEBUG
 #define LOG_NDEBUG 0
 #define FUNC_LOG ALOGV("%s", __FUNCTION__)
@@ -264,6 +266,27 @@ gestures_data_poll(JNIEnv *env, jclass clazz, jint nativeQueue,
     return event.sensor;
 }
 
+/* drains up to max_events events from the queue into a direct ByteBuffer,
+ * see gestures_drain(). Returns the number of records written, 0 on
+ * timeout or -1 on error. */
+static jint
+gestures_data_poll_batch(JNIEnv *env, jclass clazz, jint nativeQueue,
+        jobject buffer, jint max_events, jint timeout_ms)
+{
+    sp<SensorEventQueue> queue(reinterpret_cast<SensorEventQueue *>(nativeQueue));
+    if (queue == 0) return -1;
+
+    gestures_record_t *rec =
+        (gestures_record_t *)env->GetDirectBufferAddress(buffer);
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (rec == NULL || capacity < (jlong)sizeof(gestures_record_t))
+        return -1;
+    if (max_events > capacity / (jlong)sizeof(gestures_record_t))
+        max_events = capacity / sizeof(gestures_record_t);
+
+    return gestures_drain(*queue, rec, max_events, timeout_ms);
+}
+
 static void
 nativeClassInit (JNIEnv *_env, jclass _this)
 {
@@ -288,6 +311,8 @@ static JNINativeMethod gMethods[] = {
                                             (void*)gestures_enable_gesture },
 
     {"gestures_data_poll",  "(I[I[I[J)I",     (void*)gestures_data_poll },
+    {"gestures_data_poll_batch", "(ILjava/nio/ByteBuffer;II)I",
+                                            (void*)gestures_data_poll_batch },
 };
 
 sp<IMplConnection> get_mpl_binder() {
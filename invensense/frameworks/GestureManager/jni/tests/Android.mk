@@ -0,0 +1,20 @@
+# Host built tests and benchmarks for the GestureManager JNI code, run as
+#   gestures_host_tests [--bench] [test ...]
+# from $(HOST_OUT_EXECUTABLES).
+LOCAL_PATH := $(call my-dir)/..
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := gestures_host_tests
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH) frameworks/native/include
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../../../../test-support
+
+LOCAL_SRC_FILES := tests/host_tests.c
+LOCAL_SRC_FILES += tests/test_batch.cpp
+
+LOCAL_STATIC_LIBRARIES := libhost_test
+LOCAL_LDLIBS := -lpthread -lrt
+
+include $(BUILD_HOST_EXECUTABLE)
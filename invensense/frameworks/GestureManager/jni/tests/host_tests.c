@@ -0,0 +1,26 @@
+/*
+ * Copyright 2008, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host_tests.h"
+
+/*****************************************************************************/
+
+const struct host_test host_tests[] = {
+    { "gestures_drain",         test_gestures_drain,    0 },
+    { "gestures_batch",         bench_gestures_drain,   1 },
+};
+
+const size_t host_test_count = sizeof(host_tests) / sizeof(host_tests[0]);
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2008, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host built tests and benchmarks for the GestureManager JNI code, listed
+ * in host_tests.c and run by the runner of test-support/host_test.h.
+ */
+
+#ifndef GESTURES_HOST_TESTS_H
+#define GESTURES_HOST_TESTS_H
+
+#include "host_test.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* gestures_batch.h */
+void test_gestures_drain(void);
+void bench_gestures_drain(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GESTURES_HOST_TESTS_H */
@@ -0,0 +1,256 @@
+/*
+ * Copyright 2008, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * gestures_drain() against stand-in event queues: one holding the events
+ * pushed to it, readable on a pipe while it is not empty, as the
+ * SensorEventQueue BitTube is, and one making up events as fast as they
+ * are read for the cost of the draining itself.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gestures_batch.h"
+
+#include "host_tests.h"
+
+/*****************************************************************************/
+
+#define QUEUE_SIZE      (256)
+
+class StandInQueue {
+public:
+    StandInQueue() : mHead(0), mCount(0), mError(0), mReads(0) {
+        pthread_mutex_init(&mLock, NULL);
+        if (pipe(mPipe) < 0)
+            mPipe[0] = mPipe[1] = -1;
+    }
+    ~StandInQueue() {
+        close(mPipe[0]);
+        close(mPipe[1]);
+        pthread_mutex_destroy(&mLock);
+    }
+
+    /* gesture g, values g * 10 + i, timestamp t. Gesture events carry six
+     * ints, so the fourth one overlays the status of the vector. */
+    void push(int g, int64_t t) {
+        ASensorEvent ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.sensor = g;
+        ev.timestamp = t;
+        for (int i = 0; i < 6; i++)
+            ((int32_t *)ev.data)[i] = g * 10 + i;
+        pthread_mutex_lock(&mLock);
+        if (mCount < QUEUE_SIZE) {
+            mEvents[(mHead + mCount) % QUEUE_SIZE] = ev;
+            if (mCount++ == 0)
+                write(mPipe[1], "e", 1);
+        }
+        pthread_mutex_unlock(&mLock);
+    }
+
+    /* later reads fail with err once the queue is empty */
+    void fail(ssize_t err) { mError = err; }
+
+    size_t pending() {
+        pthread_mutex_lock(&mLock);
+        size_t n = mCount;
+        pthread_mutex_unlock(&mLock);
+        return n;
+    }
+
+    int reads() const { return mReads; }
+
+    ssize_t read(ASensorEvent *events, size_t n) {
+        char c;
+        size_t i;
+
+        pthread_mutex_lock(&mLock);
+        mReads++;
+        for (i = 0; i < n && mCount > 0; i++, mCount--) {
+            events[i] = mEvents[mHead];
+            mHead = (mHead + 1) % QUEUE_SIZE;
+        }
+        if (i > 0 && mCount == 0)
+            ::read(mPipe[0], &c, 1);
+        pthread_mutex_unlock(&mLock);
+        if (i == 0)
+            return mError ? mError : -EAGAIN;
+        return i;
+    }
+
+    android::status_t waitForEvent() {
+        struct pollfd pfd;
+        pfd.fd = mPipe[0];
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        return poll(&pfd, 1, -1) == 1 ? android::NO_ERROR : -errno;
+    }
+
+    int getFd() const { return mPipe[0]; }
+
+private:
+    pthread_mutex_t mLock;
+    ASensorEvent mEvents[QUEUE_SIZE];
+    size_t mHead;
+    size_t mCount;
+    ssize_t mError;
+    int mReads;
+    int mPipe[2];
+};
+
+static bool record_matches(const gestures_record_t *rec, int g, int64_t t)
+{
+    if (rec->gesture != g || rec->status != (int8_t)(g * 10 + 3) ||
+        rec->timestamp != t)
+        return false;
+    for (int i = 0; i < 6; i++)
+        if (rec->values[i] != g * 10 + i)
+            return false;
+    return true;
+}
+
+static void *push_later(void *arg)
+{
+    StandInQueue *queue = (StandInQueue *)arg;
+    usleep(10000);
+    queue->push(7, 700);
+    return NULL;
+}
+
+void test_gestures_drain(void)
+{
+    gestures_record_t rec[64];
+    long long t0;
+    int i, n;
+
+    {
+        /* nothing queued: 0 at once, or after the timeout */
+        StandInQueue queue;
+        CHECK(gestures_drain(queue, rec, 64, 0) == 0);
+        t0 = host_test_now_ns();
+        CHECK(gestures_drain(queue, rec, 64, 20) == 0);
+        CHECK(host_test_now_ns() - t0 >= 15000000LL);
+        CHECK(gestures_drain(queue, rec, 0, 0) == -1);
+        CHECK(gestures_drain(queue, rec, -3, 0) == -1);
+    }
+    {
+        /* everything queued in one call, over several chunks */
+        StandInQueue queue;
+        for (i = 0; i < 40; i++)
+            queue.push(i + 1, 1000 + i);
+        n = gestures_drain(queue, rec, 64, 0);
+        CHECK(n == 40);
+        for (i = 0; i < n; i++)
+            CHECK(record_matches(&rec[i], i + 1, 1000 + i));
+        CHECK(queue.pending() == 0);
+        /* 16 + 16 + 8 and the read finding the queue empty */
+        CHECK(queue.reads() == 4);
+    }
+    {
+        /* at most max_events, the rest left for the next call */
+        StandInQueue queue;
+        for (i = 0; i < 40; i++)
+            queue.push(i + 1, 1000 + i);
+        CHECK(gestures_drain(queue, rec, 8, 0) == 8);
+        CHECK(queue.pending() == 32);
+        CHECK(record_matches(&rec[7], 8, 1007));
+        n = gestures_drain(queue, rec, 64, -1);
+        CHECK(n == 32);
+        CHECK(record_matches(&rec[0], 9, 1008));
+    }
+    {
+        /* blocking and timed waits return as soon as an event comes */
+        StandInQueue queue;
+        pthread_t thread;
+        pthread_create(&thread, NULL, push_later, &queue);
+        CHECK(gestures_drain(queue, rec, 64, -1) == 1);
+        CHECK(record_matches(&rec[0], 7, 700));
+        pthread_join(thread, NULL);
+
+        pthread_create(&thread, NULL, push_later, &queue);
+        t0 = host_test_now_ns();
+        CHECK(gestures_drain(queue, rec, 64, 1000) == 1);
+        CHECK(host_test_now_ns() - t0 < 500000000LL);
+        pthread_join(thread, NULL);
+    }
+    {
+        /* a broken queue is an error, unless events were read first */
+        StandInQueue queue;
+        queue.fail(-EPIPE);
+        CHECK(gestures_drain(queue, rec, 64, 0) == -1);
+        queue.push(3, 30);
+        queue.push(4, 40);
+        CHECK(gestures_drain(queue, rec, 64, 0) == 2);
+        CHECK(gestures_drain(queue, rec, 64, -1) == -1);
+    }
+}
+
+/*****************************************************************************/
+
+/* an endless stream of events, as from a gesture firing continuously */
+class StreamQueue {
+public:
+    StreamQueue() : mNext(0), mReads(0) {}
+
+    ssize_t read(ASensorEvent *events, size_t n) {
+        mReads++;
+        for (size_t i = 0; i < n; i++) {
+            events[i].sensor = mNext & 7;
+            events[i].timestamp = mNext++;
+            events[i].vector.status = 3;
+        }
+        return n;
+    }
+    android::status_t waitForEvent() { return android::NO_ERROR; }
+    int getFd() const { return -1; }
+
+    long long mNext;
+    long long mReads;
+};
+
+#define BENCH_EVENTS    (1 << 22)
+
+void bench_gestures_drain(void)
+{
+    static const int batches[] = { 1, 8, 64 };
+    static gestures_record_t rec[64];
+    volatile int64_t sink = 0;
+
+    for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+        StreamQueue queue;
+        int batch = batches[b];
+        long long calls = 0;
+        long long t0 = host_test_now_ns();
+
+        while (queue.mNext < BENCH_EVENTS) {
+            int n = gestures_drain(queue, rec, batch, -1);
+            sink += rec[n - 1].timestamp;
+            calls++;
+        }
+
+        long long ns = host_test_now_ns() - t0;
+        printf("    batch %2d: %.1f Mevents/s, %.1f ns/event, "
+               "%.2f reads/event, %lld calls\n",
+               batch, queue.mNext * 1e3 / ns, (double)ns / queue.mNext,
+               (double)queue.mReads / queue.mNext, calls);
+    }
+    (void)sink;
+}
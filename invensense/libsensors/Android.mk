@@ -60,6 +60,7 @@ endif
 LOCAL_SRC_FILES := SensorBase.cpp
 LOCAL_SRC_FILES += MPLSensor.cpp
 LOCAL_SRC_FILES += MPLSensorSysApi.cpp
+LOCAL_SRC_FILES += SensorTrace.cpp
 
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(SDK_LIB_FOLDER)/platform/include
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(SDK_LIB_FOLDER)/platform/include/linux
@@ -80,6 +81,9 @@ LOCAL_CPPFLAGS += -DLINUX=1
 LOCAL_CPPFLAGS += -DMPL_LIB_NAME=\"libmplmpu.so\"
 LOCAL_CPPFLAGS += -DAICHI_LIB_NAME=\"libami.so\"
 LOCAL_CPPFLAGS += -DAKM_LIB_NAME=\"libakmd.so\"
+ifneq ($(BOARD_SENSORS_NO_TRACE),true)
+LOCAL_CPPFLAGS += -DSENSOR_TRACE=1
+endif
 LOCAL_PRELINK_MODULE := false
 
 include $(BUILD_SHARED_LIBRARY)
@@ -105,6 +109,9 @@ LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(SDK_LIB_FOLDER)/mldmp
 LOCAL_PRELINK_MODULE := false
 LOCAL_MODULE_TAGS := optional
 LOCAL_CFLAGS := -DLOG_TAG=\"Sensors\"
+ifneq ($(BOARD_SENSORS_NO_TRACE),true)
+LOCAL_CFLAGS += -DSENSOR_TRACE=1
+endif
 ifeq ($(BOARD_HAVE_BMP180),true)
 LOCAL_CFLAGS += -DBOARD_HAVE_BMP180
 LOCAL_CFLAGS += -DBMP180_INPUT_NAME=\"$(BOARD_BMP180_INPUT_NAME)\"
@@ -140,34 +147,6 @@ LOCAL_MODULE_PATH := $(TARGET_OUT)/lib
 OVERRIDE_BUILT_MODULE_PATH := $(TARGET_OUT_INTERMEDIATE_LIBRARIES)
 include $(BUILD_PREBUILT)
 
-include $(CLEAR_VARS)
-LOCAL_MODULE := libmllite
-ifeq ($(MPU_NAME),MPU3050)
-LOCAL_SRC_FILES := libmllite3050.so
-else
-LOCAL_SRC_FILES := libmllite.so
-endif
-LOCAL_MODULE_TAGS := optional
-LOCAL_MODULE_SUFFIX := .so
-LOCAL_MODULE_CLASS := SHARED_LIBRARIES
-LOCAL_MODULE_PATH := $(TARGET_OUT)/lib
-OVERRIDE_BUILT_MODULE_PATH := $(TARGET_OUT_INTERMEDIATE_LIBRARIES)
-include $(BUILD_PREBUILT)
-
-include $(CLEAR_VARS)
-LOCAL_MODULE := libmlplatform
-ifeq ($(MPU_NAME),MPU3050)
-LOCAL_SRC_FILES := libmlplatform3050.so
-else
-LOCAL_SRC_FILES := libmlplatform.so
-endif
-LOCAL_MODULE_TAGS := optional
-LOCAL_MODULE_SUFFIX := .so
-LOCAL_MODULE_CLASS := SHARED_LIBRARIES
-LOCAL_MODULE_PATH := $(TARGET_OUT)/lib
-OVERRIDE_BUILT_MODULE_PATH := $(TARGET_OUT_INTERMEDIATE_LIBRARIES)
-include $(BUILD_PREBUILT)
-
 include $(CLEAR_VARS) 
 LOCAL_MODULE := libakmd 
 LOCAL_SRC_FILES := libakmd.so 
@@ -177,3 +156,9 @@ LOCAL_MODULE_CLASS := SHARED_LIBRARIES
 LOCAL_MODULE_PATH := $(TARGET_OUT)/lib 
 OVERRIDE_BUILT_MODULE_PATH := $(TARGET_OUT_INTERMEDIATE_LIBRARIES) 
 include $(BUILD_PREBUILT)
+
+include $(LOCAL_PATH)/tests/Android.mk
+
+# libmllite and libmlplatform, built from the MPL sources of the same tree
+# the HAL includes its headers from
+include $(LOCAL_PATH)/$(SDK_LIB_FOLDER)/Android.mk
@@ -37,8 +37,11 @@ LightSensor::LightSensor()
 {
     mPendingEvent[Light].sensor = ID_L;
     mPendingEvent[Light].type = SENSOR_TYPE_LIGHT;
+	for (int i = 0; i < numSensors; i++)
+		mSensors[i] = -1;
 	mSensors[Light] = ABS_X;
 	setSensors(mSensors);
+	mLatestOnly = true;
 }
 
 bool LightSensor::handleEvent(input_event const *event) {
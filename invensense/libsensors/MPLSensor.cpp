@@ -36,10 +36,12 @@
 #include <string.h>
 
 #include "MPLSensor.h"
+#include "SensorTrace.h"
 
 #include "math.h"
 #include "ml.h"
 #include "mlFIFO.h"
+#include "mlMathFuncVec.h"
 #include "mlsl.h"
 #include "mlos.h"
 #include "ml_mputest.h"
@@ -55,6 +57,7 @@
 
 extern "C" {
 #include "mlsupervisor.h"
+#include "compass_supervisor.h"
 }
 
 #include "mlcontrol.h"
@@ -87,6 +90,16 @@ void procData_cb_wrapper()
     }
 }
 
+int mplLock_trylock_wrapper(void *lock)
+{
+    return pthread_mutex_trylock((pthread_mutex_t *)lock);
+}
+
+void mplLock_unlock_wrapper(void *lock)
+{
+    pthread_mutex_unlock((pthread_mutex_t *)lock);
+}
+
 void setCallbackObject(MPLSensor* gbpt)
 {
     MPLSensor::gMPLSensor = gbpt;
@@ -216,7 +229,8 @@ MPLSensor::MPLSensor() : SensorBase(NULL, NULL),
                          mSampleCount(0),
                          mMplMutex(PTHREAD_MUTEX_INITIALIZER),
                          mEnabled(0),
-                         mPendingMask(0)
+                         mPendingMask(0),
+                         mDueMask(0)
 {
     VFUNC_LOG;
     inv_error_t rv;
@@ -228,10 +242,8 @@ MPLSensor::MPLSensor() : SensorBase(NULL, NULL),
 
     mForceSleep = false;
 
-    for (i = 0; i < (int)ARRAY_SIZE(mPollFds); i++) {
-        mPollFds[i].fd = -1;
-        mPollFds[i].events = 0;
-    }
+    if (IntMuxCreate(&mIrqMux) != INV_SUCCESS)
+        mIrqMux = NULL;
 
     pthread_mutex_lock(&mMplMutex);
 
@@ -242,8 +254,8 @@ MPLSensor::MPLSensor() : SensorBase(NULL, NULL),
         fcntl(mpu_int_fd, F_SETFL, O_NONBLOCK);
         //ioctl(mpu_int_fd, MPUIRQ_SET_TIMEOUT, 0);
         mIrqFds.add(MPUIRQ_FD, mpu_int_fd);
-        mPollFds[MPUIRQ_FD].fd = mpu_int_fd;
-        mPollFds[MPUIRQ_FD].events = POLLIN;
+        if (mIrqMux)
+            IntMuxAdd(mIrqMux, mpu_int_fd, MPUIRQ_FD);
     }
 
     accel_fd = open("/dev/accelirq", O_RDWR);
@@ -253,8 +265,8 @@ MPLSensor::MPLSensor() : SensorBase(NULL, NULL),
         fcntl(accel_fd, F_SETFL, O_NONBLOCK);
         //ioctl(accel_fd, SLAVEIRQ_SET_TIMEOUT, 0);
         mIrqFds.add(ACCELIRQ_FD, accel_fd);
-        mPollFds[ACCELIRQ_FD].fd = accel_fd;
-        mPollFds[ACCELIRQ_FD].events = POLLIN;
+        if (mIrqMux)
+            IntMuxAdd(mIrqMux, accel_fd, ACCELIRQ_FD);
     }
 
     timer_fd = open("/dev/timerirq", O_RDWR);
@@ -264,8 +276,8 @@ MPLSensor::MPLSensor() : SensorBase(NULL, NULL),
         fcntl(timer_fd, F_SETFL, O_NONBLOCK);
         //ioctl(timer_fd, TIMERIRQ_SET_TIMEOUT, 0);
         mIrqFds.add(TIMERIRQ_FD, timer_fd);
-        mPollFds[TIMERIRQ_FD].fd = timer_fd;
-        mPollFds[TIMERIRQ_FD].events = POLLIN;
+        if (mIrqMux)
+            IntMuxAdd(mIrqMux, timer_fd, TIMERIRQ_FD);
     }
 
     data_fd = mpu_int_fd;
@@ -277,6 +289,7 @@ MPLSensor::MPLSensor() : SensorBase(NULL, NULL),
     }
 
     memset(mPendingEvents, 0, sizeof(mPendingEvents));
+    memset(&mSnapshot, 0, sizeof(mSnapshot));
 
     mPendingEvents[RotationVector].version = sizeof(sensors_event_t);
     mPendingEvents[RotationVector].sensor = ID_RV;
@@ -325,8 +338,11 @@ MPLSensor::MPLSensor() : SensorBase(NULL, NULL),
     mHandlers[MagneticField] = &MPLSensor::compassHandler;
     mHandlers[Orientation] = &MPLSensor::orienHandler;
 
-    for (int i = 0; i < numSensors; i++)
+    for (int i = 0; i < numSensors; i++) {
         mDelays[i] = 30000000LLU; // 30 ms by default
+        mDecimation[i] = 1;
+        mDecimCount[i] = 0;
+    }
 
     if (inv_serial_start(port) != INV_SUCCESS) {
         ALOGE("Fatal Error : could not open MPL serial interface");
@@ -365,30 +381,28 @@ MPLSensor::~MPLSensor()
     if (inv_serial_stop() != INV_SUCCESS) {
         ALOGD("Error : could not close the serial port");
     }
+    if (mIrqMux)
+        IntMuxDestroy(mIrqMux);
     pthread_mutex_unlock(&mMplMutex);
 }
 
-/* clear any data from our various filehandles */
+/* clear any data from our various filehandles: every interrupt queued on
+   every device since the last call, in one epoll_wait() */
 void MPLSensor::clearIrqData(bool* irq_set)
 {
-    unsigned int i;
-    int nread;
-    struct mpuirq_data irqdata;
-
-    poll(mPollFds, ARRAY_SIZE(mPollFds), 0); //check which ones need to be cleared
-
-    for (i = 0; i < ARRAY_SIZE(mPollFds); i++) {
-        int cur_fd = mPollFds[i].fd;
-        int j = 0;
-        if (mPollFds[i].revents & POLLIN) {
-            nread = read(cur_fd, &irqdata, sizeof(irqdata));
-            if (nread > 0) {
-                irq_set[i] = true;
-                //ALOGV_IF(EXTRA_VERBOSE, "irq: %d %d (%d)", i, irqdata.interruptcount, j++);
-            }
+    struct int_irq_record irqs[INT_MUX_MAX_READ];
+    int i, n;
+
+    if (mIrqMux == NULL)
+        return;
+
+    do {
+        n = IntMuxProcess(mIrqMux, irqs, ARRAY_SIZE(irqs), 0);
+        for (i = 0; i < n; i++) {
+            irq_set[irqs[i].source] = true;
+            SENSOR_TRACE_IRQ(irqs[i].data.irqtime);
         }
-        mPollFds[i].revents = 0;
-    }
+    } while (n == (int)ARRAY_SIZE(irqs));
 }
 
 bool MPLSensor::needDMPStop() 
@@ -439,6 +453,33 @@ void MPLSensor::computeLocalSensorMask(int enabled_sensors)
     } while (0);
 }
 
+/* the fusion snapshot outputs read by the handlers of the enabled sensors */
+unsigned long MPLSensor::computeSnapshotMask(int enabled_sensors)
+{
+    unsigned long mask = 0;
+
+#if defined USE_TYPE_GYROSCOPE_COMPENSATED
+    if (GY_ENABLED)
+        mask |= INV_SNAPSHOT_GYRO;
+#else
+    if (GY_ENABLED)
+        mask |= INV_SNAPSHOT_GYRO_RAW;
+#endif
+    if (A_ENABLED)
+        mask |= INV_SNAPSHOT_ACCEL;
+    if (M_ENABLED)
+        mask |= INV_SNAPSHOT_MAGNETOMETER | INV_SNAPSHOT_COMPASS_ACCURACY;
+    if (RV_ENABLED)
+        mask |= INV_SNAPSHOT_QUATERNION | INV_SNAPSHOT_COMPASS_ACCURACY;
+    if (O_ENABLED)
+        mask |= INV_SNAPSHOT_ROTATION_MATRIX | INV_SNAPSHOT_COMPASS_ACCURACY;
+    if (GR_ENABLED)
+        mask |= INV_SNAPSHOT_GRAVITY;
+    if (LA_ENABLED)
+        mask |= INV_SNAPSHOT_LINEAR_ACCEL;
+    return mask;
+}
+
 /* set the power states of the various sensors based on the bits set in the
  * enabled_sensors parameter.
  * this function modifies globalish state variables.  It must be called with the mMplMutex held. */
@@ -459,6 +500,9 @@ void MPLSensor::setPowerStates(int enabled_sensors)
     /* record the new sensor state */
     sen_mask = mLocalSensorMask & mMasterSensorMask;
 
+    rv = inv_set_fusion_snapshot_mask(computeSnapshotMask(enabled_sensors));
+    ALOGE_IF(rv != INV_SUCCESS, "unable to set the fusion snapshot mask");
+
     changing_sensors = (
         (inv_get_dl_config()->inv_mpu_cfg->requested_sensors != sen_mask) 
             && (sen_mask != 0));
@@ -595,6 +639,13 @@ void MPLSensor::initMPL()
     ALOGE_IF(result != INV_SUCCESS,
             "Fatal Error : could not set enabled sensors.");
 
+    /* read the compass and pressure slaves off the FIFO path, serialized
+       with the FIFO processing by mMplMutex */
+    result = inv_set_compass_sampler(1, mplLock_trylock_wrapper,
+                                     mplLock_unlock_wrapper, &mMplMutex);
+    ALOGE_IF(result != INV_SUCCESS,
+            "could not enable the compass sampler (%d)", result);
+
     result = inv_load_calibration();
     if (result)
         ALOGV("Calibration file successfully loaded");
@@ -780,6 +831,19 @@ void MPLSensor::cbProcData()
     mNewData = 1;
     mSampleCount++;
     //ALOGV_IF(EXTRA_VERBOSE, "new data (%d)", sampleCount);
+
+    // called for every fifo packet by inv_update_data(), under mMplMutex;
+    // one wakeup may process several packets, so decimate here
+    for (int i = 0; i < numSensors; i++) {
+        if (!(mEnabled & (1 << i)))
+            continue;
+        if (mDecimCount[i]) {
+            mDecimCount[i]--;
+            continue;
+        }
+        mDecimCount[i] = mDecimation[i] - 1;
+        mDueMask |= (1 << i);
+    }
 }
 
 //these handlers transform mpl data into one of the Android sensor types
@@ -789,17 +853,18 @@ void MPLSensor::gyroHandler(sensors_event_t* s, uint32_t* pending_mask,
                              int index)
 {
     VFUNC_LOG;
-    inv_error_t res;
 #if defined USE_TYPE_GYROSCOPE_COMPENSATED
-    res = inv_get_gyro_float(s->gyro.v);
+    const float *gyro = mSnapshot.gyro;
+    unsigned long valid = mSnapshot.mask & INV_SNAPSHOT_GYRO;
 #else
-    res = inv_get_gyro_raw_float(s->gyro.v);
+    const float *gyro = mSnapshot.gyro_raw;
+    unsigned long valid = mSnapshot.mask & INV_SNAPSHOT_GYRO_RAW;
 #endif
-     s->gyro.v[0] = s->gyro.v[0] * M_PI / 180.0;
-     s->gyro.v[1] = s->gyro.v[1] * M_PI / 180.0;
-     s->gyro.v[2] = s->gyro.v[2] * M_PI / 180.0;
+     s->gyro.v[0] = gyro[0] * M_PI / 180.0;
+     s->gyro.v[1] = gyro[1] * M_PI / 180.0;
+     s->gyro.v[2] = gyro[2] * M_PI / 180.0;
     s->gyro.status = mMpuAccuracy;
-    if (res == INV_SUCCESS)
+    if (valid)
         *pending_mask |= (1 << index);
 }
 
@@ -807,41 +872,38 @@ void MPLSensor::accelHandler(sensors_event_t* s, uint32_t* pending_mask,
                               int index)
 {
     VFUNC_LOG;
-    inv_error_t res;
-    res = inv_get_accel_float(s->acceleration.v);
-    //res = inv_get_accel_float(s->acceleration.v);
-    s->acceleration.v[0] = s->acceleration.v[0] * 9.81;
-    s->acceleration.v[1] = s->acceleration.v[1] * 9.81;
-    s->acceleration.v[2] = s->acceleration.v[2] * 9.81;
+    s->acceleration.v[0] = mSnapshot.accel[0] * 9.81;
+    s->acceleration.v[1] = mSnapshot.accel[1] * 9.81;
+    s->acceleration.v[2] = mSnapshot.accel[2] * 9.81;
     //ALOGV_IF(EXTRA_VERBOSE, "accel data: %f %f %f", s->acceleration.v[0], s->acceleration.v[1], s->acceleration.v[2]);
     s->acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
-    if (res == INV_SUCCESS)
+    if (mSnapshot.mask & INV_SNAPSHOT_ACCEL)
         *pending_mask |= (1 << index);
 }
 
 int MPLSensor::estimateCompassAccuracy()
 {
-    int rv;
-    inv_error_t res = inv_get_compass_accuracy(&rv);
-    ALOGE_IF(res, "error returned from inv_get_compass_accuracy");
-    return rv;
+    if (!(mSnapshot.mask & INV_SNAPSHOT_COMPASS_ACCURACY)) {
+        ALOGE("no compass accuracy in the fusion snapshot");
+        return SENSOR_STATUS_UNRELIABLE;
+    }
+    return mSnapshot.compass_accuracy;
 }
 
 void MPLSensor::compassHandler(sensors_event_t* s, uint32_t* pending_mask,
                                int index)
 {
     VFUNC_LOG;
-    inv_error_t res, res2;
-    float bias_error[3];
-    float total_be;
-    static int bias_error_settled = 0;
+    bool valid = mSnapshot.mask & INV_SNAPSHOT_MAGNETOMETER;
 
-    res = inv_get_magnetometer_float(s->magnetic.v);
-    ALOGE_IF(res, "compass_handler inv_get_magnetometer_float returned %d", res);
+    ALOGE_IF(!valid, "compass_handler: no magnetometer in the fusion snapshot");
+    s->magnetic.v[0] = mSnapshot.magnetometer[0];
+    s->magnetic.v[1] = mSnapshot.magnetometer[1];
+    s->magnetic.v[2] = mSnapshot.magnetometer[2];
 
     s->magnetic.status = estimateCompassAccuracy();
 
-    if (res == INV_SUCCESS)
+    if (valid)
         *pending_mask |= (1 << index);
 }
 
@@ -850,29 +912,15 @@ void MPLSensor::rvHandler(sensors_event_t* s, uint32_t* pending_mask,
 {
     VFUNC_LOG;
     float quat[4];
-    float norm = 0;
-    float ang = 0;
-    inv_error_t r;
 
-    r = inv_get_quaternion_float(quat);
-    if (r) {
+    if (!(mSnapshot.mask & INV_SNAPSHOT_QUATERNION)) {
         *pending_mask &= ~(1 << index);
         return;
     } else {
         *pending_mask |= (1 << index);
     }
-
-    norm = quat[1] * quat[1] + quat[2] * quat[2] + quat[3] * quat[3]
-            + FLT_EPSILON;
-
-    if (norm > 1.0f) {
-        //renormalize
-        norm = sqrtf(norm);
-        float inv_norm = 1.0f / norm;
-        quat[1] = quat[1] * inv_norm;
-        quat[2] = quat[2] * inv_norm;
-        quat[3] = quat[3] * inv_norm;
-    }
+    /* the snapshot quaternion is already unit length */
+    memcpy(quat, mSnapshot.quat, sizeof(quat));
 
     if (quat[0] < 0.0) {
         quat[1] = -quat[1];
@@ -884,21 +932,20 @@ void MPLSensor::rvHandler(sensors_event_t* s, uint32_t* pending_mask,
     s->gyro.v[1] = quat[2];
     s->gyro.v[2] = quat[3];
 
-    s->gyro.status = ((mMpuAccuracy < estimateCompassAccuracy()) ? mMpuAccuracy
-                     : estimateCompassAccuracy());
+    int compass_accuracy = estimateCompassAccuracy();
+    s->gyro.status = ((mMpuAccuracy < compass_accuracy) ? mMpuAccuracy
+                     : compass_accuracy);
 }
 
 void MPLSensor::laHandler(sensors_event_t* s, uint32_t* pending_mask,
                           int index)
 {
     VFUNC_LOG;
-    inv_error_t res;
-    res = inv_get_float_array(INV_LINEAR_ACCELERATION, s->gyro.v);
-    s->gyro.v[0] *= 9.81;
-    s->gyro.v[1] *= 9.81;
-    s->gyro.v[2] *= 9.81;
+    s->gyro.v[0] = mSnapshot.linear_accel[0] * 9.81;
+    s->gyro.v[1] = mSnapshot.linear_accel[1] * 9.81;
+    s->gyro.v[2] = mSnapshot.linear_accel[2] * 9.81;
     s->gyro.status = mMpuAccuracy;
-    if (res == INV_SUCCESS)
+    if (mSnapshot.mask & INV_SNAPSHOT_LINEAR_ACCEL)
         *pending_mask |= (1 << index);
 }
 
@@ -906,16 +953,16 @@ void MPLSensor::gravHandler(sensors_event_t* s, uint32_t* pending_mask,
                             int index)
 {
     VFUNC_LOG;
-    inv_error_t res;
-    res = inv_get_float_array(INV_GRAVITY, s->gyro.v);
-    s->gyro.v[0] *= 9.81;
-    s->gyro.v[1] *= 9.81;
-    s->gyro.v[2] *= 9.81;
+    s->gyro.v[0] = mSnapshot.gravity[0] * 9.81;
+    s->gyro.v[1] = mSnapshot.gravity[1] * 9.81;
+    s->gyro.v[2] = mSnapshot.gravity[2] * 9.81;
     s->gyro.status = mMpuAccuracy;
-    if (res == INV_SUCCESS)
+    if (mSnapshot.mask & INV_SNAPSHOT_GRAVITY)
         *pending_mask |= (1 << index);
 }
 
+/* uses the polynomial atan2/asin approximations from mlMathFuncVec.h,
+   accurate to ~1e-5 rad, since this runs for every orientation event */
 void MPLSensor::calcOrientationSensor(float *R, float *values)
 {
     float tmp;
@@ -933,11 +980,11 @@ void MPLSensor::calcOrientationSensor(float *R, float *values)
 
     float eular[2][3];
 
-    eular[XYZ][Z_ANGLE] = atan2(R[3], R[0])*57.295779513082320876798154814105f;
+    eular[XYZ][Z_ANGLE] = inv_fast_atan2f(R[3], R[0])*57.295779513082320876798154814105f;
 
-    eular[YXZ][X_ANGLE] = asin(R[7])*57.295779513082320876798154814105f;
-    eular[YXZ][Y_ANGLE] = atan2(-R[6], R[8])*57.295779513082320876798154814105f;
-    eular[YXZ][Z_ANGLE] = atan2(-R[1], R[4])*57.295779513082320876798154814105f;
+    eular[YXZ][X_ANGLE] = inv_fast_asinf(R[7])*57.295779513082320876798154814105f;
+    eular[YXZ][Y_ANGLE] = inv_fast_atan2f(-R[6], R[8])*57.295779513082320876798154814105f;
+    eular[YXZ][Z_ANGLE] = inv_fast_atan2f(-R[1], R[4])*57.295779513082320876798154814105f;
 
     float a = fabs(eular[YXZ][X_ANGLE]/90);
     a = a*a;
@@ -988,7 +1035,7 @@ void MPLSensor::calcOrientationSensor(float *R, float *values)
         tmp = -1.0f;
     }    
 
-    values[1] = -asinf(tmp)*57.295779513082320876798154814105f;
+    values[1] = -inv_fast_asinf(tmp)*57.295779513082320876798154814105f;
     if (R[8] < 0) {
         values[1] = 180.0f-values[1];
     }
@@ -997,9 +1044,9 @@ void MPLSensor::calcOrientationSensor(float *R, float *values)
     }
     //Roll
     if ((fabs(R[7])>0.7071067f)) {
-        values[2] = (float) atan2f(R[6], R[7]);
+        values[2] = inv_fast_atan2f(R[6], R[7]);
     } else {
-        values[2] = (float) atan2f(R[6], R[8]);
+        values[2] = inv_fast_atan2f(R[6], R[8]);
     }
 
     values[2] *= 57.295779513082320876798154814105f;
@@ -1015,24 +1062,22 @@ void MPLSensor::orienHandler(sensors_event_t* s, uint32_t* pending_mask,
                              int index) // note that this is the handler for the android 'orientation' sensor, not the mpl orientation output
 {
     VFUNC_LOG;
-    inv_error_t res;
-    float euler[3];
-    float heading[1];
-    float rot_mat[9];
+    int compass_accuracy;
 
-    res = inv_get_float_array(INV_ROTATION_MATRIX, rot_mat);
+    if (!(mSnapshot.mask & INV_SNAPSHOT_ROTATION_MATRIX)) {
+        ALOGD("orien_handler: data not valid");
+        return;
+    }
 
     //ComputeAndOrientation(heading[0], euler, s->orientation.v);
-    calcOrientationSensor(rot_mat, s->orientation.v);
+    calcOrientationSensor(mSnapshot.rot_mat, s->orientation.v);
 
+    compass_accuracy = estimateCompassAccuracy();
     s->orientation.status
-            = ((mMpuAccuracy < estimateCompassAccuracy()) ? mMpuAccuracy
-                                                            : estimateCompassAccuracy());
+            = ((mMpuAccuracy < compass_accuracy) ? mMpuAccuracy
+                                                 : compass_accuracy);
 
-    if (res == INV_SUCCESS)
-        *pending_mask |= (1 << index);
-    else
-        ALOGD("orien_handler: data not valid (%d)", (int) res);
+    *pending_mask |= (1 << index);
 
 }
 
@@ -1174,35 +1219,58 @@ int MPLSensor::update_delay()
 
     if (mEnabled) {
         uint64_t wanted = -1LLU;
-        
-        // search the minimum delay requested across all enabled sensors
+        uint64_t minDelay = getMinDelayNs();
+
+        // the DMP runs at the rate of the fastest enabled sensor, the
+        // slower ones are decimated per packet in cbProcData()
         for (int i = 0; i < numSensors; i++) {
             if (mEnabled & (1 << i)) {
                 uint64_t ns = mDelays[i];
                 wanted = wanted < ns ? wanted : ns;
             }
         }
-        // Limit all rates to 100Hz max. => 10ms or 10000000ns
-        if (wanted < 10000000LLU) {
-            wanted = 10000000LLU;
+        if (wanted < minDelay) {
+            wanted = minDelay;
         }
 
         // mpu fifo rate is in increments of 5ms
-        int rate = (wanted / 5000000LLU) - ((wanted % 5000000LLU == 0) ? 1 : 0);
+        int rate = (wanted / MPL_FIFO_RATE_STEP_NS) -
+                   ((wanted % MPL_FIFO_RATE_STEP_NS == 0) ? 1 : 0);
         if (rate == 0) // disallow fifo rate 0
             rate = 1;
 
         adjustFifoRate(rate);
 
+        // events are never delivered slower than requested
+        uint64_t period = (uint64_t)(rate + 1) * MPL_FIFO_RATE_STEP_NS;
+        for (int i = 0; i < numSensors; i++) {
+            uint64_t ns = mDelays[i] < minDelay ? minDelay : mDelays[i];
+            uint32_t decim = ns / period;
+            if (decim == 0)
+                decim = 1;
+            if (rate != mCurFifoRate || decim != mDecimation[i])
+                mDecimCount[i] = 0;
+            mDecimation[i] = decim;
+        }
+
         if (rate != mCurFifoRate) {
             ALOGV("set fifo rate - divider : %d, delay : %llu ms (%.2f Hz)", 
                  rate, wanted / 1000000LL, 1000000000.f / wanted);
-            inv_error_t res = inv_dmp_stop();
-            ALOGE_IF(res != INV_SUCCESS, "error stopping the DMP");
-            res = inv_set_fifo_rate(rate);
-            ALOGE_IF(res != INV_SUCCESS, "error setting FIFO rate");
-            res = inv_dmp_start();
-            ALOGE_IF(res != INV_SUCCESS, "error re-starting the DMP");
+            inv_error_t res = INV_ERROR;
+            if (mDmpStarted) {
+                // the DMP picks the new divider up at the next packet
+                res = inv_set_fifo_rate(rate);
+                ALOGE_IF(res != INV_SUCCESS,
+                         "error updating FIFO rate, restarting the DMP");
+            }
+            if (res != INV_SUCCESS) {
+                res = inv_dmp_stop();
+                ALOGE_IF(res != INV_SUCCESS, "error stopping the DMP");
+                res = inv_set_fifo_rate(rate);
+                ALOGE_IF(res != INV_SUCCESS, "error setting FIFO rate");
+                res = inv_dmp_start();
+                ALOGE_IF(res != INV_SUCCESS, "error re-starting the DMP");
+            }
 
             mCurFifoRate = rate;
             rv = (res == INV_SUCCESS);
@@ -1256,10 +1324,12 @@ int MPLSensor::readEvents(sensors_event_t* data, int count)
     clearIrqData(irq_set);
 
     pthread_mutex_lock(&mMplMutex);
+    SENSOR_TRACE_MARK(Locked);
     if (mDmpStarted) {
         //ALOGV_IF(EXTRA_VERBOSE, "Update Data");
         rv = inv_update_data();
         ALOGE_IF(rv != INV_SUCCESS, "inv_update_data error (code %d)", (int) rv);
+        SENSOR_TRACE_MARK(Fifo);
     }
 
     else {
@@ -1277,13 +1347,20 @@ int MPLSensor::readEvents(sensors_event_t* data, int count)
     mNewData = 0;
     int64_t tt = now_ns();
     pthread_mutex_lock(&mMplMutex);
+    /* every handler reads the outputs of the last packet from here */
+    if (inv_get_fusion_snapshot(&mSnapshot) == INV_SUCCESS)
+        tt = mSnapshot.timestamp;
+    else
+        mSnapshot.mask = 0;
     for (int i = 0; i < numSensors; i++) {
-        if (mEnabled & (1 << i)) {
+        if (mEnabled & mDueMask & (1 << i)) {
             CALL_MEMBER_FN(this,mHandlers[i])(mPendingEvents + i,
                                               &mPendingMask, i);
             mPendingEvents[i].timestamp = tt;
         }
     }
+    mDueMask = 0;
+    SENSOR_TRACE_MARK(Handlers);
 
     for (int j = 0; count && mPendingMask && j < numSensors; j++) {
         if (mPendingMask & (1 << j)) {
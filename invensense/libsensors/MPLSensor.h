@@ -28,6 +28,8 @@
 #include "SensorBase.h"
 
 #include "ml.h"
+#include "mlFIFO.h"
+#include "int.h"
 
 /* comment this define to use raw (not bias compensated) gyro as 
    TYPE_GYROSCOPE */
@@ -40,6 +42,12 @@
 #define VFUNC_LOG ALOGV_IF(EXTRA_VERBOSE, "%s", __PRETTY_FUNCTION__)
 #define CALL_MEMBER_FN(pobject, ptrToMember) ((pobject)->*(ptrToMember))
 
+/* the DMP produces packets at 200Hz divided by (fifo rate + 1) */
+#define MPL_FIFO_RATE_STEP_NS  (5000000LL)
+/* fastest rate the HAL reports events at, unless a subclass overrides
+   getMinDelayNs() */
+#define MPL_MIN_DELAY_NS       (10000000LL)
+
 /*****************************************************************************/
 /** MPLSensor implementation which fits into the HAL example for crespo provided
  * * by Google.
@@ -88,11 +96,13 @@ public:
     virtual int enable(int32_t handle, int enabled);
     virtual int readEvents(sensors_event_t *data, int count);
     virtual void computeLocalSensorMask(int enabled_sensors);
+    unsigned long computeSnapshotMask(int enabled_sensors);
     virtual bool needDMPStop();
     virtual bool needStateChange(bool changing_sensors, bool restart) { return (changing_sensors || restart); }
     virtual void enableFeatures() { return; }
     virtual void shutdownFeatures() { return; }
     virtual void adjustFifoRate(int& rate) { return ; }
+    virtual int64_t getMinDelayNs() const { return MPL_MIN_DELAY_NS; }
     virtual int getFd() const;
     virtual int getAccelFd() const;
     virtual int getTimerFd() const;
@@ -140,7 +150,7 @@ protected:
     bool mUseTimerIrqAccel;
     bool mUsetimerIrqCompass;
     bool mUseTimerirq;
-    struct pollfd mPollFds[4];
+    struct int_mux *mIrqMux; // the irq devices below, by FILEHANDLES
     int mSampleCount;
     pthread_mutex_t mMplMutex;
     NineAxisSensorFusion nineAxisSF;
@@ -157,7 +167,11 @@ protected:
     uint32_t mPendingMask;
     sensors_event_t mPendingEvents[numSensors];
     uint64_t mDelays[numSensors];
+    uint32_t mDecimation[numSensors]; // fifo packets per event
+    uint32_t mDecimCount[numSensors]; // packets to skip before next event
+    uint32_t mDueMask; // sensors with an event due since the last readEvents
     hfunc_t mHandlers[numSensors];
+    struct inv_fusion_snapshot mSnapshot; // outputs of the last fifo packet
     bool mForceSleep;
     long int mOldEnabledMask;
     android::KeyedVector<int, int> mIrqFds;
@@ -40,12 +40,14 @@ PressureSensor::PressureSensor()
 #ifdef WITH_AMBIENT_TEMPERATURE
     mPendingEvent[Temperature].sensor = ID_T;
     mPendingEvent[Temperature].type = SENSOR_TYPE_AMBIENT_TEMPERATURE;
+#endif
+	for (int i = 0; i < numSensors; i++)
+		mSensors[i] = -1;
 #ifdef A4
 	mSensors[Pressure] = ABS_X;
 #else
 	mSensors[Pressure] = ABS_PRESSURE;
 #endif
-#endif
 #ifdef WITH_AMBIENT_TEMPERATURE
 #ifdef A4
 	mSensors[Temperature] = ABS_Y;
@@ -54,6 +56,7 @@ PressureSensor::PressureSensor()
 #endif
 #endif
 	setSensors(mSensors);
+	mLatestOnly = true;
 }
 
 bool PressureSensor::handleEvent(input_event const *event) {
@@ -27,6 +27,9 @@
 
 #include "SamsungSensorBase.h"
 
+/* input events read per fill */
+#define INPUT_READER_EVENTS 32
+
 char *SamsungSensorBase::makeSysfsName(const char *input_name,
                                        const char *file_name) {
     char *name;
@@ -60,7 +63,12 @@ SamsungSensorBase::SamsungSensorBase(const char *dev_name,
     : SensorBase(dev_name, data_name),
       mEnabled(true),
       mHasPendingEvent(false),
-      mInputReader(4),
+      mLatestOnly(false),
+      mFrameMask(0),
+      mReadyMask(0),
+      mInputReader(INPUT_READER_EVENTS),
+      mInputSysfsEnable(NULL),
+      mInputSysfsPollDelay(NULL),
 	  mSensorCode(sensor_code),
       mLock(PTHREAD_MUTEX_INITIALIZER)
 {
@@ -69,7 +77,7 @@ SamsungSensorBase::SamsungSensorBase(const char *dev_name,
 		memset(mPendingEvent[i].data, 0, sizeof(mPendingEvent[i].data));
 	}
  
-    if (!data_fd)
+    if (data_fd < 0)
         return;
     mInputSysfsEnable = makeSysfsName(input_name, "enable");
     if (!mInputSysfsEnable) {
@@ -146,49 +154,91 @@ done:
     return result;
 }
 
+bool SamsungSensorBase::hasPendingEvents() const {
+    return mHasPendingEvent;
+}
+
+/* copy the completed frames out, as many as fit in count */
+int SamsungSensorBase::flushReady(sensors_event_t* data, int count)
+{
+    int numEventReceived = 0;
+
+    for (int i = 0; i < numSensors && numEventReceived < count; i++) {
+        if (mReadyMask & (1 << i)) {
+            *data++ = mFrameEvent[i];
+            numEventReceived++;
+            mReadyMask &= ~(1 << i);
+        }
+    }
+    return numEventReceived;
+}
+
+/*
+ * ABS values are accumulated into mPendingEvent until the driver closes the
+ * frame with SYN_REPORT, then one event per updated sensor is copied to
+ * mFrameEvent and returned with the time of the frame.  With mLatestOnly,
+ * only the last frame of the events read in this call is returned.  Frames
+ * that did not fit in count are returned by the next call.  A burst is
+ * collapsed one reader fill at a time, so that a fast stream cannot keep
+ * the poll thread in here.
+ * Only readEvents() touches the reader state, from the poll thread, so
+ * mLock is just taken to sample mEnabled.
+ */
 int SamsungSensorBase::readEvents(sensors_event_t* data, int count)
 {
     if (count < 1)
         return -EINVAL;
 
     pthread_mutex_lock(&mLock);
-    int numEventReceived = 0;
+    bool enabled = mEnabled;
+    pthread_mutex_unlock(&mLock);
 
-    if (mHasPendingEvent) {
-        mHasPendingEvent = false;
-        if (mEnabled) {
-			if (mSensorCode == NULL)
-				return 0;
-			for (int i = 0; numSensors; i++) {
-				mPendingEvent[i].timestamp = getTimestamp();
-				*data++ = mPendingEvent[i];
-				numEventReceived++;
-			}
-        }
-        goto done;
+    if (mSensorCode == NULL)
+        return 0;
+    if (!enabled)
+        mReadyMask = 0;
+
+    int numEventReceived = flushReady(data, count);
+    if (mReadyMask) {
+        mHasPendingEvent = true;
+        return numEventReceived;
     }
 
     input_event const* event;
-    while (count && mInputReader.readEvent(data_fd, &event)) {
+    int numEventRead = 0;
+    while (numEventReceived < count &&
+           mInputReader.readEvent(data_fd, &event)) {
         if (event->type == EV_ABS) {
-			if (mSensorCode == NULL)
-					return 0;
-			for (int i = 0; i < numSensors; i++) {
-				if (event->code == mSensorCode[i]) {
-					if (mEnabled && handleEvent(event)) {
-						mPendingEvent[i].timestamp = timevalToNano(event->time);
-						*data++ = mPendingEvent[i];
-						count--;
-						numEventReceived++;
-					}
-				}
-			} 
-		}
+            for (int i = 0; i < numSensors; i++) {
+                if (event->code == mSensorCode[i] &&
+                    enabled && handleEvent(event)) {
+                    mFrameMask |= 1 << i;
+                }
+            }
+        } else if (event->type == EV_SYN && event->code == SYN_REPORT) {
+            int64_t time = timevalToNano(event->time);
+            for (int i = 0; i < numSensors; i++) {
+                if (mFrameMask & (1 << i)) {
+                    mPendingEvent[i].timestamp = time;
+                    mFrameEvent[i] = mPendingEvent[i];
+                }
+            }
+            mReadyMask |= mFrameMask;
+            mFrameMask = 0;
+            if (!mLatestOnly) {
+                numEventReceived += flushReady(data + numEventReceived,
+                                               count - numEventReceived);
+            }
+        }
         mInputReader.next();
+        if (++numEventRead >= INPUT_READER_EVENTS && mReadyMask)
+            break;
+    }
+    if (mLatestOnly) {
+        numEventReceived += flushReady(data + numEventReceived,
+                                       count - numEventReceived);
     }
 
-done:
-    pthread_mutex_unlock(&mLock);
+    mHasPendingEvent = (mReadyMask != 0);
     return numEventReceived;
-
 }
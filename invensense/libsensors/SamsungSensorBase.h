@@ -42,8 +42,12 @@ public:
 protected:
     bool mEnabled;
     bool mHasPendingEvent;
+    bool mLatestOnly;       /* return only the last frame of a burst */
+    uint32_t mFrameMask;    /* sensors updated since the last SYN_REPORT */
+    uint32_t mReadyMask;    /* sensors with a frame not returned yet */
     InputEventCircularReader mInputReader;
     sensors_event_t mPendingEvent[numSensors];
+    sensors_event_t mFrameEvent[numSensors];    /* last complete frame */
     char *mInputSysfsEnable;
     char *mInputSysfsPollDelay;
     int *mSensorCode;
@@ -54,6 +58,7 @@ protected:
 
     virtual int handleEnable(int en);
     virtual bool handleEvent(input_event const * event);
+    int flushReady(sensors_event_t* data, int count);
 
 public:
     SamsungSensorBase(const char* dev_name,
@@ -64,6 +69,7 @@ public:
     virtual int enable(int32_t handle, int en);
     virtual int setDelay(int32_t handle, int64_t ns);
     virtual int readEvents(sensors_event_t *data, int count);
+    virtual bool hasPendingEvents() const;
 	void setSensors(int *sensor_code);
 };
 #endif /* SAMSUNG_SENSORBASE_H */
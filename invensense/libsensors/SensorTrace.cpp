@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "SensorTrace.h"
+
+/*****************************************************************************/
+
+struct TraceRecord {
+    int32_t sensor;
+    int64_t stage[SensorTrace::numStages];
+};
+
+struct TraceThread {
+    int64_t stage[SensorTrace::numStages];  /* frame being traced */
+    pthread_mutex_t lock;                   /* ring, against the dump */
+    TraceRecord ring[SENSOR_TRACE_RING_SIZE];
+    unsigned int head;
+    unsigned int count;
+    TraceThread *next;
+};
+
+static const char *sStageNames[SensorTrace::numStages] = {
+    "irq", "wake", "lock", "fifo", "handlers", "copy",
+};
+
+volatile int SensorTrace::sEnabled = 0;
+
+static pthread_once_t sTraceOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t sTraceKey;
+static pthread_mutex_t sTraceLock = PTHREAD_MUTEX_INITIALIZER;
+static TraceThread *sTraceThreads;      /* every ring, under sTraceLock */
+static int64_t sNextPropertyCheck;
+static char sProperty[PROPERTY_VALUE_MAX];
+
+static int64_t trace_now(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void trace_init_key()
+{
+    pthread_key_create(&sTraceKey, NULL);
+}
+
+/* the rings are kept on thread exit so that their samples can be dumped */
+static TraceThread *trace_thread()
+{
+    pthread_once(&sTraceOnce, trace_init_key);
+    TraceThread *t = (TraceThread *) pthread_getspecific(sTraceKey);
+    if (t == NULL) {
+        t = (TraceThread *) calloc(1, sizeof(*t));
+        if (t == NULL)
+            return NULL;
+        pthread_mutex_init(&t->lock, NULL);
+        pthread_setspecific(sTraceKey, t);
+        pthread_mutex_lock(&sTraceLock);
+        t->next = sTraceThreads;
+        sTraceThreads = t;
+        pthread_mutex_unlock(&sTraceLock);
+    }
+    return t;
+}
+
+void SensorTrace::mark(int stage)
+{
+    TraceThread *t = trace_thread();
+    if (t == NULL)
+        return;
+    /* a wakeup starts a new frame */
+    if (stage == PollWake)
+        memset(t->stage, 0, sizeof(t->stage));
+    t->stage[stage] = trace_now(CLOCK_MONOTONIC);
+}
+
+/*
+ * The mpuirq and timerirq drivers stamp interrupts with do_gettimeofday(),
+ * encoded as (tv_sec << 32) + tv_usec; move it to CLOCK_MONOTONIC.
+ */
+void SensorTrace::markIrq(uint64_t irqtime)
+{
+    TraceThread *t = trace_thread();
+    if (t == NULL || irqtime == 0)
+        return;
+    int64_t real = (int64_t) (irqtime >> 32) * 1000000000 +
+        (int64_t) (irqtime & 0xffffffff) * 1000;
+    t->stage[Irq] = trace_now(CLOCK_MONOTONIC) -
+        (trace_now(CLOCK_REALTIME) - real);
+}
+
+/*
+ * One record per event read, then a new frame: the events left over from
+ * an earlier read only get the stages marked since.
+ */
+void SensorTrace::commit(const sensors_event_t *data, int count)
+{
+    TraceThread *t = trace_thread();
+    if (t == NULL || count <= 0)
+        return;
+    t->stage[CopyOut] = trace_now(CLOCK_MONOTONIC);
+
+    pthread_mutex_lock(&t->lock);
+    for (int i = 0; i < count; i++) {
+        TraceRecord *r = &t->ring[t->head];
+        r->sensor = data[i].sensor;
+        memcpy(r->stage, t->stage, sizeof(r->stage));
+        t->head = (t->head + 1) % SENSOR_TRACE_RING_SIZE;
+        if (t->count < SENSOR_TRACE_RING_SIZE)
+            t->count++;
+    }
+    pthread_mutex_unlock(&t->lock);
+    memset(t->stage, 0, sizeof(t->stage));
+}
+
+/* called from every pollEvents(), reads the property once a second */
+void SensorTrace::checkProperty()
+{
+    char value[PROPERTY_VALUE_MAX];
+    int64_t now = trace_now(CLOCK_MONOTONIC);
+
+    if (now < sNextPropertyCheck)
+        return;
+    sNextPropertyCheck = now + 1000000000LL;
+
+    property_get(SENSOR_TRACE_PROPERTY, value, "0");
+    sEnabled = strcmp(value, "0") != 0;
+    if (strcmp(value, sProperty) == 0)
+        return;
+    strcpy(sProperty, value);
+
+    if (strcmp(value, "log") == 0) {
+        dump(-1);
+    } else if (value[0] == '/') {
+        int fd = open(value, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            ALOGE("SensorTrace: cannot open %s (%s)", value, strerror(errno));
+            return;
+        }
+        dump(fd);
+        if (close(fd) < 0)
+            ALOGE("SensorTrace: cannot write %s (%s)", value, strerror(errno));
+    }
+}
+
+static int compare_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a;
+    int64_t y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/* one line to the log, or to fd; -1 when it cannot be written */
+static int trace_print(int fd, const char *line)
+{
+    char buf[130];
+    int len;
+    int done = 0;
+
+    if (fd < 0) {
+        ALOGI("%s", line);
+        return 0;
+    }
+    len = snprintf(buf, sizeof(buf), "%s\n", line);
+    if (len >= (int) sizeof(buf))
+        len = sizeof(buf) - 1;
+    while (done < len) {
+        ssize_t n = write(fd, buf + done, len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            ALOGE("SensorTrace: dump write failed (%s)",
+                  n < 0 ? strerror(errno) : "short write");
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+/* percentiles, in us, of n samples; sorts them */
+static int trace_print_stat(int fd, const char *name, int64_t *v, int n)
+{
+    char line[128];
+
+    if (n == 0)
+        return 0;
+    qsort(v, n, sizeof(*v), compare_int64);
+    snprintf(line, sizeof(line),
+             "  %-14s n=%-4d p50=%lldus p90=%lldus p99=%lldus max=%lldus",
+             name, n,
+             (long long) v[n * 50 / 100] / 1000,
+             (long long) v[n * 90 / 100] / 1000,
+             (long long) v[n * 99 / 100] / 1000,
+             (long long) v[n - 1] / 1000);
+    return trace_print(fd, line);
+}
+
+static void trace_unlock_all()
+{
+    for (TraceThread *t = sTraceThreads; t; t = t->next)
+        pthread_mutex_unlock(&t->lock);
+    pthread_mutex_unlock(&sTraceLock);
+}
+
+/*
+ * Percentiles of every stage, measured from the previous recorded stage,
+ * and of the whole pipeline, per sensor handle.  The rings are locked for
+ * the whole dump, so that the threads tracing wait rather than overwrite
+ * the records being read.
+ */
+void SensorTrace::dump(int fd)
+{
+    int total = 0;
+    int err = 0;
+    char line[128];
+
+    pthread_mutex_lock(&sTraceLock);
+    for (TraceThread *t = sTraceThreads; t; t = t->next) {
+        pthread_mutex_lock(&t->lock);
+        total += t->count;
+    }
+
+    int64_t *v = (int64_t *) malloc(sizeof(*v) * (total ? total : 1));
+    if (v == NULL) {
+        trace_unlock_all();
+        return;
+    }
+
+    snprintf(line, sizeof(line), "sensor latency trace, %d events", total);
+    err = trace_print(fd, line);
+    for (int sensor = 0; !err && sensor < SENSOR_TRACE_MAX_SENSOR; sensor++) {
+        bool found = false;
+        /* the irq stage has no previous stage, start at the next one */
+        for (int stage = Irq + 1; !err && stage <= numStages; stage++) {
+            int n = 0;
+            for (TraceThread *t = sTraceThreads; t; t = t->next) {
+                for (unsigned int i = 0; i < t->count; i++) {
+                    const TraceRecord *r = &t->ring[i];
+                    int first = 0;
+                    int prev;
+
+                    if (r->sensor != sensor)
+                        continue;
+                    while (first < CopyOut && r->stage[first] == 0)
+                        first++;
+                    if (stage == numStages) {
+                        /* whole pipeline, of the events with a start */
+                        if (first < CopyOut)
+                            v[n++] = r->stage[CopyOut] - r->stage[first];
+                        continue;
+                    }
+                    if (stage <= first || r->stage[stage] == 0)
+                        continue;
+                    prev = stage - 1;
+                    while (r->stage[prev] == 0)
+                        prev--;
+                    v[n++] = r->stage[stage] - r->stage[prev];
+                }
+            }
+            if (n == 0)
+                continue;
+            if (!found) {
+                snprintf(line, sizeof(line), "sensor %d", sensor);
+                if ((err = trace_print(fd, line)))
+                    break;
+                found = true;
+            }
+            err = trace_print_stat(fd, stage == numStages ? "total" :
+                                   sStageNames[stage], v, n);
+        }
+    }
+    free(v);
+    trace_unlock_all();
+}
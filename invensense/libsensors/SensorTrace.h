@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_TRACE_H
+#define ANDROID_SENSOR_TRACE_H
+
+#include <stdint.h>
+#include <hardware/sensors.h>
+
+/*****************************************************************************/
+
+/*
+ * Latency tracing of the sensor pipeline, from the interrupt to the event
+ * returned by pollEvents().  Each stage is time stamped into a per-thread
+ * frame; the events of one readEvents() commit the frame into a per-thread
+ * ring, one record each, and the frame is cleared for the next read.
+ *
+ * Built in with -DSENSOR_TRACE=1 and turned on at runtime with the
+ * debug.sensors.trace property:
+ *      0           off (default)
+ *      1           record
+ *      log         record, and dump the percentiles to the log
+ *      <path>      record, and dump the percentiles to the file <path>
+ * A dump is done once each time the property changes to log or a path.
+ * When built in but off, each trace point costs a load and a branch.
+ */
+#define SENSOR_TRACE_PROPERTY   "debug.sensors.trace"
+#define SENSOR_TRACE_RING_SIZE  512
+#define SENSOR_TRACE_MAX_SENSOR 32
+
+class SensorTrace {
+public:
+    enum {
+        Irq,            /* driver interrupt time stamp */
+        PollWake,       /* poll() returned in pollEvents */
+        Locked,         /* mMplMutex acquired in readEvents */
+        Fifo,           /* inv_update_data() done */
+        Handlers,       /* per-sensor handlers done */
+        CopyOut,        /* event copied to the caller */
+        numStages,
+    };
+
+    static volatile int sEnabled;
+
+    static void mark(int stage);
+    static void markIrq(uint64_t irqtime);
+    static void commit(const sensors_event_t *data, int count);
+    static void checkProperty();
+    static void dump(int fd);
+};
+
+#if defined(SENSOR_TRACE) && SENSOR_TRACE
+#define SENSOR_TRACE_MARK(stage) \
+    do { if (SensorTrace::sEnabled) SensorTrace::mark(SensorTrace::stage); } while (0)
+#define SENSOR_TRACE_IRQ(irqtime) \
+    do { if (SensorTrace::sEnabled) SensorTrace::markIrq(irqtime); } while (0)
+#define SENSOR_TRACE_COMMIT(data, count) \
+    do { if (SensorTrace::sEnabled) SensorTrace::commit(data, count); } while (0)
+#define SENSOR_TRACE_CHECK() SensorTrace::checkProperty()
+#else
+#define SENSOR_TRACE_MARK(stage)        do { } while (0)
+#define SENSOR_TRACE_IRQ(irqtime)       do { } while (0)
+#define SENSOR_TRACE_COMMIT(data, count) do { } while (0)
+#define SENSOR_TRACE_CHECK()            do { } while (0)
+#endif
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_TRACE_H
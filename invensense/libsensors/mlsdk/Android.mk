@@ -1,7 +1,12 @@
 # Android.mk for building InvenSense MPL as part of the Android source tree
+# Included by ../Android.mk; libmplmpu itself is a prebuilt declared there.
 LOCAL_PATH := $(call my-dir)
 
-MPL_LIB_NAME = libmplmpu
+# the MPU the HAL is built for, see ../Android.mk
+MPL_DEVICE := $(MPU_NAME)
+ifeq ($(MPL_DEVICE),)
+MPL_DEVICE := MPU6050B1
+endif
 
 #### MLPLATFORM build ##########################################################
 include $(CLEAR_VARS)
@@ -20,7 +25,8 @@ LOCAL_CFLAGS += -I$(LOCAL_PATH)/$(MLPLATFORM_DIR)
 LOCAL_CFLAGS += -I$(LOCAL_PATH)/$(MLPLATFORM_DIR)/kernel
 LOCAL_CFLAGS += -I$(LOCAL_PATH)/$(MLSDK_ROOT)/mllite
 
-LOCAL_SRC_FILES := $(MLPLATFORM_DIR)/mlos_linux.c
+LOCAL_SRC_FILES := $(MLPLATFORM_DIR)/int_linux.c
+LOCAL_SRC_FILES += $(MLPLATFORM_DIR)/mlos_linux.c
 LOCAL_SRC_FILES += $(MLPLATFORM_DIR)/mlsl_linux_mpu.c
 
 LOCAL_SHARED_LIBRARIES := liblog libm libutils libcutils
@@ -41,7 +47,8 @@ MLLITE_DIR = $(MLSDK_ROOT)/mllite
 MPL_DIR = $(MLSDK_ROOT)/mldmp
 
 LOCAL_CFLAGS += -D_REENTRANT -DLINUX -DANDROID
-LOCAL_CFLAGS += -DCONFIG_MPU_SENSORS_$(DEVICE)
+LOCAL_CFLAGS += -DCONFIG_MPU_SENSORS_$(MPL_DEVICE)
+LOCAL_CFLAGS += -DINV_CACHE_DMP=1
 LOCAL_CFLAGS += -DUNICODE -D_UNICODE -DSK_RELEASE
 LOCAL_CFLAGS += -DI2CDEV=\"/dev/mpu\"
 LOCAL_CFLAGS += -I$(LOCAL_PATH)/$(MPL_DIR) 
@@ -68,9 +75,15 @@ LOCAL_SRC_FILES += $(MLLITE_DIR)/mlarray_lite.c
 LOCAL_SRC_FILES += $(MLLITE_DIR)/mlarray_adv.c
 LOCAL_SRC_FILES += $(MLLITE_DIR)/mlarray_legacy.c
 LOCAL_SRC_FILES += $(MLLITE_DIR)/mlBiasNoMotion.c
+LOCAL_SRC_FILES += $(MLLITE_DIR)/mlcbtable.c
 LOCAL_SRC_FILES += $(MLLITE_DIR)/mlFIFO.c
 LOCAL_SRC_FILES += $(MLLITE_DIR)/mlFIFOHW.c
 LOCAL_SRC_FILES += $(MLLITE_DIR)/mlMathFunc.c
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+    LOCAL_SRC_FILES += $(MLLITE_DIR)/mlMathFuncVec.c.neon
+else
+    LOCAL_SRC_FILES += $(MLLITE_DIR)/mlMathFuncVec.c
+endif
 LOCAL_SRC_FILES += $(MLLITE_DIR)/mlcontrol.c
 LOCAL_SRC_FILES += $(MLLITE_DIR)/mldl.c
 LOCAL_SRC_FILES += $(MLLITE_DIR)/mldmp.c
@@ -88,33 +101,8 @@ LOCAL_SRC_FILES += $(MLSDK_ROOT)/mlutils/checksum.c
 LOCAL_SRC_FILES += $(MLLITE_DIR)/ml_mputest.c
 LOCAL_SRC_FILES += $(MLSDK_ROOT)/mlutils/mputest.c
 LOCAL_SRC_FILES += $(MLLITE_DIR)/mldl_print_cfg.c
-ifneq ($(DEVICE),MPU3050)
-    LOCAL_SRC_FILES += $(MLLITE_DIR)/accel/mpu6050.c
-endif
 
 LOCAL_SHARED_LIBRARIES := libm libutils libcutils liblog libmlplatform
 LOCAL_PRELINK_MODULE := false
 
 include $(BUILD_SHARED_LIBRARY)
-
-### MPLMPU build ##############################################################
-# to make an .so from our .a statically build library
-
-MPL_LIB_NAME = $(MPL_LIB_NAME)
-
-include $(CLEAR_VARS)
-
-LOCAL_MODULE := $(MPL_LIB_NAME)
-LOCAL_MODULE_TAGS := optional
-
-LOCAL_SRC_FILES := mlsdk/mldmp/mpl/android/$(MPL_LIB_NAME).a
-LOCAL_SHARED_LIBRARIES := libm libutils libcutils liblog libmlplatform libmllite
-
-LOCAL_WHOLE_STATIC_LIBRARIES := $(MPL_LIB_NAME)
-
-LOCAL_PREBUILT_LIBS := mlsdk/mldmp/mpl/android/$(MPL_LIB_NAME).a
-LOCAL_PRELINK_MODULE := false
-
-include $(BUILD_SHARED_LIBRARY)
-include $(BUILD_MULTI_PREBUILT)
-
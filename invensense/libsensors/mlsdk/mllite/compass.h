@@ -35,6 +35,7 @@ extern "C" {
     /* --------------------- */
 
     unsigned char inv_compass_present(void);
+    unsigned char inv_compass_read_on_bus(void);
     unsigned char inv_get_compass_slave_addr(void);
     inv_error_t inv_get_compass_data(long *data);
     inv_error_t inv_set_compass_bias(struct compass_obj_t *obj, long *bias);
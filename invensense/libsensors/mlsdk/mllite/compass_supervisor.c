@@ -16,8 +16,11 @@
 #include "mlMathFunc.h"
 #include "mlFIFO.h"
 #include "mlos.h"
+#include "mlcbtable.h"
 #include "compass.h"
+#include "pressure.h"
 #include "mldl.h"
+#include "mlstates.h"
 
 #include "log.h"
 #undef MPL_LOG_TAG
@@ -29,24 +32,51 @@
 typedef inv_error_t (*inv_compass_cb_t)(struct compass_obj_t *obj);
 
 inv_error_t inv_try_compass(int *got_data);
+static inv_error_t inv_compass_sampler_state_cb(unsigned char newState);
+static inv_error_t inv_stop_compass_sampler(void);
 
 struct compass_rate_t {
     // These describe callbacks happening everytime a new compass value is read
-    int_fast8_t num_cb;
-    HANDLE mutex;
-    inv_compass_cb_t compass_process_cb[MAX_COMPASS_RATE_PROCESSES];
-    int priority[MAX_COMPASS_RATE_PROCESSES];
+    struct inv_cb_table callbacks;
     unsigned long polltime;
     unsigned long pollrate;
 };
 static struct compass_rate_t compass_rate_obj;
 
+/* Samples taken by the sampler thread, waiting for the FIFO processing. */
+#define COMPASS_SAMPLE_QUEUE_LEN    (4)
+#define PRESSURE_POLL_RATE          (80)    /* ms */
+
+struct compass_sample_t {
+    long raw[3];
+    unsigned long long timestamp;   /* ns, when the read was issued */
+};
+
+struct compass_sampler_t {
+    int supervised;     /* the compass supervisor is enabled, mutex made */
+    int enabled;
+    volatile int running;
+    inv_mpl_trylock_t trylock;
+    inv_mpl_unlock_t unlock;
+    void *lock;
+    HANDLE thread;
+    HANDLE mutex;
+    struct compass_sample_t queue[COMPASS_SAMPLE_QUEUE_LEN];
+    int head;
+    int count;
+    unsigned long dropped;
+    long pressure;
+    int pressure_ready;
+};
+static struct compass_sampler_t compass_sampler;
+
 struct compass_obj_t inv_compass_obj;
 
 inv_error_t inv_enable_compass_supervisor(void)
 {
     inv_error_t result;
-    result = inv_create_mutex(&compass_rate_obj.mutex);
+    result = inv_cb_table_init(&compass_rate_obj.callbacks,
+                               MAX_COMPASS_RATE_PROCESSES);
     if (result) {
         LOG_RESULT_LOCATION(result);
         return result;
@@ -57,10 +87,21 @@ inv_error_t inv_enable_compass_supervisor(void)
         LOG_RESULT_LOCATION(result);
         return result;
     }
-    compass_rate_obj.num_cb = 0;
     compass_rate_obj.polltime = 0;
     compass_rate_obj.pollrate = 20;
 
+    result = inv_create_mutex(&compass_sampler.mutex);
+    if (result) {
+        LOG_RESULT_LOCATION(result);
+        return result;
+    }
+    compass_sampler.supervised = 1;
+    result = inv_register_state_callback(inv_compass_sampler_state_cb);
+    if (result) {
+        LOG_RESULT_LOCATION(result);
+        return result;
+    }
+
     /* inv_obj compass supervisor callbacks are registered
      * by an external function, so that compass_supervisor.c
      * doesn't depend on inv_obj in any way.
@@ -82,71 +123,261 @@ inv_error_t inv_disable_compass_supervisor(void)
         LOG_RESULT_LOCATION(result);
         return result;
     }
+    result = inv_unregister_state_callback(inv_compass_sampler_state_cb);
+    if (result) {
+        LOG_RESULT_LOCATION(result);
+        return result;
+    }
+    result = inv_stop_compass_sampler();
+    if (result) {
+        LOG_RESULT_LOCATION(result);
+        return result;
+    }
+    compass_sampler.supervised = 0;
+    inv_destroy_mutex(compass_sampler.mutex);
     result = inv_unregister_fifo_rate_process(inv_run_compass_rate_processes);
+    inv_cb_table_close(&compass_rate_obj.callbacks);
     return result;
 }
 
+static void inv_push_compass_sample(const struct compass_sample_t *sample)
+{
+    int tail;
+
+    inv_lock_mutex(compass_sampler.mutex);
+    if (compass_sampler.count == COMPASS_SAMPLE_QUEUE_LEN) {
+        /* FIFO processing is behind, drop the oldest sample */
+        compass_sampler.head =
+            (compass_sampler.head + 1) % COMPASS_SAMPLE_QUEUE_LEN;
+        compass_sampler.count--;
+        compass_sampler.dropped++;
+    }
+    tail = (compass_sampler.head + compass_sampler.count) %
+        COMPASS_SAMPLE_QUEUE_LEN;
+    compass_sampler.queue[tail] = *sample;
+    compass_sampler.count++;
+    inv_unlock_mutex(compass_sampler.mutex);
+}
+
+static int inv_pop_compass_sample(struct compass_sample_t *sample)
+{
+    int got_data = 0;
+
+    inv_lock_mutex(compass_sampler.mutex);
+    if (compass_sampler.count) {
+        *sample = compass_sampler.queue[compass_sampler.head];
+        compass_sampler.head =
+            (compass_sampler.head + 1) % COMPASS_SAMPLE_QUEUE_LEN;
+        compass_sampler.count--;
+        got_data = 1;
+    }
+    inv_unlock_mutex(compass_sampler.mutex);
+    return got_data;
+}
+
 /**
  * @internal
- * @brief   This registers a function to be called for each set of
- *          gyro/quaternion/rotation matrix/etc output.
- * @param[in] func The callback function to register
- * @param[in] priority The unique priority number of the callback. Lower numbers
- *            are called first.
- * @return  error code.
+ * @brief   Body of the sampler thread.  Reads the compass every pollrate ms
+ *          and the pressure sensor every PRESSURE_POLL_RATE ms, so that the
+ *          blocking slave reads happen outside of the FIFO processing.
+ *          The reads share the serial handle, inv_obj and the poll rate
+ *          with the FIFO processing and are done under the caller's MPL
+ *          lock.  The lock is only tried: inv_stop_compass_sampler() joins
+ *          the thread from a state change, with the lock held.
  */
-inv_error_t inv_register_compass_rate_process(
-                inv_error_t (*func)(struct compass_obj_t *obj), int priority)
+static void *inv_compass_sampler_thread(void *arg)
 {
-    INVENSENSE_FUNC_START;
-    inv_error_t result;
-    int kk, nn;
-
-    result = inv_lock_mutex(compass_rate_obj.mutex);
-    if (INV_SUCCESS != result) {
-        return result;
-    }
-    // Make sure we haven't registered this function already
-    // Or used the same priority
-    for (kk = 0; kk < compass_rate_obj.num_cb; ++kk) {
-        if ((compass_rate_obj.compass_process_cb[kk] == func) ||
-            (compass_rate_obj.priority[kk] == priority)) {
-            inv_unlock_mutex(compass_rate_obj.mutex);
-            return INV_ERROR_INVALID_PARAMETER;
+    unsigned long long now, next_compass = 0, next_pressure = 0, next;
+    struct compass_sample_t sample;
+    long pressure;
+
+    while (compass_sampler.running) {
+        if (compass_sampler.trylock(compass_sampler.lock)) {
+            inv_sleep(1);
+            continue;
+        }
+        if (!compass_sampler.running) {
+            compass_sampler.unlock(compass_sampler.lock);
+            break;
         }
-    }
 
-    // Make sure we have not filled up our number of allowable callbacks
-    if (compass_rate_obj.num_cb <= MAX_HIGH_RATE_PROCESSES - 1) {
-        kk = 0;
-        if (compass_rate_obj.num_cb != 0) {
-            // set kk to be where this new callback goes in the array
-            while ((kk < compass_rate_obj.num_cb) &&
-                   (compass_rate_obj.priority[kk] < priority)) {
-                kk++;
+        now = inv_get_tick_count_ns();
+        next = now + compass_rate_obj.pollrate * 1000000ULL;
+
+        if (inv_compass_present() && inv_compass_read_on_bus()) {
+            if (now >= next_compass) {
+                next_compass = now + compass_rate_obj.pollrate * 1000000ULL;
+                if (inv_get_compass_data(sample.raw) == INV_SUCCESS) {
+                    sample.timestamp = now;
+                    inv_push_compass_sample(&sample);
+                }
             }
-            if (kk != compass_rate_obj.num_cb) {
-                // We need to move the others
-                for (nn = compass_rate_obj.num_cb; nn > kk; --nn) {
-                    compass_rate_obj.compass_process_cb[nn] =
-                                    compass_rate_obj.compass_process_cb[nn - 1];
-                    compass_rate_obj.priority[nn] = 
-                                            compass_rate_obj.priority[nn - 1];
+            if (next_compass < next)
+                next = next_compass;
+        }
+
+        if (inv_pressure_present()) {
+            if (now >= next_pressure) {
+                next_pressure = now + PRESSURE_POLL_RATE * 1000000ULL;
+                if (inv_get_pressure_data(&pressure) == INV_SUCCESS) {
+                    inv_lock_mutex(compass_sampler.mutex);
+                    compass_sampler.pressure = pressure;
+                    compass_sampler.pressure_ready = 1;
+                    inv_unlock_mutex(compass_sampler.mutex);
                 }
             }
+            if (next_pressure < next)
+                next = next_pressure;
         }
-        // Add new callback
-        compass_rate_obj.compass_process_cb[kk] = func;
-        compass_rate_obj.priority[kk] = priority;
-        compass_rate_obj.num_cb++;
-    } else {
-        result = INV_ERROR_MEMORY_EXAUSTED;
+        compass_sampler.unlock(compass_sampler.lock);
+
+        now = inv_get_tick_count_ns();
+        if (next > now)
+            inv_sleep((int)((next - now + 999999ULL) / 1000000ULL));
+    }
+    return NULL;
+}
+
+/**
+ * @internal
+ * @brief   Starts the sampler thread, if enabled.  Called by inv_dmp_start()
+ *          once the DMP is started, so that the thread never reads a slave
+ *          the start sequence is still configuring.
+ * @return  INV_SUCCESS or non-zero error code.
+ */
+inv_error_t inv_start_compass_sampler(void)
+{
+    inv_error_t result;
+
+    if (compass_sampler.running || !compass_sampler.enabled ||
+        !compass_sampler.supervised ||
+        inv_get_state() != INV_STATE_DMP_STARTED)
+        return INV_SUCCESS;
+
+    compass_sampler.head = 0;
+    compass_sampler.count = 0;
+    compass_sampler.pressure_ready = 0;
+    compass_sampler.running = 1;
+    result = inv_create_thread(&compass_sampler.thread,
+                               inv_compass_sampler_thread, NULL);
+    if (result) {
+        compass_sampler.running = 0;
+        LOG_RESULT_LOCATION(result);
     }
+    return result;
+}
+
+static inv_error_t inv_stop_compass_sampler(void)
+{
+    inv_error_t result;
 
-    inv_unlock_mutex(compass_rate_obj.mutex);
+    if (!compass_sampler.running)
+        return INV_SUCCESS;
+
+    compass_sampler.running = 0;
+    result = inv_join_thread(compass_sampler.thread);
+    MPL_LOGV_IF(compass_sampler.dropped,
+                "compass sampler dropped %lu samples\n",
+                compass_sampler.dropped);
+    compass_sampler.dropped = 0;
     return result;
 }
 
+/**
+ * @internal
+ * @brief   Stops the sampler thread before the DMP leaves the started state.
+ */
+static inv_error_t inv_compass_sampler_state_cb(unsigned char newState)
+{
+    if (newState != INV_STATE_DMP_STARTED)
+        return inv_stop_compass_sampler();
+    return INV_SUCCESS;
+}
+
+/**
+ * @brief   Moves the compass and pressure reads to a sampler thread.
+ *          The slave sensors are then read in the background and the
+ *          samples, time stamped when they are read, are handed to the
+ *          compass rate processes from the FIFO processing without waiting
+ *          on the serial bus.  When disabled, the default, the sensors are
+ *          read inline from the FIFO processing.
+ *          A compass read through the FIFO, on the MPU secondary bus, is
+ *          always done inline.  The thread runs while the DMP is started.
+ * @param[in] enable    non-zero to enable the sampler thread.
+ * @param[in] trylock   tries to take the lock the caller holds around
+ *                      every MPL call, returns 0 when taken.
+ * @param[in] unlock    releases it.
+ * @param[in] lock      argument for trylock and unlock.
+ * @pre     inv_dmp_open() must have succeeded.
+ * @return  INV_SUCCESS or non-zero error code.
+ */
+inv_error_t inv_set_compass_sampler(int enable, inv_mpl_trylock_t trylock,
+                                    inv_mpl_unlock_t unlock, void *lock)
+{
+    INVENSENSE_FUNC_START;
+
+    if (inv_get_state() < INV_STATE_DMP_OPENED)
+        return INV_ERROR_SM_IMPROPER_STATE;
+    if (enable && (!trylock || !unlock))
+        return INV_ERROR_INVALID_PARAMETER;
+    if (enable && !compass_sampler.supervised)
+        return INV_ERROR_FEATURE_NOT_ENABLED;
+
+    if (!enable) {
+        compass_sampler.enabled = 0;
+        return inv_stop_compass_sampler();
+    }
+    if (compass_sampler.running)
+        return INV_SUCCESS;
+    compass_sampler.trylock = trylock;
+    compass_sampler.unlock = unlock;
+    compass_sampler.lock = lock;
+    compass_sampler.enabled = 1;
+    return inv_start_compass_sampler();
+}
+
+/**
+ * @internal
+ * @brief   Gets the last pressure sample read by the sampler thread.
+ * @param[out] data     pressure measurement.
+ * @param[out] got_data set to 1 if a new sample was available, 0 if not.
+ * @return  INV_ERROR_FEATURE_NOT_ENABLED if the sampler thread is not
+ *          running and the pressure must be read inline, INV_SUCCESS
+ *          otherwise.
+ */
+inv_error_t inv_get_sampled_pressure(long *data, int *got_data)
+{
+    *got_data = 0;
+    if (!compass_sampler.running)
+        return INV_ERROR_FEATURE_NOT_ENABLED;
+
+    inv_lock_mutex(compass_sampler.mutex);
+    if (compass_sampler.pressure_ready) {
+        *data = compass_sampler.pressure;
+        compass_sampler.pressure_ready = 0;
+        *got_data = 1;
+    }
+    inv_unlock_mutex(compass_sampler.mutex);
+    return INV_SUCCESS;
+}
+
+/**
+ * @internal
+ * @brief   This registers a function to be called for each set of
+ *          gyro/quaternion/rotation matrix/etc output.
+ * @param[in] func The callback function to register
+ * @param[in] priority The unique priority number of the callback. Lower numbers
+ *            are called first.
+ * @return  error code.
+ */
+inv_error_t inv_register_compass_rate_process(
+                inv_error_t (*func)(struct compass_obj_t *obj), int priority)
+{
+    INVENSENSE_FUNC_START;
+    return inv_cb_table_add(&compass_rate_obj.callbacks,
+                            (inv_cb_func)func, priority);
+}
+
 /**
  * @internal
  * @brief   This unregisters a function to be called for each set of
@@ -156,70 +387,90 @@ inv_error_t inv_register_compass_rate_process(
 inv_error_t inv_unregister_compass_rate_process(inv_error_t (*func)(struct compass_obj_t *obj))
 {
     INVENSENSE_FUNC_START;
-    int kk, jj;
-    inv_error_t result;
+    return inv_cb_table_remove(&compass_rate_obj.callbacks, (inv_cb_func)func);
+}
 
-    result = inv_lock_mutex(compass_rate_obj.mutex);
-    if (INV_SUCCESS != result) {
-        return result;
-    }
-    // Make sure we haven't registered this function already
-    result = INV_ERROR_INVALID_PARAMETER;
-    for (kk = 0; kk < compass_rate_obj.num_cb; ++kk) {
-        if (compass_rate_obj.compass_process_cb[kk] == func) {
-            for (jj = kk + 1; jj < compass_rate_obj.num_cb; ++jj) {
-                compass_rate_obj.compass_process_cb[jj - 1] =
-                    compass_rate_obj.compass_process_cb[jj];
-                compass_rate_obj.priority[jj - 1] =
-                    compass_rate_obj.priority[jj];
-            }
-            compass_rate_obj.compass_process_cb[compass_rate_obj.num_cb - 1] = NULL;
-            compass_rate_obj.priority[compass_rate_obj.num_cb - 1] = 0;
-            compass_rate_obj.num_cb--;
-            result = INV_SUCCESS;
-            break;
-        }
-    }
+static inv_error_t inv_run_compass_callbacks(void)
+{
+    int kk;
+    inv_error_t result = INV_SUCCESS, result2;
+    const struct inv_cb_snapshot *snap;
 
-    inv_unlock_mutex(compass_rate_obj.mutex);
-    return result;
+    snap = inv_cb_table_acquire(&compass_rate_obj.callbacks);
+    if (snap == NULL)
+        return INV_SUCCESS;
 
+    for (kk = 0; kk < snap->num_cb; ++kk) {
+        inv_compass_cb_t cb = (inv_compass_cb_t)snap->cb[kk];
+        result2 = cb(&inv_compass_obj);
+        if (result == INV_SUCCESS)
+            result = result2;
+        MPL_LOGW_IF(result2 > 0,
+            "Calling compass_process_cb %d/%d, "
+            "priority %d, callback %p, "
+            "polltime %ld, pollrate %ld, "
+            "returned %d\n",
+            kk, snap->num_cb,
+            snap->priority[kk], cb,
+            compass_rate_obj.polltime, compass_rate_obj.pollrate,
+            result2);
+    }
+    inv_cb_table_release(snap);
+    return result;
 }
 
-inv_error_t inv_run_compass_rate_processes(struct inv_obj_t *inv_obj)
+/** Hands a compass sample to inv_compass_obj, as inv_try_compass() does
+* for an inline read.
+*/
+static void inv_set_compass_sample(const long *raw, unsigned long long timestamp)
 {
-    int kk,got_data;
-    inv_error_t result, result2;
+    int i;
 
-    result = inv_lock_mutex(compass_rate_obj.mutex);
-    if (INV_SUCCESS != result) {
-        MPL_LOGE("MLOsLockMutex returned %d\n", result);
-        return result;
-    }
+    for (i = 0; i < 3; i++)
+        inv_compass_obj.raw[i] = raw[i];
+    inv_compass_obj.timestamp = timestamp;
 
-    result = inv_try_compass(&got_data);
-
-    if (result == INV_SUCCESS && got_data == 1) {
-        for (kk = 0; kk < compass_rate_obj.num_cb; ++kk) {
-            if (compass_rate_obj.compass_process_cb[kk]) {
-                result2 = compass_rate_obj.compass_process_cb[kk](&inv_compass_obj);
-                if (result == INV_SUCCESS)
-                    result = result2;
-                MPL_LOGW_IF(result2 > 0,
-                    "Calling compass_process_cb %d/%d, "
-                    "priority %d, callback %p, "
-                    "polltime %ld, pollrate %ld, "
-                    "returned %d\n",
-                    kk, compass_rate_obj.num_cb,
-                    compass_rate_obj.priority[kk],
-                    compass_rate_obj.compass_process_cb[kk],
-                    compass_rate_obj.polltime, compass_rate_obj.pollrate,
-                    result2);
+    /* Save the intial compass value to make bias convergence faster in local
+     *  body high fields */
+    if (IS_INV_ADVFEATURES_ENABLED(inv_obj)) {
+        if (inv_obj.adv_fusion->got_init_compass_bias == 0) {
+            inv_obj.adv_fusion->got_init_compass_bias = 1;
+            for (i = 0; i < 3; i++) {
+                inv_compass_obj.init_bias[i] = inv_compass_obj.raw[i];
             }
         }
     }
+}
+
+inv_error_t inv_run_compass_rate_processes(struct inv_obj_t *inv_obj)
+{
+    int got_data;
+    inv_error_t result = INV_SUCCESS, result2;
+    struct compass_sample_t sample;
+
+    if (compass_sampler.running && inv_compass_read_on_bus()) {
+        /* every queued sample, oldest first */
+        while (inv_pop_compass_sample(&sample)) {
+            if (inv_compass_obj.timestamp &&
+                sample.timestamp > inv_compass_obj.timestamp)
+                inv_compass_obj.delta_time = (unsigned long)
+                    ((sample.timestamp - inv_compass_obj.timestamp) /
+                     1000000ULL);
+            else
+                inv_compass_obj.delta_time = compass_rate_obj.pollrate;
+            inv_set_compass_sample(sample.raw, sample.timestamp);
+            compass_rate_obj.polltime = inv_get_tick_count();
+
+            result2 = inv_run_compass_callbacks();
+            if (result == INV_SUCCESS)
+                result = result2;
+        }
+    } else {
+        result = inv_try_compass(&got_data);
+        if (result == INV_SUCCESS && got_data == 1)
+            result = inv_run_compass_callbacks();
+    }
 
-    inv_unlock_mutex(compass_rate_obj.mutex);
     if (result == INV_ERROR_COMPASS_DATA_NOT_READY)
         result = INV_SUCCESS;
 
@@ -234,7 +485,7 @@ inv_error_t inv_try_compass(int *got_data)
 {
     inv_error_t result;
     unsigned long ctime;
-    int i;
+    unsigned long long timestamp;
 
     *got_data = 0;
 
@@ -250,6 +501,7 @@ inv_error_t inv_try_compass(int *got_data)
         return INV_SUCCESS;
     }
 
+    timestamp = inv_get_tick_count_ns();
     result = inv_get_compass_data(inv_compass_obj.raw);
 
     /* external slave wants the data even if there is an error */
@@ -257,17 +509,7 @@ inv_error_t inv_try_compass(int *got_data)
         return result;
 
     compass_rate_obj.polltime = ctime;
-
-    /* Save the intial compass value to make bias convergence faster in local
-     *  body high fields */
-    if (IS_INV_ADVFEATURES_ENABLED(inv_obj)) {
-        if (inv_obj.adv_fusion->got_init_compass_bias == 0) {
-            inv_obj.adv_fusion->got_init_compass_bias = 1;
-            for (i = 0; i < 3; i++) {
-                inv_compass_obj.init_bias[i] = inv_compass_obj.raw[i];
-            }
-        }
-    }
+    inv_set_compass_sample(inv_compass_obj.raw, timestamp);
 
     *got_data = 1;
 
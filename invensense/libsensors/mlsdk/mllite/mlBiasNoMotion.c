@@ -83,9 +83,10 @@ inv_error_t inv_update_bias(void)
 {
     INVENSENSE_FUNC_START;
     inv_error_t result;
-    unsigned char regs[12], is_enabled;
+    unsigned char regs[12], flag[2], temp[2], fcfg_6, is_enabled;
     short bias[GYRO_NUM_AXES];
     unsigned short motion_flag;
+    struct inv_mpu_batch batch;
 
     result = inv_bias_nomot_is_enabled(&is_enabled);
     if (result) {
@@ -95,14 +96,14 @@ inv_error_t inv_update_bias(void)
 
     if (is_enabled && inv_get_gyro_present()) {
 
-        regs[0] = DINAA0 + 3;
-        result = inv_set_mpu_memory(KEY_FCFG_6, 1, regs);
-        if (result) {
-            LOG_RESULT_LOCATION(result);
-            return result;
-        }
-
-        result = inv_get_mpu_memory(KEY_D_1_244, 12, regs);
+        /* hold the DMP bias update and fetch the bias and the motion flag
+           in one batch, a single call on backends that can submit one */
+        inv_mpu_batch_init(&batch);
+        fcfg_6 = DINAA0 + 3;
+        inv_mpu_batch_set_memory(&batch, KEY_FCFG_6, 1, &fcfg_6);
+        inv_mpu_batch_get_memory(&batch, KEY_D_1_244, 12, regs);
+        inv_mpu_batch_get_memory(&batch, KEY_D_1_98, 2, flag);
+        result = inv_mpu_batch_submit(&batch);
         if (result) {
             LOG_RESULT_LOCATION(result);
             return result;
@@ -113,8 +114,8 @@ inv_error_t inv_update_bias(void)
         result = inv_check_max_gyro_bias(bias);
 
         if (result) {
-            regs[0] = DINAA0 + 15;
-            result = inv_set_mpu_memory(KEY_FCFG_6, 1, regs);
+            fcfg_6 = DINAA0 + 15;
+            result = inv_set_mpu_memory(KEY_FCFG_6, 1, &fcfg_6);
             if (result) {
                 LOG_RESULT_LOCATION(result);
                 return result;
@@ -122,19 +123,15 @@ inv_error_t inv_update_bias(void)
             return INV_WARNING_GYRO_MAG;
         }
 
-        result = inv_get_mpu_memory(KEY_D_1_98, 2, regs);
-        if (result) {
-            LOG_RESULT_LOCATION(result);
-            return result;
-        }
-
-        motion_flag = (unsigned short)regs[0] * 256 + (unsigned short)regs[1];
+        motion_flag = (unsigned short)flag[0] * 256 + (unsigned short)flag[1];
 
         if (motion_flag != inv_obj.lite_fusion->motion_duration)
             return INV_WARNING_MOTION_RACE;
 
-        regs[0] = DINAA0 + 15;
-        result = inv_set_mpu_memory(KEY_FCFG_6, 1, regs);
+        fcfg_6 = DINAA0 + 15;
+        inv_mpu_batch_set_memory(&batch, KEY_FCFG_6, 1, &fcfg_6);
+        inv_mpu_batch_read(&batch, MPUREG_TEMP_OUT_H, 2, temp);
+        result = inv_mpu_batch_submit(&batch);
         if (result) {
             LOG_RESULT_LOCATION(result);
             return result;
@@ -146,14 +143,7 @@ inv_error_t inv_update_bias(void)
             return result;
         }
 
-        result =
-            inv_serial_read(inv_get_serial_handle(), inv_get_mpu_slave_addr(),
-                            MPUREG_TEMP_OUT_H, 2, regs);
-        if (result) {
-            LOG_RESULT_LOCATION(result);
-            return result;
-        }
-        result = inv_set_mpu_memory(KEY_DMP_PREVPTAT, 2, regs);
+        result = inv_set_mpu_memory(KEY_DMP_PREVPTAT, 2, temp);
         if (result) {
             LOG_RESULT_LOCATION(result);
             return result;
@@ -26,12 +26,14 @@
 #include "mlFIFOHW.h"
 #include "dmpKey.h"
 #include "mlMathFunc.h"
+#include "mlMathFuncVec.h"
 #include "ml.h"
 #include "mldl.h"
 #include "mldl_cfg.h"
 #include "mlstates.h"
 #include "mlsupervisor.h"
 #include "mlos.h"
+#include "mlcbtable.h"
 #include "mlmath.h"
 #include "accel.h"
 #include "compass.h"
@@ -126,6 +128,9 @@ struct fifo_obj {
     long acc_bias_filt[3];
     float acc_filter_coef;
     long gravity_cache[3];
+    unsigned long long packet_time;
+    unsigned long snapshot_mask;
+    struct inv_fusion_snapshot snapshot;
 };
 static struct fifo_obj fifo_obj;
 
@@ -134,14 +139,8 @@ static struct fifo_obj fifo_obj;
 #define FIFO_CACHE_GRAVITY_BODY 4
 #define FIFO_CACHE_ACC_BIAS 8
 
-struct fifo_rate_obj_t {
-    /* These describe callbacks happening everytime a FIFO block is processed */
-    int_fast8_t num_cb;
-    HANDLE mutex;
-    inv_obj_func fifo_process_cb[MAX_HIGH_RATE_PROCESSES];
-    int priority[MAX_HIGH_RATE_PROCESSES];
-};
-struct fifo_rate_obj_t fifo_rate_obj;
+/* Callbacks happening everytime a FIFO block is processed */
+static struct inv_cb_table fifo_rate_obj;
 
 /** Sets accuracy to be one of 0, INV_32_BIT, or INV_16_BIT. Looks up old
  *  accuracy if needed.
@@ -522,8 +521,7 @@ inv_error_t inv_init_fifo_param(void)
     inv_set_linear_accel_filter_coef(0.f);
     fifo_obj.fifo_rate = 20;
     fifo_obj.sample_step_size_ms = 100;
-    memset(&fifo_rate_obj, 0, sizeof(struct fifo_rate_obj_t));
-    result = inv_create_mutex(&fifo_rate_obj.mutex);
+    result = inv_cb_table_init(&fifo_rate_obj, MAX_HIGH_RATE_PROCESSES);
     if (result) {
         LOG_RESULT_LOCATION(result);
         return result;
@@ -546,9 +544,8 @@ inv_error_t inv_close_fifo(void)
     inv_error_t first = INV_SUCCESS;
     result = inv_unregister_state_callback(inv_state_change_fifo);
     ERROR_CHECK_FIRST(first, result);
-    result = inv_destroy_mutex(fifo_rate_obj.mutex);
+    result = inv_cb_table_close(&fifo_rate_obj);
     ERROR_CHECK_FIRST(first, result);
-    memset(&fifo_rate_obj, 0, sizeof(struct fifo_rate_obj_t));
     return first;
 }
 
@@ -681,6 +678,7 @@ inv_error_t inv_read_and_process_fifo(int_fast8_t numPackets,
                 }
                 return result;
             }
+            fifo_obj.packet_time = inv_get_fifo_packet_time();
             if (!MPL_LOG_NDEBUG)
                 print_debug_dmp_output(buf, read);
             result = inv_process_fifo_packet(buf);
@@ -705,6 +703,7 @@ inv_error_t inv_read_and_process_fifo(int_fast8_t numPackets,
 
             memset(fifo_obj.decoded, 0, sizeof(fifo_obj.decoded));
             fifo_obj.cache = 0;
+            fifo_obj.packet_time = inv_get_tick_count_ns();
             for (kk = 0; kk < ACCEL_NUM_AXES; ++kk) {
                 fifo_obj.decoded[REF_RAW + 4 + kk] =
                     inv_q30_mult((data[kk] << 16),
@@ -783,6 +782,164 @@ inv_error_t inv_set_fifo_processed_callback(void (*func) (void))
     return INV_SUCCESS;
 }
 
+/**
+ *  @brief  Select the outputs kept in the fusion snapshot.
+ *          The selected outputs are computed once per processed packet,
+ *          before the callback set with inv_set_fifo_processed_callback(),
+ *          and read back with inv_get_fusion_snapshot(); 0 turns the
+ *          snapshot off.
+ *
+ *  @pre    inv_dmp_open() must have been called.
+ *
+ *  @param  mask    a combination of the INV_SNAPSHOT_ values.
+ *
+ *  @return INV_SUCCESS if successful, or non-zero error code otherwise.
+ */
+inv_error_t inv_set_fusion_snapshot_mask(unsigned long mask)
+{
+    INVENSENSE_FUNC_START;
+
+    if (inv_get_state() < INV_STATE_DMP_OPENED)
+        return INV_ERROR_SM_IMPROPER_STATE;
+
+    fifo_obj.snapshot_mask = mask;
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Get the outputs selected with inv_set_fusion_snapshot_mask().
+ *  @return the INV_SNAPSHOT_ mask.
+ */
+unsigned long inv_get_fusion_snapshot_mask(void)
+{
+    return fifo_obj.snapshot_mask;
+}
+
+/**
+ *  @brief  Copy the fusion snapshot of the last processed packet.
+ *          Only the outputs flagged in snap->mask are valid: an output
+ *          selected but not available, such as the magnetometer without
+ *          a compass, is left out.  A change of snap->seq tells a new
+ *          packet.
+ *
+ *  @param[out] snap    the snapshot.
+ *
+ *  @return INV_SUCCESS if successful, INV_ERROR_FEATURE_NOT_ENABLED if no
+ *          packet was processed with a non-zero mask.
+ */
+inv_error_t inv_get_fusion_snapshot(struct inv_fusion_snapshot *snap)
+{
+    if (snap == NULL)
+        return INV_ERROR_INVALID_PARAMETER;
+
+    if (fifo_obj.snapshot.seq == 0)
+        return INV_ERROR_FEATURE_NOT_ENABLED;
+
+    *snap = fifo_obj.snapshot;
+    return INV_SUCCESS;
+}
+
+/**
+ *  @internal
+ *  @brief  Fill the fusion snapshot from the packet just processed.
+ *          The quaternion is renormalized: the DMP one is unit length
+ *          only to within its rounding.
+ *          Gravity is the fixed point one of inv_get_gravity(), which
+ *          inv_get_linear_accel() reuses.
+ *          The timestamp is when the DMP produced the packet.
+ */
+static void inv_fill_fusion_snapshot(void)
+{
+    struct inv_fusion_snapshot *snap = &fifo_obj.snapshot;
+    unsigned long want = fifo_obj.snapshot_mask;
+    unsigned long mask = 0;
+    long data[3];
+    float quat[4];
+    float rot[9];
+    int kk;
+
+    if ((want & INV_SNAPSHOT_GYRO) && inv_get_gyro(data) == INV_SUCCESS) {
+        for (kk = 0; kk < 3; ++kk)
+            snap->gyro[kk] = data[kk] / 65536.f;
+        mask |= INV_SNAPSHOT_GYRO;
+    }
+    if ((want & INV_SNAPSHOT_GYRO_RAW) &&
+        inv_get_gyro_raw(data) == INV_SUCCESS) {
+        for (kk = 0; kk < 3; ++kk)
+            snap->gyro_raw[kk] = data[kk] / 65536.f;
+        mask |= INV_SNAPSHOT_GYRO_RAW;
+    }
+    if ((want & INV_SNAPSHOT_ACCEL) && inv_get_accel(data) == INV_SUCCESS) {
+        for (kk = 0; kk < ACCEL_NUM_AXES; ++kk)
+            snap->accel[kk] = data[kk] / 65536.f;
+        mask |= INV_SNAPSHOT_ACCEL;
+    }
+
+    if (fifo_obj.data_config[CONFIG_QUAT]) {
+        inv_q30_to_float_batch(&fifo_obj.decoded[REF_QUATERNION], quat, 4);
+        inv_q_normalize_batchf(quat, 1);
+
+        if (want & INV_SNAPSHOT_QUATERNION) {
+            for (kk = 0; kk < 4; ++kk)
+                snap->quat[kk] = quat[kk];
+            mask |= INV_SNAPSHOT_QUATERNION;
+        }
+        if (want & INV_SNAPSHOT_ROTATION_MATRIX) {
+            inv_quaternion_to_rotation_batchf(quat, rot, 1);
+            for (kk = 0; kk < 9; ++kk)
+                snap->rot_mat[kk] = rot[kk];
+            mask |= INV_SNAPSHOT_ROTATION_MATRIX;
+        }
+        if ((want & INV_SNAPSHOT_GRAVITY) &&
+            inv_get_gravity(data) == INV_SUCCESS) {
+            for (kk = 0; kk < ACCEL_NUM_AXES; ++kk)
+                snap->gravity[kk] = data[kk] / 65536.f;
+            mask |= INV_SNAPSHOT_GRAVITY;
+        }
+    }
+    if ((want & (INV_SNAPSHOT_LINEAR_ACCEL | INV_SNAPSHOT_LINEAR_ACCEL_WORLD))
+        && inv_get_linear_accel(data) == INV_SUCCESS) {
+        float la[4], conj[4];
+
+        la[0] = 0.f;
+        for (kk = 0; kk < ACCEL_NUM_AXES; ++kk)
+            la[kk + 1] = data[kk] / 65536.f;
+        if (want & INV_SNAPSHOT_LINEAR_ACCEL) {
+            for (kk = 0; kk < ACCEL_NUM_AXES; ++kk)
+                snap->linear_accel[kk] = la[kk + 1];
+            mask |= INV_SNAPSHOT_LINEAR_ACCEL;
+        }
+        /* q * la * q', as inv_get_linear_accel_in_world() */
+        if ((want & INV_SNAPSHOT_LINEAR_ACCEL_WORLD) &&
+            fifo_obj.data_config[CONFIG_QUAT]) {
+            conj[0] = quat[0];
+            for (kk = 1; kk < 4; ++kk)
+                conj[kk] = -quat[kk];
+            inv_q_mult_batchf(quat, la, la, 1);
+            inv_q_mult_batchf(la, conj, la, 1);
+            for (kk = 0; kk < ACCEL_NUM_AXES; ++kk)
+                snap->linear_accel_world[kk] = la[kk + 1];
+            mask |= INV_SNAPSHOT_LINEAR_ACCEL_WORLD;
+        }
+    }
+
+    if ((want & INV_SNAPSHOT_MAGNETOMETER) && inv_obj.mag != NULL) {
+        for (kk = 0; kk < 3; ++kk)
+            snap->magnetometer[kk] =
+                inv_obj.mag->calibrated_data[kk] / 65536.0f;
+        mask |= INV_SNAPSHOT_MAGNETOMETER;
+    }
+    if ((want & INV_SNAPSHOT_COMPASS_ACCURACY) && inv_obj.adv_fusion != NULL) {
+        snap->compass_accuracy = inv_obj.adv_fusion->compass_accuracy;
+        mask |= INV_SNAPSHOT_COMPASS_ACCURACY;
+    }
+
+    snap->version = INV_FUSION_SNAPSHOT_VERSION;
+    snap->mask = mask;
+    snap->timestamp = fifo_obj.packet_time;
+    snap->seq++;
+}
+
 /**
  * @internal
  * @brief   Process data from the dmp read via the fifo.  Takes a buffer
@@ -2281,51 +2438,7 @@ void inv_override_quaternion(long *q)
 inv_error_t inv_register_fifo_rate_process(inv_obj_func func, int priority)
 {
     INVENSENSE_FUNC_START;
-    inv_error_t result;
-    int kk, nn;
-
-    result = inv_lock_mutex(fifo_rate_obj.mutex);
-    if (INV_SUCCESS != result) {
-        return result;
-    }
-    /* Make sure we haven't registered this function already
-       Or used the same priority */
-    for (kk = 0; kk < fifo_rate_obj.num_cb; ++kk) {
-        if ((fifo_rate_obj.fifo_process_cb[kk] == func) ||
-            (fifo_rate_obj.priority[kk] == priority)) {
-            inv_unlock_mutex(fifo_rate_obj.mutex);
-            return INV_ERROR_INVALID_PARAMETER;
-        }
-    }
-
-    /* Make sure we have not filled up our number of allowable callbacks */
-    if (fifo_rate_obj.num_cb <= MAX_HIGH_RATE_PROCESSES - 1) {
-        kk = 0;
-        if (fifo_rate_obj.num_cb != 0) {
-            /* set kk to be where this new callback goes in the array */
-            while ((kk < fifo_rate_obj.num_cb) &&
-                   (fifo_rate_obj.priority[kk] < priority)) {
-                kk++;
-            }
-            if (kk != fifo_rate_obj.num_cb) {
-                /* We need to move the others */
-                for (nn = fifo_rate_obj.num_cb; nn > kk; --nn) {
-                    fifo_rate_obj.fifo_process_cb[nn] =
-                        fifo_rate_obj.fifo_process_cb[nn - 1];
-                    fifo_rate_obj.priority[nn] = fifo_rate_obj.priority[nn - 1];
-                }
-            }
-        }
-        /* Add new callback */
-        fifo_rate_obj.fifo_process_cb[kk] = func;
-        fifo_rate_obj.priority[kk] = priority;
-        fifo_rate_obj.num_cb++;
-    } else {
-        result = INV_ERROR_MEMORY_EXAUSTED;
-    }
-
-    inv_unlock_mutex(fifo_rate_obj.mutex);
-    return result;
+    return inv_cb_table_add(&fifo_rate_obj, (inv_cb_func)func, priority);
 }
 
 /**
@@ -2337,34 +2450,7 @@ inv_error_t inv_register_fifo_rate_process(inv_obj_func func, int priority)
 inv_error_t inv_unregister_fifo_rate_process(inv_obj_func func)
 {
     INVENSENSE_FUNC_START;
-    int kk, jj;
-    inv_error_t result;
-
-    result = inv_lock_mutex(fifo_rate_obj.mutex);
-    if (INV_SUCCESS != result) {
-        return result;
-    }
-    // Make sure we haven't registered this function already
-    result = INV_ERROR_INVALID_PARAMETER;
-    for (kk = 0; kk < fifo_rate_obj.num_cb; ++kk) {
-        if (fifo_rate_obj.fifo_process_cb[kk] == func) {
-            for (jj = kk + 1; jj < fifo_rate_obj.num_cb; ++jj) {
-                fifo_rate_obj.fifo_process_cb[jj - 1] =
-                    fifo_rate_obj.fifo_process_cb[jj];
-                fifo_rate_obj.priority[jj - 1] =
-                    fifo_rate_obj.priority[jj];
-            }
-            fifo_rate_obj.fifo_process_cb[fifo_rate_obj.num_cb - 1] = NULL;
-            fifo_rate_obj.priority[fifo_rate_obj.num_cb - 1] = 0;
-            fifo_rate_obj.num_cb--;
-            result = INV_SUCCESS;
-            break;
-        }
-    }
-
-    inv_unlock_mutex(fifo_rate_obj.mutex);
-    return result;
-
+    return inv_cb_table_remove(&fifo_rate_obj, (inv_cb_func)func);
 }
 
 /**
@@ -2378,66 +2464,48 @@ inv_error_t inv_unregister_fifo_rate_process(inv_obj_func func)
 inv_error_t inv_check_fifo_callback(inv_obj_func callback,
     unsigned char *is_registered)
 {
-    int ii;
-    /*
-    inv_error_t result;
-
-    result = inv_lock_mutex(fifo_rate_obj.mutex);
-    if (result) {
-        LOG_RESULT_LOCATION(result);
-        return result;
-    }
-    */
-
-    is_registered[0] = false;
-
-    for (ii = 0; ii < fifo_rate_obj.num_cb; ii++) {
-        if (fifo_rate_obj.fifo_process_cb[ii] == callback) {
-            is_registered[0] = true;
-            break;
-        }
-    }
-
-    /*
-    result = inv_unlock_mutex(fifo_rate_obj.mutex);
-    if (result) {
-        LOG_RESULT_LOCATION(result);
-        return result;
-    }
-    */
+    is_registered[0] =
+        inv_cb_table_contains(&fifo_rate_obj, (inv_cb_func)callback);
     return INV_SUCCESS;
 }
 
+/**
+ *  @brief  Run the FIFO rate callbacks, in order of priority.
+ *          Takes no lock: the callbacks registered when it starts are run,
+ *          changes made meanwhile, by them or by another thread, apply
+ *          from the next packet.
+ */
 inv_error_t inv_run_fifo_rate_processes(void)
 {
     int kk;
-    inv_error_t result, result2;
+    inv_error_t result = INV_SUCCESS, result2;
+    const struct inv_cb_snapshot *snap;
 
-    result = inv_lock_mutex(fifo_rate_obj.mutex);
-    if (INV_SUCCESS != result) {
-        MPL_LOGE("inv_lock_mutex returned %d\n", result);
-        return result;
-    }
+    snap = inv_cb_table_acquire(&fifo_rate_obj);
+    if (snap == NULL)
+        return INV_SUCCESS;
 
-    for (kk = 0; kk < fifo_rate_obj.num_cb; ++kk) {
-        if (fifo_rate_obj.fifo_process_cb[kk]) {
-            result2 = fifo_rate_obj.fifo_process_cb[kk](&inv_obj);
-            if (result == INV_SUCCESS)
-                result = result2;
-            MPL_LOGW_IF(result2 > 0,
-                "Calling fifo_process_cb %d/%d, "
-                "priority %d, callback %p, returned %d\n",
-                kk, fifo_rate_obj.num_cb, 
-                fifo_rate_obj.priority[kk], 
-                fifo_rate_obj.fifo_process_cb[kk], result2);
-        }
+    for (kk = 0; kk < snap->num_cb; ++kk) {
+        inv_obj_func cb = (inv_obj_func)snap->cb[kk];
+        result2 = cb(&inv_obj);
+        if (result == INV_SUCCESS)
+            result = result2;
+        MPL_LOGW_IF(result2 > 0,
+            "Calling fifo_process_cb %d/%d, "
+            "priority %d, callback %p, returned %d\n",
+            kk, snap->num_cb,
+            snap->priority[kk],
+            cb, result2);
     }
+    inv_cb_table_release(snap);
+
+    if (fifo_obj.snapshot_mask)
+        inv_fill_fusion_snapshot();
 
     /* User callbacks */
     if (fifo_obj.fifo_process_cb)
         fifo_obj.fifo_process_cb();
 
-    inv_unlock_mutex(fifo_rate_obj.mutex);
     return result;
 }
 
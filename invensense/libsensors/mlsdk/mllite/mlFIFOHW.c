@@ -25,11 +25,13 @@
 #include "mpu.h"
 #include "mpu6050b1.h"
 #include "mlFIFOHW.h"
+#include "mlFIFO.h"
 #include "ml.h"
 #include "mldl.h"
 #include "mldl_cfg.h"
 
 #include "mlsl.h"
+#include "mlos.h"
 
 #include "log.h"
 #undef MPL_LOG_TAG
@@ -50,6 +52,7 @@ struct fifo_hw_obj {
     inv_error_t fifoError;
     unsigned char fifoOverflow;
     unsigned char fifoResetOnOverflow;
+    unsigned long long packetTime;
 };
 
 /*
@@ -94,6 +97,7 @@ uint_fast16_t inv_get_fifo(uint_fast16_t length, unsigned char *buffer)
     inv_error_t result;
     uint_fast16_t inFifo;
     uint_fast16_t toRead;
+    unsigned long long now;
     int_fast8_t kk;
 
     toRead = length - FIFO_FOOTER_SIZE + fifo_objHW.fifoCount;
@@ -103,6 +107,7 @@ uint_fast16_t inv_get_fifo(uint_fast16_t length, unsigned char *buffer)
         return 0;
     }
 
+    now = inv_get_tick_count_ns();
     result = inv_get_fifo_length(&inFifo);
     if (INV_SUCCESS != result) {
         fifo_objHW.fifoError = result;
@@ -155,6 +160,12 @@ uint_fast16_t inv_get_fifo(uint_fast16_t length, unsigned char *buffer)
         }
     }
 
+    /* the packet read is the oldest of those queued, the newest one was
+       about done when the length was read */
+    fifo_objHW.packetTime = now -
+        (unsigned long long)((inFifo - fifo_objHW.fifoCount) / length - 1) *
+        inv_get_sample_step_size_ms() * 1000000ULL;
+
     if (fifo_objHW.fifoCount == 0) {
         fifo_objHW.fifoCount = FIFO_FOOTER_SIZE;
     }
@@ -162,6 +173,18 @@ uint_fast16_t inv_get_fifo(uint_fast16_t length, unsigned char *buffer)
     return length - FIFO_FOOTER_SIZE;
 }
 
+/**
+ *  @brief  Get the time the DMP produced the packet last read with
+ *          inv_get_fifo().
+ *          It is taken back from when the FIFO length was read by one
+ *          sample step per packet queued after it.
+ *  @return the time, in ns of CLOCK_MONOTONIC.
+ */
+unsigned long long inv_get_fifo_packet_time(void)
+{
+    return fifo_objHW.packetTime;
+}
+
 /**
  *  @brief  Used to query the status of the FIFO.
  *  @return INV_SUCCESS if the fifo is OK. An error code otherwise.
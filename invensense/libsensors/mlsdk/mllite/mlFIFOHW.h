@@ -23,6 +23,7 @@ extern "C" {
 #define FIFO_FOOTER_SIZE            (2)
 
     uint_fast16_t inv_get_fifo(uint_fast16_t length, unsigned char *buffer);
+    unsigned long long inv_get_fifo_packet_time(void);
     inv_error_t inv_get_fifo_status(void);
     inv_error_t inv_get_fifo_length(uint_fast16_t * len);
     short inv_get_fifo_count(void);
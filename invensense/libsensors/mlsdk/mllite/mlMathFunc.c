@@ -394,6 +394,12 @@ float inv_matrix_det(float *p, int *n)
     m = *n;
     if (*n == 2)
         return (*p ** (p + 11) - *(p + 1) ** (p + 10));
+    if (*n == 3) {
+        /* closed form, avoids building the 10x10 cofactor matrices */
+        return p[0] * (p[11] * p[22] - p[12] * p[21])
+            - p[1] * (p[10] * p[22] - p[12] * p[20])
+            + p[2] * (p[10] * p[21] - p[11] * p[20]);
+    }
     for (i = 0, j = 0; j < m; j++) {
         *n = m;
         inv_matrix_det_inc(p, &d[0][0], n, i, j);
@@ -412,6 +418,12 @@ double inv_matrix_detd(double *p, int *n)
     m = *n;
     if (*n == 2)
         return (*p ** (p + 11) - *(p + 1) ** (p + 10));
+    if (*n == 3) {
+        /* closed form, avoids building the 10x10 cofactor matrices */
+        return p[0] * (p[11] * p[22] - p[12] * p[21])
+            - p[1] * (p[10] * p[22] - p[12] * p[20])
+            + p[2] * (p[10] * p[21] - p[11] * p[20]);
+    }
     for (i = 0, j = 0; j < m; j++) {
         *n = m;
         inv_matrix_det_incd(p, &d[0][0], n, i, j);
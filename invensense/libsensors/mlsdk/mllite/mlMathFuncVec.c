@@ -0,0 +1,370 @@
+/*
+ $License:
+    Copyright (C) 2011 InvenSense Corporation, All Rights Reserved.
+ $
+ */
+/**
+ *  @defgroup MLMATHVEC
+ *  @brief  Batched single precision quaternion, rotation matrix and
+ *          small matrix helpers with a portable and an ARM NEON
+ *          implementation.
+ *
+ *  @{
+ *      @file   mlMathFuncVec.c
+ *      @brief  Batched math functions.
+ */
+
+#include "mlMathFunc.h"
+#include "mlMathFuncVec.h"
+#include "mlinclude.h"
+
+#ifdef INV_MATH_NEON
+#include <arm_neon.h>
+#endif
+
+/* determinants below this magnitude are treated as singular */
+#define INV_MATRIX_DET_EPSILON (1e-12f)
+
+/*
+ * Portable implementations. Also used by the NEON versions to process the
+ * elements left over once the input has been consumed 4 at a time.
+ */
+
+static void q30_to_float_c(const long *q30, float *out, int count)
+{
+    int ii;
+    for (ii = 0; ii < count; ii++)
+        out[ii] = inv_q30_to_float(q30[ii]);
+}
+
+static void q_mult_c(const float *q1, const float *q2, float *qProd,
+                     int count)
+{
+    int ii;
+    for (ii = 0; ii < count; ii++, q1 += 4, q2 += 4, qProd += 4) {
+        float w = q1[0] * q2[0] - q1[1] * q2[1] - q1[2] * q2[2] - q1[3] * q2[3];
+        float x = q1[0] * q2[1] + q1[1] * q2[0] + q1[2] * q2[3] - q1[3] * q2[2];
+        float y = q1[0] * q2[2] - q1[1] * q2[3] + q1[2] * q2[0] + q1[3] * q2[1];
+        float z = q1[0] * q2[3] + q1[1] * q2[2] - q1[2] * q2[1] + q1[3] * q2[0];
+        qProd[0] = w;
+        qProd[1] = x;
+        qProd[2] = y;
+        qProd[3] = z;
+    }
+}
+
+static void q_normalize_c(float *q, int count)
+{
+    int ii;
+    for (ii = 0; ii < count; ii++, q += 4) {
+        float mag = q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3];
+        if (mag > 0) {
+            mag = 1.f / sqrtf(mag);
+            q[0] *= mag;
+            q[1] *= mag;
+            q[2] *= mag;
+            q[3] *= mag;
+        } else {
+            q[0] = 1.f;
+            q[1] = 0.f;
+            q[2] = 0.f;
+            q[3] = 0.f;
+        }
+    }
+}
+
+static void quaternion_to_rotation_c(const float *quat, float *rot, int count)
+{
+    int ii;
+    for (ii = 0; ii < count; ii++, quat += 4, rot += 9) {
+        float w = quat[0], x = quat[1], y = quat[2], z = quat[3];
+        float ww = w * w;
+        rot[0] = 2.f * (x * x + ww) - 1.f;
+        rot[1] = 2.f * (x * y - z * w);
+        rot[2] = 2.f * (x * z + y * w);
+        rot[3] = 2.f * (x * y + z * w);
+        rot[4] = 2.f * (y * y + ww) - 1.f;
+        rot[5] = 2.f * (y * z - x * w);
+        rot[6] = 2.f * (x * z - y * w);
+        rot[7] = 2.f * (y * z + x * w);
+        rot[8] = 2.f * (z * z + ww) - 1.f;
+    }
+}
+
+#ifdef INV_MATH_NEON
+/* 1/sqrt(v) refined with two Newton-Raphson steps (~23 bits) */
+static inline float32x4_t neon_rsqrt(float32x4_t v)
+{
+    float32x4_t e = vrsqrteq_f32(v);
+    e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(v, e), e));
+    e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(v, e), e));
+    return e;
+}
+#endif
+
+/**
+ *  @brief  Converts an array of Q30 fixed point values to float.
+ *  @param[in]  q30     input values. One is 2^30.
+ *  @param[out] out     output values.
+ *  @param[in]  count   number of elements.
+ */
+void inv_q30_to_float_batch(const long *q30, float *out, int count)
+{
+#if defined(INV_MATH_NEON) && !defined(__LP64__)
+    /* long is 32 bits wide here: convert 4 at a time with 30 fraction bits */
+    for (; count >= 4; count -= 4, q30 += 4, out += 4) {
+        int32x4_t v = vld1q_s32((const int32_t *)q30);
+        vst1q_f32(out, vcvtq_n_f32_s32(v, 30));
+    }
+#endif
+    q30_to_float_c(q30, out, count);
+}
+
+/**
+ *  @brief  Multiplies count pairs of quaternions, qProd[i] = q1[i] * q2[i].
+ *          qProd may alias q1 or q2.
+ *  @param[in]  q1      count quaternions, 4 floats each.
+ *  @param[in]  q2      count quaternions, 4 floats each.
+ *  @param[out] qProd   count quaternions, 4 floats each.
+ *  @param[in]  count   number of quaternions.
+ */
+void inv_q_mult_batchf(const float *q1, const float *q2, float *qProd,
+                       int count)
+{
+    INVENSENSE_FUNC_START;
+#ifdef INV_MATH_NEON
+    for (; count >= 4; count -= 4, q1 += 16, q2 += 16, qProd += 16) {
+        /* de-interleave 4 quaternions into w, x, y, z lanes */
+        float32x4x4_t a = vld4q_f32(q1);
+        float32x4x4_t b = vld4q_f32(q2);
+        float32x4x4_t r;
+
+        r.val[0] = vmulq_f32(a.val[0], b.val[0]);
+        r.val[0] = vmlsq_f32(r.val[0], a.val[1], b.val[1]);
+        r.val[0] = vmlsq_f32(r.val[0], a.val[2], b.val[2]);
+        r.val[0] = vmlsq_f32(r.val[0], a.val[3], b.val[3]);
+
+        r.val[1] = vmulq_f32(a.val[0], b.val[1]);
+        r.val[1] = vmlaq_f32(r.val[1], a.val[1], b.val[0]);
+        r.val[1] = vmlaq_f32(r.val[1], a.val[2], b.val[3]);
+        r.val[1] = vmlsq_f32(r.val[1], a.val[3], b.val[2]);
+
+        r.val[2] = vmulq_f32(a.val[0], b.val[2]);
+        r.val[2] = vmlsq_f32(r.val[2], a.val[1], b.val[3]);
+        r.val[2] = vmlaq_f32(r.val[2], a.val[2], b.val[0]);
+        r.val[2] = vmlaq_f32(r.val[2], a.val[3], b.val[1]);
+
+        r.val[3] = vmulq_f32(a.val[0], b.val[3]);
+        r.val[3] = vmlaq_f32(r.val[3], a.val[1], b.val[2]);
+        r.val[3] = vmlsq_f32(r.val[3], a.val[2], b.val[1]);
+        r.val[3] = vmlaq_f32(r.val[3], a.val[3], b.val[0]);
+
+        vst4q_f32(qProd, r);
+    }
+#endif
+    q_mult_c(q1, q2, qProd, count);
+}
+
+/**
+ *  @brief  Normalizes count quaternions in place.
+ *          Quaternions with a zero magnitude are set to [1,0,0,0].
+ *  @param[in,out]  q       count quaternions, 4 floats each.
+ *  @param[in]      count   number of quaternions.
+ */
+void inv_q_normalize_batchf(float *q, int count)
+{
+    INVENSENSE_FUNC_START;
+#ifdef INV_MATH_NEON
+    const float32x4_t zero = vdupq_n_f32(0.f);
+    const float32x4_t one = vdupq_n_f32(1.f);
+    for (; count >= 4; count -= 4, q += 16) {
+        float32x4x4_t v = vld4q_f32(q);
+        float32x4_t mag, scale;
+        uint32x4_t valid;
+
+        mag = vmulq_f32(v.val[0], v.val[0]);
+        mag = vmlaq_f32(mag, v.val[1], v.val[1]);
+        mag = vmlaq_f32(mag, v.val[2], v.val[2]);
+        mag = vmlaq_f32(mag, v.val[3], v.val[3]);
+        valid = vcgtq_f32(mag, zero);
+        scale = neon_rsqrt(mag);
+
+        v.val[0] = vbslq_f32(valid, vmulq_f32(v.val[0], scale), one);
+        v.val[1] = vbslq_f32(valid, vmulq_f32(v.val[1], scale), zero);
+        v.val[2] = vbslq_f32(valid, vmulq_f32(v.val[2], scale), zero);
+        v.val[3] = vbslq_f32(valid, vmulq_f32(v.val[3], scale), zero);
+        vst4q_f32(q, v);
+    }
+#endif
+    q_normalize_c(q, count);
+}
+
+/**
+ *  @brief  Converts count unit quaternions to rotation matrices.
+ *          Same convention as inv_quaternion_to_rotation(): the first 3
+ *          elements are the first row, and the matrix transforms a column
+ *          vector from Body to World.
+ *  @param[in]  quat    count quaternions, 4 floats each.
+ *  @param[out] rot     count rotation matrices, 9 floats each.
+ *  @param[in]  count   number of quaternions.
+ */
+void inv_quaternion_to_rotation_batchf(const float *quat, float *rot,
+                                       int count)
+{
+    INVENSENSE_FUNC_START;
+#ifdef INV_MATH_NEON
+    const float32x4_t two = vdupq_n_f32(2.f);
+    const float32x4_t one = vdupq_n_f32(1.f);
+    for (; count >= 4; count -= 4, quat += 16, rot += 36) {
+        float32x4x4_t q = vld4q_f32(quat);
+        float32x4_t w2 = vmulq_f32(two, q.val[0]);
+        float32x4_t x2 = vmulq_f32(two, q.val[1]);
+        float32x4_t y2 = vmulq_f32(two, q.val[2]);
+        float32x4_t ww2 = vmulq_f32(w2, q.val[0]);
+        float r[9][4];
+        int ii;
+
+        vst1q_f32(r[0], vsubq_f32(vmlaq_f32(ww2, x2, q.val[1]), one));
+        vst1q_f32(r[1], vmlsq_f32(vmulq_f32(x2, q.val[2]), w2, q.val[3]));
+        vst1q_f32(r[2], vmlaq_f32(vmulq_f32(x2, q.val[3]), w2, q.val[2]));
+        vst1q_f32(r[3], vmlaq_f32(vmulq_f32(x2, q.val[2]), w2, q.val[3]));
+        vst1q_f32(r[4], vsubq_f32(vmlaq_f32(ww2, y2, q.val[2]), one));
+        vst1q_f32(r[5], vmlsq_f32(vmulq_f32(y2, q.val[3]), w2, q.val[1]));
+        vst1q_f32(r[6], vmlsq_f32(vmulq_f32(x2, q.val[3]), w2, q.val[2]));
+        vst1q_f32(r[7], vmlaq_f32(vmulq_f32(y2, q.val[3]), w2, q.val[1]));
+        vst1q_f32(r[8], vsubq_f32(vmlaq_f32(ww2, vmulq_f32(two, q.val[3]),
+                                            q.val[3]), one));
+
+        /* transpose from lanes back to 9 contiguous elements per matrix */
+        for (ii = 0; ii < 4; ii++) {
+            float *m = rot + 9 * ii;
+            m[0] = r[0][ii];
+            m[1] = r[1][ii];
+            m[2] = r[2][ii];
+            m[3] = r[3][ii];
+            m[4] = r[4][ii];
+            m[5] = r[5][ii];
+            m[6] = r[6][ii];
+            m[7] = r[7][ii];
+            m[8] = r[8][ii];
+        }
+    }
+#endif
+    quaternion_to_rotation_c(quat, rot, count);
+}
+
+/**
+ *  @brief  Closed form determinant of a 3x3 row-major matrix.
+ */
+float inv_matrix_det3f(const float *m)
+{
+    return m[0] * (m[4] * m[8] - m[5] * m[7])
+        - m[1] * (m[3] * m[8] - m[5] * m[6])
+        + m[2] * (m[3] * m[7] - m[4] * m[6]);
+}
+
+/*
+ * 2x2 sub-determinants of the top (s) and bottom (c) two rows of a 4x4
+ * row-major matrix, shared by the determinant and the inverse.
+ */
+static void matrix4_minors(const float *m, float *s, float *c)
+{
+    s[0] = m[0] * m[5] - m[4] * m[1];
+    s[1] = m[0] * m[6] - m[4] * m[2];
+    s[2] = m[0] * m[7] - m[4] * m[3];
+    s[3] = m[1] * m[6] - m[5] * m[2];
+    s[4] = m[1] * m[7] - m[5] * m[3];
+    s[5] = m[2] * m[7] - m[6] * m[3];
+
+    c[5] = m[10] * m[15] - m[14] * m[11];
+    c[4] = m[9] * m[15] - m[13] * m[11];
+    c[3] = m[9] * m[14] - m[13] * m[10];
+    c[2] = m[8] * m[15] - m[12] * m[11];
+    c[1] = m[8] * m[14] - m[12] * m[10];
+    c[0] = m[8] * m[13] - m[12] * m[9];
+}
+
+/**
+ *  @brief  Closed form determinant of a 4x4 row-major matrix.
+ */
+float inv_matrix_det4f(const float *m)
+{
+    float s[6], c[6];
+    matrix4_minors(m, s, c);
+    return s[0] * c[5] - s[1] * c[4] + s[2] * c[3]
+        + s[3] * c[2] - s[4] * c[1] + s[5] * c[0];
+}
+
+/**
+ *  @brief  Inverts a 3x3 row-major matrix using its adjugate.
+ *  @param[in]  m   input matrix.
+ *  @param[out] inv inverse of m. Must not alias m.
+ *  @return INV_SUCCESS or INV_ERROR_DIVIDE_BY_ZERO if m is singular.
+ */
+inv_error_t inv_matrix_inverse3f(const float *m, float *inv)
+{
+    float det, idet;
+
+    inv[0] = m[4] * m[8] - m[5] * m[7];
+    inv[3] = m[5] * m[6] - m[3] * m[8];
+    inv[6] = m[3] * m[7] - m[4] * m[6];
+    det = m[0] * inv[0] + m[1] * inv[3] + m[2] * inv[6];
+    if (ABS(det) < INV_MATRIX_DET_EPSILON)
+        return INV_ERROR_DIVIDE_BY_ZERO;
+    idet = 1.f / det;
+
+    inv[0] *= idet;
+    inv[3] *= idet;
+    inv[6] *= idet;
+    inv[1] = (m[2] * m[7] - m[1] * m[8]) * idet;
+    inv[4] = (m[0] * m[8] - m[2] * m[6]) * idet;
+    inv[7] = (m[1] * m[6] - m[0] * m[7]) * idet;
+    inv[2] = (m[1] * m[5] - m[2] * m[4]) * idet;
+    inv[5] = (m[2] * m[3] - m[0] * m[5]) * idet;
+    inv[8] = (m[0] * m[4] - m[1] * m[3]) * idet;
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Inverts a 4x4 row-major matrix using its adjugate.
+ *  @param[in]  m   input matrix.
+ *  @param[out] inv inverse of m. Must not alias m.
+ *  @return INV_SUCCESS or INV_ERROR_DIVIDE_BY_ZERO if m is singular.
+ */
+inv_error_t inv_matrix_inverse4f(const float *m, float *inv)
+{
+    float s[6], c[6];
+    float det, idet;
+
+    matrix4_minors(m, s, c);
+    det = s[0] * c[5] - s[1] * c[4] + s[2] * c[3]
+        + s[3] * c[2] - s[4] * c[1] + s[5] * c[0];
+    if (ABS(det) < INV_MATRIX_DET_EPSILON)
+        return INV_ERROR_DIVIDE_BY_ZERO;
+    idet = 1.f / det;
+
+    inv[0] = (m[5] * c[5] - m[6] * c[4] + m[7] * c[3]) * idet;
+    inv[1] = (-m[1] * c[5] + m[2] * c[4] - m[3] * c[3]) * idet;
+    inv[2] = (m[13] * s[5] - m[14] * s[4] + m[15] * s[3]) * idet;
+    inv[3] = (-m[9] * s[5] + m[10] * s[4] - m[11] * s[3]) * idet;
+
+    inv[4] = (-m[4] * c[5] + m[6] * c[2] - m[7] * c[1]) * idet;
+    inv[5] = (m[0] * c[5] - m[2] * c[2] + m[3] * c[1]) * idet;
+    inv[6] = (-m[12] * s[5] + m[14] * s[2] - m[15] * s[1]) * idet;
+    inv[7] = (m[8] * s[5] - m[10] * s[2] + m[11] * s[1]) * idet;
+
+    inv[8] = (m[4] * c[4] - m[5] * c[2] + m[7] * c[0]) * idet;
+    inv[9] = (-m[0] * c[4] + m[1] * c[2] - m[3] * c[0]) * idet;
+    inv[10] = (m[12] * s[4] - m[13] * s[2] + m[15] * s[0]) * idet;
+    inv[11] = (-m[8] * s[4] + m[9] * s[2] - m[11] * s[0]) * idet;
+
+    inv[12] = (-m[4] * c[3] + m[5] * c[1] - m[6] * c[0]) * idet;
+    inv[13] = (m[0] * c[3] - m[1] * c[1] + m[2] * c[0]) * idet;
+    inv[14] = (-m[12] * s[3] + m[13] * s[1] - m[14] * s[0]) * idet;
+    inv[15] = (m[8] * s[3] - m[9] * s[1] + m[10] * s[0]) * idet;
+    return INV_SUCCESS;
+}
+
+/**
+ *  @}
+ */
@@ -0,0 +1,98 @@
+/*
+ $License:
+    Copyright (C) 2011 InvenSense Corporation, All Rights Reserved.
+ $
+ */
+#ifndef INVENSENSE_INV_MATH_FUNC_VEC_H__
+#define INVENSENSE_INV_MATH_FUNC_VEC_H__
+
+#include "mltypes.h"
+#include "mlmath.h"
+
+/*
+ * Batched single precision versions of the quaternion and rotation matrix
+ * helpers found in mlMathFunc.h.
+ * Quaternions are packed as [w x y z] and rotation matrices as 9 row-major
+ * elements, one after the other.
+ * The ARM NEON implementation is selected at build time when the compiler
+ * targets NEON (-mfpu=neon) and INV_MATH_NO_NEON is not defined; otherwise
+ * the portable scalar implementation is used.
+ */
+#if (defined(__ARM_NEON__) || defined(__ARM_NEON)) && !defined(INV_MATH_NO_NEON)
+#define INV_MATH_NEON 1
+#endif
+
+#define INV_FAST_ATAN2_MAX_ERROR (1.2e-5f)  /* radians */
+#define INV_FAST_ASIN_MAX_ERROR  (1.0e-6f)  /* radians */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     *  @brief  Approximates atan(z) for |z| <= 1.
+     *          Abramowitz & Stegun 4.4.49, max error 1.2e-5 rad.
+     */
+    static inline float inv_fast_atan_unit(float z)
+    {
+        float z2 = z * z;
+        return z * (0.9998660f + z2 * (-0.3302995f + z2 * (0.1801410f +
+                    z2 * (-0.0851330f + z2 * 0.0208351f))));
+    }
+
+    /**
+     *  @brief  Approximates atan2(y, x) in (-M_PI, M_PI].
+     *          Max error is INV_FAST_ATAN2_MAX_ERROR.
+     */
+    static inline float inv_fast_atan2f(float y, float x)
+    {
+        float ax = (x < 0) ? -x : x;
+        float ay = (y < 0) ? -y : y;
+        float ang;
+
+        if (ax == 0.f && ay == 0.f)
+            return 0.f;
+        if (ay <= ax) {
+            ang = inv_fast_atan_unit(ay / ax);
+        } else {
+            ang = (float)(M_PI / 2) - inv_fast_atan_unit(ax / ay);
+        }
+        if (x < 0)
+            ang = (float)M_PI - ang;
+        return (y < 0) ? -ang : ang;
+    }
+
+    /**
+     *  @brief  Approximates asin(x). The input is clamped to [-1, 1].
+     *          Abramowitz & Stegun 4.4.46, max error INV_FAST_ASIN_MAX_ERROR.
+     */
+    static inline float inv_fast_asinf(float x)
+    {
+        float ax = (x < 0) ? -x : x;
+        float r;
+
+        if (ax > 1.f)
+            ax = 1.f;
+        r = 1.5707963050f + ax * (-0.2145988016f + ax * (0.0889789874f +
+            ax * (-0.0501743046f + ax * (0.0308918810f + ax * (-0.0170881256f +
+            ax * (0.0066700901f + ax * -0.0012624911f))))));
+        r = (float)(M_PI / 2) - sqrtf(1.f - ax) * r;
+        return (x < 0) ? -r : r;
+    }
+
+    void inv_q30_to_float_batch(const long *q30, float *out, int count);
+    void inv_q_mult_batchf(const float *q1, const float *q2, float *qProd,
+                           int count);
+    void inv_q_normalize_batchf(float *q, int count);
+    void inv_quaternion_to_rotation_batchf(const float *quat, float *rot,
+                                           int count);
+
+    float inv_matrix_det3f(const float *m);
+    float inv_matrix_det4f(const float *m);
+    inv_error_t inv_matrix_inverse3f(const float *m, float *inv);
+    inv_error_t inv_matrix_inverse4f(const float *m, float *inv);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          // INVENSENSE_INV_MATH_FUNC_VEC_H__
@@ -65,6 +65,30 @@ inv_error_t inv_self_test_run(void)
                            INV_SIX_AXIS_GYRO_ACCEL, false, true);
 }
 
+/**
+ *  @brief  Runs the MPU Self Test at MPL runtime (short version) in quick
+ *          mode: the collection for each gyro clock source ends as soon as
+ *          the biases are known to be within threshold.
+ *          If the DMP is operating, stops the DMP temporarely,
+ *          runs the MPU Self Test, and re-starts the DMP.
+ *
+ *  @return INV_SUCCESS or a non-zero error code otherwise.
+ */
+inv_error_t inv_self_test_quick_run(void)
+{
+    inv_error_t result;
+
+    if (inv_get_state() < INV_STATE_DMP_OPENED) {
+        MPL_LOGE("Self Test cannot run before inv_dmp_open()\n");
+        return INV_ERROR_SM_IMPROPER_STATE;
+    }
+    inv_set_test_quick_mode(true);
+    result = inv_device_test(inv_get_serial_handle(),
+                             INV_SIX_AXIS_GYRO_ACCEL, false, true);
+    inv_set_test_quick_mode(false);
+    return result;
+}
+
 const char* inv_self_test_get_result(void)
 {
     return inv_device_get_log();
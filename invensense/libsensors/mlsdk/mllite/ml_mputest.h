@@ -24,6 +24,7 @@ extern "C" {
 inv_error_t inv_self_test_set_accel_z_orient(signed char z_sign);
 
 inv_error_t inv_self_test_run(void);
+inv_error_t inv_self_test_quick_run(void);
 inv_error_t inv_self_test_calibration_run(void);
 inv_error_t inv_self_test_bias_run(void);
 inv_error_t inv_self_test_accel_z_run(void);
@@ -34,6 +34,9 @@
 #include "mlsl.h"
 #include "mlos.h"
 
+#include <stddef.h>
+#include <string.h>
+
 #include "log.h"
 #undef MPL_LOG_TAG
 #define MPL_LOG_TAG "MPL-storeload"
@@ -48,6 +51,33 @@ typedef inv_error_t(*tMLLoadFunc) (unsigned char *, unsigned short);
 */
 extern struct inv_obj_t inv_obj;
 
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#error "calibration format type 6 is stored little endian"
+#endif
+
+/* every section starts on an 8 byte boundary, see ml_stored_data.h */
+#define INV_CAL_V6_LEN   (2720)
+typedef char inv_cal_image_len_check
+    [(sizeof(struct inv_cal_image_t) == INV_CAL_V6_LEN) ? 1 : -1];
+
+/*
+    Last calibration image read from or written to storage, used to skip
+    the write when no section changed.
+*/
+static struct inv_cal_image_t sCalImage;
+static int sCalImageValid = false;
+
+static const uint32_t sCalSectionOffset[INV_CAL_NUM_SECTIONS] = {
+    offsetof(struct inv_cal_image_t, temp_comp),
+    offsetof(struct inv_cal_image_t, accel),
+    offsetof(struct inv_cal_image_t, compass),
+};
+static const uint32_t sCalSectionLength[INV_CAL_NUM_SECTIONS] = {
+    sizeof(struct inv_cal_temp_comp_t),
+    sizeof(struct inv_cal_accel_t),
+    sizeof(struct inv_cal_compass_t),
+};
+
 /*
     Debugging Definitions
     set LOADCAL_DEBUG and/or STORECAL_DEBUG to 1 print the fields
@@ -965,6 +995,184 @@ inv_error_t inv_load_cal_V5(unsigned char *calData, unsigned short len)
     return INV_SUCCESS;
 }
 
+/**
+ *  @brief  Loads a type 6 set of calibration data.
+ *          Type 6 is a fixed layout image (struct inv_cal_image_t)
+ *          holding the same data as type 4, with a CRC per section, and is
+ *          the format written by inv_store_calibration().
+ *          The image is kept to detect which sections change before the
+ *          next store.
+ *
+ *  @pre    inv_dmp_open()
+ *          @ifnot MPL_MF
+ *              or inv_open_low_power_pedometer()
+ *              or inv_eis_open_dmp()
+ *          @endif
+ *          must have been called.
+ *
+ *  @param  calData
+ *              A pointer to an array of bytes to be parsed.
+ *  @param  len
+ *              the length of the calibration
+ *
+ *  @return INV_SUCCESS if successful, a non-zero error code otherwise.
+ */
+inv_error_t inv_load_cal_V6(unsigned char *calData, unsigned int len)
+{
+    INVENSENSE_FUNC_START;
+    struct inv_cal_image_t *img = &sCalImage;
+    struct inv_cal_temp_comp_t *tc = &img->temp_comp;
+    struct inv_cal_compass_t *cc = &img->compass;
+    inv_error_t result;
+    uint32_t crc;
+    long bias[3];
+    int i, j;
+
+    LOADCAL_LOG("Entering inv_load_cal_V6\n");
+
+    sCalImageValid = false;
+    if (len != sizeof(*img)) {
+        MPL_LOGE("Calibration data type 6 must be %d bytes long (got %d)\n",
+                 (int)sizeof(*img), len);
+        return INV_ERROR_FILE_READ;
+    }
+    /* copy first, calData may not be suitably aligned */
+    memcpy(img, calData, sizeof(*img));
+
+    if (img->hdr.magic != INV_CAL_MAGIC ||
+        img->hdr.version != INV_CAL_VERSION ||
+        img->hdr.num_sections != INV_CAL_NUM_SECTIONS ||
+        img->hdr.length != sizeof(*img)) {
+        MPL_LOGE("Invalid calibration data type 6 header\n");
+        return INV_ERROR_FILE_READ;
+    }
+    crc = img->hdr.crc;
+    img->hdr.crc = 0;
+    if (crc != inv_crc32(0, &img->hdr, sizeof(img->hdr))) {
+        MPL_LOGE("Calibration header checksum failed\n");
+        return INV_ERROR_CALIBRATION_CHECKSUM;
+    }
+    img->hdr.crc = crc;
+    for (i = 0; i < INV_CAL_NUM_SECTIONS; i++) {
+        struct inv_cal_section_t *sec = &img->hdr.section[i];
+        if (sec->offset != sCalSectionOffset[i] ||
+            sec->length != sCalSectionLength[i]) {
+            MPL_LOGE("Invalid calibration section %d\n", i);
+            return INV_ERROR_FILE_READ;
+        }
+        crc = inv_crc32(0, (unsigned char *)img + sec->offset, sec->length);
+        if (crc != sec->crc) {
+            MPL_LOGE("Calibration section %d checksum failed : "
+                     "0x%08x VS 0x%08x\n", i, sec->crc, crc);
+            return INV_ERROR_CALIBRATION_CHECKSUM;
+        }
+    }
+
+    /* gyro temperature compensation */
+    for (i = 0; i < BINS; i++) {
+        inv_obj.gyro_tc->temp_ptrs[i] = tc->temp_ptrs[i];
+        inv_obj.gyro_tc->temp_valid_data[i] = tc->temp_valid_data[i];
+        for (j = 0; j < PTS_PER_BIN; j++) {
+            inv_obj.gyro_tc->temp_data[i][j] = tc->temp_data[i][j];
+            inv_obj.gyro_tc->x_gyro_temp_data[i][j] =
+                tc->x_gyro_temp_data[i][j];
+            inv_obj.gyro_tc->y_gyro_temp_data[i][j] =
+                tc->y_gyro_temp_data[i][j];
+            inv_obj.gyro_tc->z_gyro_temp_data[i][j] =
+                tc->z_gyro_temp_data[i][j];
+        }
+    }
+
+    /* accel biases */
+    for (i = 0; i < 3; i++)
+        bias[i] = img->accel.bias[i];
+    result = inv_set_array(INV_ACCEL_BIAS, bias);
+    if (result) {
+        LOG_RESULT_LOCATION(result);
+        return result;
+    }
+
+    /* compass calibration */
+    inv_obj.adv_fusion->got_compass_bias = cc->got_compass_bias;
+    inv_obj.adv_fusion->got_init_compass_bias = cc->got_init_compass_bias;
+    inv_obj.adv_fusion->compass_state = cc->compass_state;
+    for (i = 0; i < 3; i++) {
+        inv_obj.adv_fusion->compass_bias_error[i] = cc->compass_bias_error[i];
+        inv_obj.mag->bias[i] = cc->bias[i];
+        inv_obj.adv_fusion->compass_scale[i] = cc->compass_scale[i];
+    }
+    bias[0] = (long)(inv_obj.mag->bias[0] * (1LL<<30) / inv_obj.mag->sens);
+    bias[1] = (long)(inv_obj.mag->bias[1] * (1LL<<30) / inv_obj.mag->sens);
+    bias[2] = (long)(inv_obj.mag->bias[2] * (1LL<<30) / inv_obj.mag->sens);
+    inv_set_compass_bias(NULL, bias);
+    for (i = 0; i < 18; i++)
+        inv_obj.adv_fusion->compass_peaks[i] = cc->compass_peaks[i];
+    memcpy(inv_obj.adv_fusion->compass_prev_xty, cc->compass_prev_xty,
+           sizeof(cc->compass_prev_xty));
+    memcpy(inv_obj.adv_fusion->compass_prev_m, cc->compass_prev_m,
+           sizeof(cc->compass_prev_m));
+
+    inv_obj.lite_fusion->got_no_motion_bias = true;
+    inv_obj.sys->cal_loaded_flag = true;
+    sCalImageValid = true;
+
+    LOADCAL_LOG("Exiting inv_load_cal_V6\n");
+    return INV_SUCCESS;
+}
+
+/**
+ *  @internal
+ *  @brief  Fills the sections of a type 6 image from the MPL state.
+ */
+static void inv_store_cal_V6(struct inv_cal_image_t *img)
+{
+    struct inv_cal_temp_comp_t *tc = &img->temp_comp;
+    struct inv_cal_compass_t *cc = &img->compass;
+    long bias[3];
+    int i, j;
+
+    memset(img, 0, sizeof(*img));
+
+    for (i = 0; i < BINS; i++) {
+        tc->temp_ptrs[i] = inv_obj.gyro_tc->temp_ptrs[i];
+        tc->temp_valid_data[i] = inv_obj.gyro_tc->temp_valid_data[i];
+        for (j = 0; j < PTS_PER_BIN; j++) {
+            tc->temp_data[i][j] = inv_obj.gyro_tc->temp_data[i][j];
+            tc->x_gyro_temp_data[i][j] =
+                inv_obj.gyro_tc->x_gyro_temp_data[i][j];
+            tc->y_gyro_temp_data[i][j] =
+                inv_obj.gyro_tc->y_gyro_temp_data[i][j];
+            tc->z_gyro_temp_data[i][j] =
+                inv_obj.gyro_tc->z_gyro_temp_data[i][j];
+        }
+    }
+
+    inv_get_array(INV_ACCEL_BIAS, bias);
+    for (i = 0; i < 3; i++)
+        img->accel.bias[i] = (int32_t) bias[i];
+
+    cc->got_compass_bias = (uint8_t) inv_obj.adv_fusion->got_compass_bias;
+    cc->got_init_compass_bias =
+        (uint8_t) inv_obj.adv_fusion->got_init_compass_bias;
+    if (inv_obj.adv_fusion->compass_state == SF_UNCALIBRATED) {
+        cc->compass_state = SF_UNCALIBRATED;
+    } else {
+        cc->compass_state = SF_STARTUP_SETTLE;
+    }
+    for (i = 0; i < 3; i++) {
+        cc->compass_bias_error[i] =
+            (int32_t) inv_obj.adv_fusion->compass_bias_error[i];
+        cc->bias[i] = (int32_t) inv_obj.mag->bias[i];
+        cc->compass_scale[i] = (int32_t) inv_obj.adv_fusion->compass_scale[i];
+    }
+    for (i = 0; i < 18; i++)
+        cc->compass_peaks[i] = inv_obj.adv_fusion->compass_peaks[i];
+    memcpy(cc->compass_prev_xty, inv_obj.adv_fusion->compass_prev_xty,
+           sizeof(cc->compass_prev_xty));
+    memcpy(cc->compass_prev_m, inv_obj.adv_fusion->compass_prev_m,
+           sizeof(cc->compass_prev_m));
+}
+
 /**
  * @brief   Loads a set of calibration data.
  *          It parses a binary data set containing calibration data.
@@ -979,10 +1187,12 @@ inv_error_t inv_load_cal_V5(unsigned char *calData, unsigned short len)
  *
  * @param   calData
  *              A pointer to an array of bytes to be parsed.
+ * @param   length
+ *              The amount of bytes available in the array.
  *
  * @return  INV_SUCCESS if successful, a non-zero error code otherwise.
  */
-inv_error_t inv_load_cal(unsigned char *calData)
+inv_error_t inv_load_cal(unsigned char *calData, unsigned int length)
 {
     INVENSENSE_FUNC_START;
     int calType = 0;
@@ -1003,6 +1213,20 @@ inv_error_t inv_load_cal(unsigned char *calData)
     if (inv_get_state() < INV_STATE_DMP_OPENED)
         return INV_ERROR_SM_IMPROPER_STATE;
 
+    if (length < INV_CAL_HDR_LEN + INV_CAL_CHK_LEN) {
+        MPL_LOGE("Calibration data too short (%d bytes)\n", length);
+        return INV_ERROR_FILE_READ;
+    }
+
+    /* type 6 starts with a little endian magic number instead of the
+       big endian length of the older types */
+    if (((uint32_t) calData[0] | (uint32_t) calData[1] << 8 |
+         (uint32_t) calData[2] << 16 | (uint32_t) calData[3] << 24)
+        == INV_CAL_MAGIC) {
+        return inv_load_cal_V6(calData, length);
+    }
+    sCalImageValid = false;
+
     /* read the header (type and len)
        len is the total record length including header and checksum */
     len = 0;
@@ -1011,6 +1235,13 @@ inv_error_t inv_load_cal(unsigned char *calData)
     len += 256 * ((int)calData[2]);
     len += (int)calData[3];
 
+    if (len < INV_CAL_HDR_LEN + INV_CAL_CHK_LEN ||
+        (unsigned int)len > length) {
+        MPL_LOGE("Invalid calibration data length %d (%d bytes read)\n",
+                 len, length);
+        return INV_ERROR_FILE_READ;
+    }
+
     calType = ((int)calData[4]) * 256 + ((int)calData[5]);
     if (calType > 5) {
         MPL_LOGE("Unsupported calibration file format %d. "
@@ -1309,12 +1540,22 @@ inv_error_t inv_load_calibration(void)
         goto free_mem_n_exit;
 
     }
-    result = inv_load_cal(calData);
+    result = inv_load_cal(calData, length);
     if (result) {
         MPL_LOGE("Could not load the calibration data - "
                  "error %d - aborting\n", result);
         goto free_mem_n_exit;
     }
+    if (!sCalImageValid) {
+        /* one-shot migration of type 0..5 data to type 6 */
+        MPL_LOGI("Converting calibration data to type %d\n",
+                 INV_CAL_VERSION);
+        result = inv_store_calibration();
+        if (result) {
+            MPL_LOGE("Could not convert the calibration data - "
+                     "error %d\n", result);
+        }
+    }
 
 free_mem_n_exit:
     inv_free(calData);
@@ -1333,38 +1574,58 @@ free_mem_n_exit:
  */
 inv_error_t inv_store_calibration(void)
 {
-    unsigned char *calData;
+    struct inv_cal_image_t *img;
     inv_error_t result;
-    unsigned int length;
+    int dirty = false;
+    int i;
 
     if (inv_get_state() < INV_STATE_DMP_OPENED)
         return INV_ERROR_SM_IMPROPER_STATE;
 
-    length = inv_get_cal_length();
-    calData = (unsigned char *)inv_malloc(length);
-    if (!calData) {
+    img = (struct inv_cal_image_t *)inv_malloc(sizeof(*img));
+    if (!img) {
         MPL_LOGE("Could not allocate buffer of %d bytes - "
-                 "aborting\n", length);
+                 "aborting\n", (int)sizeof(*img));
         return INV_ERROR_MEMORY_EXAUSTED;
     }
-    result = inv_store_cal(calData, length);
-    if (result) {
-        MPL_LOGE("Could not store calibrated data on file - "
-                 "error %d - aborting\n", result);
+    inv_store_cal_V6(img);
+
+    /* only the sections that changed since the last load/store need a
+       new CRC; when none did, the file is already up to date */
+    for (i = 0; i < INV_CAL_NUM_SECTIONS; i++) {
+        unsigned char *sec = (unsigned char *)img + sCalSectionOffset[i];
+        img->hdr.section[i].offset = sCalSectionOffset[i];
+        img->hdr.section[i].length = sCalSectionLength[i];
+        if (sCalImageValid &&
+            !memcmp(sec, (unsigned char *)&sCalImage + sCalSectionOffset[i],
+                    sCalSectionLength[i])) {
+            img->hdr.section[i].crc = sCalImage.hdr.section[i].crc;
+            continue;
+        }
+        STORECAL_LOG("section %d changed\n", i);
+        img->hdr.section[i].crc = inv_crc32(0, sec, sCalSectionLength[i]);
+        dirty = true;
+    }
+    if (!dirty)
         goto free_mem_n_exit;
 
-    }
-    result = inv_serial_write_cal(calData, length);
+    img->hdr.magic = INV_CAL_MAGIC;
+    img->hdr.version = INV_CAL_VERSION;
+    img->hdr.num_sections = INV_CAL_NUM_SECTIONS;
+    img->hdr.length = sizeof(*img);
+    img->hdr.crc = 0;
+    img->hdr.crc = inv_crc32(0, &img->hdr, sizeof(img->hdr));
+
+    result = inv_serial_write_cal((unsigned char *)img, sizeof(*img));
     if (result) {
         MPL_LOGE("Could not write calibration data - " "error %d\n", result);
         goto free_mem_n_exit;
-
     }
-
-
+    memcpy(&sCalImage, img, sizeof(*img));
+    sCalImageValid = true;
 
 free_mem_n_exit:
-    inv_free(calData);
+    inv_free(img);
     return INV_SUCCESS;
 }
 
@@ -22,6 +22,7 @@ extern "C" {
 */
 
 #include "mltypes.h"
+#include "ml.h"
 #include "ml_stored_data_legacy.h"
 
 /*
@@ -32,6 +33,75 @@ extern "C" {
 #define INV_CAL_HDR_LEN      (6)
 #define INV_CAL_CHK_LEN      (4)
 
+/*
+    Calibration format type 6.
+    A fixed layout, little endian image made of a header, a section
+    directory and one section per calibration block.  Every member is
+    naturally aligned and every section starts on an 8 byte boundary so
+    the image has the same layout on all ABIs and can be used in place
+    (e.g. mmapped) once its CRCs are verified.
+*/
+#define INV_CAL_MAGIC        (0x434C504DUL)     /* "MPLC" */
+#define INV_CAL_VERSION      (6)
+
+enum inv_cal_section_e {
+    INV_CAL_SECTION_TEMP_COMP = 0,
+    INV_CAL_SECTION_ACCEL,
+    INV_CAL_SECTION_COMPASS,
+
+    INV_CAL_NUM_SECTIONS
+};
+
+struct inv_cal_section_t {
+    uint32_t offset;
+    uint32_t length;
+    uint32_t crc;               /* inv_crc32() of the section */
+};
+
+struct inv_cal_hdr_t {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t num_sections;
+    uint32_t length;            /* whole image, header included */
+    uint32_t crc;               /* header and directory, with crc = 0 */
+    struct inv_cal_section_t section[INV_CAL_NUM_SECTIONS];
+    uint32_t reserved;
+};
+
+struct inv_cal_temp_comp_t {
+    int32_t temp_ptrs[BINS];
+    int32_t temp_valid_data[BINS];
+    float temp_data[BINS][PTS_PER_BIN];
+    float x_gyro_temp_data[BINS][PTS_PER_BIN];
+    float y_gyro_temp_data[BINS][PTS_PER_BIN];
+    float z_gyro_temp_data[BINS][PTS_PER_BIN];
+};
+
+struct inv_cal_accel_t {
+    int32_t bias[3];
+    int32_t reserved;
+};
+
+struct inv_cal_compass_t {
+    uint8_t got_compass_bias;
+    uint8_t got_init_compass_bias;
+    uint8_t compass_state;
+    uint8_t reserved;
+    int32_t compass_bias_error[3];
+    int32_t bias[3];
+    int32_t compass_peaks[18];
+    int32_t compass_scale[3];
+    double compass_prev_xty[6];
+    double compass_prev_m[36];
+};
+
+struct inv_cal_image_t {
+    struct inv_cal_hdr_t hdr;
+    struct inv_cal_temp_comp_t temp_comp;
+    struct inv_cal_accel_t accel;
+    struct inv_cal_compass_t compass;
+};
+
 /*
     APIs
 */
@@ -41,7 +111,8 @@ extern "C" {
 /*
     Other prototypes
 */
-    inv_error_t inv_load_cal(unsigned char *calData);
+    inv_error_t inv_load_cal(unsigned char *calData, unsigned int length);
+    inv_error_t inv_load_cal_V6(unsigned char *calData, unsigned int len);
     inv_error_t inv_store_cal(unsigned char *calData, int length);
     unsigned int inv_get_cal_length(void);
 
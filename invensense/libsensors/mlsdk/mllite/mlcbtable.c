@@ -0,0 +1,270 @@
+/*
+ $License:
+    Copyright (C) 2011 InvenSense Corporation, All Rights Reserved.
+ $
+ */
+
+/**
+ *  @defgroup   MLCBTABLE
+ *  @brief      Copy-on-write callback registries for the per-packet
+ *              dispatch of the Motion Library.
+ *
+ *  @{
+ *      @file   mlcbtable.c
+ *      @brief  Callback registries published as immutable snapshots.
+ */
+
+#include <string.h>
+
+#include "mlcbtable.h"
+#include "mlinclude.h"
+
+#include "log.h"
+#undef MPL_LOG_TAG
+#define MPL_LOG_TAG "MPL-cbtable"
+
+/**
+ *  @internal
+ *  @brief  Find a slot that is neither published nor walked by a dispatch.
+ *          Called with the table mutex held.
+ */
+static struct inv_cb_snapshot *inv_cb_table_free_slot(
+    struct inv_cb_table *table)
+{
+    int ii;
+
+    for (ii = 0; ii < INV_CB_TABLE_SLOTS; ii++) {
+        struct inv_cb_snapshot *snap = &table->slot[ii];
+        if (snap != table->current && snap->readers == 0) {
+            /* no reading of the old contents past this point */
+            __sync_synchronize();
+            return snap;
+        }
+    }
+    return NULL;
+}
+
+/**
+ *  @internal
+ *  @brief  Copy the published callbacks into a free slot, for editing.
+ *          Leaves the reader count of the slot alone, a failed
+ *          inv_cb_table_acquire() may still be undoing its increment.
+ */
+static struct inv_cb_snapshot *inv_cb_table_copy(struct inv_cb_table *table)
+{
+    struct inv_cb_snapshot *snap = inv_cb_table_free_slot(table);
+    const struct inv_cb_snapshot *cur = table->current;
+
+    if (snap == NULL) {
+        MPL_LOGE("no free callback table slot\n");
+        return NULL;
+    }
+    snap->num_cb = cur->num_cb;
+    memcpy(snap->cb, cur->cb, sizeof(snap->cb));
+    memcpy(snap->priority, cur->priority, sizeof(snap->priority));
+    return snap;
+}
+
+/**
+ *  @internal
+ *  @brief  Make an edited copy the published snapshot.
+ */
+static void inv_cb_table_publish(struct inv_cb_table *table,
+                                 struct inv_cb_snapshot *snap)
+{
+    /* the contents have to be visible before the pointer */
+    __sync_synchronize();
+    table->current = snap;
+}
+
+/**
+ *  @brief  Initialize an empty callback table.
+ *  @param  table   the table.
+ *  @param  max_cb  most callbacks the table accepts, up to
+ *                  INV_CB_TABLE_MAX.
+ *  @return INV_SUCCESS if successful, a non-zero error code otherwise.
+ */
+inv_error_t inv_cb_table_init(struct inv_cb_table *table, int max_cb)
+{
+    inv_error_t result;
+
+    if (max_cb > INV_CB_TABLE_MAX)
+        return INV_ERROR_INVALID_PARAMETER;
+
+    memset(table, 0, sizeof(*table));
+    result = inv_create_mutex(&table->mutex);
+    if (result) {
+        LOG_RESULT_LOCATION(result);
+        return result;
+    }
+    table->max_cb = max_cb;
+    table->current = &table->slot[0];
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Release the resources of a callback table.
+ *          No dispatch may be running on it.
+ *  @return INV_SUCCESS if successful, a non-zero error code otherwise.
+ */
+inv_error_t inv_cb_table_close(struct inv_cb_table *table)
+{
+    inv_error_t result = INV_SUCCESS;
+
+    if (table->current != NULL)
+        result = inv_destroy_mutex(table->mutex);
+    memset(table, 0, sizeof(*table));
+    return result;
+}
+
+/**
+ *  @brief  Register a callback, called in increasing order of priority.
+ *  @param  table       the table.
+ *  @param  func        the callback; may be registered once.
+ *  @param  priority    unique priority of the callback.
+ *  @return INV_SUCCESS if successful, a non-zero error code otherwise.
+ */
+inv_error_t inv_cb_table_add(struct inv_cb_table *table,
+                             inv_cb_func func, int priority)
+{
+    INVENSENSE_FUNC_START;
+    inv_error_t result;
+    struct inv_cb_snapshot *snap;
+    const struct inv_cb_snapshot *cur;
+    int kk, nn;
+
+    if (table->current == NULL)
+        return INV_ERROR_SM_IMPROPER_STATE;
+
+    result = inv_lock_mutex(table->mutex);
+    if (INV_SUCCESS != result) {
+        return result;
+    }
+    cur = table->current;
+
+    /* Make sure we haven't registered this function already
+       Or used the same priority */
+    for (kk = 0; kk < cur->num_cb; ++kk) {
+        if ((cur->cb[kk] == func) || (cur->priority[kk] == priority)) {
+            inv_unlock_mutex(table->mutex);
+            return INV_ERROR_INVALID_PARAMETER;
+        }
+    }
+
+    /* Make sure we have not filled up our number of allowable callbacks */
+    if (cur->num_cb >= table->max_cb) {
+        inv_unlock_mutex(table->mutex);
+        return INV_ERROR_MEMORY_EXAUSTED;
+    }
+
+    snap = inv_cb_table_copy(table);
+    if (snap == NULL) {
+        inv_unlock_mutex(table->mutex);
+        return INV_ERROR_MEMORY_EXAUSTED;
+    }
+
+    /* set kk to be where this new callback goes in the array */
+    kk = 0;
+    while ((kk < snap->num_cb) && (snap->priority[kk] < priority))
+        kk++;
+    for (nn = snap->num_cb; nn > kk; --nn) {
+        snap->cb[nn] = snap->cb[nn - 1];
+        snap->priority[nn] = snap->priority[nn - 1];
+    }
+    snap->cb[kk] = func;
+    snap->priority[kk] = priority;
+    snap->num_cb++;
+    if (priority >= table->next_priority)
+        table->next_priority = priority + 1;
+
+    inv_cb_table_publish(table, snap);
+    inv_unlock_mutex(table->mutex);
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Register a callback to be called after all the ones already
+ *          registered.
+ *  @return INV_SUCCESS if successful, a non-zero error code otherwise.
+ */
+inv_error_t inv_cb_table_append(struct inv_cb_table *table, inv_cb_func func)
+{
+    return inv_cb_table_add(table, func, table->next_priority);
+}
+
+/**
+ *  @brief  Unregister a callback.
+ *  @return INV_SUCCESS if successful, INV_ERROR_INVALID_PARAMETER if the
+ *          callback is not registered, a non-zero error code otherwise.
+ */
+inv_error_t inv_cb_table_remove(struct inv_cb_table *table, inv_cb_func func)
+{
+    INVENSENSE_FUNC_START;
+    inv_error_t result;
+    struct inv_cb_snapshot *snap;
+    const struct inv_cb_snapshot *cur;
+    int kk, jj;
+
+    if (table->current == NULL)
+        return INV_ERROR_SM_IMPROPER_STATE;
+
+    result = inv_lock_mutex(table->mutex);
+    if (INV_SUCCESS != result) {
+        return result;
+    }
+    cur = table->current;
+
+    for (kk = 0; kk < cur->num_cb; ++kk) {
+        if (cur->cb[kk] == func)
+            break;
+    }
+    if (kk == cur->num_cb) {
+        inv_unlock_mutex(table->mutex);
+        return INV_ERROR_INVALID_PARAMETER;
+    }
+
+    snap = inv_cb_table_copy(table);
+    if (snap == NULL) {
+        inv_unlock_mutex(table->mutex);
+        return INV_ERROR_MEMORY_EXAUSTED;
+    }
+    for (jj = kk + 1; jj < snap->num_cb; ++jj) {
+        snap->cb[jj - 1] = snap->cb[jj];
+        snap->priority[jj - 1] = snap->priority[jj];
+    }
+    snap->num_cb--;
+    snap->cb[snap->num_cb] = NULL;
+    snap->priority[snap->num_cb] = 0;
+
+    inv_cb_table_publish(table, snap);
+    inv_unlock_mutex(table->mutex);
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Whether a callback is registered.
+ *  @return true if it is, false otherwise.
+ */
+int inv_cb_table_contains(struct inv_cb_table *table, inv_cb_func func)
+{
+    const struct inv_cb_snapshot *snap;
+    int kk, found = false;
+
+    if (table->current == NULL)
+        return false;
+
+    inv_lock_mutex(table->mutex);
+    snap = table->current;
+    for (kk = 0; kk < snap->num_cb; ++kk) {
+        if (snap->cb[kk] == func) {
+            found = true;
+            break;
+        }
+    }
+    inv_unlock_mutex(table->mutex);
+    return found;
+}
+
+/**
+ * @}
+ */
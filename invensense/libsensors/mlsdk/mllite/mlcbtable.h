@@ -0,0 +1,99 @@
+/*
+ $License:
+    Copyright (C) 2011 InvenSense Corporation, All Rights Reserved.
+ $
+ */
+
+#ifndef __INV_CB_TABLE_H__
+#define __INV_CB_TABLE_H__
+
+#include "mltypes.h"
+#include "mlos.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  @file   mlcbtable.h
+ *  @brief  Callback registries walked without locking.
+ *
+ *  A table publishes its callbacks as an immutable snapshot, sorted by
+ *  priority.  Registration copies the current snapshot into a free slot,
+ *  edits the copy and swaps the published pointer; writers serialize on
+ *  the table mutex.  Dispatch walks whatever snapshot was published when
+ *  it started, so callbacks may register and unregister from within a
+ *  dispatch and the change is seen by the next one.
+ *
+ *  A snapshot is kept from being recycled while it is walked by a reader
+ *  count that only the dispatching thread updates: each table is to be
+ *  dispatched from one thread at a time, which the MPL processing already
+ *  requires.  Nested dispatch of the same table is allowed.
+ */
+
+#define INV_CB_TABLE_MAX        (16)
+#define INV_CB_TABLE_SLOTS      (4)
+
+typedef void (*inv_cb_func)(void);
+
+struct inv_cb_snapshot {
+    volatile int readers;
+    int num_cb;
+    inv_cb_func cb[INV_CB_TABLE_MAX];
+    int priority[INV_CB_TABLE_MAX];
+};
+
+struct inv_cb_table {
+    HANDLE mutex;               /* writers only */
+    int max_cb;
+    int next_priority;          /* for inv_cb_table_append() */
+    struct inv_cb_snapshot *volatile current;
+    struct inv_cb_snapshot slot[INV_CB_TABLE_SLOTS];
+};
+
+inv_error_t inv_cb_table_init(struct inv_cb_table *table, int max_cb);
+inv_error_t inv_cb_table_close(struct inv_cb_table *table);
+inv_error_t inv_cb_table_add(struct inv_cb_table *table,
+                             inv_cb_func func, int priority);
+inv_error_t inv_cb_table_append(struct inv_cb_table *table, inv_cb_func func);
+inv_error_t inv_cb_table_remove(struct inv_cb_table *table, inv_cb_func func);
+int inv_cb_table_contains(struct inv_cb_table *table, inv_cb_func func);
+
+/**
+ *  inv_cb_table_acquire() - pin the published snapshot for a dispatch.
+ *  Each call returning a snapshot has to be paired with
+ *  inv_cb_table_release() on it; NULL if the table was never initialized.
+ */
+static inline const struct inv_cb_snapshot *
+inv_cb_table_acquire(struct inv_cb_table *table)
+{
+    struct inv_cb_snapshot *snap;
+
+    for (;;) {
+        snap = table->current;
+        if (snap == NULL)
+            return NULL;
+        snap->readers++;
+        /* the count has to be visible before the pointer is checked again,
+           a writer tests them in the opposite order */
+        __sync_synchronize();
+        if (snap == table->current)
+            return snap;
+        snap->readers--;
+    }
+}
+
+static inline void inv_cb_table_release(const struct inv_cb_snapshot *snap)
+{
+    struct inv_cb_snapshot *s = (struct inv_cb_snapshot *)snap;
+
+    /* the walk has to be done before the slot can be seen as free */
+    __sync_synchronize();
+    s->readers--;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INV_CB_TABLE_H__ */
@@ -40,6 +40,7 @@
 #include "compass.h"
 #include "pressure.h"
 #include "mldl_cfg_init.h"
+#include "mlmath.h"
 
 #include "log.h"
 #undef MPL_LOG_TAG
@@ -905,6 +906,218 @@ inv_error_t inv_set_mpu_memory(unsigned short key,
     return result;
 }
 
+/**
+ *  @internal
+ *  @brief  Prepares an empty batch of MPU transfers.
+ *          Register reads and DMP memory accesses are queued with
+ *          inv_mpu_batch_read(), inv_mpu_batch_get_memory() and
+ *          inv_mpu_batch_set_memory() and then sent together by
+ *          inv_mpu_batch_submit(), executing in the order queued.
+ *          Buffers passed to the batch must stay valid until it has been
+ *          submitted; read buffers are only filled by the submit.
+ *  @param  batch   the batch to initialize.
+ */
+void inv_mpu_batch_init(struct inv_mpu_batch *batch)
+{
+    batch->count = 0;
+    batch->result = INV_SUCCESS;
+}
+
+/**
+ *  @internal
+ *  @brief  Keeps the first error of a batch; its submit then fails
+ *          without sending anything.
+ */
+static inv_error_t inv_mpu_batch_fail(struct inv_mpu_batch *batch,
+                                      inv_error_t result)
+{
+    if (result && INV_SUCCESS == batch->result) {
+        batch->result = result;
+        LOG_RESULT_LOCATION(result);
+    }
+    return result;
+}
+
+static inv_error_t inv_mpu_batch_add(struct inv_mpu_batch *batch,
+                                     unsigned char op,
+                                     unsigned short address,
+                                     unsigned short length,
+                                     unsigned char *buffer)
+{
+    struct inv_serial_xfer *xfer;
+
+    if (batch->result)
+        return batch->result;
+    if (batch->count >= INV_MPU_BATCH_MAX)
+        return inv_mpu_batch_fail(batch, INV_ERROR_MEMORY_EXAUSTED);
+    xfer = &batch->xfer[batch->count++];
+    xfer->op = op;
+    xfer->address = address;
+    xfer->length = length;
+    xfer->data = buffer;
+    return INV_SUCCESS;
+}
+
+/**
+ *  @internal
+ *  @brief  Queues a read of consecutive MPU registers.
+ *  @param  batch   the batch to add to.
+ *  @param  reg     first register to read.
+ *  @param  length  number of bytes to read.
+ *  @param  buffer  filled with the register values by the submit.
+ *  @return INV_SUCCESS if successful, a non-zero error code otherwise.
+ */
+inv_error_t inv_mpu_batch_read(struct inv_mpu_batch *batch,
+                               unsigned char reg,
+                               unsigned short length,
+                               unsigned char *buffer)
+{
+    if (NULL == buffer || length > SERIAL_MAX_TRANSFER_SIZE)
+        return inv_mpu_batch_fail(batch, INV_ERROR_INVALID_PARAMETER);
+    return inv_mpu_batch_add(batch, INV_SERIAL_XFER_READ, reg, length,
+                             buffer);
+}
+
+/**
+ *  @internal
+ *  @brief  Queues a read of the DMP memory at the location of a key.
+ *          Same as inv_get_mpu_memory(): while the device is suspended
+ *          the data is copied from the DMP cache right away.
+ *  @param  batch   the batch to add to.
+ *  @param  key     the key to use when looking up the address.
+ *  @param  length  number of bytes to read.
+ *  @param  buffer  result for data.
+ *  @return INV_SUCCESS if successful, a non-zero error code otherwise.
+ */
+inv_error_t inv_mpu_batch_get_memory(struct inv_mpu_batch *batch,
+                                     unsigned short key,
+                                     unsigned short length,
+                                     unsigned char *buffer)
+{
+    inv_error_t result = INV_SUCCESS;
+    unsigned short memAddr;
+    unsigned short sub_length;
+
+    if (batch->result)
+        return batch->result;
+    if (p_get_dmp_address == NULL)
+        return inv_mpu_batch_fail(batch, INV_ERROR_NOT_OPENED);
+    if (NULL == buffer)
+        return inv_mpu_batch_fail(batch, INV_ERROR_INVALID_PARAMETER);
+    memAddr = p_get_dmp_address(key);
+    if (memAddr >= 0xffff)
+        return inv_mpu_batch_fail(batch, INV_ERROR_FEATURE_NOT_IMPLEMENTED);
+
+    if (g_mldl_cfg->inv_mpu_state->status & MPU_DEVICE_IS_SUSPENDED) {
+        return inv_mpu_batch_fail(batch,
+                                  inv_get_mpu_memory(key, length, buffer));
+    }
+
+    while (length && INV_SUCCESS == result) {
+        /* transfers do not cross a bank */
+        sub_length = MIN(length, MPU_MEM_BANK_SIZE - (memAddr & 0xff));
+        result = inv_mpu_batch_add(batch, INV_SERIAL_XFER_READ_MEM,
+                                   memAddr, sub_length, buffer);
+        memAddr += sub_length;
+        buffer += sub_length;
+        length -= sub_length;
+    }
+    return result;
+}
+
+/**
+ *  @internal
+ *  @brief  Queues a write of the DMP memory at the location of a key.
+ *          Same as inv_set_mpu_memory(): the DMP cache is updated right
+ *          away and, while the device is suspended, nothing is queued and
+ *          the change is applied when the device is resumed.
+ *  @param  batch   the batch to add to.
+ *  @param  key     the key to use when looking up the address.
+ *  @param  length  number of bytes to write.
+ *  @param  buffer  data to write.
+ *  @return INV_SUCCESS if successful, a non-zero error code otherwise.
+ */
+inv_error_t inv_mpu_batch_set_memory(struct inv_mpu_batch *batch,
+                                     unsigned short key,
+                                     unsigned short length,
+                                     const unsigned char *buffer)
+{
+    inv_error_t result = INV_SUCCESS;
+    unsigned short memAddr;
+    unsigned short sub_length;
+    unsigned char *cache;
+    int different = 1;
+
+    if (batch->result)
+        return batch->result;
+    if (p_get_dmp_address == NULL) {
+        MPL_LOGE("%s : p_get_dmp_address is NULL\n", __func__);
+        return inv_mpu_batch_fail(batch, INV_ERROR_INVALID_MODULE);
+    }
+    if (NULL == buffer)
+        return inv_mpu_batch_fail(batch, INV_ERROR_INVALID_PARAMETER);
+    memAddr = p_get_dmp_address(key);
+    if (memAddr >= 0xffff) {
+        MPL_LOGE("inv_mpu_batch_set_memory unsupported key\n");
+        return inv_mpu_batch_fail(batch, INV_ERROR_INVALID_MODULE);
+    }
+    if (memAddr + length > MPU_MEM_NUM_RAM_BANKS * MPU_MEM_BANK_SIZE)
+        return inv_mpu_batch_fail(batch, INV_ERROR_INVALID_PARAMETER);
+
+    if (INV_CACHE_DMP != 0) {
+        cache = &g_mldl_cfg->mpu_ram->ram[memAddr];
+        different = memcmp(cache, buffer, length);
+        memcpy(cache, buffer, length);
+    }
+
+    if (g_mldl_cfg->inv_mpu_state->status & MPU_DEVICE_IS_SUSPENDED) {
+        if (different) {
+            g_mldl_cfg->inv_mpu_state->status |= MPU_GYRO_NEEDS_CONFIG;
+            if (INV_CACHE_DMP == 0) {
+                MPL_LOGE("INV_CACHE_DMP == 0:"
+                         " tried to inv_set_mpu_memory while device suspended\n");
+                result = INV_ERROR_SERIAL_WRITE;
+            }
+        }
+        return inv_mpu_batch_fail(batch, result);
+    }
+
+    while (length && INV_SUCCESS == result) {
+        sub_length = MIN(length, MPU_MEM_BANK_SIZE - (memAddr & 0xff));
+        result = inv_mpu_batch_add(batch, INV_SERIAL_XFER_WRITE_MEM,
+                                   memAddr, sub_length,
+                                   (unsigned char *)buffer);
+        memAddr += sub_length;
+        buffer += sub_length;
+        length -= sub_length;
+    }
+    return result;
+}
+
+/**
+ *  @internal
+ *  @brief  Sends the queued transfers to the MPU and empties the batch.
+ *          Nothing is sent when queueing failed; read buffers are then
+ *          left as they were.
+ *  @param  batch   the batch to submit.
+ *  @return INV_SUCCESS if every transfer was queued and executed
+ *          successfully, the first error otherwise.
+ */
+inv_error_t inv_mpu_batch_submit(struct inv_mpu_batch *batch)
+{
+    inv_error_t result = batch->result;
+
+    if (INV_SUCCESS == result && batch->count) {
+        result = inv_serial_submit(g_mlsl_handle,
+                                   g_mldl_cfg->mpu_chip_info->addr,
+                                   batch->xfer, batch->count);
+        if (result)
+            LOG_RESULT_LOCATION(result);
+    }
+    inv_mpu_batch_init(batch);
+    return result;
+}
+
 /**
  *  @brief  Load the DMP with the given code and configuration.
  *  @param  buffer
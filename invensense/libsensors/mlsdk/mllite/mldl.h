@@ -92,6 +92,15 @@ typedef enum {
     /* - Structures. - */
     /* --------------- */
 
+#define INV_MPU_BATCH_MAX           (16)
+
+    /** Register and DMP memory transfers sent to the MPU in one submit. */
+struct inv_mpu_batch {
+    int count;
+    inv_error_t result;         /* first error while queueing */
+    struct inv_serial_xfer xfer[INV_MPU_BATCH_MAX];
+};
+
     /* --------------- */
     /* - Variables.  - */
     /* --------------- */
@@ -127,6 +136,20 @@ extern "C" {
     inv_error_t inv_set_mpu_memory(unsigned short key,
                                    unsigned short length,
                                    const unsigned char *buffer);
+    void inv_mpu_batch_init(struct inv_mpu_batch *batch);
+    inv_error_t inv_mpu_batch_read(struct inv_mpu_batch *batch,
+                                   unsigned char reg,
+                                   unsigned short length,
+                                   unsigned char *buffer);
+    inv_error_t inv_mpu_batch_get_memory(struct inv_mpu_batch *batch,
+                                         unsigned short key,
+                                         unsigned short length,
+                                         unsigned char *buffer);
+    inv_error_t inv_mpu_batch_set_memory(struct inv_mpu_batch *batch,
+                                         unsigned short key,
+                                         unsigned short length,
+                                         const unsigned char *buffer);
+    inv_error_t inv_mpu_batch_submit(struct inv_mpu_batch *batch);
     inv_error_t inv_load_dmp(const unsigned char *buffer,
                              unsigned short length,
                              unsigned short startAddress);
@@ -60,7 +60,7 @@ static int mldl_cfg_push_gyro(void *gyro_handle, __u32 key,
     config.len = len;
     config.apply = 0;
     config.data = data;
-    if (ioctl((int)gyro_handle, MPU_CONFIG_GYRO, &config))
+    if (inv_serial_ioctl(gyro_handle, MPU_CONFIG_GYRO, &config))
         return errno;
     return 0;
 }
@@ -73,7 +73,7 @@ static int mldl_cfg_pull_gyro(void *gyro_handle, __u32 key,
     config.len = len;
     config.apply = 0;
     config.data = data;
-    if (ioctl((int)gyro_handle, MPU_GET_CONFIG_GYRO, &config))
+    if (inv_serial_ioctl(gyro_handle, MPU_GET_CONFIG_GYRO, &config))
         return errno;
 
     return 0;
@@ -188,8 +188,8 @@ static int mldl_cfg_push_inv_mpu_cfg(void *gyro_handle,
                                      struct inv_mpu_cfg *inv_mpu_cfg)
 {
     int result;
-    result = ioctl((int) gyro_handle, MPU_SET_IGNORE_SYSTEM_SUSPEND,
-                   inv_mpu_cfg->ignore_system_suspend);
+    result = inv_serial_ioctl(gyro_handle, MPU_SET_IGNORE_SYSTEM_SUSPEND,
+                (void *)(unsigned long)inv_mpu_cfg->ignore_system_suspend);
     if (result)
         result = errno;
     if (result) {
@@ -383,16 +383,16 @@ static int mldl_cfg_pull_inv_mpu_cfg(void *gyro_handle,
                                      struct inv_mpu_cfg *inv_mpu_cfg)
 {
     int result;
-    result = ioctl((int) gyro_handle, MPU_GET_REQUESTED_SENSORS,
-                   &inv_mpu_cfg->requested_sensors);
+    result = inv_serial_ioctl(gyro_handle, MPU_GET_REQUESTED_SENSORS,
+                              &inv_mpu_cfg->requested_sensors);
     if (result)
         result = errno;
     if (result) {
         LOG_RESULT_LOCATION(result);
         return result;
     }
-    result = ioctl((int) gyro_handle, MPU_GET_IGNORE_SYSTEM_SUSPEND,
-                   &inv_mpu_cfg->ignore_system_suspend);
+    result = inv_serial_ioctl(gyro_handle, MPU_GET_IGNORE_SYSTEM_SUSPEND,
+                              &inv_mpu_cfg->ignore_system_suspend);
     if (result)
         result = errno;
     if (result) {
@@ -405,16 +405,16 @@ static int mldl_cfg_pull_inv_mpu_state(void *gyro_handle,
                                        struct inv_mpu_state *inv_mpu_state)
 {
     int result;
-    result = ioctl((int) gyro_handle, MPU_GET_MLDL_STATUS,
-                   &inv_mpu_state->status);
+    result = inv_serial_ioctl(gyro_handle, MPU_GET_MLDL_STATUS,
+                              &inv_mpu_state->status);
     if (result)
         result = errno;
     if (result) {
         LOG_RESULT_LOCATION(result);
         return result;
     }
-    result = ioctl((int) gyro_handle, MPU_GET_I2C_SLAVES_ENABLED,
-                   &inv_mpu_state->i2c_slaves_enabled);
+    result = inv_serial_ioctl(gyro_handle, MPU_GET_I2C_SLAVES_ENABLED,
+                              &inv_mpu_state->i2c_slaves_enabled);
     if (result)
         result = errno;
     if (result) {
@@ -426,14 +426,14 @@ static int mldl_cfg_pull_inv_mpu_state(void *gyro_handle,
 static int mldl_cfg_pull_ext_slave_descr(void *gyro_handle,
                                          struct ext_slave_descr *slave)
 {
-    if (ioctl((int)gyro_handle, MPU_GET_EXT_SLAVE_DESCR, slave))
+    if (inv_serial_ioctl(gyro_handle, MPU_GET_EXT_SLAVE_DESCR, slave))
         return errno;
     return 0;
 }
 static int mldl_cfg_pull_mpu_platform_data(void *gyro_handle,
                                            struct mpu_platform_data *pdata)
 {
-    if (ioctl((int)gyro_handle, MPU_GET_MPU_PLATFORM_DATA, pdata))
+    if (inv_serial_ioctl(gyro_handle, MPU_GET_MPU_PLATFORM_DATA, pdata))
         return errno;
     return 0;
 }
@@ -441,8 +441,8 @@ static int mldl_cfg_pull_ext_slave_platform_data(
     void *gyro_handle,
     struct ext_slave_platform_data *pdata_slave)
 {
-    if (ioctl((int)gyro_handle,
-              MPU_GET_EXT_SLAVE_PLATFORM_DATA, pdata_slave))
+    if (inv_serial_ioctl(gyro_handle,
+                         MPU_GET_EXT_SLAVE_PLATFORM_DATA, pdata_slave))
         return errno;
     return 0;
 }
@@ -628,7 +628,7 @@ int inv_mpu_resume(struct mldl_cfg* mldl_cfg,
 
     mldl_print_cfg(mldl_cfg);
 
-    result = ioctl((int)mlsl_handle, MPU_RESUME, sensors);
+    result = inv_serial_ioctl(mlsl_handle, MPU_RESUME, (void *)sensors);
     if (result)
         result = errno;
     if (result) {
@@ -663,7 +663,7 @@ int inv_mpu_suspend(struct mldl_cfg *mldl_cfg,
         LOG_RESULT_LOCATION(result);
         return result;
     }
-    result = ioctl((int)mlsl_handle, MPU_SUSPEND, sensors);
+    result = inv_serial_ioctl(mlsl_handle, MPU_SUSPEND, (void *)sensors);
     if (result)
         result = errno;
     if (result) {
@@ -737,17 +737,17 @@ int inv_mpu_slave_read(struct mldl_cfg *mldl_cfg,
 
     switch (slave->type) {
     case EXT_SLAVE_TYPE_ACCEL:
-        result = ioctl((int)gyro_handle, MPU_READ_ACCEL, data);
+        result = inv_serial_ioctl(gyro_handle, MPU_READ_ACCEL, data);
         if (result)
             result = errno;
         break;
     case EXT_SLAVE_TYPE_COMPASS:
-        result = ioctl((int)gyro_handle, MPU_READ_COMPASS, data);
+        result = inv_serial_ioctl(gyro_handle, MPU_READ_COMPASS, data);
         if (result)
             result = errno;
         break;
     case EXT_SLAVE_TYPE_PRESSURE:
-        result = ioctl((int)gyro_handle, MPU_READ_PRESSURE, data);
+        result = inv_serial_ioctl(gyro_handle, MPU_READ_PRESSURE, data);
         if (result)
             result = errno;
         break;
@@ -787,7 +787,7 @@ int inv_mpu_slave_config(struct mldl_cfg *mldl_cfg,
 
     switch (slave->type) {
     case EXT_SLAVE_TYPE_ACCEL:
-        result = ioctl((int)gyro_handle, MPU_CONFIG_ACCEL, data);
+        result = inv_serial_ioctl(gyro_handle, MPU_CONFIG_ACCEL, data);
         if (result)
             result = errno;
         if (result) {
@@ -796,7 +796,7 @@ int inv_mpu_slave_config(struct mldl_cfg *mldl_cfg,
         }
         break;
     case EXT_SLAVE_TYPE_COMPASS:
-        result = ioctl((int)gyro_handle, MPU_CONFIG_COMPASS, data);
+        result = inv_serial_ioctl(gyro_handle, MPU_CONFIG_COMPASS, data);
         if (result)
             result = errno;
         if (result) {
@@ -805,7 +805,7 @@ int inv_mpu_slave_config(struct mldl_cfg *mldl_cfg,
         }
         break;
     case EXT_SLAVE_TYPE_PRESSURE:
-        result = ioctl((int)gyro_handle, MPU_CONFIG_PRESSURE, data);
+        result = inv_serial_ioctl(gyro_handle, MPU_CONFIG_PRESSURE, data);
         if (result)
             result = errno;
         if (result) {
@@ -851,21 +851,21 @@ int inv_mpu_get_slave_config(struct mldl_cfg *mldl_cfg,
     }
     switch (slave->type) {
     case EXT_SLAVE_TYPE_ACCEL:
-        result = ioctl((int)gyro_handle, MPU_GET_CONFIG_ACCEL, data);
+        result = inv_serial_ioctl(gyro_handle, MPU_GET_CONFIG_ACCEL, data);
         if (result) {
             LOG_RESULT_LOCATION(result);
             return result;
         }
         break;
     case EXT_SLAVE_TYPE_COMPASS:
-        result = ioctl((int)gyro_handle, MPU_GET_CONFIG_COMPASS, data);
+        result = inv_serial_ioctl(gyro_handle, MPU_GET_CONFIG_COMPASS, data);
         if (result) {
             LOG_RESULT_LOCATION(result);
             return result;
         }
         break;
     case EXT_SLAVE_TYPE_PRESSURE:
-        result = ioctl((int)gyro_handle, MPU_GET_CONFIG_PRESSURE, data);
+        result = inv_serial_ioctl(gyro_handle, MPU_GET_CONFIG_PRESSURE, data);
         if (result) {
             LOG_RESULT_LOCATION(result);
             return result;
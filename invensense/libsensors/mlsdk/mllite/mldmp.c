@@ -228,6 +228,11 @@ inv_error_t inv_dmp_start(void)
         LOG_RESULT_LOCATION(result);
         return result;
     }
+    result = inv_start_compass_sampler();
+    if (result) {
+        LOG_RESULT_LOCATION(result);
+        return result;
+    }
     return result;
 }
 
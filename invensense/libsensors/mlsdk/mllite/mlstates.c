@@ -32,6 +32,7 @@
 #include "mlinclude.h"
 #include "ml.h"
 #include "mlos.h"
+#include "mlcbtable.h"
 
 #include <log.h>
 #undef MPL_LOG_TAG
@@ -41,13 +42,7 @@
 
 #define MAX_STATE_CHANGE_PROCESSES (8)
 
-struct state_callback_obj {
-    int_fast8_t numStateChangeCallbacks;
-    HANDLE mutex;
-    state_change_callback_t stateChangeCallbacks[MAX_STATE_CHANGE_PROCESSES];
-};
-
-static struct state_callback_obj sStateChangeCallbacks = { 0 };
+static struct inv_cb_table sStateChangeCallbacks;
 
 /* --------------- */
 /* -  Functions. - */
@@ -55,16 +50,14 @@ static struct state_callback_obj sStateChangeCallbacks = { 0 };
 
 static inv_error_t inv_init_state_callbacks(void)
 {
-    memset(&sStateChangeCallbacks, 0, sizeof(sStateChangeCallbacks));
-    return inv_create_mutex(&sStateChangeCallbacks.mutex);
+    inv_cb_table_close(&sStateChangeCallbacks);
+    return inv_cb_table_init(&sStateChangeCallbacks,
+                             MAX_STATE_CHANGE_PROCESSES);
 }
 
 static inv_error_t MLStateCloseCallbacks(void)
 {
-    inv_error_t result;
-    result = inv_destroy_mutex(sStateChangeCallbacks.mutex);
-    memset(&sStateChangeCallbacks, 0, sizeof(sStateChangeCallbacks));
-    return result;
+    return inv_cb_table_close(&sStateChangeCallbacks);
 }
 
 /**
@@ -163,37 +156,7 @@ unsigned char inv_get_state(void)
 inv_error_t inv_register_state_callback(state_change_callback_t callback)
 {
     INVENSENSE_FUNC_START;
-    int kk;
-    inv_error_t result;
-
-    result = inv_lock_mutex(sStateChangeCallbacks.mutex);
-    if (INV_SUCCESS != result) {
-        return result;
-    }
-    // Make sure we have not filled up our number of allowable callbacks
-    if (sStateChangeCallbacks.numStateChangeCallbacks <
-        MAX_STATE_CHANGE_PROCESSES) {
-        // Make sure we haven't registered this function already
-        for (kk = 0; kk < sStateChangeCallbacks.numStateChangeCallbacks; ++kk) {
-            if (sStateChangeCallbacks.stateChangeCallbacks[kk] == callback) {
-                result = INV_ERROR_INVALID_PARAMETER;
-                break;
-            }
-        }
-
-        if (INV_SUCCESS == result) {
-            // Add new callback
-            sStateChangeCallbacks.stateChangeCallbacks[sStateChangeCallbacks.
-                                                       numStateChangeCallbacks]
-                = callback;
-            sStateChangeCallbacks.numStateChangeCallbacks++;
-        }
-    } else {
-        result = INV_ERROR_MEMORY_EXAUSTED;
-    }
-
-    inv_unlock_mutex(sStateChangeCallbacks.mutex);
-    return result;
+    return inv_cb_table_append(&sStateChangeCallbacks, (inv_cb_func)callback);
 }
 
 /**
@@ -206,53 +169,33 @@ inv_error_t inv_register_state_callback(state_change_callback_t callback)
 inv_error_t inv_unregister_state_callback(state_change_callback_t callback)
 {
     INVENSENSE_FUNC_START;
-    int kk, jj;
-    inv_error_t result;
-
-    result = inv_lock_mutex(sStateChangeCallbacks.mutex);
-    if (INV_SUCCESS != result) {
-        return result;
-    }
-    // Make sure we haven't registered this function already
-    result = INV_ERROR_INVALID_PARAMETER;
-    for (kk = 0; kk < sStateChangeCallbacks.numStateChangeCallbacks; ++kk) {
-        if (sStateChangeCallbacks.stateChangeCallbacks[kk] == callback) {
-            for (jj = kk + 1;
-                 jj < sStateChangeCallbacks.numStateChangeCallbacks; ++jj) {
-                sStateChangeCallbacks.stateChangeCallbacks[jj - 1] =
-                    sStateChangeCallbacks.stateChangeCallbacks[jj];
-            }
-            sStateChangeCallbacks.numStateChangeCallbacks--;
-            result = INV_SUCCESS;
-            break;
-        }
-    }
-
-    inv_unlock_mutex(sStateChangeCallbacks.mutex);
-    return result;
+    return inv_cb_table_remove(&sStateChangeCallbacks, (inv_cb_func)callback);
 }
 
+/**
+ * @internal
+ * @brief   Run the state callbacks in order of registration, until one
+ *          fails. Callbacks registered or unregistered by a callback take
+ *          effect from the next state change.
+ */
 inv_error_t inv_run_state_callbacks(unsigned char newState)
 {
     int kk;
-    inv_error_t result;
+    inv_error_t result = INV_SUCCESS;
+    const struct inv_cb_snapshot *snap;
 
-    result = inv_lock_mutex(sStateChangeCallbacks.mutex);
-    if (INV_SUCCESS != result) {
-        MPL_LOGE("MLOsLockMutex returned %d\n", result);
-        return result;
-    }
+    snap = inv_cb_table_acquire(&sStateChangeCallbacks);
+    if (snap == NULL)
+        return INV_SUCCESS;
 
-    for (kk = 0; kk < sStateChangeCallbacks.numStateChangeCallbacks; ++kk) {
-        if (sStateChangeCallbacks.stateChangeCallbacks[kk]) {
-            result = sStateChangeCallbacks.stateChangeCallbacks[kk] (newState);
-            if (INV_SUCCESS != result) {
-                break;          // Can't return, must release mutex
-            }
+    for (kk = 0; kk < snap->num_cb; ++kk) {
+        result = ((state_change_callback_t)snap->cb[kk]) (newState);
+        if (INV_SUCCESS != result) {
+            break;
         }
     }
 
-    inv_unlock_mutex(sStateChangeCallbacks.mutex);
+    inv_cb_table_release(snap);
     return result;
 }
 
@@ -268,16 +211,7 @@ inv_error_t inv_run_state_callbacks(unsigned char newState)
 inv_error_t inv_check_state_callback(state_change_callback_t callback,
     unsigned char *is_registered)
 {
-    int ii;
-
-    is_registered[0] = false;
-
-    for (ii = 0; ii < sStateChangeCallbacks.numStateChangeCallbacks; ii++) {
-        if (sStateChangeCallbacks.stateChangeCallbacks[ii] == callback) {
-            is_registered[0] = true;
-            break;
-        }
-    }
-
+    is_registered[0] =
+        inv_cb_table_contains(&sStateChangeCallbacks, (inv_cb_func)callback);
     return INV_SUCCESS;
 }
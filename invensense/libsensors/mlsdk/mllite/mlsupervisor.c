@@ -32,6 +32,7 @@
 #include "mlFIFO.h"
 #include "mlFIFOHW.h"
 #include "mlMathFunc.h"
+#include "mlMathFuncVec.h"
 #include "mlsupervisor.h"
 #include "mlmath.h"
 #include "compass_supervisor.h"
@@ -48,6 +49,10 @@ static long s_compass_test_bias[3]; // Compass bias in mounting frame, raw units
 
 #define SUPERVISOR_DEBUG 0
 
+/* det(C) / trace(C)^3 of the covariance C of the compass samples below
+   which they are taken as flat: 1/27 for a sphere, 0 for a plane */
+#define COMPASS_CAL_MIN_SPREAD (1e-3f)
+
 /**
  *  @brief  This initializes all variables that should be reset on
  */
@@ -73,14 +78,13 @@ static int MLUpdateCompassCalibration3DOF(int command, long *data,
     INVENSENSE_FUNC_START;
     int retValue = INV_SUCCESS;
     static float m[10][10] = { {0} };
-    float mInv[10][10] = { {0} };
-    float mTmp[10][10] = { {0} };
+    float mPacked[16];
+    float mInv[16];
+    float cov[9], trace;
     static float xTransY[4] = { 0 };
     float magSqr = 0;
     float inpData[3] = { 0 };
     int i, j;
-    int a, b;
-    float d;
     switch (command) {
     case CAL_ADD_DATA:
         inpData[0] = (float)data[0];
@@ -111,24 +115,32 @@ static int MLUpdateCompassCalibration3DOF(int command, long *data,
         xTransY[3] += magSqr;
         break;
     case CAL_RUN:
-        a = 4;
-        b = a;
-        for (i = 0; i < b; i++) {
-            for (j = 0; j < b; j++) {
-                a = b;
-                inv_matrix_det_inc(&m[0][0], &mTmp[0][0], &a, i, j);
-                mInv[j][i] = SIGNM(i + j) * inv_matrix_det(&mTmp[0][0], &a);
+        /* samples close to a plane leave the bias along its normal to
+           the noise: m holds 4 * sum(x * x') and -2 * sum(x) */
+        if (m[3][3] < 1.0f)
+            return INV_ERROR;
+        for (i = 0; i < 3; i++) {
+            for (j = 0; j < 3; j++) {
+                cov[i * 3 + j] = m[i][j] - m[i][3] * m[3][j] / m[3][3];
+            }
+        }
+        trace = cov[0] + cov[4] + cov[8];
+        if (inv_matrix_det3f(cov) <
+            COMPASS_CAL_MIN_SPREAD * trace * trace * trace) {
+            return INV_ERROR;
+        }
+        for (i = 0; i < 4; i++) {
+            for (j = 0; j < 4; j++) {
+                mPacked[i * 4 + j] = m[i][j];
             }
         }
-        a = b;
-        d = inv_matrix_det(&m[0][0], &a);
-        if (d == 0) {
+        if (inv_matrix_inverse4f(mPacked, mInv) != INV_SUCCESS) {
             return INV_ERROR;
         }
         for (i = 0; i < 3; i++) {
             float tmp = 0;
             for (j = 0; j < 4; j++) {
-                tmp += mInv[j][i] / d * xTransY[j];
+                tmp += mInv[j * 4 + i] * xTransY[j];
             }
             s_compass_test_bias[i] = -(long)(tmp * (1L<<16));
         }
@@ -248,6 +260,16 @@ inv_error_t inv_pressure_supervisor(void)
 {
     long pressureSensorData[1];
     static unsigned long pressurePolltime = 0;
+    int got_data;
+
+    /* read in the background by the compass sampler thread */
+    if (inv_get_sampled_pressure(&pressureSensorData[0], &got_data) ==
+        INV_SUCCESS) {
+        if (got_data)
+            inv_obj.pressure->meas = pressureSensorData[0];
+        return INV_SUCCESS;
+    }
+
     if (inv_pressure_present()) {   /* check for pressure data */
         unsigned long ctime = inv_get_tick_count();
         if ((pressurePolltime == 0 || ((ctime - pressurePolltime) > 80))) { //every 1/8 second
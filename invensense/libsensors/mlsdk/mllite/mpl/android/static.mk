@@ -54,9 +54,11 @@ ML_SOURCES += $(MLLITE_DIR)/mlarray_lite.c
 ML_SOURCES += $(MLLITE_DIR)/mlarray_adv.c
 ML_SOURCES += $(MLLITE_DIR)/mlarray_legacy.c
 ML_SOURCES += $(MLLITE_DIR)/mlBiasNoMotion.c
+ML_SOURCES += $(MLLITE_DIR)/mlcbtable.c
 ML_SOURCES += $(MLLITE_DIR)/mlFIFO.c
 ML_SOURCES += $(MLLITE_DIR)/mlFIFOHW.c
 ML_SOURCES += $(MLLITE_DIR)/mlMathFunc.c
+ML_SOURCES += $(MLLITE_DIR)/mlMathFuncVec.c
 ML_SOURCES += $(MLLITE_DIR)/mlcontrol.c
 ML_SOURCES += $(MLLITE_DIR)/mldl.c
 ML_SOURCES += $(MLLITE_DIR)/mldmp.c
@@ -94,6 +96,11 @@ $(OBJFOLDER) :
 	@$(call echo_in_colors, "\n<creating object's folder 'obj/'>\n")
 	mkdir obj
 
+# only the vector math helpers are built for NEON
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+$(OBJFOLDER)/mlMathFuncVec.c.o : CFLAGS += -mfpu=neon -mfloat-abi=softfp
+endif
+
 $(ML_OBJS_DST) : $(OBJFOLDER)/%.c.o : %.c  $(MK_NAME)
 	@$(call echo_in_colors, "\n<compile $< to $(OBJFOLDER)/$(notdir $@)>\n")
 	$(COMP) $(CFLAGS) $(ANDROID_INCLUDES) $(KERNEL_INCLUDES) $(MLSDK_INCLUDES) -o $@ -c $<
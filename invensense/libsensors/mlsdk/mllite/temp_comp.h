@@ -19,10 +19,17 @@ extern "C" {
 
 #include "mltypes.h"
 
+/* Fit models of the gyro bias over temperature */
+#define INV_TEMP_COMP_LINEAR        (0)     /* B = a + b T, default */
+#define INV_TEMP_COMP_QUADRATIC     (1)     /* B = a + b T + c T^2 */
+#define INV_TEMP_COMP_PIECEWISE     (2)     /* linear, from the nearby bins */
+
 /* APIs */
 inv_error_t inv_enable_temp_comp(void);
 inv_error_t inv_disable_temp_comp(void);
 inv_error_t inv_temp_comp_is_enabled(unsigned char *is_enabled);
+inv_error_t inv_set_temp_comp_model(int model);
+inv_error_t inv_get_temp_comp_model(int *model);
 /* Formerly declared in ml.h: */
 inv_error_t inv_get_gyro_temp_slope(long *data);
 inv_error_t inv_get_gyro_temp_slope_float(float *data);
@@ -50,6 +50,18 @@
 /*
     Data Structures
 */
+
+/*  Running sums of the normal equations of the fit, over the points of one
+    bin or of the whole table; kept in double so that evicting a point does
+    not leave float residue behind. */
+struct _TCSums {
+    double n;
+    double t, t2, t3, t4;
+    double g[GYRO_NUM_AXES];
+    double gt[GYRO_NUM_AXES];
+    double gt2[GYRO_NUM_AXES];
+};
+
 struct _TC {
     short haveSlope;
     int noMotionTimer;
@@ -63,6 +75,10 @@ struct _TC {
     unsigned long lastTime;
     long temperatureRange;
     int first_pass;
+    /* zeroed along with the rest on reset, rebuilt from the table on use */
+    int sumsValid;
+    struct _TCSums binSums[BINS];
+    struct _TCSums sums;
 };
 
 /*
@@ -71,6 +87,7 @@ struct _TC {
 extern struct inv_supervisor_cb_obj ml_supervisor_cb;
 
 struct _TC tcData;
+static int tcModel = INV_TEMP_COMP_LINEAR;
 
 /*
     Prototypes
@@ -190,6 +207,42 @@ inv_error_t inv_temp_comp_is_enabled(unsigned char *is_enabled)
     return INV_SUCCESS;
 }
 
+/**
+ *  @brief  Select the model fitted to the temperature table.
+ *          The DMP only takes a linear correction, so for the non-linear
+ *          models the tangent at the current temperature is pushed down.
+ *          Takes effect at the next recomputation of the fit.
+ *  @param  model
+ *              INV_TEMP_COMP_LINEAR, INV_TEMP_COMP_QUADRATIC or
+ *              INV_TEMP_COMP_PIECEWISE.
+ *  @return INV_SUCCESS if successful, a non-zero error code otherwise.
+ */
+inv_error_t inv_set_temp_comp_model(int model)
+{
+    if (model != INV_TEMP_COMP_LINEAR &&
+        model != INV_TEMP_COMP_QUADRATIC &&
+        model != INV_TEMP_COMP_PIECEWISE) {
+        return INV_ERROR_INVALID_PARAMETER;
+    }
+    tcModel = model;
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Get the model fitted to the temperature table.
+ *  @param[out] model
+ *              one of INV_TEMP_COMP_LINEAR, INV_TEMP_COMP_QUADRATIC or
+ *              INV_TEMP_COMP_PIECEWISE.
+ *  @return INV_SUCCESS if successful, a non-zero error code otherwise.
+ */
+inv_error_t inv_get_temp_comp_model(int *model)
+{
+    if (NULL == model)
+        return INV_ERROR_INVALID_PARAMETER;
+    *model = tcModel;
+    return INV_SUCCESS;
+}
+
 /**
  *  @brief  Reset the temperature compensation algorithm internal state
  *          machine.
@@ -270,7 +323,7 @@ int inv_temp_comp_find_bin(float temp)
 {
     int bin;
 
-    bin = (int)((temp - MIN_TEMP) / ((MAX_TEMP - MIN_TEMP) / BINS));
+    bin = (int)((temp - MIN_TEMP) / TEMP_PER_BIN);
     if (bin < 0)
         bin = 0;
     if (bin > BINS - 1)
@@ -355,6 +408,164 @@ void temp_comp_print_table(void)
     MPL_LOGI("\n");
 }
 
+/**
+ *  @internal
+ *  @brief  Add (sign = +1) or evict (sign = -1) one point of the table
+ *          to/from a set of running sums.
+ */
+static void temp_comp_sums_update(struct _TCSums *s, double sign, float temp,
+                                  float x, float y, float z)
+{
+    double t = temp;
+    double t2 = t * t;
+    double g[GYRO_NUM_AXES];
+    int i;
+
+    g[0] = x;
+    g[1] = y;
+    g[2] = z;
+    s->n += sign;
+    s->t += sign * t;
+    s->t2 += sign * t2;
+    s->t3 += sign * t2 * t;
+    s->t4 += sign * t2 * t2;
+    for (i = 0; i < GYRO_NUM_AXES; i++) {
+        s->g[i] += sign * g[i];
+        s->gt[i] += sign * g[i] * t;
+        s->gt2[i] += sign * g[i] * t2;
+    }
+}
+
+static void temp_comp_sums_merge(struct _TCSums *s, const struct _TCSums *b)
+{
+    int i;
+
+    s->n += b->n;
+    s->t += b->t;
+    s->t2 += b->t2;
+    s->t3 += b->t3;
+    s->t4 += b->t4;
+    for (i = 0; i < GYRO_NUM_AXES; i++) {
+        s->g[i] += b->g[i];
+        s->gt[i] += b->gt[i];
+        s->gt2[i] += b->gt2[i];
+    }
+}
+
+/**
+ *  @internal
+ *  @brief  Rebuild the sums of one bin from the points it holds: every
+ *          point once the bin has filled up, the first temp_ptrs[] before.
+ */
+static void temp_comp_rebuild_bin(int bin)
+{
+    struct _TCSums *s = &tcData.binSums[bin];
+    int k, count;
+
+    memset(s, 0, sizeof(*s));
+    if (inv_obj.gyro_tc->temp_valid_data[bin])
+        count = PTS_PER_BIN;
+    else
+        count = inv_obj.gyro_tc->temp_ptrs[bin];
+    for (k = 0; k < count; k++) {
+        temp_comp_sums_update(s, 1., inv_obj.gyro_tc->temp_data[bin][k],
+                              inv_obj.gyro_tc->x_gyro_temp_data[bin][k],
+                              inv_obj.gyro_tc->y_gyro_temp_data[bin][k],
+                              inv_obj.gyro_tc->z_gyro_temp_data[bin][k]);
+    }
+}
+
+/**
+ *  @internal
+ *  @brief  Re-add the table totals from the per-bin sums.
+ */
+static void temp_comp_rebuild_totals(void)
+{
+    int j;
+
+    memset(&tcData.sums, 0, sizeof(tcData.sums));
+    for (j = 0; j < BINS; j++)
+        temp_comp_sums_merge(&tcData.sums, &tcData.binSums[j]);
+}
+
+/**
+ *  @internal
+ *  @brief  Rebuild all the sums from the temperature table; needed after
+ *          a reset or when the table is loaded from a calibration file.
+ */
+static void temp_comp_rebuild_sums(void)
+{
+    int j;
+
+    for (j = 0; j < BINS; j++)
+        temp_comp_rebuild_bin(j);
+    temp_comp_rebuild_totals();
+    tcData.sumsValid = true;
+}
+
+/**
+ *  @internal
+ *  @brief  Store one no motion point in the bin of its temperature,
+ *          in place of the oldest one of a full bin, and update the sums.
+ *  @param  temp
+ *              The temperature of the point in degree C.
+ *  @param  gyro
+ *              The gyro biases of the point in dps, for the 3 axis.
+ */
+static void temp_comp_add_point(float temp, const float *gyro)
+{
+    int bin = inv_temp_comp_find_bin(temp);
+    int *tempPtr = &(inv_obj.gyro_tc->temp_ptrs[bin]);
+    int slot = *tempPtr;
+
+    if (!tcData.sumsValid)
+        temp_comp_rebuild_sums();
+
+    /* a full bin drops its oldest point for the new one */
+    if (inv_obj.gyro_tc->temp_valid_data[bin]) {
+        temp_comp_sums_update(&tcData.binSums[bin], -1.,
+                              inv_obj.gyro_tc->temp_data[bin][slot],
+                              inv_obj.gyro_tc->x_gyro_temp_data[bin][slot],
+                              inv_obj.gyro_tc->y_gyro_temp_data[bin][slot],
+                              inv_obj.gyro_tc->z_gyro_temp_data[bin][slot]);
+        temp_comp_sums_update(&tcData.sums, -1.,
+                              inv_obj.gyro_tc->temp_data[bin][slot],
+                              inv_obj.gyro_tc->x_gyro_temp_data[bin][slot],
+                              inv_obj.gyro_tc->y_gyro_temp_data[bin][slot],
+                              inv_obj.gyro_tc->z_gyro_temp_data[bin][slot]);
+    }
+
+    inv_obj.gyro_tc->temp_data[bin][*tempPtr] = temp;
+    inv_obj.gyro_tc->x_gyro_temp_data[bin][*tempPtr] = gyro[0];
+    inv_obj.gyro_tc->y_gyro_temp_data[bin][*tempPtr] = gyro[1];
+    inv_obj.gyro_tc->z_gyro_temp_data[bin][*tempPtr] = gyro[2];
+
+    if (!MPL_LOG_NDEBUG) {
+        MPL_LOGV(
+            "temp_comp -> add data to temp table : "
+            "%+10.3f degC - %+10.3f %+10.3f %+10.3f dps\n",
+            temp, gyro[0], gyro[1], gyro[2]);
+        temp_comp_print_table();
+    }
+
+    /* Treat each bin as a circular buffer
+       If pointer wraps around, set the data valid bit,
+       indicating that the bin is full. */
+    *tempPtr = (*tempPtr + 1) % PTS_PER_BIN;
+    if (*tempPtr == 0) {
+        inv_obj.gyro_tc->temp_valid_data[bin] = true;
+        /* once per lap of a bin, start its sums and the totals over
+           so that rounding from add/evict cannot build up */
+        temp_comp_rebuild_bin(bin);
+        temp_comp_rebuild_totals();
+    } else {
+        temp_comp_sums_update(&tcData.binSums[bin], 1., temp,
+                              gyro[0], gyro[1], gyro[2]);
+        temp_comp_sums_update(&tcData.sums, 1., temp,
+                              gyro[0], gyro[1], gyro[2]);
+    }
+}
+
 /**
  *  @brief  Add old data to temperature table.
  *          Adding current data risks adding a motion point, since there is a
@@ -376,32 +587,7 @@ static inv_error_t temp_comp_add_data(void)
 
     /* got data from a previous run */
     if (tcData.gotLastData) {
-        int bin = inv_temp_comp_find_bin(tcData.lastTemp);
-        int *tempPtr = &(inv_obj.gyro_tc->temp_ptrs[bin]);
-
-        inv_obj.gyro_tc->temp_data[bin][*tempPtr] = tcData.lastTemp;
-        inv_obj.gyro_tc->x_gyro_temp_data[bin][*tempPtr] = tcData.lastGyroData[0];
-        inv_obj.gyro_tc->y_gyro_temp_data[bin][*tempPtr] = tcData.lastGyroData[1];
-        inv_obj.gyro_tc->z_gyro_temp_data[bin][*tempPtr] = tcData.lastGyroData[2];
-
-        if (!MPL_LOG_NDEBUG) {
-            MPL_LOGV(
-                "temp_comp -> add data to temp table : "
-                "%+10.3f degC - %+10.3f %+10.3f %+10.3f dps\n",
-                tcData.lastTemp,
-                tcData.lastGyroData[0],
-                tcData.lastGyroData[1],
-                tcData.lastGyroData[2]
-                );
-            temp_comp_print_table();
-        }
-
-        /* Treat each bin as a circular buffer
-           If pointer wraps around, set the data valid bit,
-           indicating that the bin is full. */
-        *tempPtr = (*tempPtr + 1) % PTS_PER_BIN;
-        if (*tempPtr == 0)
-            inv_obj.gyro_tc->temp_valid_data[bin] = true;
+        temp_comp_add_point(tcData.lastTemp, tcData.lastGyroData);
 
         /*  Track the current bias and temperature to be used as the offset
             (temp comp table will only be used to generate the slope) */
@@ -548,69 +734,57 @@ inv_error_t inv_set_dmp_slope(float slope_x, float slope_y, float slope_z)
 
 
 /**
- *  @brief  Walk through temperature table and construct a linear fit.
- *          Should only access bins near current temperature?
- *  @return INV_SUCCESS if successful, a non-zero error code otherwise.
+ *  @internal
+ *  @brief  Closed form least squares fit of B = c0 + c1 T from a set of sums.
+ *  @return true if the points span a wide enough temperature range
+ *          (about 8 deg. C), false otherwise.
  */
-static inv_error_t temp_comp_recompute(void)
+static int temp_comp_fit_linear(const struct _TCSums *s, double coef[][3])
 {
-#define ORD 1
-    float mXGyro[3] = {0};
-    float mYGyro[3] = {0};
-    float mZGyro[3] = {0};
-    float m[3][3] = {{0}};
-    float minv[3][3] = {{0}};
-    float det = 0;
-    int i, j, k;
+    double det = s->n * s->t2 - s->t * s->t;
+    int i;
 
-    for (j = 0; j < BINS; j++) {
-        for (k = 0; k < PTS_PER_BIN; k++) {
-            float temp;
-            if (!inv_obj.gyro_tc->temp_valid_data[j]
-                    || k >= inv_obj.gyro_tc->temp_ptrs[j]) {
-                continue;
-            }
+    /* check that determinant is big enough */
+    if (fabs(det) < 100.)
+        return false;
 
-            temp = inv_obj.gyro_tc->temp_data[j][k];
-
-            m[0][0] += 1.f;
-            m[0][1] += temp;
-            m[0][2] += temp * temp;
-            m[1][0] += temp;
-            m[1][1] += temp * temp;
-            m[1][2] += temp * temp * temp;
-            m[2][0] += temp * temp;
-            m[2][1] += temp * temp * temp;
-            m[2][2] += temp * temp * temp * temp;
-
-            mXGyro[0] += inv_obj.gyro_tc->x_gyro_temp_data[j][k];
-            mXGyro[1] += inv_obj.gyro_tc->x_gyro_temp_data[j][k] * temp;
-            mXGyro[2] += inv_obj.gyro_tc->x_gyro_temp_data[j][k] * temp * temp;
-
-            mYGyro[0] += inv_obj.gyro_tc->y_gyro_temp_data[j][k];
-            mYGyro[1] += inv_obj.gyro_tc->y_gyro_temp_data[j][k] * temp;
-            mYGyro[2] += inv_obj.gyro_tc->y_gyro_temp_data[j][k] * temp * temp;
-
-            mZGyro[0] += inv_obj.gyro_tc->z_gyro_temp_data[j][k];
-            mZGyro[1] += inv_obj.gyro_tc->z_gyro_temp_data[j][k] * temp;
-            mZGyro[2] += inv_obj.gyro_tc->z_gyro_temp_data[j][k] * temp * temp;
-        }
+    for (i = 0; i < GYRO_NUM_AXES; i++) {
+        coef[i][0] = (s->t2 * s->g[i] - s->t * s->gt[i]) / det;
+        coef[i][1] = (s->n * s->gt[i] - s->t * s->g[i]) / det;
+        coef[i][2] = 0.;
     }
+    return true;
+}
+
+/**
+ *  @internal
+ *  @brief  Closed form least squares fit of B = c0 + c1 T + c2 T^2 from a
+ *          set of sums.
+ *  @return true if the normal equations are well conditioned,
+ *          false otherwise.
+ */
+static int temp_comp_fit_quadratic(const struct _TCSums *s, double coef[][3])
+{
+    double m[3][3], minv[3][3];
+    double det;
+    int i;
+
+    if (s->n < 3.)
+        return false;
+
+    m[0][0] = s->n;  m[0][1] = s->t;  m[0][2] = s->t2;
+    m[1][0] = s->t;  m[1][1] = s->t2; m[1][2] = s->t3;
+    m[2][0] = s->t2; m[2][1] = s->t3; m[2][2] = s->t4;
 
-#if (ORD == 2)
-    /* Second order fit (not currently used, probably better to
-       do piece-wise linear) */
     det =
         m[0][0] * m[1][1] * m[2][2] - m[0][0] * m[1][2] * m[2][1] -
         m[0][1] * m[1][0] * m[2][2] + m[0][1] * m[1][2] * m[2][0] +
         m[0][2] * m[1][0] * m[2][1] - m[0][2] * m[1][1] * m[2][0];
 
     /* check that determinant is big enough */
-    if (fabs(det) < 100.f) {
-        return;
-    }
+    if (fabs(det) < 100.)
+        return false;
 
-    /* Matrix inversion for second order fit */
     minv[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) / det;
     minv[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) / det;
     minv[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) / det;
@@ -621,45 +795,108 @@ static inv_error_t temp_comp_recompute(void)
     minv[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) / det;
     minv[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) / det;
 
-    /* Populate coefficients for second order fit */
-    for (i = 0; i < 3; i++) {
-        inv_obj.gyro_tc->x_gyro_coef[i] = 0.f;
-        inv_obj.gyro_tc->y_gyro_coef[i] = 0.f;
-        inv_obj.gyro_tc->z_gyro_coef[i] = 0.f;
-        for (j = 0; j < 3; j++) {
-            inv_obj.gyro_tc->x_gyro_coef[i] += minv[j][i] * mXGyro[j];
-            inv_obj.gyro_tc->y_gyro_coef[i] += minv[j][i] * mYGyro[j];
-            inv_obj.gyro_tc->z_gyro_coef[i] += minv[j][i] * mZGyro[j];
+    for (i = 0; i < GYRO_NUM_AXES; i++) {
+        coef[i][0] = minv[0][0] * s->g[i] + minv[1][0] * s->gt[i] +
+            minv[2][0] * s->gt2[i];
+        coef[i][1] = minv[0][1] * s->g[i] + minv[1][1] * s->gt[i] +
+            minv[2][1] * s->gt2[i];
+        coef[i][2] = minv[0][2] * s->g[i] + minv[1][2] * s->gt[i] +
+            minv[2][2] * s->gt2[i];
+    }
+    return true;
+}
+
+/**
+ *  @internal
+ *  @brief  Linear fit over the bins around the current temperature,
+ *          widened until they span enough of a temperature range.
+ *  @return true if a fit was found, false otherwise.
+ */
+static int temp_comp_fit_piecewise(float temp, double coef[][3])
+{
+    struct _TCSums s;
+    int bin = inv_temp_comp_find_bin(temp);
+    int width, j;
+
+    memset(&s, 0, sizeof(s));
+    temp_comp_sums_merge(&s, &tcData.binSums[bin]);
+    for (width = 1; width <= 2; width++) {
+        for (j = bin - width; j <= bin + width; j += 2 * width) {
+            if (j >= 0 && j < BINS)
+                temp_comp_sums_merge(&s, &tcData.binSums[j]);
         }
+        if (temp_comp_fit_linear(&s, coef))
+            return true;
     }
-#else
-    /* Linear fit */
-    det = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+    return false;
+}
 
-    /* check that determinant is big enough;
-       (temperature range has to be at least 8 deg. C wide) */
-    if (fabs(det) < 100.f) {
-        return INV_SUCCESS;
+/**
+ *  @internal
+ *  @brief  Fit the selected model to the temperature table, as the line
+ *          B = coef[axis][0] + coef[axis][1] T tangent to it at temp.
+ *          The table is summarized by running sums updated as points are
+ *          added, so this is constant time whatever the table holds.
+ *  @return true if a fit was found, false if there are too few points.
+ */
+static int temp_comp_fit(float temp, double coef[][3])
+{
+    int i, fitted;
+
+    if (!tcData.sumsValid)
+        temp_comp_rebuild_sums();
+
+    switch (tcModel) {
+    case INV_TEMP_COMP_QUADRATIC:
+        fitted = temp_comp_fit_quadratic(&tcData.sums, coef);
+        break;
+    case INV_TEMP_COMP_PIECEWISE:
+        fitted = temp_comp_fit_piecewise(temp, coef);
+        break;
+    default:
+        fitted = false;
+        break;
+    }
+    /* too few points for the selected model: fall back to a line */
+    if (!fitted && !temp_comp_fit_linear(&tcData.sums, coef))
+        return false;
+
+    /*  The coefficients are kept as B = a + b T, the form the DMP applies;
+        for a curve that is its tangent at the current temperature. */
+    for (i = 0; i < GYRO_NUM_AXES; i++) {
+        double slope = coef[i][1] + 2. * coef[i][2] * temp;
+        double intercept = coef[i][0] - coef[i][2] * temp * temp;
+        coef[i][0] = intercept;
+        coef[i][1] = slope;
     }
+    return true;
+}
+
+/**
+ *  @brief  Fit the selected model to the temperature table and push the
+ *          slope down to the DMP.
+ *  @return INV_SUCCESS if successful, a non-zero error code otherwise.
+ */
+static inv_error_t temp_comp_recompute(void)
+{
+    double coef[GYRO_NUM_AXES][3];
+    float temp;
+    int i;
 
-    /* Matrix inversion for linear fit */
-    minv[0][0] = +m[1][1] / det;
-    minv[0][1] = -m[1][0] / det;
-    minv[1][0] = -m[0][1] / det;
-    minv[1][1] = +m[0][0] / det;
+    temp_comp_get_temp(&temp);
+    if (!temp_comp_fit(temp, coef))
+        return INV_SUCCESS;
 
-    /* Populate coefficients for first order fit */
-    for (i = 0; i < 2; i++) {
+    for (i = 0; i < 3; i++) {
         inv_obj.gyro_tc->x_gyro_coef[i] = 0.f;
         inv_obj.gyro_tc->y_gyro_coef[i] = 0.f;
         inv_obj.gyro_tc->z_gyro_coef[i] = 0.f;
-        for (j = 0; j < 2; j++) {
-            inv_obj.gyro_tc->x_gyro_coef[i] += minv[j][i] * mXGyro[j];
-            inv_obj.gyro_tc->y_gyro_coef[i] += minv[j][i] * mYGyro[j];
-            inv_obj.gyro_tc->z_gyro_coef[i] += minv[j][i] * mZGyro[j];
-        }
     }
-#endif
+    for (i = 0; i < 2; i++) {
+        inv_obj.gyro_tc->x_gyro_coef[i] = (float)coef[0][i];
+        inv_obj.gyro_tc->y_gyro_coef[i] = (float)coef[1][i];
+        inv_obj.gyro_tc->z_gyro_coef[i] = (float)coef[2][i];
+    }
 
     {
         inv_error_t result;
@@ -711,6 +948,8 @@ inv_error_t temp_comp_load_calibration_handler(void)
     MPL_LOGV("Load Calibration Handler\n");
 
     tcData.gotLastData = false;
+    /* the table was replaced, its sums have to be rebuilt */
+    tcData.sumsValid = false;
 
     /* recompute the temp comp table */
     result = temp_comp_recompute();
@@ -728,7 +967,7 @@ inv_error_t temp_comp_load_calibration_handler(void)
     /* find best guess for gyro offset */
     bin = inv_temp_comp_find_bin(newTemp);
 
-    /* If we have a slope from the ORD order fit,
+    /* If we have a slope from the fit,
         apply it to the biases with B = a + b T */
     if (tcData.haveSlope) {
         newBiases[0] =
@@ -11,6 +11,7 @@ extern "C" {
 #endif
 
     uint32_t inv_checksum(unsigned char *str, int len);
+    uint32_t inv_crc32(uint32_t crc, const void *data, int len);
 
 #ifdef __cplusplus
 }
@@ -89,6 +89,12 @@ extern "C" {
                                                   calibration data file      */
 #define DEF_PERIOD_SELF          (75)          /* ms of time, self test */
 #define DEF_PERIOD_CAL           (600)         /* ms of time, full cal */
+#define DEF_QUICK_SPLIT          (3)           /* windows per period, quick
+                                                  mode */
+#define DEF_QUICK_MIN_SAMPLES    (20)          /* samples per clock source
+                                                  before an early exit      */
+#define DEF_QUICK_SIGMAS         (3)           /* bias confidence bound, in
+                                                  standard errors           */
 
 /*
     Macros
@@ -111,8 +117,23 @@ typedef struct {
     int bias_thresh;
     unsigned int tests_per_axis;
     unsigned short accel_samples;
+    uint_fast8_t quick;
 } tTestSetup;
 
+/* running statistics of a set of 3 axis samples */
+typedef struct {
+    long n;
+    double mean[3];
+    double m2[3];               /* sum of squared deviations from the mean */
+} tTestStats;
+
+/* buffers kept from one test run to the next */
+typedef struct {
+    unsigned char fifo[2][FIFO_HW_SIZE];    /* windows read and in flight */
+    unsigned char *pending;     /* window read but not yet accounted */
+    int pending_count;
+} tTestSession;
+
 /*
     Global variables
 */
@@ -126,9 +147,12 @@ static tTestSetup test_setup = {
     DEF_TOTAL_TIMING_TOL,
     (int)DEF_BIAS_THRESH_SELF,  /* now obsolete - has no effect */
     DEF_TESTS_PER_AXIS,
-    DEF_N_ACCEL_SAMPLES
+    DEF_N_ACCEL_SAMPLES,
+    false
 };
 
+static tTestSession test_session;
+
 static float adj_gyro_sens;
 static char a_name[3][2] = {"X", "Y", "Z"};
 
@@ -226,7 +250,9 @@ const char* inv_device_get_log(void)
  *              Depends on the sampling frequency of choice (set by default to
  *              1 kHz) and low pass filter cut-off frequency selection (set
  *              to 42 Hz).
- *              The default is DEF_PACKET_THRESH = 75 packets.
+ *              The default is DEF_PACKET_THRESH = 75 packets.  With its
+ *              tolerance, a period of 6 bytes packets must fit the
+ *              FIFO_HW_SIZE bytes FIFO, or the gyro test is not run.
  *  @param  total_time_tol
  *              time skew tolerance, taking into account imprecision in turning
  *              the FIFO on and off and the processor time imprecision (for
@@ -254,15 +280,144 @@ void inv_set_test_parameters(unsigned int slave_addr, float sensitivity,
     test_setup.accel_samples = accel_samples;
 }
 
+/**
+ *  @brief  Select the quick mode of the gyro self test.
+ *  @param  quick
+ *              If 1, each collection period is split in DEF_QUICK_SPLIT
+ *              shorter windows and a gyro clock source is done as soon as
+ *              its biases are within threshold by DEF_QUICK_SIGMAS standard
+ *              errors, or its timing failed.
+ *              The default is 0, every period is collected.  The mode is
+ *              cleared when the next gyro test starts.
+ */
+void inv_set_test_quick_mode(uint_fast8_t quick)
+{
+    test_setup.quick = quick;
+}
+
 #define X   (0)
 #define Y   (1)
 #define Z   (2)
 
+/**
+ *  @internal
+ *  @brief  Add a block of samples to the statistics (Welford's update).
+ */
+static void test_stats_add(tTestStats *s, const short *vals)
+{
+    int ii;
+
+    s->n++;
+    for (ii = 0; ii < 3; ii++) {
+        double delta = vals[ii] - s->mean[ii];
+        s->mean[ii] += delta / s->n;
+        s->m2[ii] += delta * (vals[ii] - s->mean[ii]);
+    }
+}
+
+/**
+ *  @internal
+ *  @brief  Fold the statistics of another set of samples into s.
+ */
+static void test_stats_merge(tTestStats *s, const tTestStats *o)
+{
+    long n = s->n + o->n;
+    int ii;
+
+    if (o->n == 0)
+        return;
+    for (ii = 0; ii < 3; ii++) {
+        double delta = o->mean[ii] - s->mean[ii];
+        s->mean[ii] += delta * o->n / n;
+        s->m2[ii] += o->m2[ii] + delta * delta * s->n * o->n / n;
+    }
+    s->n = n;
+}
+
+/**
+ *  @internal
+ *  @brief  Add the 6 bytes gyro packets read from the FIFO.
+ */
+static void test_stats_add_fifo(tTestStats *s, const unsigned char *data,
+                                int packet_count)
+{
+    short vals[3];
+    int ii;
+
+    for (ii = 0; ii < packet_count; ii++, data += 6) {
+        vals[X] = inv_big8_to_int16(&data[0]);
+        vals[Y] = inv_big8_to_int16(&data[2]);
+        vals[Z] = inv_big8_to_int16(&data[4]);
+        test_stats_add(s, vals);
+        if (VERBOSE_OUT) {
+            MPL_LOGI("Gyros %-4ld    : %+13d %+13d %+13d\n",
+                     s->n, vals[X], vals[Y], vals[Z]);
+        }
+    }
+}
+
+/**
+ *  @internal
+ *  @brief  Whether the bias of every axis is known to be within threshold,
+ *          with DEF_QUICK_SIGMAS standard errors of margin.  A noiseless
+ *          axis is never accepted, it is checked at the end of the test.
+ */
+static int test_stats_settled(const tTestStats *s, int bias_thresh)
+{
+    int ii;
+
+    if (s->n < DEF_QUICK_MIN_SAMPLES)
+        return false;
+    for (ii = 0; ii < 3; ii++) {
+        double err = sqrt(s->m2[ii] / s->n / s->n);
+        if (s->m2[ii] == 0 ||
+            fabs(s->mean[ii]) + DEF_QUICK_SIGMAS * err >= bias_thresh)
+            return false;
+    }
+    return true;
+}
+
+/**
+ *  @internal
+ *  @brief  Account the FIFO window read last, if any.  Called while the
+ *          part is busy collecting the next window or settling on a new
+ *          clock source, so that the bus is not kept waiting.
+ */
+static void test_gyro_flush(tTestStats *s)
+{
+    if (test_session.pending) {
+        test_stats_add_fifo(s, test_session.pending,
+                            test_session.pending_count);
+        test_session.pending = NULL;
+    }
+}
+
+/**
+ *  @internal
+ *  @brief  Sleep until usec have elapsed since start_ns.
+ */
+static void test_sleep_until(unsigned long long start_ns, unsigned long usec)
+{
+    unsigned long long elapsed = (inv_get_tick_count_ns() - start_ns) / 1000;
+
+    if (elapsed < usec)
+        usleep(usec - (unsigned long)elapsed);
+}
+
 /**
  *  @brief  Test the gyroscope sensor.
  *          Implements the core logic of the MPU Self Test.
  *          Produces the PASS/FAIL result. Loads the calculated gyro biases
  *          and temperature datum into the corresponding pointers.
+ *
+ *          Each collection window is read back with one FIFO count and
+ *          one bulk FIFO read.  The next window is started before the
+ *          samples of the previous one are accounted, and bias and noise
+ *          are accumulated as running sums rather than from stored
+ *          samples.  In quick mode (see inv_set_test_quick_mode()) the
+ *          period of each clock source is split in DEF_QUICK_SPLIT windows
+ *          and the clock source is done as soon as its biases are known to
+ *          be within threshold.
  *  @param  mlsl_handle
  *              serial interface handle to allow serial communication with the
  *              device, both gyro and accelerometer.
@@ -300,21 +455,46 @@ int inv_test_gyro(void *mlsl_handle,
 {
     int ret_val = 0;
     inv_error_t result;
-    int total_count = 0;
-    int total_count_axis[3] = {0, 0, 0};
     int packet_count;
-    short x[DEF_PERIOD_CAL * DEF_TESTS_PER_AXIS / 8 * 4] = {0};
-    short y[DEF_PERIOD_CAL * DEF_TESTS_PER_AXIS / 8 * 4] = {0};
-    short z[DEF_PERIOD_CAL * DEF_TESTS_PER_AXIS / 8 * 4] = {0};
+    tTestStats total, per_clock;
     int temperature = 0;
     float avg[3];
     float rms[3];
     unsigned long test_start = inv_get_tick_count();
-    int i, j, tmp;
-    char tmpStr[200];
+    const unsigned char fifo_en_reg = MPUREG_FIFO_EN;
+    unsigned long window_us;
+    int windows, packet_thresh, packet_tol;
+    uint_fast8_t quick;
+    int i, j, w;
     unsigned char regs[7] = {0};
 
     inv_device_init_log();
+    memset(&total, 0, sizeof(total));
+    memset(&per_clock, 0, sizeof(per_clock));
+    test_session.pending = NULL;
+    /* quick mode is for this run only */
+    quick = test_setup.quick;
+    test_setup.quick = false;
+
+    /* one period per clock source and test, or DEF_QUICK_SPLIT shorter
+       windows in quick mode */
+    window_us = (perform_full_test ? DEF_PERIOD_CAL : DEF_PERIOD_SELF) * 1000;
+    windows = test_setup.tests_per_axis;
+    packet_thresh = test_setup.packet_thresh;
+    if (quick) {
+        window_us /= DEF_QUICK_SPLIT;
+        windows *= DEF_QUICK_SPLIT;
+        packet_thresh /= DEF_QUICK_SPLIT;
+    }
+    /* within total_timing_tol % range, rounded up */
+    packet_tol = (int)(test_setup.total_timing_tol * packet_thresh + 1);
+    /* a window is read in one transfer: the largest count accepted below
+       must fit the FIFO */
+    if ((packet_thresh + packet_tol) * 6 > FIFO_HW_SIZE) {
+        MPL_LOGE("Packet threshold %d does not fit the %d bytes FIFO\n",
+                 packet_thresh, FIFO_HW_SIZE);
+        return INV_ERROR_INVALID_PARAMETER;
+    }
 
     /* make sure the DMP is disabled first */
     result = inv_serial_single_write(
@@ -388,6 +568,8 @@ int inv_test_gyro(void *mlsl_handle,
 
     /* 1st, timing test */
     for (j = 0; j < 3; j++) {
+        unsigned long long settle_start;
+
         MPL_LOGI("Collecting gyro data from %s gyro PLL\n", a_name[j]);
 
         /* turn on all gyros, use gyro X for clocking
@@ -399,9 +581,15 @@ int inv_test_gyro(void *mlsl_handle,
             LOG_RESULT_LOCATION(result);
             return result;
         }
+        settle_start = inv_get_tick_count_ns();
+
+        /* the last window of the previous clock source */
+        test_gyro_flush(&per_clock);
+        test_stats_merge(&total, &per_clock);
+        memset(&per_clock, 0, sizeof(per_clock));
 
         /* wait for 2 ms after switching clock source */
-        usleep(2000);
+        test_sleep_until(settle_start, 2000);
 
         /* enable & reset FIFO */
         result = inv_serial_single_write(
@@ -412,9 +600,12 @@ int inv_test_gyro(void *mlsl_handle,
             return result;
         }
 
-        tmp = test_setup.tests_per_axis;
-        while (tmp-- > 0) {
-            const unsigned char fifo_en_reg = MPUREG_FIFO_EN;
+        for (w = 0; w < windows; w++) {
+            unsigned long long window_start;
+            unsigned long long window_end;
+            unsigned char *buf;
+            int packet_due;
+
             /* enable XYZ gyro in FIFO and nothing else */
             result = inv_serial_single_write(mlsl_handle,
                         mldl_cfg->mpu_chip_info->addr, fifo_en_reg,
@@ -423,12 +614,22 @@ int inv_test_gyro(void *mlsl_handle,
                 LOG_RESULT_LOCATION(result);
                 return result;
             }
+            window_start = inv_get_tick_count_ns();
+
+            /* account the previous window while this one is collected */
+            test_gyro_flush(&per_clock);
+            if (quick && w > 0 &&
+                ((ret_val & (1 << j)) ||
+                 test_stats_settled(&per_clock, test_setup.bias_thresh))) {
+                /* drop the window just started, the FIFO is reset on the
+                   next clock source */
+                MPL_LOGI("%s gyro PLL done after %d windows\n", a_name[j], w);
+                break;
+            }
 
             /* wait one period for data */
-            if (perform_full_test)
-                usleep(DEF_PERIOD_CAL * 1000);
-            else
-                usleep(DEF_PERIOD_SELF * 1000);
+            test_sleep_until(window_start, window_us);
+            window_end = inv_get_tick_count_ns();
 
             /* stop storing gyro in the FIFO */
             result = inv_serial_single_write(
@@ -450,38 +651,32 @@ int inv_test_gyro(void *mlsl_handle,
 
             /* number of 6 B packets in the FIFO */
             packet_count = inv_big8_to_int16(dataout) / 6;
-            sprintf(tmpStr, "Packet Count: %d - ", packet_count);
-
-            if (abs(packet_count - test_setup.packet_thresh)
-                        <= /* Within total_timing_tol % range, rounded up */
-                (int)(test_setup.total_timing_tol *
-                      test_setup.packet_thresh + 1)) {
-                for (i = 0; i < packet_count; i++) {
-                    /* getting FIFO data */
-                    result = inv_serial_read_fifo(mlsl_handle,
-                                mldl_cfg->mpu_chip_info->addr, 6, dataout);
-                    if (result) {
-                        LOG_RESULT_LOCATION(result);
-                        return result;
-                    }
-                    x[total_count + i] = inv_big8_to_int16(&dataout[0]);
-                    y[total_count + i] = inv_big8_to_int16(&dataout[2]);
-                    z[total_count + i] = inv_big8_to_int16(&dataout[4]);
-                    if (VERBOSE_OUT) {
-                        MPL_LOGI("Gyros %-4d    : %+13d %+13d %+13d\n",
-                                    total_count + i, x[total_count + i],
-                                    y[total_count + i], z[total_count + i]);
-                    }
+            /* against the time the window really lasted: waking up late is
+               not a clock error, and a short window has little margin */
+            packet_due = (int)((window_end - window_start) / 1000 *
+                               packet_thresh / window_us);
+
+            if (abs(packet_count - packet_due) <= packet_tol) {
+                /* getting the whole window in one transfer */
+                buf = test_session.fifo[w & 1];
+                result = inv_serial_read_fifo(mlsl_handle,
+                            mldl_cfg->mpu_chip_info->addr,
+                            (unsigned short)(packet_count * 6), buf);
+                if (result) {
+                    LOG_RESULT_LOCATION(result);
+                    return result;
                 }
-                total_count += packet_count;
-                total_count_axis[j] += packet_count;
-                sprintf(tmpStr, "%sOK", tmpStr);
+                test_session.pending = buf;
+                test_session.pending_count = packet_count;
+                MPL_LOGI("Packet Count: %d - OK\n", packet_count);
+                inv_device_put_log("Packet Count: %d - OK\n", packet_count);
             } else {
                 ret_val |= 1 << j;
-                sprintf(tmpStr, "%sNOK - samples ignored", tmpStr);
+                MPL_LOGI("Packet Count: %d - NOK - samples ignored\n",
+                         packet_count);
+                inv_device_put_log("Packet Count: %d - NOK - "
+                                   "samples ignored\n", packet_count);
             }
-            MPL_LOGI("%s\n", tmpStr);
-            inv_device_put_log("%s\n",tmpStr);
         }
 
         /* remove gyros from FIFO */
@@ -502,20 +697,19 @@ int inv_test_gyro(void *mlsl_handle,
         }
         temperature += (short)inv_big8_to_int16(dataout);
     }
+    test_gyro_flush(&per_clock);
+    test_stats_merge(&total, &per_clock);
 
     MPL_LOGI("\n");
-    MPL_LOGI("Total %d samples\n", total_count);
+    MPL_LOGI("Total %ld samples\n", total.n);
     MPL_LOGI("\n");
 
-    inv_device_put_log("\nTotal %d sampels\n\n", total_count);
+    inv_device_put_log("\nTotal %ld sampels\n\n", total.n);
 
     /* 2nd, check bias from X, Y, and Z PLL clock source */
-    tmp = total_count != 0 ? total_count : 1;
-    for (i = 0, avg[X] = .0f, avg[Y] = .0f, avg[Z] = .0f;
-         i < total_count; i++) {
-        avg[X] += 1.f * x[i] / tmp;
-        avg[Y] += 1.f * y[i] / tmp;
-        avg[Z] += 1.f * z[i] / tmp;
+    for (i = 0; i < 3; i++) {
+        avg[i] = (float)total.mean[i];
+        rms[i] = total.n ? (float)sqrt(total.m2[i] / total.n) : 0.f;
     }
     MPL_LOGI("bias          : %+13.3f %+13.3f %+13.3f (LSB)\n",
              avg[X], avg[Y], avg[Z]);
@@ -543,20 +737,13 @@ int inv_test_gyro(void *mlsl_handle,
       If any of the RMS noise value returns zero,
       then we might have dead gyro or FIFO/register failure,
       the part is sleeping, or the part is not responsive */
-    for (i = 0,
-            rms[X] = 0.f, rms[Y] = 0.f, rms[Z] = 0.f;
-         i < total_count; i++) {
-        rms[X] += (x[i] - avg[X]) * (x[i] - avg[X]);
-        rms[Y] += (y[i] - avg[Y]) * (y[i] - avg[Y]);
-        rms[Z] += (z[i] - avg[Z]) * (z[i] - avg[Z]);
-    }
     if (rms[X] == 0 || rms[Y] == 0 || rms[Z] == 0) {
         ret_val |= 1 << 9;
     }
     inv_device_put_log("RMS : %+.3f %+.3f %+.3f (dps-rms)\n",
-             sqrt(rms[X]/total_count)/ adj_gyro_sens, 
-             sqrt(rms[Y]/total_count)/ adj_gyro_sens, 
-             sqrt(rms[Z]/total_count)/ adj_gyro_sens);
+             rms[X] / adj_gyro_sens,
+             rms[Y] / adj_gyro_sens,
+             rms[Z] / adj_gyro_sens);
 
     /* 4th, temperature average */
     temperature /= 3;
@@ -755,7 +942,7 @@ int inv_test_accel(void *mlsl_handle, int enable_axes,
                    short *bias, long gravity,
                    uint_fast8_t perform_full_test)
 {
-    short *p_vals;
+    tTestStats stats;
     float avg[3] = {0.f, 0.f, 0.f}, zg = 0.f;
     float rms[3];
     float accel_rms_thresh = 1000000.f; /* enourmous to make the test always
@@ -764,14 +951,14 @@ int inv_test_accel(void *mlsl_handle, int enable_axes,
     const long sample_period = inv_get_sample_step_size_ms() * 1000;
     int ii;
 
-    p_vals = (short*)inv_malloc(sizeof(short) * 3 * test_setup.accel_samples);
+    memset(&stats, 0, sizeof(stats));
 
     /* collect the samples  */
     for(ii = 0; ii < test_setup.accel_samples; ii++) {
         unsigned result = INV_ERROR_ACCEL_DATA_NOT_READY;
         int tries = 0;
         long accel_data[3];
-        short *vals = &p_vals[3 * ii];
+        short vals[3];
 
         /* ignore data not ready errors but don't try more than 5 times */
         while (result == INV_ERROR_ACCEL_DATA_NOT_READY && tries++ < 5) {
@@ -786,13 +973,15 @@ int inv_test_accel(void *mlsl_handle, int enable_axes,
         vals[X] = (short)accel_data[X];
         vals[Y] = (short)accel_data[Y];
         vals[Z] = (short)accel_data[Z];
-        avg[X] += 1.f * vals[X] / test_setup.accel_samples;
-        avg[Y] += 1.f * vals[Y] / test_setup.accel_samples;
-        avg[Z] += 1.f * vals[Z] / test_setup.accel_samples;
+        test_stats_add(&stats, vals);
         if (VERBOSE_OUT)
             MPL_LOGI("Accel         : %+13d %+13d %+13d (LSB)\n",
                      vals[X], vals[Y], vals[Z]);
     }
+    for (ii = 0; ii < 3; ii++) {
+        avg[ii] = (float)stats.mean[ii];
+        rms[ii] = stats.n ? (float)sqrt(stats.m2[ii] / stats.n) : 0.f;
+    }
 
     if (((enable_axes << 4) & INV_THREE_AXIS_ACCEL) == INV_THREE_AXIS_ACCEL) {
         MPL_LOGI("Accel biases  : %+13.3f %+13.3f %+13.3f (LSB)\n",
@@ -817,29 +1006,17 @@ int inv_test_accel(void *mlsl_handle, int enable_axes,
 
         if (perform_full_test) {
             /* accel RMS - for now the threshold is only indicative */
-            for (ii = 0,
-                     rms[X] = 0.f, rms[Y] = 0.f, rms[Z] = 0.f;
-                 ii <  test_setup.accel_samples; ii++) {
-                short *vals = &p_vals[3 * ii];
-                rms[X] += (vals[X] - avg[X]) * (vals[X] - avg[X]);
-                rms[Y] += (vals[Y] - avg[Y]) * (vals[Y] - avg[Y]);
-                rms[Z] += (vals[Z] - avg[Z]) * (vals[Z] - avg[Z]);
-            }
             for (ii = 0; ii < 3; ii++) {
-                if (rms[ii] >  accel_rms_thresh * accel_rms_thresh
-                                * test_setup.accel_samples) {
+                if (rms[ii] > accel_rms_thresh) {
                     MPL_LOGI("%s-Accel RMS (%.2f) exceeded threshold "
                              "(threshold = %.2f)\n", a_name[ii],
-                             sqrt(rms[ii] / test_setup.accel_samples),
-                             accel_rms_thresh);
+                             rms[ii], accel_rms_thresh);
                     accel_error = true;
                     goto accel_early_exit;
                 }
             }
             MPL_LOGI("Accel RMS     : %+13.3f %+13.3f %+13.3f (LSB-rms)\n",
-                     sqrt(rms[X] / DEF_N_ACCEL_SAMPLES),
-                     sqrt(rms[Y] / DEF_N_ACCEL_SAMPLES),
-                     sqrt(rms[Z] / DEF_N_ACCEL_SAMPLES));
+                     rms[X], rms[Y], rms[Z]);
         }
     } else {
         MPL_LOGI("Accel Z bias    : %+13.3f (LSB)\n", avg[Z]);
@@ -860,7 +1037,6 @@ accel_early_exit:
         bias[0] = bias[1] = bias[2] = 0;
         return (1);     /* error */
     }
-    inv_free(p_vals);
 
     return (0);         /* success */
 }
@@ -23,8 +23,8 @@ extern "C" {
 
 void inv_set_test_parameters(unsigned int slave_addr, float sensitivity,
                              int p_thresh, float total_time_tol,
-                             int bias_thresh, float sp_shift_thresh,
-                             unsigned short accel_samples);
+                             int bias_thresh, unsigned short accel_samples);
+void inv_set_test_quick_mode(uint_fast8_t quick);
 int inv_device_test(void *mlsl_handle, unsigned long sensor_mask,
                 uint_fast8_t perform_full_test, uint_fast8_t provide_result);
 int inv_accel_z_test(void *mlsl_handle);
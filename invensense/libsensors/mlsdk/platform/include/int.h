@@ -23,6 +23,12 @@ extern "C" {
     /* - Defines. - */
     /* ------------ */
 
+/* maximum number of ready handles serviced per IntMuxProcess call; any
+   other ready handle is reported again by the next call */
+#define INT_MUX_MAX_READY      (16)
+/* maximum number of mpuirq_data records drained per read() */
+#define INT_MUX_MAX_READ       (16)
+
     /* ---------- */
     /* - Enums. - */
     /* ---------- */
@@ -31,6 +37,15 @@ extern "C" {
     /* - Structures. - */
     /* --------------- */
 
+    /** one interrupt reported by IntMuxProcess */
+    struct int_irq_record {
+        int source;                 /**< id passed to IntMuxAdd */
+        struct mpuirq_data data;    /**< data.irqtime is the irq timestamp */
+    };
+
+    /** persistent interrupt multiplexer, see IntMuxCreate */
+    struct int_mux;
+
     /* --------------------- */
     /* - Function p-types. - */
     /* --------------------- */
@@ -44,6 +59,14 @@ extern "C" {
     inv_error_t IntClose(int *handles, int numHandles);
     inv_error_t IntSetTimeout(int handle, int timeout);
 
+    inv_error_t IntMuxCreate(struct int_mux **mux);
+    inv_error_t IntMuxAdd(struct int_mux *mux, int handle, int source);
+    inv_error_t IntMuxRemove(struct int_mux *mux, int handle);
+    int IntMuxProcess(struct int_mux *mux,
+                      struct int_irq_record *records, int maxRecords,
+                      int timeout_ms);
+    inv_error_t IntMuxDestroy(struct int_mux *mux);
+
 #ifdef __cplusplus
 }
 #endif
@@ -59,6 +59,11 @@ typedef unsigned int HANDLE;
 
 	void inv_sleep(int mSecs);
 	unsigned long inv_get_tick_count(void);
+	unsigned long long inv_get_tick_count_ns(void);
+
+	inv_error_t inv_create_thread(HANDLE *thread,
+				      void *(*func)(void *arg), void *arg);
+	inv_error_t inv_join_thread(HANDLE thread);
 
 	/* Kernel implmentations */
 #define GFP_KERNEL (0x70)
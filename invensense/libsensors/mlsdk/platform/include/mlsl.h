@@ -90,6 +90,16 @@ inv_error_t inv_serial_close(void *sl_handle);
  *  returns INV_SUCCESS if successful, a non-zero error code otherwise.
  */
 inv_error_t inv_serial_reset(void *sl_handle);
+
+/**
+ *  inv_serial_ioctl() - issue a /dev/mpu ioctl through the serial backend.
+ *  @sl_handle	a file handle to the serial device used for the communication.
+ *  @cmd	one of the MPU_* ioctl commands from mpu.h.
+ *  @arg	argument of the command, as passed to ioctl(2).
+ *
+ *  returns 0 if successful; -1 with errno set otherwise, like ioctl(2).
+ */
+int inv_serial_ioctl(void *sl_handle, unsigned long cmd, void *arg);
 #endif
 
 /**
@@ -208,6 +218,42 @@ inv_error_t inv_serial_write_fifo(
 	unsigned short length,
 	unsigned char const *data);
 
+/*
+ * Operations of struct inv_serial_xfer.
+ * Unlike inv_serial_write(), the data of a register write does not start
+ * with the register address; the address field holds it.
+ */
+#define INV_SERIAL_XFER_READ		(0)
+#define INV_SERIAL_XFER_WRITE		(1)
+#define INV_SERIAL_XFER_READ_MEM	(2)
+#define INV_SERIAL_XFER_WRITE_MEM	(3)
+
+struct inv_serial_xfer {
+	unsigned char op;
+	unsigned short address;	/* register or memory address */
+	unsigned short length;
+	unsigned char *data;
+};
+
+/**
+ *  inv_serial_submit() - run a batch of register and memory transfers.
+ *  @sl_handle	a file handle to the serial device used for the communication.
+ *  @slave_addr	I2C slave address of device.
+ *  @xfer	transfers, executed in order.
+ *  @count	number of transfers.
+ *
+ *	The batch is handed to the serial backend in one call when it
+ *	supports it and is otherwise issued as sequential transfers.
+ *	Processing stops at the first failing transfer.
+ *
+ *  returns INV_SUCCESS == 0 if successful; a non-zero error code otherwise.
+ */
+inv_error_t inv_serial_submit(
+	void *sl_handle,
+	unsigned char slave_addr,
+	struct inv_serial_xfer *xfer,
+	int count);
+
 #ifndef __KERNEL__
 /**
  *  inv_serial_read_cfg() - used to get the configuration data.
@@ -0,0 +1,114 @@
+/*
+ $License:
+    Copyright (C) 2011 InvenSense Corporation, All Rights Reserved.
+ $
+ */
+#ifndef __MLSL_BACKEND_H__
+#define __MLSL_BACKEND_H__
+
+/**
+ *  @file   mlsl_backend.h
+ *  @brief  Runtime pluggable backends for the Motion Library Serial Layer.
+ *
+ *  Every access the MPL makes to /dev/mpu is an ioctl on the serial handle;
+ *  a backend only has to implement open, close and ioctl with the same
+ *  contract as the kernel driver (0 on success, -1 with errno set on error).
+ *
+ *  Production builds only have the kernel driver.  Test builds define
+ *  INV_SERIAL_TEST_BACKENDS and link mlsl_linux_mock.c, and then
+ *  inv_serial_open() picks the backend from the port string:
+ *      "/dev/mpu"                    kernel driver (default)
+ *      "mock:[trace][@rate]"         software MPU model, see mlsl_linux_mock.c
+ *      "record:<file>[,<port>]"      ioctl recorder wrapping <port>
+ *  When the port is NULL the MPL_SERIAL_PORT environment variable is used
+ *  before falling back to I2CDEV.
+ */
+
+#include "mltypes.h"
+#include "mlsl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef INV_SERIAL_TEST_BACKENDS
+#define INV_SERIAL_MOCK_PREFIX      "mock:"
+#define INV_SERIAL_RECORD_PREFIX    "record:"
+#define INV_SERIAL_PORT_ENV         "MPL_SERIAL_PORT"
+#endif
+
+/* trace files written by the recorder and read back by the mock */
+#define INV_SERIAL_TRACE_MAGIC      (0x4D504C54L)   /* 'MPLT' */
+#define INV_SERIAL_TRACE_VERSION    (1)
+
+struct inv_serial_trace_hdr {
+    unsigned long magic;
+    unsigned long version;
+};
+
+struct inv_serial_trace_rec {
+    unsigned long long timestamp;   /* ns, CLOCK_MONOTONIC */
+    unsigned long cmd;
+    long result;
+    unsigned short address;
+    unsigned short length;          /* payload bytes following the record */
+};
+
+struct inv_serial_backend {
+    const char *name;
+    int (*open)(char const *port, void **handle);
+    int (*close)(void *handle);
+    int (*ioctl)(void *handle, unsigned long cmd, void *arg);
+    /* optional, runs a whole inv_serial_submit() batch at once */
+    int (*submit)(void *handle, struct inv_serial_xfer *xfer, int count);
+};
+
+/* transaction counters, kept for every backend */
+enum inv_serial_op {
+    INV_SERIAL_OP_READ,
+    INV_SERIAL_OP_WRITE,
+    INV_SERIAL_OP_READ_MEM,
+    INV_SERIAL_OP_WRITE_MEM,
+    INV_SERIAL_OP_READ_FIFO,
+    INV_SERIAL_OP_WRITE_FIFO,
+    INV_SERIAL_OP_OTHER,
+
+    INV_SERIAL_NUM_OPS
+};
+
+struct inv_serial_stats {
+    unsigned long transactions[INV_SERIAL_NUM_OPS];
+    unsigned long long bytes[INV_SERIAL_NUM_OPS];
+    unsigned long batches;
+    unsigned long errors;
+};
+
+extern const struct inv_serial_backend inv_serial_kernel_backend;
+
+void inv_serial_get_stats(struct inv_serial_stats *stats);
+void inv_serial_reset_stats(void);
+const struct inv_serial_backend *inv_serial_get_backend(void);
+
+#ifdef INV_SERIAL_TEST_BACKENDS
+extern const struct inv_serial_backend inv_serial_mock_backend;
+extern const struct inv_serial_backend inv_serial_record_backend;
+
+/* Software MPU model controls, valid on the open handle when it was opened
+   with "mock:" or "record:<file>,mock:"; INV_ERROR_INVALID_MODULE
+   otherwise. */
+inv_error_t inv_mock_mpu_set_rate(void *handle, unsigned int rate_hz,
+                                  unsigned short sample_len);
+inv_error_t inv_mock_mpu_set_gyro(void *handle, const short bias[3],
+                                  unsigned short noise);
+inv_error_t inv_mock_mpu_set_compass(void *handle, const short data[3],
+                                     unsigned int read_us);
+inv_error_t inv_mock_mpu_push_fifo(void *handle, unsigned short length,
+                                   const unsigned char *data);
+inv_error_t inv_mock_mpu_read_mem(void *handle, unsigned short address,
+                                  unsigned short length, unsigned char *data);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* __MLSL_BACKEND_H__ */
@@ -23,6 +23,7 @@
 /* ------------- */
 
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <stdlib.h>
@@ -188,6 +189,62 @@ unsigned long inv_get_tick_count()
     return (long)((tv.tv_sec * 1000000LL + tv.tv_usec) / 1000LL);
 }
 
+/**
+ *  @brief  get a monotonic time stamp, used to time stamp sensor samples.
+ *  @return current time in nanoseconds.
+ */
+unsigned long long inv_get_tick_count_ns(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+        return 0;
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ *  @brief  Thread create function
+ *  @param  thread  pointer to the thread handle
+ *  @param  func    thread entry point
+ *  @param  arg     argument passed to func
+ *  @return error code.
+ */
+inv_error_t inv_create_thread(HANDLE *thread,
+                              void *(*func)(void *arg), void *arg)
+{
+    pthread_t *pt = malloc(sizeof(pthread_t));
+    if (pt == NULL)
+        return INV_ERROR_MEMORY_EXAUSTED;
+
+    if (pthread_create(pt, NULL, func, arg)) {
+        free(pt);
+        return INV_ERROR_OS_CREATE_FAILED;
+    }
+
+    *thread = (HANDLE)pt;
+
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Wait for a thread to return and release its handle
+ *  @param  thread  thread handle
+ *  @return error code.
+ */
+inv_error_t inv_join_thread(HANDLE thread)
+{
+    pthread_t *pt = (pthread_t *)thread;
+    int res;
+
+    res = pthread_join(*pt, NULL);
+    free(pt);
+    if (res)
+        return INV_ERROR_OS_BAD_HANDLE;
+
+    return INV_SUCCESS;
+}
+
   /**********************/
  /** @} */ /* defgroup */
 /**********************/
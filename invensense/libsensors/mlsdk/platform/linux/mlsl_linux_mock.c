@@ -0,0 +1,867 @@
+/*
+ $License:
+    Copyright (C) 2011 InvenSense Corporation, All Rights Reserved.
+ $
+ */
+
+/**
+ *  @addtogroup MLSL
+ *
+ *  @{
+ *      @file   mlsl_linux_mock.c
+ *      @brief  Software MPU model and ioctl recorder serial backends.
+ *
+ *  The mock backend answers the /dev/mpu ioctls from memory: a 256 byte
+ *  register space, the DMP memory and a 1kB FIFO.  The FIFO is fed from a
+ *  trace captured by the recorder backend, either one recorded read at a
+ *  time whenever the FIFO count is polled on an empty FIFO (deterministic
+ *  replay) or at a fixed rate in Hz, and from inv_mock_mpu_push_fifo() for
+ *  synthetic data.  Without a trace, inv_mock_mpu_set_gyro() makes the
+ *  gyro outputs enabled in FIFO_EN fill the FIFO in real time at the
+ *  sample rate set in SMPLRT_DIV, as the self test expects.
+ *  There are no secondary slaves, except for the compass reads served by
+ *  MPU_READ_COMPASS once inv_mock_mpu_set_compass() was called.
+ *      port = "mock:[trace][@rate]"
+ *
+ *  The recorder wraps another backend and appends every transaction,
+ *  with the data read or written, to a trace file.
+ *      port = "record:<file>[,<port>]"
+ */
+
+/* ------------------ */
+/* - Include Files. - */
+/* ------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "mpu.h"
+#include "mpu6050b1.h"
+
+#include "mlsl.h"
+#include "mlsl_backend.h"
+#include "mlos.h"
+#include "mlmath.h"
+#include "mlinclude.h"
+
+#include <log.h>
+#undef MPL_LOG_TAG
+#define MPL_LOG_TAG "MPL-mlsl"
+
+#ifndef INV_SERIAL_TEST_BACKENDS
+#error "the mock and recorder backends are only built into test binaries"
+#endif
+
+#ifndef I2CDEV
+#define I2CDEV "/dev/mpu"
+#endif
+
+/* ---------------- */
+/* - Definitions. - */
+/* ---------------- */
+
+#define MOCK_NUM_REGS       (256)
+#define MOCK_MEM_SIZE       (0x10000)
+#define MOCK_FIFO_SIZE      (1024)
+#define MOCK_MAX_KEYS       (32)
+#define MOCK_WHOAMI         (0x68)
+
+struct mock_key {
+    unsigned char key;
+    unsigned short len;
+    unsigned char *data;
+};
+
+struct mock_mpu {
+    unsigned char regs[MOCK_NUM_REGS];
+    unsigned char *mem;
+
+    unsigned char fifo[MOCK_FIFO_SIZE];
+    unsigned short fifo_head;
+    unsigned short fifo_count;
+
+    FILE *trace;
+    unsigned int rate_hz;
+    unsigned short sample_len;
+    unsigned long long fill_ns;
+
+    int gyro_on;
+    short gyro_bias[3];
+    unsigned short gyro_noise;
+    unsigned long gyro_seed;
+    unsigned long long gyro_ns;     /* time of the next gyro sample */
+
+    int compass_on;
+    short compass_data[3];
+    unsigned int compass_read_us;   /* bus time of one compass read */
+
+    __u32 requested_sensors;
+    __u8 ignore_system_suspend;
+    __u8 mldl_status;
+    __u8 i2c_slaves_enabled;
+    struct mpu_platform_data pdata;
+
+    struct mock_key keys[MOCK_MAX_KEYS];
+    int num_keys;
+};
+
+struct record_handle {
+    const struct inv_serial_backend *backend;
+    void *handle;
+    FILE *fp;
+};
+
+static unsigned long long mock_get_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int mock_errno(int err)
+{
+    errno = err;
+    return -1;
+}
+
+/* ------------------------ */
+/* - FIFO and trace feed. - */
+/* ------------------------ */
+
+static int mock_fifo_put(struct mock_mpu *mpu, unsigned short length,
+                         const unsigned char *data)
+{
+    unsigned short ii;
+
+    if (length > MOCK_FIFO_SIZE - mpu->fifo_count) {
+        /* the part sets FIFO_OFLOW and drops the oldest bytes */
+        unsigned short drop = length - (MOCK_FIFO_SIZE - mpu->fifo_count);
+        if (drop > mpu->fifo_count)
+            drop = mpu->fifo_count;
+        mpu->fifo_head = (mpu->fifo_head + drop) % MOCK_FIFO_SIZE;
+        mpu->fifo_count -= drop;
+        mpu->regs[MPUREG_INT_STATUS] |= BIT_FIFO_OVERFLOW_INT;
+        if (length > MOCK_FIFO_SIZE) {
+            data += length - MOCK_FIFO_SIZE;
+            length = MOCK_FIFO_SIZE;
+        }
+    }
+    for (ii = 0; ii < length; ii++) {
+        mpu->fifo[(mpu->fifo_head + mpu->fifo_count + ii) % MOCK_FIFO_SIZE] =
+            data[ii];
+    }
+    mpu->fifo_count += length;
+    return 0;
+}
+
+static void mock_fifo_get(struct mock_mpu *mpu, unsigned short length,
+                          unsigned char *data)
+{
+    unsigned short ii;
+
+    for (ii = 0; ii < length; ii++) {
+        if (ii < mpu->fifo_count) {
+            data[ii] = mpu->fifo[(mpu->fifo_head + ii) % MOCK_FIFO_SIZE];
+        } else {
+            data[ii] = 0;
+        }
+    }
+    if (length > mpu->fifo_count)
+        length = mpu->fifo_count;
+    mpu->fifo_head = (mpu->fifo_head + length) % MOCK_FIFO_SIZE;
+    mpu->fifo_count -= length;
+}
+
+/**
+ *  @internal
+ *  @brief  Moves the next recorded FIFO read of the trace into the FIFO.
+ *  @return 0 on success, -1 when the trace is exhausted.
+ */
+static int mock_trace_feed_one(struct mock_mpu *mpu)
+{
+    struct inv_serial_trace_rec rec;
+    unsigned char buf[MOCK_FIFO_SIZE];
+
+    if (!mpu->trace)
+        return -1;
+
+    while (fread(&rec, sizeof(rec), 1, mpu->trace) == 1) {
+        if (rec.cmd != MPU_READ_FIFO || rec.result ||
+            rec.length > sizeof(buf)) {
+            if (fseek(mpu->trace, rec.length, SEEK_CUR))
+                break;
+            continue;
+        }
+        if (fread(buf, 1, rec.length, mpu->trace) != rec.length)
+            break;
+        mpu->sample_len = rec.length;
+        return mock_fifo_put(mpu, rec.length, buf);
+    }
+    fclose(mpu->trace);
+    mpu->trace = NULL;
+    return -1;
+}
+
+static void mock_fifo_update(struct mock_mpu *mpu)
+{
+    unsigned long long now;
+    unsigned long long period;
+
+    if (!mpu->trace)
+        return;
+
+    if (!mpu->rate_hz) {
+        if (!mpu->fifo_count)
+            mock_trace_feed_one(mpu);
+        return;
+    }
+
+    now = mock_get_ns();
+    period = 1000000000LL / mpu->rate_hz;
+    if (!mpu->fill_ns)
+        mpu->fill_ns = now;
+    while (mpu->fill_ns + period <= now) {
+        if (mock_trace_feed_one(mpu))
+            break;
+        mpu->fill_ns += period;
+    }
+}
+
+/**
+ *  @internal
+ *  @brief  Puts the gyro samples due by now into the FIFO, for the gyro
+ *          outputs enabled in FIFO_EN.
+ */
+static void mock_gyro_update(struct mock_mpu *mpu)
+{
+    unsigned char fifo_en = mpu->regs[MPUREG_FIFO_EN] &
+        (BIT_GYRO_XOUT | BIT_GYRO_YOUT | BIT_GYRO_ZOUT);
+    unsigned char dlpf = mpu->regs[MPUREG_CONFIG] & 0x07;
+    unsigned long long now;
+    unsigned long long period;
+    unsigned char buf[6];
+    unsigned short len;
+    int ii;
+
+    if (!mpu->gyro_on || mpu->trace || !fifo_en)
+        return;
+
+    /* 8 kHz internal rate with the low pass filter off, 1 kHz otherwise */
+    period = (dlpf == 0 || dlpf == 7) ? 125000 : 1000000;
+    period *= mpu->regs[MPUREG_SMPLRT_DIV] + 1;
+    now = mock_get_ns();
+    for (; mpu->gyro_ns + period <= now; mpu->gyro_ns += period) {
+        len = 0;
+        for (ii = 0; ii < 3; ii++) {
+            long val = mpu->gyro_bias[ii];
+            if (!(fifo_en & (BIT_GYRO_XOUT >> ii)))
+                continue;
+            if (mpu->gyro_noise) {
+                mpu->gyro_seed = mpu->gyro_seed * 1103515245 + 12345;
+                val += (long)((mpu->gyro_seed >> 16) %
+                              (2 * mpu->gyro_noise + 1)) - mpu->gyro_noise;
+            }
+            buf[len++] = (unsigned char)((val >> 8) & 0xff);
+            buf[len++] = (unsigned char)(val & 0xff);
+        }
+        mock_fifo_put(mpu, len, buf);
+    }
+}
+
+/* ------------------- */
+/* - Register space. - */
+/* ------------------- */
+
+static void mock_reg_write(struct mock_mpu *mpu, unsigned char reg,
+                           unsigned char val)
+{
+    unsigned short addr;
+
+    switch (reg) {
+    case MPUREG_MEM_R_W:
+        addr = (mpu->regs[MPUREG_BANK_SEL] << 8) |
+            mpu->regs[MPUREG_MEM_START_ADDR];
+        mpu->mem[addr] = val;
+        mpu->regs[MPUREG_MEM_START_ADDR]++;
+        break;
+    case MPUREG_FIFO_R_W:
+        mock_fifo_put(mpu, 1, &val);
+        break;
+    case MPUREG_FIFO_EN:
+        /* samples up to now belong to the previous setting */
+        mock_gyro_update(mpu);
+        if (!(mpu->regs[reg] & (BIT_GYRO_XOUT | BIT_GYRO_YOUT |
+                                BIT_GYRO_ZOUT)))
+            mpu->gyro_ns = mock_get_ns();
+        mpu->regs[reg] = val;
+        break;
+    case MPUREG_USER_CTRL:
+        if (val & BIT_FIFO_RST) {
+            mpu->fifo_head = 0;
+            mpu->fifo_count = 0;
+            val &= ~BIT_FIFO_RST;
+        }
+        mpu->regs[reg] = val;
+        break;
+    default:
+        mpu->regs[reg] = val;
+        break;
+    }
+}
+
+static unsigned char mock_reg_read(struct mock_mpu *mpu, unsigned char reg)
+{
+    unsigned char val;
+    unsigned short addr;
+
+    switch (reg) {
+    case MPUREG_FIFO_COUNTH:
+        mock_fifo_update(mpu);
+        mock_gyro_update(mpu);
+        return (unsigned char)(mpu->fifo_count >> 8);
+    case MPUREG_FIFO_COUNTL:
+        return (unsigned char)(mpu->fifo_count & 0xff);
+    case MPUREG_FIFO_R_W:
+        mock_fifo_get(mpu, 1, &val);
+        return val;
+    case MPUREG_MEM_R_W:
+        addr = (mpu->regs[MPUREG_BANK_SEL] << 8) |
+            mpu->regs[MPUREG_MEM_START_ADDR];
+        mpu->regs[MPUREG_MEM_START_ADDR]++;
+        return mpu->mem[addr];
+    case MPUREG_INT_STATUS:
+        /* clear on read */
+        val = mpu->regs[reg];
+        mpu->regs[reg] = 0;
+        return val;
+    default:
+        return mpu->regs[reg];
+    }
+}
+
+static int mock_config(struct mock_mpu *mpu, struct ext_slave_config *config,
+                       int get)
+{
+    struct mock_key *entry = NULL;
+    int ii;
+
+    for (ii = 0; ii < mpu->num_keys; ii++) {
+        if (mpu->keys[ii].key == config->key) {
+            entry = &mpu->keys[ii];
+            break;
+        }
+    }
+
+    if (get) {
+        if (!config->data)
+            return mock_errno(EINVAL);
+        memset(config->data, 0, config->len);
+        if (entry)
+            memcpy(config->data, entry->data,
+                   MIN(config->len, entry->len));
+        return 0;
+    }
+
+    if (!entry) {
+        if (mpu->num_keys >= MOCK_MAX_KEYS)
+            return mock_errno(ENOMEM);
+        entry = &mpu->keys[mpu->num_keys++];
+        entry->key = config->key;
+        entry->len = 0;
+        entry->data = NULL;
+    }
+    if (entry->len < config->len) {
+        inv_free(entry->data);
+        entry->data = (unsigned char *)inv_malloc(config->len);
+        if (!entry->data) {
+            entry->len = 0;
+            return mock_errno(ENOMEM);
+        }
+    }
+    entry->len = config->len;
+    if (config->data)
+        memcpy(entry->data, config->data, config->len);
+    else
+        memset(entry->data, 0, config->len);
+    return 0;
+}
+
+/* the compass output, little endian, after the simulated bus time */
+static int mock_read_compass(struct mock_mpu *mpu, unsigned char *data)
+{
+    unsigned long long done = mock_get_ns() + mpu->compass_read_us * 1000ULL;
+    int ii;
+
+    while (mock_get_ns() < done)
+        ;
+    for (ii = 0; ii < 3; ii++) {
+        data[2 * ii] = (unsigned char)mpu->compass_data[ii];
+        data[2 * ii + 1] = (unsigned char)(mpu->compass_data[ii] >> 8);
+    }
+    return 0;
+}
+
+/* ------------------ */
+/* - Mock backend.  - */
+/* ------------------ */
+
+static int inv_serial_mock_ioctl(void *handle, unsigned long cmd, void *arg)
+{
+    struct mock_mpu *mpu = (struct mock_mpu *)handle;
+    struct mpu_read_write *msg = (struct mpu_read_write *)arg;
+    unsigned short ii;
+
+    switch (cmd) {
+    case MPU_WRITE:
+        /* data[0] is the first register, the address auto increments
+           except on the FIFO and memory windows */
+        if (msg->length < 1)
+            return mock_errno(EINVAL);
+        for (ii = 1; ii < msg->length; ii++) {
+            unsigned char reg = msg->data[0];
+            if (reg != MPUREG_FIFO_R_W && reg != MPUREG_MEM_R_W)
+                reg += ii - 1;
+            mock_reg_write(mpu, reg, msg->data[ii]);
+        }
+        return 0;
+    case MPU_READ:
+        for (ii = 0; ii < msg->length; ii++) {
+            unsigned char reg = (unsigned char)msg->address;
+            if (reg != MPUREG_FIFO_R_W && reg != MPUREG_MEM_R_W)
+                reg += ii;
+            msg->data[ii] = mock_reg_read(mpu, reg);
+        }
+        return 0;
+    case MPU_WRITE_MEM:
+        if (msg->address + msg->length > MOCK_MEM_SIZE)
+            return mock_errno(EINVAL);
+        memcpy(&mpu->mem[msg->address], msg->data, msg->length);
+        return 0;
+    case MPU_READ_MEM:
+        if (msg->address + msg->length > MOCK_MEM_SIZE)
+            return mock_errno(EINVAL);
+        memcpy(msg->data, &mpu->mem[msg->address], msg->length);
+        return 0;
+    case MPU_WRITE_FIFO:
+        return mock_fifo_put(mpu, msg->length, msg->data);
+    case MPU_READ_FIFO:
+        mock_fifo_get(mpu, msg->length, msg->data);
+        return 0;
+
+    case MPU_CONFIG_GYRO:
+        return mock_config(mpu, (struct ext_slave_config *)arg, 0);
+    case MPU_GET_CONFIG_GYRO:
+        return mock_config(mpu, (struct ext_slave_config *)arg, 1);
+    case MPU_SET_REQUESTED_SENSORS:
+        mpu->requested_sensors = (__u32)(unsigned long)arg;
+        return 0;
+    case MPU_GET_REQUESTED_SENSORS:
+        *(__u32 *)arg = mpu->requested_sensors;
+        return 0;
+    case MPU_SET_IGNORE_SYSTEM_SUSPEND:
+        mpu->ignore_system_suspend = (__u8)(unsigned long)arg;
+        return 0;
+    case MPU_GET_IGNORE_SYSTEM_SUSPEND:
+        *(__u8 *)arg = mpu->ignore_system_suspend;
+        return 0;
+    case MPU_GET_MLDL_STATUS:
+        *(__u8 *)arg = mpu->mldl_status;
+        return 0;
+    case MPU_GET_I2C_SLAVES_ENABLED:
+        *(__u8 *)arg = mpu->i2c_slaves_enabled;
+        return 0;
+    case MPU_GET_MPU_PLATFORM_DATA:
+        memcpy(arg, &mpu->pdata, sizeof(mpu->pdata));
+        return 0;
+    case MPU_RESUME:
+        mpu->requested_sensors = (__u32)(unsigned long)arg;
+        mpu->regs[MPUREG_PWR_MGMT_1] &= ~BIT_SLEEP;
+        mpu->fill_ns = 0;
+        return 0;
+    case MPU_SUSPEND:
+        mpu->requested_sensors &= ~(__u32)(unsigned long)arg;
+        if (!mpu->requested_sensors)
+            mpu->regs[MPUREG_PWR_MGMT_1] |= BIT_SLEEP;
+        return 0;
+    case MPU_PM_EVENT_HANDLED:
+        return 0;
+    case MPU_READ_COMPASS:
+        if (mpu->compass_on)
+            return mock_read_compass(mpu, (unsigned char *)arg);
+        return mock_errno(ENODEV);
+    case MPU_GET_EXT_SLAVE_DESCR:
+    case MPU_GET_EXT_SLAVE_PLATFORM_DATA:
+    case MPU_READ_ACCEL:
+    case MPU_READ_PRESSURE:
+    case MPU_CONFIG_ACCEL:
+    case MPU_CONFIG_COMPASS:
+    case MPU_CONFIG_PRESSURE:
+    case MPU_GET_CONFIG_ACCEL:
+    case MPU_GET_CONFIG_COMPASS:
+    case MPU_GET_CONFIG_PRESSURE:
+        /* gyro only model, no secondary slaves */
+        return mock_errno(ENODEV);
+    default:
+        return mock_errno(ENOTTY);
+    }
+}
+
+static int inv_serial_mock_close(void *handle)
+{
+    struct mock_mpu *mpu = (struct mock_mpu *)handle;
+    int ii;
+
+    if (!mpu)
+        return 0;
+    if (mpu->trace)
+        fclose(mpu->trace);
+    for (ii = 0; ii < mpu->num_keys; ii++)
+        inv_free(mpu->keys[ii].data);
+    inv_free(mpu->mem);
+    inv_free(mpu);
+    return 0;
+}
+
+static int inv_serial_mock_open(char const *port, void **handle)
+{
+    struct mock_mpu *mpu;
+    struct inv_serial_trace_hdr hdr;
+    char path[256];
+    const char *rate;
+    size_t len;
+
+    port += strlen(INV_SERIAL_MOCK_PREFIX);
+    rate = strrchr(port, '@');
+    len = rate ? (size_t)(rate - port) : strlen(port);
+    if (len >= sizeof(path))
+        return mock_errno(ENAMETOOLONG);
+    memcpy(path, port, len);
+    path[len] = '\0';
+
+    mpu = (struct mock_mpu *)inv_malloc(sizeof(*mpu));
+    if (!mpu)
+        return mock_errno(ENOMEM);
+    memset(mpu, 0, sizeof(*mpu));
+    mpu->mem = (unsigned char *)inv_malloc(MOCK_MEM_SIZE);
+    if (!mpu->mem) {
+        inv_free(mpu);
+        return mock_errno(ENOMEM);
+    }
+    memset(mpu->mem, 0, MOCK_MEM_SIZE);
+
+    mpu->regs[MPUREG_WHOAMI] = MOCK_WHOAMI;
+    mpu->regs[MPUREG_PWR_MGMT_1] = BIT_SLEEP;
+    mpu->pdata.orientation[0] = 1;
+    mpu->pdata.orientation[4] = 1;
+    mpu->pdata.orientation[8] = 1;
+    if (rate)
+        mpu->rate_hz = strtoul(rate + 1, NULL, 10);
+
+    if (len) {
+        mpu->trace = fopen(path, "rb");
+        if (!mpu->trace) {
+            MPL_LOGE("Cannot open trace \"%s\"\n", path);
+            inv_serial_mock_close(mpu);
+            return mock_errno(ENOENT);
+        }
+        if (fread(&hdr, sizeof(hdr), 1, mpu->trace) != 1 ||
+            hdr.magic != INV_SERIAL_TRACE_MAGIC ||
+            hdr.version != INV_SERIAL_TRACE_VERSION) {
+            MPL_LOGE("\"%s\" is not a serial trace\n", path);
+            inv_serial_mock_close(mpu);
+            return mock_errno(EINVAL);
+        }
+    }
+
+    *handle = mpu;
+    return 0;
+}
+
+/* the whole batch is served in one call, as a batching driver would */
+static int inv_serial_mock_submit(void *handle, struct inv_serial_xfer *xfer,
+                                  int count)
+{
+    struct mock_mpu *mpu = (struct mock_mpu *)handle;
+    struct mpu_read_write msg;
+    unsigned short jj;
+    int ii;
+    int result = 0;
+
+    for (ii = 0; ii < count && !result; ii++) {
+        msg.address = xfer[ii].address;
+        msg.length = xfer[ii].length;
+        msg.data = xfer[ii].data;
+        switch (xfer[ii].op) {
+        case INV_SERIAL_XFER_READ:
+            result = inv_serial_mock_ioctl(handle, MPU_READ, &msg);
+            break;
+        case INV_SERIAL_XFER_WRITE:
+            for (jj = 0; jj < msg.length; jj++) {
+                unsigned char reg = (unsigned char)msg.address;
+                if (reg != MPUREG_FIFO_R_W && reg != MPUREG_MEM_R_W)
+                    reg += jj;
+                mock_reg_write(mpu, reg, msg.data[jj]);
+            }
+            break;
+        case INV_SERIAL_XFER_READ_MEM:
+            result = inv_serial_mock_ioctl(handle, MPU_READ_MEM, &msg);
+            break;
+        case INV_SERIAL_XFER_WRITE_MEM:
+            result = inv_serial_mock_ioctl(handle, MPU_WRITE_MEM, &msg);
+            break;
+        default:
+            result = mock_errno(EINVAL);
+            break;
+        }
+    }
+    return result;
+}
+
+const struct inv_serial_backend inv_serial_mock_backend = {
+    "mock",
+    inv_serial_mock_open,
+    inv_serial_mock_close,
+    inv_serial_mock_ioctl,
+    inv_serial_mock_submit,
+};
+
+/**
+ *  @internal
+ *  @brief  Returns the model behind an open serial handle, directly or
+ *          through the recorder, or NULL when another backend serves it.
+ */
+static struct mock_mpu *mock_get_mpu(void *handle)
+{
+    const struct inv_serial_backend *backend = inv_serial_get_backend();
+
+    if (!handle)
+        return NULL;
+    if (backend == &inv_serial_mock_backend)
+        return (struct mock_mpu *)handle;
+    if (backend == &inv_serial_record_backend) {
+        struct record_handle *rec = (struct record_handle *)handle;
+        if (rec->backend == &inv_serial_mock_backend)
+            return (struct mock_mpu *)rec->handle;
+    }
+    return NULL;
+}
+
+/**
+ *  @brief  Sets the rate at which the trace is played back into the FIFO.
+ *  @param  handle      handle returned by inv_serial_open("mock:...").
+ *  @param  rate_hz     recorded FIFO reads per second; 0 replays one read
+ *                      each time the FIFO count is polled on an empty FIFO.
+ *  @param  sample_len  expected FIFO packet length, 0 to keep the current.
+ *  @return INV_SUCCESS or a non-zero error code.
+ */
+inv_error_t inv_mock_mpu_set_rate(void *handle, unsigned int rate_hz,
+                                  unsigned short sample_len)
+{
+    struct mock_mpu *mpu = mock_get_mpu(handle);
+
+    if (!mpu)
+        return INV_ERROR_INVALID_MODULE;
+    mpu->rate_hz = rate_hz;
+    if (sample_len)
+        mpu->sample_len = sample_len;
+    mpu->fill_ns = 0;
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Turns on the gyro of the model, for runs without a trace.
+ *  @param  handle      handle returned by inv_serial_open("mock:...").
+ *  @param  bias        gyro output at rest, in LSB, for X, Y and Z.
+ *  @param  noise       the samples are spread uniformly by +/- noise LSB.
+ *  @return INV_SUCCESS or a non-zero error code.
+ */
+inv_error_t inv_mock_mpu_set_gyro(void *handle, const short bias[3],
+                                  unsigned short noise)
+{
+    struct mock_mpu *mpu = mock_get_mpu(handle);
+
+    if (!bias)
+        return INV_ERROR_INVALID_PARAMETER;
+    if (!mpu)
+        return INV_ERROR_INVALID_MODULE;
+    memcpy(mpu->gyro_bias, bias, sizeof(mpu->gyro_bias));
+    mpu->gyro_noise = noise;
+    mpu->gyro_seed = 1;
+    mpu->gyro_on = true;
+    mpu->gyro_ns = mock_get_ns();
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Serves MPU_READ_COMPASS, for the slave descriptor a test sets
+ *          up itself since the model does not describe its slaves.
+ *  @param  handle      handle returned by inv_serial_open("mock:...").
+ *  @param  data        compass output for X, Y and Z, read little endian.
+ *  @param  read_us     time each read keeps the caller busy, in us.
+ *  @return INV_SUCCESS or a non-zero error code.
+ */
+inv_error_t inv_mock_mpu_set_compass(void *handle, const short data[3],
+                                     unsigned int read_us)
+{
+    struct mock_mpu *mpu = mock_get_mpu(handle);
+
+    if (!data)
+        return INV_ERROR_INVALID_PARAMETER;
+    if (!mpu)
+        return INV_ERROR_INVALID_MODULE;
+    memcpy(mpu->compass_data, data, sizeof(mpu->compass_data));
+    mpu->compass_read_us = read_us;
+    mpu->compass_on = true;
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Appends synthetic data to the FIFO of the model.
+ */
+inv_error_t inv_mock_mpu_push_fifo(void *handle, unsigned short length,
+                                   const unsigned char *data)
+{
+    struct mock_mpu *mpu = mock_get_mpu(handle);
+
+    if (!data)
+        return INV_ERROR_INVALID_PARAMETER;
+    if (!mpu)
+        return INV_ERROR_INVALID_MODULE;
+    mock_fifo_put(mpu, length, data);
+    mpu->regs[MPUREG_INT_STATUS] |= BIT_DMP_INT;
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Reads back the DMP memory of the model, e.g. to compare the
+ *          image loaded by the MPL against a golden one.
+ */
+inv_error_t inv_mock_mpu_read_mem(void *handle, unsigned short address,
+                                  unsigned short length, unsigned char *data)
+{
+    struct mock_mpu *mpu = mock_get_mpu(handle);
+
+    if (!data || address + length > MOCK_MEM_SIZE)
+        return INV_ERROR_INVALID_PARAMETER;
+    if (!mpu)
+        return INV_ERROR_INVALID_MODULE;
+    memcpy(data, &mpu->mem[address], length);
+    return INV_SUCCESS;
+}
+
+/* --------------------- */
+/* - Recorder backend. - */
+/* --------------------- */
+
+static int inv_serial_record_ioctl(void *handle, unsigned long cmd,
+                                   void *arg)
+{
+    struct record_handle *rec = (struct record_handle *)handle;
+    struct inv_serial_trace_rec entry;
+    struct mpu_read_write *msg = NULL;
+    int result;
+
+    result = rec->backend->ioctl(rec->handle, cmd, arg);
+
+    switch (cmd) {
+    case MPU_READ:
+    case MPU_WRITE:
+    case MPU_READ_MEM:
+    case MPU_WRITE_MEM:
+    case MPU_READ_FIFO:
+    case MPU_WRITE_FIFO:
+        msg = (struct mpu_read_write *)arg;
+        break;
+    default:
+        break;
+    }
+
+    memset(&entry, 0, sizeof(entry));
+    entry.timestamp = mock_get_ns();
+    entry.cmd = cmd;
+    entry.result = result ? errno : 0;
+    if (msg) {
+        entry.address = msg->address;
+        entry.length = msg->length;
+    }
+    fwrite(&entry, sizeof(entry), 1, rec->fp);
+    if (msg && msg->length)
+        fwrite(msg->data, 1, msg->length, rec->fp);
+
+    if (result)
+        errno = entry.result;
+    return result;
+}
+
+static int inv_serial_record_close(void *handle)
+{
+    struct record_handle *rec = (struct record_handle *)handle;
+    int result;
+
+    result = rec->backend->close(rec->handle);
+    fclose(rec->fp);
+    inv_free(rec);
+    return result;
+}
+
+static int inv_serial_record_open(char const *port, void **handle)
+{
+    struct record_handle *rec;
+    struct inv_serial_trace_hdr hdr;
+    char path[256];
+    const char *inner;
+    size_t len;
+
+    port += strlen(INV_SERIAL_RECORD_PREFIX);
+    inner = strchr(port, ',');
+    len = inner ? (size_t)(inner - port) : strlen(port);
+    if (!len || len >= sizeof(path))
+        return mock_errno(EINVAL);
+    memcpy(path, port, len);
+    path[len] = '\0';
+    inner = (inner && inner[1]) ? inner + 1 : I2CDEV;
+
+    rec = (struct record_handle *)inv_malloc(sizeof(*rec));
+    if (!rec)
+        return mock_errno(ENOMEM);
+    rec->backend = &inv_serial_kernel_backend;
+    if (!strncmp(inner, INV_SERIAL_MOCK_PREFIX,
+                 strlen(INV_SERIAL_MOCK_PREFIX)))
+        rec->backend = &inv_serial_mock_backend;
+
+    rec->fp = fopen(path, "wb");
+    if (!rec->fp) {
+        MPL_LOGE("Cannot open trace \"%s\" for write\n", path);
+        inv_free(rec);
+        return -1;
+    }
+    hdr.magic = INV_SERIAL_TRACE_MAGIC;
+    hdr.version = INV_SERIAL_TRACE_VERSION;
+    fwrite(&hdr, sizeof(hdr), 1, rec->fp);
+
+    if (rec->backend->open(inner, &rec->handle)) {
+        int err = errno;
+        fclose(rec->fp);
+        inv_free(rec);
+        errno = err;
+        return -1;
+    }
+    MPL_LOGI("recording %s (%s) to %s\n", inner, rec->backend->name, path);
+
+    *handle = rec;
+    return 0;
+}
+
+const struct inv_serial_backend inv_serial_record_backend = {
+    "record",
+    inv_serial_record_open,
+    inv_serial_record_close,
+    inv_serial_record_ioctl,
+    NULL,               /* batches are recorded one transfer at a time */
+};
+
+/**
+ *  @}
+ */
@@ -28,6 +28,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <linux/fs.h>
 #include <linux/i2c.h>
 #include <string.h>
@@ -38,12 +39,17 @@
 #include "mpu6050b1.h"
 
 #include "mlsl.h"
+#include "mlsl_backend.h"
 #include "mlos.h"
 #include "mlmath.h"
 #include "mlinclude.h"
 
 #define MLCAL_ID      (0x0A0B0C0DL)
-#define MLCAL_FILE    "/data/cal.bin"
+#ifndef MLCAL_DIR
+#define MLCAL_DIR     "/data"
+#endif
+#define MLCAL_FILE    MLCAL_DIR "/cal.bin"
+#define MLCAL_TMP_FILE MLCAL_DIR "/cal.bin.tmp"
 #define MLCFG_ID      (0x01020304L)
 #define MLCFG_FILE    "/data/cfg.bin"
 
@@ -68,6 +74,13 @@
 /* --------------------------- */
 /* - Global and Static vars. - */
 /* --------------------------- */
+static const struct inv_serial_backend *sSerialBackend =
+    &inv_serial_kernel_backend;
+/* the counters are also read by threads other than the MPL one: they are
+   updated with atomic adds, so transactions never wait on each other */
+static struct inv_serial_stats sSerialStats;
+#define SERIAL_STATS_ADD(field, n) \
+    __sync_fetch_and_add(&sSerialStats.field, (n))
 
 /* ---------------- */
 /* - Definitions. - */
@@ -164,44 +177,71 @@ read_cal_end:
     return result;
 }
 
+/**
+ *  @brief  Replaces MLCAL_FILE atomically: the data is written to a
+ *          temporary file, synced, then renamed over the old one so a
+ *          power cut leaves either the old or the new file, never a
+ *          truncated one.
+ */
 inv_error_t inv_serial_write_cal(unsigned char *cal, unsigned int len)
 {
-    FILE *fp;
-    int bytesWritten;
+    int fd;
+    int dirFd;
+    ssize_t bytesWritten;
+    unsigned int total = 0;
     inv_error_t result = INV_SUCCESS;
 
-    fp = fopen(MLCAL_FILE,"wb");
-    if (fp == NULL) {
-        MPL_LOGE("Cannot open file \"%s\" for write\n", MLCAL_FILE);
+    fd = open(MLCAL_TMP_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0660);
+    if (fd < 0) {
+        MPL_LOGE("Cannot open file \"%s\" for write\n", MLCAL_TMP_FILE);
         return INV_ERROR_FILE_OPEN;
     }
-    bytesWritten = fwrite(cal, 1, len, fp);
-    if (bytesWritten != len) {
+    while (total < len) {
+        bytesWritten = write(fd, cal + total, len - total);
+        if (bytesWritten < 0 && errno == EINTR)
+            continue;
+        if (bytesWritten <= 0)
+            break;
+        total += bytesWritten;
+    }
+    if (total != len) {
         MPL_LOGE("bytes written (%d) don't match requested length (%d)\n",
-                 bytesWritten, len);
+                 total, len);
+        result = INV_ERROR_FILE_WRITE;
+    } else if (fsync(fd)) {
+        MPL_LOGE("Cannot sync \"%s\" : %d\n", MLCAL_TMP_FILE, errno);
         result = INV_ERROR_FILE_WRITE;
     }
-    fclose(fp);
+    close(fd);
+    if (result) {
+        unlink(MLCAL_TMP_FILE);
+        return result;
+    }
+
+    if (rename(MLCAL_TMP_FILE, MLCAL_FILE)) {
+        MPL_LOGE("Cannot rename \"%s\" : %d\n", MLCAL_TMP_FILE, errno);
+        unlink(MLCAL_TMP_FILE);
+        return INV_ERROR_FILE_WRITE;
+    }
+    /* make the rename itself durable */
+    dirFd = open(MLCAL_DIR, O_RDONLY);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
     return result;
 }
 
 inv_error_t inv_serial_get_cal_length(unsigned int *len)
 {
-    FILE *calFile;
+    struct stat st;
     *len = 0;
 
-    calFile = fopen(MLCAL_FILE, "rb");
-    if (calFile == NULL) {
+    if (stat(MLCAL_FILE, &st)) {
         MPL_LOGE("Cannot open file \"%s\" for read\n", MLCAL_FILE);
         return INV_ERROR_FILE_OPEN;
     }
-
-    *len += (unsigned char)fgetc(calFile) << 24;
-    *len += (unsigned char)fgetc(calFile) << 16;
-    *len += (unsigned char)fgetc(calFile) << 8;
-    *len += (unsigned char)fgetc(calFile);
-
-    fclose(calFile);
+    *len = (unsigned int)st.st_size;
 
     if (*len <= 0)
         return INV_ERROR_FILE_READ;
@@ -209,22 +249,135 @@ inv_error_t inv_serial_get_cal_length(unsigned int *len)
     return INV_SUCCESS;
 }
 
+/* default backend, the /dev/mpu kernel driver */
+static int inv_serial_kernel_open(char const *port, void **handle)
+{
+    int fd = open(port, O_RDWR | O_NONBLOCK);
+    if (fd < 0)
+        return -1;
+    *handle = (void *)fd;
+    return 0;
+}
+
+static int inv_serial_kernel_close(void *handle)
+{
+    return close((int)handle);
+}
+
+static int inv_serial_kernel_ioctl(void *handle, unsigned long cmd, void *arg)
+{
+    return ioctl((int)handle, cmd, arg);
+}
+
+const struct inv_serial_backend inv_serial_kernel_backend = {
+    "kernel",
+    inv_serial_kernel_open,
+    inv_serial_kernel_close,
+    inv_serial_kernel_ioctl,
+    NULL,
+};
+
+static int inv_serial_op(unsigned long cmd)
+{
+    switch (cmd) {
+    case MPU_READ:
+        return INV_SERIAL_OP_READ;
+    case MPU_WRITE:
+        return INV_SERIAL_OP_WRITE;
+    case MPU_READ_MEM:
+        return INV_SERIAL_OP_READ_MEM;
+    case MPU_WRITE_MEM:
+        return INV_SERIAL_OP_WRITE_MEM;
+    case MPU_READ_FIFO:
+        return INV_SERIAL_OP_READ_FIFO;
+    case MPU_WRITE_FIFO:
+        return INV_SERIAL_OP_WRITE_FIFO;
+    default:
+        return INV_SERIAL_OP_OTHER;
+    }
+}
+
+void inv_serial_get_stats(struct inv_serial_stats *stats)
+{
+    int op;
+
+    for (op = 0; op < INV_SERIAL_NUM_OPS; op++) {
+        stats->transactions[op] = SERIAL_STATS_ADD(transactions[op], 0);
+        stats->bytes[op] = SERIAL_STATS_ADD(bytes[op], 0);
+    }
+    stats->batches = SERIAL_STATS_ADD(batches, 0);
+    stats->errors = SERIAL_STATS_ADD(errors, 0);
+}
+
+void inv_serial_reset_stats(void)
+{
+    int op;
+
+    for (op = 0; op < INV_SERIAL_NUM_OPS; op++) {
+        __sync_fetch_and_and(&sSerialStats.transactions[op], 0);
+        __sync_fetch_and_and(&sSerialStats.bytes[op], 0);
+    }
+    __sync_fetch_and_and(&sSerialStats.batches, 0);
+    __sync_fetch_and_and(&sSerialStats.errors, 0);
+}
+
+/**
+ *  @brief  Returns the backend serving the handle of the last
+ *          inv_serial_open().
+ */
+const struct inv_serial_backend *inv_serial_get_backend(void)
+{
+    return sSerialBackend;
+}
+
+int inv_serial_ioctl(void *sl_handle, unsigned long cmd, void *arg)
+{
+    int op = inv_serial_op(cmd);
+    int result;
+
+    result = sSerialBackend->ioctl(sl_handle, cmd, arg);
+
+    SERIAL_STATS_ADD(transactions[op], 1);
+    if (result)
+        SERIAL_STATS_ADD(errors, 1);
+    else if (op != INV_SERIAL_OP_OTHER)
+        SERIAL_STATS_ADD(bytes[op], ((struct mpu_read_write *)arg)->length);
+    return result;
+}
+
 inv_error_t inv_serial_open(char const *port, void **sl_handle)
 {
     INVENSENSE_FUNC_START;
+    const struct inv_serial_backend *backend = &inv_serial_kernel_backend;
 
+#ifdef INV_SERIAL_TEST_BACKENDS
+    if (NULL == port)
+        port = getenv(INV_SERIAL_PORT_ENV);
+    if (NULL == port || '\0' == port[0]) {
+        port = I2CDEV;
+    }
+    if (!strncmp(port, INV_SERIAL_MOCK_PREFIX,
+                 strlen(INV_SERIAL_MOCK_PREFIX))) {
+        backend = &inv_serial_mock_backend;
+    } else if (!strncmp(port, INV_SERIAL_RECORD_PREFIX,
+                        strlen(INV_SERIAL_RECORD_PREFIX))) {
+        backend = &inv_serial_record_backend;
+    }
+#else
     if (NULL == port) {
         port = I2CDEV;
     }
-    *sl_handle = (void*) open(port, O_RDWR | O_NONBLOCK);
-    if(sl_handle < 0) {
+#endif
+
+    if (backend->open(port, sl_handle)) {
         /* ERROR HANDLING; you can check errno to see what went wrong */
         MPL_LOGE("inv_serial_open\n");
         MPL_LOGE("I2C Error %d: Cannot open Adapter %s\n", errno, port);
         return INV_ERROR_SERIAL_OPEN_ERROR;
     } else {
-        MPL_LOGI("inv_serial_open: %s\n", port);
+        MPL_LOGI("inv_serial_open: %s (%s)\n", port, backend->name);
     }
+    sSerialBackend = backend;
 
     return INV_SUCCESS;
 }
@@ -233,7 +386,8 @@ inv_error_t inv_serial_close(void *sl_handle)
 {
     INVENSENSE_FUNC_START;
 
-    close((int)sl_handle);
+    sSerialBackend->close(sl_handle);
+    sSerialBackend = &inv_serial_kernel_backend;
 
     return INV_SUCCESS;
 }
@@ -271,7 +425,7 @@ inv_error_t inv_serial_write(void *sl_handle,
     msg.length  = length;
     msg.data    = (unsigned char*)data;
 
-    if ((result = ioctl((int)sl_handle, MPU_WRITE, &msg))) {
+    if ((result = inv_serial_ioctl(sl_handle, MPU_WRITE, &msg))) {
         MPL_LOGE("I2C Error: could not write: R:%02x L:%d %d \n",
                  data[0], length, result);
        return result;
@@ -308,7 +462,7 @@ inv_error_t inv_serial_read(void *sl_handle,
     msg.length  = length;
     msg.data    = data;
 
-    result = ioctl((int)sl_handle, MPU_READ, &msg);
+    result = inv_serial_ioctl(sl_handle, MPU_READ, &msg);
 
     if (result != INV_SUCCESS) {
         MPL_LOGE("I2C Error %08x: could not read: R:%02x L:%d\n",
@@ -343,7 +497,7 @@ inv_error_t inv_serial_write_mem(void *sl_handle,
     msg.length  = length;
     msg.data    = (unsigned char *)data;
 
-    result = ioctl((int)sl_handle, MPU_WRITE_MEM, &msg);
+    result = inv_serial_ioctl(sl_handle, MPU_WRITE_MEM, &msg);
     if (result) {
         LOG_RESULT_LOCATION(result);
         return result;
@@ -379,7 +533,7 @@ inv_error_t inv_serial_read_mem(void *sl_handle,
     msg.length  = length;
     msg.data    = data;
 
-    result = ioctl((int)sl_handle, MPU_READ_MEM, &msg);
+    result = inv_serial_ioctl(sl_handle, MPU_READ_MEM, &msg);
     if (result != INV_SUCCESS) {
         MPL_LOGE("I2C Error %08x: could not read memory: A:%04x L:%d\n",
                  result, memAddr, length);
@@ -415,7 +569,7 @@ inv_error_t inv_serial_write_fifo(void *sl_handle,
     msg.length  = length;
     msg.data    = (unsigned char *)data;
 
-    result = ioctl((int)sl_handle, MPU_WRITE_FIFO, &msg);
+    result = inv_serial_ioctl(sl_handle, MPU_WRITE_FIFO, &msg);
     if (result != INV_SUCCESS) {
         MPL_LOGE("I2C Error: could not write fifo: %02x %02x\n",
                   MPUREG_FIFO_R_W, length);
@@ -451,7 +605,7 @@ inv_error_t inv_serial_read_fifo(void *sl_handle,
     msg.length  = length;
     msg.data    = data;
 
-    result = ioctl((int)sl_handle, MPU_READ_FIFO, &msg);
+    result = inv_serial_ioctl(sl_handle, MPU_READ_FIFO, &msg);
     if (result != INV_SUCCESS) {
         MPL_LOGE("I2C Error %08x: could not read fifo: R:%02x L:%d\n",
                  result, MPUREG_FIFO_R_W, length);
@@ -470,6 +624,81 @@ inv_error_t inv_serial_read_fifo(void *sl_handle,
     return INV_SUCCESS;
 }
 
+inv_error_t inv_serial_submit(void *sl_handle,
+                              unsigned char slaveAddr,
+                              struct inv_serial_xfer *xfer,
+                              int count)
+{
+    INVENSENSE_FUNC_START;
+    unsigned char buf[SERIAL_MAX_TRANSFER_SIZE + 1];
+    inv_error_t result = INV_SUCCESS;
+    int ii;
+
+    if (NULL == xfer || count < 0) {
+        return INV_ERROR_INVALID_PARAMETER;
+    }
+    for (ii = 0; ii < count; ii++) {
+        if (xfer[ii].op > INV_SERIAL_XFER_WRITE_MEM || NULL == xfer[ii].data)
+            return INV_ERROR_INVALID_PARAMETER;
+    }
+    SERIAL_STATS_ADD(batches, 1);
+
+    if (sSerialBackend->submit) {
+        int op;
+        if (sSerialBackend->submit(sl_handle, xfer, count)) {
+            int err = errno;
+            SERIAL_STATS_ADD(errors, 1);
+            MPL_LOGE("I2C Error %d: could not submit %d transfers\n",
+                     err, count);
+            return INV_ERROR_SERIAL_READ;
+        }
+        for (ii = 0; ii < count; ii++) {
+            /* INV_SERIAL_XFER_* map onto the first INV_SERIAL_OP_* */
+            op = xfer[ii].op;
+            SERIAL_STATS_ADD(transactions[op], 1);
+            SERIAL_STATS_ADD(bytes[op], xfer[ii].length);
+        }
+        return INV_SUCCESS;
+    }
+
+    for (ii = 0; ii < count && INV_SUCCESS == result; ii++) {
+        switch (xfer[ii].op) {
+        case INV_SERIAL_XFER_READ:
+            result = inv_serial_read(sl_handle, slaveAddr,
+                                     (unsigned char)xfer[ii].address,
+                                     xfer[ii].length, xfer[ii].data);
+            break;
+        case INV_SERIAL_XFER_WRITE:
+            if (xfer[ii].length > SERIAL_MAX_TRANSFER_SIZE) {
+                result = INV_ERROR_INVALID_PARAMETER;
+                break;
+            }
+            buf[0] = (unsigned char)xfer[ii].address;
+            memcpy(&buf[1], xfer[ii].data, xfer[ii].length);
+            result = inv_serial_write(sl_handle, slaveAddr,
+                                      xfer[ii].length + 1, buf);
+            break;
+        case INV_SERIAL_XFER_READ_MEM:
+            result = inv_serial_read_mem(sl_handle, slaveAddr,
+                                         xfer[ii].address,
+                                         xfer[ii].length, xfer[ii].data);
+            break;
+        case INV_SERIAL_XFER_WRITE_MEM:
+            result = inv_serial_write_mem(sl_handle, slaveAddr,
+                                          xfer[ii].address,
+                                          xfer[ii].length, xfer[ii].data);
+            break;
+        default:
+            result = INV_ERROR_INVALID_PARAMETER;
+            break;
+        }
+    }
+    if (result) {
+        LOG_RESULT_LOCATION(result);
+    }
+    return result;
+}
+
 /**
  *  @}
  */
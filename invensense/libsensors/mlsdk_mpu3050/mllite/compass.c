@@ -82,6 +82,20 @@ unsigned char inv_compass_present(void)
         return false;
 }
 
+/**
+ *  @brief  Does inv_get_compass_data() read the compass over the serial bus?
+ *          Otherwise the data comes from the FIFO, the compass being on the
+ *          MPU secondary bus and read by the DMP.
+ *  @return true if every compass sample costs a serial transaction.
+ */
+unsigned char inv_compass_read_on_bus(void)
+{
+    struct mldl_cfg *mldl_cfg = inv_get_dl_config();
+    return (mldl_cfg->pdata_slave[EXT_SLAVE_TYPE_COMPASS]->bus ==
+            EXT_SLAVE_BUS_PRIMARY ||
+            !(mldl_cfg->inv_mpu_cfg->requested_sensors & INV_DMP_PROCESSOR));
+}
+
 /**
  *  @brief   Query the compass slave address.
  *  @return  The 7-bit compass slave address.
@@ -131,9 +145,7 @@ inv_error_t inv_get_compass_data(long *data)
         return INV_ERROR_INVALID_CONFIGURATION;
     }
 
-    if (mldl_cfg->pdata_slave[EXT_SLAVE_TYPE_COMPASS]->bus ==
-        EXT_SLAVE_BUS_PRIMARY ||
-        !(mldl_cfg->inv_mpu_cfg->requested_sensors & INV_DMP_PROCESSOR)) {
+    if (inv_compass_read_on_bus()) {
         /*--- read the compass sensor data.
           The compass read function may return an INV_ERROR_COMPASS_* errors
           when the data is not ready (read/refresh frequency mismatch) or 
@@ -23,12 +23,19 @@ extern "C" {
 
 #define MAX_COMPASS_RATE_PROCESSES 8
 
+/* Lock held by the caller around the MPL calls, taken by the compass
+   sampler thread around its reads.  trylock returns 0 when the lock was
+   taken, like pthread_mutex_trylock(). */
+typedef int (*inv_mpl_trylock_t)(void *lock);
+typedef void (*inv_mpl_unlock_t)(void *lock);
+
 struct compass_obj_t {
     long raw[3];
     long calibrated[3];
     long bias[3];
     long init_bias[3]; /* Used to center compass data for extreme local body fields */
     unsigned long delta_time; /* Time in milliseconds from last measurement */
+    unsigned long long timestamp; /* Time in nanoseconds of the raw read */
 };
 
 #define INV_COMPASS_PRIORITY_RAW_DATA                   100
@@ -57,6 +64,10 @@ inv_error_t inv_unregister_compass_rate_process(
 inv_error_t inv_register_compass_rate_process(
                 inv_error_t (*func)(struct compass_obj_t *obj), int priority);
 inv_error_t inv_calibrate_compass(struct compass_obj_t *obj);
+inv_error_t inv_set_compass_sampler(int enable, inv_mpl_trylock_t trylock,
+                                    inv_mpl_unlock_t unlock, void *lock);
+inv_error_t inv_start_compass_sampler(void);
+inv_error_t inv_get_sampled_pressure(long *data, int *got_data);
 
 #ifdef __cplusplus
 }
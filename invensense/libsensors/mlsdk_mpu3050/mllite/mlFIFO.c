@@ -26,6 +26,7 @@
 #include "mlFIFOHW.h"
 #include "dmpKey.h"
 #include "mlMathFunc.h"
+#include "mlMathFuncVec.h"
 #include "ml.h"
 #include "mldl.h"
 #include "mldl_cfg.h"
@@ -126,6 +127,9 @@ struct fifo_obj {
     long acc_bias_filt[3];
     float acc_filter_coef;
     long gravity_cache[3];
+    unsigned long long packet_time;
+    unsigned long snapshot_mask;
+    struct inv_fusion_snapshot snapshot;
 };
 static struct fifo_obj fifo_obj;
 
@@ -681,6 +685,7 @@ inv_error_t inv_read_and_process_fifo(int_fast8_t numPackets,
                 }
                 return result;
             }
+            fifo_obj.packet_time = inv_get_fifo_packet_time();
             if (MPL_LOG_NDEBUG)
                 print_debug_dmp_output(buf, read);
             result = inv_process_fifo_packet(buf);
@@ -705,6 +710,7 @@ inv_error_t inv_read_and_process_fifo(int_fast8_t numPackets,
 
             memset(fifo_obj.decoded, 0, sizeof(fifo_obj.decoded));
             fifo_obj.cache = 0;
+            fifo_obj.packet_time = inv_get_tick_count_ns();
             for (kk = 0; kk < ACCEL_NUM_AXES; ++kk) {
                 fifo_obj.decoded[REF_RAW + 4 + kk] =
                     inv_q30_mult((data[kk] << 16),
@@ -776,6 +782,164 @@ inv_error_t inv_set_fifo_processed_callback(void (*func) (void))
     return INV_SUCCESS;
 }
 
+/**
+ *  @brief  Select the outputs kept in the fusion snapshot.
+ *          The selected outputs are computed once per processed packet,
+ *          before the callback set with inv_set_fifo_processed_callback(),
+ *          and read back with inv_get_fusion_snapshot(); 0 turns the
+ *          snapshot off.
+ *
+ *  @pre    inv_dmp_open() must have been called.
+ *
+ *  @param  mask    a combination of the INV_SNAPSHOT_ values.
+ *
+ *  @return INV_SUCCESS if successful, or non-zero error code otherwise.
+ */
+inv_error_t inv_set_fusion_snapshot_mask(unsigned long mask)
+{
+    INVENSENSE_FUNC_START;
+
+    if (inv_get_state() < INV_STATE_DMP_OPENED)
+        return INV_ERROR_SM_IMPROPER_STATE;
+
+    fifo_obj.snapshot_mask = mask;
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Get the outputs selected with inv_set_fusion_snapshot_mask().
+ *  @return the INV_SNAPSHOT_ mask.
+ */
+unsigned long inv_get_fusion_snapshot_mask(void)
+{
+    return fifo_obj.snapshot_mask;
+}
+
+/**
+ *  @brief  Copy the fusion snapshot of the last processed packet.
+ *          Only the outputs flagged in snap->mask are valid: an output
+ *          selected but not available, such as the magnetometer without
+ *          a compass, is left out.  A change of snap->seq tells a new
+ *          packet.
+ *
+ *  @param[out] snap    the snapshot.
+ *
+ *  @return INV_SUCCESS if successful, INV_ERROR_FEATURE_NOT_ENABLED if no
+ *          packet was processed with a non-zero mask.
+ */
+inv_error_t inv_get_fusion_snapshot(struct inv_fusion_snapshot *snap)
+{
+    if (snap == NULL)
+        return INV_ERROR_INVALID_PARAMETER;
+
+    if (fifo_obj.snapshot.seq == 0)
+        return INV_ERROR_FEATURE_NOT_ENABLED;
+
+    *snap = fifo_obj.snapshot;
+    return INV_SUCCESS;
+}
+
+/**
+ *  @internal
+ *  @brief  Fill the fusion snapshot from the packet just processed.
+ *          The quaternion is renormalized: the DMP one is unit length
+ *          only to within its rounding.
+ *          Gravity is the fixed point one of inv_get_gravity(), which
+ *          inv_get_linear_accel() reuses.
+ *          The timestamp is when the DMP produced the packet.
+ */
+static void inv_fill_fusion_snapshot(void)
+{
+    struct inv_fusion_snapshot *snap = &fifo_obj.snapshot;
+    unsigned long want = fifo_obj.snapshot_mask;
+    unsigned long mask = 0;
+    long data[3];
+    float quat[4];
+    float rot[9];
+    int kk;
+
+    if ((want & INV_SNAPSHOT_GYRO) && inv_get_gyro(data) == INV_SUCCESS) {
+        for (kk = 0; kk < 3; ++kk)
+            snap->gyro[kk] = data[kk] / 65536.f;
+        mask |= INV_SNAPSHOT_GYRO;
+    }
+    if ((want & INV_SNAPSHOT_GYRO_RAW) &&
+        inv_get_gyro_raw(data) == INV_SUCCESS) {
+        for (kk = 0; kk < 3; ++kk)
+            snap->gyro_raw[kk] = data[kk] / 65536.f;
+        mask |= INV_SNAPSHOT_GYRO_RAW;
+    }
+    if ((want & INV_SNAPSHOT_ACCEL) && inv_get_accel(data) == INV_SUCCESS) {
+        for (kk = 0; kk < ACCEL_NUM_AXES; ++kk)
+            snap->accel[kk] = data[kk] / 65536.f;
+        mask |= INV_SNAPSHOT_ACCEL;
+    }
+
+    if (fifo_obj.data_config[CONFIG_QUAT]) {
+        inv_q30_to_float_batch(&fifo_obj.decoded[REF_QUATERNION], quat, 4);
+        inv_q_normalize_batchf(quat, 1);
+
+        if (want & INV_SNAPSHOT_QUATERNION) {
+            for (kk = 0; kk < 4; ++kk)
+                snap->quat[kk] = quat[kk];
+            mask |= INV_SNAPSHOT_QUATERNION;
+        }
+        if (want & INV_SNAPSHOT_ROTATION_MATRIX) {
+            inv_quaternion_to_rotation_batchf(quat, rot, 1);
+            for (kk = 0; kk < 9; ++kk)
+                snap->rot_mat[kk] = rot[kk];
+            mask |= INV_SNAPSHOT_ROTATION_MATRIX;
+        }
+        if ((want & INV_SNAPSHOT_GRAVITY) &&
+            inv_get_gravity(data) == INV_SUCCESS) {
+            for (kk = 0; kk < ACCEL_NUM_AXES; ++kk)
+                snap->gravity[kk] = data[kk] / 65536.f;
+            mask |= INV_SNAPSHOT_GRAVITY;
+        }
+    }
+    if ((want & (INV_SNAPSHOT_LINEAR_ACCEL | INV_SNAPSHOT_LINEAR_ACCEL_WORLD))
+        && inv_get_linear_accel(data) == INV_SUCCESS) {
+        float la[4], conj[4];
+
+        la[0] = 0.f;
+        for (kk = 0; kk < ACCEL_NUM_AXES; ++kk)
+            la[kk + 1] = data[kk] / 65536.f;
+        if (want & INV_SNAPSHOT_LINEAR_ACCEL) {
+            for (kk = 0; kk < ACCEL_NUM_AXES; ++kk)
+                snap->linear_accel[kk] = la[kk + 1];
+            mask |= INV_SNAPSHOT_LINEAR_ACCEL;
+        }
+        /* q * la * q', as inv_get_linear_accel_in_world() */
+        if ((want & INV_SNAPSHOT_LINEAR_ACCEL_WORLD) &&
+            fifo_obj.data_config[CONFIG_QUAT]) {
+            conj[0] = quat[0];
+            for (kk = 1; kk < 4; ++kk)
+                conj[kk] = -quat[kk];
+            inv_q_mult_batchf(quat, la, la, 1);
+            inv_q_mult_batchf(la, conj, la, 1);
+            for (kk = 0; kk < ACCEL_NUM_AXES; ++kk)
+                snap->linear_accel_world[kk] = la[kk + 1];
+            mask |= INV_SNAPSHOT_LINEAR_ACCEL_WORLD;
+        }
+    }
+
+    if ((want & INV_SNAPSHOT_MAGNETOMETER) && inv_obj.mag != NULL) {
+        for (kk = 0; kk < 3; ++kk)
+            snap->magnetometer[kk] =
+                inv_obj.mag->calibrated_data[kk] / 65536.0f;
+        mask |= INV_SNAPSHOT_MAGNETOMETER;
+    }
+    if ((want & INV_SNAPSHOT_COMPASS_ACCURACY) && inv_obj.adv_fusion != NULL) {
+        snap->compass_accuracy = inv_obj.adv_fusion->compass_accuracy;
+        mask |= INV_SNAPSHOT_COMPASS_ACCURACY;
+    }
+
+    snap->version = INV_FUSION_SNAPSHOT_VERSION;
+    snap->mask = mask;
+    snap->timestamp = fifo_obj.packet_time;
+    snap->seq++;
+}
+
 /**
  * @internal
  * @brief   Process data from the dmp read via the fifo.  Takes a buffer
@@ -2347,6 +2511,9 @@ inv_error_t inv_run_fifo_rate_processes(void)
         }
     }
 
+    if (fifo_obj.snapshot_mask)
+        inv_fill_fusion_snapshot();
+
     /* User callbacks */
     if (fifo_obj.fifo_process_cb)
         fifo_obj.fifo_process_cb();
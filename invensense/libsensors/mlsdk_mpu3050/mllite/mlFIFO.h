@@ -64,6 +64,41 @@ extern "C" {
 #define GYRO_MAG_SQR_SHIFT 6
 #define ACC_MAG_SQR_SHIFT 16
 
+    /**************************************************************************/
+    /*  Fusion snapshot                                                       */
+    /*  Outputs filled once per processed packet, for the masked fields only. */
+    /**************************************************************************/
+
+#define INV_FUSION_SNAPSHOT_VERSION      (1)
+
+#define INV_SNAPSHOT_GYRO                (0x0001)
+#define INV_SNAPSHOT_GYRO_RAW            (0x0002)
+#define INV_SNAPSHOT_ACCEL               (0x0004)
+#define INV_SNAPSHOT_QUATERNION          (0x0008)
+#define INV_SNAPSHOT_ROTATION_MATRIX     (0x0010)
+#define INV_SNAPSHOT_GRAVITY             (0x0020)
+#define INV_SNAPSHOT_LINEAR_ACCEL        (0x0040)
+#define INV_SNAPSHOT_MAGNETOMETER        (0x0080)
+#define INV_SNAPSHOT_COMPASS_ACCURACY    (0x0100)
+#define INV_SNAPSHOT_LINEAR_ACCEL_WORLD  (0x0200)
+
+    struct inv_fusion_snapshot {
+        int version;            /* INV_FUSION_SNAPSHOT_VERSION */
+        unsigned long seq;      /* packet count, 0 until the first packet */
+        unsigned long long timestamp;   /* ns, CLOCK_MONOTONIC, of the packet */
+        unsigned long mask;     /* INV_SNAPSHOT_ fields filled in */
+        float gyro[3];          /* dps */
+        float gyro_raw[3];      /* dps */
+        float accel[3];         /* g */
+        float quat[4];          /* unit length */
+        float rot_mat[9];
+        float gravity[3];       /* g */
+        float linear_accel[3];  /* g */
+        float magnetometer[3];  /* uT */
+        int compass_accuracy;   /* 0-3 */
+        float linear_accel_world[3];    /* g */
+    };
+
     /**************************************************************************/
     /*  Prototypes                                                            */
     /**************************************************************************/
@@ -133,6 +168,10 @@ extern "C" {
 
     inv_error_t inv_set_fifo_processed_callback(void (*func) (void));
 
+    inv_error_t inv_set_fusion_snapshot_mask(unsigned long mask);
+    unsigned long inv_get_fusion_snapshot_mask(void);
+    inv_error_t inv_get_fusion_snapshot(struct inv_fusion_snapshot *snap);
+
     inv_error_t inv_init_fifo_param(void);
     inv_error_t inv_close_fifo(void);
     inv_error_t inv_set_gyro_data_source(uint_fast8_t source);
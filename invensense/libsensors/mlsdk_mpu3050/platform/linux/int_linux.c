@@ -38,11 +38,13 @@
 #include "mlsl.h"
 #include "mldl.h"
 #include "int.h"
+#include "mlos.h"
 #include "log.h"
 #include "mlmath.h"
 #include <unistd.h>
 #include <errno.h>
-#include <sys/select.h>
+#include <poll.h>
+#include <sys/epoll.h>
 #include <sys/time.h>
 #include <sys/ioctl.h>
 #include "kernel/mpuirq.h"
@@ -59,6 +61,13 @@
 /* - Static Variables. - */
 /* --------------------- */
 
+/* number of pollfd kept on the stack by IntProcess */
+#define INT_POLL_STACK_FDS (8)
+
+struct int_mux {
+    int epfd;
+};
+
 /* --------------------- */
 /* - Static Functions. - */
 /* --------------------- */
@@ -92,9 +101,13 @@ void IntOpen(const char **ints,
 /**
  * @brief   This function should be called from the main event loop in systems 
  *          that support interrupt polling.
+ *          The interrupt drivers return one mpuirq_data record per read().
  * @param data Data read
  * @param tv_sec timeout value in seconds
- * @param tv_usec timeout value in micro seconds
+ * @param tv_usec timeout value in micro seconds, rounded up to the next
+ *                millisecond
+ * @return the number of records read, 0 on timeout or a negative error
+ *         code. A short read is logged and not counted.
  */
 int IntProcess(int *handles, int numHandles,
                struct mpuirq_data **data, 
@@ -104,50 +117,65 @@ int IntProcess(int *handles, int numHandles,
     int numRead = 0;
     int result;
     int size;
-    fd_set read_fd;
-    fd_set excep_fd;
-    int nfds = 0;
-    struct timeval timeout;
+    int timeout_ms;
+    ssize_t got;
+    struct pollfd stack_fds[INT_POLL_STACK_FDS];
+    struct pollfd *fds = stack_fds;
 
-    if (numHandles > 5) {
-        LOG_RESULT_LOCATION(INV_ERROR_MEMORY_EXAUSTED);
-        return INV_ERROR_MEMORY_EXAUSTED;
+    if (numHandles > INT_POLL_STACK_FDS) {
+        fds = (struct pollfd *)inv_malloc(sizeof(*fds) * numHandles);
+        if (fds == NULL) {
+            LOG_RESULT_LOCATION(INV_ERROR_MEMORY_EXAUSTED);
+            return INV_ERROR_MEMORY_EXAUSTED;
+        }
     }
 
-    FD_ZERO(&read_fd);
-    FD_ZERO(&excep_fd);
     for (ii = 0; ii < numHandles; ii++) {
-        FD_SET(handles[ii], &read_fd);
-        FD_SET(handles[ii], &excep_fd);
-        nfds = MAX(nfds, handles[ii]);
+        fds[ii].fd = handles[ii];
+        fds[ii].events = POLLIN | POLLPRI;
+        fds[ii].revents = 0;
     }
-    timeout.tv_sec = tv_sec;
-    timeout.tv_usec = tv_usec;
 
-    result = select((nfds+1), &read_fd, NULL, &excep_fd, &timeout);
+    /* a sub-millisecond timeout must still wait, not poll */
+    timeout_ms = tv_sec * 1000 + (tv_usec + 999) / 1000;
+    result = poll(fds, numHandles, timeout_ms);
     if (result < 0) {
         LOG_RESULT_LOCATION(result);
-        return result;
+        goto out;
     }
     
     /* Timeout */
     if (0 == result) {
         MPL_LOGV("IntProcess Timeout\n");
-        return INV_SUCCESS;
+        result = INV_SUCCESS;
+        goto out;
     }
 
+    if (data != NULL) {
+        size = sizeof(*data[0]);
+    } else {
+        size = 0;
+    }
     for (ii = 0; ii < numHandles; ii++) {
-        if (FD_ISSET(handles[ii], &read_fd)) {
-            if (data != NULL) {
-                size = sizeof(*data[0]);
+        if (fds[ii].revents & POLLIN) {
+            /* count records, not bytes */
+            got = read(handles[ii], data ? data[ii] : NULL, size);
+            if (got == size) {
+                numRead++;
+            } else if (got < 0) {
+                MPL_LOGE("read %d error %d\n", handles[ii], errno);
             } else {
-                size = 0;
+                MPL_LOGE("short read %d: %d of %d bytes\n",
+                         handles[ii], (int)got, size);
             }
-            numRead += read(handles[ii],data[ii],size);
         }
     }
-    
-    return numRead;
+    result = numRead;
+
+out:
+    if (fds != stack_fds)
+        inv_free(fds);
+    return result;
 }
 
 inv_error_t IntSetTimeout(int handle, int timeout)
@@ -174,6 +202,163 @@ inv_error_t IntClose(int *handles, int numHandles)
 }
 
 
+/**
+ *  @brief  Creates a persistent interrupt multiplexer.
+ *          Unlike IntProcess, handles are registered once with IntMuxAdd
+ *          and there is no limit on their number.
+ *  @param  mux     returns the new multiplexer.
+ *  @return INV_SUCCESS or non-zero error code
+ */
+inv_error_t IntMuxCreate(struct int_mux **mux)
+{
+    struct int_mux *m;
+
+    if (mux == NULL)
+        return INV_ERROR_INVALID_PARAMETER;
+
+    m = (struct int_mux *)inv_malloc(sizeof(*m));
+    if (m == NULL) {
+        LOG_RESULT_LOCATION(INV_ERROR_MEMORY_EXAUSTED);
+        return INV_ERROR_MEMORY_EXAUSTED;
+    }
+    m->epfd = epoll_create(INT_MUX_MAX_READY);
+    if (m->epfd < 0) {
+        MPL_LOGE("epoll_create error %d\n", errno);
+        inv_free(m);
+        return INV_ERROR_OS_CREATE_FAILED;
+    }
+    *mux = m;
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Registers an interrupt handle with the multiplexer.
+ *          The handle is switched to non-blocking mode.
+ *  @param  mux     multiplexer from IntMuxCreate.
+ *  @param  handle  open interrupt device (mpuirq, slaveirq, timerirq...).
+ *  @param  source  id reported back in int_irq_record::source.
+ *  @return INV_SUCCESS or non-zero error code
+ */
+inv_error_t IntMuxAdd(struct int_mux *mux, int handle, int source)
+{
+    struct epoll_event ev;
+
+    if (mux == NULL || handle < 0)
+        return INV_ERROR_INVALID_PARAMETER;
+
+    fcntl(handle, F_SETFL, fcntl(handle, F_GETFL) | O_NONBLOCK);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLPRI;
+    /* keep both ids in the event so that dispatch needs no lookup */
+    ev.data.u64 = ((unsigned long long)(unsigned int)source << 32) |
+        (unsigned int)handle;
+    if (epoll_ctl(mux->epfd, EPOLL_CTL_ADD, handle, &ev) < 0) {
+        MPL_LOGE("epoll_ctl add %d error %d\n", handle, errno);
+        return INV_ERROR;
+    }
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Unregisters an interrupt handle. The handle is not closed.
+ *  @return INV_SUCCESS or non-zero error code
+ */
+inv_error_t IntMuxRemove(struct int_mux *mux, int handle)
+{
+    struct epoll_event ev;
+
+    if (mux == NULL)
+        return INV_ERROR_INVALID_PARAMETER;
+
+    memset(&ev, 0, sizeof(ev));
+    if (epoll_ctl(mux->epfd, EPOLL_CTL_DEL, handle, &ev) < 0) {
+        MPL_LOGE("epoll_ctl del %d error %d\n", handle, errno);
+        return INV_ERROR;
+    }
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Waits for interrupts on the registered handles and drains all
+ *          pending mpuirq_data records from each ready handle, so that
+ *          interrupts queued while the caller was busy cost one wakeup.
+ *  @param  mux         multiplexer from IntMuxCreate.
+ *  @param  records     array receiving one entry per interrupt.
+ *  @param  maxRecords  size of the records array. Interrupts that do not
+ *                      fit are left queued for the next call.
+ *  @param  timeout_ms  maximum wait in milliseconds, -1 to wait forever.
+ *  @return the number of records filled, 0 on timeout or a negative
+ *          error code.
+ */
+int IntMuxProcess(struct int_mux *mux,
+                  struct int_irq_record *records, int maxRecords,
+                  int timeout_ms)
+{
+    struct epoll_event evs[INT_MUX_MAX_READY];
+    struct mpuirq_data buf[INT_MUX_MAX_READ];
+    int numReady;
+    int numRecords = 0;
+    int ii, jj;
+
+    if (mux == NULL || records == NULL || maxRecords <= 0)
+        return INV_ERROR_INVALID_PARAMETER;
+
+    numReady = epoll_wait(mux->epfd, evs,
+                          MIN(maxRecords, INT_MUX_MAX_READY), timeout_ms);
+    if (numReady < 0) {
+        if (errno == EINTR)
+            return 0;
+        LOG_RESULT_LOCATION(numReady);
+        return numReady;
+    }
+
+    for (ii = 0; ii < numReady && numRecords < maxRecords; ii++) {
+        int handle = (int)(unsigned int)(evs[ii].data.u64 & 0xffffffffULL);
+        int source = (int)(unsigned int)(evs[ii].data.u64 >> 32);
+        int want;
+        int got;
+
+        if (!(evs[ii].events & (EPOLLIN | EPOLLPRI)))
+            continue;
+
+        /* the drivers return one record per read(), others may return
+           several: read until the non-blocking handle is empty */
+        while (numRecords < maxRecords) {
+            want = MIN(maxRecords - numRecords, INT_MUX_MAX_READ);
+            got = read(handle, buf, want * sizeof(buf[0]));
+            if (got <= 0) {
+                if (got < 0 && errno != EAGAIN)
+                    MPL_LOGE("read %d error %d\n", handle, errno);
+                break;
+            }
+            if (got % sizeof(buf[0]))
+                MPL_LOGE("short read %d: %d bytes\n", handle, got);
+            got /= sizeof(buf[0]);
+            for (jj = 0; jj < got; jj++) {
+                records[numRecords].source = source;
+                records[numRecords].data = buf[jj];
+                numRecords++;
+            }
+        }
+    }
+
+    return numRecords;
+}
+
+/**
+ *  @brief  Destroys the multiplexer. Registered handles are not closed.
+ *  @return INV_SUCCESS or non-zero error code
+ */
+inv_error_t IntMuxDestroy(struct int_mux *mux)
+{
+    if (mux == NULL)
+        return INV_ERROR_INVALID_PARAMETER;
+    close(mux->epfd);
+    inv_free(mux);
+    return INV_SUCCESS;
+}
+
 /**
  * @}
  */
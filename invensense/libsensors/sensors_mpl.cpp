@@ -34,6 +34,7 @@
 
 #include "sensors.h"
 #include "MPLSensor.h"
+#include "SensorTrace.h"
 
 #include "MPLSensorSysApi.h"
 
@@ -329,12 +330,14 @@ int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
     int n = 0;
     int polltime = -1;
 
+    SENSOR_TRACE_CHECK();
     do {
         // see if we have some leftover from the last poll()
         for (int i=0 ; count && i<numSensorDrivers ; i++) {
             SensorBase* const sensor(mSensors[i]);
             if ((mPollFds[i].revents & POLLIN) || (sensor->hasPendingEvents())) {
                 int nb = sensor->readEvents(data, count);
+                SENSOR_TRACE_COMMIT(data, nb);
                 if (nb < count) {
                     // no more data for this sensor
                     mPollFds[i].revents = 0;
@@ -367,6 +370,8 @@ int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
                 ALOGE("poll() failed (%s)", strerror(errno));
                 return -errno;
             }
+            if (n > 0)
+                SENSOR_TRACE_MARK(PollWake);
             if (mPollFds[wake].revents & POLLIN) {
                 char msg;
                 int result = read(mPollFds[wake].fd, &msg, 1);
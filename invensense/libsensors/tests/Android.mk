@@ -0,0 +1,116 @@
+# Host built tests and benchmarks for the HAL and the MPL sources, run as
+#   sensors_host_tests [--bench] [test ...]
+# from $(HOST_OUT_EXECUTABLES).
+LOCAL_PATH := $(call my-dir)/..
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := sensors_host_tests
+LOCAL_MODULE_TAGS := optional
+# the MPL keeps pointers in 32-bit HANDLEs
+LOCAL_MULTILIB := 32
+
+MPL_DIR := mlsdk
+
+LOCAL_CFLAGS := -D_REENTRANT -DLINUX -DANDROID
+LOCAL_CFLAGS += -DCONFIG_MPU_SENSORS_MPU6050B1
+LOCAL_CFLAGS += -DINV_CACHE_DMP=1
+LOCAL_CFLAGS += -DI2CDEV=\"/dev/mpu\"
+LOCAL_CFLAGS += -DMLCAL_DIR=\"/tmp\"
+LOCAL_CFLAGS += -DBOARD_HAVE_BMP180 -DWITH_AMBIENT_TEMPERATURE
+LOCAL_CFLAGS += -DBMP180_INPUT_NAME=\"bmp180\"
+# the mock and recorder serial backends of mlsl_linux_mock.c
+LOCAL_CFLAGS += -DINV_SERIAL_TEST_BACKENDS
+
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(MPL_DIR)/platform/include
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(MPL_DIR)/platform/include/linux
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(MPL_DIR)/platform/linux
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(MPL_DIR)/platform/linux/kernel
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(MPL_DIR)/mllite
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(MPL_DIR)/mllite/akmd
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(MPL_DIR)/mldmp
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(MPL_DIR)/mlutils
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(MPL_DIR)/mlapps/common
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../../test-support
+
+LOCAL_SRC_FILES := tests/host_tests.c
+LOCAL_SRC_FILES += tests/test_math.c
+LOCAL_SRC_FILES += tests/test_int.c
+LOCAL_SRC_FILES += tests/test_mpl.c
+LOCAL_SRC_FILES += tests/test_snapshot.c
+LOCAL_SRC_FILES += tests/test_mputest.c
+LOCAL_SRC_FILES += tests/test_cal.c
+LOCAL_SRC_FILES += tests/test_compass.c
+LOCAL_SRC_FILES += tests/test_samsung.cpp
+LOCAL_SRC_FILES += tests/test_trace.cpp
+LOCAL_SRC_FILES += tests/test_cbtable.c
+LOCAL_SRC_FILES += tests/test_tempcomp.c
+LOCAL_SRC_FILES += tests/test_readevents.cpp
+
+# libmllite, as built by mlsdk/Android.mk
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mldl_cfg_mpu.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mldl_cfg_init_linux.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/accel.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/compass.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/compass_supervisor.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/compass_supervisor_adv_callbacks.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/key0_96.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/pressure.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/ml.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/ml_invobj.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/ml_init.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mlarray_lite.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mlarray_adv.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mlarray_legacy.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mlBiasNoMotion.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mlcbtable.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mlFIFO.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mlFIFOHW.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mlMathFunc.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mlMathFuncVec.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mlcontrol.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mldl.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mldmp.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/dmpDefault.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mlstates.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mlsupervisor.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/ml_stored_data.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/ustore_manager.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/ustore_mlsl_io.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/ustore_adv_fusion_delegate.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/ustore_lite_fusion_delegate.c
+# temp_comp_legacy.c is built by tests/test_tempcomp.c, which includes it
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mlSetGyroBias.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/ml_mputest.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mllite/mldl_print_cfg.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mlutils/checksum.c
+LOCAL_SRC_FILES += $(MPL_DIR)/mlutils/mputest.c
+
+# the input device sensors of the HAL
+LOCAL_SRC_FILES += SensorBase.cpp
+LOCAL_SRC_FILES += InputEventReader.cpp
+LOCAL_SRC_FILES += SamsungSensorBase.cpp
+LOCAL_SRC_FILES += PressureSensor.cpp
+LOCAL_SRC_FILES += SensorTrace.cpp
+
+# the MPL sensor of the HAL, over the mock serial backend. The libraries it
+# dlopen()s are not built for the host, so it runs without 9-axis fusion
+LOCAL_SRC_FILES += MPLSensor.cpp
+LOCAL_CPPFLAGS += -DMPL_LIB_NAME=\"libmplmpu.so\"
+LOCAL_CPPFLAGS += -DAICHI_LIB_NAME=\"libami.so\"
+LOCAL_CPPFLAGS += -DAKM_LIB_NAME=\"libakmd.so\"
+
+# libmlplatform
+LOCAL_SRC_FILES += $(MPL_DIR)/platform/linux/int_linux.c
+LOCAL_SRC_FILES += $(MPL_DIR)/platform/linux/log_linux.c
+LOCAL_SRC_FILES += $(MPL_DIR)/platform/linux/log_printf_linux.c
+LOCAL_SRC_FILES += $(MPL_DIR)/platform/linux/mlos_linux.c
+LOCAL_SRC_FILES += $(MPL_DIR)/platform/linux/mlsl_linux_mpu.c
+LOCAL_SRC_FILES += $(MPL_DIR)/platform/linux/mlsl_linux_mock.c
+
+LOCAL_STATIC_LIBRARIES := liblog libcutils libutils libhost_test
+LOCAL_LDLIBS := -lm -lpthread -lrt -ldl
+# test_int.c counts the syscalls of the interrupt code
+LOCAL_LDFLAGS := -Wl,--wrap=read -Wl,--wrap=poll -Wl,--wrap=epoll_wait
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host_tests.h"
+
+/*****************************************************************************/
+
+const struct host_test host_tests[] = {
+    { "math_accuracy",          test_math_accuracy,     0 },
+    { "fusion_pipeline",        bench_fusion_pipeline,  1 },
+    { "int_process",            test_int_process,       0 },
+    { "int_mux",                test_int_mux,           0 },
+    { "int_wakeups",            bench_int_mux,          1 },
+    { "read_events",            bench_read_events,      1 },
+    { "mpl_decimation",         test_mpl_decimation,    0 },
+    { "mixed_rates",            bench_mixed_rates,      1 },
+    { "mock_backend",           test_mock_backend,      0 },
+    { "mpl_replay",             test_mpl_replay,        0 },
+    { "fusion_snapshot",        test_fusion_snapshot,   0 },
+    { "fusion_getters",         bench_fusion_snapshot,  1 },
+    { "mpu_batch",              test_mpu_batch,         0 },
+    { "self_test",              test_self_test,         0 },
+    { "self_test_time",         bench_self_test,        1 },
+    { "cal_store",              test_cal_store,         0 },
+    { "compass_sampler",        test_compass_sampler,   0 },
+    { "samsung_frames",         test_samsung_frames,    0 },
+    { "samsung_pipe",           bench_samsung_pipe,     1 },
+    { "cb_table",               test_cb_table,          0 },
+    { "cb_dispatch",            bench_cb_dispatch,      1 },
+    { "trace_dump",             test_trace_dump,        0 },
+    { "temp_comp_fit",          test_temp_comp_fit,     0 },
+    { "temp_comp_replay",       bench_temp_comp_replay, 1 },
+};
+
+const size_t host_test_count = sizeof(host_tests) / sizeof(host_tests[0]);
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host built tests and benchmarks for the sensor HAL and the MPL, listed
+ * in host_tests.c and run by the runner of test-support/host_test.h.
+ */
+
+#ifndef ANDROID_SENSORS_HOST_TESTS_H
+#define ANDROID_SENSORS_HOST_TESTS_H
+
+#include "host_test.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* mlMathFuncVec.c */
+void test_math_accuracy(void);
+void bench_fusion_pipeline(void);
+
+/* int_linux.c */
+void test_int_process(void);
+void test_int_mux(void);
+void bench_int_mux(void);
+
+/* MPLSensor.cpp */
+void bench_read_events(void);
+void test_mpl_decimation(void);
+void bench_mixed_rates(void);
+
+/* mlsl_linux_mpu.c, mlsl_linux_mock.c */
+void test_mock_backend(void);
+void test_mpl_replay(void);
+
+/* mlFIFO.c */
+void test_fusion_snapshot(void);
+void bench_fusion_snapshot(void);
+
+/* mldl.c, mlBiasNoMotion.c */
+void test_mpu_batch(void);
+
+/* mputest.c */
+void test_self_test(void);
+void bench_self_test(void);
+
+/* ml_stored_data.c */
+void test_cal_store(void);
+
+/* mlcbtable.c */
+void test_cb_table(void);
+void bench_cb_dispatch(void);
+
+/* temp_comp_legacy.c */
+void test_temp_comp_fit(void);
+void bench_temp_comp_replay(void);
+
+/* compass_supervisor.c */
+void test_compass_sampler(void);
+
+/* SamsungSensorBase.cpp */
+void test_samsung_frames(void);
+void bench_samsung_pipe(void);
+
+/* SensorTrace.cpp */
+void test_trace_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ANDROID_SENSORS_HOST_TESTS_H
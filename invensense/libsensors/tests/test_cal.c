@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Calibration store of ml_stored_data.c: round trips through the type 6
+ * image and the type 4 record, and loads of truncated and corrupted data.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ml.h"
+#include "mlinclude.h"
+#include "mldl_cfg.h"
+#include "mlsl.h"
+#include "ml_stored_data.h"
+#include "checksum.h"
+
+#include "host_tests.h"
+
+/* MLCAL_DIR is set for this target */
+#define CAL_FILE    "/tmp/cal.bin"
+
+/*****************************************************************************/
+
+static void cal_set_state(int seed)
+{
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        inv_obj.adv_fusion->compass_bias_error[i] = seed + i;
+        inv_obj.adv_fusion->compass_scale[i] = seed * 2 + i;
+    }
+    for (i = 0; i < 18; i++)
+        inv_obj.adv_fusion->compass_peaks[i] = seed - i;
+    inv_obj.adv_fusion->compass_prev_xty[5] = seed / 4.0;
+    inv_obj.gyro_tc->temp_ptrs[1] = seed % BINS;
+    inv_obj.gyro_tc->temp_valid_data[1] = 1;
+    inv_obj.gyro_tc->temp_data[1][2] = seed / 8.0f;
+    inv_obj.gyro_tc->z_gyro_temp_data[1][2] = -seed / 2.0f;
+}
+
+static int cal_check_state(int seed)
+{
+    int ok = 1;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        ok &= inv_obj.adv_fusion->compass_bias_error[i] == seed + i;
+        ok &= inv_obj.adv_fusion->compass_scale[i] == seed * 2 + i;
+    }
+    for (i = 0; i < 18; i++)
+        ok &= inv_obj.adv_fusion->compass_peaks[i] == seed - i;
+    ok &= inv_obj.adv_fusion->compass_prev_xty[5] == seed / 4.0;
+    ok &= inv_obj.gyro_tc->temp_ptrs[1] == seed % BINS;
+    ok &= inv_obj.gyro_tc->temp_valid_data[1] == 1;
+    ok &= inv_obj.gyro_tc->temp_data[1][2] == seed / 8.0f;
+    ok &= inv_obj.gyro_tc->z_gyro_temp_data[1][2] == -seed / 2.0f;
+    return ok;
+}
+
+static unsigned char *cal_read_file(unsigned int *length)
+{
+    unsigned char *buf;
+    FILE *fp;
+    long size;
+
+    fp = fopen(CAL_FILE, "rb");
+    if (!fp)
+        return NULL;
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    buf = malloc(size);
+    if (buf && fread(buf, 1, size, fp) != (size_t)size) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(fp);
+    *length = size;
+    return buf;
+}
+
+/* loads length bytes of data from a buffer of exactly that size */
+static inv_error_t cal_load_copy(const unsigned char *data,
+                                 unsigned int length)
+{
+    unsigned char *copy = malloc(length ? length : 1);
+    inv_error_t result;
+
+    memcpy(copy, data, length);
+    result = inv_load_cal(copy, length);
+    free(copy);
+    return result;
+}
+
+static void cal_check_truncated(const unsigned char *data,
+                                unsigned int length)
+{
+    unsigned int n;
+    int accepted = 0;
+
+    for (n = 0; n < length; n++)
+        if (cal_load_copy(data, n) == INV_SUCCESS)
+            accepted++;
+    CHECK(accepted == 0);
+}
+
+static void cal_check_corrupted(const unsigned char *data,
+                                unsigned int length)
+{
+    unsigned char *copy = malloc(length);
+    unsigned int n;
+    int accepted = 0;
+
+    for (n = 0; n < length; n++) {
+        memcpy(copy, data, length);
+        copy[n] ^= 0x10;
+        if (inv_load_cal(copy, length) == INV_SUCCESS) {
+            fprintf(stderr, "    corrupted byte %u accepted\n", n);
+            accepted++;
+        }
+    }
+    free(copy);
+    CHECK(accepted == 0);
+}
+
+void test_cal_store(void)
+{
+    struct ext_slave_platform_data compass = {
+        .orientation = { 1, 0, 0, 0, 1, 0, 0, 0, 1 },
+    };
+    struct mldl_cfg *cfg;
+    unsigned char *data;
+    unsigned int length;
+    inv_error_t result;
+
+    /* the CRC-32 check value, whole and continued from an odd offset */
+    CHECK(inv_crc32(0, "123456789", 9) == 0xCBF43926UL);
+    CHECK(inv_crc32(inv_crc32(0, "1", 1), "23456789", 8) == 0xCBF43926UL);
+
+    CHECK(inv_serial_start("mock:") == INV_SUCCESS);
+    /* the model has no accel, so only its calibration fails */
+    result = inv_dmp_open();
+    CHECK(result == INV_SUCCESS || result == INV_ERROR_INVALID_CONFIGURATION);
+    /* nor a compass, which the loaders expect */
+    cfg = inv_get_dl_config();
+    cfg->pdata_slave[EXT_SLAVE_TYPE_COMPASS] = &compass;
+    inv_obj.mag->sens = 1L << 30;
+    unlink(CAL_FILE);
+
+    /* type 6, as written by inv_store_calibration() */
+    cal_set_state(1000);
+    CHECK(inv_store_calibration() == INV_SUCCESS);
+    data = cal_read_file(&length);
+    CHECK(data != NULL);
+    if (data) {
+        CHECK(length == sizeof(struct inv_cal_image_t));
+        cal_set_state(0);
+        CHECK(cal_load_copy(data, length) == INV_SUCCESS);
+        CHECK(cal_check_state(1000));
+
+        cal_set_state(0);
+        CHECK(inv_load_calibration() == INV_SUCCESS);
+        CHECK(cal_check_state(1000));
+
+        cal_check_truncated(data, length);
+        cal_check_corrupted(data, length);
+        free(data);
+    }
+
+    /* type 4, the record of inv_store_cal() */
+    length = inv_get_cal_length();
+    data = malloc(length + 1);
+    cal_set_state(2000);
+    CHECK(inv_store_cal(data, length) == INV_SUCCESS);
+    cal_set_state(0);
+    CHECK(cal_load_copy(data, length) == INV_SUCCESS);
+    CHECK(cal_check_state(2000));
+    /* trailing bytes past the record are ignored */
+    CHECK(cal_load_copy(data, length + 1) == INV_SUCCESS);
+
+    cal_check_truncated(data, length);
+    cal_check_corrupted(data, length);
+
+    /* a record length below the header and checksum */
+    data[0] = data[1] = data[2] = 0;
+    data[3] = INV_CAL_HDR_LEN;
+    CHECK(cal_load_copy(data, length) == INV_ERROR_FILE_READ);
+    free(data);
+
+    cfg->pdata_slave[EXT_SLAVE_TYPE_COMPASS] = NULL;
+    inv_dmp_close();
+    inv_serial_stop();
+    unlink(CAL_FILE);
+}
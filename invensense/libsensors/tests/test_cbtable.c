@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The callback snapshot tables of mlcbtable.c: their order and copy on
+ * write, FIFO rate callbacks registered and removed from another thread
+ * while a FIFO stream is replayed, and the cost of a dispatch.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ml.h"
+#include "mlFIFO.h"
+#include "mlcbtable.h"
+#include "mlos.h"
+#include "mlsl.h"
+#include "mlsl_backend.h"
+
+#include "host_tests.h"
+
+#define STRESS_PACKETS      20000
+#define BENCH_DISPATCHES    2000000
+/* DMP output of inv_send_gyro(INV_ALL, INV_32_BIT), then the FIFO footer */
+#define GYRO_BYTES          12
+#define FOOTER_0            0xB2
+#define FOOTER_1            0x6A
+
+/*****************************************************************************/
+
+static int sCalls[3];
+
+static void cb0(void) { sCalls[0]++; }
+static void cb1(void) { sCalls[1]++; }
+static void cb2(void) { sCalls[2]++; }
+
+static void test_snapshots(void)
+{
+    static struct inv_cb_table table;
+    const struct inv_cb_snapshot *old, *snap;
+
+    CHECK(inv_cb_table_init(&table, INV_CB_TABLE_MAX + 1) ==
+          INV_ERROR_INVALID_PARAMETER);
+    CHECK(inv_cb_table_init(&table, 2) == INV_SUCCESS);
+    CHECK(inv_cb_table_add(&table, cb1, 10) == INV_SUCCESS);
+    CHECK(inv_cb_table_add(&table, cb0, 1) == INV_SUCCESS);
+    /* one registration per callback and per priority, max_cb in all */
+    CHECK(inv_cb_table_add(&table, cb0, 3) != INV_SUCCESS);
+    CHECK(inv_cb_table_add(&table, cb2, 1) != INV_SUCCESS);
+    CHECK(inv_cb_table_add(&table, cb2, 5) != INV_SUCCESS);
+    CHECK(inv_cb_table_close(&table) == INV_SUCCESS);
+
+    CHECK(inv_cb_table_init(&table, INV_CB_TABLE_MAX) == INV_SUCCESS);
+    CHECK(inv_cb_table_add(&table, cb1, 10) == INV_SUCCESS);
+    CHECK(inv_cb_table_add(&table, cb0, 1) == INV_SUCCESS);
+    old = inv_cb_table_acquire(&table);
+    CHECK(old->num_cb == 2 && old->cb[0] == cb0 && old->cb[1] == cb1);
+
+    /* a dispatch keeps walking what it started with */
+    CHECK(inv_cb_table_add(&table, cb2, 5) == INV_SUCCESS);
+    CHECK(old->num_cb == 2);
+    snap = inv_cb_table_acquire(&table);
+    CHECK(snap->num_cb == 3 && snap->cb[1] == cb2);
+    CHECK(inv_cb_table_remove(&table, cb2) == INV_SUCCESS);
+    CHECK(old->num_cb == 2 && snap->num_cb == 3);
+    CHECK(!inv_cb_table_contains(&table, cb2));
+    CHECK(inv_cb_table_remove(&table, cb2) != INV_SUCCESS);
+    inv_cb_table_release(snap);
+    inv_cb_table_release(old);
+
+    /* appended callbacks run in the order they were added */
+    CHECK(inv_cb_table_close(&table) == INV_SUCCESS);
+    CHECK(inv_cb_table_init(&table, INV_CB_TABLE_MAX) == INV_SUCCESS);
+    CHECK(inv_cb_table_append(&table, cb2) == INV_SUCCESS);
+    CHECK(inv_cb_table_append(&table, cb0) == INV_SUCCESS);
+    snap = inv_cb_table_acquire(&table);
+    CHECK(snap->num_cb == 2 && snap->cb[0] == cb2 && snap->cb[1] == cb0);
+    inv_cb_table_release(snap);
+    CHECK(inv_cb_table_close(&table) == INV_SUCCESS);
+}
+
+/*****************************************************************************/
+
+static int sPackets;
+static int sToggled;
+static int sOrderErrors;
+static int sAfterLast;
+static volatile int sStop;
+static int sRegistrations;
+
+/* priority 5, before fifo_last */
+static inv_error_t fifo_toggled(struct inv_obj_t *obj)
+{
+    sToggled++;
+    if (sAfterLast)
+        sOrderErrors++;
+    return INV_SUCCESS;
+}
+
+/* priority 10, after fifo_toggled */
+static inv_error_t fifo_last(struct inv_obj_t *obj)
+{
+    sPackets++;
+    sAfterLast = 1;
+    return INV_SUCCESS;
+}
+
+static void *fifo_registrar(void *arg)
+{
+    while (!sStop) {
+        if (inv_register_fifo_rate_process(fifo_toggled, 5) == INV_SUCCESS)
+            sRegistrations++;
+        inv_unregister_fifo_rate_process(fifo_toggled);
+    }
+    return NULL;
+}
+
+/*
+ * Replays FIFO packets through inv_update_data() while another thread
+ * keeps registering and removing a FIFO rate callback, with no lock in
+ * between: every packet has to run the fixed callback once, and the
+ * toggled one, when it runs, before it.
+ */
+static void test_fifo_stress(void)
+{
+    unsigned char pkt[GYRO_BYTES + 2];
+    inv_error_t result;
+    pthread_t thread;
+    void *mpu;
+    int ii;
+
+    CHECK(inv_serial_start("mock:") == INV_SUCCESS);
+    result = inv_dmp_open();
+    CHECK(result == INV_SUCCESS || result == INV_ERROR_INVALID_CONFIGURATION);
+    CHECK(inv_send_gyro(INV_ALL, INV_32_BIT) == INV_SUCCESS);
+    CHECK(inv_set_fifo_rate(0) == INV_SUCCESS);
+    CHECK(inv_get_fifo_packet_size() == sizeof(pkt));
+    CHECK(inv_register_fifo_rate_process(fifo_last, 10) == INV_SUCCESS);
+    CHECK(inv_dmp_start() == INV_SUCCESS);
+    mpu = inv_get_serial_handle();
+
+    sPackets = 0;
+    sToggled = 0;
+    sOrderErrors = 0;
+    sRegistrations = 0;
+    sStop = 0;
+    memset(pkt, 0, sizeof(pkt));
+    pkt[GYRO_BYTES] = FOOTER_0;
+    pkt[GYRO_BYTES + 1] = FOOTER_1;
+    CHECK(pthread_create(&thread, NULL, fifo_registrar, NULL) == 0);
+    for (ii = 0; ii < STRESS_PACKETS; ii++) {
+        pkt[0] = ii;
+        sAfterLast = 0;
+        CHECK(inv_mock_mpu_push_fifo(mpu, sizeof(pkt), pkt) == INV_SUCCESS);
+        CHECK(inv_update_data() == INV_SUCCESS);
+    }
+    sStop = 1;
+    pthread_join(thread, NULL);
+
+    printf("%d packets, %d registrations, toggled callback ran %d times\n",
+           sPackets, sRegistrations, sToggled);
+    CHECK(sPackets == STRESS_PACKETS);
+    CHECK(sToggled <= STRESS_PACKETS);
+    CHECK(sOrderErrors == 0);
+    CHECK(sRegistrations > 0);
+
+    CHECK(inv_dmp_stop() == INV_SUCCESS);
+    CHECK(inv_unregister_fifo_rate_process(fifo_last) == INV_SUCCESS);
+    CHECK(inv_unregister_fifo_rate_process(fifo_toggled) != INV_SUCCESS);
+    inv_dmp_close();
+    inv_serial_stop();
+}
+
+void test_cb_table(void)
+{
+    test_snapshots();
+    test_fifo_stress();
+}
+
+/*****************************************************************************/
+
+#define CB_NOP(n) static void cb_nop##n(void) { }
+CB_NOP(0)  CB_NOP(1)  CB_NOP(2)  CB_NOP(3)
+CB_NOP(4)  CB_NOP(5)  CB_NOP(6)  CB_NOP(7)
+CB_NOP(8)  CB_NOP(9)  CB_NOP(10) CB_NOP(11)
+CB_NOP(12) CB_NOP(13) CB_NOP(14) CB_NOP(15)
+
+static const inv_cb_func sNops[INV_CB_TABLE_MAX] = {
+    cb_nop0,  cb_nop1,  cb_nop2,  cb_nop3,
+    cb_nop4,  cb_nop5,  cb_nop6,  cb_nop7,
+    cb_nop8,  cb_nop9,  cb_nop10, cb_nop11,
+    cb_nop12, cb_nop13, cb_nop14, cb_nop15,
+};
+
+/*
+ * ns per dispatch of a table of n callbacks, walked from a snapshot and,
+ * as the registries used to be, under the table mutex.
+ */
+static void run_dispatch(int n)
+{
+    static struct inv_cb_table table;
+    long long start, snapshot, locked;
+    HANDLE mutex;
+    int ii, kk;
+
+    CHECK(inv_cb_table_init(&table, INV_CB_TABLE_MAX) == INV_SUCCESS);
+    for (kk = 0; kk < n; kk++)
+        CHECK(inv_cb_table_add(&table, sNops[kk], kk) == INV_SUCCESS);
+    CHECK(inv_create_mutex(&mutex) == INV_SUCCESS);
+
+    start = host_test_now_ns();
+    for (ii = 0; ii < BENCH_DISPATCHES; ii++) {
+        const struct inv_cb_snapshot *snap = inv_cb_table_acquire(&table);
+        for (kk = 0; kk < snap->num_cb; kk++)
+            snap->cb[kk]();
+        inv_cb_table_release(snap);
+    }
+    snapshot = host_test_now_ns() - start;
+
+    start = host_test_now_ns();
+    for (ii = 0; ii < BENCH_DISPATCHES; ii++) {
+        inv_lock_mutex(mutex);
+        for (kk = 0; kk < n; kk++)
+            sNops[kk]();
+        inv_unlock_mutex(mutex);
+    }
+    locked = host_test_now_ns() - start;
+
+    printf("%2d callbacks: snapshot %.1f ns/dispatch, mutex %.1f ns/dispatch\n",
+           n, (double)snapshot / BENCH_DISPATCHES,
+           (double)locked / BENCH_DISPATCHES);
+    inv_destroy_mutex(mutex);
+    inv_cb_table_close(&table);
+}
+
+void bench_cb_dispatch(void)
+{
+    run_dispatch(1);
+    run_dispatch(4);
+    run_dispatch(16);
+}
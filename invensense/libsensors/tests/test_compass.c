@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The compass sampler thread of compass_supervisor.c, against the
+ * compass reads of the software MPU model.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mpu.h"
+#include "ml.h"
+#include "mldl.h"
+#include "mldl_cfg.h"
+#include "mlFIFO.h"
+#include "mlstates.h"
+#include "compass_supervisor.h"
+#include "mlsl.h"
+#include "mlsl_backend.h"
+
+#include "host_tests.h"
+
+#define SAMPLER_PACKETS     500
+#define PACKET_PERIOD_US    2000
+/* a 6 byte read at 400 kHz, with the register address and start/stop */
+#define COMPASS_READ_US     250
+/* DMP output of inv_send_gyro(INV_ALL, INV_32_BIT), then the FIFO footer;
+   the quaternion check of the FIFO decoding only passes with 32 bit longs */
+#define GYRO_BYTES          12
+#define FOOTER_0            0xB2
+#define FOOTER_1            0x6A
+
+/*****************************************************************************/
+
+/* the HAL's mMplMutex */
+static pthread_mutex_t sMplLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int mpl_trylock(void *lock)
+{
+    return pthread_mutex_trylock((pthread_mutex_t *)lock);
+}
+
+static void mpl_unlock(void *lock)
+{
+    pthread_mutex_unlock((pthread_mutex_t *)lock);
+}
+
+static int compass_resume(void *mlsl_handle, struct ext_slave_descr *slave,
+                          struct ext_slave_platform_data *pdata)
+{
+    return 0;
+}
+
+static const short sCompassData[3] = { 120, -340, 560 };
+
+static struct ext_slave_descr sCompass = {
+    .resume = compass_resume,
+    .name = "mock compass",
+    .type = EXT_SLAVE_TYPE_COMPASS,
+    .read_len = 6,
+    .endian = EXT_SLAVE_LITTLE_ENDIAN,
+};
+
+static struct ext_slave_platform_data sCompassPdata = {
+    .bus = EXT_SLAVE_BUS_PRIMARY,
+    .orientation = { 1, 0, 0, 0, 1, 0, 0, 0, 1 },
+};
+
+static int sSamples;
+static int sBadSamples;
+static long long sAgeTotal;
+
+static inv_error_t count_compass(struct compass_obj_t *obj)
+{
+    int ii;
+
+    sSamples++;
+    sAgeTotal += host_test_now_ns() - (long long)obj->timestamp;
+    for (ii = 0; ii < 3; ii++)
+        if (obj->raw[ii] != sCompassData[ii])
+            sBadSamples++;
+    return INV_SUCCESS;
+}
+
+static int compare_ns(const void *a, const void *b)
+{
+    long long d = *(const long long *)a - *(const long long *)b;
+    return d < 0 ? -1 : d > 0;
+}
+
+/* whether the sampler thread runs, as seen from the FIFO processing */
+static int sampler_running(void)
+{
+    long pressure;
+    int got_data;
+
+    return inv_get_sampled_pressure(&pressure, &got_data) == INV_SUCCESS;
+}
+
+/*
+ * Feeds FIFO packets at 500 Hz and times each inv_update_data() as the
+ * HAL's FIFO thread sees it, lock wait included, with the compass read
+ * inline or by the sampler thread.
+ */
+static void run_compass_reads(int sampler, const char *name)
+{
+    static long long times[SAMPLER_PACKETS];
+    unsigned char pkt[GYRO_BYTES + 2];
+    struct mldl_cfg *cfg;
+    inv_error_t result;
+    long long start;
+    long long total = 0;
+    void *mpu;
+    int ii;
+
+    CHECK(inv_serial_start("mock:") == INV_SUCCESS);
+    /* the model has no accel, so only its calibration fails, and with
+       it the last steps of the open */
+    result = inv_dmp_open();
+    CHECK(result == INV_SUCCESS || result == INV_ERROR_INVALID_CONFIGURATION);
+    if (result == INV_ERROR_INVALID_CONFIGURATION) {
+        /* no sampler without the supervisor owning its queue */
+        CHECK(inv_set_compass_sampler(1, mpl_trylock, mpl_unlock,
+                                      &sMplLock) ==
+              INV_ERROR_FEATURE_NOT_ENABLED);
+        CHECK(inv_enable_compass_supervisor() == INV_SUCCESS);
+    }
+    CHECK(inv_send_gyro(INV_ALL, INV_32_BIT) == INV_SUCCESS);
+    CHECK(inv_set_fifo_rate(0) == INV_SUCCESS);
+    CHECK(inv_get_fifo_packet_size() == sizeof(pkt));
+    CHECK(inv_register_compass_rate_process(count_compass, 1000) ==
+          INV_SUCCESS);
+
+    pthread_mutex_lock(&sMplLock);
+    CHECK(inv_set_compass_sampler(1, NULL, NULL, NULL) ==
+          INV_ERROR_INVALID_PARAMETER);
+    if (sampler) {
+        CHECK(inv_set_compass_sampler(1, mpl_trylock, mpl_unlock,
+                                      &sMplLock) == INV_SUCCESS);
+        /* not before the DMP is started */
+        CHECK(!sampler_running());
+    }
+    CHECK(inv_dmp_start() == INV_SUCCESS);
+    CHECK(sampler_running() == sampler);
+
+    /* the model serves compass reads for a slave set up here, once the
+       start has looked for the slaves the model does not have */
+    mpu = inv_get_serial_handle();
+    CHECK(inv_mock_mpu_set_compass(mpu, sCompassData, COMPASS_READ_US) ==
+          INV_SUCCESS);
+    cfg = inv_get_dl_config();
+    cfg->slave[EXT_SLAVE_TYPE_COMPASS] = &sCompass;
+    cfg->pdata_slave[EXT_SLAVE_TYPE_COMPASS] = &sCompassPdata;
+    cfg->inv_mpu_cfg->requested_sensors |= INV_THREE_AXIS_COMPASS;
+    for (ii = 0; ii < 3; ii++)
+        inv_obj.mag->asa[ii] = 1L << 30;
+    inv_obj.mag->sens = 1L << 30;
+    pthread_mutex_unlock(&sMplLock);
+
+    sSamples = 0;
+    sBadSamples = 0;
+    sAgeTotal = 0;
+    memset(pkt, 0, sizeof(pkt));
+    pkt[GYRO_BYTES] = FOOTER_0;
+    pkt[GYRO_BYTES + 1] = FOOTER_1;
+    for (ii = 0; ii < SAMPLER_PACKETS; ii++) {
+        usleep(PACKET_PERIOD_US);
+        start = host_test_now_ns();
+        pthread_mutex_lock(&sMplLock);
+        CHECK(inv_mock_mpu_push_fifo(mpu, sizeof(pkt), pkt) == INV_SUCCESS);
+        CHECK(inv_update_data() == INV_SUCCESS);
+        pthread_mutex_unlock(&sMplLock);
+        times[ii] = host_test_now_ns() - start;
+        total += times[ii];
+    }
+
+    pthread_mutex_lock(&sMplLock);
+    CHECK(inv_dmp_stop() == INV_SUCCESS);
+    CHECK(!sampler_running());
+    CHECK(inv_set_compass_sampler(0, NULL, NULL, NULL) == INV_SUCCESS);
+    pthread_mutex_unlock(&sMplLock);
+
+    /* one read per 20 ms poll period, every one of them delivered */
+    CHECK(sSamples >= SAMPLER_PACKETS * PACKET_PERIOD_US / 1000 / 20 / 2);
+    CHECK(sBadSamples == 0);
+
+    qsort(times, SAMPLER_PACKETS, sizeof(times[0]), compare_ns);
+    printf("%s: %d compass samples, %lld us old when processed\n", name,
+           sSamples, sSamples ? sAgeTotal / sSamples / 1000 : 0);
+    printf("  fifo processing avg %lld us, p99 %lld us, max %lld us\n",
+           total / SAMPLER_PACKETS / 1000,
+           times[SAMPLER_PACKETS * 99 / 100] / 1000,
+           times[SAMPLER_PACKETS - 1] / 1000);
+
+    CHECK(inv_unregister_compass_rate_process(count_compass) == INV_SUCCESS);
+    cfg->inv_mpu_cfg->requested_sensors &= ~INV_THREE_AXIS_COMPASS;
+    cfg->slave[EXT_SLAVE_TYPE_COMPASS] = NULL;
+    cfg->pdata_slave[EXT_SLAVE_TYPE_COMPASS] = NULL;
+    inv_dmp_close();
+    inv_serial_stop();
+}
+
+void test_compass_sampler(void)
+{
+    run_compass_reads(0, "inline");
+    run_compass_reads(1, "sampler");
+}
@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * IntProcess() and the IntMux multiplexer with pipes and SOCK_SEQPACKET
+ * sockets standing in for the interrupt devices. A seqpacket socket
+ * returns one record per read(), as the mpuirq, slaveirq and timerirq
+ * drivers do.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "mltypes.h"
+#include "int.h"
+
+#include "host_tests.h"
+
+/*****************************************************************************/
+
+#define INT_PIPES   10
+
+static int sPipes[INT_PIPES][2];
+
+static void irq_pipes_open(void)
+{
+    int ii;
+    for (ii = 0; ii < INT_PIPES; ii++)
+        CHECK(pipe(sPipes[ii]) == 0);
+}
+
+static void irq_pipes_close(void)
+{
+    int ii;
+    for (ii = 0; ii < INT_PIPES; ii++) {
+        close(sPipes[ii][0]);
+        close(sPipes[ii][1]);
+    }
+}
+
+static void raise_irq(int ii, int count, long long irqtime)
+{
+    struct mpuirq_data irq;
+
+    memset(&irq, 0, sizeof(irq));
+    irq.interruptcount = count;
+    irq.irqtime = irqtime;
+    CHECK(write(sPipes[ii][1], &irq, sizeof(irq)) == sizeof(irq));
+}
+
+void test_int_process(void)
+{
+    struct mpuirq_data records[INT_PIPES];
+    struct mpuirq_data *data[INT_PIPES];
+    int handles[INT_PIPES];
+    long long start;
+    int ii;
+
+    irq_pipes_open();
+    for (ii = 0; ii < INT_PIPES; ii++) {
+        handles[ii] = sPipes[ii][0];
+        data[ii] = &records[ii];
+    }
+    memset(records, 0, sizeof(records));
+
+    /* one record from one of two handles */
+    raise_irq(1, 7, 1234);
+    CHECK(IntProcess(handles, 2, data, 0, 0) == 1);
+    CHECK(records[1].interruptcount == 7);
+    CHECK(records[1].irqtime == 1234);
+    CHECK(records[0].interruptcount == 0);
+
+    /* one record per call, even with two queued */
+    raise_irq(0, 1, 1);
+    raise_irq(0, 2, 2);
+    CHECK(IntProcess(handles, 2, data, 0, 0) == 1);
+    CHECK(records[0].interruptcount == 1);
+    CHECK(IntProcess(handles, 2, data, 0, 0) == 1);
+    CHECK(records[0].interruptcount == 2);
+
+    /* a short read is not a record */
+    CHECK(write(sPipes[0][1], "abc", 3) == 3);
+    CHECK(IntProcess(handles, 2, data, 0, 0) == 0);
+
+    /* more handles than fit on the stack */
+    for (ii = 0; ii < INT_PIPES; ii++)
+        raise_irq(ii, ii + 1, ii);
+    CHECK(IntProcess(handles, INT_PIPES, data, 0, 0) == INT_PIPES);
+    for (ii = 0; ii < INT_PIPES; ii++)
+        CHECK(records[ii].interruptcount == ii + 1);
+
+    /* a sub-millisecond timeout waits instead of polling */
+    start = host_test_now_ns();
+    CHECK(IntProcess(handles, 2, data, 0, 500) == 0);
+    CHECK(host_test_now_ns() - start >= 500000);
+
+    irq_pipes_close();
+}
+
+/*****************************************************************************/
+
+/* the test target links with --wrap for these, to count the syscalls made
+   by the interrupt code */
+static int sSyscalls;
+
+ssize_t __real_read(int fd, void *buf, size_t count);
+int __real_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+int __real_epoll_wait(int epfd, struct epoll_event *events,
+                      int maxevents, int timeout);
+
+ssize_t __wrap_read(int fd, void *buf, size_t count)
+{
+    sSyscalls++;
+    return __real_read(fd, buf, count);
+}
+
+int __wrap_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    sSyscalls++;
+    return __real_poll(fds, nfds, timeout);
+}
+
+int __wrap_epoll_wait(int epfd, struct epoll_event *events,
+                      int maxevents, int timeout)
+{
+    sSyscalls++;
+    return __real_epoll_wait(epfd, events, maxevents, timeout);
+}
+
+#define MUX_DEVICES     20
+
+/* read end in [0], as for the pipes */
+static int sDevices[MUX_DEVICES][2];
+
+static void irq_devices_open(void)
+{
+    int ii;
+    for (ii = 0; ii < MUX_DEVICES; ii++) {
+        CHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sDevices[ii]) == 0);
+        fcntl(sDevices[ii][1], F_SETFL, O_NONBLOCK);
+    }
+}
+
+static void irq_devices_close(void)
+{
+    int ii;
+    for (ii = 0; ii < MUX_DEVICES; ii++) {
+        close(sDevices[ii][0]);
+        close(sDevices[ii][1]);
+    }
+}
+
+static void raise_device_irq(int ii, int count, long long irqtime)
+{
+    struct mpuirq_data irq;
+
+    memset(&irq, 0, sizeof(irq));
+    irq.interruptcount = count;
+    irq.irqtime = irqtime;
+    CHECK(write(sDevices[ii][1], &irq, sizeof(irq)) == sizeof(irq));
+}
+
+void test_int_mux(void)
+{
+    struct int_irq_record records[64];
+    struct int_mux *mux;
+    long long start;
+    int ii, n, seen[MUX_DEVICES];
+
+    CHECK(IntMuxCreate(NULL) == INV_ERROR_INVALID_PARAMETER);
+    CHECK(IntMuxCreate(&mux) == INV_SUCCESS);
+    CHECK(IntMuxProcess(mux, records, 0, 0) == INV_ERROR_INVALID_PARAMETER);
+    CHECK(IntMuxProcess(mux, NULL, 8, 0) == INV_ERROR_INVALID_PARAMETER);
+
+    irq_devices_open();
+    for (ii = 0; ii < MUX_DEVICES; ii++)
+        CHECK(IntMuxAdd(mux, sDevices[ii][0], 100 + ii) == INV_SUCCESS);
+
+    /* everything queued on two devices in one call, in order */
+    for (ii = 0; ii < 5; ii++)
+        raise_device_irq(0, ii, 1000 + ii);
+    raise_device_irq(2, 7, 2000);
+    raise_device_irq(2, 8, 2001);
+    CHECK(IntMuxProcess(mux, records, 64, 0) == 7);
+    for (ii = 0, n = 0; ii < 7; ii++) {
+        if (records[ii].source == 100) {
+            CHECK(records[ii].data.interruptcount == n);
+            CHECK(records[ii].data.irqtime == 1000 + n);
+            n++;
+        } else {
+            CHECK(records[ii].source == 102);
+        }
+    }
+    CHECK(n == 5);
+    CHECK(IntMuxProcess(mux, records, 64, 0) == 0);
+
+    /* what does not fit is left for the next call */
+    for (ii = 0; ii < 20; ii++)
+        raise_device_irq(1, ii, ii);
+    CHECK(IntMuxProcess(mux, records, 8, 0) == 8);
+    CHECK(records[7].data.interruptcount == 7);
+    CHECK(IntMuxProcess(mux, records, 64, 0) == 12);
+    CHECK(records[0].data.interruptcount == 8);
+
+    /* more ready devices than one epoll_wait() returns */
+    for (ii = 0; ii < MUX_DEVICES; ii++)
+        raise_device_irq(ii, ii, ii);
+    memset(seen, 0, sizeof(seen));
+    n = IntMuxProcess(mux, records, 64, 0);
+    CHECK(n == INT_MUX_MAX_READY);
+    for (ii = 0; ii < n; ii++)
+        seen[records[ii].source - 100]++;
+    n = IntMuxProcess(mux, records, 64, 0);
+    CHECK(n == MUX_DEVICES - INT_MUX_MAX_READY);
+    for (ii = 0; ii < n; ii++)
+        seen[records[ii].source - 100]++;
+    for (ii = 0; ii < MUX_DEVICES; ii++)
+        CHECK(seen[ii] == 1);
+
+    /* pipes return all queued records at once */
+    irq_pipes_open();
+    CHECK(IntMuxAdd(mux, sPipes[0][0], 7) == INV_SUCCESS);
+    for (ii = 0; ii < 3; ii++)
+        raise_irq(0, ii, ii);
+    CHECK(IntMuxProcess(mux, records, 64, 0) == 3);
+    CHECK(records[2].source == 7 && records[2].data.interruptcount == 2);
+
+    /* a removed device is not reported */
+    CHECK(IntMuxRemove(mux, sDevices[3][0]) == INV_SUCCESS);
+    raise_device_irq(3, 1, 1);
+    CHECK(IntMuxProcess(mux, records, 64, 0) == 0);
+
+    start = host_test_now_ns();
+    CHECK(IntMuxProcess(mux, records, 64, 20) == 0);
+    CHECK(host_test_now_ns() - start >= 15000000LL);
+
+    CHECK(IntMuxDestroy(mux) == INV_SUCCESS);
+    irq_pipes_close();
+    irq_devices_close();
+}
+
+/*
+ * Wakeups and syscalls per 1000 interrupts from three devices, queued
+ * in bursts while the MPL is busy, drained by IntProcess() and by
+ * IntMuxProcess() until nothing is left. A wakeup is a call that
+ * returned interrupts, one trip through the HAL poll loop.
+ */
+#define BENCH_IRQS      (1000)
+#define BENCH_SOURCES   (3)
+
+void bench_int_mux(void)
+{
+    static const int bursts[] = { 1, 4, 16 };
+    struct mpuirq_data records[BENCH_SOURCES];
+    struct mpuirq_data *data[BENCH_SOURCES];
+    struct int_irq_record irqs[INT_MUX_MAX_READ];
+    int handles[BENCH_SOURCES];
+    struct int_mux *mux;
+    size_t b;
+    int ii, jj, raised, n, wakeups;
+    long long t0;
+
+    irq_devices_open();
+    CHECK(IntMuxCreate(&mux) == INV_SUCCESS);
+    for (ii = 0; ii < BENCH_SOURCES; ii++) {
+        handles[ii] = sDevices[ii][0];
+        data[ii] = &records[ii];
+        CHECK(IntMuxAdd(mux, handles[ii], ii) == INV_SUCCESS);
+    }
+
+    for (b = 0; b < sizeof(bursts) / sizeof(bursts[0]); b++) {
+        for (jj = 0; jj < 2; jj++) {
+            wakeups = 0;
+            sSyscalls = 0;
+            t0 = host_test_now_ns();
+            for (raised = 0; raised < BENCH_IRQS; ) {
+                for (ii = 0; ii < bursts[b] && raised < BENCH_IRQS;
+                     ii++, raised++)
+                    raise_device_irq(raised % BENCH_SOURCES, raised, raised);
+                do {
+                    if (jj == 0)
+                        n = IntProcess(handles, BENCH_SOURCES, data, 0, 0);
+                    else
+                        n = IntMuxProcess(mux, irqs, INT_MUX_MAX_READ, 0);
+                    if (n > 0)
+                        wakeups++;
+                } while (n > 0);
+            }
+            printf("    burst %2d, %s: %4d wakeups, %4d syscalls, "
+                   "%.1f us per 1000 irqs\n",
+                   bursts[b], jj ? "IntMuxProcess" : "IntProcess   ",
+                   wakeups, sSyscalls, (host_test_now_ns() - t0) / 1e3);
+        }
+    }
+
+    IntMuxDestroy(mux);
+    irq_devices_close();
+}
@@ -0,0 +1,417 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * mlMathFuncVec.c against the fixed point and cofactor code it replaces
+ * in the fusion snapshot and in the 3DOF compass calibration, and the
+ * per-sample cost of the 9-axis outputs computed both ways.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mlMathFunc.h"
+#include "mlMathFuncVec.h"
+
+#include "host_tests.h"
+
+/*****************************************************************************/
+
+#define MATH_QUATS      1024
+#define MATH_SAMPLES    1000000
+
+static float frand(void)
+{
+    return rand() / (float)RAND_MAX * 2.f - 1.f;
+}
+
+/* a random unit quaternion, as float and as the Q30 the FIFO decodes */
+static void random_quat(float *qf, long *q30)
+{
+    int kk;
+
+    for (kk = 0; kk < 4; kk++)
+        qf[kk] = frand();
+    inv_q_norm4(qf);
+    for (kk = 0; kk < 4; kk++) {
+        q30[kk] = (long)(qf[kk] * 1073741824.0);
+        qf[kk] = q30[kk] / 1073741824.0f;
+    }
+}
+
+/* the inverse the 3DOF compass calibration used to build from cofactors */
+static int cofactor_inverse4(float *m4, float *inv)
+{
+    float m[10][10] = { {0} };
+    float tmp[10][10];
+    float d;
+    int i, j, n;
+
+    for (i = 0; i < 4; i++)
+        for (j = 0; j < 4; j++)
+            m[i][j] = m4[i * 4 + j];
+    for (i = 0; i < 4; i++) {
+        for (j = 0; j < 4; j++) {
+            n = 4;
+            inv_matrix_det_inc(&m[0][0], &tmp[0][0], &n, i, j);
+            inv[j * 4 + i] = SIGNM(i + j) * inv_matrix_det(&tmp[0][0], &n);
+        }
+    }
+    n = 4;
+    d = inv_matrix_det(&m[0][0], &n);
+    if (d == 0)
+        return -1;
+    for (i = 0; i < 16; i++)
+        inv[i] /= d;
+    return 0;
+}
+
+/* a random matrix in the 10x10 layout of inv_matrix_det() and packed */
+static void random_matrix(float *m10, float *packed, int n)
+{
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++) {
+            m10[i * 10 + j] = frand() * 10.f;
+            packed[i * n + j] = m10[i * 10 + j];
+        }
+    }
+}
+
+static void test_det_inverse3(void)
+{
+    float m10[100], m[9], inv[9];
+    float singular[9] = { 1, 2, 3,  2, 4, 6,  0, 1, 0 };
+    double err = 0, derr = 0;
+    int t, i, j, k, n;
+
+    for (t = 0; t < 1000; t++) {
+        float d, ref;
+
+        random_matrix(m10, m, 3);
+        n = 3;
+        ref = inv_matrix_det(m10, &n);
+        d = inv_matrix_det3f(m);
+        derr = fmax(derr, fabs(d - ref) / 1e3);
+        if (fabs(ref) < 1.f)
+            continue;
+        CHECK(inv_matrix_inverse3f(m, inv) == INV_SUCCESS);
+        for (i = 0; i < 3; i++) {
+            for (j = 0; j < 3; j++) {
+                double s = 0;
+                for (k = 0; k < 3; k++)
+                    s += (double)m[i * 3 + k] * inv[k * 3 + j];
+                err = fmax(err, fabs(s - (i == j)));
+            }
+        }
+    }
+    printf("    det3f relative to cofactors %g, |M*inv3f - I| %g\n",
+           derr, err);
+    CHECK(derr < 1e-5);
+    CHECK(err < 1e-4);
+    CHECK(inv_matrix_det3f(singular) == 0.f);
+    CHECK(inv_matrix_inverse3f(singular, inv) == INV_ERROR_DIVIDE_BY_ZERO);
+}
+
+static void test_det4(void)
+{
+    float m10[100], m[16];
+    double derr = 0;
+    int t, n;
+
+    for (t = 0; t < 1000; t++) {
+        float ref;
+
+        random_matrix(m10, m, 4);
+        n = 4;
+        ref = inv_matrix_det(m10, &n);
+        /* relative to the size of the products, the entries being ~10 */
+        derr = fmax(derr, fabs(inv_matrix_det4f(m) - ref) / 1e4);
+    }
+    printf("    det4f relative to cofactors %g\n", derr);
+    CHECK(derr < 1e-5);
+}
+
+static void test_inverse4(void)
+{
+    float m[16], inv[16], ref[16];
+    float singular[16] = { 1, 2, 3, 4,  2, 4, 6, 8,  0, 1, 0, 1,  1, 0, 1, 0 };
+    double err = 0, diff = 0;
+    int t, i, j, k;
+
+    for (t = 0; t < 1000; t++) {
+        /* the normal equations the compass calibration accumulates */
+        float x[3];
+        for (i = 0; i < 16; i++)
+            m[i] = 0;
+        for (k = 0; k < 50; k++) {
+            float row[4];
+            for (i = 0; i < 3; i++)
+                x[i] = frand() * 50.f;
+            row[0] = -2 * x[0];
+            row[1] = -2 * x[1];
+            row[2] = -2 * x[2];
+            row[3] = 1;
+            for (i = 0; i < 4; i++)
+                for (j = 0; j < 4; j++)
+                    m[i * 4 + j] += row[i] * row[j];
+        }
+
+        CHECK(inv_matrix_inverse4f(m, inv) == INV_SUCCESS);
+        CHECK(cofactor_inverse4(m, ref) == 0);
+        for (i = 0; i < 4; i++) {
+            for (j = 0; j < 4; j++) {
+                double s = 0;
+                for (k = 0; k < 4; k++)
+                    s += (double)m[i * 4 + k] * inv[k * 4 + j];
+                err = fmax(err, fabs(s - (i == j)));
+                diff = fmax(diff, fabs(inv[i * 4 + j] - ref[i * 4 + j]) /
+                            fmax(fabs(ref[i * 4 + j]), 1e-6));
+            }
+        }
+    }
+    printf("    inverse4f: |M*inv - I| %g, relative to cofactors %g\n",
+           err, diff);
+    CHECK(err < 1e-3);
+    CHECK(diff < 1e-3);
+    CHECK(inv_matrix_inverse4f(singular, inv) == INV_ERROR_DIVIDE_BY_ZERO);
+}
+
+static void test_quaternion(void)
+{
+    /* odd counts so the NEON builds also run their scalar tail */
+    enum { COUNT = 7 };
+    long q30[COUNT * 4];
+    float qf[COUNT * 4], q[COUNT * 4];
+    float rot[COUNT * 9];
+    long rot30[9];
+    double err = 0;
+    long grav = 0;
+    int t, ii, kk;
+
+    for (t = 0; t < 1000; t++) {
+        for (ii = 0; ii < COUNT; ii++)
+            random_quat(&qf[ii * 4], &q30[ii * 4]);
+
+        inv_q30_to_float_batch(q30, q, COUNT * 4);
+        for (kk = 0; kk < COUNT * 4; kk++)
+            CHECK(q[kk] == inv_q30_to_float(q30[kk]));
+
+        inv_quaternion_to_rotation_batchf(q, rot, COUNT);
+        for (ii = 0; ii < COUNT; ii++) {
+            inv_quaternion_to_rotation(&q30[ii * 4], rot30);
+            for (kk = 0; kk < 9; kk++)
+                err = fmax(err, fabs(rot[ii * 9 + kk] -
+                                     rot30[kk] / 1073741824.0));
+            /* the body gravity cached by the snapshot, in Q16 */
+            for (kk = 0; kk < 3; kk++)
+                grav = MAX(grav, labs((long)(rot[ii * 9 + 6 + kk] * 65536.f)
+                                      - (rot30[6 + kk] >> 14)));
+        }
+    }
+    printf("    rotation: max error %g, gravity max error %ld LSB\n",
+           err, grav);
+    CHECK(err < 1e-6);
+    CHECK(grav <= 1);
+}
+
+static void test_quaternion_ops(void)
+{
+    /* odd counts so the NEON builds also run their scalar tail */
+    enum { COUNT = 7 };
+    float q1[COUNT * 4], q2[COUNT * 4], prod[COUNT * 4], ref[4];
+    float q[COUNT * 4];
+    long q30[4];
+    double err = 0, nerr = 0;
+    int t, ii, kk;
+
+    for (t = 0; t < 1000; t++) {
+        for (ii = 0; ii < COUNT; ii++) {
+            random_quat(&q1[ii * 4], q30);
+            random_quat(&q2[ii * 4], q30);
+        }
+
+        inv_q_mult_batchf(q1, q2, prod, COUNT);
+        for (ii = 0; ii < COUNT; ii++) {
+            inv_q_multf(&q1[ii * 4], &q2[ii * 4], ref);
+            for (kk = 0; kk < 4; kk++)
+                err = fmax(err, fabs(prod[ii * 4 + kk] - ref[kk]));
+        }
+        /* in place, as the snapshot uses it */
+        inv_q_mult_batchf(q1, q2, q1, COUNT);
+        for (kk = 0; kk < COUNT * 4; kk++)
+            CHECK(q1[kk] == prod[kk]);
+
+        /* off unit length by up to 1%, as a drifting quaternion */
+        for (kk = 0; kk < COUNT * 4; kk++)
+            q[kk] = q2[kk] * (1.f + frand() * 0.01f);
+        inv_q_normalize_batchf(q, COUNT);
+        for (ii = 0; ii < COUNT; ii++) {
+            double mag = 0;
+            for (kk = 0; kk < 4; kk++)
+                mag += (double)q[ii * 4 + kk] * q[ii * 4 + kk];
+            nerr = fmax(nerr, fabs(sqrt(mag) - 1.));
+        }
+    }
+    printf("    q_mult max error %g, normalized length error %g\n",
+           err, nerr);
+    CHECK(err < 1e-6);
+    CHECK(nerr < 1e-6);
+
+    memset(q, 0, sizeof(q));
+    inv_q_normalize_batchf(q, COUNT);
+    for (ii = 0; ii < COUNT; ii++)
+        CHECK(q[ii * 4] == 1.f && q[ii * 4 + 1] == 0.f &&
+              q[ii * 4 + 2] == 0.f && q[ii * 4 + 3] == 0.f);
+}
+
+static void test_trig(void)
+{
+    double ea = 0, es = 0;
+    int t;
+
+    for (t = 0; t < 100000; t++) {
+        float y = frand(), x = frand();
+        ea = fmax(ea, fabs(inv_fast_atan2f(y, x) - atan2(y, x)));
+        es = fmax(es, fabs(inv_fast_asinf(x) - asin(x)));
+    }
+    printf("    atan2 max error %g, asin max error %g\n", ea, es);
+    CHECK(ea <= INV_FAST_ATAN2_MAX_ERROR);
+    CHECK(es <= INV_FAST_ASIN_MAX_ERROR);
+    CHECK(inv_fast_atan2f(0.f, 0.f) == 0.f);
+    CHECK(fabs(inv_fast_asinf(1.5f) - M_PI / 2) < 1e-6);
+}
+
+void test_math_accuracy(void)
+{
+    srand(1);
+    test_inverse4();
+    test_quaternion();
+    test_trig();
+    test_det_inverse3();
+    test_det4();
+    test_quaternion_ops();
+}
+
+/*****************************************************************************/
+
+/*
+ * Per-sample cost of the 9-axis outputs of a FIFO packet, from the Q30
+ * quaternion and the Q16 accel to what the orientation, rotation vector,
+ * gravity and linear acceleration handlers report: as the MPL getters and
+ * the HAL computed them, in fixed point with libm, and as the snapshot and
+ * the HAL do now.  Then the cost of one 3DOF compass calibration solve.
+ */
+void bench_fusion_pipeline(void)
+{
+    static long q30[MATH_QUATS][4];
+    static long acc[MATH_QUATS][3];
+    float qf[4], q[4], rot[9], grav[3], la[4], conj[4], out[3];
+    long qn[4], rot30[9], g30[3], la30[4], qi[4], t30[4];
+    float m10[100], tmp10[100], m[16], inv[16];
+    volatile float sink = 0;
+    long long t0, t1, t2;
+    int ii, kk, jj, n;
+
+    srand(2);
+    for (ii = 0; ii < MATH_QUATS; ii++) {
+        random_quat(qf, q30[ii]);
+        for (kk = 0; kk < 3; kk++)
+            acc[ii][kk] = (long)(frand() * 2.f * 65536.f);
+    }
+
+    t0 = host_test_now_ns();
+    for (ii = 0; ii < MATH_SAMPLES; ii++) {
+        const long *a = acc[ii % MATH_QUATS];
+        memcpy(qn, q30[ii % MATH_QUATS], sizeof(qn));
+        inv_q_normalize(qn);
+        for (kk = 0; kk < 4; kk++)
+            q[kk] = qn[kk] / 1073741824.0f;
+        inv_quaternion_to_rotation(qn, rot30);
+        for (kk = 0; kk < 9; kk++)
+            rot[kk] = rot30[kk] / 1073741824.0f;
+        /* gravity and linear accel, body and world frame */
+        la30[0] = 0;
+        for (kk = 0; kk < 3; kk++) {
+            g30[kk] = rot30[6 + kk] >> 14;
+            la30[kk + 1] = a[kk] - g30[kk];
+        }
+        inv_q_mult(qn, la30, t30);
+        inv_q_invert(qn, qi);
+        inv_q_mult(t30, qi, la30);
+        /* orientation and rotation vector */
+        out[0] = atan2f(rot[3], rot[0]);
+        out[1] = atan2f(rot[7], rot[8]);
+        out[2] = asinf(-rot[6]);
+        sink += q[1] / sqrtf(q[1] * q[1] + q[2] * q[2] + q[3] * q[3]) +
+            out[0] + out[1] + out[2] + la30[1] / 65536.f;
+    }
+    t1 = host_test_now_ns();
+    for (ii = 0; ii < MATH_SAMPLES; ii++) {
+        const long *a = acc[ii % MATH_QUATS];
+        inv_q30_to_float_batch(q30[ii % MATH_QUATS], q, 4);
+        inv_q_normalize_batchf(q, 1);
+        inv_quaternion_to_rotation_batchf(q, rot, 1);
+        la[0] = 0.f;
+        for (kk = 0; kk < 3; kk++) {
+            grav[kk] = rot[6 + kk];
+            la[kk + 1] = a[kk] / 65536.f - grav[kk];
+        }
+        conj[0] = q[0];
+        for (kk = 1; kk < 4; kk++)
+            conj[kk] = -q[kk];
+        inv_q_mult_batchf(q, la, la, 1);
+        inv_q_mult_batchf(la, conj, la, 1);
+        out[0] = inv_fast_atan2f(rot[3], rot[0]);
+        out[1] = inv_fast_atan2f(rot[7], rot[8]);
+        out[2] = inv_fast_asinf(-rot[6]);
+        sink += q[1] + out[0] + out[1] + out[2] + la[1];
+    }
+    t2 = host_test_now_ns();
+
+    printf("    9-axis outputs, fixed point + libm: %.1f ns/sample\n",
+           (double)(t1 - t0) / MATH_SAMPLES);
+    printf("    9-axis outputs, float batch + fast trig: %.1f ns/sample\n",
+           (double)(t2 - t1) / MATH_SAMPLES);
+
+    /* the 4x4 normal equations of the compass calibration */
+    random_matrix(m10, m, 4);
+    t0 = host_test_now_ns();
+    for (ii = 0; ii < MATH_SAMPLES / 100; ii++) {
+        for (kk = 0; kk < 4; kk++) {
+            for (jj = 0; jj < 4; jj++) {
+                n = 4;
+                inv_matrix_det_inc(m10, tmp10, &n, kk, jj);
+                inv[jj * 4 + kk] = SIGNM(kk + jj) * inv_matrix_det(tmp10, &n);
+            }
+        }
+        n = 4;
+        sink += inv[ii & 15] / inv_matrix_det(m10, &n);
+    }
+    t1 = host_test_now_ns();
+    for (ii = 0; ii < MATH_SAMPLES / 100; ii++) {
+        inv_matrix_inverse4f(m, inv);
+        sink += inv[ii & 15] + inv_matrix_det3f(m);
+    }
+    t2 = host_test_now_ns();
+    printf("    compass solve, cofactors: %.1f ns, closed form: %.1f ns\n",
+           (double)(t1 - t0) / (MATH_SAMPLES / 100),
+           (double)(t2 - t1) / (MATH_SAMPLES / 100));
+    (void)sink;
+}
@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The serial backends of mlsl_linux_mpu.c and mlsl_linux_mock.c, and the
+ * MPL fed from the software MPU model.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mpu.h"
+#include "mpu6050b1.h"
+#include "ml.h"
+#include "mldl.h"
+#include "mlFIFO.h"
+#include "mlBiasNoMotion.h"
+#include "dmpKey.h"
+#include "mlsl.h"
+#include "mlsl_backend.h"
+
+#include "host_tests.h"
+
+#define TRACE_FILE          "/tmp/sensors_host_tests.trace"
+#define STATS_THREADS       4
+#define STATS_IOCTLS        10000
+
+#define REPLAY_PACKETS      2000
+#define BIAS_UPDATES        2000
+/* DMP output of inv_send_quaternion(INV_32_BIT), then the FIFO footer */
+#define QUAT_BYTES          16
+#define FOOTER_0            0xB2
+#define FOOTER_1            0x6A
+
+/*****************************************************************************/
+
+static unsigned long total_transactions(const struct inv_serial_stats *stats)
+{
+    unsigned long total = 0;
+    int op;
+
+    for (op = 0; op < INV_SERIAL_NUM_OPS; op++)
+        total += stats->transactions[op];
+    return total;
+}
+
+static unsigned long long total_bytes(const struct inv_serial_stats *stats)
+{
+    unsigned long long total = 0;
+    int op;
+
+    for (op = 0; op < INV_SERIAL_NUM_OPS; op++)
+        total += stats->bytes[op];
+    return total;
+}
+
+static void *stats_thread(void *arg)
+{
+    void *handle = arg;
+    unsigned char val;
+    struct mpu_read_write msg;
+    int ii;
+
+    for (ii = 0; ii < STATS_IOCTLS; ii++) {
+        msg.address = MPUREG_WHOAMI;
+        msg.length = 1;
+        msg.data = &val;
+        inv_serial_ioctl(handle, MPU_READ, &msg);
+    }
+    return NULL;
+}
+
+void test_mock_backend(void)
+{
+    void *handle;
+    unsigned char byte = 0;
+    unsigned char cfg[64];
+    struct inv_serial_stats stats;
+    pthread_t threads[STATS_THREADS];
+    int ii;
+
+    /* the mock controls refuse handles of other backends */
+    CHECK(inv_serial_get_backend() == &inv_serial_kernel_backend);
+    CHECK(inv_mock_mpu_push_fifo(&byte, 1, &byte) ==
+          INV_ERROR_INVALID_MODULE);
+    CHECK(inv_mock_mpu_set_rate(&byte, 0, 0) == INV_ERROR_INVALID_MODULE);
+    CHECK(inv_mock_mpu_read_mem(&byte, 0, 1, &byte) ==
+          INV_ERROR_INVALID_MODULE);
+
+    CHECK(inv_serial_open("mock:", &handle) == INV_SUCCESS);
+    CHECK(inv_serial_get_backend() == &inv_serial_mock_backend);
+    CHECK(inv_mock_mpu_push_fifo(handle, 1, &byte) == INV_SUCCESS);
+    CHECK(inv_mock_mpu_push_fifo(NULL, 1, &byte) ==
+          INV_ERROR_INVALID_MODULE);
+
+    /* a gyro only model: the secondary slaves report a real errno */
+    errno = 0;
+    CHECK(inv_serial_ioctl(handle, MPU_GET_CONFIG_ACCEL, cfg) < 0);
+    CHECK(errno == ENODEV);
+
+    /* concurrent transactions are all counted */
+    inv_serial_reset_stats();
+    for (ii = 0; ii < STATS_THREADS; ii++)
+        CHECK(!pthread_create(&threads[ii], NULL, stats_thread, handle));
+    for (ii = 0; ii < STATS_THREADS; ii++)
+        pthread_join(threads[ii], NULL);
+    inv_serial_get_stats(&stats);
+    CHECK(stats.transactions[INV_SERIAL_OP_READ] ==
+          STATS_THREADS * STATS_IOCTLS);
+    CHECK(stats.bytes[INV_SERIAL_OP_READ] == STATS_THREADS * STATS_IOCTLS);
+    CHECK(stats.errors == 0);
+
+    inv_serial_close(handle);
+    CHECK(inv_serial_get_backend() == &inv_serial_kernel_backend);
+    CHECK(inv_mock_mpu_push_fifo(handle, 1, &byte) ==
+          INV_ERROR_INVALID_MODULE);
+
+    /* and accept the mock wrapped by the recorder */
+    CHECK(inv_serial_open("record:" TRACE_FILE ",mock:", &handle) ==
+          INV_SUCCESS);
+    CHECK(inv_serial_get_backend() == &inv_serial_record_backend);
+    CHECK(inv_mock_mpu_push_fifo(handle, 1, &byte) == INV_SUCCESS);
+    inv_serial_close(handle);
+    unlink(TRACE_FILE);
+}
+
+/*****************************************************************************/
+
+static void put_long(unsigned char *buf, long val)
+{
+    buf[0] = (unsigned char)(val >> 24);
+    buf[1] = (unsigned char)(val >> 16);
+    buf[2] = (unsigned char)(val >> 8);
+    buf[3] = (unsigned char)val;
+}
+
+/* a unit quaternion turning about z, in q30 */
+static void make_quat(int sample, long *quat)
+{
+    double angle = sample * 0.01;
+
+    quat[0] = (long)(cos(angle / 2) * (1L << 30));
+    quat[1] = 0;
+    quat[2] = 0;
+    quat[3] = (long)(sin(angle / 2) * (1L << 30));
+}
+
+/*
+ * Pushes synthetic DMP packets into the model one at a time and checks
+ * the quaternion the MPL decodes from each, then reports the serial
+ * transactions, bytes and CPU time spent per sample.
+ */
+void test_mpl_replay(void)
+{
+    inv_error_t result;
+    struct inv_serial_stats stats;
+    unsigned char pkt[QUAT_BYTES + 2];
+    long quat[4];
+    long golden[4];
+    long maxErr = 0;
+    long long start;
+    long long elapsed;
+    void *mpu;
+    int ii;
+    int kk;
+
+    CHECK(inv_serial_start("mock:") == INV_SUCCESS);
+    /* the model has no accel, so only its calibration fails */
+    result = inv_dmp_open();
+    CHECK(result == INV_SUCCESS || result == INV_ERROR_INVALID_CONFIGURATION);
+    CHECK(inv_send_quaternion(INV_32_BIT) == INV_SUCCESS);
+    CHECK(inv_set_fifo_rate(0) == INV_SUCCESS);
+    CHECK(inv_dmp_start() == INV_SUCCESS);
+    CHECK(inv_get_fifo_packet_size() == sizeof(pkt));
+
+    mpu = inv_get_serial_handle();
+    inv_serial_reset_stats();
+    elapsed = 0;
+    for (ii = 0; ii < REPLAY_PACKETS; ii++) {
+        make_quat(ii, golden);
+        for (kk = 0; kk < 4; kk++)
+            put_long(&pkt[kk * 4], golden[kk]);
+        pkt[QUAT_BYTES] = FOOTER_0;
+        pkt[QUAT_BYTES + 1] = FOOTER_1;
+        CHECK(inv_mock_mpu_push_fifo(mpu, sizeof(pkt), pkt) == INV_SUCCESS);
+
+        start = host_test_now_ns();
+        result = inv_update_data();
+        elapsed += host_test_now_ns() - start;
+        CHECK(result == INV_SUCCESS);
+
+        CHECK(inv_get_quaternion(quat) == INV_SUCCESS);
+        for (kk = 0; kk < 4; kk++) {
+            long err = labs(quat[kk] - golden[kk]);
+            if (err > maxErr)
+                maxErr = err;
+        }
+    }
+    inv_serial_get_stats(&stats);
+    /* the FIFO is unpacked by byte offsets into 32 bit longs */
+    if (sizeof(long) == 4)
+        CHECK(maxErr == 0);
+    else
+        printf("  quaternions not checked, long is %d bytes\n",
+               (int)sizeof(long));
+    CHECK(stats.transactions[INV_SERIAL_OP_READ_FIFO] == REPLAY_PACKETS);
+    CHECK(stats.errors == 0);
+
+    printf("%d samples: %.1f transactions, %.1f bytes, %lld ns per sample\n",
+           REPLAY_PACKETS,
+           (double)total_transactions(&stats) / REPLAY_PACKETS,
+           (double)total_bytes(&stats) / REPLAY_PACKETS,
+           elapsed / REPLAY_PACKETS);
+    printf("  fifo reads %lu, register reads %lu, batches %lu\n",
+           stats.transactions[INV_SERIAL_OP_READ_FIFO],
+           stats.transactions[INV_SERIAL_OP_READ], stats.batches);
+
+    inv_dmp_stop();
+    inv_dmp_close();
+    inv_serial_stop();
+}
+
+/*****************************************************************************/
+
+/*
+ * Errors while queueing are kept by the batch: the submit fails without
+ * sending anything and leaves the read buffers alone.
+ */
+static void check_failed_batch(struct inv_mpu_batch *batch,
+                               const unsigned char *regs, int count)
+{
+    struct inv_serial_stats stats;
+    int ii;
+
+    inv_serial_reset_stats();
+    CHECK(inv_mpu_batch_submit(batch) != INV_SUCCESS);
+    inv_serial_get_stats(&stats);
+    CHECK(total_transactions(&stats) == 0);
+    for (ii = 0; ii < count; ii++)
+        CHECK(regs[ii] == 0xa5);
+}
+
+static void run_bias_updates(const char *port, const char *name)
+{
+    struct inv_serial_stats stats;
+    unsigned char flag[2];
+    long long start;
+    long long elapsed = 0;
+    int failed = 0;
+    int ii;
+
+    CHECK(inv_serial_start(port) == INV_SUCCESS);
+    inv_dmp_open();
+    CHECK(inv_enable_bias_no_motion() == INV_SUCCESS);
+    CHECK(inv_dmp_start() == INV_SUCCESS);
+    /* the DMP agrees on the no motion duration */
+    flag[0] = (unsigned char)(inv_obj.lite_fusion->motion_duration >> 8);
+    flag[1] = (unsigned char)inv_obj.lite_fusion->motion_duration;
+    CHECK(inv_set_mpu_memory(KEY_D_1_98, 2, flag) == INV_SUCCESS);
+
+    inv_serial_reset_stats();
+    for (ii = 0; ii < BIAS_UPDATES; ii++) {
+        start = host_test_now_ns();
+        if (inv_update_bias() != INV_SUCCESS)
+            failed++;
+        elapsed += host_test_now_ns() - start;
+    }
+    inv_serial_get_stats(&stats);
+    CHECK(failed == 0);
+    CHECK(stats.errors == 0);
+
+    printf("%s: %.1f transfers, %.1f batches, %lld ns per bias update\n",
+           name, (double)total_transactions(&stats) / BIAS_UPDATES,
+           (double)stats.batches / BIAS_UPDATES, elapsed / BIAS_UPDATES);
+
+    inv_dmp_stop();
+    inv_dmp_close();
+    inv_serial_stop();
+}
+
+void test_mpu_batch(void)
+{
+    struct inv_mpu_batch batch;
+    unsigned char regs[SERIAL_MAX_TRANSFER_SIZE + 1];
+    unsigned char val = 0;
+    inv_error_t result;
+
+    CHECK(inv_serial_start("mock:") == INV_SUCCESS);
+    result = inv_dmp_open();
+    CHECK(result == INV_SUCCESS || result == INV_ERROR_INVALID_CONFIGURATION);
+    memset(regs, 0xa5, sizeof(regs));
+
+    inv_mpu_batch_init(&batch);
+    CHECK(inv_mpu_batch_get_memory(&batch, KEY_D_1_244, 12, regs) ==
+          INV_SUCCESS);
+    CHECK(inv_mpu_batch_get_memory(&batch, NUM_KEYS, 2, &regs[12]) != 0);
+    CHECK(inv_mpu_batch_read(&batch, MPUREG_TEMP_OUT_H, 2, &regs[14]) != 0);
+    check_failed_batch(&batch, regs, 16);
+
+    inv_mpu_batch_init(&batch);
+    CHECK(inv_mpu_batch_set_memory(&batch, NUM_KEYS, 1, &val) != 0);
+    CHECK(inv_mpu_batch_get_memory(&batch, KEY_D_1_244, 12, regs) != 0);
+    check_failed_batch(&batch, regs, 12);
+
+    inv_mpu_batch_init(&batch);
+    CHECK(inv_mpu_batch_get_memory(&batch, KEY_D_1_244, 12, regs) ==
+          INV_SUCCESS);
+    CHECK(inv_mpu_batch_set_memory(&batch, KEY_FCFG_6, 1, NULL) != 0);
+    check_failed_batch(&batch, regs, 12);
+
+    inv_mpu_batch_init(&batch);
+    CHECK(inv_mpu_batch_read(&batch, MPUREG_TEMP_OUT_H, sizeof(regs),
+                             regs) != 0);
+    check_failed_batch(&batch, regs, sizeof(regs));
+
+    /* an empty batch is fine */
+    inv_mpu_batch_init(&batch);
+    CHECK(inv_mpu_batch_submit(&batch) == INV_SUCCESS);
+
+    inv_dmp_close();
+    inv_serial_stop();
+
+    /* the model runs a batch in one call, the recorder one transfer at
+       a time like the kernel backend */
+    run_bias_updates("mock:", "batched");
+    run_bias_updates("record:/dev/null,mock:", "unbatched");
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The gyro self test of mputest.c, run against the gyro of the software
+ * MPU model: its biases, its FIFO reads and its quick mode.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ml.h"
+#include "mldl_cfg.h"
+#include "mlsl.h"
+#include "mlsl_backend.h"
+#include "mputest.h"
+
+#include "host_tests.h"
+
+/* the defaults of mputest.c */
+#define SELF_TEST_ADDR      0x68
+#define SELF_TEST_SENS      (32768.f / 250)
+#define SELF_TEST_PACKETS   75
+#define SELF_TEST_TOL       .03f
+#define SELF_TEST_PERIOD_MS 75
+
+#define GYRO_NOISE          30
+
+extern struct mldl_cfg *mldl_cfg;
+int inv_test_gyro(void *mlsl_handle, short gyro_biases[3], short *temp_avg,
+                  uint_fast8_t perform_full_test);
+
+static const short sBias[3] = { 100, -50, 20 };
+
+/*****************************************************************************/
+
+struct self_test_run {
+    int result;
+    short bias[3];
+    long long ms;
+    unsigned long transactions;
+    unsigned long fifo_reads;
+};
+
+static void *self_test_open(void)
+{
+    inv_error_t result;
+    void *mpu;
+
+    CHECK(inv_serial_start("mock:") == INV_SUCCESS);
+    result = inv_dmp_open();
+    CHECK(result == INV_SUCCESS || result == INV_ERROR_INVALID_CONFIGURATION);
+    mpu = inv_get_serial_handle();
+    mldl_cfg = inv_get_dl_config();
+    CHECK(inv_mock_mpu_set_gyro(mpu, sBias, GYRO_NOISE) == INV_SUCCESS);
+    return mpu;
+}
+
+static void self_test_close(void)
+{
+    inv_dmp_close();
+    inv_serial_stop();
+}
+
+static void self_test_run(void *mpu, int quick, int full,
+                          struct self_test_run *run)
+{
+    struct inv_serial_stats stats;
+    short temp;
+    long long start;
+    int op;
+
+    inv_serial_reset_stats();
+    /* otherwise left to mputest.c, which clears it at every run */
+    if (quick)
+        inv_set_test_quick_mode(true);
+    start = host_test_now_ns();
+    run->result = inv_test_gyro(mpu, run->bias, &temp, full);
+    run->ms = (host_test_now_ns() - start) / 1000000;
+    inv_serial_get_stats(&stats);
+    run->transactions = 0;
+    for (op = 0; op < INV_SERIAL_NUM_OPS; op++)
+        run->transactions += stats.transactions[op];
+    run->fifo_reads = stats.transactions[INV_SERIAL_OP_READ_FIFO];
+}
+
+static int bias_close(const short *bias)
+{
+    int kk;
+
+    for (kk = 0; kk < 3; kk++)
+        if (abs(bias[kk] - sBias[kk]) > 5)
+            return false;
+    return true;
+}
+
+void test_self_test(void)
+{
+    struct self_test_run run;
+    void *mpu;
+
+    mpu = self_test_open();
+
+    /* one bulk FIFO read per clock source */
+    self_test_run(mpu, false, false, &run);
+    CHECK(run.result == 0);
+    CHECK(bias_close(run.bias));
+    CHECK(run.fifo_reads == 3);
+    CHECK(run.ms >= 3 * SELF_TEST_PERIOD_MS);
+
+    /* quick mode: the same biases, sooner */
+    self_test_run(mpu, true, false, &run);
+    CHECK(run.result == 0);
+    CHECK(bias_close(run.bias));
+    CHECK(run.fifo_reads >= 3);
+    CHECK(run.ms < 3 * SELF_TEST_PERIOD_MS);
+
+    /* and for that run only */
+    self_test_run(mpu, false, false, &run);
+    CHECK(run.result == 0);
+    CHECK(run.ms >= 3 * SELF_TEST_PERIOD_MS);
+
+    /* a period that cannot be read back in one FIFO transfer */
+    inv_set_test_parameters(SELF_TEST_ADDR, SELF_TEST_SENS, 200,
+                            SELF_TEST_TOL, 60, 20);
+    self_test_run(mpu, false, false, &run);
+    CHECK(run.result == INV_ERROR_INVALID_PARAMETER);
+    CHECK(run.fifo_reads == 0);
+    inv_set_test_parameters(SELF_TEST_ADDR, SELF_TEST_SENS, SELF_TEST_PACKETS,
+                            SELF_TEST_TOL, 60, 20);
+
+    self_test_close();
+}
+
+/*****************************************************************************/
+
+/* wall time and bus transactions of a self test and a calibration run */
+void bench_self_test(void)
+{
+    static const char *names[2] = { "self test", "calibration" };
+    struct self_test_run run;
+    void *mpu;
+    int full, quick;
+
+    mpu = self_test_open();
+    for (full = 0; full < 2; full++) {
+        for (quick = 0; quick < 2; quick++) {
+            self_test_run(mpu, quick, full, &run);
+            printf("%s%s: %s, %lld ms, %lu transactions, %lu FIFO reads\n",
+                   names[full], quick ? ", quick" : "",
+                   run.result ? "FAIL" : "pass", run.ms, run.transactions,
+                   run.fifo_reads);
+        }
+    }
+    self_test_close();
+}
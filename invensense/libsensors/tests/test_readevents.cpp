@@ -0,0 +1,438 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * MPLSensor::readEvents over the software MPU model: against the events the
+ * HAL built from the per value MPL getters before the fusion snapshot, and
+ * the per sensor decimation of mixed rate listeners.
+ */
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MPLSensor.h"
+#include "ml.h"
+#include "mlFIFO.h"
+#include "mlFIFOHW.h"
+#include "mlstates.h"
+#include "mlsl.h"
+#include "mlsl_backend.h"
+
+#include "host_tests.h"
+
+#define TRACE_PACKETS       2000
+#define FIFO_PERIOD_NS      10000000LL
+/* the fusion outputs of the trace, in m/s^2 and rad/s */
+#define MAX_DELTA           (1e-3f)
+/* the snapshot renormalizes every quaternion, the getters only those
+   longer than one */
+#define MAX_RV_DELTA        (1e-2f)
+#define FOOTER_0            0xB2
+#define FOOTER_1            0x6A
+
+/*****************************************************************************/
+
+namespace {
+
+const int kSensors[] = { ID_RV, ID_LA, ID_GR, ID_GY, ID_A };
+const char *const kNames[] = { "rv", "la", "gr", "gy", "a" };
+#define NUM_TRACE_SENSORS   (int)(sizeof(kSensors) / sizeof(kSensors[0]))
+
+/* packet n of the trace: a unit quaternion in q30, then small big endian
+   words for the other DMP outputs, then the footer.
+   Each quaternion word repeats one byte, so that it reads the same whatever
+   byte order the MPL unpacks the FIFO with (glibc defines BIG_ENDIAN), and
+   q1 and q3 stay 0 as with 64 bit longs they land in the upper halves of
+   q0 and q2. The DMP rounding keeps the norm within 1% of one. */
+void makePacket(int n, unsigned char *pkt, int len)
+{
+    int b = (n * 7) % 40;
+    int a = (int)(sqrt(64.0 * 64.0 - b * b) + 0.5);
+    int ii;
+
+    memset(pkt, 0, 16);
+    memset(&pkt[0], a, 4);
+    memset(&pkt[8], b, 4);
+    for (ii = 16; ii + 1 < len - 2; ii += 2) {
+        short val = (short)(((n * 131 + ii * 17) % 2048) - 1024);
+        pkt[ii] = (unsigned char)(val >> 8);
+        pkt[ii + 1] = (unsigned char)val;
+    }
+    pkt[len - 2] = FOOTER_0;
+    pkt[len - 1] = FOOTER_1;
+}
+
+/* the event sensor s used to report for the last packet, from the getters
+   of the MPL and the scaling of the handlers */
+bool goldenEvent(int s, float *v)
+{
+    float quat[4];
+    float norm;
+    int ii;
+
+    switch (s) {
+    case ID_RV:
+        if (inv_get_quaternion_float(quat))
+            return false;
+        norm = quat[1] * quat[1] + quat[2] * quat[2] + quat[3] * quat[3]
+                + FLT_EPSILON;
+        if (norm > 1.0f) {
+            norm = sqrtf(norm);
+            for (ii = 1; ii < 4; ii++)
+                quat[ii] /= norm;
+        }
+        for (ii = 0; ii < 3; ii++)
+            v[ii] = quat[0] < 0.0f ? -quat[ii + 1] : quat[ii + 1];
+        return true;
+    case ID_LA:
+        if (inv_get_float_array(INV_LINEAR_ACCELERATION, v))
+            return false;
+        break;
+    case ID_GR:
+        if (inv_get_float_array(INV_GRAVITY, v))
+            return false;
+        break;
+    case ID_GY:
+#if defined USE_TYPE_GYROSCOPE_COMPENSATED
+        if (inv_get_gyro_float(v))
+            return false;
+#else
+        if (inv_get_gyro_raw_float(v))
+            return false;
+#endif
+        for (ii = 0; ii < 3; ii++)
+            v[ii] = v[ii] * M_PI / 180.0;
+        return true;
+    case ID_A:
+        if (inv_get_accel_float(v))
+            return false;
+        break;
+    default:
+        return false;
+    }
+    for (ii = 0; ii < 3; ii++)
+        v[ii] *= 9.81;
+    return true;
+}
+
+unsigned long totalTransactions(const struct inv_serial_stats *stats)
+{
+    unsigned long total = 0;
+
+    for (int op = 0; op < INV_SERIAL_NUM_OPS; op++)
+        total += stats->transactions[op];
+    return total;
+}
+
+unsigned long long totalBytes(const struct inv_serial_stats *stats)
+{
+    unsigned long long total = 0;
+
+    for (int op = 0; op < INV_SERIAL_NUM_OPS; op++)
+        total += stats->bytes[op];
+    return total;
+}
+
+/* the MPL sensor of the HAL on a fresh software MPU model */
+MPLSensor *openSensor(void)
+{
+    setenv(INV_SERIAL_PORT_ENV, INV_SERIAL_MOCK_PREFIX, 1);
+    MPLSensor *sensor = new MPLSensor();
+    setCallbackObject(sensor);
+    return sensor;
+}
+
+void closeSensor(MPLSensor *sensor)
+{
+    for (int s = 0; s < MPLSensor::numSensors; s++)
+        sensor->enable(s, 0);
+    setCallbackObject(NULL);
+    delete sensor;
+    unsetenv(INV_SERIAL_PORT_ENV);
+}
+
+/* pushes packets one at a time, each read by its own readEvents() call as
+   on a FIFO interrupt, and counts the events of every sensor. Returns the
+   CPU time spent, in ns */
+long long runPackets(MPLSensor *sensor, int packets, int *count)
+{
+    sensors_event_t events[MPLSensor::numSensors];
+    unsigned char pkt[MAX_FIFO_LENGTH];
+    long long elapsed = 0;
+    long long start;
+    void *mpu = inv_get_serial_handle();
+    int len = inv_get_fifo_packet_size();
+    int ii, jj, n;
+
+    for (ii = 0; ii < packets; ii++) {
+        makePacket(ii, pkt, len);
+        CHECK(inv_mock_mpu_push_fifo(mpu, len, pkt) == INV_SUCCESS);
+
+        start = host_test_now_ns();
+        n = sensor->readEvents(events, MPLSensor::numSensors);
+        elapsed += host_test_now_ns() - start;
+
+        for (jj = 0; jj < n; jj++)
+            if (events[jj].sensor < MPLSensor::numSensors)
+                count[events[jj].sensor]++;
+    }
+    return elapsed;
+}
+
+/* the DMP leaving the started state; rate changes also notify STARTED */
+int sDmpStops;
+
+inv_error_t countDmpStops(unsigned char newState)
+{
+    if (newState != INV_STATE_DMP_STARTED)
+        sDmpStops++;
+    return INV_SUCCESS;
+}
+
+/* the FIFO packet period the DMP runs at, in ms */
+int fifoPeriodMs(void)
+{
+    return (inv_get_fifo_rate() + 1) * (int)(MPL_FIFO_RATE_STEP_NS / 1000000);
+}
+
+} // namespace
+
+/*
+ * Replays a synthetic trace through readEvents() one FIFO packet per call
+ * with the MPL sensors enabled at the FIFO rate, and reports the serial
+ * transactions, bytes and CPU time spent per sample along with how far
+ * each sensor strays from the golden events.
+ */
+void bench_read_events(void)
+{
+    struct inv_serial_stats stats;
+    sensors_event_t events[MPLSensor::numSensors];
+    float golden[3];
+    float maxDelta[NUM_TRACE_SENSORS];
+    int count[NUM_TRACE_SENSORS];
+    unsigned char *pkt;
+    long long elapsed = 0;
+    long long start;
+    void *mpu;
+    int len;
+    int ii, jj, kk, n;
+
+    MPLSensor *sensor = openSensor();
+    for (ii = 0; ii < NUM_TRACE_SENSORS; ii++) {
+        CHECK(sensor->enable(kSensors[ii], 1) == 0);
+        sensor->setDelay(kSensors[ii], FIFO_PERIOD_NS);
+    }
+    len = inv_get_fifo_packet_size();
+    CHECK(len > 18);
+    pkt = (unsigned char *)malloc(len);
+    memset(maxDelta, 0, sizeof(maxDelta));
+    memset(count, 0, sizeof(count));
+
+    mpu = inv_get_serial_handle();
+    inv_serial_reset_stats();
+    for (ii = 0; ii < TRACE_PACKETS; ii++) {
+        makePacket(ii, pkt, len);
+        CHECK(inv_mock_mpu_push_fifo(mpu, len, pkt) == INV_SUCCESS);
+
+        start = host_test_now_ns();
+        n = sensor->readEvents(events, MPLSensor::numSensors);
+        elapsed += host_test_now_ns() - start;
+
+        for (jj = 0; jj < n; jj++) {
+            for (kk = 0; kk < NUM_TRACE_SENSORS; kk++)
+                if (kSensors[kk] == events[jj].sensor)
+                    break;
+            if (kk == NUM_TRACE_SENSORS || !goldenEvent(kSensors[kk], golden))
+                continue;
+            count[kk]++;
+            for (int v = 0; v < 3; v++) {
+                float delta = fabsf(events[jj].data[v] - golden[v]);
+                if (!(delta <= maxDelta[kk]))
+                    maxDelta[kk] = delta;
+            }
+        }
+    }
+    inv_serial_get_stats(&stats);
+    CHECK(stats.errors == 0);
+
+    printf("    %d samples of %d bytes: %.1f transactions, %.1f bytes, "
+           "%lld ns per readEvents\n", TRACE_PACKETS, len,
+           (double)totalTransactions(&stats) / TRACE_PACKETS,
+           (double)totalBytes(&stats) / TRACE_PACKETS,
+           elapsed / TRACE_PACKETS);
+    for (kk = 0; kk < NUM_TRACE_SENSORS; kk++) {
+        printf("    %-2s: %d events, max delta %g\n", kNames[kk], count[kk],
+               maxDelta[kk]);
+        CHECK(count[kk] == TRACE_PACKETS);
+        CHECK(maxDelta[kk] <=
+              (kSensors[kk] == ID_RV ? MAX_RV_DELTA : MAX_DELTA));
+    }
+
+    free(pkt);
+    closeSensor(sensor);
+}
+
+/*****************************************************************************/
+
+/*
+ * Each sensor gets one event every so many packets of the fastest one, is
+ * never reported slower than asked, and rate changes keep the DMP running.
+ */
+void test_mpl_decimation(void)
+{
+    int count[MPLSensor::numSensors];
+
+    MPLSensor *sensor = openSensor();
+    CHECK(sensor->enable(ID_GY, 1) == 0);
+    CHECK(sensor->enable(ID_A, 1) == 0);
+    CHECK(sensor->enable(ID_LA, 1) == 0);
+    CHECK(sensor->enable(ID_RV, 1) == 0);
+    sensor->setDelay(ID_GY, 10000000LL);
+    sensor->setDelay(ID_A, 20000000LL);
+    sensor->setDelay(ID_LA, 50000000LL);
+    sensor->setDelay(ID_RV, 200000000LL);
+    CHECK(fifoPeriodMs() == 10);
+
+    /* the first packet is due for every sensor */
+    memset(count, 0, sizeof(count));
+    runPackets(sensor, 200, count);
+    CHECK(count[MPLSensor::Gyro] == 200);
+    CHECK(count[MPLSensor::Accelerometer] == 100);
+    CHECK(count[MPLSensor::LinearAccel] == 40);
+    CHECK(count[MPLSensor::RotationVector] == 10);
+    CHECK(count[MPLSensor::Gravity] == 0);
+
+    /* 15 ms is not a multiple of the packet period: every packet */
+    sensor->setDelay(ID_RV, 15000000LL);
+    memset(count, 0, sizeof(count));
+    runPackets(sensor, 20, count);
+    CHECK(count[MPLSensor::RotationVector] == 20);
+    CHECK(count[MPLSensor::Gyro] == 20);
+
+    /* the base rate follows the fastest sensor, and the DMP picks the new
+       divider up without being stopped */
+    sensor->setDelay(ID_RV, 200000000LL);
+    sDmpStops = 0;
+    CHECK(inv_register_state_callback(countDmpStops) == INV_SUCCESS);
+    sensor->setDelay(ID_GY, 20000000LL);
+    CHECK(inv_unregister_state_callback(countDmpStops) == INV_SUCCESS);
+    CHECK(sDmpStops == 0);
+    CHECK(fifoPeriodMs() == 20);
+    memset(count, 0, sizeof(count));
+    runPackets(sensor, 100, count);
+    CHECK(count[MPLSensor::Gyro] == 100);
+    CHECK(count[MPLSensor::Accelerometer] == 100);
+    CHECK(count[MPLSensor::LinearAccel] == 50);
+    CHECK(count[MPLSensor::RotationVector] == 10);
+
+    /* and drops when the fastest one goes */
+    CHECK(sensor->enable(ID_GY, 0) == 0);
+    sensor->setDelay(ID_A, 50000000LL);
+    CHECK(fifoPeriodMs() == 50);
+    memset(count, 0, sizeof(count));
+    runPackets(sensor, 20, count);
+    CHECK(count[MPLSensor::Gyro] == 0);
+    CHECK(count[MPLSensor::Accelerometer] == 20);
+    CHECK(count[MPLSensor::LinearAccel] == 20);
+    CHECK(count[MPLSensor::RotationVector] == 5);
+
+    /* requests faster than the capability are capped to it */
+    sensor->setDelay(ID_A, 1000000LL);
+    CHECK(fifoPeriodMs() == (int)(sensor->getMinDelayNs() / 1000000));
+
+    closeSensor(sensor);
+}
+
+/*****************************************************************************/
+
+struct listener {
+    int handle;
+    int64_t delay_ns;
+};
+
+struct workload {
+    const char *name;
+    struct listener listeners[MPLSensor::numSensors];
+    int num;
+};
+
+#define WORKLOAD_SECONDS    20
+
+/*
+ * Mixed rate listener workloads on the simulated device, WORKLOAD_SECONDS
+ * of packets each: the events delivered against the events of a HAL
+ * reporting every enabled sensor on every packet, the wakeups, one per
+ * FIFO interrupt, and the CPU time of readEvents().
+ */
+void bench_mixed_rates(void)
+{
+    static const struct workload workloads[] = {
+        { "gyro 100 Hz", { { ID_GY, 10000000LL } }, 1 },
+        { "gyro 100 Hz, rv 5 Hz",
+          { { ID_GY, 10000000LL }, { ID_RV, 200000000LL } }, 2 },
+        { "accel 50 Hz, la 20 Hz, gravity 10 Hz",
+          { { ID_A, 20000000LL }, { ID_LA, 50000000LL },
+            { ID_GR, 100000000LL } }, 3 },
+        { "game: gyro 100 Hz, rv 50 Hz, accel 5 Hz",
+          { { ID_GY, 10000000LL }, { ID_RV, 20000000LL },
+            { ID_A, 200000000LL } }, 3 },
+        { "five listeners at 5 Hz",
+          { { ID_GY, 200000000LL }, { ID_A, 200000000LL },
+            { ID_LA, 200000000LL }, { ID_GR, 200000000LL },
+            { ID_RV, 200000000LL } }, 5 },
+    };
+    int count[MPLSensor::numSensors];
+
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+        const struct workload *wl = &workloads[w];
+        MPLSensor *sensor = openSensor();
+        long long elapsed;
+        int period, packets, events = 0, wanted = 0;
+        int ii;
+
+        for (ii = 0; ii < wl->num; ii++) {
+            CHECK(sensor->enable(wl->listeners[ii].handle, 1) == 0);
+            sensor->setDelay(wl->listeners[ii].handle,
+                             wl->listeners[ii].delay_ns);
+        }
+        period = fifoPeriodMs();
+        packets = WORKLOAD_SECONDS * 1000 / period;
+
+        memset(count, 0, sizeof(count));
+        elapsed = runPackets(sensor, packets, count);
+        for (ii = 0; ii < wl->num; ii++) {
+            int s = wl->listeners[ii].handle;
+            events += count[s];
+            wanted += WORKLOAD_SECONDS * 1000000000LL /
+                      wl->listeners[ii].delay_ns;
+        }
+        /* one event per listener period, never fewer */
+        CHECK(events >= wanted);
+
+        printf("    %-40s %3d Hz DMP: %5.1f events/s (%.1f asked, %.1f "
+               "undecimated), %5.1f wakeups/s, %.1f us CPU/s\n",
+               wl->name, 1000 / period, (double)events / WORKLOAD_SECONDS,
+               (double)wanted / WORKLOAD_SECONDS,
+               (double)packets * wl->num / WORKLOAD_SECONDS,
+               (double)packets / WORKLOAD_SECONDS,
+               elapsed / 1e3 / WORKLOAD_SECONDS);
+        closeSensor(sensor);
+    }
+}
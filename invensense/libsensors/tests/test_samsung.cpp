@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The SYN_REPORT frames of SamsungSensorBase.cpp, with input_event
+ * streams written to a pipe in place of the input device.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "PressureSensor.h"
+
+#include "host_tests.h"
+
+#define BENCH_FRAMES        200000
+#define FRAMES_PER_WRITE    8
+
+/*****************************************************************************/
+
+namespace {
+
+/* a pressure and temperature sensor reading a pipe */
+class PipePressureSensor : public PressureSensor {
+public:
+    PipePressureSensor(int fd, bool latestOnly) {
+        if (data_fd >= 0)
+            close(data_fd);
+        data_fd = fd;
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        mEnabled = true;
+        mLatestOnly = latestOnly;
+    }
+};
+
+/* the events of one frame: pressure in Pa, temperature in 0.1 C, SYN */
+int putFrame(input_event *ev, int pressure, int temperature, int usec)
+{
+    int n = 0;
+
+    memset(ev, 0, 3 * sizeof(*ev));
+    ev[n].type = EV_ABS;
+    ev[n].code = ABS_PRESSURE;
+    ev[n++].value = pressure;
+    if (temperature) {
+        ev[n].type = EV_ABS;
+        ev[n].code = ABS_X;
+        ev[n++].value = temperature;
+    }
+    ev[n].type = EV_SYN;
+    ev[n].code = SYN_REPORT;
+    ev[n].time.tv_sec = usec / 1000000;
+    ev[n++].time.tv_usec = usec % 1000000;
+    return n;
+}
+
+void writeFrame(int fd, int pressure, int temperature, int usec)
+{
+    input_event ev[3];
+    int n = putFrame(ev, pressure, temperature, usec);
+
+    CHECK(write(fd, ev, n * sizeof(ev[0])) == (ssize_t)(n * sizeof(ev[0])));
+}
+
+bool isFrame(const sensors_event_t *data, int pressure, int temperature,
+             int usec)
+{
+    return data[0].sensor == ID_PR &&
+           data[0].pressure == pressure * (1.0f / 100.0f) &&
+           data[0].timestamp == usec * 1000LL &&
+           data[1].sensor == ID_T &&
+           data[1].temperature == temperature * (1.0f / 10.0f) &&
+           data[1].timestamp == usec * 1000LL;
+}
+
+} // namespace
+
+void test_samsung_frames(void)
+{
+    sensors_event_t data[16];
+    int fds[2];
+    int n;
+
+    /* every frame, one event per sensor updated in it */
+    CHECK(pipe(fds) == 0);
+    {
+        PipePressureSensor sensor(fds[0], false);
+        for (int i = 0; i < 5; i++)
+            writeFrame(fds[1], 100000 + i, 250 + i, i);
+        n = sensor.readEvents(data, 16);
+        CHECK(n == 10);
+        for (int i = 0; i < n / 2; i++)
+            CHECK(isFrame(&data[2 * i], 100000 + i, 250 + i, i));
+        CHECK(!sensor.hasPendingEvents());
+
+        /* nothing before the frame is closed, then only what it updated */
+        input_event ev[3];
+        putFrame(ev, 101000, 0, 10);
+        CHECK(write(fds[1], ev, sizeof(ev[0])) == sizeof(ev[0]));
+        CHECK(sensor.readEvents(data, 16) == 0);
+        CHECK(write(fds[1], &ev[1], sizeof(ev[1])) == sizeof(ev[1]));
+        CHECK(sensor.readEvents(data, 16) == 1);
+        CHECK(data[0].sensor == ID_PR && data[0].timestamp == 10000);
+
+        /* frames past count are kept for the next call, in order */
+        for (int i = 0; i < 3; i++)
+            writeFrame(fds[1], 102000 + i, 260 + i, 20 + i);
+        for (int i = 0; i < 6; i++) {
+            CHECK(sensor.readEvents(&data[i], 1) == 1);
+            CHECK(sensor.hasPendingEvents() == (i % 2 == 0));
+        }
+        for (int i = 0; i < 3; i++)
+            CHECK(isFrame(&data[2 * i], 102000 + i, 260 + i, 20 + i));
+    }
+    close(fds[1]);
+
+    /* latest only: the last frame of everything read */
+    CHECK(pipe(fds) == 0);
+    {
+        PipePressureSensor sensor(fds[0], true);
+        for (int i = 0; i < 5; i++)
+            writeFrame(fds[1], 100000 + i, 250 + i, i);
+        CHECK(sensor.readEvents(data, 16) == 2);
+        CHECK(isFrame(data, 100004, 254, 4));
+        CHECK(sensor.readEvents(data, 16) == 0);
+
+        /* a long burst one reader fill, 32 events, at a time */
+        for (int i = 0; i < 20; i++)
+            writeFrame(fds[1], 100000 + i, 250 + i, i);
+        CHECK(sensor.readEvents(data, 16) == 2);
+        CHECK(isFrame(data, 100009, 259, 9));
+        CHECK(sensor.readEvents(data, 16) == 2);
+        CHECK(isFrame(data, 100019, 269, 19));
+    }
+    close(fds[1]);
+}
+
+/*****************************************************************************/
+
+namespace {
+
+struct BenchWriter {
+    int fd;
+};
+
+void *benchWriter(void *arg)
+{
+    BenchWriter *w = (BenchWriter *)arg;
+    input_event ev[FRAMES_PER_WRITE * 3];
+
+    for (int frame = 0; frame < BENCH_FRAMES; frame += FRAMES_PER_WRITE) {
+        int n = 0;
+        for (int i = 0; i < FRAMES_PER_WRITE; i++)
+            n += putFrame(&ev[n], 100000 + frame + i, 250, frame + i);
+        const char *p = (const char *)ev;
+        size_t left = n * sizeof(ev[0]);
+        while (left) {
+            ssize_t done = write(w->fd, p, left);
+            if (done < 0)
+                return NULL;
+            p += done;
+            left -= done;
+        }
+    }
+    close(w->fd);
+    return NULL;
+}
+
+/* read syscalls of the calling thread */
+long long threadReads(void)
+{
+    char line[64];
+    long long reads = 0;
+    FILE *fp = fopen("/proc/thread-self/io", "r");
+
+    if (!fp)
+        return 0;
+    while (fgets(line, sizeof(line), fp))
+        if (sscanf(line, "syscr: %lld", &reads) == 1)
+            break;
+    fclose(fp);
+    return reads;
+}
+
+void runPipeBench(bool latestOnly, const char *name)
+{
+    sensors_event_t data[16];
+    struct rusage start, end;
+    BenchWriter writer;
+    pthread_t thread;
+    long long events = 0;
+    long long calls = 0;
+    long long reads;
+    long long t0, elapsed;
+    int fds[2];
+
+    CHECK(pipe(fds) == 0);
+    PipePressureSensor sensor(fds[0], latestOnly);
+    struct pollfd pfd = { fds[0], POLLIN, 0 };
+
+    writer.fd = fds[1];
+    getrusage(RUSAGE_THREAD, &start);
+    reads = threadReads();
+    t0 = host_test_now_ns();
+    pthread_create(&thread, NULL, benchWriter, &writer);
+    for (;;) {
+        if (!sensor.hasPendingEvents() && poll(&pfd, 1, 1000) <= 0)
+            break;
+        int n = sensor.readEvents(data, 16);
+        calls++;
+        events += n;
+        if (n == 0 && (pfd.revents & POLLHUP))
+            break;
+    }
+    elapsed = host_test_now_ns() - t0;
+    reads = threadReads() - reads;
+    getrusage(RUSAGE_THREAD, &end);
+    pthread_join(thread, NULL);
+
+    double sec = elapsed / 1e9;
+    long long cpu = (end.ru_utime.tv_sec - start.ru_utime.tv_sec) * 1000000LL +
+        (end.ru_utime.tv_usec - start.ru_utime.tv_usec) +
+        (end.ru_stime.tv_sec - start.ru_stime.tv_sec) * 1000000LL +
+        (end.ru_stime.tv_usec - start.ru_stime.tv_usec);
+    printf("%s: %d frames in %.0f ms, %.0f frames/s\n", name, BENCH_FRAMES,
+           sec * 1000, BENCH_FRAMES / sec);
+    printf("  %.0f events/s, %.0f readEvents/s, %.0f reads/s, "
+           "reader cpu %.0f%%\n", events / sec, calls / sec, reads / sec,
+           cpu / 10000.0 / sec);
+}
+
+} // namespace
+
+void bench_samsung_pipe(void)
+{
+    runPipeBench(false, "every frame");
+    runPipeBench(true, "latest only");
+}
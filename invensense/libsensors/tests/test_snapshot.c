@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The fusion snapshot of mlFIFO.c, filled from quaternion and gyro
+ * packets fed to the software MPU model, against the mlarray getters.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ml.h"
+#include "mlFIFO.h"
+#include "mlos.h"
+#include "ml_lite.h"
+#include "ml_adv.h"
+#include "mlsl.h"
+#include "mlsl_backend.h"
+
+#include "host_tests.h"
+
+#define SNAPSHOT_PACKETS    1000
+#define BENCH_EVENTS        200000
+/* inv_send_quaternion(INV_32_BIT), inv_send_gyro(INV_ALL, INV_32_BIT),
+   then the FIFO footer */
+#define QUAT_BYTES          16
+#define GYRO_BYTES          12
+#define PACKET_BYTES        (QUAT_BYTES + GYRO_BYTES + 2)
+#define FOOTER_0            0xB2
+#define FOOTER_1            0x6A
+
+/* The FIFO decoding lays the packet bytes out for 32 bit longs: on other
+   hosts a quaternion decodes to zero and is dropped as trashed, so the
+   packets carry the gyro rate only there. */
+#define SEND_QUATERNION     (sizeof(long) == 4)
+#define PACKET_SIZE         (SEND_QUATERNION ? PACKET_BYTES : GYRO_BYTES + 2)
+
+#define SNAPSHOT_ALL        (INV_SNAPSHOT_GYRO | INV_SNAPSHOT_QUATERNION | \
+                             INV_SNAPSHOT_ROTATION_MATRIX |               \
+                             INV_SNAPSHOT_GRAVITY)
+
+/*****************************************************************************/
+
+static void put_be32(unsigned char *p, long v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+/* a packet of a random attitude and rate, PACKET_SIZE bytes */
+static void make_packet(unsigned char *pkt)
+{
+    unsigned char *p = pkt;
+    double v[4], norm = 0.;
+    int kk;
+
+    for (kk = 0; kk < 4; kk++) {
+        v[kk] = rand() / (double)RAND_MAX - 0.5;
+        norm += v[kk] * v[kk];
+    }
+    if (SEND_QUATERNION) {
+        for (kk = 0; kk < 4; kk++, p += 4)
+            put_be32(p, (long)(v[kk] / sqrt(norm) * 1073741823.));
+    }
+    for (kk = 0; kk < 3; kk++, p += 4)
+        put_be32(p, (rand() % 2000 - 1000) * 65536L);
+    p[0] = FOOTER_0;
+    p[1] = FOOTER_1;
+}
+
+static void *snapshot_open(void)
+{
+    inv_error_t result;
+
+    CHECK(inv_serial_start("mock:") == INV_SUCCESS);
+    result = inv_dmp_open();
+    CHECK(result == INV_SUCCESS || result == INV_ERROR_INVALID_CONFIGURATION);
+    if (SEND_QUATERNION)
+        CHECK(inv_send_quaternion(INV_32_BIT) == INV_SUCCESS);
+    CHECK(inv_send_gyro(INV_ALL, INV_32_BIT) == INV_SUCCESS);
+    CHECK(inv_set_fifo_rate(0) == INV_SUCCESS);
+    CHECK(inv_get_fifo_packet_size() == (int)PACKET_SIZE);
+    CHECK(inv_dmp_start() == INV_SUCCESS);
+    return inv_get_serial_handle();
+}
+
+static void snapshot_close(void)
+{
+    CHECK(inv_set_fusion_snapshot_mask(0) == INV_SUCCESS);
+    CHECK(inv_dmp_stop() == INV_SUCCESS);
+    inv_dmp_close();
+    inv_serial_stop();
+}
+
+static float max_diff(const float *a, const float *b, int n)
+{
+    float worst = 0.f;
+    int kk;
+
+    for (kk = 0; kk < n; kk++)
+        worst = fmaxf(worst, fabsf(a[kk] - b[kk]));
+    return worst;
+}
+
+/* the snapshot, against the getters read right after the same packet */
+static void check_snapshot(const struct inv_fusion_snapshot *snap)
+{
+    float quat[4], rot[9], gyro[3];
+    long grav[3];
+    int kk;
+
+    CHECK(snap->version == INV_FUSION_SNAPSHOT_VERSION);
+    CHECK(inv_get_gyro_float(gyro) == INV_SUCCESS);
+    CHECK(max_diff(snap->gyro, gyro, 3) == 0.f);
+    if (!SEND_QUATERNION) {
+        /* what the packets do not carry is left out */
+        CHECK(snap->mask == INV_SNAPSHOT_GYRO);
+        return;
+    }
+
+    CHECK(snap->mask == SNAPSHOT_ALL);
+    CHECK(inv_get_quaternion_float(quat) == INV_SUCCESS);
+    CHECK(max_diff(snap->quat, quat, 4) == 0.f);
+    CHECK(inv_get_rot_mat_float(rot) == INV_SUCCESS);
+    CHECK(max_diff(snap->rot_mat, rot, 9) < 1e-6f);
+
+    /* the fixed point body gravity of inv_get_gravity() */
+    CHECK(inv_get_gravity(grav) == INV_SUCCESS);
+    for (kk = 0; kk < 3; kk++)
+        CHECK(snap->gravity[kk] == grav[kk] / 65536.f);
+}
+
+/* the snapshot of every packet of an update */
+static struct inv_fusion_snapshot sSnapshots[3];
+static int sNumSnapshots;
+
+static void save_snapshot(void)
+{
+    if (sNumSnapshots < 3)
+        inv_get_fusion_snapshot(&sSnapshots[sNumSnapshots++]);
+}
+
+void test_fusion_snapshot(void)
+{
+    struct inv_fusion_snapshot snap, prev;
+    unsigned char pkt[3][PACKET_BYTES];
+    unsigned long long t0, t1, step;
+    void *mpu;
+    int ii;
+
+    srand(3);
+    mpu = snapshot_open();
+    CHECK(inv_set_fusion_snapshot_mask(SNAPSHOT_ALL) == INV_SUCCESS);
+    CHECK(inv_get_fusion_snapshot_mask() == SNAPSHOT_ALL);
+    CHECK(inv_get_fusion_snapshot(NULL) == INV_ERROR_INVALID_PARAMETER);
+    /* nothing to read before the first packet */
+    CHECK(inv_get_fusion_snapshot(&prev) == INV_ERROR_FEATURE_NOT_ENABLED);
+    memset(&prev, 0, sizeof(prev));
+
+    /* one snapshot per packet, each matching the getters */
+    for (ii = 0; ii < SNAPSHOT_PACKETS; ii++) {
+        make_packet(pkt[0]);
+        CHECK(inv_mock_mpu_push_fifo(mpu, PACKET_SIZE, pkt[0]) ==
+              INV_SUCCESS);
+        CHECK(inv_update_data() == INV_SUCCESS);
+        CHECK(inv_get_fusion_snapshot(&snap) == INV_SUCCESS);
+        CHECK(snap.seq == prev.seq + 1);
+        CHECK(snap.timestamp >= prev.timestamp);
+        check_snapshot(&snap);
+        prev = snap;
+    }
+
+    /* several packets in one update: the outputs of the last one, each
+       packet stamped one sample step after the one before, the last one
+       when the FIFO was read */
+    for (ii = 0; ii < 3; ii++) {
+        make_packet(pkt[ii]);
+        CHECK(inv_mock_mpu_push_fifo(mpu, PACKET_SIZE, pkt[ii]) ==
+              INV_SUCCESS);
+    }
+    sNumSnapshots = 0;
+    CHECK(inv_set_fifo_processed_callback(save_snapshot) == INV_SUCCESS);
+    t0 = inv_get_tick_count_ns();
+    CHECK(inv_update_data() == INV_SUCCESS);
+    t1 = inv_get_tick_count_ns();
+    CHECK(inv_set_fifo_processed_callback(NULL) == INV_SUCCESS);
+    CHECK(inv_get_fusion_snapshot(&snap) == INV_SUCCESS);
+    CHECK(snap.seq == prev.seq + 3);
+    check_snapshot(&snap);
+    CHECK(sNumSnapshots == 3);
+    step = inv_get_sample_step_size_ms() * 1000000ULL;
+    for (ii = 1; ii < 3; ii++) {
+        CHECK(sSnapshots[ii].timestamp - sSnapshots[ii - 1].timestamp >=
+              step);
+        CHECK(sSnapshots[ii].timestamp - sSnapshots[ii - 1].timestamp <
+              step + (t1 - t0));
+    }
+    CHECK(snap.timestamp >= t0 && snap.timestamp <= t1);
+    prev = snap;
+
+    /* only the outputs asked for */
+    CHECK(inv_set_fusion_snapshot_mask(INV_SNAPSHOT_GYRO) == INV_SUCCESS);
+    make_packet(pkt[0]);
+    CHECK(inv_mock_mpu_push_fifo(mpu, PACKET_SIZE, pkt[0]) == INV_SUCCESS);
+    CHECK(inv_update_data() == INV_SUCCESS);
+    CHECK(inv_get_fusion_snapshot(&snap) == INV_SUCCESS);
+    CHECK(snap.mask == INV_SNAPSHOT_GYRO);
+    CHECK(snap.seq == prev.seq + 1);
+
+    snapshot_close();
+}
+
+/*****************************************************************************/
+
+/*
+ * Per event cost of the outputs of the gyro, orientation, rotation vector
+ * and gravity handlers: through the getters, as the HAL used to read
+ * them, and as one copy of the snapshot.
+ */
+void bench_fusion_snapshot(void)
+{
+    struct inv_fusion_snapshot snap;
+    unsigned char pkt[PACKET_BYTES];
+    float gyro[3], quat[4], rot[9], grav[3];
+    volatile float sink = 0.f;
+    long long t0, t1, t2;
+    void *mpu;
+    int ii, accuracy;
+
+    srand(4);
+    mpu = snapshot_open();
+    CHECK(inv_set_fusion_snapshot_mask(SNAPSHOT_ALL) == INV_SUCCESS);
+    make_packet(pkt);
+    CHECK(inv_mock_mpu_push_fifo(mpu, PACKET_SIZE, pkt) == INV_SUCCESS);
+    CHECK(inv_update_data() == INV_SUCCESS);
+
+    t0 = host_test_now_ns();
+    for (ii = 0; ii < BENCH_EVENTS; ii++) {
+        inv_get_gyro_float(gyro);
+        /* orientation */
+        inv_get_float_array(INV_ROTATION_MATRIX, rot);
+        inv_get_compass_accuracy(&accuracy);
+        /* rotation vector */
+        inv_get_quaternion_float(quat);
+        inv_get_compass_accuracy(&accuracy);
+        inv_get_float_array(INV_GRAVITY, grav);
+        sink += gyro[0] + rot[0] + quat[0] + grav[0] + accuracy;
+    }
+    t1 = host_test_now_ns();
+    for (ii = 0; ii < BENCH_EVENTS; ii++) {
+        inv_get_fusion_snapshot(&snap);
+        sink += snap.gyro[0] + snap.rot_mat[0] + snap.quat[0] +
+            snap.gravity[0];
+    }
+    t2 = host_test_now_ns();
+
+    printf("getters %.1f ns per event set, snapshot %.1f ns\n",
+           (double)(t1 - t0) / BENCH_EVENTS, (double)(t2 - t1) / BENCH_EVENTS);
+
+    /* the cost of filling it, per packet */
+    for (ii = 0; ii < 2; ii++) {
+        int jj;
+
+        CHECK(inv_set_fusion_snapshot_mask(ii ? SNAPSHOT_ALL : 0) ==
+              INV_SUCCESS);
+        t0 = host_test_now_ns();
+        for (jj = 0; jj < BENCH_EVENTS / 10; jj++) {
+            inv_mock_mpu_push_fifo(mpu, PACKET_SIZE, pkt);
+            inv_update_data();
+        }
+        t1 = host_test_now_ns();
+        printf("packet processing, %s: %.1f ns/packet\n",
+               ii ? "snapshot filled" : "no snapshot",
+               (double)(t1 - t0) / (BENCH_EVENTS / 10));
+    }
+    (void)sink;
+    snapshot_close();
+}
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The running sum fits of temp_comp_legacy.c, against least squares fits
+ * walking the whole temperature table, on replayed thermal drift traces.
+ * The file is built in here, for its static table and fit functions.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "temp_comp_legacy.c"
+
+#include "host_tests.h"
+
+#define TEST_POINTS         20000
+#define BENCH_POINTS        1000000
+/* one no motion point a second: a day and a half per sweep */
+#define SWEEP_POINTS        (36 * 3600)
+
+/*****************************************************************************/
+
+static unsigned int sSeed;
+
+/* uniform in [-1, 1), the same sequence on every host */
+static double trace_noise(void)
+{
+    sSeed = sSeed * 1103515245 + 12345;
+    return ((sSeed >> 8) & 0xffff) / 32768. - 1.;
+}
+
+/* ambient cycles of -10 to 60 C, and the gyro biases they cause */
+static void trace_point(int i, int piecewise, float *temp, float *gyro)
+{
+    double t = 25. + 35. * sin(2. * M_PI * i / SWEEP_POINTS) +
+        0.2 * trace_noise();
+    double knee = t > 20. ? t - 20. : 0.;
+    int k;
+
+    *temp = (float)t;
+    for (k = 0; k < GYRO_NUM_AXES; k++) {
+        double b = 0.5 * (k - 1) + 0.02 * t;
+        if (piecewise)
+            b += 0.04 * knee;
+        else
+            b += 4e-4 * (k + 1) * t * t;
+        gyro[k] = (float)(b + 0.01 * trace_noise());
+    }
+}
+
+static void trace_reset(int model)
+{
+    memset(&tcData, 0, sizeof(tcData));
+    memset(inv_obj.gyro_tc, 0, sizeof(*inv_obj.gyro_tc));
+    CHECK(inv_set_temp_comp_model(model) == INV_SUCCESS);
+    sSeed = 1;
+}
+
+/*
+ * The fit as temp_comp_recompute() used to do it: the normal equations
+ * summed over every point held in the table, at every point added; with
+ * the same fall back to a line when a curve cannot be fitted.
+ */
+static int walk_fit(int order, double coef[][3])
+{
+    struct _TCSums s;
+    int j, k, count;
+
+    memset(&s, 0, sizeof(s));
+    for (j = 0; j < BINS; j++) {
+        if (inv_obj.gyro_tc->temp_valid_data[j])
+            count = PTS_PER_BIN;
+        else
+            count = inv_obj.gyro_tc->temp_ptrs[j];
+        for (k = 0; k < count; k++) {
+            double t = inv_obj.gyro_tc->temp_data[j][k];
+            double g[GYRO_NUM_AXES];
+            int i;
+
+            g[0] = inv_obj.gyro_tc->x_gyro_temp_data[j][k];
+            g[1] = inv_obj.gyro_tc->y_gyro_temp_data[j][k];
+            g[2] = inv_obj.gyro_tc->z_gyro_temp_data[j][k];
+            s.n += 1.;
+            s.t += t;
+            s.t2 += t * t;
+            s.t3 += t * t * t;
+            s.t4 += t * t * t * t;
+            for (i = 0; i < GYRO_NUM_AXES; i++) {
+                s.g[i] += g[i];
+                s.gt[i] += g[i] * t;
+                s.gt2[i] += g[i] * t * t;
+            }
+        }
+    }
+    if (order == 2 && temp_comp_fit_quadratic(&s, coef))
+        return true;
+    return temp_comp_fit_linear(&s, coef);
+}
+
+/* the largest difference of the biases of two fits, over -10 to 60 C */
+static double fit_difference(double a[][3], double b[][3])
+{
+    double worst = 0.;
+    int i;
+    int t;
+
+    for (i = 0; i < GYRO_NUM_AXES; i++) {
+        for (t = -10; t <= 60; t += 5) {
+            double d = (a[i][0] + a[i][1] * t + a[i][2] * t * t) -
+                (b[i][0] + b[i][1] * t + b[i][2] * t * t);
+            if (fabs(d) > worst)
+                worst = fabs(d);
+        }
+    }
+    return worst;
+}
+
+void test_temp_comp_fit(void)
+{
+    double coef[GYRO_NUM_AXES][3];
+    double ref[GYRO_NUM_AXES][3];
+    double worst[2] = { 0., 0. };
+    float temp, gyro[GYRO_NUM_AXES];
+    int order, i;
+
+    CHECK(inv_temp_comp_find_bin(MIN_TEMP - 100.f) == 0);
+    CHECK(inv_temp_comp_find_bin(MIN_TEMP + TEMP_PER_BIN * 2.5f) == 2);
+    CHECK(inv_temp_comp_find_bin(MAX_TEMP + 100.f) == BINS - 1);
+    CHECK(inv_set_temp_comp_model(INV_TEMP_COMP_PIECEWISE + 1) ==
+          INV_ERROR_INVALID_PARAMETER);
+
+    /* the running sums fit the points the table walk fits */
+    for (order = 1; order <= 2; order++) {
+        trace_reset(order == 1 ? INV_TEMP_COMP_LINEAR :
+                    INV_TEMP_COMP_QUADRATIC);
+        for (i = 0; i < TEST_POINTS; i++) {
+            int fitted;
+
+            trace_point(i * (SWEEP_POINTS / TEST_POINTS * 3), 0, &temp, gyro);
+            temp_comp_add_point(temp, gyro);
+            memset(coef, 0, sizeof(coef));
+            memset(ref, 0, sizeof(ref));
+            /* the tangent at 0 C is the curve itself */
+            fitted = temp_comp_fit(0.f, coef);
+            CHECK(fitted == walk_fit(order, ref));
+            if (fitted && fit_difference(coef, ref) > worst[order - 1])
+                worst[order - 1] = fit_difference(coef, ref);
+        }
+    }
+    printf("running sums vs table walk: linear %.2g dps, quadratic %.2g dps\n",
+           worst[0], worst[1]);
+    CHECK(worst[0] < 1e-4);
+    CHECK(worst[1] < 1e-4);
+
+    /* a curved bias: the quadratic and local fits follow it, the line
+       through the whole table does not */
+    for (order = INV_TEMP_COMP_LINEAR; order <= INV_TEMP_COMP_PIECEWISE;
+         order++) {
+        double slope;
+
+        trace_reset(order);
+        for (i = 0; i < SWEEP_POINTS; i += 7) {
+            trace_point(i, order == INV_TEMP_COMP_PIECEWISE, &temp, gyro);
+            temp_comp_add_point(temp, gyro);
+        }
+        CHECK(temp_comp_fit(50.f, coef));
+        slope = coef[0][1];
+        if (order == INV_TEMP_COMP_LINEAR)
+            CHECK(fabs(slope - 0.02 - 4e-4 * 2 * 50) > 0.01);
+        else if (order == INV_TEMP_COMP_QUADRATIC)
+            CHECK(fabs(slope - 0.02 - 4e-4 * 2 * 50) < 0.005);
+        else
+            CHECK(fabs(slope - 0.06) < 0.005);
+    }
+    inv_set_temp_comp_model(INV_TEMP_COMP_LINEAR);
+}
+
+/*
+ * Time per no motion point of adding it and refitting, over a long
+ * drift trace, with the running sums and with the table walk.
+ */
+static void run_temp_comp_replay(int model, const char *name)
+{
+    double coef[GYRO_NUM_AXES][3];
+    float temp, gyro[GYRO_NUM_AXES];
+    long long start, sums, walk;
+    int i, fits = 0;
+
+    trace_reset(model);
+    start = host_test_now_ns();
+    for (i = 0; i < BENCH_POINTS; i++) {
+        trace_point(i, 0, &temp, gyro);
+        temp_comp_add_point(temp, gyro);
+        fits += temp_comp_fit(temp, coef);
+    }
+    sums = host_test_now_ns() - start;
+
+    trace_reset(model);
+    start = host_test_now_ns();
+    for (i = 0; i < BENCH_POINTS; i++) {
+        trace_point(i, 0, &temp, gyro);
+        temp_comp_add_point(temp, gyro);
+        fits += walk_fit(model == INV_TEMP_COMP_QUADRATIC ? 2 : 1, coef);
+    }
+    walk = host_test_now_ns() - start;
+
+    printf("%s: %d points, %d fits\n", name, BENCH_POINTS, fits);
+    printf("  running sums %lld ns/point, table walk %lld ns/point\n",
+           sums / BENCH_POINTS, walk / BENCH_POINTS);
+}
+
+void bench_temp_comp_replay(void)
+{
+    run_temp_comp_replay(INV_TEMP_COMP_LINEAR, "linear");
+    run_temp_comp_replay(INV_TEMP_COMP_QUADRATIC, "quadratic");
+    run_temp_comp_replay(INV_TEMP_COMP_PIECEWISE, "piecewise");
+    inv_set_temp_comp_model(INV_TEMP_COMP_LINEAR);
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2011 Invensense, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The frames, rings and dump of SensorTrace.cpp, dumped to a file.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "SensorTrace.h"
+
+#include "host_tests.h"
+
+#define TRACE_WRITER_EVENTS 100000
+
+/*****************************************************************************/
+
+namespace {
+
+/* the dump, as read back from a temporary file */
+void dumpToString(char *buf, size_t size)
+{
+    FILE *fp = tmpfile();
+    size_t n;
+
+    CHECK(fp != NULL);
+    if (fp == NULL) {
+        buf[0] = 0;
+        return;
+    }
+    SensorTrace::dump(fileno(fp));
+    rewind(fp);
+    n = fread(buf, 1, size - 1, fp);
+    buf[n] = 0;
+    fclose(fp);
+}
+
+/* the sample count of a stage of a sensor, -1 if not dumped */
+int stageCount(const char *dump, int sensor, const char *stage)
+{
+    char header[32];
+    char name[32];
+    const char *p;
+    int n;
+
+    snprintf(header, sizeof(header), "sensor %d\n", sensor);
+    p = strstr(dump, header);
+    if (p == NULL)
+        return -1;
+    p += strlen(header);
+    while (sscanf(p, " %31s n=%d", name, &n) == 2) {
+        if (strcmp(name, stage) == 0)
+            return n;
+        p = strchr(p, '\n');
+        if (p == NULL)
+            break;
+        p++;
+    }
+    return -1;
+}
+
+void *traceWriter(void *arg)
+{
+    sensors_event_t data[4];
+
+    memset(data, 0, sizeof(data));
+    for (int i = 0; i < 4; i++)
+        data[i].sensor = 8 + i;
+    for (int i = 0; i < TRACE_WRITER_EVENTS / 4; i++) {
+        SensorTrace::mark(SensorTrace::PollWake);
+        SensorTrace::mark(SensorTrace::Locked);
+        SensorTrace::commit(data, 4);
+    }
+    return NULL;
+}
+
+} // namespace
+
+void test_trace_dump(void)
+{
+    static char dump[8192];
+    sensors_event_t data[2];
+    pthread_t thread;
+    int fd;
+
+    SensorTrace::sEnabled = 1;
+    memset(data, 0, sizeof(data));
+    data[0].sensor = 0;
+    data[1].sensor = 1;
+
+    /* a frame, committed for the two events of one read */
+    SensorTrace::mark(SensorTrace::PollWake);
+    SensorTrace::mark(SensorTrace::Locked);
+    SensorTrace::mark(SensorTrace::Fifo);
+    SensorTrace::mark(SensorTrace::Handlers);
+    SensorTrace::commit(data, 2);
+    /* a leftover event read later: the frame has been cleared */
+    SensorTrace::commit(data, 1);
+    /* a frame without a wakeup or a lock */
+    SensorTrace::mark(SensorTrace::Fifo);
+    SensorTrace::commit(&data[1], 1);
+
+    dumpToString(dump, sizeof(dump));
+    CHECK(strncmp(dump, "sensor latency trace, 4 events\n", 31) == 0);
+    CHECK(stageCount(dump, 0, "lock") == 1);
+    CHECK(stageCount(dump, 0, "copy") == 1);
+    CHECK(stageCount(dump, 0, "total") == 1);
+    CHECK(stageCount(dump, 1, "lock") == 1);
+    CHECK(stageCount(dump, 1, "copy") == 2);
+    CHECK(stageCount(dump, 1, "total") == 2);
+    CHECK(stageCount(dump, 2, "total") == -1);
+
+    /* a failed write ends the dump */
+    fd = open("/dev/full", O_WRONLY);
+    if (fd >= 0) {
+        SensorTrace::dump(fd);
+        close(fd);
+    }
+
+    /* dumps while another thread commits */
+    CHECK(pthread_create(&thread, NULL, traceWriter, NULL) == 0);
+    for (int i = 0; i < 20; i++) {
+        dumpToString(dump, sizeof(dump));
+        CHECK(strncmp(dump, "sensor latency trace, ", 22) == 0);
+        for (int sensor = 8; sensor < 12; sensor++) {
+            int n = stageCount(dump, sensor, "total");
+            CHECK(n == -1 || n == stageCount(dump, sensor, "lock"));
+        }
+    }
+    pthread_join(thread, NULL);
+    dumpToString(dump, sizeof(dump));
+    CHECK(stageCount(dump, 8, "total") == SENSOR_TRACE_RING_SIZE / 4);
+    CHECK(stageCount(dump, 11, "copy") == SENSOR_TRACE_RING_SIZE / 4);
+    SensorTrace::sEnabled = 0;
+}
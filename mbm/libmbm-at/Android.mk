@@ -0,0 +1,23 @@
+# AT channel code shared by the RIL and libmbm-gps, which both talk AT to
+# the modem. Built for the target and for the host tests.
+LOCAL_PATH:= $(call my-dir)
+
+mbm_at_src_files := \
+    at_reader.c \
+    at_reader.h \
+    prefix_table.c \
+    prefix_table.h
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := libmbm-at
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := $(mbm_at_src_files)
+LOCAL_CFLAGS := -Wall -Wextra
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := libmbm-at
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := $(mbm_at_src_files)
+LOCAL_CFLAGS := -Wall -Wextra
+include $(BUILD_HOST_STATIC_LIBRARY)
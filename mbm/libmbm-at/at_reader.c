@@ -0,0 +1,248 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+**
+** Based on reference-ril by The Android Open Source Project.
+**
+** Modified for ST-Ericsson U300 modems.
+** Author: Christian Bejram <christian.bejram@stericsson.com>
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/uio.h>
+
+#define LOG_TAG "AT"
+#include <cutils/log.h>
+
+#include "at_reader.h"
+
+#ifndef ALOGE
+#define ALOGE LOGE
+#endif
+#ifndef ALOGD
+#define ALOGD LOGD
+#endif
+
+/* Unread data is moved to the front of buf when less room is left. */
+#define AT_READ_MIN (AT_READER_SIZE / 4)
+
+/** Empty the reader, eg when the channel is opened. */
+void atReaderReset(struct atReader *r)
+{
+    r->cur = r->buf;
+    r->scan = r->buf;
+    r->end = r->buf;
+}
+
+/**
+ * Returns a pointer to the end of the next line in the unread data,
+ * special-cases the "> " SMS prompt.
+ *
+ * returns NULL if there is no complete line.
+ */
+static char *findNextEOL(struct atReader *r)
+{
+    char *cur = r->cur;
+    char *eol;
+    char *nl;
+    size_t len;
+
+    if (r->end - cur == 2 && cur[0] == '>' && cur[1] == ' ') {
+        /* SMS prompt character...not \r terminated */
+        return cur + 2;
+    }
+
+    /* Find next newline, from where the last search stopped. */
+    len = r->end - r->scan;
+    eol = memchr(r->scan, '\r', len);
+    if (eol != NULL)
+        len = eol - r->scan;
+    nl = memchr(r->scan, '\n', len);
+    if (nl != NULL)
+        eol = nl;
+
+    if (eol == NULL)
+        r->scan = r->end;
+
+    return eol;
+}
+
+/**
+ * Reads a line from the AT channel *fd. Returns NULL once *fd is closed
+ * (negative), on EOF and on error. Data on wakeFd is drained and only
+ * makes the reader look at *fd again.
+ *
+ * This line is valid only until the next call to atReaderLine.
+ *
+ * Lines are returned in place from buf. The unread data is only moved to
+ * the front of the buffer when less than AT_READ_MIN is left to read
+ * into, so a burst of lines is not moved once per line.
+ */
+const char *atReaderLine(struct atReader *r, const int *fd, int wakeFd)
+{
+    ssize_t count;
+    char *p_eol = NULL;
+    char *ret;
+
+    for (;;) {
+        int err;
+        struct pollfd pfds[2];
+
+        /* Skip over leading newlines. */
+        while (r->cur < r->end && (*r->cur == '\r' || *r->cur == '\n'))
+            r->cur++;
+        if (r->scan < r->cur)
+            r->scan = r->cur;
+
+        if (r->cur == r->end) {
+            /* Empty buffer. */
+            atReaderReset(r);
+        } else if ((p_eol = findNextEOL(r)) != NULL)
+            break;
+
+        if (r->end - r->buf > AT_READER_SIZE - AT_READ_MIN) {
+            if (r->cur > r->buf) {
+                /* A partial line. Move it up to make room to read more. */
+                size_t len = r->end - r->cur;
+                size_t scanned = r->scan - r->cur;
+
+                memmove(r->buf, r->cur, len);
+                r->cur = r->buf;
+                r->scan = r->buf + scanned;
+                r->end = r->buf + len;
+            } else if (r->end - r->buf >= AT_READER_SIZE) {
+                ALOGE("%s() ERROR: Input line exceeded buffer", __func__);
+                /* Ditch buffer and start over again. */
+                atReaderReset(r);
+            }
+        }
+
+        /* If our fd is invalid, we are probably closed. Return. */
+        if (*fd < 0)
+            return NULL;
+
+        pfds[0].fd = *fd;
+        pfds[0].events = POLLIN | POLLERR;
+
+        pfds[1].fd = wakeFd;
+        pfds[1].events = POLLIN;
+
+        err = poll(pfds, 2, -1);
+
+        if (err < 0) {
+            if (errno == EINTR)
+                continue;
+            ALOGE("%s() poll: error: %s", __func__, strerror(errno));
+            return NULL;
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            char buf[10];
+
+            /* Just drain it. We don't care, this is just for waking up. */
+            if (read(pfds[1].fd, &buf, 1) < 0 && errno != EINTR)
+                ALOGE("%s() wakeup read: error: %s", __func__,
+                      strerror(errno));
+            continue;
+        }
+
+        if (pfds[0].revents & POLLERR) {
+            ALOGE("%s() POLLERR event! Returning...", __func__);
+            return NULL;
+        }
+
+        if (!(pfds[0].revents & POLLIN))
+            continue;
+
+        /* One byte of buf is kept for the \0 ending the last line. */
+        do
+            count = read(*fd, r->end, AT_READER_SIZE - (r->end - r->buf));
+        while (count < 0 && (errno == EINTR || errno == EAGAIN));
+
+        if (count > 0) {
+            r->readCount += count;
+            r->end += count;
+        } else {
+            /* Read error encountered or EOF reached. */
+            if (count == 0)
+                ALOGD("%s() atchannel: EOF reached.", __func__);
+            else
+                ALOGD("%s() atchannel: read error %s", __func__,
+                      strerror(errno));
+
+            return NULL;
+        }
+    }
+
+    /* A full line in the buffer. Place a \0 over the \r and return. */
+    ret = r->cur;
+    *p_eol = '\0';
+
+    /* Only the SMS prompt ends at end rather than on an EOL. */
+    if (p_eol < r->end)
+        p_eol++;
+    r->cur = p_eol;
+    r->scan = p_eol;
+
+    return ret;
+}
+
+/**
+ * Writes string s followed by the terminator to fd in a single writev(),
+ * so the tty does not send them in separate transfers. Waits delayUsec
+ * before each writev(), for modems that need the pacing.
+ * Returns 0 on success, -1 with errno set on error.
+ */
+int atWriteTerminated(int fd, const char *s, const char *term,
+                      unsigned int delayUsec)
+{
+    struct iovec iov[2];
+    struct iovec *cur = iov;
+    int count = 2;
+    ssize_t written;
+
+    iov[0].iov_base = (void *) s;
+    iov[0].iov_len = strlen(s);
+    iov[1].iov_base = (void *) term;
+    iov[1].iov_len = strlen(term);
+
+    while (count > 0) {
+        do {
+            if (delayUsec > 0)
+                usleep(delayUsec);
+            written = writev(fd, cur, count);
+        } while (written < 0 && (errno == EINTR || errno == EAGAIN));
+
+        if (written < 0)
+            return -1;
+
+        /* Skip what was written, a short write continues mid vector. */
+        while (count > 0 && (size_t) written >= cur->iov_len) {
+            written -= cur->iov_len;
+            cur++;
+            count--;
+        }
+        if (count > 0) {
+            cur->iov_base = (char *) cur->iov_base + written;
+            cur->iov_len -= written;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+**
+** Based on reference-ril by The Android Open Source Project.
+**
+** Modified for ST-Ericsson U300 modems.
+** Author: Christian Bejram <christian.bejram@stericsson.com>
+*/
+
+#ifndef _MBM_AT_READER_H
+#define _MBM_AT_READER_H 1
+
+/*
+ * The line reader and the writer of an AT channel, shared by the RIL and
+ * gpsctrl. Each channel keeps its own struct atReader, read from its
+ * reader thread only.
+ */
+#define AT_READER_SIZE (8 * 1024)
+
+struct atReader {
+    char buf[AT_READER_SIZE + 1];
+    char *cur;               /* Start of the unread data. */
+    char *scan;              /* End of line search continues here. */
+    char *end;               /* End of the unread data. */
+    int readCount;           /* Bytes read, for statistics. */
+};
+
+void atReaderReset(struct atReader *r);
+
+const char *atReaderLine(struct atReader *r, const int *fd, int wakeFd);
+
+int atWriteTerminated(int fd, const char *s, const char *term,
+                      unsigned int delayUsec);
+
+#endif
@@ -0,0 +1,93 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+**
+** Based on reference-ril by The Android Open Source Project.
+**
+** Modified for ST-Ericsson U300 modems.
+** Author: Christian Bejram <christian.bejram@stericsson.com>
+*/
+
+#include <string.h>
+#include <errno.h>
+
+#include "prefix_table.h"
+
+/**
+ * Add prefix to the table. The prefix is not copied.
+ * Returns 0 on success, -EINVAL for an empty prefix, -EEXIST if the
+ * prefix is already in the table and -ENOSPC if the table is full.
+ */
+int prefixTableAdd(struct prefixTable *table, const char *prefix,
+                   int value, void *data)
+{
+    unsigned char c = (unsigned char) prefix[0];
+    size_t len = strlen(prefix);
+    int i;
+    int pos;
+
+    if (len == 0)
+        return -EINVAL;
+
+    for (i = table->first[c]; i < table->first[c + 1]; i++)
+        if (strcmp(table->entries[i].prefix, prefix) == 0)
+            return -EEXIST;
+
+    if (table->count >= PREFIX_TABLE_MAX)
+        return -ENOSPC;
+
+    /* Longest first within the group of c. */
+    for (pos = table->first[c]; pos < table->first[c + 1]; pos++)
+        if (table->entries[pos].len < len)
+            break;
+
+    memmove(&table->entries[pos + 1], &table->entries[pos],
+            (table->count - pos) * sizeof(table->entries[0]));
+    table->entries[pos].prefix = prefix;
+    table->entries[pos].len = len;
+    table->entries[pos].value = value;
+    table->entries[pos].data = data;
+    table->count++;
+
+    for (i = c + 1; i <= 256; i++)
+        table->first[i]++;
+
+    return 0;
+}
+
+/**
+ * Returns the longest entry of the table that line starts with,
+ * NULL if there is none.
+ */
+const struct prefixEntry *prefixTableMatch(const struct prefixTable *table,
+                                           const char *line)
+{
+    unsigned char c = (unsigned char) line[0];
+    int i;
+
+    if (c == '\0')
+        return NULL;
+
+    for (i = table->first[c]; i < table->first[c + 1]; i++) {
+        const struct prefixEntry *e = &table->entries[i];
+
+        /* The first byte is known to match. */
+        if (strncmp(line + 1, e->prefix + 1, e->len - 1) == 0)
+            return e;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,58 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+**
+** Based on reference-ril by The Android Open Source Project.
+**
+** Modified for ST-Ericsson U300 modems.
+** Author: Christian Bejram <christian.bejram@stericsson.com>
+*/
+
+#ifndef _MBM_PREFIX_TABLE_H
+#define _MBM_PREFIX_TABLE_H 1
+
+#include <stddef.h>
+
+/**
+ * Prefix lookup table. Entries are grouped by the first byte of their
+ * prefix and kept longest first within a group, so a line is compared
+ * against the few prefixes sharing its first byte only and gets the most
+ * specific match. A zeroed table is empty. Tables are filled before they
+ * are looked up from other threads; lookups do not lock.
+ */
+#define PREFIX_TABLE_MAX 64
+
+struct prefixEntry {
+    const char *prefix;
+    size_t      len;
+    int         value;
+    void       *data;
+};
+
+struct prefixTable {
+    /* Entries starting with byte c are [first[c], first[c + 1]). */
+    unsigned char      first[257];
+    int                count;
+    struct prefixEntry entries[PREFIX_TABLE_MAX];
+};
+
+int prefixTableAdd(struct prefixTable *table, const char *prefix,
+                   int value, void *data);
+
+const struct prefixEntry *prefixTableMatch(const struct prefixTable *table,
+                                           const char *line);
+
+#endif
@@ -16,6 +16,8 @@ LOCAL_SRC_FILES := \
 	src/nmea_tokenizer.c \
 	src/gpsctrl/gps_ctrl.c \
 	src/gpsctrl/gps_ctrl.h \
+	src/gpsctrl/event_queue.c \
+	src/gpsctrl/event_queue.h \
 	src/gpsctrl/atchannel.c \
 	src/gpsctrl/atchannel.h \
 	src/gpsctrl/at_tok.c \
@@ -31,6 +33,10 @@ LOCAL_SRC_FILES := \
 	src/gpsctrl/misc.c \
 	src/gpsctrl/misc.h
 
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../libmbm-at
+
+LOCAL_STATIC_LIBRARIES := libmbm-at
+
 LOCAL_SHARED_LIBRARIES := \
     liblog \
 	libutils \
@@ -47,4 +53,6 @@ LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 
 include $(BUILD_SHARED_LIBRARY)
 
+include $(LOCAL_PATH)/tests/Android.mk
+
 endif
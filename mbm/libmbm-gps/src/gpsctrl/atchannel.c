@@ -36,8 +36,6 @@
 #include <unistd.h>
 #include <stdarg.h>
 
-#include <poll.h>
-
 #define LOG_NDEBUG 0
 #define LOG_TAG "libgpsctrl-at"
 #include "../log.h"
@@ -48,8 +46,9 @@
 #endif /*HAVE_ANDROID_OS*/
 
 #include "misc.h"
+#include "prefix_table.h"
+#include "at_reader.h"
 
-#define MAX_AT_RESPONSE (8 * 1024)
 #define HANDSHAKE_RETRY_COUNT 8
 #define HANDSHAKE_TIMEOUT_MSEC 1000
 #define DEFAULT_AT_TIMEOUT_MSEC (3 * 60 * 1000)
@@ -64,10 +63,7 @@ struct atcontext {
     ATUnsolHandler unsolHandler;
 
     /* For input buffering. */
-    char ATBuffer[MAX_AT_RESPONSE+1];
-    char *ATBufferCur;
-
-    int readCount;
+    struct atReader reader;
 
     /*
      * For current pending command, these are protected by commandmutex.
@@ -157,7 +153,7 @@ static int initializeAtContext(void)
         ac->fd = -1;
         ac->readerCmdFds[0] = -1;
         ac->readerCmdFds[1] = -1;
-        ac->ATBufferCur = ac->ATBuffer;
+        atReaderReset(&ac->reader);
 
         if (pipe(ac->readerCmdFds)) {
             ALOGE("%s(): Failed to create pipe: %s", __func__,
@@ -277,7 +273,7 @@ static void addIntermediate(const char *line)
 
 
 /**
- * Returns 1 if line is a final response indicating error.
+ * Final responses indicating error.
  * See 27.007 annex B.
  * WARNING: NO CARRIER and others are sometimes unsolicited.
  */
@@ -289,21 +285,9 @@ static const char * s_finalResponsesError[] = {
     "NO ANSWER",
     "NO DIALTONE",
 };
-static int isFinalResponseError(const char *line)
-{
-    size_t i;
-
-    for (i = 0 ; i < NUM_ELEMS(s_finalResponsesError) ; i++) {
-        if (strStartsWith(line, s_finalResponsesError[i])) {
-            return 1;
-        }
-    }
-
-    return 0;
-}
 
 /**
- * Returns 1 if line is a final response indicating success.
+ * Final responses indicating success.
  * See 27.007 annex B.
  * WARNING: NO CARRIER and others are sometimes unsolicited.
  */
@@ -311,39 +295,69 @@ static const char * s_finalResponsesSuccess[] = {
     "OK",
     "CONNECT"       /* Some stacks start up data on another channel. */
 };
-static int isFinalResponseSuccess(const char *line)
-{
-    size_t i;
-
-    for (i = 0 ; i < NUM_ELEMS(s_finalResponsesSuccess) ; i++) {
-        if (strStartsWith(line, s_finalResponsesSuccess[i])) {
-            return 1;
-        }
-    }
-
-    return 0;
-}
 
 /**
- * Returns 1 if line is the first line in (what will be) a two-line
- * SMS unsolicited response.
+ * First lines in (what will be) a two-line SMS unsolicited response.
  */
 static const char * s_smsUnsoliciteds[] = {
     "+CMT:",
     "+CDS:",
     "+CBM:"
 };
-static int isSMSUnsolicited(const char *line)
+
+enum {
+    LINE_OTHER = 0,
+    LINE_FINAL_SUCCESS,
+    LINE_FINAL_ERROR,
+    LINE_SMS_UNSOLICITED
+};
+
+/* Every prefix above, classifies a line in one lookup. */
+static struct prefixTable s_lineClasses;
+static pthread_once_t s_lineClassesOnce = PTHREAD_ONCE_INIT;
+
+static void addLineClass(const char **prefixes, size_t count, int value)
 {
     size_t i;
 
-    for (i = 0 ; i < NUM_ELEMS(s_smsUnsoliciteds) ; i++) {
-        if (strStartsWith(line, s_smsUnsoliciteds[i])) {
-            return 1;
-        }
-    }
+    for (i = 0; i < count; i++)
+        (void) prefixTableAdd(&s_lineClasses, prefixes[i], value, NULL);
+}
 
-    return 0;
+static void makeLineClasses(void)
+{
+    addLineClass(s_finalResponsesSuccess, NUM_ELEMS(s_finalResponsesSuccess),
+                 LINE_FINAL_SUCCESS);
+    addLineClass(s_finalResponsesError, NUM_ELEMS(s_finalResponsesError),
+                 LINE_FINAL_ERROR);
+    addLineClass(s_smsUnsoliciteds, NUM_ELEMS(s_smsUnsoliciteds),
+                 LINE_SMS_UNSOLICITED);
+}
+
+/** Returns the LINE_* class of line. */
+static int lineClass(const char *line)
+{
+    const struct prefixEntry *e;
+
+    (void) pthread_once(&s_lineClassesOnce, makeLineClasses);
+
+    e = prefixTableMatch(&s_lineClasses, line);
+    return e != NULL ? e->value : LINE_OTHER;
+}
+
+/** Returns 1 if line is a final response indicating success. */
+static int isFinalResponseSuccess(const char *line)
+{
+    return lineClass(line) == LINE_FINAL_SUCCESS;
+}
+
+/**
+ * Returns 1 if line is the first line in (what will be) a two-line
+ * SMS unsolicited response.
+ */
+static int isSMSUnsolicited(const char *line)
+{
+    return lineClass(line) == LINE_SMS_UNSOLICITED;
 }
 
 
@@ -369,15 +383,17 @@ static void handleUnsolicited(const char *line)
 static void processLine(const char *line)
 {
     struct atcontext *ac = getAtContext();
+    int cls;
+
     pthread_mutex_lock(&ac->commandmutex);
 
     if (ac->response == NULL) {
         /* No command pending. */
         handleUnsolicited(line);
-    } else if (isFinalResponseSuccess(line)) {
+    } else if ((cls = lineClass(line)) == LINE_FINAL_SUCCESS) {
         ac->response->success = 1;
         handleFinalResponse(line);
-    } else if (isFinalResponseError(line)) {
+    } else if (cls == LINE_FINAL_ERROR) {
         ac->response->success = 0;
         handleFinalResponse(line);
     } else if (ac->smsPDU != NULL && 0 == strcmp(line, "> ")) {
@@ -428,165 +444,24 @@ static void processLine(const char *line)
 }
 
 
-/**
- * Returns a pointer to the end of the next line,
- * special-cases the "> " SMS prompt.
- *
- * returns NULL if there is no complete line.
- */
-static char * findNextEOL(char *cur)
-{
-    if (cur[0] == '>' && cur[1] == ' ' && cur[2] == '\0') {
-        /* SMS prompt character...not \r terminated */
-        return cur+2;
-    }
-
-    /* Find next newline */
-    while (*cur != '\0' && *cur != '\r' && *cur != '\n') cur++;
-
-    return *cur == '\0' ? NULL : cur;
-}
-
-
 /**
  * Reads a line from the AT channel, returns NULL on timeout.
  * Assumes it has exclusive read access to the FD.
  *
  * This line is valid only until the next call to readline.
- *
- * This function exists because as of writing, android libc does not
- * have buffered stdio.
  */
-
 static const char *readline(void)
 {
-    ssize_t count;
-
-    char *p_read = NULL;
-    char *p_eol = NULL;
-    char *ret = NULL;
-
     struct atcontext *ac = getAtContext();
-    read(ac->fd,NULL,0);
-
-    /* This is a little odd. I use *s_ATBufferCur == 0 to mean
-     * "buffer consumed completely". If it points to a character,
-     * then the buffer continues until a \0.
-     */
-    if (*ac->ATBufferCur == '\0') {
-        /* Empty buffer. */
-        ac->ATBufferCur = ac->ATBuffer;
-        *ac->ATBufferCur = '\0';
-        p_read = ac->ATBuffer;
-    } else {   /* *s_ATBufferCur != '\0' */
-        /* There's data in the buffer from the last read. */
-
-        /* skip over leading newlines */
-        while (*ac->ATBufferCur == '\r' || *ac->ATBufferCur == '\n')
-            ac->ATBufferCur++;
-
-        p_eol = findNextEOL(ac->ATBufferCur);
-
-        if (p_eol == NULL) {
-            /* A partial line. Move it up and prepare to read more. */
-            size_t len;
-
-            len = strlen(ac->ATBufferCur);
-
-            memmove(ac->ATBuffer, ac->ATBufferCur, len + 1);
-            p_read = ac->ATBuffer + len;
-            ac->ATBufferCur = ac->ATBuffer;
-        }
-        /* Otherwise, (p_eol !- NULL) there is a complete line 
-           that will be returned from the while () loop below. */
-    }
-
-    while (p_eol == NULL) {
-        int err;
-        struct pollfd pfds[2];
-
-        if (0 >= MAX_AT_RESPONSE - (p_read - ac->ATBuffer)) {
-            ALOGE("%s() ERROR: Input line exceeded buffer", __func__);
-            /* Ditch buffer and start over again. */
-            ac->ATBufferCur = ac->ATBuffer;
-            *ac->ATBufferCur = '\0';
-            p_read = ac->ATBuffer;
-        }
-
-        /* If our fd is invalid, we are probably closed. Return. */
-        if (ac->fd < 0)
-            return NULL;
-
-        pfds[0].fd = ac->fd;
-        pfds[0].events = POLLIN | POLLERR;
-
-        pfds[1].fd = ac->readerCmdFds[0];
-        pfds[1].events = POLLIN;
-
-        err = poll(pfds, 2, -1);
-
-        if (err < 0) {
-            ALOGE("%s() poll: error: %s", __func__, strerror(errno));
-            return NULL;
-        }
-
-        if (pfds[1].revents & POLLIN) {
-            char buf[10];
-
-            /* Just drain it. We don't care, this is just for waking up. */
-            read(pfds[1].fd, &buf, 1);
-            continue;
-        }
-
-        if (pfds[0].revents & POLLERR) {
-            ALOGE("POLLERR! Returning..");
-            return NULL;
-        }
-
-        if (!(pfds[0].revents & POLLIN)) {
-            continue;
-        }
-
-        do {
-            count = read(ac->fd, p_read,
-                            MAX_AT_RESPONSE - (p_read - ac->ATBuffer));
-        } while (count < 0 && ((errno == EINTR) || (errno == EAGAIN)));
-
-        if (count > 0) {
-            AT_DUMP( "<< ", p_read, count );
-            ac->readCount += count;
-
-            p_read[count] = '\0';
-
-            /* Skip over leading newlines. */
-            while (*ac->ATBufferCur == '\r' || *ac->ATBufferCur == '\n')
-                ac->ATBufferCur++;
-
-            p_eol = findNextEOL(ac->ATBufferCur);
-            p_read += count;
-        } else if (count <= 0) {
-            /* Read error encountered or EOF reached. */
-            if (count == 0)
-                ALOGD("%s() atchannel: EOF reached.", __func__);
-            else
-                ALOGD("%s() atchannel: read error %s", __func__, strerror(errno));
+    const char *line;
 
-            return NULL;
-        }
-    }
-
-    /* A full line in the buffer. Place a \0 over the \r and return. */
-
-    ret = ac->ATBufferCur;
-    *p_eol = '\0';
-    ac->ATBufferCur = p_eol + 1;     /* This will always be <= p_read,    
-                                        and there will be a \0 at *p_read. */
+    line = atReaderLine(&ac->reader, &ac->fd, ac->readerCmdFds[0]);
+    if (line != NULL)
+        ALOGI("AT(%d)< %s", ac->fd, line);
 
-    ALOGI("AT(%d)< %s", ac->fd, ret);
-    return ret;
+    return line;
 }
 
-
 static void onReaderClosed(void)
 {
     struct atcontext *ac = getAtContext();
@@ -651,7 +526,20 @@ static void *readerLoop(void *arg)
 }
 
 /**
- * Sends string s to the radio with a \r appended.
+ * Writes string s followed by the terminator to the AT channel in a
+ * single writev(). Returns AT_ERROR_* on error, 0 on success.
+ */
+static int writeTerminated (struct atcontext *ac, const char *s,
+                            const char *term)
+{
+    if (atWriteTerminated(ac->fd, s, term, AT_WRITE_DELAY) < 0)
+        return AT_ERROR_GENERIC;
+
+    return 0;
+}
+
+/**
+ * Sends string s to the radio with a \r\n appended.
  * Returns AT_ERROR_* on error, 0 on success.
  *
  * This function exists because as of writing, android libc does not
@@ -659,11 +547,6 @@ static void *readerLoop(void *arg)
  */
 static int writeline (const char *s)
 {
-    size_t cur = 0;
-    size_t len;
-    ssize_t written;
-    char *cmd = NULL;
-
     struct atcontext *ac = getAtContext();
 
     if (ac->fd < 0 || ac->readerClosed > 0) {
@@ -674,26 +557,7 @@ static int writeline (const char *s)
 
     AT_DUMP( ">> ", s, strlen(s) );
 
-    len = asprintf(&cmd, "%s\r\n", s);
-
-    /* The main string. */
-    while (cur < len) {
-        do {
-            usleep(AT_WRITE_DELAY);
-            written = write (ac->fd, cmd + cur, len - cur);
-        } while (written < 0 && (errno == EINTR || errno == EAGAIN));
-
-        if (written < 0) {
-            free(cmd);
-            return AT_ERROR_GENERIC;
-        }
-
-        cur += written;
-    }
-
-    free(cmd);
-
-    return 0;
+    return writeTerminated(ac, s, "\r\n");
 }
 
 
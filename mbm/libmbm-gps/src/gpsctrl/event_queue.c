@@ -0,0 +1,241 @@
+/* Ericsson libgpsctrl
+ *
+ * Copyright (C) Ericsson AB 2011
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * Author: Torgny Johansson <torgny.johansson@ericsson.com>
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "gps_ctrl.h"
+#include "event_queue.h"
+
+#define LOG_TAG "libgpsctrl"
+#include "../log.h"
+
+#define EVENT_QUEUE_STATS_PERIOD_MSEC (60 * 1000)
+
+/*
+ * Events are run by a fixed set of workers in the order they were queued,
+ * except that an event is held back while another event with the same
+ * handler is running. Events of one kind are thus handled one at a time
+ * and in order, while events of different kinds may run in parallel.
+ */
+typedef struct queued_event {
+    gpsctrl_queued_event handler;
+    void *data;
+    long long queued;
+    struct queued_event *next;
+} queued_event;
+
+static queued_event s_slots[EVENT_QUEUE_MAX];
+static queued_event *s_free;
+static queued_event *s_head;
+static queued_event *s_tail;
+static gpsctrl_queued_event s_running[EVENT_QUEUE_WORKERS];
+
+static GpsCtrlEventStats s_stats;
+static long long s_statsStart;
+
+static pthread_mutex_t s_queueMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_queueCond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t s_queueOnce = PTHREAD_ONCE_INIT;
+
+static long long clock_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static int is_running(gpsctrl_queued_event handler)
+{
+    int i;
+
+    for (i = 0; i < EVENT_QUEUE_WORKERS; i++)
+        if (s_running[i] == handler)
+            return 1;
+    return 0;
+}
+
+/* unlink the oldest event whose handler is not running; queue mutex held */
+static queued_event *take_event(void)
+{
+    queued_event *prev = NULL;
+    queued_event *event;
+
+    for (event = s_head; event != NULL; prev = event, event = event->next) {
+        if (is_running(event->handler))
+            continue;
+
+        if (prev != NULL)
+            prev->next = event->next;
+        else
+            s_head = event->next;
+        if (s_tail == event)
+            s_tail = prev;
+        event->next = NULL;
+        s_stats.depth--;
+        return event;
+    }
+    return NULL;
+}
+
+static void *event_worker(void *arg)
+{
+    int self = (int) (long) arg;
+    queued_event *event;
+    gpsctrl_queued_event handler;
+    void *data;
+    long long started;
+    long long done;
+    long long wait;
+    int log_stats;
+
+    pthread_mutex_lock(&s_queueMutex);
+    for (;;) {
+        while ((event = take_event()) == NULL)
+            pthread_cond_wait(&s_queueCond, &s_queueMutex);
+
+        handler = event->handler;
+        data = event->data;
+        s_running[self] = handler;
+        started = clock_usec();
+        wait = started - event->queued;
+
+        event->data = NULL;
+        event->next = s_free;
+        s_free = event;
+        pthread_mutex_unlock(&s_queueMutex);
+
+        handler(data);
+        free(data);
+        done = clock_usec();
+
+        pthread_mutex_lock(&s_queueMutex);
+        s_running[self] = NULL;
+        s_stats.handled++;
+        s_stats.wait_total += wait;
+        if (wait > s_stats.wait_max)
+            s_stats.wait_max = wait;
+        s_stats.run_total += done - started;
+        if (done - started > s_stats.run_max)
+            s_stats.run_max = done - started;
+
+        log_stats = done - s_statsStart >=
+            EVENT_QUEUE_STATS_PERIOD_MSEC * 1000LL;
+        if (log_stats)
+            s_statsStart = done;
+
+        /* events held back for this handler may run now */
+        pthread_cond_broadcast(&s_queueCond);
+
+        if (log_stats) {
+            pthread_mutex_unlock(&s_queueMutex);
+            event_queue_log_stats();
+            pthread_mutex_lock(&s_queueMutex);
+        }
+    }
+
+    return NULL;
+}
+
+static void start_workers(void)
+{
+    pthread_attr_t attr;
+    pthread_t tid;
+    long i;
+
+    for (i = 0; i < EVENT_QUEUE_MAX; i++) {
+        s_slots[i].next = s_free;
+        s_free = &s_slots[i];
+    }
+    s_statsStart = clock_usec();
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    for (i = 0; i < EVENT_QUEUE_WORKERS; i++)
+        if (pthread_create(&tid, &attr, event_worker, (void *) i) != 0)
+            ALOGE("%s error creating event worker %ld", __FUNCTION__, i);
+
+    pthread_attr_destroy(&attr);
+}
+
+/* enqueue a function to be executed on an event worker */
+void enqueue_event (gpsctrl_queued_event queued_event, void *data)
+{
+    struct queued_event *event;
+
+    pthread_once(&s_queueOnce, start_workers);
+
+    pthread_mutex_lock(&s_queueMutex);
+    event = s_free;
+    if (event == NULL) {
+        s_stats.dropped++;
+        pthread_mutex_unlock(&s_queueMutex);
+        ALOGE("%s event queue full, dropping event", __FUNCTION__);
+        free(data);
+        return;
+    }
+    s_free = event->next;
+
+    event->handler = queued_event;
+    event->data = data;
+    event->queued = clock_usec();
+    event->next = NULL;
+    if (s_tail != NULL)
+        s_tail->next = event;
+    else
+        s_head = event;
+    s_tail = event;
+
+    if (++s_stats.depth > s_stats.max_depth)
+        s_stats.max_depth = s_stats.depth;
+
+    pthread_cond_signal(&s_queueCond);
+    pthread_mutex_unlock(&s_queueMutex);
+}
+
+/* get a snapshot of the event queue statistics */
+void event_queue_get_stats (GpsCtrlEventStats *stats)
+{
+    pthread_mutex_lock(&s_queueMutex);
+    *stats = s_stats;
+    pthread_mutex_unlock(&s_queueMutex);
+}
+
+/* log the event queue statistics */
+void event_queue_log_stats (void)
+{
+    GpsCtrlEventStats stats;
+
+    event_queue_get_stats(&stats);
+
+    ALOGD("%s, handled %u, dropped %u, depth %d (max %d), "
+          "wait avg %lld max %lld usec, run avg %lld max %lld usec",
+          __FUNCTION__, stats.handled, stats.dropped,
+          stats.depth, stats.max_depth,
+          stats.handled ? stats.wait_total / stats.handled : 0,
+          stats.wait_max,
+          stats.handled ? stats.run_total / stats.handled : 0,
+          stats.run_max);
+}
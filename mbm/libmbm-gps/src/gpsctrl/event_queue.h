@@ -0,0 +1,47 @@
+/* Ericsson libgpsctrl
+ *
+ * Copyright (C) Ericsson AB 2011
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * Author: Torgny Johansson <torgny.johansson@ericsson.com>
+ *
+ */
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H 1
+
+/* worker threads running queued events */
+#define EVENT_QUEUE_WORKERS 2
+/* events waiting at most, further events are dropped */
+#define EVENT_QUEUE_MAX 64
+
+/* event queue statistics, times in microseconds */
+typedef struct {
+    int depth;                  /* events waiting now */
+    int max_depth;              /* most events waiting at once */
+    unsigned int handled;
+    unsigned int dropped;
+    long long wait_total;       /* queued until started */
+    long long wait_max;
+    long long run_total;        /* started until handler returned */
+    long long run_max;
+} GpsCtrlEventStats;
+
+/* get a snapshot of the event queue statistics */
+void event_queue_get_stats (GpsCtrlEventStats *stats);
+
+/* log the event queue statistics */
+void event_queue_log_stats (void);
+
+#endif /* EVENT_QUEUE_H */
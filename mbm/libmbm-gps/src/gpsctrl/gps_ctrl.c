@@ -20,6 +20,8 @@
  */
 
 #include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <pthread.h>
 
@@ -28,6 +30,7 @@
 #include "nmeachannel.h"
 #include "misc.h"
 #include "gps_ctrl.h"
+#include "event_queue.h"
 #include "supl.h"
 #include "pgps.h"
 
@@ -36,11 +39,6 @@ static GpsCtrlContext global_context;
 #define LOG_TAG "libgpsctrl"
 #include "../log.h"
 
-typedef struct {
-    gpsctrl_queued_event handler;
-    char *data;
-} queued_event;
-
 /**************************************************************
  * Internal functions
  *
@@ -110,83 +108,39 @@ static void* onGpsStatusChange (void *s)
     return NULL;
 }
 
-/* Handle queued unsolicited events */
-static void *unsolicitedHandler(void *data)
-{
-    queued_event *event = (queued_event *)data;
-    if (NULL == event)
-        ALOGE("%s: event = NULL", __FUNCTION__);
-    else if (NULL == event->handler)
-        ALOGE("%s: event->handler = NULL", __FUNCTION__);
-    else {
-        event->handler(event->data);
-        free(event->data);
-        free(event);
-    }
-
-    return NULL;
-}
-
 /**
  * Called by atchannel when an unsolicited line appears.
  * This is called on atchannel's reader thread. AT commands may
- * not be issued here.
+ * not be issued here, the handlers are queued to the event workers
+ * with a copy of the line.
  */
 static void onUnsolicited(const char *s, const char *sms_pdu)
 {
+    gpsctrl_queued_event gpsctrl_event = NULL;
+    char *line;
+
     ALOGD("%s: %s", __FUNCTION__, s);
 
     (void) sms_pdu;
 
-    /* enqueue events for any function calls that will send at commands */
-
     if (strStartsWith(s, "*E2GPSSUPLNI:"))
-        onSuplNiRequest((char *)s);
+        gpsctrl_event = onSuplNiRequest;
     else if (strStartsWith(s, "*EEGPSEEDATA:"))
-        onPgpsUrlReceived((char *)s);
-    else {
-        gpsctrl_queued_event gpsctrl_event = NULL;
-        queued_event *event = NULL;
-        const char *str = NULL;
-        int err;
-
-        /* List queuing events below */
-
-        /* Actually, current implementation of the queuing creating separate
-         * threads for each queued event could in theory, though not very
-         * likely, lead to that the unsolicited messages are handled in
-         * reverse order. So far, analysis of the unsolicited messages handled
-         * below do not indicate issues, even if handled in reverse order. For
-         * any new message added, an analysis is needed, and when we hit a
-         * message which will have issues, we need to consider a new
-         * implementation of the queuing strategy.
-         */
-        if (strStartsWith(s, "*E2CERTUN:")) {
-            gpsctrl_event = onUnknownCertificate;
-            str = s;
-        }
-        else if (strStartsWith(s, "*E2GPSSTAT:")) {
-            gpsctrl_event = onGpsStatusChange;
-            str = s;
-        }
-
-        if (gpsctrl_event && str) {
-            event = malloc(sizeof(queued_event));
-            if (!event) {
-                ALOGE("%s: allocating memory for event", __FUNCTION__);
-                return;
-            }
-
-            event->handler = gpsctrl_event;
-            err = asprintf(&event->data, "%s", str);
-            if (err < 0) {
-                ALOGE("%s: allocating memory for event->data", __FUNCTION__);
-                free(event);
-                return;
-            }
-            enqueue_event(unsolicitedHandler, (void *)event);
-        }
+        gpsctrl_event = onPgpsUrlReceived;
+    else if (strStartsWith(s, "*E2CERTUN:"))
+        gpsctrl_event = onUnknownCertificate;
+    else if (strStartsWith(s, "*E2GPSSTAT:"))
+        gpsctrl_event = onGpsStatusChange;
+
+    if (gpsctrl_event == NULL)
+        return;
+
+    line = strdup(s);
+    if (!line) {
+        ALOGE("%s: allocating memory for event data", __FUNCTION__);
+        return;
     }
+    enqueue_event(gpsctrl_event, line);
 }
 
 static void onATTimeout(void)
@@ -212,23 +166,6 @@ GpsCtrlContext* get_context(void)
     return &global_context;
 }
 
-/* enqueue a function to be executed in own thread
- * maybe this should be changed to not spawn a new thread
- * every time?
- */
-void enqueue_event (gpsctrl_queued_event queued_event, void *data)
-{
-    int ret;
-
-    ALOGD("%s", __FUNCTION__);
-
-    pthread_t event_thread;
-
-    ret = pthread_create(&event_thread, NULL, queued_event, data);
-    if (ret < 0)
-        ALOGE("%s error creating event thread", __FUNCTION__);
-}
-
 /* set the devices to be used */
 int gpsctrl_set_devices (char *ctrl_dev, char* nmea_dev)
 {
@@ -560,6 +497,8 @@ int gpsctrl_cleanup(void)
 
     close_devices();
 
+    event_queue_log_stats();
+
     return 0;
 }
 
@@ -88,7 +88,9 @@ typedef struct {
 /* get the current context */
 GpsCtrlContext* get_context(void);
 
-/* enqueue an event */
+/* enqueue an event to be run on an event worker thread, data is freed
+ * when the handler returns. Events with the same handler run one at a
+ * time in the order they were enqueued. */
 void enqueue_event (gpsctrl_queued_event queued_event, void *data);
 
 /* set the devices to be used */
@@ -28,23 +28,24 @@
 #define LOG_TAG "libgpsctrl-nmea"
 #include "../log.h"
 
-int nmea_read (int fd, char *nmea)
+/*
+ * Read what the NMEA port has, into buf. Sentences may be split across
+ * reads or several may come in one, they are framed by nmea_reader_feed().
+ * Returns the number of bytes read, 0 if there was nothing, -1 on error.
+ */
+int nmea_read (int fd, char *buf, int size)
 {
     int ret;
 
     do {
-        ret = read(fd, nmea, MAX_NMEA_LENGTH);
+        ret = read(fd, buf, size);
     }
     while (ret < 0 && errno == EINTR);
 
-    /* remove \r\n */
-    if (strncmp(&nmea[ret - 2], "\r\n", 2)) {
-        nmea[0] = '\0';
-        return -1;
-    }
-    nmea[ret - 2] = '\0';
+    if (ret < 0 && errno == EAGAIN)
+        return 0;
 
-    return 0;
+    return ret;
 }
 
 static int writeline (int fd, const char *s)
@@ -25,7 +25,7 @@
 
 int nmea_open(char *dev);
 int nmea_activate_port (int nmea_fd);
-int nmea_read (int fd, char *nmea);
+int nmea_read (int fd, char *buf, int size);
 void nmea_close (int fd);
 
 #endif /* NMEACHANNEL_H */
@@ -111,7 +111,7 @@ typedef struct {
 GpsContext global_context;
 
 static void add_pending_command(char cmd);
-static void nmea_received(char *line);
+static void nmea_received(const char *buf, int len);
 static int mbm_gps_start(void);
 static void main_loop(void *arg);
 
@@ -541,19 +541,13 @@ static void add_pending_command(char cmd)
     write(context->control_fd[0], &cmd, 1);
 }
 
-static void nmea_received(char *line)
+static void nmea_received(const char *buf, int len)
 {
     GpsContext *context = get_gps_context();
 
-    if (line == NULL) {
-        ALOGE("%s: line null", __FUNCTION__);
-        return;
-    }
-
-    //ALOGD("%s: %s", __FUNCTION__, (char *) line);
+    //ALOGD("%s: %.*s", __FUNCTION__, len, buf);
 
-    if ((strstr(line, "$GP") != NULL) && (strlen(line) > 3))
-        nmea_reader_add(context->reader, (char *) line);
+    nmea_reader_feed(context->reader, buf, len);
 }
 
 static int epoll_register(int epoll_fd, int fd)
@@ -837,8 +831,9 @@ static void main_loop(void *arg)
                         break;
                     }
                 } else if (fd == nmea_fd) {
-                    nmea_read(nmea_fd, nmea);
-                    nmea_received(nmea);
+                    ret = nmea_read(nmea_fd, nmea, sizeof(nmea));
+                    if (ret > 0)
+                        nmea_received(nmea, ret);
                 } else {
                     ALOGE("epoll_wait() returned unkown fd %d ?", fd);
                 }
@@ -73,24 +73,49 @@ static int str2int(const char *p, const char *end)
     return -1;
 }
 
-static double str2float(const char *p, const char *end)
+/*
+ * Parse a decimal number, scaled by 10^decimals and truncated, without
+ * copying it: "5740.857675" gives 57408576 for 4 decimals. Stops at the
+ * first character that is not part of the number, an empty field is 0.
+ */
+static long long str2fixed(const char *p, const char *end, int decimals)
 {
-    /* int result = 0; */
-    int len = end - p;
-    char temp[16];
+    long long result = 0;
+    int negative = 0;
+    int fraction = -1;
 
-    ENTER;
-    /* if (len == 0) { */
-    /*      return -1.0; */
-    /* } */
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
 
-    if (len >= (int) sizeof(temp))
-        return 0.;
+    for (; p < end; p++) {
+        int c = *p - '0';
 
-    memcpy(temp, p, len);
-    temp[len] = 0;
-    EXIT;
-    return strtod(temp, NULL);
+        if (*p == '.' && fraction < 0) {
+            fraction = 0;
+            continue;
+        }
+        if ((unsigned) c >= 10)
+            break;
+        if (fraction >= 0 && fraction++ >= decimals)
+            continue;
+        result = result * 10 + c;
+    }
+
+    if (fraction < 0)
+        fraction = 0;
+    for (; fraction < decimals; fraction++)
+        result *= 10;
+
+    return negative ? -result : result;
+}
+
+#define FLOAT_DECIMALS  6
+
+static double str2float(const char *p, const char *end)
+{
+    return str2fixed(p, end, FLOAT_DECIMALS) / 1e6;
 }
 
 static void nmea_reader_update_utc_diff(NmeaReader * r)
@@ -124,8 +149,8 @@ void nmea_reader_init(NmeaReader * r)
     ENTER;
     memset(r, 0, sizeof(*r));
 
+    r->state = NMEA_STATE_IDLE;
     r->pos = 0;
-    r->overflow = 0;
     r->utc_year = -1;
     r->utc_mon = -1;
     r->utc_day = -1;
@@ -158,12 +183,12 @@ void nmea_reader_set_callbacks(NmeaReader * r, GpsCallbacks * cbs)
         r->sv_status_changed = 0;
     }
 
-    /*old data */
+    /* last complete sentence, kept until the next one starts */
     r->nmea_callback = cbs->nmea_cb;
-    if (cbs->nmea_cb != NULL) {
+    if (cbs->nmea_cb != NULL && r->state == NMEA_STATE_IDLE && r->pos > 0) {
         ALOGD("%s: sending latest nmea sentence to new callback",
              __FUNCTION__);
-        r->nmea_callback(time(NULL)*1000, r->in, r->pos + 1);
+        r->nmea_callback(time(NULL)*1000, r->in, r->pos + 2);
     }
 
     EXIT;
@@ -172,8 +197,7 @@ void nmea_reader_set_callbacks(NmeaReader * r, GpsCallbacks * cbs)
 static int nmea_reader_update_time(NmeaReader * r, Token tok)
 {
     int hour, minute;
-    double seconds;
-    double milliseconds;
+    long long milliseconds;
     struct tm tm;
     time64_t fix_time;
 
@@ -192,8 +216,8 @@ static int nmea_reader_update_time(NmeaReader * r, Token tok)
 
     hour = str2int(tok.p, tok.p + 2);
     minute = str2int(tok.p + 2, tok.p + 4);
-    seconds = str2float(tok.p + 4, tok.end);
-    milliseconds = seconds * 1000.0;    /* This is seconds + milliseconds */
+    /* This is seconds + milliseconds */
+    milliseconds = str2fixed(tok.p + 4, tok.end, 3);
 
     /* initialize all values inside the tm-struct to 0,
        otherwise mktime(&tm) will return -1 */
@@ -216,7 +240,7 @@ static int nmea_reader_update_time(NmeaReader * r, Token tok)
      */
     fix_time = timegm64(&tm) * 1000LL;
     /* Now add the seconds+millliseconds */
-    fix_time = fix_time + ((long) milliseconds);
+    fix_time = fix_time + milliseconds;
 
     /* Assign calculated value to fix */
     r->fix.timestamp = (time64_t) fix_time;
@@ -255,13 +279,16 @@ static int nmea_reader_update_date(NmeaReader * r, Token date)
 }
 
 
+#define COORD_DECIMALS  7
+
+/* ddmm.mmmm to degrees, in fixed point up to the final division */
 static double hhmm2dcoord(Token tok)
 {
-    double val = str2float(tok.p, tok.end);
-    int degrees = (int) (floor(val) / 100);
-    double minutes = val - degrees * 100.;
-    double dcoord = degrees + minutes / 60.0;
-    return dcoord;
+    long long val = str2fixed(tok.p, tok.end, COORD_DECIMALS);
+    long long degrees = val / (100 * 10000000LL);
+    long long minutes = val - degrees * (100 * 10000000LL);
+
+    return degrees + minutes / (60 * 1e7);
 }
 
 
@@ -379,17 +406,12 @@ static void nmea_reader_parse(NmeaReader * r)
     /* we received a complete sentence, now parse it to generate
      * a new GPS fix...
      */
-    NmeaTokenizer tzer[1];
+    NmeaTokenizer *tzer = &r->tzer;
     Token tok;
+    int id;
 
     ENTER;
     /* ALOGD("Received: %.*s", r->pos, r->in); */
-    if (r->pos < 9) {
-        ALOGD("Too short. discarded.");
-        return;
-    }
-
-    nmea_tokenizer_init(tzer, r->in, r->in + r->pos);
 #if 0 /* Kept for debugging purposes */
     {
         int n;
@@ -407,8 +429,8 @@ static void nmea_reader_parse(NmeaReader * r)
              tok.p);
         return;
     }
-    /* ignore first two characters. */
-    tok.p += 2;
+    /* ignore the talker, the first two characters. */
+    id = NMEA_ID(tok.p[2], tok.p[3], tok.p[4]);
 
 /*
 **     GGA          Global Positioning System Fix Data
@@ -434,7 +456,7 @@ static void nmea_reader_parse(NmeaReader * r)
 **     *47          the checksum data, always begins with *
 */
 /* GGA,214258.00,5740.857675,N,01159.649523,E,1,08,3.0,104.0,M,,,,*32 */
-    if (!memcmp(tok.p, "GGA", 3)) {
+    if (id == NMEA_ID('G', 'G', 'A')) {
         /* ALOGD("GGA"); */
         /* GPS fix */
         Token tok_fixstaus = nmea_tokenizer_get(tzer, 6);
@@ -459,7 +481,7 @@ static void nmea_reader_parse(NmeaReader * r)
 **18     *39      the checksum data, always begins with *
 */
 /* GSA,A,3,02,04,07,13,20,23,,,,,,,6.7,3.0,6.0*36 */
-    } else if (!memcmp(tok.p, "GSA", 3)) {
+    } else if (id == NMEA_ID('G', 'S', 'A')) {
         /* ALOGD("GSA"); */
         Token tok_fixStatus = nmea_tokenizer_get(tzer, 2);
         int i;
@@ -497,7 +519,7 @@ static void nmea_reader_parse(NmeaReader * r)
 **
 **  $GPGLL,4916.45,N,12311.12,W,225444,A*31
 */
-    } else if (!memcmp(tok.p, "GLL", 3)) {
+    } else if (id == NMEA_ID('G', 'L', 'L')) {
         /* ALOGD("GLL"); */
         Token tok_fixStatus = nmea_tokenizer_get(tzer, 6);
 
@@ -531,7 +553,7 @@ static void nmea_reader_parse(NmeaReader * r)
 **     *6A          The checksum data, always begins with *
 */
 /* RMC,232401.00,A,5740.841023,N,01159.626002,E,000.0,244.0,031109,,,A*56 */
-    } else if (!memcmp(tok.p, "RMC", 3)) {
+    } else if (id == NMEA_ID('R', 'M', 'C')) {
         /* ALOGD("RMC"); */
         Token tok_fixStatus = nmea_tokenizer_get(tzer, 2);
 
@@ -575,7 +597,7 @@ static void nmea_reader_parse(NmeaReader * r)
 **      *75          the checksum data, always begins with *
 */
 /* GSV,1,1,01,07,,,49,,,,,,,,,,,,*72 */
-    } else if (!memcmp(tok.p, "GSV", 3)) {
+    } else if (id == NMEA_ID('G', 'S', 'V')) {
         /* ALOGD("GSV"); */
 
         Token tok_noSatellites = nmea_tokenizer_get(tzer, 3);
@@ -603,7 +625,8 @@ static void nmea_reader_parse(NmeaReader * r)
 
             i = 0;
 
-            while ((i < 4) && (r->sv_status.num_svs < noSatellites)) {
+            while ((i < 4) && (r->sv_status.num_svs < noSatellites)
+                   && (r->sv_status.num_svs < GPS_MAX_SVS)) {
 
                 Token tok_prn = nmea_tokenizer_get(tzer, i * 4 + 4);
                 Token tok_elevation = nmea_tokenizer_get(tzer, i * 4 + 5);
@@ -638,7 +661,6 @@ static void nmea_reader_parse(NmeaReader * r)
         }
 
     } else {
-        tok.p -= 2;
         /* ALOGD("unknown sentence '%.*s", tok.end - tok.p, tok.p); */
     }
 
@@ -690,50 +712,132 @@ static void nmea_reader_parse(NmeaReader * r)
 
 }
 
-void nmea_reader_add(NmeaReader * r, char *nmea)
+/* a '$' was read, start framing a sentence */
+static void nmea_reader_start(NmeaReader * r)
 {
-    unsigned int i;
+    r->state = NMEA_STATE_BODY;
+    r->in[0] = '$';
+    r->pos = 1;
+    r->checksum = 0;
+    r->star = 0;
+    r->field = 1;
+    r->tzer.count = 0;
+}
 
-    ENTER;
-    /* ALOGD("%s: %s", __FUNCTION__, nmea); */
+/* end of the current field, at r->pos - 1 */
+static void nmea_reader_end_field(NmeaReader * r)
+{
+    NmeaTokenizer *t = &r->tzer;
 
-    for (i = 0; i < strlen(nmea); i++)
-        nmea_reader_addc(r, nmea[i]);
-    nmea_reader_addc(r, '\n');
-    EXIT;
+    if (t->count < MAX_NMEA_TOKENS) {
+        t->tokens[t->count].p = r->in + r->field;
+        t->tokens[t->count].end = r->in + r->pos - 1;
+        t->count += 1;
+    }
+    r->field = r->pos;
 }
 
-void nmea_reader_addc(NmeaReader * r, int c)
+static int hex2int(char c)
 {
-    ENTER;
-    //ALOGV("%s: %c", __FUNCTION__, (char) c);
-    if (r->overflow) {
-        r->overflow = (c != '\n');
-        return;
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+/* end of line, check the sentence and hand it on */
+static void nmea_reader_end(NmeaReader * r)
+{
+    int hi, lo;
+
+    if (r->state != NMEA_STATE_CHECKSUM || r->pos != r->star + 3) {
+        ALOGD("sentence without checksum discarded: '%.*s'", r->pos, r->in);
+        r->checksum_errors++;
+        goto discard;
     }
 
-    if (r->pos >= (int) sizeof(r->in) - 1) {
-        r->overflow = 1;
-        r->pos = 0;
-        return;
+    hi = hex2int(r->in[r->star + 1]);
+    lo = hex2int(r->in[r->star + 2]);
+    if (hi < 0 || lo < 0 || ((hi << 4) | lo) != r->checksum) {
+        ALOGD("checksum mismatch, sentence discarded: '%.*s'", r->pos, r->in);
+        r->checksum_errors++;
+        goto discard;
     }
 
-    r->in[r->pos] = (char) c;
-    r->pos += 1;
-
-    if (c == '\n') {
-        /* ALOGD("Got an nmea string, parsing."); */
-        nmea_reader_parse(r);
-        if (r->nmea_callback) {
-            struct timeval tv;
-            int64_t now;
-            gettimeofday(&tv, (struct timezone *) NULL);
-            now = tv.tv_sec * 1000LL + tv.tv_usec / 1000;
-            r->nmea_callback(time(NULL) * 1000,
-                                                r->in,
-                                                r->pos + 1);
+    r->state = NMEA_STATE_IDLE;
+    r->sentences++;
+
+    /* Only GPS sentences are of interest. */
+    if (r->tzer.count == 0
+        || NMEA_TALKER(r->in[1], r->in[2]) != NMEA_TALKER('G', 'P'))
+        return;
+
+    r->in[r->pos] = '\n';
+    r->in[r->pos + 1] = '\0';
+
+    nmea_reader_parse(r);
+    if (r->nmea_callback)
+        r->nmea_callback(time(NULL) * 1000, r->in, r->pos + 2);
+    return;
+
+  discard:
+    r->state = NMEA_STATE_IDLE;
+    r->pos = 0;
+}
+
+/*
+ * Frame sentences out of what was read from the NMEA port, read
+ * boundaries do not matter. The checksum is computed and the fields are
+ * split in the same pass; every sentence is parsed as soon as its line
+ * ends, if its checksum matches. A '$' starts over, bytes outside of a
+ * sentence are ignored.
+ */
+void nmea_reader_feed(NmeaReader * r, const char *buf, int len)
+{
+    const char *end = buf + len;
+
+    ENTER;
+    for (; buf < end; buf++) {
+        char c = *buf;
+
+        if (c == '$') {
+            nmea_reader_start(r);
+            continue;
+        }
+
+        if (r->state == NMEA_STATE_IDLE)
+            continue;
+
+        if (c == '\r' || c == '\n') {
+            nmea_reader_end(r);
+            continue;
         }
-        r->pos = 0;
+
+        if (r->pos >= NMEA_MAX_SIZE) {
+            r->overflows++;
+            r->state = NMEA_STATE_IDLE;
+            r->pos = 0;
+            continue;
+        }
+
+        r->in[r->pos++] = c;
+
+        if (r->state == NMEA_STATE_CHECKSUM)
+            continue;
+
+        if (c == '*') {
+            r->state = NMEA_STATE_CHECKSUM;
+            r->star = r->pos - 1;
+            nmea_reader_end_field(r);
+            continue;
+        }
+
+        r->checksum ^= (unsigned char) c;
+        if (c == ',')
+            nmea_reader_end_field(r);
     }
     EXIT;
 }
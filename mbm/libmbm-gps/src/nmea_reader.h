@@ -24,13 +24,34 @@
 
 #include <hardware/gps.h>
 
+#include "nmea_tokenizer.h"
+
 #define  NMEA_MAX_SIZE  83
 
+/* Sentence identifiers packed into an int, eg NMEA_ID('G', 'G', 'A'). */
+#define NMEA_TALKER(a, b)   (((a) << 8) | (b))
+#define NMEA_ID(a, b, c)    (((a) << 16) | ((b) << 8) | (c))
+
 typedef void (*set_pending_callback) (char callback);
 
+enum {
+    NMEA_STATE_IDLE,            /* waiting for a '$' */
+    NMEA_STATE_BODY,            /* up to the '*' of the checksum */
+    NMEA_STATE_CHECKSUM         /* after the '*' */
+};
+
 typedef struct {
+    /* framer, see nmea_reader_feed() */
+    int state;
     int pos;
-    int overflow;
+    int checksum;
+    int star;
+    int field;
+    NmeaTokenizer tzer;
+    unsigned int sentences;
+    unsigned int checksum_errors;
+    unsigned int overflows;
+
     int utc_year;
     int utc_mon;
     int utc_day;
@@ -41,7 +62,7 @@ typedef struct {
     gps_location_callback callback;
     gps_sv_status_callback sv_status_callback;
     gps_nmea_callback nmea_callback;
-    char in[NMEA_MAX_SIZE + 1];
+    char in[NMEA_MAX_SIZE + 2];
     int update;
 } NmeaReader;
 
@@ -49,8 +70,6 @@ void nmea_reader_init(NmeaReader * r);
 
 void nmea_reader_set_callbacks(NmeaReader * r, GpsCallbacks * cbs);
 
-void nmea_reader_addc(NmeaReader * r, int c);
-
-void nmea_reader_add(NmeaReader * r, char *nmea);
+void nmea_reader_feed(NmeaReader * r, const char *buf, int len);
 
 #endif /* NMEA_READER_H */
@@ -35,50 +35,6 @@
 /*****************************************************************/
 /*****************************************************************/
 
-int nmea_tokenizer_init(NmeaTokenizer * t, const char *p, const char *end)
-{
-    int count = 0;
-    /* char *q; */
-
-    ENTER;
-    /* the initial '$' is optional */
-    if (p < end && p[0] == '$')
-        p += 1;
-
-    /* remove trailing newline */
-    if (end > p && end[-1] == '\n') {
-        end -= 1;
-        if (end > p && end[-1] == '\r')
-            end -= 1;
-    }
-    /* get rid of checksum at the end of the sentecne */
-    if (end >= p + 3 && end[-3] == '*') {
-        end -= 3;
-    }
-
-    while (p < end) {
-        const char *q = p;
-
-        q = (const char *) memchr(p, ',', end - p);
-        if (q == NULL)
-            q = end;
-
-        if (count < MAX_NMEA_TOKENS) {
-            t->tokens[count].p = p;
-            t->tokens[count].end = q;
-            count += 1;
-        }
-        if (q < end)
-            q += 1;
-
-        p = q;
-    }
-
-    t->count = count;
-    EXIT;
-    return count;
-}
-
 Token nmea_tokenizer_get(NmeaTokenizer * t, int index)
 {
     Token tok;
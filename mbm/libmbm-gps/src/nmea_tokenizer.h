@@ -26,15 +26,14 @@ typedef struct {
     const char *end;
 } Token;
 
-#define  MAX_NMEA_TOKENS  20
+#define  MAX_NMEA_TOKENS  24
 
+/* Fields of a sentence, filled in by nmea_reader_feed() while framing it. */
 typedef struct {
     int count;
     Token tokens[MAX_NMEA_TOKENS];
 } NmeaTokenizer;
 
-int nmea_tokenizer_init(NmeaTokenizer * t, const char *p, const char *end);
-
 Token nmea_tokenizer_get(NmeaTokenizer * t, int index);
 
 #endif /* NMEA_TOKENIZER_H */
@@ -0,0 +1,28 @@
+# Host built tests and benchmarks for libmbm-gps, run as
+#   mbm_gps_host_tests [--bench] [test ...]
+# from $(HOST_OUT_EXECUTABLES). Built apart from the RIL tests, both
+# have an atchannel.c of their own.
+LOCAL_PATH := $(call my-dir)/..
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := mbm_gps_host_tests
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS := -D_GNU_SOURCE -Wall -Wextra
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/src $(LOCAL_PATH)/src/gpsctrl
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../../test-support
+
+LOCAL_SRC_FILES := tests/host_tests.c
+LOCAL_SRC_FILES += tests/test_nmea.c
+LOCAL_SRC_FILES += tests/test_event_queue.c
+
+LOCAL_SRC_FILES += src/nmea_reader.c
+LOCAL_SRC_FILES += src/nmea_tokenizer.c
+LOCAL_SRC_FILES += src/gpsctrl/event_queue.c
+
+LOCAL_STATIC_LIBRARIES := liblog libcutils libhost_test
+LOCAL_LDLIBS := -lm -lpthread -lrt
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) Ericsson AB 2009-2010
+ * Copyright 2006, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host_tests.h"
+
+const struct host_test host_tests[] = {
+    { "nmea_reader",            test_nmea_reader,       0 },
+    { "nmea_fuzz",              test_nmea_fuzz,         0 },
+    { "nmea_throughput",        bench_nmea_reader,      1 },
+    { "event_queue",            test_event_queue,       0 },
+};
+
+const size_t host_test_count = sizeof(host_tests) / sizeof(host_tests[0]);
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) Ericsson AB 2009-2010
+ * Copyright 2006, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host built tests and benchmarks for libmbm-gps, listed in host_tests.c and
+ * run by the runner of test-support/host_test.h.
+ */
+
+#ifndef _LIBMBMGPS_HOST_TESTS_H
+#define _LIBMBMGPS_HOST_TESTS_H 1
+
+#include "host_test.h"
+
+/* nmea_reader.c */
+void test_nmea_reader(void);
+void test_nmea_fuzz(void);
+void bench_nmea_reader(void);
+
+/* gpsctrl/event_queue.c */
+void test_event_queue(void);
+
+#endif                          /* end _LIBMBMGPS_HOST_TESTS_H */
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) Ericsson AB 2009-2010
+ * Copyright 2006, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The event queue of gpsctrl/event_queue.c: a few workers run the queued
+ * events, never two of one handler at once, each handler's in the order
+ * they were queued. A full queue drops events.
+ */
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "gps_ctrl.h"
+#include "event_queue.h"
+#include "host_tests.h"
+
+#define STRESS_EVENTS   20000
+#define STRESS_DEPTH    (EVENT_QUEUE_MAX * 3 / 4)
+#define HANDLERS        3
+
+static int s_last[HANDLERS];
+static int s_running[HANDLERS];
+static int s_bad;
+
+static void handle(int n, void *data)
+{
+    int v = *(int *) data;
+
+    if (__sync_fetch_and_add(&s_running[n], 1) != 0)
+        __sync_fetch_and_add(&s_bad, 1);
+    if (v <= s_last[n])
+        __sync_fetch_and_add(&s_bad, 1);
+    s_last[n] = v;
+    usleep(20);
+    __sync_fetch_and_sub(&s_running[n], 1);
+}
+
+static void *handler0(void *data)
+{
+    handle(0, data);
+    return NULL;
+}
+
+static void *handler1(void *data)
+{
+    handle(1, data);
+    return NULL;
+}
+
+static void *handler2(void *data)
+{
+    handle(2, data);
+    return NULL;
+}
+
+static void *noHandler(void *data)
+{
+    (void) data;
+    return NULL;
+}
+
+static const gpsctrl_queued_event s_handlers[HANDLERS] = {
+    handler0, handler1, handler2,
+};
+
+/* Held until released, to fill the queue behind it. */
+static pthread_mutex_t s_holdMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_holdCond = PTHREAD_COND_INITIALIZER;
+static int s_held;
+static int s_release;
+
+static void *holdHandler(void *data)
+{
+    (void) data;
+    pthread_mutex_lock(&s_holdMutex);
+    s_held++;
+    pthread_cond_broadcast(&s_holdCond);
+    while (!s_release)
+        pthread_cond_wait(&s_holdCond, &s_holdMutex);
+    pthread_mutex_unlock(&s_holdMutex);
+    return NULL;
+}
+
+static void enqueue(gpsctrl_queued_event handler, int v)
+{
+    int *data = malloc(sizeof(*data));
+
+    CHECK(data != NULL);
+    if (data == NULL)
+        return;
+    *data = v;
+    enqueue_event(handler, data);
+}
+
+/* Waits for handled events to reach handled, for at most 10 s. */
+static int waitHandled(unsigned int handled)
+{
+    GpsCtrlEventStats stats;
+    int i;
+
+    for (i = 0; i < 10000; i++) {
+        event_queue_get_stats(&stats);
+        if (stats.handled >= handled && stats.depth == 0)
+            return 1;
+        usleep(1000);
+    }
+    return 0;
+}
+
+static int threadCount(void)
+{
+    DIR *dir = opendir("/proc/self/task");
+    struct dirent *e;
+    int n = 0;
+
+    if (dir == NULL)
+        return -1;
+    while ((e = readdir(dir)) != NULL)
+        if (e->d_name[0] != '.')
+            n++;
+    closedir(dir);
+    return n;
+}
+
+void test_event_queue(void)
+{
+    GpsCtrlEventStats before;
+    GpsCtrlEventStats stats;
+    int threads;
+    int most = 0;
+    int i;
+
+    for (i = 0; i < HANDLERS; i++)
+        s_last[i] = -1;
+
+    /* The workers are started by the first event, and are all it takes. */
+    event_queue_get_stats(&before);
+    enqueue(noHandler, 0);
+    CHECK(waitHandled(before.handled + 1));
+    threads = threadCount();
+
+    /* Kept from filling up, every event runs, in order for its handler. */
+    event_queue_get_stats(&before);
+    for (i = 0; i < STRESS_EVENTS; i++) {
+        enqueue(s_handlers[i % HANDLERS], i);
+        event_queue_get_stats(&stats);
+        if (stats.depth > STRESS_DEPTH)
+            usleep(500);
+        if (i % 1000 == 0 && threadCount() > most)
+            most = threadCount();
+    }
+    CHECK(waitHandled(before.handled + STRESS_EVENTS));
+    event_queue_get_stats(&stats);
+    CHECK(stats.handled - before.handled == STRESS_EVENTS);
+    CHECK(stats.dropped == before.dropped);
+    CHECK(stats.max_depth <= EVENT_QUEUE_MAX);
+    CHECK(s_bad == 0);
+    for (i = STRESS_EVENTS - HANDLERS; i < STRESS_EVENTS; i++)
+        CHECK(s_last[i % HANDLERS] == i);
+    CHECK(most <= threads);
+
+    /*
+     * Behind a running handler its further events wait, and take up the
+     * queue; past EVENT_QUEUE_MAX of them, events are dropped.
+     */
+    event_queue_get_stats(&before);
+    enqueue(holdHandler, 0);
+    pthread_mutex_lock(&s_holdMutex);
+    while (s_held == 0)
+        pthread_cond_wait(&s_holdCond, &s_holdMutex);
+    pthread_mutex_unlock(&s_holdMutex);
+    for (i = 0; i < EVENT_QUEUE_MAX + 10; i++)
+        enqueue(holdHandler, i);
+    event_queue_get_stats(&stats);
+    CHECK(stats.depth == EVENT_QUEUE_MAX);
+    CHECK(stats.dropped - before.dropped == 10);
+
+    pthread_mutex_lock(&s_holdMutex);
+    s_release = 1;
+    pthread_cond_broadcast(&s_holdCond);
+    pthread_mutex_unlock(&s_holdMutex);
+    CHECK(waitHandled(before.handled + 1 + EVENT_QUEUE_MAX));
+    CHECK(s_held == 1 + EVENT_QUEUE_MAX);
+}
@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) Ericsson AB 2009-2010
+ * Copyright 2006, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The NMEA reader of nmea_reader.c, fed a synthetic log of fixes as the
+ * NMEA port would read it: RMC, GGA, GSA and three GSV sentences a fix,
+ * with their checksums, cut at random read boundaries.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nmea_reader.h"
+#include "host_tests.h"
+
+#define FIX_SENTENCES   6
+#define SENTENCE_MAX    (NMEA_MAX_SIZE + 2)     /* with "\r\n" */
+#define READ_MAX        255
+
+static unsigned int s_seed = 1;
+
+static unsigned int nextRandom(void)
+{
+    s_seed = s_seed * 1103515245 + 12345;
+    return s_seed >> 16;
+}
+
+/* Appends "$body*hh\r\n", returns its length. */
+static int sentence(char *out, const char *body)
+{
+    unsigned char sum = 0;
+    const char *p;
+
+    for (p = body; *p != '\0'; p++)
+        sum ^= (unsigned char) *p;
+    return sprintf(out, "$%s*%02X\r\n", body, sum);
+}
+
+static double fixLatitude(int fix)
+{
+    return 57.68 + fix * 1e-5;
+}
+
+static double fixLongitude(int fix)
+{
+    return 11.99 + fix * 2e-5;
+}
+
+/* NMEA "ddmm.mmmmmm" of degrees. */
+static void degrees(char *out, size_t size, double deg, int width)
+{
+    int d = (int) deg;
+
+    snprintf(out, size, "%0*d%09.6f", width, d, (deg - d) * 60.0);
+}
+
+/* A log of fixes, FIX_SENTENCES sentences each; returns its length. */
+static size_t makeLog(char *buf, int fixes)
+{
+    char body[SENTENCE_MAX];
+    char lat[16];
+    char lon[16];
+    char *p = buf;
+    int i;
+    int k;
+
+    for (i = 0; i < fixes; i++) {
+        int s = i % 86400;
+
+        degrees(lat, sizeof(lat), fixLatitude(i), 2);
+        degrees(lon, sizeof(lon), fixLongitude(i), 3);
+
+        snprintf(body, sizeof(body),
+                 "GPRMC,%02d%02d%02d.00,A,%s,N,%s,E,%05.1f,%05.1f,161122,,,A",
+                 s / 3600, s / 60 % 60, s % 60, lat, lon,
+                 (i % 1000) / 10.0, (i % 3600) / 10.0);
+        p += sentence(p, body);
+
+        snprintf(body, sizeof(body),
+                 "GPGGA,%02d%02d%02d.00,%s,N,%s,E,1,08,1.0,%d.0,M,,,,",
+                 s / 3600, s / 60 % 60, s % 60, lat, lon, 100 + i % 50);
+        p += sentence(p, body);
+
+        p += sentence(p, "GPGSA,A,3,01,02,12,14,17,22,25,31,,,,,1.8,1.0,1.5");
+
+        for (k = 0; k < 3; k++) {
+            snprintf(body, sizeof(body),
+                     "GPGSV,3,%d,12,%02d,40,083,%02d,%02d,17,308,41,"
+                     "%02d,07,344,39,%02d,22,228,45",
+                     k + 1, k * 4 + 1, 30 + i % 20, k * 4 + 2, k * 4 + 3,
+                     k * 4 + 4);
+            p += sentence(p, body);
+        }
+    }
+
+    return p - buf;
+}
+
+/* What the callbacks were given. */
+static struct {
+    int locations;
+    int svStatus;
+    int sentences;
+    int bad;                    /* sentences breaking the callback contract */
+    int svs;
+    double latitude;
+    double longitude;
+    unsigned int hash;
+} s_seen;
+
+static void locationCb(GpsLocation *location)
+{
+    s_seen.locations++;
+    s_seen.latitude = location->latitude;
+    s_seen.longitude = location->longitude;
+}
+
+static void svStatusCb(GpsSvStatus *status)
+{
+    s_seen.svStatus++;
+    s_seen.svs = status->num_svs;
+}
+
+/*
+ * A sentence is handed on nul terminated, ending in "\n", its length
+ * counting the nul, and its checksum matching.
+ */
+static void nmeaCb(GpsUtcTime timestamp, const char *nmea, int length)
+{
+    unsigned char sum = 0;
+    unsigned int check;
+    const char *p;
+
+    (void) timestamp;
+    s_seen.sentences++;
+    if (length < 6 || (int) strlen(nmea) + 1 != length || nmea[0] != '$'
+        || nmea[length - 2] != '\n' || nmea[length - 5] != '*') {
+        s_seen.bad++;
+        return;
+    }
+
+    for (p = nmea + 1; p < nmea + length - 5; p++)
+        sum ^= (unsigned char) *p;
+    if (sscanf(nmea + length - 4, "%2x", &check) != 1 || check != sum)
+        s_seen.bad++;
+
+    for (p = nmea; *p != '\0'; p++)
+        s_seen.hash = s_seen.hash * 31 + (unsigned char) *p;
+}
+
+static GpsCallbacks s_callbacks = {
+    .size = sizeof(GpsCallbacks),
+    .location_cb = locationCb,
+    .sv_status_cb = svStatusCb,
+    .nmea_cb = nmeaCb,
+};
+
+static void startReader(NmeaReader *r)
+{
+    memset(&s_seen, 0, sizeof(s_seen));
+    nmea_reader_init(r);
+    nmea_reader_set_callbacks(r, &s_callbacks);
+    /* The callbacks are given the empty sv status when set, not counted. */
+    s_seen.svStatus = 0;
+}
+
+/* Feeds buf in reads of 1 to max bytes, of max bytes if not random. */
+static void feed(NmeaReader *r, const char *buf, size_t len, int max,
+                 int random)
+{
+    size_t pos = 0;
+
+    while (pos < len) {
+        size_t n = random ? 1 + nextRandom() % max : (size_t) max;
+
+        if (n > len - pos)
+            n = len - pos;
+        nmea_reader_feed(r, buf + pos, n);
+        pos += n;
+    }
+}
+
+static void feedString(NmeaReader *r, const char *s)
+{
+    nmea_reader_feed(r, s, strlen(s));
+}
+
+#define TEST_FIXES  500
+
+void test_nmea_reader(void)
+{
+    static char log[TEST_FIXES * FIX_SENTENCES * SENTENCE_MAX];
+    size_t len = makeLog(log, TEST_FIXES);
+    char one[FIX_SENTENCES * SENTENCE_MAX];
+    char other[SENTENCE_MAX];
+    NmeaReader r;
+    unsigned int hash;
+    int max;
+
+    /*
+     * Every sentence is handed on, and each fix with its sv status: once
+     * for the satellites used, from GSA, once for those in view, from GSV.
+     */
+    startReader(&r);
+    nmea_reader_feed(&r, log, len);
+    CHECK(r.sentences == TEST_FIXES * FIX_SENTENCES);
+    CHECK(r.checksum_errors == 0 && r.overflows == 0);
+    CHECK(s_seen.sentences == TEST_FIXES * FIX_SENTENCES);
+    CHECK(s_seen.bad == 0);
+    CHECK(s_seen.locations == TEST_FIXES);
+    CHECK(s_seen.svStatus == 2 * TEST_FIXES);
+    CHECK(s_seen.svs == 12);
+    CHECK(fabs(s_seen.latitude - fixLatitude(TEST_FIXES - 1)) < 1e-6);
+    CHECK(fabs(s_seen.longitude - fixLongitude(TEST_FIXES - 1)) < 1e-6);
+    hash = s_seen.hash;
+
+    /* Read boundaries do not matter. */
+    for (max = 1; max <= READ_MAX; max += 127) {
+        startReader(&r);
+        feed(&r, log, len, max, 0);
+        CHECK(s_seen.sentences == TEST_FIXES * FIX_SENTENCES);
+        CHECK(s_seen.locations == TEST_FIXES);
+        CHECK(s_seen.hash == hash);
+    }
+    startReader(&r);
+    feed(&r, log, len, READ_MAX, 1);
+    CHECK(s_seen.sentences == TEST_FIXES * FIX_SENTENCES);
+    CHECK(s_seen.locations == TEST_FIXES);
+    CHECK(s_seen.svStatus == 2 * TEST_FIXES);
+    CHECK(s_seen.hash == hash);
+
+    /* The example of the RMC comment, with lower case hex digits. */
+    startReader(&r);
+    feedString(&r, "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,"
+                   "230394,003.1,W*6a\r\n");
+    CHECK(s_seen.locations == 1 && s_seen.bad == 0);
+    CHECK(fabs(s_seen.latitude - (48 + 7.038 / 60)) < 1e-6);
+    CHECK(fabs(s_seen.longitude - (11 + 31.0 / 60)) < 1e-6);
+
+    /* Damaged sentences are dropped, and counted. */
+    startReader(&r);
+    feedString(&r, "$GPGSA,A,3,01,02,,,,,,,,,,,1.8,1.0,1.5*00\r\n");
+    CHECK(r.checksum_errors == 1);
+    feedString(&r, "$GPGSA,A,3,01,02,,,,,,,,,,,1.8,1.0,1.5\r\n");
+    CHECK(r.checksum_errors == 2);
+    feedString(&r, "$GPGSA,A,3,01,02,,,,,,,,,,,1.8,1.0,1.5*3\r\n");
+    CHECK(r.checksum_errors == 3);
+    feedString(&r, "$GPGSV,3,1,12,01,40,083,46,02,17,308,41,12,07,344,39,"
+                   "14,22,228,45,01,40,083,46,02,17,308,41*75\r\n");
+    CHECK(r.overflows == 1);
+    CHECK(r.sentences == 0 && s_seen.sentences == 0);
+
+    /* Noise is skipped, a '$' starts over, other talkers are not handed on. */
+    startReader(&r);
+    feedString(&r, "\r\n\x01garbage,*12\r\n$GPGSA,A,3,01");
+    nmea_reader_feed(&r, one, makeLog(one, 1));
+    sentence(other, "GLGSV,1,1,01,65,40,083,46");
+    feedString(&r, other);
+    CHECK(r.sentences == FIX_SENTENCES + 1);
+    CHECK(r.checksum_errors == 0);
+    CHECK(s_seen.sentences == FIX_SENTENCES);
+    CHECK(s_seen.bad == 0);
+}
+
+#define FUZZ_FIXES      2000
+#define FUZZ_ROUNDS     200
+#define FUZZ_SLICE      (64 * 1024)
+
+/* Bytes most likely to upset the framing. */
+static const char s_special[] = "$*,\r\n0A.";
+
+void test_nmea_fuzz(void)
+{
+    static char log[FUZZ_FIXES * FIX_SENTENCES * SENTENCE_MAX];
+    static char slice[FUZZ_SLICE];
+    size_t len = makeLog(log, FUZZ_FIXES);
+    NmeaReader r;
+    int round;
+    int i;
+
+    s_seed = 48;
+    startReader(&r);
+    for (round = 0; round < FUZZ_ROUNDS; round++) {
+        size_t start = nextRandom() % (len - FUZZ_SLICE);
+        int mutations = nextRandom() % 64;
+
+        memcpy(slice, log + start, FUZZ_SLICE);
+        for (i = 0; i < mutations; i++) {
+            size_t at = ((size_t) nextRandom() << 8 ^ nextRandom()) % FUZZ_SLICE;
+
+            switch (nextRandom() % 4) {
+            case 0:
+                slice[at] = s_special[nextRandom() % (sizeof(s_special) - 1)];
+                break;
+            case 1:
+                slice[at] = (char) nextRandom();
+                break;
+            case 2:
+                /* A lost read, the rest of the slice moves up. */
+                memmove(slice + at, slice + at + 1, FUZZ_SLICE - at - 1);
+                slice[FUZZ_SLICE - 1] = '\n';
+                break;
+            default:
+                slice[at] ^= 1 << (nextRandom() % 8);
+                break;
+            }
+        }
+        feed(&r, slice, FUZZ_SLICE, READ_MAX, 1);
+    }
+    CHECK(s_seen.bad == 0);
+    CHECK(r.pos <= NMEA_MAX_SIZE);
+
+    /* Whatever came before, a clean log reads as it should. */
+    feedString(&r, "\r\n");
+    memset(&s_seen, 0, sizeof(s_seen));
+    i = r.sentences;
+    feed(&r, log, len, READ_MAX, 1);
+    CHECK(r.sentences - i == FUZZ_FIXES * FIX_SENTENCES);
+    CHECK(s_seen.sentences == FUZZ_FIXES * FIX_SENTENCES);
+    CHECK(s_seen.locations == FUZZ_FIXES);
+    CHECK(s_seen.bad == 0);
+}
+
+#define BENCH_FIXES     20000
+#define BENCH_PASSES    10
+
+/* How fast the NMEA port is read, over how it is read. */
+void bench_nmea_reader(void)
+{
+    static const struct {
+        const char *name;
+        int max;
+        int random;
+    } s_reads[] = {
+        { "whole log", 0, 0 },
+        { "reads of 1-255", READ_MAX, 1 },
+        { "reads of 64", 64, 0 },
+        { "reads of 1", 1, 0 },
+    };
+    char *log = malloc(BENCH_FIXES * FIX_SENTENCES * SENTENCE_MAX);
+    size_t len;
+    size_t i;
+    int pass;
+
+    CHECK(log != NULL);
+    if (log == NULL)
+        return;
+    len = makeLog(log, BENCH_FIXES);
+
+    for (i = 0; i < sizeof(s_reads) / sizeof(s_reads[0]); i++) {
+        NmeaReader r;
+        long long start;
+        double s;
+
+        startReader(&r);
+        start = host_test_now_ns();
+        for (pass = 0; pass < BENCH_PASSES; pass++)
+            feed(&r, log, len, s_reads[i].max ? s_reads[i].max : (int) len,
+                 s_reads[i].random);
+        s = (host_test_now_ns() - start) / 1e9;
+        CHECK(s_seen.sentences == BENCH_PASSES * BENCH_FIXES * FIX_SENTENCES);
+        printf("  %-15s %7.1f MB/s, %5.2f M sentences/s\n", s_reads[i].name,
+               BENCH_PASSES * len / s / 1e6,
+               s_seen.sentences / s / 1e6);
+    }
+
+    free(log);
+}
@@ -46,10 +46,13 @@ LOCAL_SHARED_LIBRARIES := \
     libcutils libutils libril
 # libnetutils
 
+LOCAL_STATIC_LIBRARIES := libmbm-at
+
 # For asprinf
 LOCAL_CFLAGS := -D_GNU_SOURCE
 
 LOCAL_C_INCLUDES := $(KERNEL_HEADERS) $(TOP)/hardware/ril/libril/
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../libmbm-at
 
 # Disable prelink, or add to build/core/prelink-linux-arm.map
 LOCAL_PRELINK_MODULE := false
@@ -63,5 +66,10 @@ LOCAL_LDLIBS += -lpthread
 LOCAL_LDLIBS += -lrt
 LOCAL_CFLAGS += -DRIL_SHLIB
 LOCAL_CFLAGS += -Wall
+# Log the time, AT commands and heap growth of each request type every
+# minute.
+#LOCAL_CFLAGS += -DRIL_REQUEST_STATS
 LOCAL_MODULE:= libmbm-ril
 include $(BUILD_SHARED_LIBRARY)
+
+include $(LOCAL_PATH)/tests/Android.mk
@@ -17,6 +17,7 @@
     aterror(AT, ERROR_INVALID_RESPONSE, 6) \
     aterror(AT, ERROR_MEMORY_ALLOCATION, 7) \
     aterror(AT, ERROR_STRING_CREATION, 8) \
+    aterror(AT, ERROR_CANCELLED, 9) \
 
 #define cme_error \
     aterror(CME, MODULE_FAILURE, 0) \
@@ -26,6 +26,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <pthread.h>
 #include <ctype.h>
 #include <stdlib.h>
@@ -36,8 +37,6 @@
 #include <unistd.h>
 #include <stdarg.h>
 
-#include <poll.h>
-
 #define LOG_NDEBUG 0
 #define LOG_TAG "AT"
 #include <utils/Log.h>
@@ -48,12 +47,18 @@
 #endif /*HAVE_ANDROID_OS*/
 
 #include "misc.h"
+#include "prefix_table.h"
+#include "at_reader.h"
 
-#define MAX_AT_RESPONSE (8 * 1024)
 #define HANDSHAKE_RETRY_COUNT 8
 #define HANDSHAKE_TIMEOUT_MSEC 250
 #define DEFAULT_AT_TIMEOUT_MSEC (3 * 60 * 1000)
 #define BUFFSIZE 512
+#define MAX_PIPELINE_DEPTH 8
+#define MAX_CHAINED_COMMANDS 8
+#define RESPONSE_INLINE_SIZE 512
+#define RESPONSE_CHUNK_SIZE 4096
+#define RESPONSE_CHUNK_MAX (64 * 1024)
 
 #define LOGD    ALOGD
 #define LOGI    ALOGI
@@ -61,6 +66,35 @@
 #define LOGW    ALOGW
 #define LOGV	ALOGV
 
+/*
+ * A command queued on an AT channel. The issuing thread waits on cond
+ * until the reader thread, or at_close(), marks the command done.
+ *
+ * A command that times out or is cancelled leaves the queue with its
+ * issuer. If it was written, its final response is still owed: it is
+ * counted as dropped, after the response of the written command before
+ * it, and taken off the line when it comes. The response prefixes are
+ * copied after the struct so that the issuer's array need not outlive
+ * the call.
+ */
+struct atcommand {
+    struct atcommand *next;
+    const char *line;
+    ATCommandType type;
+    const char **prefixes;   /* Matched by MULTILINE and chained commands. */
+    int prefixCount;
+    const char *smsPDU;
+    int exclusive;           /* Waits for a "> " prompt, not pipelined. */
+    ATResponse *response;
+
+    int sent;
+    int done;
+    int cancelled;           /* at_cancel_commands() asked the issuer to return. */
+    int droppedAfter;        /* Responses to drop after this one's. */
+    int err;                 /* AT_ERROR_* set when done without a response. */
+    pthread_cond_t cond;
+};
+
 struct atcontext {
     pthread_t tid_reader;
     int fd;                  /* fd of the AT channel. */
@@ -69,32 +103,29 @@ struct atcontext {
     ATUnsolHandler unsolHandler;
 
     /* For input buffering. */
-    char ATBuffer[MAX_AT_RESPONSE+1];
-    char *ATBufferCur;
-
-    int readCount;
+    struct atReader reader;
 
     /*
-     * For current pending command, these are protected by commandmutex.
-     *
-     * The mutex and cond struct is memset in the getAtChannel() function,
-     * so no initializer should be needed.
+     * Queued commands, protected by commandmutex. Written commands are
+     * at the head, in the order they were written, and are answered by
+     * the modem in that order.
      */
-    pthread_mutex_t requestmutex;
     pthread_mutex_t commandmutex;
-    pthread_cond_t requestcond;
-    pthread_cond_t commandcond;
 
-    ATCommandType type;
-    const char *responsePrefix;
-    const char *smsPDU;
-    ATResponse *response;
+    struct atcommand *cmdHead;
+    struct atcommand *cmdTail;
+    int inFlight;            /* Written commands not answered yet. */
+    int pipelineDepth;
+    int droppedResponses;    /* Owed responses to drop before the head's. */
+    int droppedPrompt;       /* A dropped command waits for a "> " prompt. */
 
     void (*onTimeout)(void);
     void (*onReaderClosed)(void);
     int readerClosed;
 
     int timeoutMsec;
+
+    int commandCount;        /* Commands queued, for statistics. */
 };
 
 static struct atcontext *s_defaultAtContext = NULL;
@@ -161,7 +192,7 @@ static int initializeAtContext(void)
         ac->fd = -1;
         ac->readerCmdFds[0] = -1;
         ac->readerCmdFds[1] = -1;
-        ac->ATBufferCur = ac->ATBuffer;
+        atReaderReset(&ac->reader);
 
         if (pipe(ac->readerCmdFds)) {
             LOGE("%s() Failed to create pipe: %s", __func__, strerror(errno));
@@ -169,11 +200,9 @@ static int initializeAtContext(void)
         }
 
         pthread_mutex_init(&ac->commandmutex, NULL);
-        pthread_mutex_init(&ac->requestmutex, NULL);
-        pthread_cond_init(&ac->requestcond, NULL);
-        pthread_cond_init(&ac->commandcond, NULL);
 
         ac->timeoutMsec = DEFAULT_AT_TIMEOUT_MSEC;
+        ac->pipelineDepth = 1;
 
         if (pthread_setspecific(key, ac)) {
             LOGE("%s() Calling pthread_setspecific failed!", __func__);
@@ -243,10 +272,22 @@ int pthread_cond_timeout_np(pthread_cond_t *cond,
 
     ts.tv_sec += msecs / 1000;
     ts.tv_nsec += (msecs % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
     return pthread_cond_timedwait(cond, mutex, &ts);
 }
 #endif /*HAVE_ANDROID_OS*/
 
+static long long nowMsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 static void sleepMsec(long long msec)
 {
     struct timespec ts;
@@ -262,26 +303,119 @@ static void sleepMsec(long long msec)
 
 
 
-/** Add an intermediate response to sp_response. */
-static void addIntermediate(const char *line)
+/*
+ * An ATResponse and the memory of its lines. The lines and their bytes
+ * are carved out of the space following the response, then out of
+ * chunks of growing size, so a response is freed with a few free()s
+ * however many lines it has.
+ */
+struct atresponsearena {
+    ATResponse response;        /* Must be first. */
+    ATLine **pp_tail;           /* Where the next line is linked. */
+    struct arenachunk *chunks;  /* Most recent first. */
+    char *cur;
+    size_t left;
+    union {
+        ATLine align;
+        char bytes[RESPONSE_INLINE_SIZE];
+    } space;
+};
+
+struct arenachunk {
+    struct arenachunk *next;
+    size_t size;
+    /* Followed by size bytes. */
+};
+
+static ATResponse *at_response_new(void)
+{
+    struct atresponsearena *arena;
+
+    /* Only the header is cleared, the inline space is left as is. */
+    arena = (struct atresponsearena *) malloc(sizeof(*arena));
+    if (arena == NULL)
+        return NULL;
+
+    memset(&arena->response, 0, sizeof(arena->response));
+    arena->pp_tail = &arena->response.p_intermediates;
+    arena->chunks = NULL;
+    arena->cur = arena->space.bytes;
+    arena->left = sizeof(arena->space);
+
+    return &arena->response;
+}
+
+/** Allocate size bytes, pointer aligned, freed with p_response. */
+static void *responseAlloc(ATResponse *p_response, size_t size)
+{
+    struct atresponsearena *arena = (struct atresponsearena *) p_response;
+    struct arenachunk *chunk;
+    size_t chunkSize;
+    void *p;
+
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+    if (size > arena->left) {
+        chunkSize = RESPONSE_CHUNK_SIZE;
+        if (arena->chunks != NULL && arena->chunks->size < RESPONSE_CHUNK_MAX)
+            chunkSize = arena->chunks->size * 2;
+        if (chunkSize < size)
+            chunkSize = size;
+
+        chunk = (struct arenachunk *) malloc(sizeof(*chunk) + chunkSize);
+        if (chunk == NULL)
+            return NULL;
+
+        chunk->size = chunkSize;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->cur = (char *) (chunk + 1);
+        arena->left = chunkSize;
+    }
+
+    p = arena->cur;
+    arena->cur += size;
+    arena->left -= size;
+
+    return p;
+}
+
+static char *responseStrdup(ATResponse *p_response, const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *p = responseAlloc(p_response, len);
+
+    if (p != NULL)
+        memcpy(p, s, len);
+
+    return p;
+}
+
+/** Append an intermediate response to p_response. */
+static void addIntermediate(ATResponse *p_response, const char *line)
 {
+    struct atresponsearena *arena = (struct atresponsearena *) p_response;
+    size_t len = strlen(line) + 1;
     ATLine *p_new;
-    struct atcontext *ac = getAtContext();
 
-    p_new = (ATLine  *) malloc(sizeof(ATLine));
+    /* The line and its bytes in one piece. */
+    p_new = (ATLine *) responseAlloc(p_response, sizeof(ATLine) + len);
+    if (p_new == NULL) {
+        LOGE("%s() Failed to allocate memory", __func__);
+        return;
+    }
 
-    p_new->line = strdup(line);
+    p_new->line = (char *) (p_new + 1);
+    memcpy(p_new->line, line, len);
+    p_new->p_next = NULL;
 
-    /* Note: This adds to the head of the list, so the list will
-       be in reverse order of lines received. the order is flipped
-       again before passing on to the command issuer. */
-    p_new->p_next = ac->response->p_intermediates;
-    ac->response->p_intermediates = p_new;
+    *arena->pp_tail = p_new;
+    arena->pp_tail = &p_new->p_next;
 }
 
 
 /**
- * Returns 1 if line is a final response indicating error.
+ * Final responses indicating error.
  * See 27.007 annex B.
  * WARNING: NO CARRIER and others are sometimes unsolicited.
  */
@@ -293,21 +427,9 @@ static const char * s_finalResponsesError[] = {
     "NO ANSWER",
     "NO DIALTONE",
 };
-static int isFinalResponseError(const char *line)
-{
-    size_t i;
-
-    for (i = 0 ; i < NUM_ELEMS(s_finalResponsesError) ; i++) {
-        if (strStartsWith(line, s_finalResponsesError[i])) {
-            return 1;
-        }
-    }
-
-    return 0;
-}
 
 /**
- * Returns 1 if line is a final response indicating success.
+ * Final responses indicating success.
  * See 27.007 annex B.
  * WARNING: NO CARRIER and others are sometimes unsolicited.
  */
@@ -315,50 +437,283 @@ static const char * s_finalResponsesSuccess[] = {
     "OK",
     "CONNECT"       /* Some stacks start up data on another channel. */
 };
-static int isFinalResponseSuccess(const char *line)
+
+/**
+ * First lines in (what will be) a two-line SMS unsolicited response.
+ */
+static const char * s_smsUnsoliciteds[] = {
+    "+CMT:",
+    "+CDS:",
+    "+CBM:"
+};
+
+enum {
+    LINE_OTHER = 0,
+    LINE_FINAL_SUCCESS,
+    LINE_FINAL_ERROR,
+    LINE_SMS_UNSOLICITED
+};
+
+/* Every prefix above, classifies a line in one lookup. */
+static struct prefixTable s_lineClasses;
+static pthread_once_t s_lineClassesOnce = PTHREAD_ONCE_INIT;
+
+static void addLineClass(const char **prefixes, size_t count, int value)
 {
     size_t i;
 
-    for (i = 0 ; i < NUM_ELEMS(s_finalResponsesSuccess) ; i++) {
-        if (strStartsWith(line, s_finalResponsesSuccess[i])) {
-            return 1;
-        }
-    }
+    for (i = 0; i < count; i++)
+        (void) prefixTableAdd(&s_lineClasses, prefixes[i], value, NULL);
+}
 
-    return 0;
+static void makeLineClasses(void)
+{
+    addLineClass(s_finalResponsesSuccess, NUM_ELEMS(s_finalResponsesSuccess),
+                 LINE_FINAL_SUCCESS);
+    addLineClass(s_finalResponsesError, NUM_ELEMS(s_finalResponsesError),
+                 LINE_FINAL_ERROR);
+    addLineClass(s_smsUnsoliciteds, NUM_ELEMS(s_smsUnsoliciteds),
+                 LINE_SMS_UNSOLICITED);
+}
+
+/** Returns the LINE_* class of line. */
+static int lineClass(const char *line)
+{
+    const struct prefixEntry *e;
+
+    (void) pthread_once(&s_lineClassesOnce, makeLineClasses);
+
+    e = prefixTableMatch(&s_lineClasses, line);
+    return e != NULL ? e->value : LINE_OTHER;
+}
+
+/** Returns 1 if line is a final response indicating success. */
+static int isFinalResponseSuccess(const char *line)
+{
+    return lineClass(line) == LINE_FINAL_SUCCESS;
 }
 
 /**
  * Returns 1 if line is the first line in (what will be) a two-line
  * SMS unsolicited response.
  */
-static const char * s_smsUnsoliciteds[] = {
-    "+CMT:",
-    "+CDS:",
-    "+CBM:"
-};
 static int isSMSUnsolicited(const char *line)
 {
-    size_t i;
+    return lineClass(line) == LINE_SMS_UNSOLICITED;
+}
 
-    for (i = 0 ; i < NUM_ELEMS(s_smsUnsoliciteds) ; i++) {
-        if (strStartsWith(line, s_smsUnsoliciteds[i])) {
-            return 1;
+
+/**
+ * Allocate a command, with a copy of its response prefixes.
+ * NULL prefixes are skipped.
+ */
+static struct atcommand *commandNew(const char *line, ATCommandType type,
+                    const char **prefixes, int prefixCount,
+                    const char *smspdu)
+{
+    struct atcommand *cmd;
+    size_t size = sizeof(*cmd) + prefixCount * sizeof(char *);
+    char *p;
+    int i;
+
+    for (i = 0; i < prefixCount; i++)
+        if (prefixes[i] != NULL)
+            size += strlen(prefixes[i]) + 1;
+
+    cmd = calloc(1, size);
+    if (cmd == NULL)
+        return NULL;
+
+    cmd->response = at_response_new();
+    if (cmd->response == NULL) {
+        free(cmd);
+        return NULL;
+    }
+
+    cmd->line = line;
+    cmd->type = type;
+    cmd->smsPDU = smspdu;
+    cmd->exclusive = (smspdu != NULL);
+
+    cmd->prefixes = (const char **) (cmd + 1);
+    p = (char *) (cmd->prefixes + prefixCount);
+    for (i = 0; i < prefixCount; i++) {
+        if (prefixes[i] == NULL)
+            continue;
+        strcpy(p, prefixes[i]);
+        cmd->prefixes[cmd->prefixCount++] = p;
+        p += strlen(p) + 1;
+    }
+
+    pthread_cond_init(&cmd->cond, NULL);
+
+    return cmd;
+}
+
+static void commandFree(struct atcommand *cmd)
+{
+    at_response_free(cmd->response);
+    pthread_cond_destroy(&cmd->cond);
+    free(cmd);
+}
+
+/** Assumes commandmutex is held. */
+static void commandUnlink(struct atcontext *ac, struct atcommand *cmd)
+{
+    struct atcommand **pp = &ac->cmdHead;
+    struct atcommand *prev = NULL;
+
+    while (*pp != NULL && *pp != cmd) {
+        prev = *pp;
+        pp = &prev->next;
+    }
+
+    if (*pp == NULL)
+        return;
+
+    *pp = cmd->next;
+    if (ac->cmdTail == cmd)
+        ac->cmdTail = prev;
+    cmd->next = NULL;
+
+    if (cmd->sent)
+        ac->inFlight--;
+}
+
+/**
+ * Take a command off the queue and hand it back to its issuer. Assumes
+ * commandmutex is held.
+ */
+static void commandFinish(struct atcontext *ac, struct atcommand *cmd, int err)
+{
+    commandUnlink(ac, cmd);
+
+    cmd->err = err;
+    cmd->done = 1;
+    pthread_cond_signal(&cmd->cond);
+}
+
+/**
+ * Write queued commands while the pipeline has room. A command waiting
+ * for a "> " prompt is only written alone. Assumes commandmutex is held.
+ */
+static void sendQueuedCommands(struct atcontext *ac)
+{
+    struct atcommand *cmd;
+    struct atcommand *next;
+    int exclusive = ac->droppedPrompt;
+    int err;
+
+    for (cmd = ac->cmdHead; cmd != NULL; cmd = next) {
+        next = cmd->next;
+
+        if (cmd->sent) {
+            exclusive |= cmd->exclusive;
+            continue;
         }
+
+        if (ac->inFlight >= ac->pipelineDepth)
+            break;
+
+        if (ac->inFlight > 0 && (exclusive || cmd->exclusive))
+            break;
+
+        err = writeline(cmd->line);
+        if (err != AT_NOERROR) {
+            commandFinish(ac, cmd, err);
+            continue;
+        }
+
+        cmd->sent = 1;
+        ac->inFlight++;
     }
+}
 
-    return 0;
+/**
+ * Take a command whose issuer returns without its response off the
+ * queue. The response to a written one is dropped when it comes, in
+ * order, and keeps its place in the pipeline until then. Assumes
+ * commandmutex is held.
+ */
+static void commandDrop(struct atcontext *ac, struct atcommand *cmd)
+{
+    struct atcommand *prev = NULL;
+    struct atcommand *p;
+
+    if (cmd->sent) {
+        for (p = ac->cmdHead; p != NULL && p != cmd; p = p->next)
+            prev = p;
+
+        /* Written commands are at the head, the one before is written. */
+        if (prev != NULL)
+            prev->droppedAfter += 1 + cmd->droppedAfter;
+        else
+            ac->droppedResponses += 1 + cmd->droppedAfter;
+        if (cmd->exclusive)
+            ac->droppedPrompt = 1;
+
+        /* Its pipeline slot is freed with the response. */
+        cmd->sent = 0;
+    }
+
+    commandUnlink(ac, cmd);
+    commandFree(cmd);
+}
+
+/**
+ * Forget the responses owed to dropped commands; they are taken as
+ * unsolicited if they come after all. Assumes commandmutex is held.
+ */
+static void forgetDroppedResponses(struct atcontext *ac)
+{
+    struct atcommand *cmd;
+
+    ac->inFlight -= ac->droppedResponses;
+    ac->droppedResponses = 0;
+    for (cmd = ac->cmdHead; cmd != NULL; cmd = cmd->next) {
+        ac->inFlight -= cmd->droppedAfter;
+        cmd->droppedAfter = 0;
+    }
+    ac->droppedPrompt = 0;
+
+    sendQueuedCommands(ac);
 }
 
+/** Fail every queued command. Assumes commandmutex is held. */
+static void failQueuedCommands(struct atcontext *ac, int err)
+{
+    while (ac->cmdHead != NULL)
+        commandFinish(ac, ac->cmdHead, err);
+    ac->inFlight = 0;
+    ac->droppedResponses = 0;
+    ac->droppedPrompt = 0;
+}
 
-/** Assumes s_commandmutex is held. */
-static void handleFinalResponse(const char *line)
+static int commandMatchesPrefix(const struct atcommand *cmd, const char *line)
 {
-    struct atcontext *ac = getAtContext();
+    int i;
+
+    for (i = 0; i < cmd->prefixCount; i++) {
+        if (strStartsWith(line, cmd->prefixes[i]))
+            return 1;
+    }
+
+    return 0;
+}
+
+/** Assumes commandmutex is held. */
+static void handleFinalResponse(struct atcontext *ac, struct atcommand *cmd,
+                                const char *line, int success)
+{
+    cmd->response->success = success;
+    cmd->response->finalResponse = responseStrdup(cmd->response, line);
 
-    ac->response->finalResponse = strdup(line);
+    ac->droppedResponses += cmd->droppedAfter;
+    cmd->droppedAfter = 0;
+    commandFinish(ac, cmd, AT_NOERROR);
 
-    pthread_cond_signal(&ac->commandcond);
+    /* The pipeline has room again. */
+    sendQueuedCommands(ac);
 }
 
 static void handleUnsolicited(const char *line)
@@ -373,30 +728,52 @@ static void handleUnsolicited(const char *line)
 static void processLine(const char *line)
 {
     struct atcontext *ac = getAtContext();
+    struct atcommand *cmd;
+    int cls;
+
     pthread_mutex_lock(&ac->commandmutex);
 
-    if (ac->response == NULL) {
+    /* The modem answers in order, lines belong to the oldest written
+       command, after the responses dropped before it. */
+    cmd = ac->cmdHead;
+
+    if (ac->droppedResponses > 0) {
+        cls = lineClass(line);
+        if (cls == LINE_FINAL_SUCCESS || cls == LINE_FINAL_ERROR) {
+            ac->droppedResponses--;
+            ac->inFlight--;
+            if (ac->droppedResponses == 0)
+                ac->droppedPrompt = 0;
+            sendQueuedCommands(ac);
+        } else if (ac->droppedPrompt && 0 == strcmp(line, "> ")) {
+            /* Nobody waits for the result, abort the PDU input. */
+            at_send_escape();
+            ac->droppedPrompt = 0;
+        } else {
+            handleUnsolicited(line);
+        }
+    } else if (cmd == NULL || !cmd->sent) {
         /* No command pending. */
         handleUnsolicited(line);
-    } else if (isFinalResponseSuccess(line)) {
-        ac->response->success = 1;
-        handleFinalResponse(line);
-    } else if (isFinalResponseError(line)) {
-        ac->response->success = 0;
-        handleFinalResponse(line);
-    } else if (ac->smsPDU != NULL && 0 == strcmp(line, "> ")) {
+    } else if ((cls = lineClass(line)) == LINE_FINAL_SUCCESS) {
+        handleFinalResponse(ac, cmd, line, 1);
+    } else if (cls == LINE_FINAL_ERROR) {
+        handleFinalResponse(ac, cmd, line, 0);
+    } else if (cmd->exclusive && cmd->smsPDU != NULL
+               && 0 == strcmp(line, "> ")) {
         /* See eg. TS 27.005 4.3.
            Commands like AT+CMGS have a "> " prompt. */
-        writeCtrlZ(ac->smsPDU);
-        ac->smsPDU = NULL;
-    } else switch (ac->type) {
+        writeCtrlZ(cmd->smsPDU);
+        cmd->smsPDU = NULL;
+        cmd->exclusive = 0;
+    } else switch (cmd->type) {
         case NO_RESULT:
             handleUnsolicited(line);
             break;
         case NUMERIC:
-            if (ac->response->p_intermediates == NULL
+            if (cmd->response->p_intermediates == NULL
                 && isdigit(line[0])) {
-                addIntermediate(line);
+                addIntermediate(cmd->response, line);
             } else {
                 /* Either we already have an intermediate response or
                    the line doesn't begin with a digit. */
@@ -404,24 +781,26 @@ static void processLine(const char *line)
             }
             break;
         case SINGLELINE:
-            if (ac->response->p_intermediates == NULL
-                && strStartsWith (line, ac->responsePrefix)) {
-                addIntermediate(line);
+            if (cmd->response->p_intermediates == NULL
+                && cmd->prefixCount > 0
+                && strStartsWith (line, cmd->prefixes[0])) {
+                addIntermediate(cmd->response, line);
             } else {
                 /* We already have an intermediate response. */
                 handleUnsolicited(line);
             }
             break;
         case MULTILINE:
-            if (strStartsWith (line, ac->responsePrefix)) {
-                addIntermediate(line);
+            /* Chained commands match any of their prefixes. */
+            if (commandMatchesPrefix(cmd, line)) {
+                addIntermediate(cmd->response, line);
             } else {
                 handleUnsolicited(line);
             }
         break;
 
         default: /* This should never be reached */
-            LOGE("%s() Unsupported AT command type %d", __func__, ac->type);
+            LOGE("%s() Unsupported AT command type %d", __func__, cmd->type);
             handleUnsolicited(line);
         break;
     }
@@ -430,177 +809,22 @@ static void processLine(const char *line)
 }
 
 
-/**
- * Returns a pointer to the end of the next line,
- * special-cases the "> " SMS prompt.
- *
- * returns NULL if there is no complete line.
- */
-static char * findNextEOL(char *cur)
-{
-    if (cur[0] == '>' && cur[1] == ' ' && cur[2] == '\0') {
-        /* SMS prompt character...not \r terminated */
-        return cur+2;
-    }
-
-    /* Find next newline */
-    while (*cur != '\0' && *cur != '\r' && *cur != '\n') cur++;
-
-    return *cur == '\0' ? NULL : cur;
-}
-
-
 /**
  * Reads a line from the AT channel, returns NULL on timeout.
  * Assumes it has exclusive read access to the FD.
  *
  * This line is valid only until the next call to readline.
- *
- * This function exists because as of writing, android libc does not
- * have buffered stdio.
  */
-
 static const char *readline(void)
 {
-    ssize_t count;
-
-    char *p_read = NULL;
-    char *p_eol = NULL;
-    char *ret = NULL;
-
     struct atcontext *ac = getAtContext();
-    read(ac->fd,NULL,0);
+    const char *line;
 
-    /* This is a little odd. I use *s_ATBufferCur == 0 to mean
-     * "buffer consumed completely". If it points to a character,
-     * then the buffer continues until a \0.
-     */
-    if (*ac->ATBufferCur == '\0') {
-        /* Empty buffer. */
-        ac->ATBufferCur = ac->ATBuffer;
-        *ac->ATBufferCur = '\0';
-        p_read = ac->ATBuffer;
-    } else {   /* *s_ATBufferCur != '\0' */
-        /* There's data in the buffer from the last read. */
+    line = atReaderLine(&ac->reader, &ac->fd, ac->readerCmdFds[0]);
+    if (line != NULL)
+        LOGI("AT(%d)< %s", ac->fd, line);
 
-        /* skip over leading newlines */
-        while (*ac->ATBufferCur == '\r' || *ac->ATBufferCur == '\n')
-            ac->ATBufferCur++;
-
-        p_eol = findNextEOL(ac->ATBufferCur);
-
-        if (p_eol == NULL) {
-            /* A partial line. Move it up and prepare to read more. */
-            size_t len;
-
-            len = strlen(ac->ATBufferCur);
-
-            memmove(ac->ATBuffer, ac->ATBufferCur, len + 1);
-            p_read = ac->ATBuffer + len;
-            ac->ATBufferCur = ac->ATBuffer;
-        }
-        /* Otherwise, (p_eol !- NULL) there is a complete line 
-           that will be returned from the while () loop below. */
-    }
-
-    while (p_eol == NULL) {
-        int err;
-        struct pollfd pfds[2];
-
-        /* This condition should be synchronized with the read function call
-         * size argument below.
-         */
-        if (0 >= MAX_AT_RESPONSE - (p_read - ac->ATBuffer) - 2) {
-            LOGE("%s() ERROR: Input line exceeded buffer", __func__);
-            /* Ditch buffer and start over again. */
-            ac->ATBufferCur = ac->ATBuffer;
-            *ac->ATBufferCur = '\0';
-            p_read = ac->ATBuffer;
-        }
-
-        /* If our fd is invalid, we are probably closed. Return. */
-        if (ac->fd < 0)
-            return NULL;
-
-        pfds[0].fd = ac->fd;
-        pfds[0].events = POLLIN | POLLERR;
-
-        pfds[1].fd = ac->readerCmdFds[0];
-        pfds[1].events = POLLIN;
-
-        err = poll(pfds, 2, -1);
-
-        if (err < 0) {
-            LOGE("%s() poll: error: %s", __func__, strerror(errno));
-            return NULL;
-        }
-
-        if (pfds[1].revents & POLLIN) {
-            char buf[10];
-
-            /* Just drain it. We don't care, this is just for waking up. */
-            read(pfds[1].fd, &buf, 1);
-            continue;
-        }
-
-        if (pfds[0].revents & POLLERR) {
-            LOGE("%s() POLLERR event! Returning...", __func__);
-            return NULL;
-        }
-
-        if (!(pfds[0].revents & POLLIN))
-            continue;
-
-        do
-            /* The size argument should be synchronized to the ditch buffer
-             * condition above.
-             */
-            count = read(ac->fd, p_read,
-                         MAX_AT_RESPONSE - (p_read - ac->ATBuffer) - 2);
-
-        while (count < 0 && errno == EINTR);
-
-        if (count > 0) {
-            AT_DUMP( "<< ", p_read, count );
-            ac->readCount += count;
-
-            /* Implementation requires extra EOS or EOL to get it right if
-             * there are no trailing newlines in the read buffer. Adding extra
-             * EOS does not harm even if there actually were trailing EOLs.
-             */
-            p_read[count] = '\0';
-            p_read[count+1] = '\0';
-
-            /* Skip over leading newlines. */
-            while (*ac->ATBufferCur == '\r' || *ac->ATBufferCur == '\n')
-                ac->ATBufferCur++;
-
-            p_eol = findNextEOL(ac->ATBufferCur);
-            p_read += count;
-        } else if (count <= 0) {
-            /* Read error encountered or EOF reached. */
-            if (count == 0)
-                LOGD("%s() atchannel: EOF reached.", __func__);
-            else
-                LOGD("%s() atchannel: read error %s", __func__, strerror(errno));
-
-            return NULL;
-        }
-    }
-
-    /* A full line in the buffer. Place a \0 over the \r and return. */
-
-    ret = ac->ATBufferCur;
-    *p_eol = '\0';
-
-    /* The extra EOS added after read takes care of the case when there is no
-     * valid data after p_eol.
-     */
-    ac->ATBufferCur = p_eol + 1;     /* This will always be <= p_read,    
-                                        and there will be a \0 at *p_read. */
-
-    LOGI("AT(%d)< %s", ac->fd, ret);
-    return ret;
+    return line;
 }
 
 static void onReaderClosed(void)
@@ -612,7 +836,7 @@ static void onReaderClosed(void)
 
         ac->readerClosed = 1;
 
-        pthread_cond_signal(&ac->commandcond);
+        failQueuedCommands(ac, AT_ERROR_CHANNEL_CLOSED);
 
         pthread_mutex_unlock(&ac->commandmutex);
 
@@ -665,6 +889,19 @@ static void *readerLoop(void *arg)
     return NULL;
 }
 
+/**
+ * Writes string s followed by the terminator to the AT channel in a
+ * single writev(). Returns AT_ERROR_* on error, 0 on success.
+ */
+static int writeTerminated (struct atcontext *ac, const char *s,
+                            const char *term)
+{
+    if (atWriteTerminated(ac->fd, s, term, 0) < 0)
+        return AT_ERROR_GENERIC;
+
+    return 0;
+}
+
 /**
  * Sends string s to the radio with a \r appended.
  * Returns AT_ERROR_* on error, 0 on success.
@@ -674,10 +911,6 @@ static void *readerLoop(void *arg)
  */
 static int writeline (const char *s)
 {
-    size_t cur = 0;
-    size_t len = strlen(s);
-    ssize_t written;
-
     struct atcontext *ac = getAtContext();
 
     if (ac->fd < 0 || ac->readerClosed > 0) {
@@ -688,38 +921,11 @@ static int writeline (const char *s)
 
     AT_DUMP( ">> ", s, strlen(s) );
 
-    /* The main string. */
-    while (cur < len) {
-        do {
-            written = write (ac->fd, s + cur, len - cur);
-        } while (written < 0 && errno == EINTR);
-
-        if (written < 0) {
-            return AT_ERROR_GENERIC;
-        }
-
-        cur += written;
-    }
-
-    /* The \r  */
-
-    do {
-        written = write (ac->fd, "\r" , 1);
-    } while ((written < 0 && errno == EINTR) || (written == 0));
-
-    if (written < 0) {
-        return AT_ERROR_GENERIC;
-    }
-
-    return 0;
+    return writeTerminated(ac, s, "\r");
 }
 
 static int writeCtrlZ (const char *s)
 {
-    size_t cur = 0;
-    size_t len = strlen(s);
-    ssize_t written;
-
     struct atcontext *ac = getAtContext();
 
     if (ac->fd < 0 || ac->readerClosed > 0)
@@ -729,39 +935,7 @@ static int writeCtrlZ (const char *s)
 
     AT_DUMP( ">* ", s, strlen(s) );
 
-    /* The main string. */
-    while (cur < len) {
-        do {
-            written = write (ac->fd, s + cur, len - cur);
-        } while (written < 0 && errno == EINTR);
-
-        if (written < 0)
-            return AT_ERROR_GENERIC;
-
-        cur += written;
-    }
-
-    /* the ^Z  */
-    do {
-        written = write (ac->fd, "\032" , 1);
-    } while ((written < 0 && errno == EINTR) || (written == 0));
-
-    if (written < 0)
-        return AT_ERROR_GENERIC;
-
-    return 0;
-}
-
-static void clearPendingCommand(void)
-{
-    struct atcontext *ac = getAtContext();
-
-    if (ac->response != NULL)
-        at_response_free(ac->response);
-
-    ac->response = NULL;
-    ac->responsePrefix = NULL;
-    ac->smsPDU = NULL;
+    return writeTerminated(ac, s, "\032");
 }
 
 static int merror(int type, int error)
@@ -847,10 +1021,6 @@ int at_open(int fd, ATUnsolHandler h)
     ac->unsolHandler = h;
     ac->readerClosed = 0;
 
-    ac->responsePrefix = NULL;
-    ac->smsPDU = NULL;
-    ac->response = NULL;
-
     pthread_attr_init (&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
 
@@ -883,7 +1053,7 @@ void at_close(void)
 
     ac->readerClosed = 1;
 
-    pthread_cond_signal(&ac->commandcond);
+    failQueuedCommands(ac, AT_ERROR_CHANNEL_CLOSED);
 
     pthread_mutex_unlock(&ac->commandmutex);
 
@@ -891,63 +1061,37 @@ void at_close(void)
     write(ac->readerCmdFds[1], "x", 1);
 }
 
-static ATResponse *at_response_new(void)
-{
-    return (ATResponse *) calloc(1, sizeof(ATResponse));
-}
-
 void at_response_free(ATResponse *p_response)
 {
-    ATLine *p_line;
+    struct atresponsearena *arena = (struct atresponsearena *) p_response;
+    struct arenachunk *chunk;
 
     if (p_response == NULL) return;
 
-    p_line = p_response->p_intermediates;
-
-    while (p_line != NULL) {
-        ATLine *p_toFree;
-
-        p_toFree = p_line;
-        p_line = p_line->p_next;
-
-        free(p_toFree->line);
-        free(p_toFree);
+    while ((chunk = arena->chunks) != NULL) {
+        arena->chunks = chunk->next;
+        free(chunk);
     }
 
-    free (p_response->finalResponse);
-    free (p_response);
-}
-
-/**
- * The line reader places the intermediate responses in reverse order,
- * here we flip them back.
- */
-static void reverseIntermediates(ATResponse *p_response)
-{
-    ATLine *pcur,*pnext;
-
-    pcur = p_response->p_intermediates;
-    p_response->p_intermediates = NULL;
-
-    while (pcur != NULL) {
-        pnext = pcur->p_next;
-        pcur->p_next = p_response->p_intermediates;
-        p_response->p_intermediates = pcur;
-        pcur = pnext;
-    }
+    free(arena);
 }
 
 /**
  * Internal send_command implementation.
- * Doesn't lock or call the timeout callback.
+ * Queues the command, written once the pipeline has room, and waits for
+ * its final response. Expects commandmutex to be held, doesn't call the
+ * timeout callback.
  *
  * timeoutMsec == 0 means infinite timeout.
  */
 static int at_send_command_full_nolock (const char *command, ATCommandType type,
-                    const char *responsePrefix, const char *smspdu,
+                    const char **prefixes, int prefixCount, const char *smspdu,
                     long long timeoutMsec, ATResponse **pp_outResponse)
 {
     int err = AT_NOERROR;
+    long long deadline = 0;
+    long long left;
+    struct atcommand *cmd;
 
     struct atcontext *ac = getAtContext();
 
@@ -956,65 +1100,53 @@ static int at_send_command_full_nolock (const char *command, ATCommandType type,
     if (pp_outResponse != NULL)
         *pp_outResponse = NULL;
 
-    /* FIXME This is to prevent future problems due to calls from other threads; should be revised. */
-    while (pthread_mutex_trylock(&ac->requestmutex) == EBUSY)
-        pthread_cond_wait(&ac->requestcond, &ac->commandmutex);
-
-    if(ac->response != NULL) {
-        err = AT_ERROR_COMMAND_PENDING;
-        goto finally;
-    }
-
-    ac->type = type;
-    ac->responsePrefix = responsePrefix;
-    ac->smsPDU = smspdu;
-    ac->response = at_response_new();
-    if (ac->response == NULL) {
-        err = AT_ERROR_MEMORY_ALLOCATION;
-        goto finally;
-    }
+    if (timeoutMsec != 0)
+        deadline = nowMsec() + timeoutMsec;
 
-    err = writeline (command);
+    cmd = commandNew(command, type, prefixes, prefixCount, smspdu);
+    if (cmd == NULL)
+        return AT_ERROR_MEMORY_ALLOCATION;
 
-    if (err != AT_NOERROR)
-        goto finally;
+    if (ac->cmdTail != NULL)
+        ac->cmdTail->next = cmd;
+    else
+        ac->cmdHead = cmd;
+    ac->cmdTail = cmd;
+    ac->commandCount++;
 
-    while (ac->response->finalResponse == NULL && ac->readerClosed == 0) {
-        if (timeoutMsec != 0)
-            err = pthread_cond_timeout_np(&ac->commandcond, &ac->commandmutex, timeoutMsec);
-        else
-            err = pthread_cond_wait(&ac->commandcond, &ac->commandmutex);
+    sendQueuedCommands(ac);
 
-        if (err == ETIMEDOUT) {
-            err = AT_ERROR_TIMEOUT;
-            goto finally;
+    while (!cmd->done && !cmd->cancelled) {
+        if (timeoutMsec == 0) {
+            pthread_cond_wait(&cmd->cond, &ac->commandmutex);
+            continue;
         }
-    }
 
-    if (ac->response->success == 0) {
-        err = at_get_error(ac->response);
+        left = deadline - nowMsec();
+        if (left <= 0)
+            break;
+        pthread_cond_timeout_np(&cmd->cond, &ac->commandmutex, left);
     }
 
-    if (pp_outResponse == NULL)
-        at_response_free(ac->response);
-    else {
-        /* Line reader stores intermediate responses in reverse order. */
-        reverseIntermediates(ac->response);
-        *pp_outResponse = ac->response;
+    if (!cmd->done) {
+        err = cmd->cancelled ? AT_ERROR_CANCELLED : AT_ERROR_TIMEOUT;
+        commandDrop(ac, cmd);
+        return err;
     }
 
-    ac->response = NULL;
+    err = cmd->err;
 
-    if(ac->readerClosed > 0) {
-        err = AT_ERROR_CHANNEL_CLOSED;
-        goto finally;
-    }
+    if (err == AT_NOERROR) {
+        if (cmd->response->success == 0)
+            err = at_get_error(cmd->response);
 
-finally:
-    clearPendingCommand();
+        if (pp_outResponse != NULL) {
+            *pp_outResponse = cmd->response;
+            cmd->response = NULL;
+        }
+    }
 
-    pthread_cond_broadcast(&ac->requestcond);
-    pthread_mutex_unlock(&ac->requestmutex);
+    commandFree(cmd);
 
     return err;
 }
@@ -1025,31 +1157,31 @@ finally:
  * timeoutMsec == 0 means infinite timeout.
  */
 static int at_send_command_full (const char *command, ATCommandType type,
-                    const char *responsePrefix, const char *smspdu,
+                    const char **prefixes, int prefixCount, const char *smspdu,
                     long long timeoutMsec, ATResponse **pp_outResponse, int useap, va_list ap)
 {
     int err;
 
     struct atcontext *ac = getAtContext();
-    static char strbuf[BUFFSIZE];
+    /* Several threads may have commands queued, each keeps its own line. */
+    char strbuf[BUFFSIZE];
     const char *ptr;
 
     if (0 != pthread_equal(ac->tid_reader, pthread_self()))
         /* Cannot be called from reader thread. */
         return AT_ERROR_INVALID_THREAD;
 
-    pthread_mutex_lock(&ac->commandmutex);
     if (useap) {
-        if (!vsnprintf(strbuf, BUFFSIZE, command, ap)) {
-           pthread_mutex_unlock(&ac->commandmutex);
+        if (!vsnprintf(strbuf, BUFFSIZE, command, ap))
            return AT_ERROR_STRING_CREATION;
-        }
         ptr = strbuf;
     } else
         ptr = command;
 
+    pthread_mutex_lock(&ac->commandmutex);
+
     err = at_send_command_full_nolock(ptr, type,
-                    responsePrefix, smspdu,
+                    prefixes, prefixCount, smspdu,
                     timeoutMsec, pp_outResponse);
 
     pthread_mutex_unlock(&ac->commandmutex);
@@ -1084,7 +1216,7 @@ int at_send_command (const char *command, ...)
     va_list ap;
     va_start(ap, command);
 
-    err = at_send_command_full (command, NO_RESULT, NULL,
+    err = at_send_command_full (command, NO_RESULT, NULL, 0,
             NULL, ac->timeoutMsec, NULL, 1, ap);
     va_end(ap);
 
@@ -1097,9 +1229,10 @@ int at_send_command (const char *command, ...)
 int at_send_command_raw (const char *command, ATResponse **pp_outResponse)
 {
     struct atcontext *ac = getAtContext();
+    const char *anyPrefix = "";
     int err;
 
-    err = at_send_command_full (command, MULTILINE, "",
+    err = at_send_command_full (command, MULTILINE, &anyPrefix, 1,
             NULL, ac->timeoutMsec, pp_outResponse, 0, empty);
 
     /* Don't check for intermediate responses as it is unknown if any
@@ -1123,7 +1256,7 @@ int at_send_command_singleline (const char *command,
     va_list ap;
     va_start(ap, pp_outResponse);
 
-    err = at_send_command_full (command, SINGLELINE, responsePrefix,
+    err = at_send_command_full (command, SINGLELINE, &responsePrefix, 1,
                                     NULL, ac->timeoutMsec, pp_outResponse, 1, ap);
 
     if (err == AT_NOERROR && pp_outResponse != NULL
@@ -1154,7 +1287,7 @@ int at_send_command_numeric (const char *command,
 
     struct atcontext *ac = getAtContext();
 
-    err = at_send_command_full (command, NUMERIC, NULL,
+    err = at_send_command_full (command, NUMERIC, NULL, 0,
                                 NULL, ac->timeoutMsec, pp_outResponse, 0, empty);
 
     if (err == AT_NOERROR && pp_outResponse != NULL
@@ -1186,7 +1319,7 @@ int at_send_command_sms (const char *command,
 
     struct atcontext *ac = getAtContext();
 
-    err = at_send_command_full (command, SINGLELINE, responsePrefix,
+    err = at_send_command_full (command, SINGLELINE, &responsePrefix, 1,
                                     pdu, ac->timeoutMsec, pp_outResponse, 0, empty);
 
     if (err == AT_NOERROR && pp_outResponse != NULL
@@ -1219,7 +1352,7 @@ int at_send_command_multiline (const char *command,
     va_list ap;
     va_start(ap, pp_outResponse);
 
-    err = at_send_command_full (command, MULTILINE, responsePrefix,
+    err = at_send_command_full (command, MULTILINE, &responsePrefix, 1,
                                     NULL, ac->timeoutMsec, pp_outResponse, 1, ap);
     va_end(ap);
 
@@ -1242,6 +1375,160 @@ int at_send_command_multiline (const char *command,
     return -err;
 }
 
+/**
+ * Copy the intermediate responses of a chained command to the commands
+ * of the chain, by prefix. Each gets a copy of the final response.
+ */
+static int splitChainedResponse(ATResponse *p_response,
+                                const char **responsePrefixes, int count,
+                                ATResponse **pp_outResponses)
+{
+    ATLine *p_line;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        pp_outResponses[i] = at_response_new();
+        if (pp_outResponses[i] == NULL)
+            goto error;
+
+        pp_outResponses[i]->success = p_response->success;
+        pp_outResponses[i]->finalResponse =
+            responseStrdup(pp_outResponses[i], p_response->finalResponse);
+        if (pp_outResponses[i]->finalResponse == NULL)
+            goto error;
+    }
+
+    for (p_line = p_response->p_intermediates; p_line != NULL;
+         p_line = p_line->p_next) {
+        for (i = 0; i < count; i++) {
+            if (responsePrefixes[i] != NULL
+                && strStartsWith(p_line->line, responsePrefixes[i])) {
+                addIntermediate(pp_outResponses[i], p_line->line);
+                break;
+            }
+        }
+    }
+
+    return AT_NOERROR;
+
+error:
+    for (i = 0; i < count; i++) {
+        at_response_free(pp_outResponses[i]);
+        pp_outResponses[i] = NULL;
+    }
+    return AT_ERROR_MEMORY_ALLOCATION;
+}
+
+/**
+ * Issue independent read commands as one chained command line, eg
+ * "AT+CSQ;+CREG?;+COPS?", saving the modem round-trips between them.
+ *
+ * "commands" are extended syntax commands, each may start with "AT".
+ * The intermediate responses starting with responsePrefixes[i] go to
+ * pp_outResponses[i]; the prefixes must not start with one another. A
+ * command with a NULL prefix, eg a set command, gets no intermediates.
+ * The modem stops at the first failing command, so on error no response
+ * is returned and the error is the one of the chain.
+ */
+int at_send_command_chained (const char **commands,
+                             const char **responsePrefixes,
+                             int count,
+                             ATResponse **pp_outResponses)
+{
+    int err;
+    int i;
+    size_t len = 0;
+    size_t n;
+    char line[BUFFSIZE];
+    const char *cmd;
+    ATResponse *p_response = NULL;
+
+    struct atcontext *ac = getAtContext();
+
+    for (i = 0; i < count; i++)
+        pp_outResponses[i] = NULL;
+
+    if (count <= 0 || count > MAX_CHAINED_COMMANDS) {
+        err = AT_ERROR_GENERIC;
+        goto finally;
+    }
+
+    for (i = 0; i < count; i++) {
+        cmd = commands[i];
+        if (i > 0 && strncasecmp(cmd, "AT", 2) == 0)
+            cmd += 2;
+
+        n = strlen(cmd);
+        if (len + n + 2 > sizeof(line)) {
+            err = AT_ERROR_STRING_CREATION;
+            goto finally;
+        }
+
+        if (i > 0)
+            line[len++] = ';';
+        memcpy(line + len, cmd, n);
+        len += n;
+    }
+    line[len] = '\0';
+
+    err = at_send_command_full (line, MULTILINE, responsePrefixes, count,
+                                NULL, ac->timeoutMsec, &p_response, 0, empty);
+
+    if (err == AT_NOERROR)
+        err = splitChainedResponse(p_response, responsePrefixes, count,
+                                   pp_outResponses);
+
+    at_response_free(p_response);
+
+finally:
+    if (err != AT_NOERROR)
+        LOGI(" --- %s", at_str_err(-err));
+
+    return -err;
+}
+
+/**
+ * Cancel the commands queued on the channel, their issuers return
+ * AT_ERROR_CANCELLED and take them off the queue. The responses to the
+ * ones already written are dropped when they come.
+ */
+void at_cancel_commands(void)
+{
+    struct atcontext *ac = getAtContext();
+    struct atcommand *cmd;
+
+    pthread_mutex_lock(&ac->commandmutex);
+
+    for (cmd = ac->cmdHead; cmd != NULL; cmd = cmd->next) {
+        cmd->cancelled = 1;
+        pthread_cond_signal(&cmd->cond);
+    }
+
+    pthread_mutex_unlock(&ac->commandmutex);
+}
+
+/**
+ * Set how many commands may be written to the channel before the first
+ * one is answered. Default is 1, raise it only for a modem that queues
+ * commands while it executes one.
+ */
+void at_set_pipeline_depth(int depth)
+{
+    struct atcontext *ac = getAtContext();
+
+    if (depth < 1)
+        depth = 1;
+    else if (depth > MAX_PIPELINE_DEPTH)
+        depth = MAX_PIPELINE_DEPTH;
+
+    pthread_mutex_lock(&ac->commandmutex);
+
+    ac->pipelineDepth = depth;
+    sendQueuedCommands(ac);
+
+    pthread_mutex_unlock(&ac->commandmutex);
+}
+
 /**
  * Set the default timeout. Let it be reasonably high, some commands
  * take their time. Default is 10 minutes.
@@ -1253,6 +1540,17 @@ void at_set_timeout_msec(int timeout)
     ac->timeoutMsec = timeout;
 }
 
+/**
+ * Returns the number of commands sent on the channel of the calling
+ * thread; the difference between two calls counts the commands between.
+ */
+int at_get_command_count(void)
+{
+    struct atcontext *ac = getAtContext();
+
+    return ac->commandCount;
+}
+
 /** This callback is invoked on the command thread. */
 void at_set_on_timeout(void (*onTimeout)(void))
 {
@@ -1296,10 +1594,14 @@ int at_handshake(void)
     for (i = 0 ; i < HANDSHAKE_RETRY_COUNT ; i++) {
         /* Some stacks start with verbose off. */
         err = at_send_command_full_nolock ("ATE0V1", NO_RESULT,
-                    NULL, NULL, HANDSHAKE_TIMEOUT_MSEC, NULL);
+                    NULL, 0, NULL, HANDSHAKE_TIMEOUT_MSEC, NULL);
 
         if (err == 0)
             break;
+
+        /* A stack that is not up yet may never answer the attempt,
+           don't wait for it in the next one. */
+        forgetDroppedResponses(ac);
     }
 
     if (err == 0) {
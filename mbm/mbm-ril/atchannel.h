@@ -67,7 +67,11 @@ typedef struct ATLine  {
     char *line;
 } ATLine;
 
-/** Free this with at_response_free(). */
+/**
+ * Free this with at_response_free(). The lines are kept in the memory of
+ * the response, in the order they were received; they may be modified in
+ * place but not freed or relinked one by one.
+ */
 typedef struct {
     int success;              /* True if final response indicates
                                  success (eg "OK"). */
@@ -92,6 +96,9 @@ void at_close(void);
  */
 void at_set_timeout_msec(int timeout);
 
+/* Commands sent on the channel of the calling thread, for statistics. */
+int at_get_command_count(void);
+
 /* 
  * This callback is invoked on the command thread.
  * You should reset or handshake here to avoid getting out of sync.
@@ -137,6 +144,32 @@ int at_send_command_sms (const char *command, const char *pdu,
                             const char *responsePrefix,
                             ATResponse **pp_outResponse);
 
+/*
+ * Issue up to 8 independent read commands as one chained command line,
+ * eg "AT+CSQ;+CREG?;+COPS?". The intermediate responses starting with
+ * responsePrefixes[i] are returned in pp_outResponses[i], each to be freed
+ * with at_response_free(); a NULL prefix gets none. Nothing is returned
+ * on error.
+ */
+int at_send_command_chained (const char **commands,
+                             const char **responsePrefixes,
+                             int count,
+                             ATResponse **pp_outResponses);
+
+/*
+ * Make every command queued on the channel return AT_ERROR_CANCELLED.
+ * Responses to the commands already written are dropped when they arrive.
+ */
+void at_cancel_commands(void);
+
+/*
+ * Commands from several threads are queued on the channel and answered in
+ * order. Set how many of them may be written before the first is
+ * answered, up to 8. Default is 1; commands waiting for a "> " prompt are
+ * always written alone.
+ */
+void at_set_pipeline_depth(int depth);
+
 void at_response_free(ATResponse *p_response);
 
 void at_make_default_channel(void);
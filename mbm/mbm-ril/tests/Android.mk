@@ -0,0 +1,49 @@
+# Host built tests and benchmarks for the RIL, run as
+#   mbm_ril_host_tests [--bench] [test ...]
+# from $(HOST_OUT_EXECUTABLES).
+LOCAL_PATH := $(call my-dir)/..
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := mbm_ril_host_tests
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS := -D_GNU_SOURCE -DRIL_SHLIB -Wall
+# the fake modem of u300-ril-fakemodem.c, and the request statistics
+LOCAL_CFLAGS += -DRIL_FAKE_MODEM -DRIL_REQUEST_STATS
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(TOP)/hardware/ril/libril/
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../libmbm-at
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../../test-support
+
+LOCAL_SRC_FILES := tests/host_tests.c
+LOCAL_SRC_FILES += tests/test_modem.c
+LOCAL_SRC_FILES += tests/test_atchannel.c
+LOCAL_SRC_FILES += tests/test_misc.c
+LOCAL_SRC_FILES += tests/test_fakemodem.c
+LOCAL_SRC_FILES += tests/test_ril.c
+LOCAL_SRC_FILES += tests/test_events.c
+LOCAL_SRC_FILES += tests/test_netcache.c
+LOCAL_SRC_FILES += tests/test_pdp.c
+LOCAL_SRC_FILES += tests/test_sim.c
+
+LOCAL_SRC_FILES += u300-ril.c
+LOCAL_SRC_FILES += u300-ril-messaging.c
+LOCAL_SRC_FILES += u300-ril-network.c
+LOCAL_SRC_FILES += u300-ril-pdp.c
+LOCAL_SRC_FILES += u300-ril-requestdatahandler.c
+LOCAL_SRC_FILES += u300-ril-device.c
+LOCAL_SRC_FILES += u300-ril-fakemodem.c
+LOCAL_SRC_FILES += u300-ril-sim.c
+LOCAL_SRC_FILES += u300-ril-oem.c
+LOCAL_SRC_FILES += u300-ril-error.c
+LOCAL_SRC_FILES += u300-ril-stk.c
+LOCAL_SRC_FILES += atchannel.c
+LOCAL_SRC_FILES += at_tok.c
+LOCAL_SRC_FILES += misc.c
+LOCAL_SRC_FILES += fcp_parser.c
+
+LOCAL_STATIC_LIBRARIES := libmbm-at liblog libcutils libhost_test
+LOCAL_LDLIBS := -lpthread -lrt
+
+include $(BUILD_HOST_EXECUTABLE)
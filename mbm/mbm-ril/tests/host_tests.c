@@ -0,0 +1,45 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include "host_tests.h"
+
+const struct host_test host_tests[] = {
+    { "at_channel",             test_at_channel,        0 },
+    { "at_response",            test_at_response,       0 },
+    { "at_throughput",          bench_at_channel,       1 },
+    { "at_response_alloc",      bench_at_response,      1 },
+    { "at_pty",                 bench_at_pty,           1 },
+    { "at_pipeline",            test_at_pipeline,       0 },
+    { "at_pipeline_depth",      bench_at_pipeline,      1 },
+    { "prefix_table",           test_prefix_table,      0 },
+    { "prefix_dispatch",        bench_prefix_table,     1 },
+    { "fake_modem",             test_fake_modem,        0 },
+    /* The RIL takes the default channel, the at_* tests run first. */
+    { "ril_requests",           test_ril_requests,      0 },
+    { "ril_request_mix",        bench_ril_request_mix,  1 },
+    { "ril_events",             test_ril_events,        0 },
+    { "ril_event_queue",        bench_ril_events,       1 },
+    { "ril_network_cache",      test_ril_network_cache, 0 },
+    { "ril_network_trace",      bench_ril_network_cache, 1 },
+    { "ril_pdp",                test_ril_pdp,           0 },
+    { "ril_pdp_setup",          bench_ril_pdp,          1 },
+    { "ril_sim_cache",          test_ril_sim_cache,     0 },
+    { "ril_sim_boot",           bench_ril_sim_boot,     1 },
+};
+
+const size_t host_test_count = sizeof(host_tests) / sizeof(host_tests[0]);
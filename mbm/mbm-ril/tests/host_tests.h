@@ -0,0 +1,105 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Host built tests and benchmarks for the RIL, listed in host_tests.c and
+ * run by the runner of test-support/host_test.h.
+ */
+
+#ifndef MBM_RIL_HOST_TESTS_H
+#define MBM_RIL_HOST_TESTS_H 1
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "host_test.h"
+
+/*
+ * test_modem.c: a modem on a socketpair. test_modem_run() opens the AT
+ * channel to it on a new thread, makes it the default channel and runs
+ * fn there; the modem waits delayUs before answering each line. A latency
+ * set with test_modem_set_latency() is waited from when each line came
+ * in instead, lines in flight overlapping, by the runs after it.
+ */
+struct test_modem_reply {
+    const char *command;        /* eg "+CSQ", without "AT" */
+    const char *lines;          /* intermediate lines, '\n' separated */
+    const char *final;          /* NULL for "OK" */
+    int delayMs;
+    int prompt;                 /* takes a PDU after "> " first */
+};
+
+void test_modem_run(const struct test_modem_reply *replies, int delayUs,
+                    void (*fn)(void));
+void test_modem_unsolicited(const char *line);
+int test_modem_lines(void);
+int test_modem_last_unsolicited(char *buf, size_t size);
+const char *test_modem_last_pdu(void);
+void test_modem_set_latency(int latencyUs);
+
+/*
+ * test_ril.c: the RIL on the fake modem, started once by the first
+ * ril_test_start(). ril_test_request() sends a request through
+ * onRequest(), calls inspect with a successful response and returns the
+ * RIL_Errno, -1 if the RIL did not start.
+ */
+int ril_test_start(void);
+int ril_test_request(int request, void *data, size_t datalen,
+                     void (*inspect)(const void *response, size_t len,
+                                     void *arg),
+                     void *arg);
+int ril_test_unsolicited(int unsol);
+
+/* test_sim.c: the fake modem rules of the card, written at start. */
+void test_sim_card_rules(FILE *f);
+
+/* atchannel.c */
+void test_at_channel(void);
+void test_at_response(void);
+void bench_at_channel(void);
+void bench_at_response(void);
+void bench_at_pty(void);
+void test_at_pipeline(void);
+void bench_at_pipeline(void);
+
+/* libmbm-at/prefix_table.c */
+void test_prefix_table(void);
+void bench_prefix_table(void);
+
+/* u300-ril-fakemodem.c */
+void test_fake_modem(void);
+
+/* u300-ril.c, on the fake modem */
+void test_ril_requests(void);
+void bench_ril_request_mix(void);
+void test_ril_events(void);
+void bench_ril_events(void);
+
+/* u300-ril-network.c, on the fake modem */
+void test_ril_network_cache(void);
+void bench_ril_network_cache(void);
+
+/* u300-ril-pdp.c, on the fake modem */
+void test_ril_pdp(void);
+void bench_ril_pdp(void);
+
+/* u300-ril-sim.c, on the fake modem */
+void test_ril_sim_cache(void);
+void bench_ril_sim_boot(void);
+
+#endif
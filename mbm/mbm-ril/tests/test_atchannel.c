@@ -0,0 +1,860 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * The command queue of atchannel.c against the socketpair modem: several
+ * issuers on one channel, chained commands, timeouts, cancellation,
+ * unsolicited lines and the SMS prompt; pipelined commands; the lines of
+ * large responses; and its throughput, latency and allocations, also
+ * against the pipeline depth. The reader and the writer are also timed
+ * on a pty, as the modem's tty.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "atchannel.h"
+#include "at_tok.h"
+#include "host_tests.h"
+
+#define ISSUERS             4
+#define ISSUER_COMMANDS     200
+#define BENCH_COMMANDS      20000
+#define BENCH_POLLS         200
+#define PHONEBOOK_ENTRIES   800
+#define LONG_LINE           6000
+#define BENCH_RESPONSES     200
+#define PIPELINE_DEPTH      4
+#define PIPELINE_ISSUERS    8
+#define PIPELINE_COMMANDS   2000
+#define MODEM_LATENCY_US    1000
+
+static const struct test_modem_reply s_replies[] = {
+    { "+CSQ",           "+CSQ: 20,99",      NULL,       0,      0 },
+    { "+CREG?",         "+CREG: 2,1",       NULL,       0,      0 },
+    { "+CGREG?",        "+CGREG: 2,1",      NULL,       0,      0 },
+    { "+COPS?",         "+COPS: 0,0,\"Op\"", NULL,      0,      0 },
+    { "+FAIL",          NULL,               "ERROR",    0,      0 },
+    { "+SLOW",          NULL,               NULL,       300,    0 },
+    { "+CMGS=20",       "+CMGS: 7",         NULL,       0,      1 },
+    { "+CMGS=99",       "+CMGS: 8",         NULL,       300,    1 },
+    { NULL,             NULL,               NULL,       0,      0 },
+};
+
+static const char *s_pollCommands[] = { "AT+CSQ", "AT+CREG?", "AT+COPS?" };
+static const char *s_pollPrefixes[] = { "+CSQ:", "+CREG:", "+COPS:" };
+
+static int csqRssi(ATResponse *p_response)
+{
+    char *line;
+    int rssi;
+
+    if (p_response == NULL || p_response->p_intermediates == NULL)
+        return -1;
+    line = p_response->p_intermediates->line;
+    if (at_tok_start(&line) < 0 || at_tok_nextint(&line, &rssi) < 0)
+        return -1;
+    return rssi;
+}
+
+static int commandCsq(void)
+{
+    ATResponse *p_response = NULL;
+    int rssi = -1;
+
+    if (at_send_command_singleline("AT+CSQ", "+CSQ:", &p_response) == 0)
+        rssi = csqRssi(p_response);
+    at_response_free(p_response);
+    return rssi;
+}
+
+/*****************************************************************************/
+
+static void *slowIssuer(void *arg)
+{
+    int *err = arg;
+
+    *err = at_send_command("AT+SLOW");
+    return NULL;
+}
+
+static void *issuerLoop(void *arg)
+{
+    long id = (long) arg;
+    ATResponse *p_response;
+    char cmd[32];
+    char *line;
+    int value;
+    int i;
+
+    for (i = 0; i < ISSUER_COMMANDS; i++) {
+        p_response = NULL;
+        snprintf(cmd, sizeof(cmd), "AT+ECHO=%ld", id * 10000 + i);
+        CHECK(at_send_command_singleline(cmd, "+ECHO:", &p_response) == 0);
+        if (p_response != NULL && p_response->p_intermediates != NULL) {
+            line = p_response->p_intermediates->line;
+            CHECK(at_tok_start(&line) == 0);
+            CHECK(at_tok_nextint(&line, &value) == 0);
+            /* Each issuer gets the answer to its own command. */
+            CHECK(value == id * 10000 + i);
+        } else {
+            CHECK(!"no +ECHO response");
+        }
+        at_response_free(p_response);
+    }
+    return NULL;
+}
+
+static void channelScenario(void)
+{
+    ATResponse *responses[3];
+    ATResponse *p_response = NULL;
+    const char *failCommands[3] = { "AT+CSQ", "AT+FAIL", "AT+COPS?" };
+    const char *setCommands[3] = { "AT+CSQ", "AT+CMEE=1", "AT+COPS?" };
+    const char *setPrefixes[3] = { "+CSQ:", NULL, "+COPS:" };
+    pthread_t tids[ISSUERS];
+    long long start;
+    int err;
+    char unsol[128];
+    char *line;
+    int count;
+    int lines;
+    int value;
+    long i;
+
+    CHECK(commandCsq() == 20);
+
+    /* Several issuers sharing the default channel. */
+    for (i = 0; i < ISSUERS; i++)
+        CHECK(pthread_create(&tids[i], NULL, issuerLoop, (void *) i) == 0);
+    for (i = 0; i < ISSUERS; i++)
+        pthread_join(tids[i], NULL);
+
+    /* A chained read is one command line, its answers split by prefix. */
+    count = at_get_command_count();
+    lines = test_modem_lines();
+    CHECK(at_send_command_chained(s_pollCommands, s_pollPrefixes, 3,
+                                  responses) == 0);
+    CHECK(at_get_command_count() == count + 1);
+    CHECK(test_modem_lines() == lines + 1);
+    CHECK(csqRssi(responses[0]) == 20);
+    CHECK(responses[1] != NULL && responses[1]->p_intermediates != NULL
+          && strcmp(responses[1]->p_intermediates->line, "+CREG: 2,1") == 0);
+    CHECK(responses[2] != NULL && responses[2]->p_intermediates != NULL
+          && strcmp(responses[2]->p_intermediates->line,
+                    "+COPS: 0,0,\"Op\"") == 0);
+    for (i = 0; i < 3; i++) {
+        CHECK(responses[i] != NULL && responses[i]->success);
+        CHECK(responses[i] == NULL
+              || responses[i]->p_intermediates->p_next == NULL);
+        at_response_free(responses[i]);
+    }
+
+    /* The modem stops at the failing command: nothing is returned. */
+    CHECK(at_send_command_chained(failCommands, s_pollPrefixes, 3,
+                                  responses) != 0);
+    for (i = 0; i < 3; i++)
+        CHECK(responses[i] == NULL);
+
+    /* A command without a prefix, eg a set command, gets no lines. */
+    CHECK(at_send_command_chained(setCommands, setPrefixes, 3,
+                                  responses) == 0);
+    CHECK(csqRssi(responses[0]) == 20);
+    CHECK(responses[1] != NULL && responses[1]->success
+          && responses[1]->p_intermediates == NULL);
+    CHECK(responses[2] != NULL && responses[2]->p_intermediates != NULL);
+    for (i = 0; i < 3; i++)
+        at_response_free(responses[i]);
+
+    /* A timed out command is answered late; the answer is not taken for
+       the one to the next command. */
+    at_set_timeout_msec(100);
+    CHECK(at_send_command("AT+SLOW") == -AT_ERROR_TIMEOUT);
+    at_set_timeout_msec(1000);
+    CHECK(commandCsq() == 20);
+
+    /* A cancelled issuer returns at once, the answer is dropped too. */
+    CHECK(pthread_create(&tids[0], NULL, slowIssuer, &err) == 0);
+    usleep(50000);
+    start = host_test_now_ns();
+    at_cancel_commands();
+    pthread_join(tids[0], NULL);
+    CHECK(err == -AT_ERROR_CANCELLED);
+    CHECK(host_test_now_ns() - start < 200000000LL);
+    CHECK(commandCsq() == 20);
+
+    /* The prompt to a timed out SMS gets ESC instead of the PDU. */
+    at_set_timeout_msec(100);
+    CHECK(at_send_command_sms("AT+CMGS=99", "0011000B916407281553F80000BB",
+                              "+CMGS:", &p_response) == -AT_ERROR_TIMEOUT);
+    CHECK(p_response == NULL);
+    at_set_timeout_msec(1000);
+    CHECK(commandCsq() == 20);
+    CHECK(strcmp(test_modem_last_pdu(), "") == 0);
+
+    /* Lines that are not answers to a NO_RESULT command are unsolicited. */
+    test_modem_unsolicited("+CIEV: 9,9");
+    CHECK(at_send_command("AT") == 0);
+    CHECK(test_modem_last_unsolicited(unsol, sizeof(unsol)) >= 1);
+    CHECK(strcmp(unsol, "+CIEV: 9,9") == 0);
+
+    /* The PDU is written at the "> " prompt. */
+    CHECK(at_send_command_sms("AT+CMGS=20", "0011000B916407281553F80000AA",
+                              "+CMGS:", &p_response) == 0);
+    CHECK(strcmp(test_modem_last_pdu(), "0011000B916407281553F80000AA") == 0);
+    if (p_response != NULL && p_response->p_intermediates != NULL) {
+        line = p_response->p_intermediates->line;
+        CHECK(at_tok_start(&line) == 0);
+        CHECK(at_tok_nextint(&line, &value) == 0);
+        CHECK(value == 7);
+    } else {
+        CHECK(!"no +CMGS response");
+    }
+    at_response_free(p_response);
+
+    CHECK(commandCsq() == 20);
+}
+
+void test_at_channel(void)
+{
+    test_modem_run(s_replies, 0, channelScenario);
+}
+
+/*****************************************************************************/
+
+static void *pipelineIssuer(void *arg)
+{
+    long id = (long) arg;
+    ATResponse *p_response;
+    char cmd[32];
+    char *line;
+    int value;
+    int i;
+
+    for (i = 0; i < ISSUER_COMMANDS; i++) {
+        p_response = NULL;
+        snprintf(cmd, sizeof(cmd), "AT+ECHO=%ld", id * 10000 + i);
+        if (at_send_command_singleline(cmd, "+ECHO:", &p_response) == 0
+            && p_response->p_intermediates != NULL) {
+            line = p_response->p_intermediates->line;
+            CHECK(at_tok_start(&line) == 0);
+            CHECK(at_tok_nextint(&line, &value) == 0);
+            CHECK(value == id * 10000 + i);
+        } else {
+            CHECK(!"no +ECHO response");
+        }
+        at_response_free(p_response);
+    }
+    return NULL;
+}
+
+static void pipelineScenario(void)
+{
+    pthread_t tids[PIPELINE_ISSUERS];
+    long long start;
+    long i;
+
+    at_set_pipeline_depth(PIPELINE_DEPTH);
+
+    /* Commands written before the first is answered, each issuer still
+       gets its own answer, in less than a latency per command. */
+    start = host_test_now_ns();
+    for (i = 0; i < PIPELINE_ISSUERS; i++)
+        CHECK(pthread_create(&tids[i], NULL, pipelineIssuer,
+                             (void *) i) == 0);
+    for (i = 0; i < PIPELINE_ISSUERS; i++)
+        pthread_join(tids[i], NULL);
+    CHECK(host_test_now_ns() - start <
+          PIPELINE_ISSUERS * ISSUER_COMMANDS * MODEM_LATENCY_US * 1000LL / 2);
+
+    /* The ones written after a timed out command are answered after it:
+       its late answer is dropped, not taken for theirs. */
+    at_set_timeout_msec(100);
+    CHECK(at_send_command("AT+SLOW") == -AT_ERROR_TIMEOUT);
+    at_set_timeout_msec(1000);
+    for (i = 0; i < PIPELINE_DEPTH - 1; i++)
+        CHECK(pthread_create(&tids[i], NULL, pipelineIssuer,
+                             (void *) i) == 0);
+    for (i = 0; i < PIPELINE_DEPTH - 1; i++)
+        pthread_join(tids[i], NULL);
+    CHECK(commandCsq() == 20);
+
+    at_set_pipeline_depth(1);
+    CHECK(commandCsq() == 20);
+}
+
+void test_at_pipeline(void)
+{
+    test_modem_set_latency(MODEM_LATENCY_US);
+    test_modem_run(s_replies, 0, pipelineScenario);
+    test_modem_set_latency(0);
+}
+
+/*****************************************************************************/
+
+static int s_benchThreads;
+static int s_benchCommands;
+static long long *s_latencies;
+
+static int compareLatency(const void *a, const void *b)
+{
+    long long x = *(const long long *) a;
+    long long y = *(const long long *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void *benchIssuer(void *arg)
+{
+    long long *latencies = arg;
+    long long start;
+    int i;
+
+    for (i = 0; i < s_benchCommands; i++) {
+        start = host_test_now_ns();
+        if (commandCsq() != 20)
+            CHECK(!"bad +CSQ response");
+        latencies[i] = host_test_now_ns() - start;
+    }
+    return NULL;
+}
+
+static void benchScenario(void)
+{
+    pthread_t tids[PIPELINE_ISSUERS];
+    long long start;
+    long long elapsed;
+    int total = s_benchThreads * s_benchCommands;
+    int i;
+
+    start = host_test_now_ns();
+    for (i = 0; i < s_benchThreads; i++)
+        CHECK(pthread_create(&tids[i], NULL, benchIssuer,
+                             s_latencies + i * s_benchCommands) == 0);
+    for (i = 0; i < s_benchThreads; i++)
+        pthread_join(tids[i], NULL);
+    elapsed = host_test_now_ns() - start;
+
+    qsort(s_latencies, total, sizeof(*s_latencies), compareLatency);
+    printf("%d issuer(s): %.0f commands/s, p50 %.1f us, p99 %.1f us\n",
+           s_benchThreads, total * 1e9 / elapsed,
+           s_latencies[total / 2] / 1e3, s_latencies[total * 99 / 100] / 1e3);
+}
+
+static void pollScenario(void)
+{
+    ATResponse *responses[3];
+    ATResponse *p_response;
+    long long start;
+    long long separate;
+    long long chained;
+    int i;
+    int j;
+
+    start = host_test_now_ns();
+    for (i = 0; i < BENCH_POLLS; i++) {
+        for (j = 0; j < 3; j++) {
+            p_response = NULL;
+            at_send_command_singleline(s_pollCommands[j], s_pollPrefixes[j],
+                                       &p_response);
+            at_response_free(p_response);
+        }
+    }
+    separate = host_test_now_ns() - start;
+
+    start = host_test_now_ns();
+    for (i = 0; i < BENCH_POLLS; i++) {
+        CHECK(at_send_command_chained(s_pollCommands, s_pollPrefixes, 3,
+                                      responses) == 0);
+        for (j = 0; j < 3; j++)
+            at_response_free(responses[j]);
+    }
+    chained = host_test_now_ns() - start;
+
+    printf("CSQ/CREG?/COPS? poll, 1 ms per modem line: separate %.2f ms, "
+           "chained %.2f ms\n", separate / 1e6 / BENCH_POLLS,
+           chained / 1e6 / BENCH_POLLS);
+}
+
+void bench_at_channel(void)
+{
+    s_latencies = malloc(sizeof(*s_latencies) * BENCH_COMMANDS);
+    if (s_latencies == NULL) {
+        CHECK(!"out of memory");
+        return;
+    }
+
+    s_benchThreads = 1;
+    s_benchCommands = BENCH_COMMANDS;
+    test_modem_run(s_replies, 0, benchScenario);
+
+    s_benchThreads = ISSUERS;
+    s_benchCommands = BENCH_COMMANDS / ISSUERS;
+    test_modem_run(s_replies, 0, benchScenario);
+
+    free(s_latencies);
+
+    test_modem_run(s_replies, 1000, pollScenario);
+}
+
+static int s_benchDepth;
+
+static void pipelineBenchScenario(void)
+{
+    at_set_pipeline_depth(s_benchDepth);
+    printf("depth %d, ", s_benchDepth);
+    benchScenario();
+}
+
+/* Issuers against a modem answering each line 1 ms after it came in. */
+void bench_at_pipeline(void)
+{
+    static const int depths[] = { 1, 2, 4, 8 };
+    size_t i;
+
+    s_latencies = malloc(sizeof(*s_latencies) * PIPELINE_COMMANDS);
+    if (s_latencies == NULL) {
+        CHECK(!"out of memory");
+        return;
+    }
+
+    test_modem_set_latency(MODEM_LATENCY_US);
+    s_benchThreads = PIPELINE_ISSUERS;
+    s_benchCommands = PIPELINE_COMMANDS / PIPELINE_ISSUERS;
+    for (i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+        s_benchDepth = depths[i];
+        test_modem_run(s_replies, 0, pipelineBenchScenario);
+    }
+    test_modem_set_latency(0);
+
+    free(s_latencies);
+}
+
+/*****************************************************************************/
+
+static char *s_phonebook;
+
+/* "+CPBR: <i>,..." lines for entries first to last, a long one in the
+   middle if asked for. */
+static char *makePhonebook(int first, int last, int longLine)
+{
+    size_t size = (last - first + 1) * 64 + LONG_LINE + 64;
+    char *book = malloc(size);
+    size_t len = 0;
+    int i;
+
+    if (book == NULL)
+        return NULL;
+
+    for (i = first; i <= last; i++) {
+        len += snprintf(book + len, size - len,
+                        "%s+CPBR: %d,\"+4670%06d\",145,\"Entry %d\"",
+                        i > first ? "\n" : "", i, i, i);
+        if (longLine && i == (first + last) / 2) {
+            len += snprintf(book + len, size - len, "\n+CPBR: 0,\"");
+            memset(book + len, '7', LONG_LINE);
+            len += LONG_LINE;
+            len += snprintf(book + len, size - len, "\",129,\"Long\"");
+        }
+    }
+    return book;
+}
+
+static void responseScenario(void)
+{
+    ATResponse *p_response = NULL;
+    ATLine *p_line;
+    char *line;
+    size_t len;
+    int index;
+    int expect = 1;
+    int count = 0;
+    int sawLong = 0;
+
+    CHECK(at_send_command_multiline("AT+CPBR=1,800", "+CPBR:",
+                                    &p_response) == 0);
+    if (p_response == NULL)
+        return;
+
+    /* Every line, in the order sent and whole. */
+    for (p_line = p_response->p_intermediates; p_line != NULL;
+         p_line = p_line->p_next) {
+        line = p_line->line;
+        /* Before the tokenizer cuts it. */
+        len = strlen(line);
+        CHECK(at_tok_start(&line) == 0);
+        CHECK(at_tok_nextint(&line, &index) == 0);
+        if (index == 0) {
+            CHECK(len == LONG_LINE + 22);
+            sawLong = 1;
+            continue;
+        }
+        CHECK(index == expect);
+        expect++;
+        count++;
+    }
+    CHECK(count == PHONEBOOK_ENTRIES);
+    CHECK(sawLong);
+    CHECK(p_response->success);
+    CHECK(strcmp(p_response->finalResponse, "OK") == 0);
+    at_response_free(p_response);
+
+    /* A response without lines is an error, and is freed. */
+    p_response = NULL;
+    CHECK(at_send_command_multiline("AT+CPBR=0", "+CPBR:", &p_response)
+          == -AT_ERROR_INVALID_RESPONSE);
+    CHECK(p_response == NULL);
+}
+
+void test_at_response(void)
+{
+    struct test_modem_reply replies[2];
+
+    s_phonebook = makePhonebook(1, PHONEBOOK_ENTRIES, 1);
+    if (s_phonebook == NULL) {
+        CHECK(!"out of memory");
+        return;
+    }
+
+    memset(replies, 0, sizeof(replies));
+    replies[0].command = "+CPBR=1,800";
+    replies[0].lines = s_phonebook;
+    test_modem_run(replies, 0, responseScenario);
+
+    free(s_phonebook);
+}
+
+static int s_benchLines;
+
+static void responseBenchScenario(void)
+{
+    ATResponse *p_response;
+    long long start;
+    long long elapsed;
+    long allocs;
+    int i;
+
+    allocs = host_test_allocs();
+    start = host_test_now_ns();
+    for (i = 0; i < BENCH_RESPONSES; i++) {
+        p_response = NULL;
+        CHECK(at_send_command_multiline("AT+CPBR=1", "+CPBR:",
+                                        &p_response) == 0);
+        at_response_free(p_response);
+    }
+    elapsed = host_test_now_ns() - start;
+    allocs = host_test_allocs() - allocs;
+
+    printf("%d line response: %.1f us", s_benchLines,
+           elapsed / 1e3 / BENCH_RESPONSES);
+    if (allocs >= 0)
+        printf(", %.1f allocations per command",
+               (double) allocs / BENCH_RESPONSES);
+    printf("\n");
+}
+
+/*
+ * Time and heap allocations per multiline command, counting those of the
+ * queue, the reader and the issuer, for small and large responses.
+ */
+void bench_at_response(void)
+{
+    static const int sizes[] = { 1, 20, PHONEBOOK_ENTRIES };
+    struct test_modem_reply replies[2];
+    size_t i;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        s_phonebook = makePhonebook(1, sizes[i], 0);
+        if (s_phonebook == NULL) {
+            CHECK(!"out of memory");
+            return;
+        }
+
+        memset(replies, 0, sizeof(replies));
+        replies[0].command = "+CPBR=1";
+        replies[0].lines = s_phonebook;
+        s_benchLines = sizes[i];
+        test_modem_run(replies, 0, responseBenchScenario);
+
+        free(s_phonebook);
+    }
+}
+
+/*****************************************************************************/
+
+#define PTY_LINES           300000
+#define PTY_LONG_LINE       2000    /* every PTY_LONG_EVERY lines */
+#define PTY_LONG_EVERY      100
+#define PTY_READ_MAX        4096
+#define PTY_COMMANDS        2000
+#define PTY_MESSAGES        200
+
+static int s_ptyMaster = -1;
+static int s_ptyLines;
+static int s_ptyOutOfOrder;
+static int s_ptyWrites;         /* of the modem end */
+
+/* Each line ends in its number, after the last ',' or ' '. */
+static void onPtyUnsolicited(const char *s, const char *sms_pdu)
+{
+    const char *p = strrchr(s, ',');
+
+    (void) sms_pdu;
+    if (p == NULL)
+        p = strrchr(s, ' ');
+    if (p == NULL || atoi(p + 1) != __sync_fetch_and_add(&s_ptyLines, 0))
+        __sync_fetch_and_add(&s_ptyOutOfOrder, 1);
+    __sync_fetch_and_add(&s_ptyLines, 1);
+}
+
+static void ptyWrite(const char *s, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(s_ptyMaster, s, len);
+        if (n <= 0) {
+            CHECK(!"write to the pty failed");
+            return;
+        }
+        s += n;
+        len -= n;
+    }
+}
+
+/* Answers each command with OK, and AT+CMGS with its prompt first. */
+static void *ptyModemLoop(void *arg)
+{
+    static const char ok[] = "\r\nOK\r\n";
+    static const char prompt[] = "\r\n> ";
+    static const char sent[] = "\r\n+CMGS: 1\r\n\r\nOK\r\n";
+    char line[64];
+    size_t len = 0;
+    char buf[4096];
+    ssize_t n;
+    ssize_t i;
+
+    (void) arg;
+
+    while ((n = read(s_ptyMaster, buf, sizeof(buf))) > 0) {
+        for (i = 0; i < n; i++) {
+            if (buf[i] == '\r') {
+                line[len] = '\0';
+                len = 0;
+                if (strncmp(line, "AT+CMGS=", 8) == 0)
+                    ptyWrite(prompt, sizeof(prompt) - 1);
+                else
+                    ptyWrite(ok, sizeof(ok) - 1);
+            } else if (buf[i] == '\032') {
+                len = 0;
+                ptyWrite(sent, sizeof(sent) - 1);
+            } else if (len + 1 < sizeof(line)) {
+                line[len++] = buf[i];
+                continue;
+            } else {
+                continue;
+            }
+            __sync_fetch_and_add(&s_ptyWrites, 1);
+        }
+    }
+    return NULL;
+}
+
+/* Write syscalls of the whole process so far, -1 if not known. */
+static long long processWrites(void)
+{
+    FILE *f = fopen("/proc/self/io", "r");
+    char name[32];
+    long long value;
+    long long writes = -1;
+
+    if (f == NULL)
+        return -1;
+    while (fscanf(f, "%31s %lld", name, &value) == 2)
+        if (strcmp(name, "syscw:") == 0)
+            writes = value;
+    fclose(f);
+    return writes;
+}
+
+/* Channel writes since start, less those of the modem end. */
+static long long channelWrites(long long start, int modemStart)
+{
+    long long writes = processWrites();
+
+    if (writes < 0 || start < 0)
+        return -1;
+    return writes - start - (__sync_fetch_and_add(&s_ptyWrites, 0)
+                             - modemStart);
+}
+
+static size_t makeBurst(char *buf)
+{
+    size_t len = 0;
+    int i;
+
+    for (i = 0; i < PTY_LINES; i++) {
+        switch (i % PTY_LONG_EVERY == PTY_LONG_EVERY - 1 ? 3 : i % 3) {
+        case 0:
+            len += sprintf(buf + len, "\r\n+CIEV: 2,%d\r\n", i);
+            break;
+        case 1:
+            len += sprintf(buf + len, "\r\n*E2REG: %d\r\n", i);
+            break;
+        case 2:
+            len += sprintf(buf + len,
+                           "\r\n+CREG: 1,\"00C3\",\"0000A1B2\",%d\r\n", i);
+            break;
+        default:
+            len += sprintf(buf + len, "\r\n+CUSD: 0,\"");
+            memset(buf + len, 'A' + i % 26, PTY_LONG_LINE);
+            len += PTY_LONG_LINE;
+            len += sprintf(buf + len, "\",15,%d\r\n", i);
+            break;
+        }
+    }
+    return len;
+}
+
+static void ptyScenario(void)
+{
+    char *burst = malloc((size_t) PTY_LINES * 64
+                         + (PTY_LINES / PTY_LONG_EVERY) * PTY_LONG_LINE);
+    pthread_t tid;
+    long long start;
+    long long elapsed;
+    long long writes;
+    int modemWrites;
+    size_t len;
+    size_t pos;
+    int i;
+
+    if (burst == NULL) {
+        CHECK(!"out of memory");
+        return;
+    }
+    len = makeBurst(burst);
+
+    /* A burst of unsolicited lines, in reads cut anywhere. */
+    srand(50);
+    start = host_test_now_ns();
+    for (pos = 0; pos < len; ) {
+        size_t n = 1 + rand() % PTY_READ_MAX;
+
+        if (n > len - pos)
+            n = len - pos;
+        ptyWrite(burst + pos, n);
+        pos += n;
+    }
+    for (i = 0; i < 30000 && __sync_fetch_and_add(&s_ptyLines, 0)
+                             < PTY_LINES; i++)
+        usleep(1000);
+    elapsed = host_test_now_ns() - start;
+    free(burst);
+
+    CHECK(__sync_fetch_and_add(&s_ptyLines, 0) == PTY_LINES);
+    CHECK(__sync_fetch_and_add(&s_ptyOutOfOrder, 0) == 0);
+    printf("  %d unsolicited lines in reads of 1-%d: %.2f M lines/s\n",
+           PTY_LINES, PTY_READ_MAX, PTY_LINES / (elapsed / 1e9) / 1e6);
+
+    /* Each command, and each PDU, is one write. */
+    CHECK(pthread_create(&tid, NULL, ptyModemLoop, NULL) == 0);
+
+    modemWrites = __sync_fetch_and_add(&s_ptyWrites, 0);
+    writes = processWrites();
+    start = host_test_now_ns();
+    for (i = 0; i < PTY_COMMANDS; i++)
+        CHECK(at_send_command("AT+CSQ") == 0);
+    elapsed = host_test_now_ns() - start;
+    writes = channelWrites(writes, modemWrites);
+    printf("  AT+CSQ: %.0f commands/s", PTY_COMMANDS / (elapsed / 1e9));
+    if (writes >= 0)
+        printf(", %.2f writes per command", (double) writes / PTY_COMMANDS);
+    printf("\n");
+
+    modemWrites = __sync_fetch_and_add(&s_ptyWrites, 0);
+    writes = processWrites();
+    for (i = 0; i < PTY_MESSAGES; i++) {
+        ATResponse *p_response = NULL;
+
+        CHECK(at_send_command_sms("AT+CMGS=23", "0011000B916407281553F8"
+                                  "0000AA0AE8329BFD4697D9EC37", "+CMGS:",
+                                  &p_response) == 0);
+        at_response_free(p_response);
+    }
+    writes = channelWrites(writes, modemWrites);
+    if (writes >= 0)
+        printf("  AT+CMGS: %.2f writes per message, PDU included\n",
+               (double) writes / PTY_MESSAGES);
+
+    at_close();
+    pthread_join(tid, NULL);
+}
+
+static void *ptyChannelThread(void *arg)
+{
+    int fd = *(int *) arg;
+
+    CHECK(at_open(fd, onPtyUnsolicited) == 0);
+    at_make_default_channel();
+    at_set_timeout_msec(5000);
+    ptyScenario();
+    return NULL;
+}
+
+/*
+ * The reader and the writer on a pty in raw mode: lines per second of a
+ * burst of unsolicited lines, some of them long, read as they come; and
+ * write syscalls per command, the modem end's own left out.
+ */
+void bench_at_pty(void)
+{
+    struct termios tio;
+    pthread_t tid;
+    int fd;
+
+    s_ptyMaster = posix_openpt(O_RDWR | O_NOCTTY);
+    CHECK(s_ptyMaster >= 0);
+    if (s_ptyMaster < 0)
+        return;
+    CHECK(grantpt(s_ptyMaster) == 0 && unlockpt(s_ptyMaster) == 0);
+    fd = open(ptsname(s_ptyMaster), O_RDWR | O_NOCTTY);
+    CHECK(fd >= 0);
+    if (fd < 0) {
+        close(s_ptyMaster);
+        return;
+    }
+    CHECK(tcgetattr(fd, &tio) == 0);
+    cfmakeraw(&tio);
+    CHECK(tcsetattr(fd, TCSANOW, &tio) == 0);
+
+    s_ptyLines = 0;
+    s_ptyOutOfOrder = 0;
+    s_ptyWrites = 0;
+    CHECK(pthread_create(&tid, NULL, ptyChannelThread, &fd) == 0);
+    pthread_join(tid, NULL);
+
+    /* at_close() closed fd. */
+    close(s_ptyMaster);
+    s_ptyMaster = -1;
+}
@@ -0,0 +1,285 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * The timed events of the request queues of u300-ril.c, run by the
+ * queueRunners of the RIL on the fake modem.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <telephony/ril.h>
+
+#include "u300-ril.h"
+#include "host_tests.h"
+
+#define EVENT_MAX           20000
+#define EVENT_THREADS       4
+#define EVENT_WAIT_SEC      10
+
+static pthread_mutex_t s_eventMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_eventCond = PTHREAD_COND_INITIALIZER;
+
+static struct {
+    int runs[EVENT_MAX];
+    long long due[EVENT_MAX];   /* ns, 0 when not checked */
+    long long lateNs[EVENT_MAX];
+    int order[EVENT_MAX];
+    int ran;
+    int early;
+} s_events;
+
+static void resetEvents(void)
+{
+    pthread_mutex_lock(&s_eventMutex);
+    memset(&s_events, 0, sizeof(s_events));
+    pthread_mutex_unlock(&s_eventMutex);
+}
+
+static void onEvent(void *param)
+{
+    int i = (int) (intptr_t) param;
+    long long now = host_test_now_ns();
+
+    pthread_mutex_lock(&s_eventMutex);
+    if (s_events.due[i] != 0 && now < s_events.due[i])
+        s_events.early++;
+    if (s_events.ran < EVENT_MAX) {
+        s_events.lateNs[s_events.ran] = now - s_events.due[i];
+        s_events.order[s_events.ran] = i;
+    }
+    s_events.runs[i]++;
+    s_events.ran++;
+    pthread_cond_broadcast(&s_eventCond);
+    pthread_mutex_unlock(&s_eventMutex);
+}
+
+/* Waits for count runs in all, returns the runs so far. */
+static int waitEvents(int count)
+{
+    struct timespec ts;
+    int ran;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += EVENT_WAIT_SEC;
+    pthread_mutex_lock(&s_eventMutex);
+    while (s_events.ran < count &&
+           pthread_cond_timedwait(&s_eventCond, &s_eventMutex, &ts) == 0)
+        ;
+    ran = s_events.ran;
+    pthread_mutex_unlock(&s_eventMutex);
+    return ran;
+}
+
+static void enqueueAt(int once, int i, long msec)
+{
+    struct timespec rel;
+
+    rel.tv_sec = msec / 1000;
+    rel.tv_nsec = (msec % 1000) * 1000000L;
+
+    pthread_mutex_lock(&s_eventMutex);
+    s_events.due[i] = host_test_now_ns() + msec * 1000000LL;
+    pthread_mutex_unlock(&s_eventMutex);
+
+    if (once)
+        enqueueRILEventOnce(RIL_EVENT_QUEUE_NORMAL, onEvent,
+                            (void *) (intptr_t) i, &rel);
+    else
+        enqueueRILEvent(RIL_EVENT_QUEUE_NORMAL, onEvent,
+                        (void *) (intptr_t) i, &rel);
+}
+
+struct enqueueRun {
+    int first;
+    int count;
+    unsigned int seed;
+};
+
+static void *enqueueThread(void *arg)
+{
+    struct enqueueRun *run = arg;
+    int i;
+
+    for (i = run->first; i < run->first + run->count; i++)
+        enqueueAt(0, i, rand_r(&run->seed) % 50);
+    return NULL;
+}
+
+void test_ril_events(void)
+{
+    struct enqueueRun runs[EVENT_THREADS];
+    pthread_t tids[EVENT_THREADS];
+    int shuffled[100];
+    long long start;
+    int tmp;
+    int i;
+    int j;
+
+    CHECK(ril_test_start() == 0);
+
+    /* In due order, 2 ms apart, whatever order they were queued in. */
+    resetEvents();
+    for (i = 0; i < 100; i++)
+        shuffled[i] = i;
+    for (i = 99; i > 0; i--) {
+        j = rand() % (i + 1);
+        tmp = shuffled[i];
+        shuffled[i] = shuffled[j];
+        shuffled[j] = tmp;
+    }
+    for (i = 0; i < 100; i++)
+        enqueueAt(0, shuffled[i], 20 + 2 * shuffled[i]);
+    CHECK(waitEvents(100) == 100);
+    for (i = 0; i < 100; i++)
+        CHECK(s_events.order[i] == i);
+    CHECK(s_events.early == 0);
+
+    /* Each enqueueRILEvent() runs, the same callback and param or not. */
+    resetEvents();
+    for (i = 0; i < 3; i++)
+        enqueueAt(0, 0, 10);
+    CHECK(waitEvents(3) == 3);
+
+    /* enqueueRILEventOnce() runs once, at the earliest time asked for. */
+    resetEvents();
+    start = host_test_now_ns();
+    enqueueAt(1, 1, 300);
+    enqueueAt(1, 1, 100);
+    enqueueAt(1, 1, 200);
+    CHECK(waitEvents(1) == 1);
+    CHECK(host_test_now_ns() - start < 200 * 1000000LL);
+    usleep(400 * 1000);
+    CHECK(s_events.runs[1] == 1);
+
+    /* dequeueRILEvent() cancels every pending run of the event. */
+    resetEvents();
+    enqueueAt(0, 2, 100);
+    enqueueAt(0, 2, 150);
+    enqueueAt(1, 2, 120);
+    enqueueAt(0, 3, 100);
+    dequeueRILEvent(onEvent, (void *) (intptr_t) 2);
+    CHECK(waitEvents(1) == 1);
+    usleep(200 * 1000);
+    CHECK(s_events.runs[2] == 0);
+    CHECK(s_events.runs[3] == 1);
+
+    /* Many threads, none lost, none run twice, none early. */
+    resetEvents();
+    for (i = 0; i < EVENT_THREADS; i++) {
+        runs[i].first = i * (EVENT_MAX / EVENT_THREADS);
+        runs[i].count = EVENT_MAX / EVENT_THREADS;
+        runs[i].seed = i + 1;
+        CHECK(pthread_create(&tids[i], NULL, enqueueThread, &runs[i]) == 0);
+    }
+    for (i = 0; i < EVENT_THREADS; i++)
+        pthread_join(tids[i], NULL);
+    CHECK(waitEvents(EVENT_MAX) == EVENT_MAX);
+    for (i = 0; i < EVENT_MAX; i++)
+        if (s_events.runs[i] != 1) {
+            fprintf(stderr, "event %d ran %d times\n", i, s_events.runs[i]);
+            CHECK(s_events.runs[i] == 1);
+            break;
+        }
+    CHECK(s_events.early == 0);
+}
+
+static void onIdleEvent(void *param)
+{
+    (void) param;
+}
+
+static int compareLongLong(const void *a, const void *b)
+{
+    long long x = *(const long long *) a;
+    long long y = *(const long long *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+#define BENCH_PENDING   1000
+#define BENCH_ENQUEUES  20000
+
+void bench_ril_events(void)
+{
+    static const struct timespec hour = { 3600, 0 };
+    static const int pending[] = { 0, 100, BENCH_PENDING };
+    long long start;
+    long long ns;
+    size_t k;
+    int n;
+    int i;
+
+    CHECK(ril_test_start() == 0);
+
+    /* Enqueue and cancel, with events pending that never come due. */
+    for (k = 0; k < sizeof(pending) / sizeof(pending[0]); k++) {
+        for (i = 0; i < pending[k]; i++)
+            enqueueRILEvent(RIL_EVENT_QUEUE_NORMAL, onIdleEvent,
+                            (void *) (intptr_t) (i + 1), &hour);
+
+        start = host_test_now_ns();
+        for (i = 0; i < BENCH_ENQUEUES; i++) {
+            enqueueRILEvent(RIL_EVENT_QUEUE_NORMAL, onIdleEvent, NULL, &hour);
+            dequeueRILEvent(onIdleEvent, NULL);
+        }
+        ns = host_test_now_ns() - start;
+        printf("  %4d pending: enqueue and cancel %5.0f ns", pending[k],
+               (double) ns / BENCH_ENQUEUES);
+
+        start = host_test_now_ns();
+        for (i = 0; i < BENCH_ENQUEUES; i++)
+            enqueueRILEventOnce(RIL_EVENT_QUEUE_NORMAL, onIdleEvent, NULL,
+                                &hour);
+        ns = host_test_now_ns() - start;
+        dequeueRILEvent(onIdleEvent, NULL);
+        printf(", enqueue once %5.0f ns", (double) ns / BENCH_ENQUEUES);
+
+        start = host_test_now_ns();
+        for (i = 0; i < BENCH_ENQUEUES; i++)
+            enqueueRILEvent(RIL_EVENT_QUEUE_NORMAL, onIdleEvent, NULL, &hour);
+        ns = host_test_now_ns() - start;
+        printf(", enqueue %5.0f ns", (double) ns / BENCH_ENQUEUES);
+
+        start = host_test_now_ns();
+        dequeueRILEvent(onIdleEvent, NULL);
+        ns = host_test_now_ns() - start;
+        printf(", cancel of %d %4.0f us\n", BENCH_ENQUEUES, ns / 1000.0);
+
+        for (i = 0; i < pending[k]; i++)
+            dequeueRILEvent(onIdleEvent, (void *) (intptr_t) (i + 1));
+    }
+
+    /* How late timers run, with many due within half a second. */
+    resetEvents();
+    for (i = 0; i < 2000; i++)
+        enqueueAt(0, i, rand() % 500);
+    n = waitEvents(2000);
+    CHECK(n == 2000);
+    qsort(s_events.lateNs, n, sizeof(s_events.lateNs[0]), compareLongLong);
+    printf("  2000 timers within 500 ms: late p50 %.0f us, p99 %.0f us,"
+           " max %.0f us\n", s_events.lateNs[n / 2] / 1000.0,
+           s_events.lateNs[n * 99 / 100] / 1000.0,
+           s_events.lateNs[n - 1] / 1000.0);
+}
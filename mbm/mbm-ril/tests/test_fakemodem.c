@@ -0,0 +1,118 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * The answers of the fake modem of u300-ril-fakemodem.c, read off its
+ * pty: rules, chained commands and the SMS prompt.
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "u300-ril-fakemodem.h"
+#include "host_tests.h"
+
+static const char s_rules[] =
+    "delay 0\n"
+    "cmd AT+CSQ 0 +CSQ: 14,99|OK\n"
+    "cmd AT+CFUN? 0 ERROR\n"
+    "cmd AT+CMGS= 0 >|+CMGS: 12|OK\n"
+    "cmd AT+CMGW= 0 >\n"
+    "cmd AT+CMGC= 0 >|+CMGC: 5\n";
+
+/* Reads what the modem sends until it has been quiet for msec. */
+static void readModem(int fd, char *buf, size_t size, int msec)
+{
+    struct pollfd pfd;
+    size_t len = 0;
+    ssize_t n;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (len + 1 < size && poll(&pfd, 1, msec) > 0) {
+        n = read(fd, buf + len, size - len - 1);
+        if (n <= 0)
+            break;
+        len += n;
+    }
+    buf[len] = '\0';
+}
+
+static void command(int fd, const char *cmd, const char *expect)
+{
+    char buf[256];
+
+    CHECK(write(fd, cmd, strlen(cmd)) == (ssize_t) strlen(cmd));
+    readModem(fd, buf, sizeof(buf), 50);
+    if (strcmp(buf, expect) != 0) {
+        fprintf(stderr, "%s: got \"%s\"\n", cmd, buf);
+        CHECK(!"unexpected answer");
+    }
+}
+
+void test_fake_modem(void)
+{
+    char path[] = "/tmp/mbm_ril_rules_XXXXXX";
+    char buf[256];
+    unsigned int count;
+    int fd;
+
+    fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    CHECK(write(fd, s_rules, sizeof(s_rules) - 1) ==
+          (ssize_t) sizeof(s_rules) - 1);
+    close(fd);
+
+    fd = fakeModemOpen(path);
+    unlink(path);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+
+    readModem(fd, buf, sizeof(buf), 50);
+    CHECK(strcmp(buf, "\r\n*EMRDY: 1\r\n") == 0);
+
+    count = fakeModemCommandCount();
+    command(fd, "AT+CSQ\r", "\r\n+CSQ: 14,99\r\n\r\nOK\r\n");
+    command(fd, "ATE0\r", "\r\nOK\r\n");
+    CHECK(fakeModemCommandCount() == count + 2);
+
+    /* The parts of a chained command, up to the first error. */
+    command(fd, "AT+CSQ;+CFUN?;+CSQ\r", "\r\n+CSQ: 14,99\r\n\r\nERROR\r\n");
+
+    /* The lines after the prompt come with the PDU. */
+    command(fd, "AT+CMGS=10\r", "\r\n> ");
+    command(fd, "0011\x1a", "\r\n+CMGS: 12\r\n\r\nOK\r\n");
+
+    /* A prompt without a final response after it is answered "OK". */
+    command(fd, "AT+CMGW=10\r", "\r\n> ");
+    command(fd, "0011\x1a", "\r\nOK\r\n");
+    command(fd, "AT+CMGC=10\r", "\r\n> ");
+    command(fd, "0011\x1a", "\r\n+CMGC: 5\r\n\r\nOK\r\n");
+
+    /* Escape aborts the PDU. */
+    command(fd, "AT+CMGW=10\r", "\r\n> ");
+    command(fd, "00\x1b", "\r\nOK\r\n");
+
+    close(fd);
+}
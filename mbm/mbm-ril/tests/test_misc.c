@@ -0,0 +1,153 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * The prefix table of libmbm-at, which classifies the lines read off the AT
+ * channel and dispatches unsolicited results to their handlers.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "misc.h"
+#include "prefix_table.h"
+#include "host_tests.h"
+
+/*
+ * What the reader thread looks a line up in: the final responses and SMS
+ * lines of atchannel.c, then the unsolicited handlers of u300-ril.c.
+ */
+static const char *s_prefixes[] = {
+    "OK", "CONNECT", "ERROR", "+CMS ERROR:", "+CME ERROR:", "NO CARRIER",
+    "NO ANSWER", "NO DIALTONE", "+CMT:", "+CDS:", "+CBM:",
+    "*ETZV:", "*EPEV", "*ESIMSR", "*E2NAP:", "*E2REG:", "*EESIMSWAP:",
+    "+CREG:", "+CGREG:", "+CMTI:", "+CIEV: 2", "+CIEV: 7", "*STKEND",
+    "*STKI:", "*STKN:",
+};
+
+#define PREFIXES    (sizeof(s_prefixes) / sizeof(s_prefixes[0]))
+
+/* Lines as read during a cell broadcast burst on a registered phone. */
+static const char *s_traffic[] = {
+    "+CBM: 88", "OK", "+CIEV: 2,3", "+CSQ: 14,99", "OK",
+    "+CREG: 1,\"00C3\",\"0000C35A\",2", "+CGREG: 1,\"00C3\",\"0000C35A\",2",
+    "*E2REG: 1", "+CBM: 88", "+CIEV: 7,1", "+CMTI: \"SM\",4", "OK",
+    "*ERINFO: 0,0,2", "OK", "+COPS: 0,2,\"24001\"", "OK", "*E2NAP: 1",
+    "+CME ERROR: 10", "*STKN: 25", "+CBM: 88", "*EPEV",
+    "+CGDCONT: 1,\"IP\",\"internet\",\"10.0.0.2\",0,0", "OK",
+};
+
+#define TRAFFIC     (sizeof(s_traffic) / sizeof(s_traffic[0]))
+
+/* The first prefix of s_prefixes the line starts with, as before. */
+static int linearMatch(const char *line)
+{
+    size_t i;
+
+    for (i = 0; i < PREFIXES; i++)
+        if (strStartsWith(line, s_prefixes[i]))
+            return (int) i;
+    return -1;
+}
+
+static int tableMatch(const struct prefixTable *table, const char *line)
+{
+    const struct prefixEntry *e = prefixTableMatch(table, line);
+
+    return e != NULL ? e->value : -1;
+}
+
+static void fillTable(struct prefixTable *table)
+{
+    size_t i;
+
+    memset(table, 0, sizeof(*table));
+    for (i = 0; i < PREFIXES; i++)
+        CHECK(prefixTableAdd(table, s_prefixes[i], (int) i, NULL) == 0);
+}
+
+void test_prefix_table(void)
+{
+    static const char *many[PREFIX_TABLE_MAX + 1];
+    static char names[PREFIX_TABLE_MAX + 1][8];
+    struct prefixTable table;
+    size_t i;
+
+    /* The longest prefix wins, whatever order they were added in. */
+    memset(&table, 0, sizeof(table));
+    CHECK(prefixTableAdd(&table, "+CIEV:", 1, NULL) == 0);
+    CHECK(prefixTableAdd(&table, "+CIEV: 7", 2, NULL) == 0);
+    CHECK(prefixTableAdd(&table, "+C", 3, NULL) == 0);
+    CHECK(prefixTableAdd(&table, "*E2NAP:", 4, NULL) == 0);
+    CHECK(tableMatch(&table, "+CIEV: 7,1") == 2);
+    CHECK(tableMatch(&table, "+CIEV: 2,3") == 1);
+    CHECK(tableMatch(&table, "+CSQ: 14,99") == 3);
+    CHECK(tableMatch(&table, "*E2NAP: 1") == 4);
+    CHECK(tableMatch(&table, "*E2NA") == -1);
+    CHECK(tableMatch(&table, "OK") == -1);
+    CHECK(tableMatch(&table, "") == -1);
+
+    CHECK(prefixTableAdd(&table, "+CIEV:", 5, NULL) == -EEXIST);
+    CHECK(prefixTableAdd(&table, "", 5, NULL) == -EINVAL);
+
+    memset(&table, 0, sizeof(table));
+    for (i = 0; i <= PREFIX_TABLE_MAX; i++) {
+        snprintf(names[i], sizeof(names[i]), "%c%zu", 'A' + (int) (i % 26),
+                 i);
+        many[i] = names[i];
+    }
+    for (i = 0; i < PREFIX_TABLE_MAX; i++)
+        CHECK(prefixTableAdd(&table, many[i], (int) i, NULL) == 0);
+    CHECK(prefixTableAdd(&table, many[i], (int) i, NULL) == -ENOSPC);
+    for (i = 0; i < PREFIX_TABLE_MAX; i++)
+        CHECK(tableMatch(&table, many[i]) == (int) i);
+
+    /* The reader's prefixes classify the traffic as the linear scan did. */
+    fillTable(&table);
+    for (i = 0; i < TRAFFIC; i++)
+        CHECK(tableMatch(&table, s_traffic[i]) == linearMatch(s_traffic[i]));
+}
+
+#define BENCH_LINES 5000000
+
+void bench_prefix_table(void)
+{
+    struct prefixTable table;
+    volatile long sum = 0;
+    long long start;
+    long long linearNs;
+    long long tableNs;
+    long i;
+
+    fillTable(&table);
+
+    start = host_test_now_ns();
+    for (i = 0; i < BENCH_LINES; i++)
+        sum += linearMatch(s_traffic[i % TRAFFIC]);
+    linearNs = host_test_now_ns() - start;
+
+    start = host_test_now_ns();
+    for (i = 0; i < BENCH_LINES; i++)
+        sum += tableMatch(&table, s_traffic[i % TRAFFIC]);
+    tableNs = host_test_now_ns() - start;
+
+    printf("  %zu prefixes, %zu lines of traffic: linear scan %.1f ns/line,"
+           " table %.1f ns/line\n", PREFIXES, TRAFFIC,
+           (double) linearNs / BENCH_LINES, (double) tableNs / BENCH_LINES);
+}
@@ -0,0 +1,393 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * A modem answering on the other end of a socketpair, for the tests that
+ * run the AT channel. Each command of a line, chained ones included, is
+ * answered from a reply table:
+ *
+ *   - a reply names the command it answers, eg "+CSQ" or "+CREG?", and
+ *     gives its intermediate lines, '\n' separated, and its final
+ *     response, "OK" when NULL;
+ *   - "+ECHO=<x>" is answered "+ECHO: <x>";
+ *   - any other command is answered "OK";
+ *   - a failing command ends the line, as on a real modem.
+ *
+ * A reply with a prompt sends "> " and takes the PDU up to Ctrl-Z first,
+ * ESC aborts it with "ERROR".
+ *
+ * With a latency set, each line is answered that long after it came in,
+ * also while the lines before it wait: the modem then takes pipelined
+ * commands, and no prompt.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "atchannel.h"
+#include "host_tests.h"
+
+#define MODEM_LINE_MAX (8 * 1024)
+#define MODEM_PIPELINE 16
+
+static struct {
+    int fd;
+    pthread_t tid;
+    const struct test_modem_reply *replies;
+    int delayUs;
+    int latencyUs;
+    int lines;
+    int unsolicited;
+    char lastUnsolicited[128];
+    char lastPdu[512];
+} s_modem;
+
+static pthread_mutex_t s_modemMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* The lines taken in and not answered yet, with a latency. */
+static struct {
+    pthread_t tid;
+    pthread_cond_t cond;
+    char lines[MODEM_PIPELINE][MODEM_LINE_MAX];
+    long long arrival[MODEM_PIPELINE];
+    int head;
+    int count;
+    int closed;
+} s_pipe = { .cond = PTHREAD_COND_INITIALIZER };
+
+static int s_latencyUs;
+
+static void modemWrite(const char *s)
+{
+    size_t len = strlen(s);
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(s_modem.fd, s, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        s += n;
+        len -= n;
+    }
+}
+
+static void modemWriteLine(const char *line)
+{
+    char buf[MODEM_LINE_MAX];
+
+    snprintf(buf, sizeof(buf), "\r\n%s\r\n", line);
+    modemWrite(buf);
+}
+
+static const struct test_modem_reply *findReply(const char *cmd)
+{
+    const struct test_modem_reply *r;
+
+    for (r = s_modem.replies; r != NULL && r->command != NULL; r++)
+        if (strcmp(r->command, cmd) == 0)
+            return r;
+    return NULL;
+}
+
+/* Reads the PDU of a prompt, up to Ctrl-Z. Returns 1 if ESC aborted it,
+   -1 on hangup. */
+static int readPdu(void)
+{
+    size_t len = 0;
+    char c;
+
+    for (;;) {
+        if (read(s_modem.fd, &c, 1) != 1)
+            return -1;
+        if (c == 0x1b)
+            return 1;
+        if (c == 0x1a)
+            break;
+        if (len + 1 < sizeof(s_modem.lastPdu))
+            s_modem.lastPdu[len++] = c;
+    }
+    s_modem.lastPdu[len] = '\0';
+    return 0;
+}
+
+/* Answers one command. Returns 1 if it failed, -1 on hangup. */
+static int answerCommand(const char *cmd)
+{
+    const struct test_modem_reply *r = findReply(cmd);
+    char buf[MODEM_LINE_MAX];
+    const char *p;
+    const char *end;
+
+    if (r == NULL) {
+        if (strncmp(cmd, "+ECHO=", 6) == 0) {
+            snprintf(buf, sizeof(buf), "+ECHO: %s", cmd + 6);
+            modemWriteLine(buf);
+        }
+        return 0;
+    }
+
+    if (r->delayMs > 0)
+        usleep(r->delayMs * 1000);
+
+    if (r->prompt) {
+        modemWrite("\r\n> ");
+        switch (readPdu()) {
+        case -1:
+            return -1;
+        case 1:
+            modemWriteLine("ERROR");
+            return 1;
+        }
+    }
+
+    for (p = r->lines; p != NULL && *p != '\0'; p = end) {
+        end = strchr(p, '\n');
+        if (end == NULL)
+            end = p + strlen(p);
+        snprintf(buf, sizeof(buf), "%.*s", (int) (end - p), p);
+        modemWriteLine(buf);
+        if (*end == '\n')
+            end++;
+    }
+
+    if (r->final != NULL && strcmp(r->final, "OK") != 0) {
+        modemWriteLine(r->final);
+        return 1;
+    }
+    return 0;
+}
+
+/* Answers a command line, "AT" and commands separated by ';'. */
+static int answerLine(char *line)
+{
+    char *cmd;
+    char *next;
+    int ret = 0;
+
+    if (strncasecmp(line, "AT", 2) != 0)
+        return 0;
+
+    pthread_mutex_lock(&s_modemMutex);
+    s_modem.lines++;
+    pthread_mutex_unlock(&s_modemMutex);
+
+    if (s_modem.delayUs > 0)
+        usleep(s_modem.delayUs);
+
+    for (cmd = line + 2; cmd != NULL && ret == 0; cmd = next) {
+        next = strchr(cmd, ';');
+        if (next != NULL)
+            *next++ = '\0';
+        if (*cmd != '\0')
+            ret = answerCommand(cmd);
+    }
+
+    if (ret < 0)
+        return -1;
+    if (ret == 0)
+        modemWriteLine("OK");
+    return 0;
+}
+
+/* Answers the lines taken in by modemLoop() once their latency is over. */
+static void *pipelineLoop(void *arg)
+{
+    char line[MODEM_LINE_MAX];
+    long long wait;
+
+    (void) arg;
+
+    pthread_mutex_lock(&s_modemMutex);
+    for (;;) {
+        while (s_pipe.count == 0 && !s_pipe.closed)
+            pthread_cond_wait(&s_pipe.cond, &s_modemMutex);
+        if (s_pipe.count == 0)
+            break;
+
+        strcpy(line, s_pipe.lines[s_pipe.head]);
+        wait = s_pipe.arrival[s_pipe.head] + s_modem.latencyUs * 1000LL
+            - host_test_now_ns();
+        s_pipe.head = (s_pipe.head + 1) % MODEM_PIPELINE;
+        s_pipe.count--;
+        pthread_cond_broadcast(&s_pipe.cond);
+        pthread_mutex_unlock(&s_modemMutex);
+
+        if (wait > 0)
+            usleep(wait / 1000);
+        answerLine(line);
+
+        pthread_mutex_lock(&s_modemMutex);
+    }
+    pthread_mutex_unlock(&s_modemMutex);
+    return NULL;
+}
+
+/* Queues a line for pipelineLoop(), waiting while the pipeline is full. */
+static void pipelineLine(const char *line, long long arrival)
+{
+    int tail;
+
+    pthread_mutex_lock(&s_modemMutex);
+    while (s_pipe.count == MODEM_PIPELINE)
+        pthread_cond_wait(&s_pipe.cond, &s_modemMutex);
+    tail = (s_pipe.head + s_pipe.count) % MODEM_PIPELINE;
+    snprintf(s_pipe.lines[tail], MODEM_LINE_MAX, "%s", line);
+    s_pipe.arrival[tail] = arrival;
+    s_pipe.count++;
+    pthread_cond_broadcast(&s_pipe.cond);
+    pthread_mutex_unlock(&s_modemMutex);
+}
+
+static void *modemLoop(void *arg)
+{
+    char line[MODEM_LINE_MAX];
+    size_t len = 0;
+    char buf[4096];
+    long long arrival;
+    ssize_t n;
+    ssize_t i;
+
+    (void) arg;
+
+    while ((n = read(s_modem.fd, buf, sizeof(buf))) > 0) {
+        arrival = host_test_now_ns();
+        for (i = 0; i < n; i++) {
+            if (buf[i] == '\r') {
+                line[len] = '\0';
+                len = 0;
+                if (s_modem.latencyUs > 0)
+                    pipelineLine(line, arrival);
+                else if (answerLine(line) < 0)
+                    return NULL;
+            } else if (buf[i] != '\n' && buf[i] != 0x1b
+                       && len + 1 < sizeof(line)) {
+                line[len++] = buf[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+static void onUnsolicited(const char *s, const char *sms_pdu)
+{
+    (void) sms_pdu;
+
+    pthread_mutex_lock(&s_modemMutex);
+    s_modem.unsolicited++;
+    snprintf(s_modem.lastUnsolicited, sizeof(s_modem.lastUnsolicited),
+             "%s", s);
+    pthread_mutex_unlock(&s_modemMutex);
+}
+
+struct channelRun {
+    int fd;
+    void (*fn)(void);
+};
+
+static void *channelThread(void *arg)
+{
+    struct channelRun *run = arg;
+
+    CHECK(at_open(run->fd, onUnsolicited) == 0);
+    at_make_default_channel();
+    at_set_timeout_msec(5000);
+    run->fn();
+    at_close();
+    return NULL;
+}
+
+void test_modem_run(const struct test_modem_reply *replies, int delayUs,
+                    void (*fn)(void))
+{
+    struct channelRun run;
+    pthread_t tid;
+    int fds[2];
+
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    memset(&s_modem, 0, sizeof(s_modem));
+    s_modem.fd = fds[1];
+    s_modem.replies = replies;
+    s_modem.delayUs = delayUs;
+    s_modem.latencyUs = s_latencyUs;
+    s_pipe.head = 0;
+    s_pipe.count = 0;
+    s_pipe.closed = 0;
+    if (s_modem.latencyUs > 0)
+        CHECK(pthread_create(&s_pipe.tid, NULL, pipelineLoop, NULL) == 0);
+    CHECK(pthread_create(&s_modem.tid, NULL, modemLoop, NULL) == 0);
+
+    run.fd = fds[0];
+    run.fn = fn;
+    CHECK(pthread_create(&tid, NULL, channelThread, &run) == 0);
+    pthread_join(tid, NULL);
+
+    /* at_close() hung up the channel end. */
+    pthread_join(s_modem.tid, NULL);
+    if (s_modem.latencyUs > 0) {
+        pthread_mutex_lock(&s_modemMutex);
+        s_pipe.closed = 1;
+        pthread_cond_broadcast(&s_pipe.cond);
+        pthread_mutex_unlock(&s_modemMutex);
+        pthread_join(s_pipe.tid, NULL);
+    }
+    close(fds[1]);
+}
+
+void test_modem_set_latency(int latencyUs)
+{
+    s_latencyUs = latencyUs;
+}
+
+void test_modem_unsolicited(const char *line)
+{
+    modemWriteLine(line);
+}
+
+int test_modem_lines(void)
+{
+    int n;
+
+    pthread_mutex_lock(&s_modemMutex);
+    n = s_modem.lines;
+    pthread_mutex_unlock(&s_modemMutex);
+    return n;
+}
+
+int test_modem_last_unsolicited(char *buf, size_t size)
+{
+    int n;
+
+    pthread_mutex_lock(&s_modemMutex);
+    n = s_modem.unsolicited;
+    snprintf(buf, size, "%s", s_modem.lastUnsolicited);
+    pthread_mutex_unlock(&s_modemMutex);
+    return n;
+}
+
+const char *test_modem_last_pdu(void)
+{
+    return s_modem.lastPdu;
+}
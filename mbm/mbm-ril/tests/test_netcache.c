@@ -0,0 +1,196 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * The network state cache of u300-ril-network.c, on the RIL on the fake
+ * modem. The unsolicited results are fed to the cache as the reader
+ * thread does, onNetworkStateUnsolicited() before they are dispatched.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <telephony/ril.h>
+
+#include "u300-ril-fakemodem.h"
+#include "u300-ril-network.h"
+#include "host_tests.h"
+
+struct registration {
+    char lac[16];
+    char cid[16];
+};
+
+static void keepRegistration(const void *response, size_t len, void *arg)
+{
+    char * const *strings = response;
+    struct registration *reg = arg;
+
+    (void) len;
+    snprintf(reg->lac, sizeof(reg->lac), "%s",
+             strings[1] != NULL ? strings[1] : "");
+    snprintf(reg->cid, sizeof(reg->cid), "%s",
+             strings[2] != NULL ? strings[2] : "");
+}
+
+/* Returns the AT commands the request sent. */
+static int request(int req, void (*inspect)(const void *, size_t, void *),
+                   void *arg)
+{
+    unsigned int commands = fakeModemCommandCount();
+
+    CHECK(ril_test_request(req, NULL, 0, inspect, arg) == RIL_E_SUCCESS);
+    return fakeModemCommandCount() - commands;
+}
+
+void test_ril_network_cache(void)
+{
+    struct registration reg;
+
+    CHECK(ril_test_start() == 0);
+
+    invalidateNetworkCache();
+    CHECK(request(RIL_REQUEST_VOICE_REGISTRATION_STATE, NULL, NULL) > 0);
+    CHECK(request(RIL_REQUEST_VOICE_REGISTRATION_STATE, NULL, NULL) == 0);
+    CHECK(request(RIL_REQUEST_OPERATOR, NULL, NULL) > 0);
+    CHECK(request(RIL_REQUEST_OPERATOR, NULL, NULL) == 0);
+
+    /*
+     * A registration result is the answer, only the access technology
+     * is asked for again. A new cell drops the operator.
+     */
+    onNetworkStateUnsolicited("+CREG: 1,\"00C3\",\"0000ABCD\"");
+    CHECK(request(RIL_REQUEST_VOICE_REGISTRATION_STATE, keepRegistration,
+                  &reg) == 1);
+    CHECK(strcmp(reg.lac, "00c3") == 0);
+    CHECK(strcmp(reg.cid, "0000abcd") == 0);
+    CHECK(request(RIL_REQUEST_OPERATOR, NULL, NULL) > 0);
+
+    onNetworkStateUnsolicited("+CGREG: 1,\"00C3\",\"0000ABCD\",2");
+    CHECK(request(RIL_REQUEST_DATA_REGISTRATION_STATE, keepRegistration,
+                  &reg) == 1);
+    CHECK(strcmp(reg.lac, "00c3") == 0);
+
+    /* A denied registration has its reason asked for. */
+    onNetworkStateUnsolicited("+CREG: 3");
+    CHECK(request(RIL_REQUEST_VOICE_REGISTRATION_STATE, keepRegistration,
+                  &reg) > 0);
+    CHECK(strcmp(reg.lac, "1a2b") == 0);
+
+    onNetworkStateUnsolicited("*E2REG: 1");
+    CHECK(request(RIL_REQUEST_DATA_REGISTRATION_STATE, NULL, NULL) > 0);
+
+    request(RIL_REQUEST_SIGNAL_STRENGTH, NULL, NULL);
+    CHECK(request(RIL_REQUEST_SIGNAL_STRENGTH, NULL, NULL) == 0);
+    onNetworkStateUnsolicited("+CIEV: 2,3");
+    CHECK(request(RIL_REQUEST_SIGNAL_STRENGTH, NULL, NULL) > 0);
+
+    invalidateNetworkCache();
+}
+
+/*
+ * A scripted minute of a registered phone: signal changes, the framework
+ * polls, a cell change and the registration reports that come with it.
+ * An entry is either an unsolicited result or a request.
+ */
+static const struct {
+    const char *unsol;
+    int request;
+} s_trace[] = {
+    { "+CIEV: 2,3", 0 },
+    { NULL, RIL_REQUEST_SIGNAL_STRENGTH },
+    { NULL, RIL_REQUEST_SIGNAL_STRENGTH },
+    { "+CREG: 1,\"1A2B\",\"0003C4D5\"", 0 },
+    { NULL, RIL_REQUEST_VOICE_REGISTRATION_STATE },
+    { NULL, RIL_REQUEST_DATA_REGISTRATION_STATE },
+    { NULL, RIL_REQUEST_OPERATOR },
+    { "+CGREG: 1,\"1A2B\",\"0003C4D5\",2", 0 },
+    { NULL, RIL_REQUEST_DATA_REGISTRATION_STATE },
+    { "+CIEV: 2,4", 0 },
+    { NULL, RIL_REQUEST_SIGNAL_STRENGTH },
+    { "+CREG: 1,\"1A2C\",\"0003C4D6\"", 0 },
+    { "+CGREG: 1,\"1A2C\",\"0003C4D6\",2", 0 },
+    { NULL, RIL_REQUEST_VOICE_REGISTRATION_STATE },
+    { NULL, RIL_REQUEST_DATA_REGISTRATION_STATE },
+    { NULL, RIL_REQUEST_OPERATOR },
+    { "*E2REG: 1", 0 },
+    { NULL, RIL_REQUEST_VOICE_REGISTRATION_STATE },
+    { NULL, RIL_REQUEST_DATA_REGISTRATION_STATE },
+    { NULL, RIL_REQUEST_SIGNAL_STRENGTH },
+    { NULL, RIL_REQUEST_VOICE_REGISTRATION_STATE },
+    { NULL, RIL_REQUEST_OPERATOR },
+};
+
+#define TRACE_ROUNDS    200
+#define TRACE_ENTRIES   (sizeof(s_trace) / sizeof(s_trace[0]))
+
+static int compareLongLong(const void *a, const void *b)
+{
+    long long x = *(const long long *) a;
+    long long y = *(const long long *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Replays the trace, with the cache dropped before each request if cold. */
+static void replayTrace(const char *name, int cold)
+{
+    static long long latency[TRACE_ROUNDS * TRACE_ENTRIES];
+    unsigned int commands = fakeModemCommandCount();
+    long long start;
+    int n = 0;
+    int round;
+    size_t i;
+
+    invalidateNetworkCache();
+    start = host_test_now_ns();
+    for (round = 0; round < TRACE_ROUNDS; round++) {
+        for (i = 0; i < TRACE_ENTRIES; i++) {
+            long long t;
+
+            if (s_trace[i].unsol != NULL) {
+                onNetworkStateUnsolicited(s_trace[i].unsol);
+                continue;
+            }
+            if (cold)
+                invalidateNetworkCache();
+            t = host_test_now_ns();
+            CHECK(ril_test_request(s_trace[i].request, NULL, 0, NULL, NULL)
+                  == RIL_E_SUCCESS);
+            latency[n++] = host_test_now_ns() - t;
+        }
+    }
+    commands = fakeModemCommandCount() - commands;
+
+    qsort(latency, n, sizeof(latency[0]), compareLongLong);
+    printf("  %-8s %5d requests, %5u AT commands (%.2f per request),"
+           " p50 %.1f us, p99 %.1f us, %.0f ms\n", name, n, commands,
+           (double) commands / n, latency[n / 2] / 1000.0,
+           latency[n * 99 / 100] / 1000.0,
+           (host_test_now_ns() - start) / 1e6);
+}
+
+void bench_ril_network_cache(void)
+{
+    CHECK(ril_test_start() == 0);
+
+    replayTrace("no cache", 1);
+    replayTrace("cache", 0);
+    invalidateNetworkCache();
+}
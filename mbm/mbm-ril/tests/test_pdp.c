@@ -0,0 +1,257 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * The data call setup of u300-ril-pdp.c, on the RIL on the fake modem.
+ * *E2NAP is fed to onConnectionStateChanged() as the reader thread
+ * does, after the delay the network takes to activate the context. The
+ * network interface calls of net-utils.c are stubbed out here.
+ */
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <telephony/ril.h>
+
+#include "net-utils.h"
+#include "u300-ril-pdp.h"
+#include "host_tests.h"
+
+#define E2NAP_REPEAT_MSEC   20
+
+static int s_configured;
+
+int ifc_init(void)
+{
+    return 0;
+}
+
+void ifc_close(void)
+{
+}
+
+int ifc_down(const char *name)
+{
+    (void) name;
+    return 0;
+}
+
+int ifc_configure(const char *ifname, in_addr_t address, in_addr_t gateway)
+{
+    (void) ifname; (void) address; (void) gateway;
+    __sync_fetch_and_add(&s_configured, 1);
+    return 0;
+}
+
+/*
+ * Sends line delayMsec after the start, again every E2NAP_REPEAT_MSEC
+ * until stopped, in case the first came before the setup was sent.
+ */
+struct e2nap {
+    pthread_t tid;
+    const char *line;
+    int delayMsec;
+    int stop;
+    long long sentNs;           /* When first sent. */
+};
+
+static void *e2napThread(void *arg)
+{
+    struct e2nap *e = arg;
+    char line[32];
+
+    usleep(e->delayMsec * 1000);
+    while (!__sync_fetch_and_add(&e->stop, 0)) {
+        /* Tokenized in place, as the reader thread's line buffer. */
+        snprintf(line, sizeof(line), "%s", e->line);
+        if (e->sentNs == 0)
+            e->sentNs = host_test_now_ns();
+        onConnectionStateChanged(line);
+        usleep(E2NAP_REPEAT_MSEC * 1000);
+    }
+    return NULL;
+}
+
+static void startE2nap(struct e2nap *e, const char *line, int delayMsec)
+{
+    e->line = line;
+    e->delayMsec = delayMsec;
+    e->stop = 0;
+    e->sentNs = 0;
+    CHECK(pthread_create(&e->tid, NULL, e2napThread, e) == 0);
+}
+
+static void stopE2nap(struct e2nap *e)
+{
+    __sync_fetch_and_add(&e->stop, 1);
+    pthread_join(e->tid, NULL);
+}
+
+struct setup {
+    pthread_t tid;
+    int err;
+    int status;
+    long long ns;
+    long long doneNs;
+    char addresses[32];
+    char gateways[32];
+    char dnses[32];
+};
+
+static void keepSetup(const void *response, size_t len, void *arg)
+{
+    const RIL_Data_Call_Response_v6 *r = response;
+    struct setup *s = arg;
+
+    CHECK(len == sizeof(*r));
+    s->status = r->status;
+    snprintf(s->addresses, sizeof(s->addresses), "%s",
+             r->addresses != NULL ? r->addresses : "");
+    snprintf(s->gateways, sizeof(s->gateways), "%s",
+             r->gateways != NULL ? r->gateways : "");
+    snprintf(s->dnses, sizeof(s->dnses), "%s",
+             r->dnses != NULL ? r->dnses : "");
+}
+
+static int setupDataCall(struct setup *s)
+{
+    static const char *data[] = { "1", "0", "internet", "", "", "0", "IP" };
+    long long start = host_test_now_ns();
+
+    memset(s->addresses, 0, sizeof(s->addresses));
+    s->status = -1;
+    s->err = ril_test_request(RIL_REQUEST_SETUP_DATA_CALL, (void *) data,
+                              sizeof(data), keepSetup, s);
+    s->doneNs = host_test_now_ns();
+    s->ns = s->doneNs - start;
+    return s->err;
+}
+
+static void *setupThread(void *arg)
+{
+    setupDataCall(arg);
+    return NULL;
+}
+
+static int deactivateDataCall(void)
+{
+    static const char *data[] = { "1", "0" };
+
+    return ril_test_request(RIL_REQUEST_DEACTIVATE_DATA_CALL, (void *) data,
+                            sizeof(data), NULL, NULL);
+}
+
+void test_ril_pdp(void)
+{
+    struct e2nap e;
+    struct setup s;
+    struct setup busy;
+    long long start;
+    int configured;
+
+    CHECK(ril_test_start() == 0);
+
+    /* Completed when *E2NAP reports the context up, with its addresses. */
+    configured = s_configured;
+    startE2nap(&e, "*E2NAP: 1", 50);
+    CHECK(setupDataCall(&s) == RIL_E_SUCCESS);
+    stopE2nap(&e);
+    CHECK(s.status == 0);
+    CHECK(strcmp(s.addresses, "10.0.0.2") == 0);
+    CHECK(strcmp(s.gateways, "10.0.0.1") == 0);
+    CHECK(strcmp(s.dnses, "10.0.0.3") == 0);
+    CHECK(e.sentNs != 0 && s.doneNs >= e.sentNs);
+    CHECK(s_configured == configured + 1);
+    CHECK(deactivateDataCall() == RIL_E_SUCCESS);
+
+    /* The queue serves other requests, and refuses a second setup. */
+    startE2nap(&e, "*E2NAP: 1", 300);
+    CHECK(pthread_create(&s.tid, NULL, setupThread, &s) == 0);
+    usleep(100 * 1000);
+    start = host_test_now_ns();
+    CHECK(ril_test_request(RIL_REQUEST_SIGNAL_STRENGTH, NULL, 0, NULL, NULL)
+          == RIL_E_SUCCESS);
+    CHECK(host_test_now_ns() - start < 150 * 1000000LL);
+    CHECK(setupDataCall(&busy) == RIL_E_GENERIC_FAILURE);
+    pthread_join(s.tid, NULL);
+    stopE2nap(&e);
+    CHECK(s.err == RIL_E_SUCCESS);
+    CHECK(e.sentNs != 0 && s.doneNs >= e.sentNs);
+    CHECK(deactivateDataCall() == RIL_E_SUCCESS);
+
+    /* A rejected activation returns its cause. */
+    startE2nap(&e, "*E2NAP: 0,33", 20);
+    CHECK(setupDataCall(&s) == RIL_E_SUCCESS);
+    stopE2nap(&e);
+    CHECK(s.status == 33);
+
+    /* A deactivation cancels a setup still waiting for *E2NAP. */
+    CHECK(pthread_create(&s.tid, NULL, setupThread, &s) == 0);
+    usleep(100 * 1000);
+    CHECK(deactivateDataCall() == RIL_E_SUCCESS);
+    pthread_join(s.tid, NULL);
+    CHECK(s.err == RIL_E_GENERIC_FAILURE);
+}
+
+/*
+ * How long a setup takes over the time *E2NAP takes to come, and how
+ * late a request queued behind it completes.
+ */
+void bench_ril_pdp(void)
+{
+    static const int delays[] = { 10, 75, 150, 420 };
+    struct e2nap e;
+    struct setup s;
+    size_t i;
+    int k;
+
+    CHECK(ril_test_start() == 0);
+
+    for (i = 0; i < sizeof(delays) / sizeof(delays[0]); i++) {
+        long long total = 0;
+        long long max = 0;
+        long long behind = 0;
+
+        for (k = 0; k < 4; k++) {
+            long long start;
+
+            startE2nap(&e, "*E2NAP: 1", delays[i]);
+            CHECK(pthread_create(&s.tid, NULL, setupThread, &s) == 0);
+            usleep(2 * 1000);
+            start = host_test_now_ns();
+            CHECK(ril_test_request(RIL_REQUEST_SIGNAL_STRENGTH, NULL, 0,
+                                   NULL, NULL) == RIL_E_SUCCESS);
+            behind += host_test_now_ns() - start;
+            pthread_join(s.tid, NULL);
+            stopE2nap(&e);
+            CHECK(s.err == RIL_E_SUCCESS);
+
+            total += s.ns;
+            if (s.ns > max)
+                max = s.ns;
+            CHECK(deactivateDataCall() == RIL_E_SUCCESS);
+        }
+        printf("  *E2NAP after %3d ms: setup mean %6.1f ms, max %6.1f ms,"
+               " request behind it %5.2f ms\n", delays[i],
+               total / 4 / 1e6, max / 1e6, behind / 4 / 1e6);
+    }
+}
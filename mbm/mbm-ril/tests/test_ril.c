@@ -0,0 +1,442 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * The whole RIL on the fake modem of u300-ril-fakemodem.c. RIL_Init()
+ * is called once per process, with both channels on the fake modem, and
+ * requests go through onRequest() as libril sends them.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <telephony/ril.h>
+
+#include "u300-ril-fakemodem.h"
+#include "u300-ril-network.h"
+#include "host_tests.h"
+
+#define RIL_TEST_TIMEOUT_SEC    10
+#define RIL_TEST_MAX_UNSOL      64
+
+static const char s_rilRules[] =
+    "delay 0\n"
+    "cmd AT+CFUN? 0 +CFUN: 1|OK\n"
+    "cmd AT+CPIN? 0 +CPIN: READY|OK\n"
+    "cmd AT+CPMS? 0 +CPMS: \"SM\",0,30,\"SM\",0,30,\"SM\",0,30|OK\n"
+    "cmd AT+CPMS= 0 +CPMS: 0,30,0,30,0,30|OK\n"
+    "cmd AT+CSQ 0 +CSQ: 20,99|OK\n"
+    "cmd AT+CREG? 0 +CREG: 2,1,\"1A2B\",\"0003C4D5\"|OK\n"
+    "cmd AT+CGREG? 0 +CGREG: 2,1,\"1A2B\",\"0003C4D5\"|OK\n"
+    "cmd AT+COPS? 0 +COPS: 0,2,\"24001\"|OK\n"
+    "cmd AT*ERINFO? 0 *ERINFO: 0,0,2|OK\n"
+    "cmd AT+CMGS= 0 >|+CMGS: 12|OK\n"
+    "cmd AT*E2IPCFG? 0 *E2IPCFG: (1,\"10.0.0.2\")(2,\"10.0.0.1\")"
+        "(3,\"10.0.0.3\")|OK\n"
+    "cmd AT*ENAP? 0 *ENAP: 0|OK\n";
+
+struct rilCall {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int done;
+    RIL_Errno err;
+    void (*inspect)(const void *response, size_t len, void *arg);
+    void *arg;
+};
+
+static const RIL_RadioFunctions *s_funcs;
+static pthread_once_t s_startOnce = PTHREAD_ONCE_INIT;
+static int s_started;
+
+static pthread_mutex_t s_unsolMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    int unsol;
+    int count;
+} s_unsols[RIL_TEST_MAX_UNSOL];
+
+/* From libril, which the test does not link. */
+const char *requestToString(int request)
+{
+    static __thread char buf[16];
+
+    snprintf(buf, sizeof(buf), "<%d>", request);
+    return buf;
+}
+
+static void onRequestComplete(RIL_Token t, RIL_Errno e, void *response,
+                              size_t responselen)
+{
+    struct rilCall *call = (struct rilCall *) t;
+
+    if (call == NULL)
+        return;
+
+    if (e == RIL_E_SUCCESS && call->inspect != NULL)
+        call->inspect(response, responselen, call->arg);
+
+    pthread_mutex_lock(&call->mutex);
+    call->err = e;
+    call->done = 1;
+    pthread_cond_signal(&call->cond);
+    pthread_mutex_unlock(&call->mutex);
+}
+
+static void onUnsolicitedResponse(int unsol, const void *data, size_t datalen)
+{
+    int i;
+
+    (void) data; (void) datalen;
+
+    pthread_mutex_lock(&s_unsolMutex);
+    for (i = 0; i < RIL_TEST_MAX_UNSOL; i++) {
+        if (s_unsols[i].count == 0)
+            s_unsols[i].unsol = unsol;
+        if (s_unsols[i].unsol == unsol) {
+            s_unsols[i].count++;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_unsolMutex);
+}
+
+/* Not used by the RIL, which runs its own timers. */
+static void requestTimedCallback(RIL_TimedCallback callback, void *param,
+                                 const struct timeval *relativeTime)
+{
+    (void) callback; (void) param; (void) relativeTime;
+}
+
+static const struct RIL_Env s_env = {
+    onRequestComplete,
+    onUnsolicitedResponse,
+    requestTimedCallback
+};
+
+static void startRil(void)
+{
+    char path[] = "/tmp/mbm_ril_XXXXXX";
+    /* Kept by RIL_Init(), as rild keeps its arguments. */
+    static char device[sizeof(FAKE_MODEM_PREFIX) + sizeof(path)];
+    static char *argv[] = { "rild", "-d", device, "-x", device, NULL };
+    FILE *rules;
+    int i;
+    int fd;
+
+    fd = mkstemp(path);
+    if (fd < 0)
+        return;
+    rules = fdopen(fd, "w");
+    if (rules == NULL) {
+        close(fd);
+        return;
+    }
+    fputs(s_rilRules, rules);
+    test_sim_card_rules(rules);
+    if (fclose(rules) != 0)
+        return;
+    snprintf(device, sizeof(device), "%s%s", FAKE_MODEM_PREFIX, path);
+
+    s_funcs = RIL_Init(&s_env, 5, argv);
+    if (s_funcs == NULL)
+        return;
+
+    for (i = 0; i < RIL_TEST_TIMEOUT_SEC * 10; i++) {
+        if (s_funcs->onStateRequest() == RADIO_STATE_SIM_READY) {
+            s_started = 1;
+            break;
+        }
+        usleep(100000);
+    }
+
+    /* Both fake modems have their rules by now. */
+    unlink(path);
+}
+
+int ril_test_start(void)
+{
+    pthread_once(&s_startOnce, startRil);
+    return s_started ? 0 : -1;
+}
+
+int ril_test_request(int request, void *data, size_t datalen,
+                     void (*inspect)(const void *response, size_t len,
+                                     void *arg),
+                     void *arg)
+{
+    struct rilCall call;
+    struct timespec ts;
+    int err = 0;
+
+    if (ril_test_start() < 0)
+        return -1;
+
+    memset(&call, 0, sizeof(call));
+    pthread_mutex_init(&call.mutex, NULL);
+    pthread_cond_init(&call.cond, NULL);
+    call.inspect = inspect;
+    call.arg = arg;
+
+    s_funcs->onRequest(request, data, datalen, (RIL_Token) &call);
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += RIL_TEST_TIMEOUT_SEC;
+    pthread_mutex_lock(&call.mutex);
+    while (!call.done && err != ETIMEDOUT)
+        err = pthread_cond_timedwait(&call.cond, &call.mutex, &ts);
+    pthread_mutex_unlock(&call.mutex);
+
+    /* The call is on the stack, a late completion would write to it. */
+    if (!call.done) {
+        fprintf(stderr, "request %d not completed, giving up\n", request);
+        abort();
+    }
+
+    pthread_cond_destroy(&call.cond);
+    pthread_mutex_destroy(&call.mutex);
+    return call.err;
+}
+
+int ril_test_unsolicited(int unsol)
+{
+    int count = 0;
+    int i;
+
+    pthread_mutex_lock(&s_unsolMutex);
+    for (i = 0; i < RIL_TEST_MAX_UNSOL && s_unsols[i].count > 0; i++)
+        if (s_unsols[i].unsol == unsol)
+            count = s_unsols[i].count;
+    pthread_mutex_unlock(&s_unsolMutex);
+    return count;
+}
+
+static void checkSignal(const void *response, size_t len, void *arg)
+{
+    const RIL_SignalStrength_v6 *s = response;
+
+    (void) arg;
+    CHECK(len == sizeof(*s));
+    CHECK(s->GW_SignalStrength.signalStrength == 20);
+    CHECK(s->GW_SignalStrength.bitErrorRate == 99);
+}
+
+static void checkRegistration(const void *response, size_t len, void *arg)
+{
+    char * const *strings = response;
+
+    (void) arg;
+    CHECK(len >= 4 * sizeof(char *));
+    CHECK(strings[0] != NULL && strcmp(strings[0], "1") == 0);
+    CHECK(strings[1] != NULL && strcmp(strings[1], "1a2b") == 0);
+    CHECK(strings[2] != NULL && strcmp(strings[2], "0003c4d5") == 0);
+}
+
+static void checkOperator(const void *response, size_t len, void *arg)
+{
+    char * const *strings = response;
+
+    (void) arg;
+    CHECK(len == 3 * sizeof(char *));
+    CHECK(strings[2] != NULL && strcmp(strings[2], "24001") == 0);
+}
+
+static void checkSimStatus(const void *response, size_t len, void *arg)
+{
+    const RIL_CardStatus_v6 *status = response;
+
+    (void) arg;
+    CHECK(len == sizeof(*status));
+    CHECK(status->card_state == RIL_CARDSTATE_PRESENT);
+    CHECK(status->num_applications >= 1);
+    CHECK(status->applications[0].app_state == RIL_APPSTATE_READY);
+}
+
+static void checkSms(const void *response, size_t len, void *arg)
+{
+    const RIL_SMS_Response *sms = response;
+
+    (void) arg;
+    CHECK(len == sizeof(*sms));
+    CHECK(sms->messageRef == 12);
+}
+
+static const char *s_smsArgs[] = {
+    NULL, "1100038100F00000FF05E8329BFD06"
+};
+
+void test_ril_requests(void)
+{
+    unsigned int commands;
+    int screen;
+
+    CHECK(ril_test_start() == 0);
+    if (!s_started)
+        return;
+
+    CHECK(ril_test_request(RIL_REQUEST_SIGNAL_STRENGTH, NULL, 0,
+                           checkSignal, NULL) == RIL_E_SUCCESS);
+    CHECK(ril_test_request(RIL_REQUEST_VOICE_REGISTRATION_STATE, NULL, 0,
+                           checkRegistration, NULL) == RIL_E_SUCCESS);
+    CHECK(ril_test_request(RIL_REQUEST_DATA_REGISTRATION_STATE, NULL, 0,
+                           checkRegistration, NULL) == RIL_E_SUCCESS);
+    CHECK(ril_test_request(RIL_REQUEST_OPERATOR, NULL, 0,
+                           checkOperator, NULL) == RIL_E_SUCCESS);
+    CHECK(ril_test_request(RIL_REQUEST_GET_SIM_STATUS, NULL, 0,
+                           checkSimStatus, NULL) == RIL_E_SUCCESS);
+    CHECK(ril_test_request(RIL_REQUEST_SEND_SMS, s_smsArgs,
+                           sizeof(s_smsArgs), checkSms, NULL)
+          == RIL_E_SUCCESS);
+
+    /* Asked again at once, the signal strength comes from the cache. */
+    commands = fakeModemCommandCount();
+    CHECK(ril_test_request(RIL_REQUEST_SIGNAL_STRENGTH, NULL, 0,
+                           checkSignal, NULL) == RIL_E_SUCCESS);
+    CHECK(fakeModemCommandCount() == commands);
+
+    screen = 1;
+    CHECK(ril_test_request(RIL_REQUEST_SCREEN_STATE, &screen, sizeof(screen),
+                           NULL, NULL) == RIL_E_SUCCESS);
+}
+
+/*
+ * Request mixes as the framework sends them. The registration and
+ * signal polls come in rounds after a network change, which drops the
+ * cached network state, the SIM status and SMS now and then.
+ */
+enum {
+    MIX_SIGNAL,
+    MIX_VOICE_REG,
+    MIX_DATA_REG,
+    MIX_OPERATOR,
+    MIX_SIM_STATUS,
+    MIX_SEND_SMS,
+    MIX_REQUESTS
+};
+
+static const struct {
+    const char *name;
+    int request;
+    void *data;
+    size_t datalen;
+} s_mixRequests[MIX_REQUESTS] = {
+    { "SIGNAL_STRENGTH", RIL_REQUEST_SIGNAL_STRENGTH, NULL, 0 },
+    { "VOICE_REG_STATE", RIL_REQUEST_VOICE_REGISTRATION_STATE, NULL, 0 },
+    { "DATA_REG_STATE", RIL_REQUEST_DATA_REGISTRATION_STATE, NULL, 0 },
+    { "OPERATOR", RIL_REQUEST_OPERATOR, NULL, 0 },
+    { "GET_SIM_STATUS", RIL_REQUEST_GET_SIM_STATUS, NULL, 0 },
+    { "SEND_SMS", RIL_REQUEST_SEND_SMS, s_smsArgs, sizeof(s_smsArgs) },
+};
+
+static const struct {
+    const char *name;
+    int weights[MIX_REQUESTS];
+    int changeEvery;            /* requests between network changes */
+} s_mixes[] = {
+    { "network poll", { 40, 20, 20, 20, 0, 0 }, 4 },
+    { "sim and sms", { 10, 5, 5, 5, 40, 35 }, 0 },
+    { "all", { 20, 15, 15, 15, 20, 15 }, 16 },
+};
+
+#define MIX_ROUNDS 2000
+
+static int compareLongLong(const void *a, const void *b)
+{
+    long long x = *(const long long *) a;
+    long long y = *(const long long *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void runMix(int mix)
+{
+    static long long latency[MIX_REQUESTS][MIX_ROUNDS];
+    unsigned long commands[MIX_REQUESTS];
+    long allocs[MIX_REQUESTS];
+    int count[MIX_REQUESTS];
+    unsigned int seed = 1;
+    int total = 0;
+    int i;
+    int r;
+
+    memset(commands, 0, sizeof(commands));
+    memset(allocs, 0, sizeof(allocs));
+    memset(count, 0, sizeof(count));
+
+    for (r = 0; r < MIX_REQUESTS; r++)
+        total += s_mixes[mix].weights[r];
+
+    for (i = 0; i < MIX_ROUNDS; i++) {
+        unsigned int commandsBefore;
+        long allocsBefore;
+        long long start;
+        int pick = rand_r(&seed) % total;
+
+        for (r = 0; pick >= s_mixes[mix].weights[r]; r++)
+            pick -= s_mixes[mix].weights[r];
+
+        if (s_mixes[mix].changeEvery > 0 && i % s_mixes[mix].changeEvery == 0)
+            invalidateNetworkCache();
+
+        commandsBefore = fakeModemCommandCount();
+        allocsBefore = host_test_allocs();
+        start = host_test_now_ns();
+        CHECK(ril_test_request(s_mixRequests[r].request, s_mixRequests[r].data,
+                               s_mixRequests[r].datalen, NULL, NULL)
+              == RIL_E_SUCCESS);
+        latency[r][count[r]++] = host_test_now_ns() - start;
+        allocs[r] += host_test_allocs() - allocsBefore;
+        commands[r] += fakeModemCommandCount() - commandsBefore;
+    }
+
+    printf("  %s mix, %d requests", s_mixes[mix].name, MIX_ROUNDS);
+    if (s_mixes[mix].changeEvery > 0)
+        printf(", a network change every %d", s_mixes[mix].changeEvery);
+    printf(":\n");
+    printf("    %-16s %6s %10s %10s %8s %8s\n", "request", "count",
+           "p50 us", "p99 us", "AT/req", "alloc/req");
+    for (r = 0; r < MIX_REQUESTS; r++) {
+        int n = count[r];
+
+        if (n == 0)
+            continue;
+        qsort(latency[r], n, sizeof(latency[r][0]), compareLongLong);
+        printf("    %-16s %6d %10.1f %10.1f %8.2f ", s_mixRequests[r].name, n,
+               latency[r][n / 2] / 1000.0, latency[r][n * 99 / 100] / 1000.0,
+               (double) commands[r] / n);
+        if (host_test_allocs() < 0)
+            printf("%8s\n", "-");
+        else
+            printf("%8.1f\n", (double) allocs[r] / n);
+    }
+}
+
+void bench_ril_request_mix(void)
+{
+    size_t mix;
+
+    CHECK(ril_test_start() == 0);
+    if (!s_started)
+        return;
+
+    for (mix = 0; mix < sizeof(s_mixes) / sizeof(s_mixes[0]); mix++)
+        runMix(mix);
+}
@@ -0,0 +1,253 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * The SIM file cache of u300-ril-sim.c, on the RIL on the fake modem.
+ * The fake modem answers AT+CUAD with a bare "OK", as a legacy SIM
+ * does, and +CRSM with the files the framework reads at boot. All
+ * records of a file read the same.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <telephony/ril.h>
+
+#include "u300-ril-fakemodem.h"
+#include "u300-ril-sim.h"
+#include "host_tests.h"
+
+#define SIM_COMMAND_MSEC    25      /* A +CRSM on a real modem, about. */
+#define SIM_READ_AHEAD      8       /* SIM_READ_AHEAD_RECORDS */
+
+static const struct {
+    int fileid;
+    const char *path;
+    int recordSize;             /* 0 for a transparent file */
+    int size;                   /* records, or bytes */
+} s_files[] = {
+    { 0x2FE2, "3F00", 0, 10 },          /* ICCID */
+    { 0x6FAD, "3F007F20", 0, 4 },       /* AD */
+    { 0x6F46, "3F007F20", 0, 17 },      /* SPN */
+    { 0x6F07, "3F007F20", 0, 9 },       /* IMSI */
+    { 0x6F38, "3F007F20", 0, 8 },       /* SST */
+    { 0x6F60, "3F007F20", 0, 200 },     /* PLMNwAcT */
+    { 0x6F40, "3F007F10", 28, 2 },      /* MSISDN */
+    { 0x6F3B, "3F007F10", 28, 10 },     /* FDN */
+    { 0x6F3C, "3F007F10", 176, 30 },    /* SMS */
+    { 0x6F3A, "3F007F10", 30, 250 },    /* ADN */
+    { 0x6F4A, "3F007F10", 13, 10 },     /* EXT1 */
+};
+
+#define SIM_FILES   (sizeof(s_files) / sizeof(s_files[0]))
+
+#define SIM_FILE_SPN    2
+#define SIM_FILE_ADN    9
+#define SIM_FILE_MAX    512     /* hex digits of a record or file */
+
+/* The content of a record, or of a transparent file, in hex. */
+static void fileContent(size_t file, char *out)
+{
+    int len = s_files[file].recordSize ? s_files[file].recordSize
+                                       : s_files[file].size;
+    int i;
+
+    for (i = 0; i < len; i++)
+        sprintf(&out[i * 2], "%02X", (s_files[file].fileid + i) & 0xff);
+}
+
+void test_sim_card_rules(FILE *f)
+{
+    char content[SIM_FILE_MAX + 1];
+    size_t i;
+
+    fprintf(f, "cmd AT+CRSM=214, 0 +CRSM: 144,0|OK\n");
+    fprintf(f, "cmd AT+CRSM=220, 0 +CRSM: 144,0|OK\n");
+
+    for (i = 0; i < SIM_FILES; i++) {
+        int linear = s_files[i].recordSize != 0;
+        int size = linear ? s_files[i].recordSize * s_files[i].size
+                          : s_files[i].size;
+
+        /* The TS 51.011 GET RESPONSE of an EF. */
+        fprintf(f, "cmd AT+CRSM=192,%d, 0 +CRSM: 144,0,"
+                "\"0000%04X%04X04000000000002%02X%02X\"|OK\n",
+                s_files[i].fileid, size, s_files[i].fileid, linear,
+                s_files[i].recordSize);
+
+        fileContent(i, content);
+        fprintf(f, "cmd AT+CRSM=%d,%d, 0 +CRSM: 144,0,\"%s\"|OK\n",
+                linear ? 178 : 176, s_files[i].fileid, content);
+    }
+}
+
+static void checkResponse(const void *response, size_t len, void *arg)
+{
+    const RIL_SIM_IO_Response *r = response;
+    const char *expect = arg;
+
+    CHECK(len == sizeof(*r));
+    CHECK(r->sw1 == 0x90 && r->sw2 == 0x00);
+    CHECK(r->simResponse != NULL && strcasecmp(r->simResponse, expect) == 0);
+}
+
+/* Sends the SIM_IO, returns the AT commands it took. */
+static int simIO(int command, size_t file, int p1, int p2, int p3,
+                 char *data, char *expect)
+{
+    unsigned int commands = fakeModemCommandCount();
+    RIL_SIM_IO_v6 io;
+
+    memset(&io, 0, sizeof(io));
+    io.command = command;
+    io.fileid = s_files[file].fileid;
+    io.path = (char *) s_files[file].path;
+    io.p1 = p1;
+    io.p2 = p2;
+    io.p3 = p3;
+    io.data = data;
+
+    CHECK(ril_test_request(RIL_REQUEST_SIM_IO, &io, sizeof(io),
+                           expect != NULL ? checkResponse : NULL, expect)
+          == RIL_E_SUCCESS);
+    return fakeModemCommandCount() - commands;
+}
+
+/*
+ * Reads the files as the framework does at boot, GET RESPONSE then the
+ * records one by one or the whole transparent file, with the cache
+ * dropped before each request if cold. Returns the AT commands.
+ */
+static int loadFiles(int cold)
+{
+    char content[SIM_FILE_MAX + 1];
+    int commands = 0;
+    size_t i;
+    int r;
+
+    for (i = 0; i < SIM_FILES; i++) {
+        if (cold)
+            invalidateSimCache();
+        commands += simIO(0xC0, i, 0, 0, 15, NULL, NULL);
+
+        fileContent(i, content);
+        if (s_files[i].recordSize == 0) {
+            if (cold)
+                invalidateSimCache();
+            commands += simIO(0xB0, i, 0, 0, s_files[i].size, NULL, content);
+            continue;
+        }
+        for (r = 1; r <= s_files[i].size; r++) {
+            if (cold)
+                invalidateSimCache();
+            commands += simIO(0xB2, i, r, 4, s_files[i].recordSize, NULL,
+                              content);
+        }
+    }
+
+    return commands;
+}
+
+void test_ril_sim_cache(void)
+{
+    char content[SIM_FILE_MAX + 1];
+    char update[SIM_FILE_MAX + 1];
+    size_t adn = SIM_FILE_ADN;
+    int commands = 0;
+    int r;
+
+    CHECK(ril_test_start() == 0);
+
+    /* The card type is asked for once, by the first SIM_IO. */
+    simIO(0xC0, SIM_FILE_SPN, 0, 0, 15, NULL, NULL);
+    invalidateSimCache();
+
+    /*
+     * The first record read reads the rest of the file ahead, after the
+     * request has completed; its commands count for the next request.
+     */
+    fileContent(adn, content);
+    CHECK(simIO(0xC0, adn, 0, 0, 15, NULL, NULL) == 1);
+    for (r = 1; r <= s_files[adn].size; r++)
+        commands += simIO(0xB2, adn, r, 4, 30, NULL, content);
+    CHECK(commands == 1 + (s_files[adn].size - 1 + SIM_READ_AHEAD - 1)
+                          / SIM_READ_AHEAD);
+    CHECK(simIO(0xC0, adn, 0, 0, 15, NULL, NULL) == 0);
+
+    /* A transparent file is read once. */
+    fileContent(SIM_FILE_SPN, content);
+    CHECK(simIO(0xC0, SIM_FILE_SPN, 0, 0, 15, NULL, NULL) == 1);
+    CHECK(simIO(0xB0, SIM_FILE_SPN, 0, 0, 17, NULL, content) == 1);
+    CHECK(simIO(0xB0, SIM_FILE_SPN, 0, 0, 17, NULL, content) == 0);
+
+    /* Updates go to the card, and are read back from the cache. */
+    memset(update, 'F', 60);
+    update[60] = '\0';
+    CHECK(simIO(0xDC, adn, 5, 4, 30, update, NULL) == 1);
+    CHECK(simIO(0xB2, adn, 5, 4, 30, NULL, update) == 0);
+    fileContent(adn, content);
+    CHECK(simIO(0xB2, adn, 6, 4, 30, NULL, content) == 0);
+
+    /* Dropping a file, as a REFRESH of it does, keeps the others. */
+    invalidateSimCacheFile(s_files[adn].fileid);
+    CHECK(simIO(0xB2, adn, 6, 4, 30, NULL, content) == 1);
+    CHECK(simIO(0xB0, SIM_FILE_SPN, 0, 0, 17, NULL, NULL) == 0);
+
+    invalidateSimCache();
+    CHECK(simIO(0xC0, SIM_FILE_SPN, 0, 0, 15, NULL, NULL) == 1);
+    invalidateSimCache();
+}
+
+/*
+ * The files read at boot, and read again, with the time the commands
+ * would take on a modem answering a +CRSM in about SIM_COMMAND_MSEC.
+ */
+void bench_ril_sim_boot(void)
+{
+    static const struct {
+        const char *name;
+        int cold;
+        int invalidate;
+    } s_loads[] = {
+        { "no cache", 1, 1 },
+        { "cache", 0, 1 },
+        { "cache, again", 0, 0 },
+    };
+    size_t i;
+
+    CHECK(ril_test_start() == 0);
+    simIO(0xC0, SIM_FILE_SPN, 0, 0, 15, NULL, NULL);
+
+    for (i = 0; i < sizeof(s_loads) / sizeof(s_loads[0]); i++) {
+        long long start;
+        int commands;
+
+        if (s_loads[i].invalidate)
+            invalidateSimCache();
+        start = host_test_now_ns();
+        commands = loadFiles(s_loads[i].cold);
+        printf("  %-15s %5d AT commands, %6.1f ms, %5.2f s at %d ms each\n",
+               s_loads[i].name, commands,
+               (host_test_now_ns() - start) / 1e6,
+               commands * SIM_COMMAND_MSEC / 1000.0, SIM_COMMAND_MSEC);
+    }
+
+    invalidateSimCache();
+}
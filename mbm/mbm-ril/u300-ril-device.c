@@ -346,14 +346,20 @@ void setRadioState(RIL_RadioState newState)
 
     /* Do these outside of the mutex. */
     if (sState != oldState || sState == RADIO_STATE_SIM_LOCKED_OR_ABSENT) {
+        invalidateNetworkCache();
         RIL_onUnsolicitedResponse(RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED,
                                   NULL, 0);
 
         if (sState == RADIO_STATE_SIM_READY) {
-            enqueueRILEvent(RIL_EVENT_QUEUE_PRIO, checkMessageStorageReady, NULL, NULL);
+            enqueueRILEventOnce(RIL_EVENT_QUEUE_PRIO, checkMessageStorageReady, NULL, NULL);
             enqueueRILEvent(RIL_EVENT_QUEUE_PRIO, onSIMReady, NULL, NULL);
         } else if (sState == RADIO_STATE_SIM_NOT_READY)
-            enqueueRILEvent(RIL_EVENT_QUEUE_NORMAL, pollSIMState, NULL, NULL);
+            enqueueRILEventOnce(RIL_EVENT_QUEUE_NORMAL, pollSIMState, NULL, NULL);
+
+        /* The SIM poll stops here, not on its next round. */
+        if (sState != RADIO_STATE_SIM_NOT_READY &&
+            sState != RADIO_STATE_SIM_LOCKED_OR_ABSENT)
+            dequeueRILEvent(pollSIMState, NULL);
     }
 }
 
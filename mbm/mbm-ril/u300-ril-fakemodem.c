@@ -0,0 +1,872 @@
+/* ST-Ericsson U300 RIL
+**
+** Copyright (C) ST-Ericsson AB 2008-2009
+** Copyright 2006, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+**
+** Based on reference-ril by The Android Open Source Project.
+**
+** Heavily modified for ST-Ericsson U300 modems.
+** Author: Christian Bejram <christian.bejram@stericsson.com>
+*/
+
+/*
+ * Fake modem on a pseudo-terminal, for running the RIL without hardware.
+ * The RIL gets the slave side of the pty as its AT channel, a thread
+ * answers on the master side from a rules file:
+ *
+ *   # Comment.
+ *   delay <ms>[~<jitter ms>]                   Default response latency.
+ *   cmd <prefix> <ms>[~<jitter ms>] <response> Answer commands starting
+ *                                              with prefix, longest wins.
+ *   unsol <first ms> <period ms> <response>    Unsolicited result, sent
+ *                                              once if period is 0.
+ *   replay <log file>                          Answer from a RIL log.
+ *
+ * A response is its lines separated by '|', eg "+CSQ: 14,99|OK" or
+ * "+CMT: ,23|0791...". A line ">" sends the "> " prompt and waits for
+ * the PDU terminated by Ctrl-Z, the lines after it are sent then, with
+ * a final "OK" if they have none.
+ * Commands without a rule are answered "OK". The parts of chained
+ * commands are answered one by one, up to the first error.
+ *
+ * A replayed log is read for its "AT(fd)> " and "AT(fd)< " lines. A
+ * command sent by the RIL is answered with the next recorded response to
+ * the same command, the last one once they are used up, followed by the
+ * unsolicited lines logged after it. Replayed commands take precedence
+ * over the cmd rules.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "misc.h"
+#include "prefix_table.h"
+#include "u300-ril-fakemodem.h"
+
+#define LOG_TAG "RIL"
+#include <utils/Log.h>
+
+#define LOGD    ALOGD
+#define LOGI    ALOGI
+#define LOGE    ALOGE
+#define LOGW    ALOGW
+
+#define FAKE_MAX_RULES      PREFIX_TABLE_MAX
+#define FAKE_MAX_UNSOL      16
+#define FAKE_MAX_INPUT      1024
+#define FAKE_LINE_SEPARATOR '|'
+
+#define CTRL_Z  0x1a
+#define ESC     0x1b
+
+struct fakeRule {
+    char *prefix;
+    int delayMsec;
+    int jitterMsec;
+    char *response;
+};
+
+struct fakeUnsol {
+    long long due;
+    int periodMsec;
+    char *response;
+};
+
+struct fakeReplay {
+    char *command;      /* NULL for lines logged before any command. */
+    char *response;
+    char *unsol;        /* Unsolicited lines logged after the response. */
+    int used;
+};
+
+struct fakeOutput {
+    long long due;
+    struct fakeOutput *next;
+    size_t len;
+    char text[];
+};
+
+struct fakeModem {
+    int fd;                     /* Master side of the pty. */
+
+    int delayMsec;
+    int jitterMsec;
+
+    struct prefixTable prefixes;    /* value is the index in rules. */
+    struct fakeRule rules[FAKE_MAX_RULES];
+
+    struct fakeUnsol unsols[FAKE_MAX_UNSOL];
+    int unsolCount;
+
+    struct fakeReplay *replay;
+    int replayCount;
+    int replayAlloc;
+
+    /* Responses not due yet, in the order they are sent. */
+    struct fakeOutput *outHead;
+    struct fakeOutput *outTail;
+
+    char input[FAKE_MAX_INPUT];
+    size_t inputLen;
+
+    /* Rest of a response waiting for the PDU after a "> " prompt. */
+    char *afterPdu;
+    int afterPduDelayMsec;
+
+    unsigned int commands;
+};
+
+/* Commands answered by all fake modems. */
+static unsigned int s_fakeCommandCount;
+
+static const char *s_fakeFinalResponses[] = {
+    "OK", "CONNECT", "ERROR", "+CMS ERROR:", "+CME ERROR:",
+    "NO CARRIER", "NO ANSWER", "NO DIALTONE"
+};
+
+static long long fakeNowMsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int fakeIsFinal(const char *line)
+{
+    size_t i;
+
+    for (i = 0; i < NUM_ELEMS(s_fakeFinalResponses); i++)
+        if (strStartsWith(line, s_fakeFinalResponses[i]))
+            return 1;
+
+    return 0;
+}
+
+/** Returns the next space separated token of *p, NULL if there is none. */
+static char *fakeNextToken(char **p)
+{
+    char *token;
+
+    while (**p == ' ' || **p == '\t')
+        (*p)++;
+    if (**p == '\0')
+        return NULL;
+
+    token = *p;
+    while (**p != '\0' && **p != ' ' && **p != '\t')
+        (*p)++;
+    if (**p != '\0')
+        *(*p)++ = '\0';
+
+    return token;
+}
+
+/** Parses "<ms>[~<jitter ms>]". */
+static int fakeParseDelay(const char *s, int *delayMsec, int *jitterMsec)
+{
+    char *end;
+
+    *delayMsec = strtol(s, &end, 10);
+    *jitterMsec = 0;
+    if (*end == '~')
+        *jitterMsec = strtol(end + 1, &end, 10);
+
+    if (*end != '\0' || *delayMsec < 0 || *jitterMsec < 0)
+        return -1;
+
+    return 0;
+}
+
+static int fakeDelayMsec(int delayMsec, int jitterMsec)
+{
+    if (jitterMsec > 0)
+        delayMsec += rand() % (jitterMsec + 1);
+
+    return delayMsec;
+}
+
+/** Appends line to the '|' separated lines of *lines. */
+static int fakeAppendLine(char **lines, const char *line)
+{
+    size_t len = *lines != NULL ? strlen(*lines) : 0;
+    char *p = realloc(*lines, len + strlen(line) + 2);
+
+    if (p == NULL)
+        return -1;
+
+    if (len > 0)
+        p[len++] = FAKE_LINE_SEPARATOR;
+    strcpy(p + len, line);
+    *lines = p;
+
+    return 0;
+}
+
+/**
+ * Queue the '|' separated lines of response, framed as the modem does,
+ * delayMsec from now but not before what is queued already.
+ */
+static void fakeQueue(struct fakeModem *m, const char *response, size_t len,
+                      int delayMsec)
+{
+    struct fakeOutput *out;
+    size_t i;
+    size_t n = 2;
+
+    for (i = 0; i < len; i++)
+        n += response[i] == FAKE_LINE_SEPARATOR ? 4 : 1;
+
+    out = malloc(sizeof(*out) + n + 2);
+    if (out == NULL) {
+        LOGE("%s() failed to allocate memory", __func__);
+        return;
+    }
+
+    out->len = 0;
+    out->text[out->len++] = '\r';
+    out->text[out->len++] = '\n';
+    for (i = 0; i < len; i++) {
+        if (response[i] != FAKE_LINE_SEPARATOR) {
+            out->text[out->len++] = response[i];
+            continue;
+        }
+        memcpy(out->text + out->len, "\r\n\r\n", 4);
+        out->len += 4;
+    }
+    /* The SMS prompt is not terminated. */
+    if (!(len == 1 && response[0] == '>')) {
+        out->text[out->len++] = '\r';
+        out->text[out->len++] = '\n';
+    } else
+        out->text[out->len++] = ' ';
+
+    out->due = fakeNowMsec() + delayMsec;
+    if (m->outTail != NULL && out->due < m->outTail->due)
+        out->due = m->outTail->due;
+    out->next = NULL;
+
+    if (m->outTail != NULL)
+        m->outTail->next = out;
+    else
+        m->outHead = out;
+    m->outTail = out;
+}
+
+/**
+ * Queue response, up to a ">" line. The lines after it are kept until
+ * the PDU is in, "OK" is added to them if they have no final response.
+ */
+static void fakeRespond(struct fakeModem *m, const char *response,
+                        int delayMsec)
+{
+    const char *p = response;
+    const char *prompt = NULL;
+
+    /* Find a line consisting of ">". */
+    while (p != NULL) {
+        if (p[0] == '>' && (p[1] == '\0' || p[1] == FAKE_LINE_SEPARATOR)) {
+            prompt = p;
+            break;
+        }
+        p = strchr(p, FAKE_LINE_SEPARATOR);
+        if (p != NULL)
+            p++;
+    }
+
+    if (prompt == NULL) {
+        fakeQueue(m, response, strlen(response), delayMsec);
+        return;
+    }
+
+    if (prompt > response)
+        fakeQueue(m, response, prompt - response - 1, delayMsec);
+    fakeQueue(m, ">", 1, prompt > response ? 0 : delayMsec);
+
+    free(m->afterPdu);
+    m->afterPdu = NULL;
+    if (prompt[1] != '\0')
+        m->afterPdu = strdup(prompt + 2);
+
+    /* The command is not done before a final response, after the PDU. */
+    p = m->afterPdu != NULL ? strrchr(m->afterPdu, FAKE_LINE_SEPARATOR) : NULL;
+    if (m->afterPdu == NULL
+        || !fakeIsFinal(p != NULL ? p + 1 : m->afterPdu))
+        fakeAppendLine(&m->afterPdu, "OK");
+    m->afterPduDelayMsec = delayMsec;
+}
+
+static struct fakeReplay *fakeFindReplay(struct fakeModem *m,
+                                         const char *command)
+{
+    struct fakeReplay *last = NULL;
+    int i;
+
+    for (i = 0; i < m->replayCount; i++) {
+        struct fakeReplay *r = &m->replay[i];
+
+        if (r->command == NULL || strcmp(r->command, command) != 0)
+            continue;
+        if (!r->used)
+            return r;
+        last = r;
+    }
+
+    return last;
+}
+
+/**
+ * Answer one part of a command line. Returns the final line, the other
+ * lines of the response are appended to *lines.
+ */
+static const char *fakeAnswerPart(struct fakeModem *m, const char *command,
+                                  char **lines, int *delayMsec)
+{
+    const struct prefixEntry *e;
+    const struct fakeRule *rule;
+    const char *final;
+    char *intermediate;
+
+    e = prefixTableMatch(&m->prefixes, command);
+    if (e == NULL) {
+        *delayMsec += fakeDelayMsec(m->delayMsec, m->jitterMsec);
+        return "OK";
+    }
+
+    rule = &m->rules[e->value];
+    *delayMsec += fakeDelayMsec(rule->delayMsec, rule->jitterMsec);
+
+    final = strrchr(rule->response, FAKE_LINE_SEPARATOR);
+    if (final == NULL)
+        return rule->response;
+
+    intermediate = strndup(rule->response, final - rule->response);
+    if (intermediate != NULL) {
+        fakeAppendLine(lines, intermediate);
+        free(intermediate);
+    }
+
+    return final + 1;
+}
+
+static void fakeHandleCommand(struct fakeModem *m, char *line)
+{
+    struct fakeReplay *r;
+    char *lines = NULL;
+    const char *final = "OK";
+    char part[FAKE_MAX_INPUT + 2];
+    char *p;
+    char *next;
+    int delayMsec = 0;
+    int quoted;
+
+    m->commands++;
+    __sync_fetch_and_add(&s_fakeCommandCount, 1);
+
+    r = fakeFindReplay(m, line);
+    if (r != NULL) {
+        r->used = 1;
+        if (r->response != NULL)
+            fakeRespond(m, r->response,
+                        fakeDelayMsec(m->delayMsec, m->jitterMsec));
+        if (r->unsol != NULL)
+            fakeQueue(m, r->unsol, strlen(r->unsol), 0);
+        return;
+    }
+
+    /* Answer the parts of chained commands one by one. */
+    for (p = line; p != NULL; p = next) {
+        quoted = 0;
+        for (next = p; *next != '\0'; next++) {
+            if (*next == '"')
+                quoted = !quoted;
+            else if (*next == ';' && !quoted)
+                break;
+        }
+        if (*next == ';')
+            *next++ = '\0';
+        else
+            next = NULL;
+
+        if (p == line)
+            snprintf(part, sizeof(part), "%s", p);
+        else if (*p == '\0')
+            continue;
+        else
+            snprintf(part, sizeof(part), "AT%s", p);
+
+        final = fakeAnswerPart(m, part, &lines, &delayMsec);
+        if (strcmp(final, "OK") != 0)
+            break;
+    }
+
+    if (lines != NULL && lines[0] != '\0') {
+        fakeAppendLine(&lines, final);
+        fakeRespond(m, lines, delayMsec);
+    } else
+        fakeRespond(m, final, delayMsec);
+
+    free(lines);
+}
+
+/** Take what the RIL wrote, commands are terminated by '\r'. */
+static void fakeInput(struct fakeModem *m, const char *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        char c = buf[i];
+
+        if (m->afterPdu != NULL || m->afterPduDelayMsec >= 0) {
+            /* Waiting for the PDU after a "> " prompt. */
+            if (c != CTRL_Z && c != ESC)
+                continue;
+            if (c == CTRL_Z && m->afterPdu != NULL)
+                fakeRespond(m, m->afterPdu, m->afterPduDelayMsec);
+            else if (c == ESC)
+                fakeQueue(m, "OK", 2, 0);
+            free(m->afterPdu);
+            m->afterPdu = NULL;
+            m->afterPduDelayMsec = -1;
+            continue;
+        }
+
+        if (c == '\n')
+            continue;
+
+        if (c != '\r') {
+            if (m->inputLen < sizeof(m->input) - 1)
+                m->input[m->inputLen++] = c;
+            continue;
+        }
+
+        m->input[m->inputLen] = '\0';
+        m->inputLen = 0;
+        if (strncasecmp(m->input, "AT", 2) == 0)
+            fakeHandleCommand(m, m->input);
+    }
+}
+
+static int fakeAddRule(struct fakeModem *m, char *args)
+{
+    char *prefix = fakeNextToken(&args);
+    char *delay = fakeNextToken(&args);
+    struct fakeRule *rule;
+    int index = m->prefixes.count;
+    int err;
+
+    while (*args == ' ' || *args == '\t')
+        args++;
+    if (prefix == NULL || delay == NULL || *args == '\0')
+        return -1;
+
+    if (index >= FAKE_MAX_RULES)
+        return -1;
+    rule = &m->rules[index];
+    if (fakeParseDelay(delay, &rule->delayMsec, &rule->jitterMsec) < 0)
+        return -1;
+
+    rule->prefix = strdup(prefix);
+    rule->response = strdup(args);
+    if (rule->prefix == NULL || rule->response == NULL)
+        goto error;
+
+    err = prefixTableAdd(&m->prefixes, rule->prefix, index, NULL);
+    if (err < 0)
+        goto error;
+
+    return 0;
+
+error:
+    free(rule->prefix);
+    free(rule->response);
+    memset(rule, 0, sizeof(*rule));
+    return -1;
+}
+
+static int fakeAddUnsol(struct fakeModem *m, char *args, long long now)
+{
+    char *first = fakeNextToken(&args);
+    char *period = fakeNextToken(&args);
+    struct fakeUnsol *u;
+
+    while (*args == ' ' || *args == '\t')
+        args++;
+    if (first == NULL || period == NULL || *args == '\0')
+        return -1;
+
+    if (m->unsolCount >= FAKE_MAX_UNSOL)
+        return -1;
+    u = &m->unsols[m->unsolCount];
+
+    u->due = now + atoi(first);
+    u->periodMsec = atoi(period);
+    u->response = strdup(args);
+    if (u->response == NULL)
+        return -1;
+
+    m->unsolCount++;
+    return 0;
+}
+
+static struct fakeReplay *fakeNewReplay(struct fakeModem *m)
+{
+    struct fakeReplay *r;
+
+    if (m->replayCount == m->replayAlloc) {
+        int alloc = m->replayAlloc ? m->replayAlloc * 2 : 64;
+
+        r = realloc(m->replay, alloc * sizeof(*r));
+        if (r == NULL)
+            return NULL;
+        m->replay = r;
+        m->replayAlloc = alloc;
+    }
+
+    r = &m->replay[m->replayCount++];
+    memset(r, 0, sizeof(*r));
+    return r;
+}
+
+/** Finds the text of a logged "AT(fd)> " or "AT(fd)< " line. */
+static char *fakeLoggedLine(char *line, char *direction)
+{
+    char *p = line;
+
+    while ((p = strstr(p, "AT")) != NULL) {
+        char *q = p + 2;
+
+        if (*q == '(') {
+            q = strchr(q, ')');
+            if (q == NULL)
+                return NULL;
+            q++;
+        }
+        if ((*q == '>' || *q == '<') && q[1] == ' ') {
+            *direction = *q;
+            return q + 2;
+        }
+        p += 2;
+    }
+
+    return NULL;
+}
+
+static int fakeLoadReplay(struct fakeModem *m, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    struct fakeReplay *r = NULL;
+    int outstanding = 0;
+    char line[FAKE_MAX_INPUT];
+
+    if (f == NULL) {
+        LOGE("%s() failed to open %s: %s", __func__, path, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char direction;
+        char *text;
+
+        line[strcspn(line, "\r\n")] = '\0';
+        text = fakeLoggedLine(line, &direction);
+        if (text == NULL)
+            continue;
+
+        if (direction == '>') {
+            /* The PDU of an SMS is logged ending in ^Z. */
+            if (strstr(text, "^Z") != NULL)
+                continue;
+            r = fakeNewReplay(m);
+            if (r == NULL)
+                break;
+            r->command = strdup(text);
+            outstanding = 1;
+            continue;
+        }
+
+        if (r == NULL && (r = fakeNewReplay(m)) == NULL)
+            break;
+
+        if (outstanding) {
+            fakeAppendLine(&r->response, text);
+            if (fakeIsFinal(text))
+                outstanding = 0;
+        } else
+            fakeAppendLine(&r->unsol, text);
+    }
+
+    fclose(f);
+    LOGI("%s() %d commands replayed from %s", __func__, m->replayCount, path);
+    return 0;
+}
+
+static int fakeLoadRules(struct fakeModem *m, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    long long now = fakeNowMsec();
+    char line[FAKE_MAX_INPUT];
+    int lineno = 0;
+
+    if (f == NULL) {
+        LOGE("%s() failed to open %s: %s", __func__, path, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *p = line;
+        char *keyword;
+        int err = -1;
+
+        lineno++;
+        line[strcspn(line, "\r\n")] = '\0';
+        keyword = fakeNextToken(&p);
+        if (keyword == NULL || keyword[0] == '#')
+            continue;
+
+        if (strcmp(keyword, "delay") == 0) {
+            char *delay = fakeNextToken(&p);
+
+            if (delay != NULL)
+                err = fakeParseDelay(delay, &m->delayMsec, &m->jitterMsec);
+        } else if (strcmp(keyword, "cmd") == 0)
+            err = fakeAddRule(m, p);
+        else if (strcmp(keyword, "unsol") == 0)
+            err = fakeAddUnsol(m, p, now);
+        else if (strcmp(keyword, "replay") == 0) {
+            char *file = fakeNextToken(&p);
+
+            if (file != NULL)
+                err = fakeLoadReplay(m, file);
+        }
+
+        if (err < 0)
+            LOGW("%s() %s:%d ignored", __func__, path, lineno);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static void fakeFree(struct fakeModem *m)
+{
+    struct fakeOutput *out;
+    int i;
+
+    while ((out = m->outHead) != NULL) {
+        m->outHead = out->next;
+        free(out);
+    }
+
+    for (i = 0; i < m->prefixes.count; i++) {
+        free(m->rules[i].prefix);
+        free(m->rules[i].response);
+    }
+
+    for (i = 0; i < m->unsolCount; i++)
+        free(m->unsols[i].response);
+
+    for (i = 0; i < m->replayCount; i++) {
+        free(m->replay[i].command);
+        free(m->replay[i].response);
+        free(m->replay[i].unsol);
+    }
+    free(m->replay);
+
+    free(m->afterPdu);
+    free(m);
+}
+
+static int fakeWrite(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+static void *fakeModemLoop(void *arg)
+{
+    struct fakeModem *m = (struct fakeModem *) arg;
+    static const char emrdy[] = "\r\n*EMRDY: 1\r\n";
+    char buf[256];
+    int i;
+
+    fakeWrite(m->fd, emrdy, sizeof(emrdy) - 1);
+
+    /* Lines logged before the first replayed command. */
+    if (m->replayCount > 0 && m->replay[0].command == NULL
+        && m->replay[0].unsol != NULL)
+        fakeQueue(m, m->replay[0].unsol, strlen(m->replay[0].unsol), 0);
+
+    for (;;) {
+        struct pollfd pfd;
+        long long now = fakeNowMsec();
+        long long next = -1;
+        int timeout;
+        ssize_t n;
+
+        while (m->outHead != NULL && m->outHead->due <= now) {
+            struct fakeOutput *out = m->outHead;
+
+            m->outHead = out->next;
+            if (m->outHead == NULL)
+                m->outTail = NULL;
+            if (fakeWrite(m->fd, out->text, out->len) < 0) {
+                free(out);
+                goto done;
+            }
+            free(out);
+        }
+
+        for (i = 0; i < m->unsolCount; i++) {
+            struct fakeUnsol *u = &m->unsols[i];
+
+            if (u->due < 0)
+                continue;
+            if (u->due <= now) {
+                fakeQueue(m, u->response, strlen(u->response), 0);
+                u->due = u->periodMsec > 0 ? now + u->periodMsec : -1;
+                /* Sent on the next round, after the responses due. */
+                next = now;
+                continue;
+            }
+            if (next < 0 || u->due < next)
+                next = u->due;
+        }
+
+        if (m->outHead != NULL && (next < 0 || m->outHead->due < next))
+            next = m->outHead->due;
+
+        timeout = next < 0 ? -1 : (int) (next > now ? next - now : 0);
+
+        pfd.fd = m->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeout) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (pfd.revents == 0)
+            continue;
+
+        /* EIO or 0 once the RIL has closed its side. */
+        n = read(m->fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+
+        fakeInput(m, buf, n);
+    }
+
+done:
+    LOGI("%s() fake modem closed after %u commands", __func__, m->commands);
+    close(m->fd);
+    fakeFree(m);
+    return NULL;
+}
+
+/**
+ * Start a fake modem answering from the rules file at rulesPath.
+ * Returns the fd of the AT channel to it, -1 on error. The modem goes
+ * away when the fd is closed.
+ */
+int fakeModemOpen(const char *rulesPath)
+{
+    struct fakeModem *m;
+    struct termios ios;
+    pthread_attr_t attr;
+    pthread_t tid;
+    char *slave;
+    int fd = -1;
+    int err;
+
+    m = calloc(1, sizeof(*m));
+    if (m == NULL)
+        return -1;
+    m->fd = -1;
+    m->afterPduDelayMsec = -1;
+
+    if (fakeLoadRules(m, rulesPath) < 0)
+        goto error;
+
+    m->fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (m->fd < 0 || grantpt(m->fd) < 0 || unlockpt(m->fd) < 0)
+        goto error;
+
+    slave = ptsname(m->fd);
+    if (slave == NULL)
+        goto error;
+
+    fd = open(slave, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+        goto error;
+
+    /* No echo and no line discipline, like the modem tty. */
+    tcgetattr(fd, &ios);
+    cfmakeraw(&ios);
+    tcsetattr(fd, TCSANOW, &ios);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    err = pthread_create(&tid, &attr, fakeModemLoop, m);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        errno = err;
+        goto error;
+    }
+
+    LOGI("%s() fake modem on %s, %d rules", __func__, slave,
+         m->prefixes.count);
+    return fd;
+
+error:
+    LOGE("%s() failed to start fake modem: %s", __func__, strerror(errno));
+    if (fd >= 0)
+        close(fd);
+    if (m->fd >= 0)
+        close(m->fd);
+    fakeFree(m);
+    return -1;
+}
+
+/**
+ * Returns the number of commands answered by the fake modems so far; the
+ * difference between two calls counts the commands between.
+ */
+unsigned int fakeModemCommandCount(void)
+{
+    return __sync_fetch_and_add(&s_fakeCommandCount, 0);
+}
@@ -771,7 +771,7 @@ void requestSmsStorageFull(void *data, size_t datalen, RIL_Token t)
  */
 void onNewSmsIndication(void)
 {
-    enqueueRILEvent(RIL_EVENT_QUEUE_PRIO, isSimSmsStorageFull, NULL, NULL);
+    enqueueRILEventOnce(RIL_EVENT_QUEUE_PRIO, isSimSmsStorageFull, NULL, NULL);
 }
 
 /*
@@ -851,6 +851,6 @@ void checkMessageStorageReady(void *p)
     trigger_time.tv_sec = MESSAGE_STORAGE_READY_TIMER;
     trigger_time.tv_nsec = 0;
 
-    enqueueRILEvent(RIL_EVENT_QUEUE_PRIO,
+    enqueueRILEventOnce(RIL_EVENT_QUEUE_PRIO,
         checkMessageStorageReady, NULL, &trigger_time);
 }
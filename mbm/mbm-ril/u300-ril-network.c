@@ -22,6 +22,10 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
 #include <telephony/ril.h>
 #include <assert.h>
 #include "atchannel.h"
@@ -113,6 +117,263 @@ enum ERINFO_umts {
 #define E2REG_ACCESS_CLASS_BARRED 2
 #define E2REG_REGISTERED          5
 
+/*
+ * Network state cache. It is fed by the answers to the registration,
+ * operator and signal strength requests, and kept current by the
+ * unsolicited +CREG, +CGREG, *E2REG, *ETZV, *E2NAP and +CIEV: 2 results,
+ * so a request only goes to the modem when its state is unknown or
+ * older than its maximum age. The registration results are only reported
+ * while the screen is on; with the screen off, cached state expires
+ * sooner and mostly serves the bursts of requests the framework sends
+ * on every state change.
+ */
+enum {
+    NETCACHE_CREG,
+    NETCACHE_CGREG,
+    NETCACHE_NETWORK,           /* *ERINFO / +CGEQNEG override of AcT. */
+    NETCACHE_OPERATOR,
+    NETCACHE_SIGNAL,
+    NETCACHE_FIELDS
+};
+
+#define NETCACHE_STATS_PERIOD_MSEC (60 * 1000)
+
+/* Maximum age in ms, with the screen off and on. */
+static const int s_netCacheMaxAge[NETCACHE_FIELDS][2] = {
+    [NETCACHE_CREG]     = { 5000, 60000 },
+    [NETCACHE_CGREG]    = { 5000, 60000 },
+    [NETCACHE_NETWORK]  = { 5000, 30000 },
+    [NETCACHE_OPERATOR] = { 10000, 60000 },
+    [NETCACHE_SIGNAL]   = { 5000, 10000 },
+};
+
+static const char *s_netCacheNames[NETCACHE_FIELDS] = {
+    "creg", "cgreg", "network", "operator", "signal"
+};
+
+static struct {
+    pthread_mutex_t mutex;
+    long long updated[NETCACHE_FIELDS];     /* 0 when unknown. */
+    unsigned int generation[NETCACHE_FIELDS];
+
+    int creg[3];                /* stat, lac, cid */
+    int cregDenied;             /* *E2REG? reason when denied. */
+    int cgreg[4];               /* stat, lac, cid, AcT */
+    int network;                /* CGREG_ACT_*, -1 for the default. */
+    char *operatorNames[3];
+    RIL_SignalStrength_v6 signal;
+
+    long long statsStart;
+    int lookups[NETCACHE_FIELDS];
+    int hits[NETCACHE_FIELDS];
+    int saved;                  /* AT commands not sent. */
+} s_netCache = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static long long netCacheNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/** Assumes the cache mutex is held. */
+static void netCacheReportStats(long long now)
+{
+    int i;
+
+    if (s_netCache.statsStart == 0)
+        s_netCache.statsStart = now;
+
+    if (now - s_netCache.statsStart < NETCACHE_STATS_PERIOD_MSEC)
+        return;
+
+    for (i = 0; i < NETCACHE_FIELDS; i++) {
+        if (s_netCache.lookups[i] == 0)
+            continue;
+        LOGI("%s() %s: %d of %d lookups cached", __func__,
+             s_netCacheNames[i], s_netCache.hits[i], s_netCache.lookups[i]);
+    }
+    LOGI("%s() %d AT commands saved per minute", __func__,
+         (int) (s_netCache.saved * 60000LL / (now - s_netCache.statsStart)));
+
+    memset(s_netCache.lookups, 0, sizeof(s_netCache.lookups));
+    memset(s_netCache.hits, 0, sizeof(s_netCache.hits));
+    s_netCache.saved = 0;
+    s_netCache.statsStart = now;
+}
+
+/**
+ * Lock the cache and tell whether field is fresh. Returns with the mutex
+ * held either way, release it with netCacheUnlock() and do not send AT
+ * commands before that, the reader thread takes the mutex too. A hit
+ * counts the AT commands a miss would have cost as saved. On a miss, gen
+ * is set for netCacheLockForStore().
+ */
+static int netCacheLookup(int field, int commands, unsigned int *gen)
+{
+    long long now = netCacheNow();
+    int fresh;
+
+    pthread_mutex_lock(&s_netCache.mutex);
+
+    fresh = s_netCache.updated[field] != 0 &&
+        now - s_netCache.updated[field] <
+        s_netCacheMaxAge[field][getScreenState() ? 1 : 0];
+
+    s_netCache.lookups[field]++;
+    if (fresh) {
+        s_netCache.hits[field]++;
+        s_netCache.saved += commands;
+    }
+    netCacheReportStats(now);
+
+    *gen = s_netCache.generation[field];
+    return fresh;
+}
+
+static void netCacheUnlock(void)
+{
+    pthread_mutex_unlock(&s_netCache.mutex);
+}
+
+/** Returns the generation of field, for netCacheLockForStore(). */
+static unsigned int netCacheGeneration(int field)
+{
+    unsigned int gen;
+
+    pthread_mutex_lock(&s_netCache.mutex);
+    gen = s_netCache.generation[field];
+    pthread_mutex_unlock(&s_netCache.mutex);
+    return gen;
+}
+
+/**
+ * Lock the cache to store a queried field. Returns 0 if the field has
+ * changed since the lookup that gave gen, and the answer is stale. Returns
+ * with the mutex held either way.
+ */
+static int netCacheLockForStore(int field, unsigned int gen)
+{
+    pthread_mutex_lock(&s_netCache.mutex);
+    return s_netCache.generation[field] == gen;
+}
+
+/** Assumes the cache mutex is held. */
+static void netCacheTouch(int field)
+{
+    s_netCache.updated[field] = netCacheNow();
+    s_netCache.generation[field]++;
+}
+
+/** Assumes the cache mutex is held. */
+static void netCacheDrop(int field)
+{
+    s_netCache.updated[field] = 0;
+    s_netCache.generation[field]++;
+}
+
+/**
+ * Forget all cached network state, on radio state changes, SIM events
+ * and when the unsolicited reporting is switched.
+ */
+void invalidateNetworkCache(void)
+{
+    int i;
+
+    pthread_mutex_lock(&s_netCache.mutex);
+    for (i = 0; i < NETCACHE_FIELDS; i++)
+        netCacheDrop(i);
+    pthread_mutex_unlock(&s_netCache.mutex);
+}
+
+/**
+ * Parse an unsolicited +CREG: <stat>[,<lac>,<ci>[,<AcT>]] or +CGREG:
+ * result into reg, unknown values set to -1. Returns the number of values.
+ */
+static int parseUnsolicitedRegistration(const char *s, int *reg, int max)
+{
+    char *line, *tok;
+    int n = 0;
+
+    tok = line = strdup(s);
+    if (line == NULL)
+        return -1;
+
+    if (at_tok_start(&tok) < 0)
+        goto finally;
+
+    for (n = 0; n < max; n++)
+        reg[n] = -1;
+
+    for (n = 0; n < max && at_tok_hasmore(&tok); n++) {
+        int err = (n == 1 || n == 2) ? at_tok_nexthexint(&tok, &reg[n])
+                                     : at_tok_nextint(&tok, &reg[n]);
+        if (err < 0)
+            break;
+    }
+
+finally:
+    free(line);
+    return n;
+}
+
+/**
+ * Feed the unsolicited network results to the cache. Called on the reader
+ * thread, before the results are dispatched.
+ */
+void onNetworkStateUnsolicited(const char *s)
+{
+    int reg[4];
+    int n;
+
+    pthread_mutex_lock(&s_netCache.mutex);
+
+    if (strStartsWith(s, "+CREG:")) {
+        n = parseUnsolicitedRegistration(s, reg, 3);
+
+        /* A new location may mean a new operator. */
+        if (n < 1 || reg[0] != s_netCache.creg[0] ||
+            reg[1] != s_netCache.creg[1])
+            netCacheDrop(NETCACHE_OPERATOR);
+        netCacheDrop(NETCACHE_NETWORK);
+
+        /* The deny reason has to be asked for. */
+        if (n < 1 || reg[0] == CGREG_STAT_REG_DENIED)
+            netCacheDrop(NETCACHE_CREG);
+        else {
+            memcpy(s_netCache.creg, reg, sizeof(s_netCache.creg));
+            netCacheTouch(NETCACHE_CREG);
+        }
+    } else if (strStartsWith(s, "+CGREG:")) {
+        n = parseUnsolicitedRegistration(s, reg, 4);
+        netCacheDrop(NETCACHE_NETWORK);
+
+        if (n < 1)
+            netCacheDrop(NETCACHE_CGREG);
+        else {
+            if (n < 4)
+                reg[3] = 0;
+            memcpy(s_netCache.cgreg, reg, sizeof(s_netCache.cgreg));
+            netCacheTouch(NETCACHE_CGREG);
+        }
+    } else if (strStartsWith(s, "*E2REG:")) {
+        netCacheDrop(NETCACHE_CREG);
+        netCacheDrop(NETCACHE_CGREG);
+    } else if (strStartsWith(s, "*ETZV:")) {
+        /* Sent when registration reporting is off, too. */
+        netCacheDrop(NETCACHE_CREG);
+        netCacheDrop(NETCACHE_OPERATOR);
+    } else if (strStartsWith(s, "*E2NAP:"))
+        netCacheDrop(NETCACHE_NETWORK);
+    else if (strStartsWith(s, "+CIEV: 2"))
+        netCacheDrop(NETCACHE_SIGNAL);
+
+    pthread_mutex_unlock(&s_netCache.mutex);
+}
+
 /**
  * Poll +COPS? and return a success, or if the loop counter reaches
  * REPOLL_OPERATOR_SELECTED, return generic failure.
@@ -266,7 +527,12 @@ void onNetworkTimeReceived(const char *s)
     free(line);
 }
 
-int getSignalStrength(RIL_SignalStrength_v6 *signalStrength){
+/**
+ * Query the signal strength. It is cached unless it changed since gen was
+ * taken, from netCacheLookup() or netCacheGeneration() before the query.
+ */
+int getSignalStrength(RIL_SignalStrength_v6 *signalStrength, unsigned int gen)
+{
     ATResponse *atresponse = NULL;
     int err;
     char *line;
@@ -348,6 +614,12 @@ cind:
     }
 
     at_response_free(atresponse);
+
+    if (netCacheLockForStore(NETCACHE_SIGNAL, gen)) {
+        s_netCache.signal = *signalStrength;
+        netCacheTouch(NETCACHE_SIGNAL);
+    }
+    netCacheUnlock();
     return 0;
 
 error:
@@ -365,9 +637,10 @@ error:
 void pollSignalStrength(void *arg)
 {
     RIL_SignalStrength_v6 signalStrength;
+    unsigned int gen = netCacheGeneration(NETCACHE_SIGNAL);
     (void) arg;
 
-    if (getSignalStrength(&signalStrength) < 0)
+    if (getSignalStrength(&signalStrength, gen) < 0)
         LOGE("%s() Polling the signal strength failed", __func__);
     else
         RIL_onUnsolicitedResponse(RIL_UNSOL_SIGNAL_STRENGTH,
@@ -377,7 +650,7 @@ void pollSignalStrength(void *arg)
 void onSignalStrengthChanged(const char *s)
 {
     (void) s;
-    enqueueRILEvent(RIL_EVENT_QUEUE_PRIO, pollSignalStrength, NULL, NULL);
+    enqueueRILEventOnce(RIL_EVENT_QUEUE_PRIO, pollSignalStrength, NULL, NULL);
 }
 
 void onNetworkStatusChanged(const char *s)
@@ -419,7 +692,8 @@ void onNetworkStatusChanged(const char *s)
 
     /* If registered, poll signal strength for faster update of signal bar */
     if ((cs_status == E2REG_REGISTERED) || (ps_status == E2REG_REGISTERED))
-        enqueueRILEvent(RIL_EVENT_QUEUE_PRIO, pollSignalStrength, (void *)-1, NULL);
+        enqueueRILEventOnce(RIL_EVENT_QUEUE_PRIO, pollSignalStrength,
+                            (void *)-1, NULL);
 
 error:
     free(line);
@@ -434,7 +708,11 @@ void requestSetNetworkSelectionAutomatic(void *data, size_t datalen,
                                          RIL_Token t)
 {
     (void) data; (void) datalen;
+    static const char *regCommands[] = { "AT+CREG?", "AT+CGREG?" };
+    static const char *regPrefixes[] = { "+CREG:", "+CGREG:" };
+    ATResponse *regResponses[2] = { NULL, NULL };
     int err = 0;
+    int i;
     ATResponse *atresponse = NULL;
     int mode = 0;
     int skip;
@@ -516,76 +794,52 @@ check_reg:
     at_response_free(atresponse);
     atresponse = NULL;
 
-    /* Check CS domain first */
-    err = at_send_command_singleline("AT+CREG?", "+CREG:", &atresponse);
+    /* Check the CS and the PS domain, in one command line */
+    err = at_send_command_chained(regCommands, regPrefixes, 2, regResponses);
     if (err != AT_NOERROR)
         goto error;
 
-    line = atresponse->p_intermediates->line;
-
-    err = at_tok_start(&line);
-    if (err < 0)
-        goto error;
-
-    /* Read registration unsolicited mode */
-    err = at_tok_nextint(&line, &mode);
-    if (err < 0)
-        goto error;
-
-    /* Read registration status */
-    err = at_tok_nextint(&line, &mode);
-    if (err < 0)
-        goto error;
-
-    /* If scanning has stopped, then perform a new scan */
-    if (mode == 0) {
-        LOGD("%s() Already in automatic mode, but not currently scanning on CS,"
-	     "trigger a new network scan", __func__);
-        goto do_auto;
-    }
-
-    /* Now check PS domain */
-    at_response_free(atresponse);
-    atresponse = NULL;
-    err = at_send_command_singleline("AT+CGREG?", "+CGREG:", &atresponse);
-    if (err != AT_NOERROR)
-        goto error;
+    for (i = 0; i < 2; i++) {
+        if (regResponses[i]->p_intermediates == NULL)
+            goto error;
 
-    line = atresponse->p_intermediates->line;
+        line = regResponses[i]->p_intermediates->line;
 
-    err = at_tok_start(&line);
-    if (err < 0)
-        goto error;
+        err = at_tok_start(&line);
+        if (err < 0)
+            goto error;
 
-    /* Read registration unsolicited mode */
-    err = at_tok_nextint(&line, &mode);
-    if (err < 0)
-        goto error;
+        /* Read registration unsolicited mode */
+        err = at_tok_nextint(&line, &mode);
+        if (err < 0)
+            goto error;
 
-    /* Read registration status */
-    err = at_tok_nextint(&line, &mode);
-    if (err < 0)
-        goto error;
+        /* Read registration status */
+        err = at_tok_nextint(&line, &mode);
+        if (err < 0)
+            goto error;
 
-    /* If scanning has stopped, then perform a new scan */
-    if (mode == 0) {
-        LOGD("%s() Already in automatic mode, but not currently scanning on PS,"
-	     "trigger a new network scan", __func__);
-        goto do_auto;
-    }
-    else
-    {
-        LOGD("%s() Already in automatic mode and scanning", __func__);
-        goto finish_scan;
+        /* If scanning has stopped, then perform a new scan */
+        if (mode == 0) {
+            LOGD("%s() Already in automatic mode, but not currently scanning on %s,"
+                 "trigger a new network scan", __func__, i == 0 ? "CS" : "PS");
+            goto do_auto;
+        }
     }
 
+    LOGD("%s() Already in automatic mode and scanning", __func__);
+    goto finish_scan;
+
 do_auto:
     at_response_free(atresponse);
     atresponse = NULL;
+    for (i = 0; i < 2; i++)
+        at_response_free(regResponses[i]);
 
     /* This command does two things, one it sets automatic mode,
        two it starts a new network scan! */
     err = at_send_command("AT+COPS=0");
+    invalidateNetworkCache();
     if (err != AT_NOERROR)
         goto error;
 
@@ -593,6 +847,8 @@ finish_scan:
 
     at_response_free(atresponse);
     atresponse = NULL;
+    for (i = 0; i < 2; i++)
+        at_response_free(regResponses[i]);
 
     poll_params->loopcount = 0;
     poll_params->t = t;
@@ -605,6 +861,8 @@ finish_scan:
 error:
     free(poll_params);
     at_response_free(atresponse);
+    for (i = 0; i < 2; i++)
+        at_response_free(regResponses[i]);
     RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
     return;
 }
@@ -639,6 +897,7 @@ void requestSetNetworkSelectionManual(void *data, size_t datalen,
 
     /* Build and send command. */
     err = at_send_command("AT+COPS=1,2,\"%s\"", mccMnc);
+    invalidateNetworkCache();
     if (err != AT_NOERROR)
         goto error;
 
@@ -817,6 +1076,7 @@ void requestSetPreferredNetworkType(void *data, size_t datalen,
     pref_net_type = arg;
 
     err = at_send_command("AT+CFUN=%d", arg);
+    invalidateNetworkCache();
     if (err == AT_NOERROR) {
         RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
         return;
@@ -947,8 +1207,18 @@ void requestSignalStrength(void *data, size_t datalen, RIL_Token t)
 {
     (void) data; (void) datalen;
     RIL_SignalStrength_v6 signalStrength;
+    unsigned int gen;
+
+    if (netCacheLookup(NETCACHE_SIGNAL, 1, &gen)) {
+        signalStrength = s_netCache.signal;
+        netCacheUnlock();
+        RIL_onRequestComplete(t, RIL_E_SUCCESS, &signalStrength,
+                              sizeof(RIL_SignalStrength_v6));
+        return;
+    }
+    netCacheUnlock();
 
-    if (getSignalStrength(&signalStrength) < 0) {
+    if (getSignalStrength(&signalStrength, gen) < 0) {
         LOGE("%s() Must never return an error when radio is on", __func__);
         RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
     } else
@@ -1001,20 +1271,26 @@ Reg_Deny_DetailReason convertRegistrationDeniedReason(int detailedReason)
     return reason;
 }
 
-char *getNetworkType(int def){
-    int network = def;
+/**
+ * Query the access technology of *ERINFO, and of +CGEQNEG when a UMTS
+ * connection is up. Sets network to -1 when neither tells, for the AcT of
+ * the registration to be used. Returns -1 on error.
+ */
+static int queryNetworkType(int *network)
+{
     int err;
     int gsm_rinfo, umts_rinfo, skip;
     int ul, dl;
-    int networkType;
     char *line;
     ATResponse *p_response;
 
+    *network = -1;
+
     err = at_send_command_singleline("AT*ERINFO?", "*ERINFO:",
                                      &p_response);
 
     if (err != AT_NOERROR)
-        return NULL;
+        return -1;
 
     line = p_response->p_intermediates->line;
     err = at_tok_start(&line);
@@ -1068,19 +1344,50 @@ char *getNetworkType(int def){
             LOGI("Max speed %i/%i, UL/DL", ul, dl);
 
             if (ul > 384)
-                network = CGREG_ACT_UTRAN_HSUPA_HSDPA;
+                *network = CGREG_ACT_UTRAN_HSUPA_HSDPA;
             else
-                network = CGREG_ACT_UTRAN_HSDPA;
+                *network = CGREG_ACT_UTRAN_HSDPA;
         }
     }
     else if (gsm_rinfo) {
         LOGD("%s() Using 2G info: %d", __func__, gsm_rinfo);
         if (gsm_rinfo == 1)
-            network = CGREG_ACT_GSM;
+            *network = CGREG_ACT_GSM;
         else
-            network = CGREG_ACT_GSM_EGPRS;
+            *network = CGREG_ACT_GSM_EGPRS;
     }
 
+    return 0;
+
+finally:
+    at_response_free(p_response);
+    return -1;
+}
+
+char *getNetworkType(int def){
+    int network;
+    int networkType;
+    unsigned int gen;
+
+    if (netCacheLookup(NETCACHE_NETWORK, 1, &gen)) {
+        network = s_netCache.network;
+        netCacheUnlock();
+    } else {
+        netCacheUnlock();
+
+        if (queryNetworkType(&network) < 0)
+            return NULL;
+
+        if (netCacheLockForStore(NETCACHE_NETWORK, gen)) {
+            s_netCache.network = network;
+            netCacheTouch(NETCACHE_NETWORK);
+        }
+        netCacheUnlock();
+    }
+
+    if (network < 0)
+        network = def;
+
     switch (network) {
     case CGREG_ACT_GSM:
         networkType = RADIO_TECH_GPRS;
@@ -1107,10 +1414,6 @@ char *getNetworkType(int def){
     char *resp;
     asprintf(&resp, "%d", networkType);
     return resp;
-
-finally:
-    at_response_free(p_response);
-    return NULL;
 }
 /**
  * RIL_REQUEST_DATA_REGISTRATION_STATE
@@ -1130,16 +1433,26 @@ void requestGprsRegistrationState(int request, void *data,
     int commas = 0;
     int skip, tmp;
     int count = 3;
+    int cached;
+    unsigned int gen;
 
     getScreenStateLock();
-    if (!getScreenState())
-        (void)at_send_command("AT+CGREG=2"); /* Response not vital */
 
     memset(responseStr, 0, sizeof(responseStr));
     memset(response, 0, sizeof(response));
     response[1] = -1;
     response[2] = -1;
 
+    cached = netCacheLookup(NETCACHE_CGREG, getScreenState() ? 1 : 3, &gen);
+    if (cached)
+        memcpy(response, s_netCache.cgreg, sizeof(s_netCache.cgreg));
+    netCacheUnlock();
+    if (cached)
+        goto respond;
+
+    if (!getScreenState())
+        (void)at_send_command("AT+CGREG=2"); /* Response not vital */
+
     err = at_send_command_singleline("AT+CGREG?", "+CGREG: ", &atresponse);
     if (err != AT_NOERROR)
         goto error;
@@ -1236,6 +1549,14 @@ void requestGprsRegistrationState(int request, void *data,
         LOGE("%s() Invalid input", __func__);
         goto error;
     }
+
+    if (netCacheLockForStore(NETCACHE_CGREG, gen)) {
+        memcpy(s_netCache.cgreg, response, sizeof(s_netCache.cgreg));
+        netCacheTouch(NETCACHE_CGREG);
+    }
+    netCacheUnlock();
+
+respond:
     if (response[0] == CGREG_STAT_REG_HOME_NET ||
         response[0] == CGREG_STAT_ROAMING)
         responseStr[3] = getNetworkType(response[3]);
@@ -1258,7 +1579,7 @@ void requestGprsRegistrationState(int request, void *data,
     RIL_onRequestComplete(t, RIL_E_SUCCESS, responseStr, resp_size * sizeof(char *));
 
 finally:
-    if (!getScreenState())
+    if (!cached && !getScreenState())
         (void)at_send_command("AT+CGREG=0");
 
     releaseScreenStateLock(); /* Important! */
@@ -1299,13 +1620,12 @@ void requestRegistrationState(int request, void *data,
     int commas = 0;
     int skip, cs_status = 0;
     int i;
+    int cached;
+    unsigned int gen;
 
     /* IMPORTANT: Will take screen state lock here. Make sure to always call
                   releaseScreenStateLock BEFORE returning! */
     getScreenStateLock();
-    if (!getScreenState()) {
-        (void)at_send_command("AT+CREG=2"); /* Ignore the response, not VITAL. */
-    }
 
     /* Setting default values in case values are not returned by AT command */
     for (i = 0; i < resp_size; i++)
@@ -1313,6 +1633,19 @@ void requestRegistrationState(int request, void *data,
 
     memset(response, 0, sizeof(response));
 
+    cached = netCacheLookup(NETCACHE_CREG, getScreenState() ? 1 : 3, &gen);
+    if (cached) {
+        memcpy(response, s_netCache.creg, sizeof(s_netCache.creg));
+        response[13] = s_netCache.cregDenied;
+    }
+    netCacheUnlock();
+    if (cached)
+        goto respond;
+
+    if (!getScreenState()) {
+        (void)at_send_command("AT+CREG=2"); /* Ignore the response, not VITAL. */
+    }
+
     err = at_send_command_singleline("AT+CREG?", "+CREG:", &cgreg_resp);
 
     if (err != AT_NOERROR)
@@ -1410,8 +1743,6 @@ void requestRegistrationState(int request, void *data,
         goto error;
     }
 
-    s_registrationDeniedReason = DEFAULT_VALUE;
-
     if (response[0] == CGREG_STAT_REG_DENIED) {
         err = at_send_command_singleline("AT*E2REG?", "*E2REG:", &e2reg_resp);
 
@@ -1432,6 +1763,19 @@ void requestRegistrationState(int request, void *data,
             goto error;
 
         response[13] = convertRegistrationDeniedReason(cs_status);
+    }
+
+    if (netCacheLockForStore(NETCACHE_CREG, gen)) {
+        memcpy(s_netCache.creg, response, sizeof(s_netCache.creg));
+        s_netCache.cregDenied = response[13];
+        netCacheTouch(NETCACHE_CREG);
+    }
+    netCacheUnlock();
+
+respond:
+    s_registrationDeniedReason = DEFAULT_VALUE;
+
+    if (response[0] == CGREG_STAT_REG_DENIED) {
         s_registrationDeniedReason = response[13];
         err = asprintf(&responseStr[13], "%08x", response[13]);
         if (err < 0)
@@ -1460,7 +1804,7 @@ void requestRegistrationState(int request, void *data,
                           resp_size * sizeof(char *));
 
 finally:
-    if (!getScreenState())
+    if (!cached && !getScreenState())
         (void)at_send_command("AT+CREG=0");
 
     releaseScreenStateLock(); /* Important! */
@@ -1493,9 +1837,23 @@ void requestOperator(void *data, size_t datalen, RIL_Token t)
     static const int num_resp_lines = 3;
     char *response[num_resp_lines];
     ATResponse *atresponse = NULL;
+    unsigned int gen;
 
     memset(response, 0, sizeof(response));
 
+    if (netCacheLookup(NETCACHE_OPERATOR, 1, &gen)) {
+        for (i = 0; i < num_resp_lines; i++) {
+            if (s_netCache.operatorNames[i] == NULL)
+                continue;
+            response[i] = alloca(strlen(s_netCache.operatorNames[i]) + 1);
+            strcpy(response[i], s_netCache.operatorNames[i]);
+        }
+        netCacheUnlock();
+        RIL_onRequestComplete(t, RIL_E_SUCCESS, response, sizeof(response));
+        return;
+    }
+    netCacheUnlock();
+
     err = at_send_command_multiline
         ("AT+COPS=3,0;+COPS?;+COPS=3,1;+COPS?;+COPS=3,2;+COPS?", "+COPS:",
          &atresponse);
@@ -1564,6 +1922,16 @@ void requestOperator(void *data, size_t datalen, RIL_Token t)
         strcpy(response[1], response[2]);
     }
 
+    if (netCacheLockForStore(NETCACHE_OPERATOR, gen)) {
+        for (i = 0; i < num_resp_lines; i++) {
+            free(s_netCache.operatorNames[i]);
+            s_netCache.operatorNames[i] =
+                response[i] ? strdup(response[i]) : NULL;
+        }
+        netCacheTouch(NETCACHE_OPERATOR);
+    }
+    netCacheUnlock();
+
     RIL_onRequestComplete(t, RIL_E_SUCCESS, response, sizeof(response));
 
 finally:
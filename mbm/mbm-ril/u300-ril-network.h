@@ -28,6 +28,9 @@
 void onNetworkTimeReceived(const char *s);
 void onSignalStrengthChanged(const char *s);
 void onNetworkStatusChanged(const char *s);
+void onNetworkStateUnsolicited(const char *s);
+
+void invalidateNetworkCache(void);
 
 int getPreferredNetworkType(void);
 
@@ -23,6 +23,9 @@
  */
 
 #include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
 #include "atchannel.h"
 #include "at_tok.h"
 #include "misc.h"
@@ -58,12 +61,27 @@ static char *ucs2StringCreate(const char *String);
 /* Last pdp fail cause */
 static int s_lastPdpFailCause = PDP_FAIL_ERROR_UNSPECIFIED;
 
-#define MBM_ENAP_WAIT_TIME 17*5	/* loops to wait CONNECTION aprox 17s */
+#define MBM_ENAP_WAIT_MSEC (17 * 1000)	/* wait for CONNECTION aprox 17s */
 
+static const struct timespec TIMEVAL_ENAP_WAIT = { 17, 0 };
+
+/* s_e2nap_cond is broadcast on every *E2NAP state change. */
 static pthread_mutex_t s_e2nap_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_e2nap_cond;
+static pthread_once_t s_e2nap_cond_once = PTHREAD_ONCE_INIT;
 static int s_e2napState = -1;
 static int s_e2napCause = -1;
 
+/*
+ * The data call setup waiting for *E2NAP, see requestSetupDefaultPDP().
+ * Protected by s_e2nap_mutex, s_setupToken is NULL when none is pending.
+ */
+static RIL_Token s_setupToken;
+static char *s_setupType;
+static long long s_setupStart;
+
+static void onSetupDefaultPDPDone(void *param);
+
 static int parse_ip_information(char** addresses, char** gateways, char** dnses, in_addr_t* addr, in_addr_t* gateway)
 {
     ATResponse* p_response = NULL;
@@ -539,86 +557,174 @@ static int networkAuth(const char *authentication, const char *user,
     return 0;
 }
 
-void requestSetupDefaultPDP(void *data, size_t datalen, RIL_Token t)
+static long long pdpNowMsec(void)
 {
-    in_addr_t addr;
-    in_addr_t gateway;
+    struct timespec ts;
 
-    const char *apn, *user, *pass, *auth;
-    char *addresses = NULL;
-    char *gateways = NULL;
-    char *dnses = NULL;
-    const char *type = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-    RIL_Data_Call_Response_v6 response;
+/* The waiters time out on CLOCK_MONOTONIC deadlines. */
+static void makeE2napCond(void)
+{
+    pthread_condattr_t attr;
 
-    int err = -1;
-    int cme_err, i;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s_e2nap_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
 
-    int e2napState = setE2napState(-1);
-    int e2napCause = setE2napCause(-1);
+static pthread_cond_t *e2napCond(void)
+{
+    (void) pthread_once(&s_e2nap_cond_once, makeE2napCond);
+    return &s_e2nap_cond;
+}
 
-    (void) data;
-    (void) datalen;
+/**
+ * Wake the waiters for an *E2NAP state, and finish a pending data call
+ * setup once the connection is up or has failed.
+ * Assumes s_e2nap_mutex is held.
+ */
+static void e2napStateChanged(void)
+{
+    int err;
 
-    memset(&response, 0, sizeof(response));
+    if ((err = pthread_cond_broadcast(e2napCond())) != 0)
+        LOGE("%s() failed to broadcast e2nap state: %s", __func__,
+                strerror(err));
 
-    apn = ((const char **) data)[2];
-    user = ((const char **) data)[3];
-    pass = ((const char **) data)[4];
-    auth = ((const char **) data)[5];
-    type = getNWType(((const char **) data)[6]);
-
-    s_lastPdpFailCause = PDP_FAIL_ERROR_UNSPECIFIED;
+    /* Moves the pending timeout of the setup to now. */
+    if (s_setupToken != NULL && (s_e2napState == E2NAP_ST_CONNECTED
+            || s_e2napState == E2NAP_ST_DISCONNECTED))
+        enqueueRILEventOnce(RIL_EVENT_QUEUE_NORMAL, onSetupDefaultPDPDone,
+                NULL, NULL);
+}
 
-    LOGD("%s() requesting data connection to APN '%s'", __func__, apn);
+/**
+ * Wait at most timeoutMsec for *E2NAP to report state.
+ * Returns the last reported state.
+ */
+static int waitE2napState(int state, int timeoutMsec)
+{
+    struct timespec deadline;
+    int err;
 
-    if (ifc_init()) {
-        LOGE("%s() FAILED to set up ifc!", __func__);
-        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
-        return;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeoutMsec / 1000;
+    deadline.tv_nsec += (timeoutMsec % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
     }
 
-    if (ifc_down(ril_iface)) {
-        LOGE("%s() Failed to bring down %s!", __func__, ril_iface);
-        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
-        return;
-    }
+    if ((err = pthread_mutex_lock(&s_e2nap_mutex)) != 0)
+        LOGE("%s() failed to take e2nap mutex: %s", __func__,
+                strerror(err));
 
-    err = at_send_command("AT+CGDCONT=%d,\"IP\",\"%s\"", RIL_CID_IP, apn);
-    if (err != AT_NOERROR) {
-        cme_err = at_get_cme_error(err);
-        LOGE("%s() CGDCONT failed: %d, cme: %d", __func__, err, cme_err);
-        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
-        return;
+    while (s_e2napState != state) {
+        err = pthread_cond_timedwait(e2napCond(), &s_e2nap_mutex, &deadline);
+        if (err == ETIMEDOUT)
+            break;
+        if (err != 0) {
+            LOGE("%s() failed to wait for e2nap state: %s", __func__,
+                    strerror(err));
+            break;
+        }
     }
+    state = s_e2napState;
 
-    if (networkAuth(auth, user, pass, RIL_CID_IP)) {
+    if ((err = pthread_mutex_unlock(&s_e2nap_mutex)) != 0)
+        LOGE("%s() failed to release e2nap mutex: %s", __func__,
+                strerror(err));
+
+    return state;
+}
+
+/**
+ * Take the pending data call setup, if any, and cancel its timeout.
+ * Returns its token, and its type in *type to be freed by the caller.
+ */
+static RIL_Token takeSetupDefaultPDP(char **type)
+{
+    RIL_Token t;
+    int err;
+
+    if ((err = pthread_mutex_lock(&s_e2nap_mutex)) != 0)
+        LOGE("%s() failed to take e2nap mutex: %s", __func__,
+                strerror(err));
+
+    t = s_setupToken;
+    *type = s_setupType;
+    s_setupToken = NULL;
+    s_setupType = NULL;
+
+    /* Not to cut the wait of the next setup short. */
+    if (t != NULL)
+        dequeueRILEvent(onSetupDefaultPDPDone, NULL);
+
+    if ((err = pthread_mutex_unlock(&s_e2nap_mutex)) != 0)
+        LOGE("%s() failed to release e2nap mutex: %s", __func__,
+                strerror(err));
+
+    return t;
+}
+
+/**
+ * Complete a failed data call setup, with the *E2NAP cause if there is
+ * one, after bringing the connection down.
+ */
+static void failSetupDefaultPDP(RIL_Token t)
+{
+    RIL_Data_Call_Response_v6 response;
+
+    memset(&response, 0, sizeof(response));
+    response.status = getE2NAPFailCause();
+
+    mbm_check_error_cause();
+
+    /* Restore enap state and wait for enap to report disconnected*/
+    at_send_command("AT*ENAP=0");
+    waitE2napState(E2NAP_ST_DISCONNECTED, MBM_ENAP_WAIT_MSEC);
+
+    if (response.status > 0)
+        RIL_onRequestComplete(t, RIL_E_SUCCESS, &response, sizeof(response));
+    else
         RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
-        return;
-    }
+}
 
-    /* Start data on PDP context for IP */
-    err = at_send_command("AT*ENAP=1,%d", RIL_CID_IP);
-    if (err != AT_NOERROR) {
-        cme_err = at_get_cme_error(err);
-        LOGE("requestSetupDefaultPDP: ENAP failed: %d  cme: %d", err, cme_err);
-        goto error;
-    }
+/**
+ * Second half of requestSetupDefaultPDP(), run from the request queue
+ * when *E2NAP reports the connection up or down, or when the wait for it
+ * has timed out.
+ */
+static void onSetupDefaultPDPDone(void *param)
+{
+    in_addr_t addr;
+    in_addr_t gateway;
+
+    char *addresses = NULL;
+    char *gateways = NULL;
+    char *dnses = NULL;
+    char *type = NULL;
 
-    for (i = 0; i < MBM_ENAP_WAIT_TIME; i++) {
-        e2napState = getE2napState();
+    RIL_Data_Call_Response_v6 response;
+    RIL_Token t;
 
-        if (e2napState == E2NAP_ST_CONNECTED
-                || e2napState == E2NAP_ST_DISCONNECTED) {
-            LOGD("%s() %s", __func__, e2napStateToString(e2napState));
-            break;
-        }
-        usleep(200 * 1000);
-    }
+    int e2napState;
+    (void) param;
+
+    /* Already finished, or cancelled by a deactivation. */
+    t = takeSetupDefaultPDP(&type);
+    if (t == NULL)
+        return;
+
+    memset(&response, 0, sizeof(response));
 
     e2napState = getE2napState();
-    e2napCause = getE2napCause();
+    LOGD("%s() %s after %lld ms", __func__, e2napStateToString(e2napState),
+            pdpNowMsec() - s_setupStart);
 
     if (e2napState == E2NAP_ST_DISCONNECTED)
         goto error;
@@ -640,7 +746,7 @@ void requestSetupDefaultPDP(void *data, size_t datalen, RIL_Token t)
 
     response.ifname = ril_iface;
     response.active = 2;
-    response.type = (char *) type;
+    response.type = type;
     response.status = 0;
     response.cid = 1;
     response.suggestedRetryTime = -1;
@@ -657,37 +763,123 @@ void requestSetupDefaultPDP(void *data, size_t datalen, RIL_Token t)
         goto error; /* we got disconnected */
 
     RIL_onRequestComplete(t, RIL_E_SUCCESS, &response, sizeof(response));
+    LOGI("%s() Data call set up in %lld ms", __func__,
+            pdpNowMsec() - s_setupStart);
 
     free(addresses);
     free(gateways);
     free(dnses);
+    free(type);
 
     return;
 
 error:
+    failSetupDefaultPDP(t);
 
-    response.status = getE2NAPFailCause();
+    free(addresses);
+    free(gateways);
+    free(dnses);
+    free(type);
+}
 
-    mbm_check_error_cause();
+/**
+ * RIL_REQUEST_SETUP_DATA_CALL
+ *
+ * Starts the connection and returns, the request is completed by
+ * onSetupDefaultPDPDone() so that the queue keeps serving requests while
+ * the network activates the context.
+ */
+void requestSetupDefaultPDP(void *data, size_t datalen, RIL_Token t)
+{
+    const char *apn, *user, *pass, *auth;
+    const char *type = NULL;
 
-    /* Restore enap state and wait for enap to report disconnected*/
-    at_send_command("AT*ENAP=0");
-    for (i = 0; i < MBM_ENAP_WAIT_TIME; i++) {
-        e2napState = getE2napState();
-        if (e2napState == E2NAP_ST_DISCONNECTED)
-            break;
+    int err = -1;
+    int cme_err;
+    int busy;
+
+    (void) data;
+    (void) datalen;
+
+    apn = ((const char **) data)[2];
+    user = ((const char **) data)[3];
+    pass = ((const char **) data)[4];
+    auth = ((const char **) data)[5];
+    type = getNWType(((const char **) data)[6]);
+
+    s_lastPdpFailCause = PDP_FAIL_ERROR_UNSPECIFIED;
 
-        usleep(200 * 1000);
+    LOGD("%s() requesting data connection to APN '%s'", __func__, apn);
+
+    if ((err = pthread_mutex_lock(&s_e2nap_mutex)) != 0)
+        LOGE("%s() failed to take e2nap mutex: %s", __func__,
+                strerror(err));
+
+    busy = s_setupToken != NULL;
+
+    if ((err = pthread_mutex_unlock(&s_e2nap_mutex)) != 0)
+        LOGE("%s() failed to release e2nap mutex: %s", __func__,
+                strerror(err));
+
+    if (busy) {
+        LOGE("%s() Data call setup already in progress", __func__);
+        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+        return;
     }
 
-    if (response.status > 0)
-        RIL_onRequestComplete(t, RIL_E_SUCCESS, &response, sizeof(response));
-    else
+    setE2napState(-1);
+    setE2napCause(-1);
+
+    if (ifc_init()) {
+        LOGE("%s() FAILED to set up ifc!", __func__);
         RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+        return;
+    }
 
-    free(addresses);
-    free(gateways);
-    free(dnses);
+    if (ifc_down(ril_iface)) {
+        LOGE("%s() Failed to bring down %s!", __func__, ril_iface);
+        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+        return;
+    }
+
+    err = at_send_command("AT+CGDCONT=%d,\"IP\",\"%s\"", RIL_CID_IP, apn);
+    if (err != AT_NOERROR) {
+        cme_err = at_get_cme_error(err);
+        LOGE("%s() CGDCONT failed: %d, cme: %d", __func__, err, cme_err);
+        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+        return;
+    }
+
+    if (networkAuth(auth, user, pass, RIL_CID_IP)) {
+        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+        return;
+    }
+
+    /* Start data on PDP context for IP */
+    s_setupStart = pdpNowMsec();
+    err = at_send_command("AT*ENAP=1,%d", RIL_CID_IP);
+    if (err != AT_NOERROR) {
+        cme_err = at_get_cme_error(err);
+        LOGE("requestSetupDefaultPDP: ENAP failed: %d  cme: %d", err, cme_err);
+        failSetupDefaultPDP(t);
+        return;
+    }
+
+    /* *E2NAP moves the timeout to when it reports the result, the
+       connection may already be up. */
+    if ((err = pthread_mutex_lock(&s_e2nap_mutex)) != 0)
+        LOGE("%s() failed to take e2nap mutex: %s", __func__,
+                strerror(err));
+
+    s_setupToken = t;
+    s_setupType = strdup(type);
+    enqueueRILEventOnce(RIL_EVENT_QUEUE_NORMAL, onSetupDefaultPDPDone, NULL,
+            &TIMEVAL_ENAP_WAIT);
+    e2napStateChanged();
+
+    if ((err = pthread_mutex_unlock(&s_e2nap_mutex)) != 0)
+        LOGE("%s() failed to release e2nap mutex: %s", __func__,
+                strerror(err));
 }
 
 /* CHECK There are several error cases if PDP deactivation fails
@@ -696,12 +888,23 @@ error:
 void requestDeactivateDefaultPDP(void *data, size_t datalen, RIL_Token t)
 {
     ATResponse *p_response = NULL;
+    RIL_Token setup;
+    char *type;
+    long long start;
     int enap = 0;
-    int err, i;
+    int err;
     char *line;
     (void) data;
     (void) datalen;
 
+    /* A setup still waiting for *E2NAP is aborted. */
+    setup = takeSetupDefaultPDP(&type);
+    if (setup != NULL) {
+        LOGI("%s() Cancelling data call setup in progress", __func__);
+        RIL_onRequestComplete(setup, RIL_E_GENERIC_FAILURE, NULL, 0);
+        free(type);
+    }
+
     err = at_send_command_singleline("AT*ENAP?", "*ENAP:", &p_response);
     if (err != AT_NOERROR)
         goto error;
@@ -715,41 +918,48 @@ void requestDeactivateDefaultPDP(void *data, size_t datalen, RIL_Token t)
     if (err < 0)
         goto error;
 
-    if (enap == ENAP_T_CONN_IN_PROG)
+    if (enap == ENAP_T_CONN_IN_PROG && setup == NULL)
         LOGE("%s() Tear down connection while connection setup in progress", __func__);
 
-    if (enap == ENAP_T_CONNECTED) {
+    if (enap == ENAP_T_CONNECTED || (enap == ENAP_T_CONN_IN_PROG && setup)) {
+        start = pdpNowMsec();
+
+        /* Any *E2NAP from here on is about the teardown. */
+        setE2napState(-1);
+
         err = at_send_command("AT*ENAP=0"); /* TODO: can return CME error */
 
         if (err != AT_NOERROR && at_get_error_type(err) != CME_ERROR)
             goto error;
-        for (i = 0; i < MBM_ENAP_WAIT_TIME; i++) {
-            at_response_free(p_response);
-            p_response = NULL;
-            err = at_send_command_singleline("AT*ENAP?", "*ENAP:", &p_response);
 
-            if (err != AT_NOERROR)
-                goto error;
+        if (waitE2napState(E2NAP_ST_DISCONNECTED, MBM_ENAP_WAIT_MSEC)
+                != E2NAP_ST_DISCONNECTED)
+            LOGW("%s() No disconnection reported", __func__);
 
-            line = p_response->p_intermediates->line;
+        /* Confirm that the context went down. */
+        at_response_free(p_response);
+        p_response = NULL;
+        err = at_send_command_singleline("AT*ENAP?", "*ENAP:", &p_response);
 
-            err = at_tok_start(&line);
-            if (err < 0)
-                goto error;
+        if (err != AT_NOERROR)
+            goto error;
 
-            err = at_tok_nextint(&line, &enap);
-            if (err < 0)
-                goto error;
+        line = p_response->p_intermediates->line;
 
-            if (enap == 0)
-                break;
+        err = at_tok_start(&line);
+        if (err < 0)
+            goto error;
 
-            sleep(1);
-        }
+        err = at_tok_nextint(&line, &enap);
+        if (err < 0)
+            goto error;
 
         if (enap != ENAP_T_NOT_CONNECTED)
             goto error;
 
+        LOGI("%s() Data call torn down in %lld ms", __func__,
+                pdpNowMsec() - start);
+
         /* Bring down the interface as well. */
         if (ifc_init())
             goto error;
@@ -872,6 +1082,7 @@ void onConnectionStateChanged(const char *s)
             s_e2napCause = m_cause;
             s_e2napState = E2NAP_ST_DISCONNECTED;
         }
+        e2napStateChanged();
         if ((err = pthread_mutex_unlock(&s_e2nap_mutex)) != 0)
             LOGE("%s() failed to release e2nap mutex: %s", __func__,
                     strerror(err));
@@ -882,6 +1093,7 @@ void onConnectionStateChanged(const char *s)
 
         s_e2napState = m_state;
         s_e2napCause = m_cause;
+        e2napStateChanged();
         if ((err = pthread_mutex_unlock(&s_e2nap_mutex)) != 0)
             LOGE("%s() failed to release e2nap mutex: %s", __func__,
                     strerror(err));
@@ -915,8 +1127,19 @@ int getE2napCause(void)
 
 int setE2napState(int state)
 {
+    int err;
+
+    if ((err = pthread_mutex_lock(&s_e2nap_mutex)) != 0)
+        LOGE("%s() failed to take e2nap mutex: %s", __func__,
+                strerror(err));
+
     s_e2napState = state;
-    return s_e2napState;
+    e2napStateChanged();
+
+    if ((err = pthread_mutex_unlock(&s_e2nap_mutex)) != 0)
+        LOGE("%s() failed to release e2nap mutex: %s", __func__,
+                strerror(err));
+    return state;
 }
 
 int setE2napCause(int state)
@@ -23,8 +23,10 @@
 
 #include <telephony/ril.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include "atchannel.h"
 #include "at_tok.h"
 #include "fcp_parser.h"
@@ -327,6 +329,8 @@ void onSimStateChanged(const char *s)
     if (at_tok_nextint(&line, &state) < 0)
         goto error;
 
+    invalidateSimCache();
+
     /*
      * s_simResetting is used to coordinate state changes during sim resetting,
      * i.e. ESIMSR state changing from 7 to 4 or 5.
@@ -385,6 +389,8 @@ error:
 
 void onSimHotswap(const char *s)
 {
+    invalidateSimCache();
+
     if (strcmp ("*EESIMSWAP:0", s) == 0) {
         LOGD("%s() SIM Removed", __func__);
         s_simRemoved = 1;
@@ -702,8 +708,8 @@ void pollSIMState(void *param)
     switch (getSIMStatus()) {
     case SIM_NOT_READY:
         LOGI("SIM_NOT_READY, poll for sim state.");
-        enqueueRILEvent(RIL_EVENT_QUEUE_PRIO, pollSIMState, NULL,
-                        &TIMEVAL_SIMPOLL);
+        enqueueRILEventOnce(RIL_EVENT_QUEUE_PRIO, pollSIMState, NULL,
+                            &TIMEVAL_SIMPOLL);
         return;
 
     case SIM_PIN2:
@@ -1139,6 +1145,421 @@ error:
     goto finally;
 }
 
+/*
+ * Elementary file cache for requestSIM_IO(). At boot and after every
+ * refresh the framework reads the same EFs, record by record. The
+ * answers to GET RESPONSE, READ RECORD and READ BINARY are kept per file,
+ * keyed by application, path and file id, until the SIM state changes,
+ * the SIM is swapped or a REFRESH reports files changed. The first record
+ * read of a linear fixed file reads the rest of it ahead, several records
+ * per chained +CRSM command line. Updates are written to the card and
+ * then to the cache.
+ */
+#define SIM_CACHE_MAX_FILES     128
+#define SIM_READ_AHEAD_RECORDS  8
+
+#define SIM_CMD_READ_BINARY     0xB0
+#define SIM_CMD_READ_RECORD     0xB2
+#define SIM_CMD_GET_RESPONSE    0xC0
+#define SIM_CMD_UPDATE_BINARY   0xD6
+#define SIM_CMD_UPDATE_RECORD   0xDC
+
+#define SIM_RECORD_ABSOLUTE     0x04
+
+/* Structure of file, byte 13 of a TS 51.011 GET RESPONSE. */
+#define EF_TYPE_TRANSPARENT     0x00
+#define EF_TYPE_LINEAR_FIXED    0x01
+
+struct simCacheFile {
+    struct simCacheFile *next;
+    char *aid;
+    char *path;
+    int fileid;
+    char *response;             /* GET RESPONSE in TS 51.011 format. */
+    int structure;
+    int fileSize;
+    int recordSize;
+    int numRecords;
+    char **records;             /* Indexed from 0, NULL until read. */
+    char *binary;               /* The whole transparent EF. */
+    int readAhead;              /* Done, or failed. */
+};
+
+static pthread_mutex_t s_simCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct simCacheFile *s_simCache;
+static int s_simCacheFiles;
+static unsigned int s_simCacheGeneration;
+static int s_simCacheReads;
+static int s_simCacheHits;
+static int s_simCacheCommands;
+
+static int simCacheKeyEquals(const char *a, const char *b)
+{
+    return strcmp(a ? a : "", b ? b : "") == 0;
+}
+
+/** Assumes s_simCacheMutex is held. */
+static struct simCacheFile *simCacheFind(const RIL_SIM_IO_v6 *ioargs)
+{
+    struct simCacheFile *f;
+
+    for (f = s_simCache; f != NULL; f = f->next)
+        if (f->fileid == ioargs->fileid &&
+            simCacheKeyEquals(f->path, ioargs->path) &&
+            simCacheKeyEquals(f->aid, ioargs->aidPtr))
+            return f;
+
+    return NULL;
+}
+
+static void simCacheClearRecords(struct simCacheFile *f)
+{
+    int i;
+
+    for (i = 0; f->records != NULL && i < f->numRecords; i++) {
+        free(f->records[i]);
+        f->records[i] = NULL;
+    }
+}
+
+static void simCacheFreeFile(struct simCacheFile *f)
+{
+    simCacheClearRecords(f);
+    free(f->records);
+    free(f->binary);
+    free(f->response);
+    free(f->path);
+    free(f->aid);
+    free(f);
+}
+
+/**
+ * Drop the cached files with the given id, or all of them for fileid -1.
+ */
+static void simCacheDrop(int fileid)
+{
+    struct simCacheFile **pp = &s_simCache;
+    struct simCacheFile *f;
+
+    pthread_mutex_lock(&s_simCacheMutex);
+
+    if (fileid == -1 && s_simCacheReads > 0)
+        LOGI("%s() %d of %d SIM requests cached, %d sent to the card",
+             __func__, s_simCacheHits, s_simCacheReads, s_simCacheCommands);
+
+    while ((f = *pp) != NULL) {
+        if (fileid != -1 && f->fileid != fileid) {
+            pp = &f->next;
+            continue;
+        }
+        *pp = f->next;
+        simCacheFreeFile(f);
+        s_simCacheFiles--;
+    }
+    s_simCacheGeneration++;
+
+    pthread_mutex_unlock(&s_simCacheMutex);
+}
+
+void invalidateSimCache(void)
+{
+    simCacheDrop(-1);
+}
+
+void invalidateSimCacheFile(int fileid)
+{
+    simCacheDrop(fileid);
+}
+
+/**
+ * Answer a read from the cache. On a hit, sr->simResponse is allocated
+ * and returns 1.
+ */
+static int simCacheRead(const RIL_SIM_IO_v6 *ioargs, RIL_SIM_IO_Response *sr)
+{
+    struct simCacheFile *f;
+    const char *data = NULL;
+    int offset, length;
+
+    pthread_mutex_lock(&s_simCacheMutex);
+    s_simCacheReads++;
+
+    f = simCacheFind(ioargs);
+    if (f == NULL)
+        goto finally;
+
+    switch (ioargs->command) {
+    case SIM_CMD_GET_RESPONSE:
+        data = f->response;
+        break;
+
+    case SIM_CMD_READ_RECORD:
+        if (ioargs->p2 == SIM_RECORD_ABSOLUTE && f->records != NULL &&
+            ioargs->p1 >= 1 && ioargs->p1 <= f->numRecords &&
+            ioargs->p3 == f->recordSize)
+            data = f->records[ioargs->p1 - 1];
+        break;
+
+    case SIM_CMD_READ_BINARY:
+        offset = (ioargs->p1 << 8) | ioargs->p2;
+        length = ioargs->p3 ? ioargs->p3 : 256;
+        if (f->binary != NULL && offset + length <= f->fileSize) {
+            sr->simResponse = strndup(&f->binary[offset * 2], length * 2);
+            goto hit;
+        }
+        break;
+    }
+
+    if (data == NULL)
+        goto finally;
+    sr->simResponse = strdup(data);
+
+hit:
+    if (sr->simResponse != NULL) {
+        sr->sw1 = 0x90;
+        sr->sw2 = 0x00;
+        s_simCacheHits++;
+    }
+
+finally:
+    pthread_mutex_unlock(&s_simCacheMutex);
+    return sr->simResponse != NULL;
+}
+
+/**
+ * Find or add the cache entry of a file, parsing the header of the GET
+ * RESPONSE answer. Assumes s_simCacheMutex is held.
+ */
+static struct simCacheFile *simCacheAdd(const RIL_SIM_IO_v6 *ioargs,
+                                        const char *response)
+{
+    struct simCacheFile *f = simCacheFind(ioargs);
+    unsigned char header[15];
+
+    if (f != NULL || response == NULL)
+        return f;
+
+    if (s_simCacheFiles >= SIM_CACHE_MAX_FILES ||
+        strlen(response) < sizeof(header) * 2 ||
+        stringToBinary(response, sizeof(header) * 2, header) < 0)
+        return NULL;
+
+    f = calloc(1, sizeof(*f));
+    if (f == NULL)
+        return NULL;
+
+    f->fileid = ioargs->fileid;
+    f->structure = header[13];
+    f->fileSize = (header[2] << 8) | header[3];
+    f->recordSize = header[14];
+    f->response = strdup(response);
+    f->path = ioargs->path ? strdup(ioargs->path) : NULL;
+    f->aid = ioargs->aidPtr ? strdup(ioargs->aidPtr) : NULL;
+    if (f->response == NULL || (ioargs->path && f->path == NULL) ||
+        (ioargs->aidPtr && f->aid == NULL))
+        goto error;
+
+    if (f->structure == EF_TYPE_LINEAR_FIXED && f->recordSize > 0) {
+        f->numRecords = f->fileSize / f->recordSize;
+        f->records = calloc(f->numRecords, sizeof(char *));
+        if (f->records == NULL)
+            goto error;
+    }
+
+    f->next = s_simCache;
+    s_simCache = f;
+    s_simCacheFiles++;
+    return f;
+
+error:
+    simCacheFreeFile(f);
+    return NULL;
+}
+
+/** Assumes s_simCacheMutex is held. */
+static void simCacheSetRecord(struct simCacheFile *f, int record,
+                              const char *data)
+{
+    if (f->records == NULL || record < 1 || record > f->numRecords ||
+        data == NULL || strlen(data) != (size_t) f->recordSize * 2)
+        return;
+
+    free(f->records[record - 1]);
+    f->records[record - 1] = strdup(data);
+}
+
+/**
+ * Keep the successful answer to a request sent to the card, unless the
+ * cache was invalidated since gen was read.
+ */
+static void simCacheWrite(const RIL_SIM_IO_v6 *ioargs,
+                          const RIL_SIM_IO_Response *sr, unsigned int gen)
+{
+    struct simCacheFile *f;
+    int offset, length;
+
+    pthread_mutex_lock(&s_simCacheMutex);
+    s_simCacheCommands++;
+
+    if (sr->sw1 != 0x90 || sr->sw2 != 0x00 || gen != s_simCacheGeneration)
+        goto finally;
+
+    if (ioargs->command == SIM_CMD_GET_RESPONSE) {
+        simCacheAdd(ioargs, sr->simResponse);
+        goto finally;
+    }
+
+    f = simCacheFind(ioargs);
+    if (f == NULL)
+        goto finally;
+
+    switch (ioargs->command) {
+    case SIM_CMD_READ_RECORD:
+        if (ioargs->p2 == SIM_RECORD_ABSOLUTE)
+            simCacheSetRecord(f, ioargs->p1, sr->simResponse);
+        break;
+
+    case SIM_CMD_UPDATE_RECORD:
+        if (ioargs->p2 == SIM_RECORD_ABSOLUTE)
+            simCacheSetRecord(f, ioargs->p1, ioargs->data);
+        else /* Cyclic and relative updates move the records. */
+            simCacheClearRecords(f);
+        break;
+
+    case SIM_CMD_READ_BINARY:
+        offset = (ioargs->p1 << 8) | ioargs->p2;
+        if (offset == 0 && f->binary == NULL && sr->simResponse != NULL &&
+            strlen(sr->simResponse) == (size_t) f->fileSize * 2)
+            f->binary = strdup(sr->simResponse);
+        break;
+
+    case SIM_CMD_UPDATE_BINARY:
+        offset = (ioargs->p1 << 8) | ioargs->p2;
+        length = ioargs->p3 ? ioargs->p3 : 256;
+        if (f->binary == NULL)
+            break;
+        if (ioargs->data != NULL && offset + length <= f->fileSize &&
+            strlen(ioargs->data) == (size_t) length * 2)
+            memcpy(&f->binary[offset * 2], ioargs->data, length * 2);
+        else {
+            free(f->binary);
+            f->binary = NULL;
+        }
+        break;
+    }
+
+finally:
+    pthread_mutex_unlock(&s_simCacheMutex);
+}
+
+static unsigned int simCacheGeneration(void)
+{
+    unsigned int gen;
+
+    pthread_mutex_lock(&s_simCacheMutex);
+    gen = s_simCacheGeneration;
+    pthread_mutex_unlock(&s_simCacheMutex);
+
+    return gen;
+}
+
+/**
+ * Read the records of a linear fixed file not yet in the cache, after
+ * the framework has read one of them. The records are read with up to
+ * SIM_READ_AHEAD_RECORDS chained +CRSM commands per command line, a
+ * failing read ends the read ahead and leaves the rest to the framework.
+ */
+static void simCacheReadAhead(const RIL_SIM_IO_v6 *ioargs, unsigned int gen)
+{
+    struct simCacheFile *f;
+    ATResponse *atresponse = NULL;
+    ATLine *cursor;
+    char line[400];
+    char cmd[64];
+    int records[SIM_READ_AHEAD_RECORDS];
+    int count, next = 1;
+    int recordSize;
+    int sw1, sw2;
+    int err, i;
+    size_t len;
+    char *tok, *data;
+
+    if (ioargs->command != SIM_CMD_READ_RECORD ||
+        ioargs->p2 != SIM_RECORD_ABSOLUTE)
+        return;
+
+    for (;;) {
+        /* Pick the next records that are not cached. */
+        pthread_mutex_lock(&s_simCacheMutex);
+        f = simCacheFind(ioargs);
+        if (gen != s_simCacheGeneration || f == NULL || f->records == NULL ||
+            (next == 1 && f->readAhead)) {
+            pthread_mutex_unlock(&s_simCacheMutex);
+            break;
+        }
+        f->readAhead = 1;
+        recordSize = f->recordSize;
+
+        for (count = 0; next <= f->numRecords &&
+             count < SIM_READ_AHEAD_RECORDS; next++)
+            if (f->records[next - 1] == NULL)
+                records[count++] = next;
+        pthread_mutex_unlock(&s_simCacheMutex);
+
+        if (count == 0)
+            break;
+
+        for (i = 0, len = 0; i < count; i++) {
+            if (ioargs->path != NULL)
+                snprintf(cmd, sizeof(cmd), "%s+CRSM=%d,%d,%d,%d,%d,,\"%s\"",
+                         i ? ";" : "AT", SIM_CMD_READ_RECORD, ioargs->fileid,
+                         records[i], SIM_RECORD_ABSOLUTE, recordSize,
+                         ioargs->path);
+            else
+                snprintf(cmd, sizeof(cmd), "%s+CRSM=%d,%d,%d,%d,%d",
+                         i ? ";" : "AT", SIM_CMD_READ_RECORD, ioargs->fileid,
+                         records[i], SIM_RECORD_ABSOLUTE, recordSize);
+
+            if (len + strlen(cmd) >= sizeof(line)) {
+                /* Read on the next line. */
+                next = records[i];
+                count = i;
+                break;
+            }
+            strcpy(&line[len], cmd);
+            len += strlen(cmd);
+        }
+
+        err = at_send_command_multiline("%s", "+CRSM:", &atresponse, line);
+
+        pthread_mutex_lock(&s_simCacheMutex);
+        s_simCacheCommands++;
+        if (err != AT_NOERROR) {
+            pthread_mutex_unlock(&s_simCacheMutex);
+            break;
+        }
+        f = gen == s_simCacheGeneration ? simCacheFind(ioargs) : NULL;
+
+        for (i = 0, cursor = atresponse->p_intermediates;
+             f != NULL && i < count && cursor != NULL;
+             i++, cursor = cursor->p_next) {
+            tok = cursor->line;
+            if (at_tok_start(&tok) < 0 ||
+                at_tok_nextint(&tok, &sw1) < 0 ||
+                at_tok_nextint(&tok, &sw2) < 0 ||
+                at_tok_nextstr(&tok, &data) < 0)
+                break;
+            if (sw1 == 0x90 && sw2 == 0x00)
+                simCacheSetRecord(f, records[i], data);
+        }
+        pthread_mutex_unlock(&s_simCacheMutex);
+
+        at_response_free(atresponse);
+        atresponse = NULL;
+    }
+
+    at_response_free(atresponse);
+}
 
 /**
  * RIL_REQUEST_SIM_IO
@@ -1155,6 +1576,7 @@ void requestSIM_IO(void *data, size_t datalen, RIL_Token t)
     RIL_SIM_IO_Response sr;
     int cvt_done = 0;
     int err;
+    unsigned int gen;
     UICC_Type UiccType = getUICCType();
 
     int pathReplaced = 0;
@@ -1199,6 +1621,13 @@ void requestSIM_IO(void *data, size_t datalen, RIL_Token t)
 
     memset(&sr, 0, sizeof(sr));
 
+    if (simCacheRead(&ioargsDup, &sr)) {
+        cvt_done = 1; /* sr.simResponse needs to be freed */
+        RIL_onRequestComplete(t, RIL_E_SUCCESS, &sr, sizeof(sr));
+        goto finally;
+    }
+
+    gen = simCacheGeneration();
     err = sendSimIOCmd(&ioargsDup, &atresponse, &sr);
 
     if (err < 0)
@@ -1215,8 +1644,13 @@ void requestSIM_IO(void *data, size_t datalen, RIL_Token t)
         cvt_done = 1; /* sr.simResponse needs to be freed */
     }
 
+    simCacheWrite(&ioargsDup, &sr, gen);
+
     RIL_onRequestComplete(t, RIL_E_SUCCESS, &sr, sizeof(sr));
 
+    if (sr.sw1 == 0x90 && sr.sw2 == 0x00)
+        simCacheReadAhead(&ioargsDup, gen);
+
 finally:
     at_response_free(atresponse);
     if (cvt_done)
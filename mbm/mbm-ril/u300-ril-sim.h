@@ -30,6 +30,9 @@ void set_pending_hotswap(int pending_hotswap);
 void onSimStateChanged(const char *s);
 void onSimHotswap(const char *s);
 
+void invalidateSimCache(void);
+void invalidateSimCacheFile(int fileid);
+
 void requestGetSimStatus(void *data, size_t datalen, RIL_Token t);
 void requestSIM_IO(void *data, size_t datalen, RIL_Token t);
 void requestEnterSimPin(void *data, size_t datalen, RIL_Token t, int request);
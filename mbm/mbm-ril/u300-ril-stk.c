@@ -29,6 +29,7 @@
 #include "misc.h"
 #include <telephony/ril.h>
 #include "u300-ril.h"
+#include "u300-ril-sim.h"
 
 #define LOG_TAG "RILV"
 #include <utils/Log.h>
@@ -583,6 +584,12 @@ static void sendSimRefresh(struct tlv *tlvRefreshCmd, char *end)
         break;
     }
 
+    /* Before the framework rereads the files. */
+    if (response[0] == SIM_FILE_UPDATE)
+        invalidateSimCacheFile(response[1]);
+    else
+        invalidateSimCache();
+
     RIL_onUnsolicitedResponse(RIL_UNSOL_SIM_REFRESH, response, sizeof(response));
 
     if (response[0] != SIM_RESET) {
@@ -31,16 +31,19 @@
 #include <fcntl.h>
 #include <pthread.h>
 #include <alloca.h>
+#include <malloc.h>
 #include <getopt.h>
 #include <sys/socket.h>
 #include <cutils/sockets.h>
 #include <termios.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <cutils/properties.h>
 
 #include "atchannel.h"
 #include "at_tok.h"
 #include "misc.h"
+#include "prefix_table.h"
 
 #include "u300-ril.h"
 #include "u300-ril-config.h"
@@ -53,6 +56,9 @@
 #include "u300-ril-error.h"
 #include "u300-ril-stk.h"
 #include "u300-ril-device.h"
+#ifdef RIL_FAKE_MODEM
+#include "u300-ril-fakemodem.h"
+#endif
 
 #define LOG_TAG "RIL"
 #include <utils/Log.h>
@@ -116,37 +122,74 @@ typedef struct RILRequest {
     struct RILRequest *next;
 } RILRequest;
 
+#ifdef RIL_REQUEST_STATS
+#define REQUEST_STATS_MAX 128
+#define REQUEST_STATS_PERIOD_MSEC (60 * 1000)
+
+struct requestStats {
+    int count;
+    int commands;
+    long long wallUsec;
+    long long maxWallUsec;
+    long long cpuUsec;
+    long long heapBytes;
+};
+
+static pthread_mutex_t s_requestStatsMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct requestStats s_requestStats[REQUEST_STATS_MAX];
+static long long s_requestStatsStart;
+#endif
+
+#define EVENT_HASH_SIZE 64
+#define EVENT_POOL_GROW 32
+
+/*
+ * A pending timed event. The events of a queue are kept in a binary heap,
+ * earliest first and in enqueue order for equal times, and hashed by
+ * callback and param so that pending ones are found without a walk.
+ */
 typedef struct RILEvent {
     void (*eventCallback) (void *param);
     void *param;
     struct timespec abstime;
-    struct RILEvent *next;
-    struct RILEvent *prev;
+    unsigned int seq;
+    int index;                  /* Position in the heap. */
+    struct RILEvent *next;      /* Hash chain, or free list when unused. */
 } RILEvent;
 
 typedef struct RequestQueue {
     pthread_mutex_t queueMutex;
     pthread_cond_t cond;
     RILRequest *requestList;
-    RILEvent *eventList;
+    RILRequest *requestTail;
+    RILEvent **eventHeap;
+    int eventCount;
+    int eventCapacity;
+    unsigned int eventSeq;
+    RILEvent *eventHash[EVENT_HASH_SIZE];
+    RILEvent *eventFree;        /* Nodes are never given back to malloc. */
     char enabled;
     char closed;
 } RequestQueue;
 
 static RequestQueue s_requestQueue = {
     .queueMutex = PTHREAD_MUTEX_INITIALIZER,
-    .cond = PTHREAD_COND_INITIALIZER,
     .requestList = NULL,
-    .eventList = NULL,
+    .requestTail = NULL,
+    .eventHeap = NULL,
+    .eventCount = 0,
+    .eventFree = NULL,
     .enabled = 1,
     .closed = 1
 };
 
 static RequestQueue s_requestQueuePrio = {
     .queueMutex = PTHREAD_MUTEX_INITIALIZER,
-    .cond = PTHREAD_COND_INITIALIZER,
     .requestList = NULL,
-    .eventList = NULL,
+    .requestTail = NULL,
+    .eventHeap = NULL,
+    .eventCount = 0,
+    .eventFree = NULL,
     .enabled = 0,
     .closed = 1
 };
@@ -156,42 +199,211 @@ static RequestQueue *s_requestQueues[] = {
     &s_requestQueuePrio
 };
 
+static pthread_once_t s_queueCondOnce = PTHREAD_ONCE_INIT;
+
+/* The conds time out on the CLOCK_MONOTONIC abstimes of the events. */
+static void makeQueueConds(void)
+{
+    pthread_condattr_t attr;
+    unsigned int i;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    for (i = 0; i < (sizeof(s_requestQueues) / sizeof(RequestQueue *)); i++)
+        pthread_cond_init(&s_requestQueues[i]->cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static pthread_cond_t *queueCond(RequestQueue *q)
+{
+    (void) pthread_once(&s_queueCondOnce, makeQueueConds);
+    return &q->cond;
+}
+
 static const struct timespec TIMEVAL_0 = { 0, 0 };
 
+/* The event helpers below assume queueMutex is held. */
+
+static int eventBefore(const RILEvent *a, const RILEvent *b)
+{
+    if (a->abstime.tv_sec != b->abstime.tv_sec ||
+        a->abstime.tv_nsec != b->abstime.tv_nsec)
+        return timespec_cmp(a->abstime, b->abstime, < );
+
+    return (int) (a->seq - b->seq) < 0;
+}
+
+static void eventHeapSet(RequestQueue *q, int i, RILEvent *e)
+{
+    q->eventHeap[i] = e;
+    e->index = i;
+}
+
+static void eventHeapUp(RequestQueue *q, int i)
+{
+    RILEvent *e = q->eventHeap[i];
+
+    while (i > 0 && eventBefore(e, q->eventHeap[(i - 1) / 2])) {
+        eventHeapSet(q, i, q->eventHeap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    eventHeapSet(q, i, e);
+}
+
+static void eventHeapDown(RequestQueue *q, int i)
+{
+    RILEvent *e = q->eventHeap[i];
+    int child;
+
+    while ((child = 2 * i + 1) < q->eventCount) {
+        if (child + 1 < q->eventCount &&
+            eventBefore(q->eventHeap[child + 1], q->eventHeap[child]))
+            child++;
+        if (!eventBefore(q->eventHeap[child], e))
+            break;
+        eventHeapSet(q, i, q->eventHeap[child]);
+        i = child;
+    }
+    eventHeapSet(q, i, e);
+}
+
+static unsigned int eventHash(void (*callback) (void *param), void *param)
+{
+    uintptr_t h = (uintptr_t) callback ^ ((uintptr_t) param * 31);
+
+    return (unsigned int) ((h >> 2) ^ (h >> 9)) % EVENT_HASH_SIZE;
+}
+
+static RILEvent *findEvent(RequestQueue *q, void (*callback) (void *param),
+                           void *param)
+{
+    RILEvent *e = q->eventHash[eventHash(callback, param)];
+
+    while (e != NULL &&
+           (e->eventCallback != callback || e->param != param))
+        e = e->next;
+
+    return e;
+}
+
+static RILEvent *allocEvent(RequestQueue *q)
+{
+    RILEvent *e;
+    int i;
+
+    if (q->eventCount == q->eventCapacity) {
+        int capacity = q->eventCapacity ? 2 * q->eventCapacity
+                                        : EVENT_POOL_GROW;
+        RILEvent **heap = realloc(q->eventHeap, capacity * sizeof(*heap));
+
+        if (heap == NULL)
+            return NULL;
+        q->eventHeap = heap;
+        q->eventCapacity = capacity;
+    }
+
+    if (q->eventFree == NULL) {
+        e = malloc(EVENT_POOL_GROW * sizeof(RILEvent));
+        if (e == NULL)
+            return NULL;
+        for (i = 0; i < EVENT_POOL_GROW; i++) {
+            e[i].next = q->eventFree;
+            q->eventFree = &e[i];
+        }
+    }
+
+    e = q->eventFree;
+    q->eventFree = e->next;
+
+    return e;
+}
+
+/** Take an event off the heap and the hash and give it back to the pool. */
+static void removeEvent(RequestQueue *q, RILEvent *e)
+{
+    RILEvent **pp = &q->eventHash[eventHash(e->eventCallback, e->param)];
+    RILEvent *last;
+    int i = e->index;
+
+    while (*pp != e)
+        pp = &(*pp)->next;
+    *pp = e->next;
+
+    last = q->eventHeap[--q->eventCount];
+    if (last != e) {
+        eventHeapSet(q, i, last);
+        if (i > 0 && eventBefore(last, q->eventHeap[(i - 1) / 2]))
+            eventHeapUp(q, i);
+        else
+            eventHeapDown(q, i);
+    }
+
+    e->next = q->eventFree;
+    q->eventFree = e;
+}
+
 /**
- * Enqueue a RILEvent to the request queue. isPrio specifies in what queue
- * the request will end up.
- *
- * 0 = the "normal" queue, 1 = prio queue and 2 = both. If only one queue
- * is present, then the event will be inserted into that queue.
+ * Schedule callback(param) on q at abstime. With once, a pending event
+ * with the same callback and param is kept instead, moved to abstime if
+ * that is earlier. Returns 1 if the earliest event of q changed.
  */
-void enqueueRILEvent(int isPrio, void (*callback) (void *param),
-                     void *param, const struct timespec *relativeTime)
+static int scheduleEvent(RequestQueue *q, void (*callback) (void *param),
+                         void *param, const struct timespec *abstime,
+                         int once)
 {
-    int err;
-    struct timespec ts;
-    char done = 0;
-    RequestQueue *q = NULL;
+    RILEvent *e = once ? findEvent(q, callback, param) : NULL;
+    unsigned int h;
+
+    if (e != NULL) {
+        if (!timespec_cmp(*abstime, e->abstime, < ))
+            return 0;
+        e->abstime = *abstime;
+        eventHeapUp(q, e->index);
+        return e->index == 0;
+    }
 
-    RILEvent *e = malloc(sizeof(RILEvent));
-    memset(e, 0, sizeof(RILEvent));
+    e = allocEvent(q);
+    if (e == NULL) {
+        LOGE("%s() failed to allocate event!", __func__);
+        return 0;
+    }
 
     e->eventCallback = callback;
     e->param = param;
+    e->abstime = *abstime;
+    e->seq = q->eventSeq++;
 
-    if (relativeTime == NULL) {
-        relativeTime = alloca(sizeof(struct timeval));
-        memset((struct timeval *) relativeTime, 0, sizeof(struct timeval));
-    }
+    h = eventHash(callback, param);
+    e->next = q->eventHash[h];
+    q->eventHash[h] = e;
+
+    eventHeapSet(q, q->eventCount++, e);
+    eventHeapUp(q, e->index);
+
+    return e->index == 0;
+}
+
+static void queueRILEvent(int isPrio, void (*callback) (void *param),
+                          void *param, const struct timespec *relativeTime,
+                          int once)
+{
+    int err;
+    struct timespec ts;
+    struct timespec abstime;
+    char done = 0;
+    RequestQueue *q = NULL;
+
+    if (relativeTime == NULL)
+        relativeTime = &TIMEVAL_0;
 
     clock_gettime(CLOCK_MONOTONIC, &ts);
 
-    e->abstime.tv_sec = ts.tv_sec + relativeTime->tv_sec;
-    e->abstime.tv_nsec = ts.tv_nsec + relativeTime->tv_nsec;
+    abstime.tv_sec = ts.tv_sec + relativeTime->tv_sec;
+    abstime.tv_nsec = ts.tv_nsec + relativeTime->tv_nsec;
 
-    if (e->abstime.tv_nsec > 1000000000) {
-        e->abstime.tv_sec++;
-        e->abstime.tv_nsec -= 1000000000;
+    if (abstime.tv_nsec >= 1000000000) {
+        abstime.tv_sec++;
+        abstime.tv_nsec -= 1000000000;
     }
 
     if (!s_requestQueuePrio.enabled ||
@@ -204,34 +416,10 @@ again:
     if ((err = pthread_mutex_lock(&q->queueMutex)) != 0)
         LOGE("%s() failed to take queue mutex: %s!", __func__, strerror(err));
 
-    if (q->eventList == NULL)
-        q->eventList = e;
-    else {
-        if (timespec_cmp(q->eventList->abstime, e->abstime, > )) {
-            e->next = q->eventList;
-            q->eventList->prev = e;
-            q->eventList = e;
-        } else {
-            RILEvent *tmp = q->eventList;
-            do {
-                if (timespec_cmp(tmp->abstime, e->abstime, > )) {
-                    tmp->prev->next = e;
-                    e->prev = tmp->prev;
-                    tmp->prev = e;
-                    e->next = tmp;
-                    break;
-                } else if (tmp->next == NULL) {
-                    tmp->next = e;
-                    e->prev = tmp;
-                    break;
-                }
-                tmp = tmp->next;
-            } while (tmp);
-        }
-    }
-
-    if ((err = pthread_cond_broadcast(&q->cond)) != 0)
-        LOGE("%s() failed to take broadcast queue update: %s!",
+    /* A single queueRunner waits, and only for the earliest event. */
+    if (scheduleEvent(q, callback, param, &abstime, once) &&
+        (err = pthread_cond_signal(queueCond(q))) != 0)
+        LOGE("%s() failed to signal queue update: %s!",
             __func__, strerror(err));
 
     if ((err = pthread_mutex_unlock(&q->queueMutex)) != 0)
@@ -239,9 +427,6 @@ again:
             __func__, strerror(err));
 
     if (s_requestQueuePrio.enabled && isPrio == RIL_EVENT_QUEUE_ALL && !done) {
-        RILEvent *e2 = malloc(sizeof(RILEvent));
-        memcpy(e2, e, sizeof(RILEvent));
-        e = e2;
         done = 1;
         q = &s_requestQueuePrio;
 
@@ -249,6 +434,57 @@ again:
     }
 }
 
+/**
+ * Enqueue a RILEvent to the request queue. isPrio specifies in what queue
+ * the request will end up.
+ *
+ * 0 = the "normal" queue, 1 = prio queue and 2 = both. If only one queue
+ * is present, then the event will be inserted into that queue.
+ */
+void enqueueRILEvent(int isPrio, void (*callback) (void *param),
+                     void *param, const struct timespec *relativeTime)
+{
+    queueRILEvent(isPrio, callback, param, relativeTime, 0);
+}
+
+/**
+ * As enqueueRILEvent(), but an event with the same callback and param
+ * still pending in the queue is not added twice, it runs once at the
+ * earlier of the two times. For pollers, where one run answers all the
+ * triggers that came before it.
+ */
+void enqueueRILEventOnce(int isPrio, void (*callback) (void *param),
+                         void *param, const struct timespec *relativeTime)
+{
+    queueRILEvent(isPrio, callback, param, relativeTime, 1);
+}
+
+/**
+ * Cancel the pending events of callback(param), eg a periodic poller that
+ * rescheduled itself, in every queue.
+ */
+void dequeueRILEvent(void (*callback) (void *param), void *param)
+{
+    unsigned int i;
+    int err;
+
+    for (i = 0; i < (sizeof(s_requestQueues) / sizeof(RequestQueue *)); i++) {
+        RequestQueue *q = s_requestQueues[i];
+        RILEvent *e;
+
+        if ((err = pthread_mutex_lock(&q->queueMutex)) != 0)
+            LOGE("%s() failed to take queue mutex: %s!",
+                __func__, strerror(err));
+
+        while ((e = findEvent(q, callback, param)) != NULL)
+            removeEvent(q, e);
+
+        if ((err = pthread_mutex_unlock(&q->queueMutex)) != 0)
+            LOGE("%s() failed to release queue mutex: %s!",
+                __func__, strerror(err));
+    }
+}
+
 /**
  * Will LOCK THE MUTEX! MAKE SURE TO RELEASE IT!
  */
@@ -289,11 +525,14 @@ static void requestScreenState(void *data, size_t datalen, RIL_Token t)
 
     getScreenStateLock();
 
-    if (datalen < sizeof(int *))
+    if (datalen < sizeof(int))
         goto error;
 
     screenState = s_screenState = ((int *) data)[0];
 
+    /* Registration reports start or stop, and with them the cache ages. */
+    invalidateNetworkCache();
+
     if (screenState == 1) {
         /* Screen is on - be sure to enable all unsolicited notifications again. */
         err = at_send_command("AT+CREG=2");
@@ -635,19 +874,14 @@ static void onRequest(int request, void *data, size_t datalen, RIL_Token t)
     if ((err = pthread_mutex_lock(&q->queueMutex)) != 0)
         LOGE("%s() failed to take queue mutex: %s!", __func__, strerror(err));
 
-    /* Queue empty, just throw r on top. */
-    if (q->requestList == NULL)
+    if (q->requestTail == NULL)
         q->requestList = r;
-    else {
-        RILRequest *l = q->requestList;
-        while (l->next != NULL)
-            l = l->next;
-
-        l->next = r;
-    }
+    else
+        q->requestTail->next = r;
+    q->requestTail = r;
 
-    if ((err = pthread_cond_broadcast(&q->cond)) != 0)
-        LOGE("%s() failed to broadcast queue update: %s!",
+    if ((err = pthread_cond_signal(queueCond(q))) != 0)
+        LOGE("%s() failed to signal queue update: %s!",
             __func__, strerror(err));
 
     if ((err = pthread_mutex_unlock(&q->queueMutex)) != 0)
@@ -844,6 +1078,117 @@ static char initializePrioChannel(void)
     return 0;
 }
 
+/* Unsolicited handlers, the prefix table maps a line to its handler. */
+struct unsolicitedHandler {
+    void (*handler)(const char *s);
+    int takesPdu;   /* Handler is given the PDU following the line. */
+};
+
+static struct prefixTable s_unsolicitedPrefixes;
+static struct unsolicitedHandler s_unsolicitedHandlers[PREFIX_TABLE_MAX];
+
+static int addUnsolicitedHandler(const char *prefix,
+                                 void (*handler)(const char *s), int takesPdu)
+{
+    int index = s_unsolicitedPrefixes.count;
+    int err;
+
+    err = prefixTableAdd(&s_unsolicitedPrefixes, prefix, index, NULL);
+    if (err < 0) {
+        LOGE("%s() failed to register handler for %s: %s", __func__, prefix,
+             strerror(-err));
+        return err;
+    }
+
+    s_unsolicitedHandlers[index].handler = handler;
+    s_unsolicitedHandlers[index].takesPdu = takesPdu;
+    return 0;
+}
+
+/**
+ * Register handler for the unsolicited lines starting with prefix, it is
+ * called on the reader thread with the line. The longest matching prefix
+ * wins. Handlers are registered before the AT channels are opened.
+ */
+int registerUnsolicitedHandler(const char *prefix,
+                               void (*handler)(const char *s))
+{
+    return addUnsolicitedHandler(prefix, handler, 0);
+}
+
+/**
+ * Register handler for a two-line SMS unsolicited response, it is called
+ * with the PDU of the second line instead.
+ */
+int registerSmsUnsolicitedHandler(const char *prefix,
+                                  void (*handler)(const char *sms_pdu))
+{
+    return addUnsolicitedHandler(prefix, handler, 1);
+}
+
+static void onNitzReceived(const char *s)
+{
+    /* If we're in screen state, we have disabled CREG, but the ETZV
+       will catch those few cases. So we send network state changed as
+       well on NITZ. */
+    RIL_onUnsolicitedResponse(RIL_UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED,
+                              NULL, 0);
+
+    onNetworkTimeReceived(s);
+}
+
+static void onPinEvent(const char *s)
+{
+    (void) s;
+
+    /* Pin event, poll SIM State! */
+    enqueueRILEventOnce(RIL_EVENT_QUEUE_PRIO, pollSIMState, NULL, NULL);
+}
+
+static void onRegistrationChanged(const char *s)
+{
+    (void) s;
+
+/*TODO: If only reporting back network change Android can sometimes hang!! */
+    RIL_onUnsolicitedResponse(RIL_UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED,
+                              NULL, 0);
+}
+
+static void onSmsIndication(const char *s)
+{
+    (void) s;
+
+    onNewSmsIndication();
+}
+
+static void onStkSessionEnd(const char *s)
+{
+    (void) s;
+
+    RIL_onUnsolicitedResponse(RIL_UNSOL_STK_SESSION_END, NULL, 0);
+}
+
+static void registerUnsolicitedHandlers(void)
+{
+    registerUnsolicitedHandler("*ETZV:", onNitzReceived);
+    registerUnsolicitedHandler("*EPEV", onPinEvent);
+    registerUnsolicitedHandler("*ESIMSR", onSimStateChanged);
+    registerUnsolicitedHandler("*E2NAP:", onConnectionStateChanged);
+    registerUnsolicitedHandler("*E2REG:", onNetworkStatusChanged);
+    registerUnsolicitedHandler("*EESIMSWAP:", onSimHotswap);
+    registerUnsolicitedHandler("+CREG:", onRegistrationChanged);
+    registerUnsolicitedHandler("+CGREG:", onRegistrationChanged);
+    registerSmsUnsolicitedHandler("+CMT:", onNewSms);
+    registerSmsUnsolicitedHandler("+CBM:", onNewBroadcastSms);
+    registerUnsolicitedHandler("+CMTI:", onNewSmsOnSIM);
+    registerSmsUnsolicitedHandler("+CDS:", onNewStatusReport);
+    registerUnsolicitedHandler("+CIEV: 2", onSignalStrengthChanged);
+    registerUnsolicitedHandler("+CIEV: 7", onSmsIndication);
+    registerUnsolicitedHandler("*STKEND", onStkSessionEnd);
+    registerUnsolicitedHandler("*STKI:", onStkProactiveCommand);
+    registerUnsolicitedHandler("*STKN:", onStkEventNotify);
+}
+
 /**
  * Called by atchannel when an unsolicited line appears.
  * This is called on atchannel's reader thread. AT commands may
@@ -851,54 +1196,22 @@ static char initializePrioChannel(void)
  */
 static void onUnsolicited(const char *s, const char *sms_pdu)
 {
+    const struct prefixEntry *e;
+    const struct unsolicitedHandler *h;
+
     /* Ignore unsolicited responses until we're initialized.
        This is OK because the RIL library will poll for initial state. */
     if (getRadioState() == RADIO_STATE_UNAVAILABLE)
         return;
 
-    if (strStartsWith(s, "*ETZV:")) {
-        /* If we're in screen state, we have disabled CREG, but the ETZV
-           will catch those few cases. So we send network state changed as
-           well on NITZ. */
-        RIL_onUnsolicitedResponse(RIL_UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED,
-                                  NULL, 0);
-
-        onNetworkTimeReceived(s);
-    } else if (strStartsWith(s, "*EPEV")) {
-        /* Pin event, poll SIM State! */
-        enqueueRILEvent(RIL_EVENT_QUEUE_PRIO, pollSIMState, NULL, NULL);
-    } else if (strStartsWith(s, "*ESIMSR"))
-        onSimStateChanged(s);
-    else if(strStartsWith(s, "*E2NAP:"))
-        onConnectionStateChanged(s);
-    else if(strStartsWith(s, "*E2REG:"))
-        onNetworkStatusChanged(s);
-    else if (strStartsWith(s, "*EESIMSWAP:"))
-        onSimHotswap(s);
-    else if (strStartsWith(s, "+CREG:")
-            || strStartsWith(s, "+CGREG:")) {
-/*TODO: If only reporting back network change Android can sometimes hang!! */
-        RIL_onUnsolicitedResponse(RIL_UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED,
-                                  NULL, 0);
-    }
-    else if (strStartsWith(s, "+CMT:"))
-        onNewSms(sms_pdu);
-    else if (strStartsWith(s, "+CBM:"))
-        onNewBroadcastSms(sms_pdu);
-    else if (strStartsWith(s, "+CMTI:"))
-        onNewSmsOnSIM(s);
-    else if (strStartsWith(s, "+CDS:"))
-        onNewStatusReport(sms_pdu);
-    else if (strStartsWith(s, "+CIEV: 2"))
-        onSignalStrengthChanged(s);
-    else if (strStartsWith(s, "+CIEV: 7"))
-        onNewSmsIndication();
-    else if (strStartsWith(s, "*STKEND"))
-        RIL_onUnsolicitedResponse(RIL_UNSOL_STK_SESSION_END, NULL, 0);
-    else if (strStartsWith(s, "*STKI:"))
-        onStkProactiveCommand(s);
-    else if (strStartsWith(s, "*STKN:"))
-        onStkEventNotify(s);
+    onNetworkStateUnsolicited(s);
+
+    e = prefixTableMatch(&s_unsolicitedPrefixes, s);
+    if (e == NULL)
+        return;
+
+    h = &s_unsolicitedHandlers[e->value];
+    h->handler(h->takesPdu ? sms_pdu : s);
 }
 
 static void signalCloseQueues(void)
@@ -912,7 +1225,7 @@ static void signalCloseQueues(void)
                 __func__, strerror(err));
 
         q->closed = 1;
-        if ((err = pthread_cond_signal(&q->cond)) != 0)
+        if ((err = pthread_cond_signal(queueCond(q))) != 0)
             LOGE("%s() failed to broadcast queue update: %s",
                 __func__, strerror(err));
 
@@ -950,10 +1263,109 @@ static void onATTimeout(void)
 
 static void usage(char *s)
 {
+#ifdef RIL_FAKE_MODEM
+    fprintf(stderr, "usage: %s [-z] [-p <tcp port>] [-d /dev/tty_device|fake:<rules>] [-x /dev/tty_device|fake:<rules>] [-i <network interface>]\n", s);
+#else
     fprintf(stderr, "usage: %s [-z] [-p <tcp port>] [-d /dev/tty_device] [-x /dev/tty_device] [-i <network interface>]\n", s);
+#endif
     exit(-1);
 }
 
+#ifdef RIL_REQUEST_STATS
+static long long clockUsec(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Account a request handled on a queue thread: the time and CPU spent
+ * in processRequest(), the AT commands it sent and how much the heap in
+ * use grew meanwhile. The heap is that of the whole process, other
+ * threads allocate into it too. Requests completed later, from an event,
+ * are only accounted for their synchronous part.
+ * Reported every REQUEST_STATS_PERIOD_MSEC.
+ */
+static void recordRequestStats(int request, long long wallUsec,
+                               long long cpuUsec, int commands,
+                               long long heapBytes)
+{
+    struct requestStats *st;
+    long long now = clockUsec(CLOCK_MONOTONIC);
+    int i;
+    int err;
+
+    if (request < 0 || request >= REQUEST_STATS_MAX)
+        return;
+
+    if ((err = pthread_mutex_lock(&s_requestStatsMutex)) != 0)
+        LOGE("%s() failed to take request stats mutex: %s",
+             __func__, strerror(err));
+
+    st = &s_requestStats[request];
+    st->count++;
+    st->commands += commands > 0 ? commands : 0;
+    st->wallUsec += wallUsec;
+    st->cpuUsec += cpuUsec;
+    st->heapBytes += heapBytes;
+    if (wallUsec > st->maxWallUsec)
+        st->maxWallUsec = wallUsec;
+
+    if (s_requestStatsStart == 0)
+        s_requestStatsStart = now;
+
+    if (now - s_requestStatsStart >= REQUEST_STATS_PERIOD_MSEC * 1000LL) {
+        for (i = 0; i < REQUEST_STATS_MAX; i++) {
+            st = &s_requestStats[i];
+            if (st->count == 0)
+                continue;
+            LOGD("%s() %s: %d requests, %lld us avg, %lld us max, "
+                 "%lld us CPU avg, %d.%02d AT commands avg, "
+                 "%lld heap bytes avg", __func__,
+                 requestToString(i), st->count, st->wallUsec / st->count,
+                 st->maxWallUsec, st->cpuUsec / st->count,
+                 st->commands / st->count,
+                 (st->commands * 100 / st->count) % 100,
+                 st->heapBytes / st->count);
+        }
+        memset(s_requestStats, 0, sizeof(s_requestStats));
+        s_requestStatsStart = now;
+    }
+
+    if ((err = pthread_mutex_unlock(&s_requestStatsMutex)) != 0)
+        LOGE("%s() failed to release request stats mutex: %s",
+             __func__, strerror(err));
+}
+
+/* Bytes of heap in use by the whole process. */
+static long long heapInUse(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#else
+    return mallinfo().uordblks;
+#endif
+}
+
+/* Run processRequest() and account it. */
+static void processRequestStats(int request, void *data, size_t datalen,
+                                RIL_Token t)
+{
+    long long wall = clockUsec(CLOCK_MONOTONIC);
+    long long cpu = clockUsec(CLOCK_THREAD_CPUTIME_ID);
+    long long heap = heapInUse();
+    int commands = at_get_command_count();
+
+    processRequest(request, data, datalen, t);
+    recordRequestStats(request, clockUsec(CLOCK_MONOTONIC) - wall,
+                       clockUsec(CLOCK_THREAD_CPUTIME_ID) - cpu,
+                       at_get_command_count() - commands,
+                       heapInUse() - heap);
+}
+#endif
+
 struct queueArgs {
     int port;
     char * loophost;
@@ -962,22 +1374,6 @@ struct queueArgs {
     char hasPrio;
 };
 
-static int safe_read(int fd, char *buf, int count)
-{
-    int n;
-    int i = 0;
-
-    while (i < count) {
-        n = read(fd, buf + i, count - i);
-        if (n > 0)
-            i += n;
-        else if (!(n < 0 && errno == EINTR))
-            return -1;
-    }
-
-    return count;
-}
-
 static void *queueRunner(void *param)
 {
     int fd = -1;
@@ -1001,6 +1397,13 @@ static void *queueRunner(void *param)
                     fd = socket_network_client(queueArgs->loophost, queueArgs->port, SOCK_STREAM);
                 else
                     fd = socket_loopback_client(queueArgs->port, SOCK_STREAM);
+#ifdef RIL_FAKE_MODEM
+            } else if (queueArgs->device_path != NULL
+                       && strStartsWith(queueArgs->device_path,
+                                        FAKE_MODEM_PREFIX)) {
+                fd = fakeModemOpen(queueArgs->device_path
+                                   + strlen(FAKE_MODEM_PREFIX));
+#endif
             } else if (queueArgs->device_path != NULL) {
                 /* Program is not controlling terminal -> O_NOCTTY */
                 /* Dont care about DCD -> O_NDELAY */
@@ -1058,7 +1461,11 @@ static void *queueRunner(void *param)
             LOGE("%s() timeout, go ahead anyway(might work)...", __func__);
         else {
             memset(start, 0, MAX_BUF);
-            safe_read(fd, start, MAX_BUF-1);
+            /* Whatever came with EMRDY, the modem says no more until
+               it is asked. */
+            do {
+                n = read(fd, start, MAX_BUF - 1);
+            } while (n < 0 && errno == EINTR);
 
             if (start == NULL) {
                 LOGD("%s() Eiii empty string", __func__);
@@ -1122,7 +1529,8 @@ static void *queueRunner(void *param)
         LOGE("%s() Looping the requestQueue!", __func__);
         for (;;) {
             RILRequest *r;
-            RILEvent *e;
+            void (*eventCallback) (void *param);
+            void *eventParam = NULL;
             struct timespec ts;
             int err;
 
@@ -1140,16 +1548,18 @@ static void *queueRunner(void *param)
             }
 
             while (q->closed == 0 && q->requestList == NULL &&
-                q->eventList == NULL) {
-                if ((err = pthread_cond_wait(&q->cond, &q->queueMutex)) != 0)
+                q->eventCount == 0) {
+                if ((err = pthread_cond_wait(queueCond(q), &q->queueMutex)) != 0)
                     LOGE("%s() failed broadcast queue cond: %s!",
                         __func__, strerror(err));
             }
 
-            /* eventList is prioritized, smallest abstime first. */
-            if (q->closed == 0 && q->requestList == NULL && q->eventList) {
-                int err = 0;
-                err = pthread_cond_timedwait(&q->cond, &q->queueMutex, &q->eventList->abstime);
+            /* eventHeap is prioritized, smallest abstime first. */
+            if (q->closed == 0 && q->requestList == NULL && q->eventCount) {
+                int err;
+
+                err = pthread_cond_timedwait(queueCond(q), &q->queueMutex,
+                                             &q->eventHeap[0]->abstime);
                 if (err && err != ETIMEDOUT)
                     LOGE("%s() timedwait returned unexpected error: %s",
 		        __func__, strerror(err));
@@ -1162,33 +1572,41 @@ static void *queueRunner(void *param)
                 continue; /* Catch the closed bit at the top of the loop. */
             }
 
-            e = NULL;
+            eventCallback = NULL;
             r = NULL;
 
             clock_gettime(CLOCK_MONOTONIC, &ts);
 
-            if (q->eventList != NULL &&
-                timespec_cmp(q->eventList->abstime, ts, < )) {
-                e = q->eventList;
-                q->eventList = e->next;
+            if (q->eventCount > 0 &&
+                !timespec_cmp(q->eventHeap[0]->abstime, ts, > )) {
+                RILEvent *e = q->eventHeap[0];
+
+                eventCallback = e->eventCallback;
+                eventParam = e->param;
+                removeEvent(q, e);
             }
 
             if (q->requestList != NULL) {
                 r = q->requestList;
                 q->requestList = r->next;
+                if (q->requestList == NULL)
+                    q->requestTail = NULL;
             }
 
             if ((err = pthread_mutex_unlock(&q->queueMutex)) != 0)
                 LOGE("%s(): Failed to release queue mutex: %s!",
                     __func__, strerror(err));
 
-            if (e) {
-                e->eventCallback(e->param);
-                free(e);
-            }
+            if (eventCallback)
+                eventCallback(eventParam);
 
             if (r) {
+#ifdef RIL_REQUEST_STATS
+                processRequestStats(r->request, r->data, r->datalen,
+                                    r->token);
+#else
                 processRequest(r->request, r->data, r->datalen, r->token);
+#endif
                 freeRequestData(r->request, r->data, r->datalen);
                 free(r);
             }
@@ -1270,6 +1688,8 @@ const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc,
     queueArgs->port = port;
     queueArgs->loophost = loophost;
 
+    registerUnsolicitedHandlers();
+
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
 
@@ -36,6 +36,14 @@ extern const struct RIL_Env *s_rilenv;
 
 void enqueueRILEvent(int isPrio, void (*callback) (void *param),
                      void *param, const struct timespec *relativeTime);
+void enqueueRILEventOnce(int isPrio, void (*callback) (void *param),
+                         void *param, const struct timespec *relativeTime);
+void dequeueRILEvent(void (*callback) (void *param), void *param);
+
+int registerUnsolicitedHandler(const char *prefix,
+                               void (*handler)(const char *s));
+int registerSmsUnsolicitedHandler(const char *prefix,
+                                  void (*handler)(const char *sms_pdu));
 
 #define RIL_EVENT_QUEUE_NORMAL 0
 #define RIL_EVENT_QUEUE_PRIO 1
@@ -0,0 +1,16 @@
+# The runner, CHECK() and allocation counter shared by the host built
+# tests of the modules, see host_test.h. A module's tests link
+# libhost_test and add this directory to their includes.
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libhost_test
+LOCAL_MODULE_TAGS := optional
+# the sensor tests are 32-bit only
+LOCAL_MULTILIB := both
+
+LOCAL_SRC_FILES := host_test.c
+LOCAL_SRC_FILES += alloc_count.c
+
+include $(BUILD_HOST_STATIC_LIBRARY)
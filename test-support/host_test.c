@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "host_test.h"
+
+static int s_failures;
+
+void host_test_fail(const char *file, int line, const char *what)
+{
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+    s_failures++;
+}
+
+long long host_test_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [--bench] [test ...]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    int bench = 0;
+    int failed = 0;
+    int first = 1;
+    size_t i;
+    int j;
+
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+        bench = 1;
+        first = 2;
+    } else if (argc > 1 && argv[1][0] == '-') {
+        usage(argv[0]);
+        return 2;
+    }
+
+    for (i = 0; i < host_test_count; i++) {
+        const struct host_test *t = &host_tests[i];
+        int selected = (first == argc);
+        int before = s_failures;
+
+        for (j = first; j < argc; j++)
+            if (!strcmp(argv[j], t->name))
+                selected = 1;
+        /* Benchmarks only run when asked for, by --bench or by name. */
+        if (!selected || (t->bench && !bench && first == argc))
+            continue;
+
+        printf("[ RUN  ] %s\n", t->name);
+        fflush(stdout);
+        t->run();
+        if (s_failures != before) {
+            printf("[ FAIL ] %s\n", t->name);
+            failed++;
+        } else {
+            printf("[  OK  ] %s\n", t->name);
+        }
+    }
+
+    printf("%d test(s) failed\n", failed);
+    return failed ? 1 : 0;
+}
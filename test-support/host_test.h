@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The runner of the host built tests and benchmarks, shared by the
+ * modules. A module lists its tests in host_tests[]; the runner's main()
+ * runs them, as
+ *   <module>_host_tests [--bench] [test ...]
+ * A test reports failures through CHECK() and keeps going; the runner
+ * counts them. Benchmarks only print their numbers and are run when
+ * --bench is given, or by name.
+ */
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond))                                                    \
+            host_test_fail(__FILE__, __LINE__, #cond);                  \
+    } while (0)
+
+struct host_test {
+    const char *name;
+    void (*run)(void);
+    int bench;
+};
+
+/* Defined by the module, run in this order. */
+extern const struct host_test host_tests[];
+extern const size_t host_test_count;
+
+void host_test_fail(const char *file, int line, const char *what);
+long long host_test_now_ns(void);
+/* Heap allocations so far, -1 when they are not counted. */
+long host_test_allocs(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_TEST_H */